@@ -0,0 +1,176 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "medusa/clock.h"
+#include "medusa/tcpsocket.h"
+#include "medusa/monitor.h"
+
+#include "benchmark.h"
+
+static int samples_compare (const void *a, const void *b)
+{
+        unsigned long long x = *(const unsigned long long *) a;
+        unsigned long long y = *(const unsigned long long *) b;
+        return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+static double samples_percentile (const unsigned long long *samples, unsigned long long nsamples, double percentile)
+{
+        unsigned long long index;
+        if (nsamples == 0) {
+                return 0;
+        }
+        index = (unsigned long long) ((percentile / 100.0) * nsamples + 0.5);
+        if (index > 0) {
+                index -= 1;
+        }
+        if (index >= nsamples) {
+                index = nsamples - 1;
+        }
+        return samples[index] / 1e3;
+}
+
+static void rusage_cpu (double *user, double *system)
+{
+        struct rusage rusage;
+        getrusage(RUSAGE_SELF, &rusage);
+        *user   = rusage.ru_utime.tv_sec + rusage.ru_utime.tv_usec / 1e6;
+        *system = rusage.ru_stime.tv_sec + rusage.ru_stime.tv_usec / 1e6;
+}
+
+static long rusage_rss (void)
+{
+        struct rusage rusage;
+        getrusage(RUSAGE_SELF, &rusage);
+#if defined(__APPLE__)
+        return rusage.ru_maxrss / 1024;
+#else
+        return rusage.ru_maxrss;
+#endif
+}
+
+unsigned long long benchmark_clock (void)
+{
+        struct timespec timespec;
+        medusa_clock_monotonic(&timespec);
+        return ((unsigned long long) timespec.tv_sec) * 1000000000ULL + timespec.tv_nsec;
+}
+
+int benchmark_init (struct benchmark *benchmark, const char *name, const char *params, ...)
+{
+        va_list ap;
+        memset(benchmark, 0, sizeof(struct benchmark));
+        snprintf(benchmark->name, sizeof(benchmark->name), "%s", name);
+        va_start(ap, params);
+        vsnprintf(benchmark->params, sizeof(benchmark->params), params, ap);
+        va_end(ap);
+        benchmark->ssamples = 4096;
+        benchmark->samples  = malloc(sizeof(unsigned long long) * benchmark->ssamples);
+        if (benchmark->samples == NULL) {
+                return -ENOMEM;
+        }
+        return 0;
+}
+
+void benchmark_uninit (struct benchmark *benchmark)
+{
+        free(benchmark->samples);
+        benchmark->samples = NULL;
+}
+
+int benchmark_start (struct benchmark *benchmark, struct medusa_monitor *monitor)
+{
+        int rc;
+        struct medusa_monitor_stats stats;
+        rc = medusa_monitor_get_stats(monitor, &stats);
+        if (rc < 0) {
+                return rc;
+        }
+        benchmark->monitor_stats = stats.enabled;
+        benchmark->iterations    = stats.iterations;
+        benchmark->changes       = stats.changes + stats.deletes;
+        rusage_cpu(&benchmark->cpu_user, &benchmark->cpu_system);
+        benchmark->started = benchmark_clock();
+        return 0;
+}
+
+int benchmark_stop (struct benchmark *benchmark, struct medusa_monitor *monitor)
+{
+        int rc;
+        double user;
+        double system;
+        struct medusa_monitor_stats stats;
+        benchmark->finished = benchmark_clock();
+        rusage_cpu(&user, &system);
+        benchmark->cpu_user   = user - benchmark->cpu_user;
+        benchmark->cpu_system = system - benchmark->cpu_system;
+        rc = medusa_monitor_get_stats(monitor, &stats);
+        if (rc < 0) {
+                return rc;
+        }
+        benchmark->iterations = stats.iterations - benchmark->iterations;
+        benchmark->changes    = stats.changes + stats.deletes - benchmark->changes;
+        return 0;
+}
+
+int benchmark_sample (struct benchmark *benchmark, unsigned long long latency)
+{
+        unsigned long long *samples;
+        if (benchmark->nsamples == benchmark->ssamples) {
+                samples = realloc(benchmark->samples, sizeof(unsigned long long) * benchmark->ssamples * 2);
+                if (samples == NULL) {
+                        return -ENOMEM;
+                }
+                benchmark->samples   = samples;
+                benchmark->ssamples *= 2;
+        }
+        benchmark->samples[benchmark->nsamples++] = latency;
+        return 0;
+}
+
+void benchmark_add_tcpsocket_stats (struct benchmark *benchmark, const struct medusa_tcpsocket_stats *stats)
+{
+        benchmark->recv_calls += stats->recv_calls;
+        benchmark->send_calls += stats->send_calls;
+}
+
+int benchmark_report (struct benchmark *benchmark)
+{
+        double duration;
+        duration = (benchmark->finished - benchmark->started) / 1e9;
+        if (duration <= 0) {
+                return -EINVAL;
+        }
+        qsort(benchmark->samples, benchmark->nsamples, sizeof(unsigned long long), samples_compare);
+        fprintf(stdout, "{\"name\": \"%s\", \"params\": {%s}, ", benchmark->name, benchmark->params);
+        fprintf(stdout, "\"operations\": %llu, \"bytes\": %llu, \"errors\": %llu, \"duration\": %.6f, ",
+                benchmark->operations, benchmark->bytes, benchmark->errors, duration);
+        fprintf(stdout, "\"throughput\": %.1f, \"bandwidth\": %.1f, ",
+                benchmark->operations / duration, benchmark->bytes / duration);
+        fprintf(stdout, "\"latency\": {\"samples\": %llu, \"p50\": %.3f, \"p99\": %.3f, \"p999\": %.3f, \"max\": %.3f}, ",
+                benchmark->nsamples,
+                samples_percentile(benchmark->samples, benchmark->nsamples, 50),
+                samples_percentile(benchmark->samples, benchmark->nsamples, 99),
+                samples_percentile(benchmark->samples, benchmark->nsamples, 99.9),
+                samples_percentile(benchmark->samples, benchmark->nsamples, 100));
+        fprintf(stdout, "\"cpu\": {\"user\": %.3f, \"system\": %.3f}, \"rss\": %ld, ",
+                benchmark->cpu_user, benchmark->cpu_system, rusage_rss());
+        if (benchmark->monitor_stats) {
+                fprintf(stdout, "\"syscalls\": {\"recv\": %llu, \"send\": %llu, \"wait\": %llu, \"ctl\": %llu}}\n",
+                        benchmark->recv_calls, benchmark->send_calls, benchmark->iterations, benchmark->changes);
+        } else {
+                fprintf(stdout, "\"syscalls\": {\"recv\": %llu, \"send\": %llu, \"wait\": null, \"ctl\": null}}\n",
+                        benchmark->recv_calls, benchmark->send_calls);
+        }
+        fflush(stdout);
+        return 0;
+}
@@ -0,0 +1,47 @@
+#if !defined(MEDUSA_BENCHMARK_H)
+#define MEDUSA_BENCHMARK_H
+
+struct medusa_monitor;
+struct medusa_tcpsocket_stats;
+
+/* one run of a benchmark, reported as a single json object on stdout
+ *
+ * latencies are in microseconds, rss in kilobytes, cpu in seconds. recv
+ * and send are the socket calls counted by the benchmark or by medusa
+ * socket stats, wait and ctl are the poll waits and poll changes counted
+ * by monitor stats, they are null when monitor stats are compiled out */
+
+struct benchmark {
+        char name[64];
+        char params[256];
+        unsigned long long operations;
+        unsigned long long bytes;
+        unsigned long long errors;
+        unsigned long long recv_calls;
+        unsigned long long send_calls;
+        unsigned long long *samples;
+        unsigned long long nsamples;
+        unsigned long long ssamples;
+        unsigned long long started;
+        unsigned long long finished;
+        double cpu_user;
+        double cpu_system;
+        int monitor_stats;
+        unsigned long long iterations;
+        unsigned long long changes;
+};
+
+unsigned long long benchmark_clock (void);
+
+int benchmark_init (struct benchmark *benchmark, const char *name, const char *params, ...) __attribute__((format(printf, 3, 4)));
+void benchmark_uninit (struct benchmark *benchmark);
+
+int benchmark_start (struct benchmark *benchmark, struct medusa_monitor *monitor);
+int benchmark_stop (struct benchmark *benchmark, struct medusa_monitor *monitor);
+
+int benchmark_sample (struct benchmark *benchmark, unsigned long long latency);
+void benchmark_add_tcpsocket_stats (struct benchmark *benchmark, const struct medusa_tcpsocket_stats *stats);
+
+int benchmark_report (struct benchmark *benchmark);
+
+#endif
@@ -0,0 +1,347 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "medusa/error.h"
+#include "medusa/udpsocket.h"
+#include "medusa/dnsresolver.h"
+#include "medusa/monitor.h"
+
+#include "benchmark.h"
+
+struct bench {
+        unsigned int window;
+};
+
+static const struct bench g_benchs[] = {
+        {  1 },
+        { 16 },
+        { 64 },
+};
+
+static unsigned int g_poll;
+static unsigned int g_count;
+
+static const struct bench *g_bench;
+static struct benchmark g_benchmark;
+static struct medusa_monitor *g_monitor;
+static struct medusa_dnsresolver *g_dnsresolver;
+
+static unsigned long long *g_started;
+static unsigned int g_issued;
+static unsigned int g_finished;
+
+static int dnsresolver_lookup_onevent (struct medusa_dnsresolver_lookup *dnsresolver_lookup, unsigned int events, void *context, void *param);
+
+static int lookup_issue (void)
+{
+        int rc;
+        char name[64];
+        struct medusa_dnsresolver_lookup *dnsresolver_lookup;
+        struct medusa_dnsresolver_lookup_options dnsresolver_lookup_options;
+        if (g_issued >= g_count) {
+                return 0;
+        }
+        /* distinct names, every lookup goes to the wire */
+        snprintf(name, sizeof(name), "host-%u.benchmark.medusa", g_issued);
+        rc = medusa_dnsresolver_lookup_options_default(&dnsresolver_lookup_options);
+        if (rc < 0) {
+                return rc;
+        }
+        dnsresolver_lookup_options.onevent = dnsresolver_lookup_onevent;
+        dnsresolver_lookup_options.context = NULL;
+        dnsresolver_lookup_options.name    = name;
+        dnsresolver_lookup_options.family  = MEDUSA_DNSRESOLVER_FAMILY_IPV4;
+        dnsresolver_lookup_options.enabled = 0;
+        dnsresolver_lookup = medusa_dnsresolver_lookup_with_options(g_dnsresolver, &dnsresolver_lookup_options);
+        if (MEDUSA_IS_ERR_OR_NULL(dnsresolver_lookup)) {
+                return MEDUSA_PTR_ERR(dnsresolver_lookup);
+        }
+        medusa_dnsresolver_lookup_set_userdata_int(dnsresolver_lookup, g_issued);
+        g_started[g_issued] = benchmark_clock();
+        rc = medusa_dnsresolver_lookup_set_enabled(dnsresolver_lookup, 1);
+        if (rc < 0) {
+                return rc;
+        }
+        g_issued += 1;
+        return 0;
+}
+
+static int dnsresolver_lookup_onevent (struct medusa_dnsresolver_lookup *dnsresolver_lookup, unsigned int events, void *context, void *param)
+{
+        int rc;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_DNSRESOLVER_LOOKUP_EVENT_ENTRY) {
+                g_benchmark.bytes += 4;
+        }
+        if (events & MEDUSA_DNSRESOLVER_LOOKUP_EVENT_FINISHED) {
+                rc = benchmark_sample(&g_benchmark, benchmark_clock() - g_started[medusa_dnsresolver_lookup_get_userdata_int(dnsresolver_lookup)]);
+                if (rc < 0) {
+                        return rc;
+                }
+                g_benchmark.operations += 1;
+        }
+        if (events & (MEDUSA_DNSRESOLVER_LOOKUP_EVENT_TIMEDOUT | MEDUSA_DNSRESOLVER_LOOKUP_EVENT_ERROR)) {
+                g_benchmark.errors += 1;
+        }
+        if (events & (MEDUSA_DNSRESOLVER_LOOKUP_EVENT_FINISHED | MEDUSA_DNSRESOLVER_LOOKUP_EVENT_TIMEDOUT | MEDUSA_DNSRESOLVER_LOOKUP_EVENT_ERROR)) {
+                medusa_dnsresolver_lookup_destroy(dnsresolver_lookup);
+                g_finished += 1;
+                if (g_finished == g_count) {
+                        return medusa_monitor_break(g_monitor);
+                }
+                return lookup_issue();
+        }
+        return 0;
+}
+
+static int dnsresolver_onevent (struct medusa_dnsresolver *dnsresolver, unsigned int events, void *context, void *param)
+{
+        (void) dnsresolver;
+        (void) events;
+        (void) context;
+        (void) param;
+        return 0;
+}
+
+static int udpsocket_server_onevent (struct medusa_udpsocket *udpsocket, unsigned int events, void *context, void *param)
+{
+        int rc;
+        int length;
+        unsigned char buffer[512];
+        socklen_t sockaddr_length;
+        struct sockaddr_storage sockaddr;
+        static const unsigned char answer[] = {
+                0xc0, 0x0c,             /* name, pointer to the question */
+                0x00, 0x01,             /* type A */
+                0x00, 0x01,             /* class IN */
+                0x00, 0x00, 0x00, 0x00, /* ttl 0, nothing is cached */
+                0x00, 0x04,             /* rdlength */
+                127, 0, 0, 1
+        };
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_UDPSOCKET_EVENT_IN) {
+                while (1) {
+                        sockaddr_length = sizeof(sockaddr);
+                        g_benchmark.recv_calls += 1;
+                        rc = recvfrom(medusa_udpsocket_get_fd(udpsocket), buffer, sizeof(buffer) - sizeof(answer), 0, (struct sockaddr *) &sockaddr, &sockaddr_length);
+                        if (rc < 0) {
+                                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                                        break;
+                                }
+                                return -1;
+                        }
+                        /* skip the question name, keep the question only */
+                        length = 12;
+                        while (length < rc && buffer[length] != 0) {
+                                length += buffer[length] + 1;
+                        }
+                        length += 1 + 4;
+                        if (length > rc) {
+                                continue;
+                        }
+                        buffer[2]  = 0x81; buffer[3]  = 0x80;
+                        buffer[4]  = 0x00; buffer[5]  = 0x01;
+                        buffer[6]  = 0x00; buffer[7]  = 0x01;
+                        buffer[8]  = 0x00; buffer[9]  = 0x00;
+                        buffer[10] = 0x00; buffer[11] = 0x00;
+                        memcpy(buffer + length, answer, sizeof(answer));
+                        length += sizeof(answer);
+                        g_benchmark.send_calls += 1;
+                        sendto(medusa_udpsocket_get_fd(udpsocket), buffer, length, 0, (struct sockaddr *) &sockaddr, sockaddr_length);
+                }
+        }
+        return 0;
+}
+
+static int test_bench (const struct bench *bench)
+{
+        int rc;
+        int port;
+        unsigned int i;
+
+        struct medusa_monitor_init_options monitor_init_options;
+
+        struct medusa_udpsocket *udpsocket;
+        struct medusa_udpsocket_bind_options udpsocket_bind_options;
+
+        struct medusa_dnsresolver_init_options dnsresolver_init_options;
+
+        g_monitor  = NULL;
+        g_bench    = bench;
+        g_issued   = 0;
+        g_finished = 0;
+
+        rc = benchmark_init(&g_benchmark, "dnsresolver-lookups", "\"poll\": \"%s\", \"window\": %u",
+                medusa_monitor_poll_type_string(g_poll), bench->window);
+        if (rc < 0) {
+                return -1;
+        }
+
+        medusa_monitor_init_options_default(&monitor_init_options);
+        monitor_init_options.poll.type = g_poll;
+
+        g_monitor = medusa_monitor_create_with_options(&monitor_init_options);
+        if (g_monitor == NULL) {
+                goto bail;
+        }
+
+        for (port = 12345; port < 65535; port++) {
+                rc = medusa_udpsocket_bind_options_default(&udpsocket_bind_options);
+                if (rc < 0) {
+                        goto bail;
+                }
+                udpsocket_bind_options.monitor     = g_monitor;
+                udpsocket_bind_options.onevent     = udpsocket_server_onevent;
+                udpsocket_bind_options.context     = NULL;
+                udpsocket_bind_options.protocol    = MEDUSA_UDPSOCKET_PROTOCOL_IPV4;
+                udpsocket_bind_options.address     = "127.0.0.1";
+                udpsocket_bind_options.port        = port;
+                udpsocket_bind_options.reuseaddr   = 1;
+                udpsocket_bind_options.reuseport   = 0;
+                udpsocket_bind_options.nonblocking = 1;
+                udpsocket_bind_options.enabled     = 1;
+                udpsocket = medusa_udpsocket_bind_with_options(&udpsocket_bind_options);
+                if (MEDUSA_IS_ERR_OR_NULL(udpsocket)) {
+                        goto bail;
+                }
+                if (medusa_udpsocket_get_state(udpsocket) == MEDUSA_UDPSOCKET_STATE_DISCONNECTED) {
+                        medusa_udpsocket_destroy(udpsocket);
+                } else {
+                        break;
+                }
+        }
+        if (port >= 65535) {
+                goto bail;
+        }
+
+        rc = medusa_dnsresolver_init_options_default(&dnsresolver_init_options);
+        if (rc < 0) {
+                goto bail;
+        }
+        dnsresolver_init_options.monitor         = g_monitor;
+        dnsresolver_init_options.onevent         = dnsresolver_onevent;
+        dnsresolver_init_options.context         = NULL;
+        dnsresolver_init_options.nameserver      = "127.0.0.1";
+        dnsresolver_init_options.port            = port;
+        dnsresolver_init_options.family          = MEDUSA_DNSRESOLVER_FAMILY_IPV4;
+        dnsresolver_init_options.retry_count     = 0;
+        dnsresolver_init_options.resolve_timeout = 2.0;
+        dnsresolver_init_options.min_ttl         = 0;
+        dnsresolver_init_options.enabled         = 1;
+        g_dnsresolver = medusa_dnsresolver_create_with_options(&dnsresolver_init_options);
+        if (MEDUSA_IS_ERR_OR_NULL(g_dnsresolver)) {
+                fprintf(stderr, "  medusa_dnsresolver_create_with_options failed\n");
+                goto bail;
+        }
+
+        rc = benchmark_start(&g_benchmark, g_monitor);
+        if (rc < 0) {
+                goto bail;
+        }
+        for (i = 0; i < bench->window; i++) {
+                rc = lookup_issue();
+                if (rc < 0) {
+                        goto bail;
+                }
+        }
+
+        rc = medusa_monitor_run(g_monitor);
+        if (rc < 0) {
+                goto bail;
+        }
+        rc = benchmark_stop(&g_benchmark, g_monitor);
+        if (rc < 0) {
+                goto bail;
+        }
+        if (g_finished != g_count) {
+                fprintf(stderr, "  finished: %u / %u, errors: %llu\n", g_finished, g_count, g_benchmark.errors);
+                goto bail;
+        }
+
+        rc = benchmark_report(&g_benchmark);
+        if (rc < 0) {
+                goto bail;
+        }
+
+        medusa_monitor_destroy(g_monitor);
+        benchmark_uninit(&g_benchmark);
+        return 0;
+bail:   if (g_monitor != NULL) {
+                medusa_monitor_destroy(g_monitor);
+        }
+        benchmark_uninit(&g_benchmark);
+        return -1;
+}
+
+static void alarm_handler (int sig)
+{
+        (void) sig;
+        abort();
+}
+
+int main (int argc, char *argv[])
+{
+        int c;
+        int rc;
+        unsigned int i;
+
+        srand(time(NULL));
+        signal(SIGALRM, alarm_handler);
+
+        g_poll  = MEDUSA_MONITOR_POLL_DEFAULT;
+        g_count = 50000;
+
+        while ((c = getopt(argc, argv, "n:p:")) != -1) {
+                switch (c) {
+                        case 'n':
+                                g_count = atoi(optarg);
+                                break;
+                        case 'p':
+                                rc = medusa_monitor_poll_type_value(optarg);
+                                if (rc < 0) {
+                                        fprintf(stderr, "unknown poll: %s\n", optarg);
+                                        return -1;
+                                }
+                                g_poll = rc;
+                                break;
+                        default:
+                                fprintf(stderr, "unknown param: %c\n", c);
+                                return -1;
+                }
+        }
+        if (g_count == 0) {
+                return -1;
+        }
+
+        g_started = malloc(sizeof(unsigned long long) * g_count);
+        if (g_started == NULL) {
+                return -1;
+        }
+
+        for (i = 0; i < sizeof(g_benchs) / sizeof(g_benchs[0]); i++) {
+                alarm(60);
+                fprintf(stderr, "running bench: window: %u\n", g_benchs[i].window);
+                rc = test_bench(&g_benchs[i]);
+                if (rc != 0) {
+                        fprintf(stderr, "  failed\n");
+                        free(g_started);
+                        return -1;
+                }
+        }
+
+        free(g_started);
+        return 0;
+}
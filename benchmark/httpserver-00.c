@@ -0,0 +1,325 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+
+#include "medusa/error.h"
+#include "medusa/tcpsocket.h"
+#include "medusa/httpserver.h"
+#include "medusa/httpclient.h"
+#include "medusa/httprequest.h"
+#include "medusa/monitor.h"
+
+#include "benchmark.h"
+
+struct bench {
+        unsigned int concurrency;
+};
+
+static const struct bench g_benchs[] = {
+        {  1 },
+        { 16 },
+        { 64 },
+};
+
+static unsigned int g_poll;
+static unsigned int g_count;
+
+static const struct bench *g_bench;
+static struct benchmark g_benchmark;
+static struct medusa_monitor *g_monitor;
+static struct medusa_httpclient *g_httpclient;
+
+static int g_port;
+static unsigned long long *g_started;
+static unsigned int g_issued;
+static unsigned int g_finished;
+
+static int httprequest_onevent (struct medusa_httprequest *httprequest, unsigned int events, void *context, void *param);
+
+static int request_issue (void)
+{
+        int rc;
+        struct medusa_httprequest *httprequest;
+        struct medusa_httprequest_init_options httprequest_init_options;
+        if (g_issued >= g_count) {
+                return 0;
+        }
+        medusa_httprequest_init_options_default(&httprequest_init_options);
+        httprequest_init_options.monitor    = g_monitor;
+        httprequest_init_options.httpclient = g_httpclient;
+        httprequest_init_options.onevent    = httprequest_onevent;
+        httprequest = medusa_httprequest_create_with_options(&httprequest_init_options);
+        if (MEDUSA_IS_ERR_OR_NULL(httprequest)) {
+                return -1;
+        }
+        medusa_httprequest_set_userdata_int(httprequest, g_issued);
+        rc = medusa_httprequest_set_url(httprequest, "http://127.0.0.1:%d/benchmark", g_port);
+        if (rc < 0) {
+                return -1;
+        }
+        g_started[g_issued] = benchmark_clock();
+        rc = medusa_httprequest_make_get(httprequest);
+        if (rc < 0) {
+                return -1;
+        }
+        g_issued += 1;
+        return 0;
+}
+
+static int httprequest_onevent (struct medusa_httprequest *httprequest, unsigned int events, void *context, void *param)
+{
+        int rc;
+        const struct medusa_httprequest_reply *reply;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_HTTPREQUEST_EVENT_RECEIVED) {
+                reply = medusa_httprequest_get_reply(httprequest);
+                if (medusa_httprequest_reply_status_get_code(medusa_httprequest_reply_get_status(reply)) != 200) {
+                        g_benchmark.errors += 1;
+                } else {
+                        rc = benchmark_sample(&g_benchmark, benchmark_clock() - g_started[medusa_httprequest_get_userdata_int(httprequest)]);
+                        if (rc < 0) {
+                                return rc;
+                        }
+                        g_benchmark.operations += 1;
+                        g_benchmark.bytes      += medusa_httprequest_reply_body_get_length(medusa_httprequest_reply_get_body(reply));
+                }
+        }
+        if (events & MEDUSA_HTTPREQUEST_EVENT_ERROR) {
+                g_benchmark.errors += 1;
+        }
+        if (events & MEDUSA_HTTPREQUEST_EVENT_DISCONNECTED) {
+                medusa_httprequest_destroy(httprequest);
+                g_finished += 1;
+                if (g_finished == g_count) {
+                        return medusa_monitor_break(g_monitor);
+                }
+                return request_issue();
+        }
+        return 0;
+}
+
+static int httpserver_client_onevent (struct medusa_httpserver_client *httpserver_client, unsigned int events, void *context, void *param)
+{
+        int rc;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_HTTPSERVER_CLIENT_EVENT_REQUEST_RECEIVED) {
+                rc  = medusa_httpserver_client_reply_send_start(httpserver_client);
+                rc |= medusa_httpserver_client_reply_send_status(httpserver_client, "1.1", 200, "OK");
+                rc |= medusa_httpserver_client_reply_send_header(httpserver_client, "Connection", "keep-alive");
+                rc |= medusa_httpserver_client_reply_send_header(httpserver_client, "Content-Length", "2");
+                rc |= medusa_httpserver_client_reply_send_header(httpserver_client, NULL, NULL);
+                rc |= medusa_httpserver_client_reply_send_body(httpserver_client, "OK", 2);
+                rc |= medusa_httpserver_client_reply_send_finish(httpserver_client);
+                if (rc != 0) {
+                        return -1;
+                }
+        }
+        return 0;
+}
+
+static int httpserver_onevent (struct medusa_httpserver *httpserver, unsigned int events, void *context, void *param)
+{
+        int rc;
+        struct medusa_httpserver_client *httpserver_client;
+        struct medusa_httpserver_accept_options httpserver_accept_options;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_HTTPSERVER_EVENT_CONNECTION) {
+                rc = medusa_httpserver_accept_options_default(&httpserver_accept_options);
+                if (rc < 0) {
+                        return rc;
+                }
+                httpserver_accept_options.onevent = httpserver_client_onevent;
+                httpserver_accept_options.context = NULL;
+                httpserver_accept_options.enabled = 1;
+                httpserver_client = medusa_httpserver_accept_with_options(httpserver, &httpserver_accept_options);
+                if (MEDUSA_IS_ERR_OR_NULL(httpserver_client)) {
+                        return MEDUSA_PTR_ERR(httpserver_client);
+                }
+        }
+        return 0;
+}
+
+static int test_bench (const struct bench *bench)
+{
+        int rc;
+        unsigned int i;
+
+        struct medusa_monitor_init_options monitor_init_options;
+
+        struct medusa_httpserver *httpserver;
+        struct medusa_httpserver_init_options httpserver_init_options;
+
+        struct medusa_httpclient_init_options httpclient_init_options;
+
+        struct medusa_tcpsocket_stats tcpsocket_stats;
+
+        g_monitor  = NULL;
+        g_bench    = bench;
+        g_issued   = 0;
+        g_finished = 0;
+
+        rc = benchmark_init(&g_benchmark, "httpserver-requests", "\"poll\": \"%s\", \"concurrency\": %u",
+                medusa_monitor_poll_type_string(g_poll), bench->concurrency);
+        if (rc < 0) {
+                return -1;
+        }
+
+        medusa_monitor_init_options_default(&monitor_init_options);
+        monitor_init_options.poll.type = g_poll;
+
+        g_monitor = medusa_monitor_create_with_options(&monitor_init_options);
+        if (g_monitor == NULL) {
+                goto bail;
+        }
+
+        rc = medusa_httpserver_init_options_default(&httpserver_init_options);
+        if (rc < 0) {
+                goto bail;
+        }
+        httpserver_init_options.monitor   = g_monitor;
+        httpserver_init_options.protocol  = MEDUSA_HTTPSERVER_PROTOCOL_IPV4;
+        httpserver_init_options.address   = "127.0.0.1";
+        httpserver_init_options.port      = 0;
+        httpserver_init_options.reuseport = 0;
+        httpserver_init_options.stats     = 1;
+        httpserver_init_options.enabled   = 1;
+        httpserver_init_options.started   = 1;
+        httpserver_init_options.onevent   = httpserver_onevent;
+        httpserver_init_options.context   = NULL;
+        httpserver = medusa_httpserver_create_with_options(&httpserver_init_options);
+        if (MEDUSA_IS_ERR_OR_NULL(httpserver)) {
+                fprintf(stderr, "  medusa_httpserver_create_with_options failed\n");
+                goto bail;
+        }
+        g_port = medusa_httpserver_get_sockport(httpserver);
+        if (g_port <= 0) {
+                fprintf(stderr, "  medusa_httpserver_get_sockport failed, port: %d\n", g_port);
+                goto bail;
+        }
+
+        medusa_httpclient_init_options_default(&httpclient_init_options);
+        httpclient_init_options.monitor                  = g_monitor;
+        httpclient_init_options.max_connections_per_host = bench->concurrency;
+        httpclient_init_options.pipelining_depth         = 1;
+        httpclient_init_options.idle_timeout             = 5.0;
+        g_httpclient = medusa_httpclient_create_with_options(&httpclient_init_options);
+        if (MEDUSA_IS_ERR_OR_NULL(g_httpclient)) {
+                goto bail;
+        }
+
+        rc = benchmark_start(&g_benchmark, g_monitor);
+        if (rc < 0) {
+                goto bail;
+        }
+        for (i = 0; i < bench->concurrency; i++) {
+                rc = request_issue();
+                if (rc < 0) {
+                        goto bail;
+                }
+        }
+
+        rc = medusa_monitor_run(g_monitor);
+        if (rc < 0) {
+                goto bail;
+        }
+        rc = benchmark_stop(&g_benchmark, g_monitor);
+        if (rc < 0) {
+                goto bail;
+        }
+        if (g_finished != g_count) {
+                fprintf(stderr, "  finished: %u / %u, errors: %llu\n", g_finished, g_count, g_benchmark.errors);
+                goto bail;
+        }
+
+        /* server side sockets only, the client has no stats */
+        rc = medusa_httpserver_get_stats(httpserver, &tcpsocket_stats);
+        if (rc < 0) {
+                goto bail;
+        }
+        benchmark_add_tcpsocket_stats(&g_benchmark, &tcpsocket_stats);
+
+        rc = benchmark_report(&g_benchmark);
+        if (rc < 0) {
+                goto bail;
+        }
+
+        medusa_monitor_destroy(g_monitor);
+        benchmark_uninit(&g_benchmark);
+        return 0;
+bail:   if (g_monitor != NULL) {
+                medusa_monitor_destroy(g_monitor);
+        }
+        benchmark_uninit(&g_benchmark);
+        return -1;
+}
+
+static void alarm_handler (int sig)
+{
+        (void) sig;
+        abort();
+}
+
+int main (int argc, char *argv[])
+{
+        int c;
+        int rc;
+        unsigned int i;
+
+        srand(time(NULL));
+        signal(SIGALRM, alarm_handler);
+        signal(SIGPIPE, SIG_IGN);
+
+        g_poll  = MEDUSA_MONITOR_POLL_DEFAULT;
+        g_count = 20000;
+
+        while ((c = getopt(argc, argv, "n:p:")) != -1) {
+                switch (c) {
+                        case 'n':
+                                g_count = atoi(optarg);
+                                break;
+                        case 'p':
+                                rc = medusa_monitor_poll_type_value(optarg);
+                                if (rc < 0) {
+                                        fprintf(stderr, "unknown poll: %s\n", optarg);
+                                        return -1;
+                                }
+                                g_poll = rc;
+                                break;
+                        default:
+                                fprintf(stderr, "unknown param: %c\n", c);
+                                return -1;
+                }
+        }
+        if (g_count == 0) {
+                return -1;
+        }
+
+        g_started = malloc(sizeof(unsigned long long) * g_count);
+        if (g_started == NULL) {
+                return -1;
+        }
+
+        for (i = 0; i < sizeof(g_benchs) / sizeof(g_benchs[0]); i++) {
+                alarm(60);
+                fprintf(stderr, "running bench: concurrency: %u\n", g_benchs[i].concurrency);
+                rc = test_bench(&g_benchs[i]);
+                if (rc != 0) {
+                        fprintf(stderr, "  failed\n");
+                        free(g_started);
+                        return -1;
+                }
+        }
+
+        free(g_started);
+        return 0;
+}
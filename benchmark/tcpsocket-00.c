@@ -0,0 +1,385 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+
+#if defined(BENCHMARK_TCPSOCKET_SSL) && (BENCHMARK_TCPSOCKET_SSL == 1)
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#endif
+
+#include "medusa/error.h"
+#include "medusa/buffer.h"
+#include "medusa/tcpsocket.h"
+#include "medusa/monitor.h"
+
+#include "benchmark.h"
+
+#if defined(BENCHMARK_TCPSOCKET_SSL) && (BENCHMARK_TCPSOCKET_SSL == 1)
+#define BENCHMARK_NAME          "tcpsocket-ssl-echo"
+#define BENCHMARK_SSL           1
+#else
+#define BENCHMARK_NAME          "tcpsocket-echo"
+#define BENCHMARK_SSL           0
+#endif
+
+#define CONNECTIONS_MAX         64
+
+struct bench {
+        unsigned int connections;
+        unsigned int size;
+};
+
+static const struct bench g_benchs[] = {
+        {  1,   64 },
+        { 16,   64 },
+        { 16, 4096 },
+};
+
+struct client {
+        struct medusa_tcpsocket *tcpsocket;
+        unsigned long long sent;
+};
+
+static unsigned int g_poll;
+static unsigned int g_count;
+
+static const struct bench *g_bench;
+static struct benchmark g_benchmark;
+static struct medusa_monitor *g_monitor;
+
+static char g_payload[4096];
+static struct client g_clients[CONNECTIONS_MAX];
+static struct medusa_tcpsocket *g_accepted[CONNECTIONS_MAX];
+static unsigned int g_naccepted;
+static unsigned int g_connected;
+static unsigned int g_issued;
+static unsigned int g_completed;
+
+static int client_send (struct client *client)
+{
+        int64_t rc;
+        if (g_issued >= g_count) {
+                return 0;
+        }
+        g_issued += 1;
+        client->sent = benchmark_clock();
+        rc = medusa_tcpsocket_write(client->tcpsocket, g_payload, g_bench->size);
+        if (rc != (int64_t) g_bench->size) {
+                return -1;
+        }
+        return 0;
+}
+
+static int tcpsocket_client_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
+{
+        int rc;
+        unsigned int i;
+        struct medusa_buffer *rbuffer;
+        struct client *client = context;
+        (void) param;
+        if (events & MEDUSA_TCPSOCKET_EVENT_CONNECTED) {
+                g_connected += 1;
+                if (g_connected == g_bench->connections) {
+                        rc = benchmark_start(&g_benchmark, g_monitor);
+                        if (rc < 0) {
+                                return rc;
+                        }
+                        for (i = 0; i < g_bench->connections; i++) {
+                                rc = client_send(&g_clients[i]);
+                                if (rc < 0) {
+                                        return rc;
+                                }
+                        }
+                }
+        }
+        if (events & MEDUSA_TCPSOCKET_EVENT_BUFFERED_READ) {
+                rbuffer = medusa_tcpsocket_get_read_buffer(tcpsocket);
+                while (medusa_buffer_get_length(rbuffer) >= (int64_t) g_bench->size) {
+                        rc = medusa_buffer_choke(rbuffer, 0, g_bench->size);
+                        if (rc != (int) g_bench->size) {
+                                return -1;
+                        }
+                        rc = benchmark_sample(&g_benchmark, benchmark_clock() - client->sent);
+                        if (rc < 0) {
+                                return rc;
+                        }
+                        g_benchmark.operations += 1;
+                        g_benchmark.bytes      += g_bench->size;
+                        g_completed += 1;
+                        if (g_completed == g_count) {
+                                return medusa_monitor_break(g_monitor);
+                        }
+                        rc = client_send(client);
+                        if (rc < 0) {
+                                return rc;
+                        }
+                }
+        }
+        if (events & (MEDUSA_TCPSOCKET_EVENT_ERROR | MEDUSA_TCPSOCKET_EVENT_DISCONNECTED)) {
+                g_benchmark.errors += 1;
+                return medusa_monitor_break(g_monitor);
+        }
+        return 0;
+}
+
+static int tcpsocket_server_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
+{
+        int64_t rc;
+        char buffer[16384];
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_TCPSOCKET_EVENT_BUFFERED_READ) {
+                while (1) {
+                        rc = medusa_tcpsocket_read(tcpsocket, buffer, sizeof(buffer));
+                        if (rc < 0) {
+                                return rc;
+                        }
+                        if (rc == 0) {
+                                break;
+                        }
+                        if (medusa_tcpsocket_write(tcpsocket, buffer, rc) != rc) {
+                                return -1;
+                        }
+                }
+        }
+        return 0;
+}
+
+static int tcpsocket_listener_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
+{
+        int rc;
+        struct medusa_tcpsocket *accepted;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_TCPSOCKET_EVENT_CONNECTION) {
+                if (g_naccepted >= CONNECTIONS_MAX) {
+                        return -1;
+                }
+                accepted = medusa_tcpsocket_accept(tcpsocket, tcpsocket_server_onevent, NULL);
+                if (MEDUSA_IS_ERR_OR_NULL(accepted)) {
+                        return MEDUSA_PTR_ERR(accepted);
+                }
+                rc  = medusa_tcpsocket_set_buffered(accepted, 1);
+                rc |= medusa_tcpsocket_set_nonblocking(accepted, 1);
+                rc |= medusa_tcpsocket_set_nodelay(accepted, 1);
+                rc |= medusa_tcpsocket_set_enabled(accepted, 1);
+                if (rc < 0) {
+                        medusa_tcpsocket_destroy(accepted);
+                        return -1;
+                }
+                g_accepted[g_naccepted++] = accepted;
+        }
+        return 0;
+}
+
+static int test_bench (const struct bench *bench)
+{
+        int rc;
+        int port;
+        unsigned int i;
+
+        struct medusa_monitor_init_options monitor_init_options;
+
+        struct medusa_tcpsocket *tcpsocket;
+        struct medusa_tcpsocket_stats tcpsocket_stats;
+        struct medusa_tcpsocket_bind_options tcpsocket_bind_options;
+        struct medusa_tcpsocket_connect_options tcpsocket_connect_options;
+
+        g_monitor   = NULL;
+        g_bench     = bench;
+        g_naccepted = 0;
+        g_connected = 0;
+        g_issued    = 0;
+        g_completed = 0;
+        memset(g_clients, 0, sizeof(g_clients));
+
+        rc = benchmark_init(&g_benchmark, BENCHMARK_NAME, "\"poll\": \"%s\", \"ssl\": %d, \"connections\": %u, \"size\": %u",
+                medusa_monitor_poll_type_string(g_poll), BENCHMARK_SSL, bench->connections, bench->size);
+        if (rc < 0) {
+                return -1;
+        }
+
+        medusa_monitor_init_options_default(&monitor_init_options);
+        monitor_init_options.poll.type = g_poll;
+
+        g_monitor = medusa_monitor_create_with_options(&monitor_init_options);
+        if (g_monitor == NULL) {
+                goto bail;
+        }
+
+        for (port = 12345; port < 65535; port++) {
+                rc = medusa_tcpsocket_bind_options_default(&tcpsocket_bind_options);
+                if (rc < 0) {
+                        goto bail;
+                }
+                tcpsocket_bind_options.monitor     = g_monitor;
+                tcpsocket_bind_options.onevent     = tcpsocket_listener_onevent;
+                tcpsocket_bind_options.context     = NULL;
+                tcpsocket_bind_options.protocol    = MEDUSA_TCPSOCKET_PROTOCOL_IPV4;
+                tcpsocket_bind_options.address     = "127.0.0.1";
+                tcpsocket_bind_options.port        = port;
+                tcpsocket_bind_options.reuseaddr   = 1;
+                tcpsocket_bind_options.reuseport   = 0;
+                tcpsocket_bind_options.backlog     = 128;
+                tcpsocket_bind_options.nonblocking = 1;
+                tcpsocket_bind_options.buffered    = 1;
+                tcpsocket_bind_options.stats       = 1;
+                tcpsocket_bind_options.enabled     = 1;
+                tcpsocket = medusa_tcpsocket_bind_with_options(&tcpsocket_bind_options);
+                if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                        goto bail;
+                }
+                if (medusa_tcpsocket_get_state(tcpsocket) == MEDUSA_TCPSOCKET_STATE_ERROR) {
+                        medusa_tcpsocket_destroy(tcpsocket);
+                } else {
+                        break;
+                }
+        }
+        if (port >= 65535) {
+                goto bail;
+        }
+
+#if defined(BENCHMARK_TCPSOCKET_SSL) && (BENCHMARK_TCPSOCKET_SSL == 1)
+        rc  = medusa_tcpsocket_set_ssl_certificate_file(tcpsocket, "../test/tcpsocket-ssl.crt");
+        rc |= medusa_tcpsocket_set_ssl_privatekey_file(tcpsocket, "../test/tcpsocket-ssl.key");
+        rc |= medusa_tcpsocket_set_ssl(tcpsocket, 1);
+        if (rc < 0) {
+                fprintf(stderr, "  can not set ssl\n");
+                goto bail;
+        }
+#endif
+
+        for (i = 0; i < bench->connections; i++) {
+                rc = medusa_tcpsocket_connect_options_default(&tcpsocket_connect_options);
+                if (rc < 0) {
+                        goto bail;
+                }
+                tcpsocket_connect_options.monitor     = g_monitor;
+                tcpsocket_connect_options.onevent     = tcpsocket_client_onevent;
+                tcpsocket_connect_options.context     = &g_clients[i];
+                tcpsocket_connect_options.protocol    = MEDUSA_TCPSOCKET_PROTOCOL_IPV4;
+                tcpsocket_connect_options.address     = "127.0.0.1";
+                tcpsocket_connect_options.port        = port;
+                tcpsocket_connect_options.nonblocking = 1;
+                tcpsocket_connect_options.nodelay     = 1;
+                tcpsocket_connect_options.buffered    = 1;
+                tcpsocket_connect_options.ssl         = BENCHMARK_SSL;
+                tcpsocket_connect_options.stats       = 1;
+                tcpsocket_connect_options.enabled     = 1;
+                g_clients[i].tcpsocket = medusa_tcpsocket_connect_with_options(&tcpsocket_connect_options);
+                if (MEDUSA_IS_ERR_OR_NULL(g_clients[i].tcpsocket)) {
+                        goto bail;
+                }
+        }
+
+        rc = medusa_monitor_run(g_monitor);
+        if (rc < 0) {
+                goto bail;
+        }
+        rc = benchmark_stop(&g_benchmark, g_monitor);
+        if (rc < 0) {
+                goto bail;
+        }
+        if (g_completed != g_count) {
+                fprintf(stderr, "  completed: %u / %u, errors: %llu\n", g_completed, g_count, g_benchmark.errors);
+                goto bail;
+        }
+
+        for (i = 0; i < bench->connections; i++) {
+                rc = medusa_tcpsocket_get_stats(g_clients[i].tcpsocket, &tcpsocket_stats);
+                if (rc < 0) {
+                        goto bail;
+                }
+                benchmark_add_tcpsocket_stats(&g_benchmark, &tcpsocket_stats);
+        }
+        for (i = 0; i < g_naccepted; i++) {
+                rc = medusa_tcpsocket_get_stats(g_accepted[i], &tcpsocket_stats);
+                if (rc < 0) {
+                        goto bail;
+                }
+                benchmark_add_tcpsocket_stats(&g_benchmark, &tcpsocket_stats);
+        }
+
+        rc = benchmark_report(&g_benchmark);
+        if (rc < 0) {
+                goto bail;
+        }
+
+        medusa_monitor_destroy(g_monitor);
+        benchmark_uninit(&g_benchmark);
+        return 0;
+bail:   if (g_monitor != NULL) {
+                medusa_monitor_destroy(g_monitor);
+        }
+        benchmark_uninit(&g_benchmark);
+        return -1;
+}
+
+static void alarm_handler (int sig)
+{
+        (void) sig;
+        abort();
+}
+
+int main (int argc, char *argv[])
+{
+        int c;
+        int rc;
+        unsigned int i;
+
+        srand(time(NULL));
+        signal(SIGALRM, alarm_handler);
+        signal(SIGPIPE, SIG_IGN);
+
+        g_poll  = MEDUSA_MONITOR_POLL_DEFAULT;
+        g_count = 100000;
+
+        while ((c = getopt(argc, argv, "n:p:")) != -1) {
+                switch (c) {
+                        case 'n':
+                                g_count = atoi(optarg);
+                                break;
+                        case 'p':
+                                rc = medusa_monitor_poll_type_value(optarg);
+                                if (rc < 0) {
+                                        fprintf(stderr, "unknown poll: %s\n", optarg);
+                                        return -1;
+                                }
+                                g_poll = rc;
+                                break;
+                        default:
+                                fprintf(stderr, "unknown param: %c\n", c);
+                                return -1;
+                }
+        }
+        if (g_count == 0) {
+                return -1;
+        }
+
+#if defined(BENCHMARK_TCPSOCKET_SSL) && (BENCHMARK_TCPSOCKET_SSL == 1)
+        SSL_library_init();
+        SSL_load_error_strings();
+#endif
+
+        for (i = 0; i < sizeof(g_payload); i++) {
+                g_payload[i] = 'a' + (rand() % 26);
+        }
+
+        for (i = 0; i < sizeof(g_benchs) / sizeof(g_benchs[0]); i++) {
+                alarm(60);
+                fprintf(stderr, "running bench: connections: %u, size: %u\n", g_benchs[i].connections, g_benchs[i].size);
+                rc = test_bench(&g_benchs[i]);
+                if (rc != 0) {
+                        fprintf(stderr, "  failed\n");
+                        return -1;
+                }
+        }
+        return 0;
+}
@@ -0,0 +1,331 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "medusa/error.h"
+#include "medusa/udpsocket.h"
+#include "medusa/monitor.h"
+
+#include "benchmark.h"
+
+#define SLOTS                   4096
+
+struct bench {
+        unsigned int window;
+        unsigned int size;
+};
+
+static const struct bench g_benchs[] = {
+        {  1,   64 },
+        { 32,   64 },
+        { 32, 1024 },
+};
+
+struct slot {
+        unsigned int seq;
+        unsigned long long sent;
+};
+
+static unsigned int g_poll;
+static unsigned int g_count;
+
+static const struct bench *g_bench;
+static struct benchmark g_benchmark;
+static struct medusa_monitor *g_monitor;
+
+static char g_payload[1024];
+static struct slot g_slots[SLOTS];
+static unsigned int g_issued;
+static unsigned int g_completed;
+static unsigned int g_pending;
+
+static int client_send (struct medusa_udpsocket *udpsocket)
+{
+        int rc;
+        unsigned int seq;
+        while (g_pending < g_bench->window && g_issued < g_count) {
+                seq = g_issued;
+                memcpy(g_payload, &seq, sizeof(seq));
+                g_slots[seq % SLOTS].seq  = seq;
+                g_slots[seq % SLOTS].sent = benchmark_clock();
+                g_benchmark.send_calls += 1;
+                rc = send(medusa_udpsocket_get_fd(udpsocket), g_payload, g_bench->size, 0);
+                if (rc != (int) g_bench->size) {
+                        if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)) {
+                                break;
+                        }
+                        return -1;
+                }
+                g_issued  += 1;
+                g_pending += 1;
+        }
+        return 0;
+}
+
+static int udpsocket_client_onevent (struct medusa_udpsocket *udpsocket, unsigned int events, void *context, void *param)
+{
+        int rc;
+        unsigned int seq;
+        char buffer[2048];
+        struct slot *slot;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_UDPSOCKET_EVENT_CONNECTED) {
+                rc = benchmark_start(&g_benchmark, g_monitor);
+                if (rc < 0) {
+                        return rc;
+                }
+                return client_send(udpsocket);
+        }
+        if (events & MEDUSA_UDPSOCKET_EVENT_IN) {
+                while (1) {
+                        g_benchmark.recv_calls += 1;
+                        rc = recv(medusa_udpsocket_get_fd(udpsocket), buffer, sizeof(buffer), 0);
+                        if (rc < 0) {
+                                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                                        break;
+                                }
+                                return -1;
+                        }
+                        if (rc != (int) g_bench->size) {
+                                return -1;
+                        }
+                        memcpy(&seq, buffer, sizeof(seq));
+                        slot = &g_slots[seq % SLOTS];
+                        if (slot->seq != seq || slot->sent == 0) {
+                                /* answer of a packet that was given up on */
+                                continue;
+                        }
+                        rc = benchmark_sample(&g_benchmark, benchmark_clock() - slot->sent);
+                        if (rc < 0) {
+                                return rc;
+                        }
+                        slot->sent = 0;
+                        g_benchmark.operations += 1;
+                        g_benchmark.bytes      += g_bench->size;
+                        g_completed += 1;
+                        g_pending   -= 1;
+                }
+                if (g_completed + g_benchmark.errors >= g_count) {
+                        return medusa_monitor_break(g_monitor);
+                }
+                return client_send(udpsocket);
+        }
+        if (events & MEDUSA_UDPSOCKET_EVENT_IN_TIMEOUT) {
+                /* loopback may still drop under pressure, count the window
+                 * as lost and keep going */
+                g_benchmark.errors += g_pending;
+                g_pending = 0;
+                memset(g_slots, 0, sizeof(g_slots));
+                if (g_completed + g_benchmark.errors >= g_count) {
+                        return medusa_monitor_break(g_monitor);
+                }
+                return client_send(udpsocket);
+        }
+        if (events & MEDUSA_UDPSOCKET_EVENT_ERROR) {
+                return medusa_monitor_break(g_monitor);
+        }
+        return 0;
+}
+
+static int udpsocket_server_onevent (struct medusa_udpsocket *udpsocket, unsigned int events, void *context, void *param)
+{
+        int rc;
+        char buffer[2048];
+        socklen_t sockaddr_length;
+        struct sockaddr_storage sockaddr;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_UDPSOCKET_EVENT_IN) {
+                while (1) {
+                        sockaddr_length = sizeof(sockaddr);
+                        g_benchmark.recv_calls += 1;
+                        rc = recvfrom(medusa_udpsocket_get_fd(udpsocket), buffer, sizeof(buffer), 0, (struct sockaddr *) &sockaddr, &sockaddr_length);
+                        if (rc < 0) {
+                                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                                        break;
+                                }
+                                return -1;
+                        }
+                        g_benchmark.send_calls += 1;
+                        sendto(medusa_udpsocket_get_fd(udpsocket), buffer, rc, 0, (struct sockaddr *) &sockaddr, sockaddr_length);
+                }
+        }
+        return 0;
+}
+
+static int test_bench (const struct bench *bench)
+{
+        int rc;
+        int port;
+
+        struct medusa_monitor_init_options monitor_init_options;
+
+        struct medusa_udpsocket *udpsocket;
+        struct medusa_udpsocket_bind_options udpsocket_bind_options;
+        struct medusa_udpsocket_connect_options udpsocket_connect_options;
+
+        g_monitor   = NULL;
+        g_bench     = bench;
+        g_issued    = 0;
+        g_completed = 0;
+        g_pending   = 0;
+        memset(g_slots, 0, sizeof(g_slots));
+
+        rc = benchmark_init(&g_benchmark, "udpsocket-echo", "\"poll\": \"%s\", \"window\": %u, \"size\": %u",
+                medusa_monitor_poll_type_string(g_poll), bench->window, bench->size);
+        if (rc < 0) {
+                return -1;
+        }
+
+        medusa_monitor_init_options_default(&monitor_init_options);
+        monitor_init_options.poll.type = g_poll;
+
+        g_monitor = medusa_monitor_create_with_options(&monitor_init_options);
+        if (g_monitor == NULL) {
+                goto bail;
+        }
+
+        for (port = 12345; port < 65535; port++) {
+                rc = medusa_udpsocket_bind_options_default(&udpsocket_bind_options);
+                if (rc < 0) {
+                        goto bail;
+                }
+                udpsocket_bind_options.monitor     = g_monitor;
+                udpsocket_bind_options.onevent     = udpsocket_server_onevent;
+                udpsocket_bind_options.context     = NULL;
+                udpsocket_bind_options.protocol    = MEDUSA_UDPSOCKET_PROTOCOL_IPV4;
+                udpsocket_bind_options.address     = "127.0.0.1";
+                udpsocket_bind_options.port        = port;
+                udpsocket_bind_options.reuseaddr   = 1;
+                udpsocket_bind_options.reuseport   = 0;
+                udpsocket_bind_options.nonblocking = 1;
+                udpsocket_bind_options.enabled     = 1;
+                udpsocket = medusa_udpsocket_bind_with_options(&udpsocket_bind_options);
+                if (MEDUSA_IS_ERR_OR_NULL(udpsocket)) {
+                        goto bail;
+                }
+                if (medusa_udpsocket_get_state(udpsocket) == MEDUSA_UDPSOCKET_STATE_DISCONNECTED) {
+                        medusa_udpsocket_destroy(udpsocket);
+                } else {
+                        break;
+                }
+        }
+        if (port >= 65535) {
+                goto bail;
+        }
+
+        rc = medusa_udpsocket_connect_options_default(&udpsocket_connect_options);
+        if (rc < 0) {
+                goto bail;
+        }
+        udpsocket_connect_options.monitor      = g_monitor;
+        udpsocket_connect_options.onevent      = udpsocket_client_onevent;
+        udpsocket_connect_options.context      = NULL;
+        udpsocket_connect_options.protocol     = MEDUSA_UDPSOCKET_PROTOCOL_IPV4;
+        udpsocket_connect_options.address      = "127.0.0.1";
+        udpsocket_connect_options.port         = port;
+        udpsocket_connect_options.read_timeout = 0.2;
+        udpsocket_connect_options.nonblocking  = 1;
+        udpsocket_connect_options.enabled      = 1;
+        udpsocket = medusa_udpsocket_connect_with_options(&udpsocket_connect_options);
+        if (MEDUSA_IS_ERR_OR_NULL(udpsocket)) {
+                goto bail;
+        }
+        if (medusa_udpsocket_get_state(udpsocket) == MEDUSA_UDPSOCKET_STATE_DISCONNECTED) {
+                goto bail;
+        }
+
+        rc = medusa_monitor_run(g_monitor);
+        if (rc < 0) {
+                goto bail;
+        }
+        rc = benchmark_stop(&g_benchmark, g_monitor);
+        if (rc < 0) {
+                goto bail;
+        }
+        if (g_completed + g_benchmark.errors != g_count) {
+                fprintf(stderr, "  completed: %u / %u, lost: %llu\n", g_completed, g_count, g_benchmark.errors);
+                goto bail;
+        }
+
+        rc = benchmark_report(&g_benchmark);
+        if (rc < 0) {
+                goto bail;
+        }
+
+        medusa_monitor_destroy(g_monitor);
+        benchmark_uninit(&g_benchmark);
+        return 0;
+bail:   if (g_monitor != NULL) {
+                medusa_monitor_destroy(g_monitor);
+        }
+        benchmark_uninit(&g_benchmark);
+        return -1;
+}
+
+static void alarm_handler (int sig)
+{
+        (void) sig;
+        abort();
+}
+
+int main (int argc, char *argv[])
+{
+        int c;
+        int rc;
+        unsigned int i;
+
+        srand(time(NULL));
+        signal(SIGALRM, alarm_handler);
+
+        g_poll  = MEDUSA_MONITOR_POLL_DEFAULT;
+        g_count = 200000;
+
+        while ((c = getopt(argc, argv, "n:p:")) != -1) {
+                switch (c) {
+                        case 'n':
+                                g_count = atoi(optarg);
+                                break;
+                        case 'p':
+                                rc = medusa_monitor_poll_type_value(optarg);
+                                if (rc < 0) {
+                                        fprintf(stderr, "unknown poll: %s\n", optarg);
+                                        return -1;
+                                }
+                                g_poll = rc;
+                                break;
+                        default:
+                                fprintf(stderr, "unknown param: %c\n", c);
+                                return -1;
+                }
+        }
+        if (g_count == 0) {
+                return -1;
+        }
+
+        for (i = 0; i < sizeof(g_payload); i++) {
+                g_payload[i] = 'a' + (rand() % 26);
+        }
+
+        for (i = 0; i < sizeof(g_benchs) / sizeof(g_benchs[0]); i++) {
+                alarm(60);
+                fprintf(stderr, "running bench: window: %u, size: %u\n", g_benchs[i].window, g_benchs[i].size);
+                rc = test_bench(&g_benchs[i]);
+                if (rc != 0) {
+                        fprintf(stderr, "  failed\n");
+                        return -1;
+                }
+        }
+        return 0;
+}
@@ -0,0 +1,305 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+
+#include "medusa/error.h"
+#include "medusa/tcpsocket.h"
+#include "medusa/websocketserver.h"
+#include "medusa/websocketclient.h"
+#include "medusa/monitor.h"
+
+#include "benchmark.h"
+
+struct bench {
+        unsigned int window;
+        unsigned int size;
+};
+
+static const struct bench g_benchs[] = {
+        {  1,   64 },
+        { 16,   64 },
+        { 16, 4096 },
+};
+
+static unsigned int g_poll;
+static unsigned int g_count;
+
+static const struct bench *g_bench;
+static struct benchmark g_benchmark;
+static struct medusa_monitor *g_monitor;
+
+static char g_payload[4096];
+static unsigned long long *g_sent;
+static unsigned int g_issued;
+static unsigned int g_completed;
+
+static int client_send (struct medusa_websocketclient *websocketclient)
+{
+        int rc;
+        while (g_issued - g_completed < g_bench->window && g_issued < g_count) {
+                g_sent[g_issued] = benchmark_clock();
+                rc = medusa_websocketclient_write(websocketclient, 1, MEDUSA_WEBSOCKETCLIENT_FRAME_TYPE_TEXT, g_payload, g_bench->size);
+                if (rc < 0) {
+                        return rc;
+                }
+                g_issued += 1;
+        }
+        return 0;
+}
+
+static int websocketserver_client_onevent (struct medusa_websocketserver_client *websocketserver_client, unsigned int events, void *context, void *param)
+{
+        int rc;
+        (void) context;
+        if (events & MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_MESSAGE) {
+                struct medusa_websocketserver_client_event_message *medusa_websocketserver_client_event_message = (struct medusa_websocketserver_client_event_message *) param;
+                rc = medusa_websocketserver_client_write(websocketserver_client, 1, MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_TEXT,
+                                medusa_websocketserver_client_event_message->payload,
+                                medusa_websocketserver_client_event_message->length);
+                if (rc < 0) {
+                        return rc;
+                }
+        }
+        if (events & MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_ERROR) {
+                g_benchmark.errors += 1;
+                return medusa_monitor_break(g_monitor);
+        }
+        return 0;
+}
+
+static int websocketserver_onevent (struct medusa_websocketserver *websocketserver, unsigned int events, void *context, void *param)
+{
+        struct medusa_websocketserver_client *websocketserver_client;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_WEBSOCKETSERVER_EVENT_CONNECTION) {
+                websocketserver_client = medusa_websocketserver_accept(websocketserver, websocketserver_client_onevent, NULL);
+                if (MEDUSA_IS_ERR_OR_NULL(websocketserver_client)) {
+                        return MEDUSA_PTR_ERR(websocketserver_client);
+                }
+        }
+        return 0;
+}
+
+static int websocketclient_onevent (struct medusa_websocketclient *websocketclient, unsigned int events, void *context, void *param)
+{
+        int rc;
+        (void) context;
+        if (events & MEDUSA_WEBSOCKETCLIENT_EVENT_CONNECTED) {
+                rc = benchmark_start(&g_benchmark, g_monitor);
+                if (rc < 0) {
+                        return rc;
+                }
+                return client_send(websocketclient);
+        }
+        if (events & MEDUSA_WEBSOCKETCLIENT_EVENT_MESSAGE) {
+                struct medusa_websocketclient_event_message *medusa_websocketclient_event_message = (struct medusa_websocketclient_event_message *) param;
+                if (medusa_websocketclient_event_message->length != g_bench->size) {
+                        g_benchmark.errors += 1;
+                        return medusa_monitor_break(g_monitor);
+                }
+                /* frames are echoed in order, so the oldest send time is the
+                 * one of this message */
+                rc = benchmark_sample(&g_benchmark, benchmark_clock() - g_sent[g_completed]);
+                if (rc < 0) {
+                        return rc;
+                }
+                g_benchmark.operations += 1;
+                g_benchmark.bytes      += g_bench->size;
+                g_completed += 1;
+                if (g_completed == g_count) {
+                        return medusa_monitor_break(g_monitor);
+                }
+                return client_send(websocketclient);
+        }
+        if (events & MEDUSA_WEBSOCKETCLIENT_EVENT_ERROR) {
+                g_benchmark.errors += 1;
+                return medusa_monitor_break(g_monitor);
+        }
+        return 0;
+}
+
+static int test_bench (const struct bench *bench)
+{
+        int rc;
+        int port;
+
+        struct medusa_monitor_init_options monitor_init_options;
+
+        struct medusa_websocketserver *websocketserver;
+        struct medusa_websocketserver_init_options websocketserver_init_options;
+
+        struct medusa_websocketclient *websocketclient;
+        struct medusa_websocketclient_connect_options websocketclient_connect_options;
+
+        struct medusa_tcpsocket_stats tcpsocket_stats;
+
+        g_monitor   = NULL;
+        g_bench     = bench;
+        g_issued    = 0;
+        g_completed = 0;
+
+        rc = benchmark_init(&g_benchmark, "websocket-echo", "\"poll\": \"%s\", \"window\": %u, \"size\": %u",
+                medusa_monitor_poll_type_string(g_poll), bench->window, bench->size);
+        if (rc < 0) {
+                return -1;
+        }
+
+        medusa_monitor_init_options_default(&monitor_init_options);
+        monitor_init_options.poll.type = g_poll;
+
+        g_monitor = medusa_monitor_create_with_options(&monitor_init_options);
+        if (g_monitor == NULL) {
+                goto bail;
+        }
+
+        rc = medusa_websocketserver_init_options_default(&websocketserver_init_options);
+        if (rc < 0) {
+                goto bail;
+        }
+        websocketserver_init_options.monitor   = g_monitor;
+        websocketserver_init_options.protocol  = MEDUSA_WEBSOCKETSERVER_PROTOCOL_IPV4;
+        websocketserver_init_options.address   = "127.0.0.1";
+        websocketserver_init_options.port      = 0;
+        websocketserver_init_options.reuseport = 0;
+        websocketserver_init_options.stats     = 1;
+        websocketserver_init_options.enabled   = 1;
+        websocketserver_init_options.started   = 1;
+        websocketserver_init_options.onevent   = websocketserver_onevent;
+        websocketserver_init_options.context   = NULL;
+        websocketserver = medusa_websocketserver_create_with_options(&websocketserver_init_options);
+        if (MEDUSA_IS_ERR_OR_NULL(websocketserver)) {
+                fprintf(stderr, "  medusa_websocketserver_create_with_options failed\n");
+                goto bail;
+        }
+        port = medusa_websocketserver_get_sockport(websocketserver);
+        if (port <= 0) {
+                fprintf(stderr, "  medusa_websocketserver_get_sockport failed, port: %d\n", port);
+                goto bail;
+        }
+
+        rc = medusa_websocketclient_connect_options_default(&websocketclient_connect_options);
+        if (rc < 0) {
+                goto bail;
+        }
+        websocketclient_connect_options.monitor         = g_monitor;
+        websocketclient_connect_options.protocol        = MEDUSA_WEBSOCKETCLIENT_PROTOCOL_IPV4;
+        websocketclient_connect_options.address         = "127.0.0.1";
+        websocketclient_connect_options.port            = port;
+        websocketclient_connect_options.server_path     = "/";
+        websocketclient_connect_options.server_protocol = "benchmark";
+        websocketclient_connect_options.enabled         = 1;
+        websocketclient_connect_options.onevent         = websocketclient_onevent;
+        websocketclient_connect_options.context         = NULL;
+        websocketclient = medusa_websocketclient_connect_with_options(&websocketclient_connect_options);
+        if (MEDUSA_IS_ERR_OR_NULL(websocketclient)) {
+                fprintf(stderr, "  medusa_websocketclient_connect_with_options failed\n");
+                goto bail;
+        }
+
+        rc = medusa_monitor_run(g_monitor);
+        if (rc < 0) {
+                goto bail;
+        }
+        rc = benchmark_stop(&g_benchmark, g_monitor);
+        if (rc < 0) {
+                goto bail;
+        }
+        if (g_completed != g_count) {
+                fprintf(stderr, "  completed: %u / %u, errors: %llu\n", g_completed, g_count, g_benchmark.errors);
+                goto bail;
+        }
+
+        /* server side sockets only, the client has no stats */
+        rc = medusa_websocketserver_get_stats(websocketserver, &tcpsocket_stats);
+        if (rc < 0) {
+                goto bail;
+        }
+        benchmark_add_tcpsocket_stats(&g_benchmark, &tcpsocket_stats);
+
+        rc = benchmark_report(&g_benchmark);
+        if (rc < 0) {
+                goto bail;
+        }
+
+        medusa_monitor_destroy(g_monitor);
+        benchmark_uninit(&g_benchmark);
+        return 0;
+bail:   if (g_monitor != NULL) {
+                medusa_monitor_destroy(g_monitor);
+        }
+        benchmark_uninit(&g_benchmark);
+        return -1;
+}
+
+static void alarm_handler (int sig)
+{
+        (void) sig;
+        abort();
+}
+
+int main (int argc, char *argv[])
+{
+        int c;
+        int rc;
+        unsigned int i;
+
+        srand(time(NULL));
+        signal(SIGALRM, alarm_handler);
+        signal(SIGPIPE, SIG_IGN);
+
+        g_poll  = MEDUSA_MONITOR_POLL_DEFAULT;
+        g_count = 100000;
+
+        while ((c = getopt(argc, argv, "n:p:")) != -1) {
+                switch (c) {
+                        case 'n':
+                                g_count = atoi(optarg);
+                                break;
+                        case 'p':
+                                rc = medusa_monitor_poll_type_value(optarg);
+                                if (rc < 0) {
+                                        fprintf(stderr, "unknown poll: %s\n", optarg);
+                                        return -1;
+                                }
+                                g_poll = rc;
+                                break;
+                        default:
+                                fprintf(stderr, "unknown param: %c\n", c);
+                                return -1;
+                }
+        }
+        if (g_count == 0) {
+                return -1;
+        }
+
+        for (i = 0; i < sizeof(g_payload); i++) {
+                g_payload[i] = 'a' + (rand() % 26);
+        }
+
+        g_sent = malloc(sizeof(unsigned long long) * g_count);
+        if (g_sent == NULL) {
+                return -1;
+        }
+
+        for (i = 0; i < sizeof(g_benchs) / sizeof(g_benchs[0]); i++) {
+                alarm(60);
+                fprintf(stderr, "running bench: window: %u, size: %u\n", g_benchs[i].window, g_benchs[i].size);
+                rc = test_bench(&g_benchs[i]);
+                if (rc != 0) {
+                        fprintf(stderr, "  failed\n");
+                        free(g_sent);
+                        return -1;
+                }
+        }
+
+        free(g_sent);
+        return 0;
+}
@@ -521,8 +521,25 @@ __attribute__ ((visibility ("default"))) const char * medusa_condition_event_str
         return "MEDUSA_CONDITION_EVENT_UNKNOWN";
 }
 
+static int condition_subject_onevent (struct medusa_subject *subject, unsigned int events, void *param)
+{
+        return medusa_condition_onevent_unlocked((struct medusa_condition *) subject, events, param);
+}
+
+static int condition_subject_destroy (struct medusa_subject *subject)
+{
+        return medusa_condition_onevent_unlocked((struct medusa_condition *) subject, MEDUSA_CONDITION_EVENT_DESTROY, NULL);
+}
+
+static const struct medusa_subject_type g_subject_type = {
+        .rank    = MEDUSA_SUBJECT_RANK_BASE,
+        .onevent = condition_subject_onevent,
+        .destroy = condition_subject_destroy
+};
+
 __attribute__ ((constructor)) static void condition_constructor (void)
 {
+        medusa_monitor_register_subject_type(MEDUSA_SUBJECT_TYPE_CONDITION, &g_subject_type);
 #if defined(MEDUSA_CONDITION_USE_POOL) && (MEDUSA_CONDITION_USE_POOL == 1)
         g_pool = medusa_pool_create("medusa-condition", sizeof(struct medusa_condition), 0, 0, MEDUSA_POOL_FLAG_DEFAULT | MEDUSA_POOL_FLAG_THREAD_SAFE, NULL, NULL, NULL);
 #endif
@@ -4,11 +4,17 @@
 #include <string.h>
 #include <stdarg.h>
 #include <time.h>
-#include <sys/time.h>
+#include <errno.h>
+#include <signal.h>
 #include <pthread.h>
 
+#include "queue.h"
 #include "debug.h"
 
+#define DEBUG_RING_SIZE         256
+#define DEBUG_MESSAGE_SIZE      240
+#define DEBUG_FLUSH_INTERVAL    10000000
+
 int medusa_debug_level                          = MEDUSA_DEBUG_LEVEL_ERROR;
 static pthread_mutex_t medusa_debug_mutex       = PTHREAD_MUTEX_INITIALIZER;
 
@@ -17,6 +23,43 @@ static int debug_buffer_size    = 0;
 static int (*debug_callback_function) (void *context, const char *format, ...)  = NULL;
 static void *debug_callback_context                                             = NULL;
 
+/* async mode: every logging thread owns a single producer ring, records
+ * carry the formatted message and the call site, date formatting and
+ * output happen on the flusher thread. a full ring drops and counts. */
+struct debug_record {
+        struct timespec timespec;
+        int level;
+        int line;
+        const char *name;
+        const char *function;
+        const char *file;
+        char message[DEBUG_MESSAGE_SIZE];
+};
+
+TAILQ_HEAD(debug_rings, debug_ring);
+struct debug_ring {
+        TAILQ_ENTRY(debug_ring) tailq;
+        unsigned int head;
+        unsigned int tail;
+        unsigned long long dropped;
+        unsigned long long reported;
+        int exited;
+        struct debug_record records[DEBUG_RING_SIZE];
+};
+
+static int debug_async                  = 0;
+static int debug_async_running          = 0;
+static pthread_t debug_async_thread;
+static pthread_once_t debug_async_once  = PTHREAD_ONCE_INIT;
+static pthread_key_t debug_async_key;
+static pthread_mutex_t debug_async_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t debug_async_cond  = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t debug_drain_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct debug_rings debug_async_rings = TAILQ_HEAD_INITIALIZER(debug_async_rings);
+static unsigned long long debug_async_dropped;
+static __thread struct debug_ring *debug_async_ring;
+static __thread int debug_async_exited;
+
 void medusa_debug_lock (void)
 {
         pthread_mutex_lock(&medusa_debug_mutex);
@@ -70,16 +113,228 @@ int medusa_debug_level_from_string (const char *string)
         return MEDUSA_DEBUG_LEVEL_ERROR;
 }
 
+static void debug_output (int level, const char *name, const char *function, const char *file, int line, const struct timespec *timespec, const char *message)
+{
+        struct tm tm;
+        time_t seconds;
+        int milliseconds;
+        char date[80];
+
+        milliseconds = (int) ((timespec->tv_nsec / 1000000.0) + 0.5);
+        seconds = timespec->tv_sec;
+        if (milliseconds >= 1000) {
+                milliseconds -= 1000;
+                seconds++;
+        }
+        localtime_r(&seconds, &tm);
+        strftime(date, sizeof(date), "%x-%H:%M:%S", &tm);
+
+        if (debug_callback_function != NULL) {
+                debug_callback_function(debug_callback_context, "medusa:%s.%03d:%-8s:%-6s: %s (%s %s:%d)\n", date, milliseconds, name, medusa_debug_level_to_string(level), message, function, file, line);
+        } else {
+                fprintf(stderr, "medusa:%s.%03d:%-8s:%-6s: %s (%s %s:%d)\n", date, milliseconds, name, medusa_debug_level_to_string(level), message, function, file, line);
+        }
+}
+
+static void debug_async_key_destroy (void *context)
+{
+        struct debug_ring *ring = context;
+        /* the drain frees the ring once it is marked, anything this thread
+         * logs from later destructors goes the synchronous way */
+        debug_async_ring = NULL;
+        debug_async_exited = 1;
+        __atomic_store_n(&ring->exited, 1, __ATOMIC_RELEASE);
+}
+
+static void debug_async_key_create (void)
+{
+        pthread_key_create(&debug_async_key, debug_async_key_destroy);
+}
+
+static struct debug_ring * debug_async_get_ring (void)
+{
+        struct debug_ring *ring;
+        ring = debug_async_ring;
+        if (ring != NULL) {
+                return ring;
+        }
+        if (debug_async_exited) {
+                return NULL;
+        }
+        pthread_once(&debug_async_once, debug_async_key_create);
+        ring = malloc(sizeof(struct debug_ring));
+        if (ring == NULL) {
+                return NULL;
+        }
+        memset(ring, 0, sizeof(struct debug_ring));
+        pthread_setspecific(debug_async_key, ring);
+        pthread_mutex_lock(&debug_async_mutex);
+        TAILQ_INSERT_TAIL(&debug_async_rings, ring, tailq);
+        pthread_mutex_unlock(&debug_async_mutex);
+        debug_async_ring = ring;
+        return ring;
+}
+
+static int debug_async_vprintf (int level, const char *name, const char *function, const char *file, int line, const char *fmt, va_list ap)
+{
+        unsigned int head;
+        unsigned int tail;
+        struct debug_ring *ring;
+        struct debug_record *record;
+
+        ring = debug_async_get_ring();
+        if (ring == NULL) {
+                return -1;
+        }
+        head = ring->head;
+        tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        if (head - tail >= DEBUG_RING_SIZE) {
+                __atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+                return 0;
+        }
+        record = &ring->records[head % DEBUG_RING_SIZE];
+        clock_gettime(CLOCK_REALTIME, &record->timespec);
+        record->level    = level;
+        record->line     = line;
+        record->name     = name;
+        record->function = function;
+        record->file     = file;
+        vsnprintf(record->message, sizeof(record->message), fmt, ap);
+        __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+        if (head - tail == DEBUG_RING_SIZE / 2) {
+                pthread_cond_signal(&debug_async_cond);
+        }
+        return 0;
+}
+
+static void debug_async_drain (void)
+{
+        unsigned int head;
+        unsigned int tail;
+        unsigned long long dropped;
+        struct timespec timespec;
+        struct debug_ring *ring;
+        struct debug_ring *nring;
+        struct debug_record *record;
+
+        pthread_mutex_lock(&debug_drain_mutex);
+        pthread_mutex_lock(&debug_async_mutex);
+        TAILQ_FOREACH_SAFE(ring, &debug_async_rings, tailq, nring) {
+                pthread_mutex_unlock(&debug_async_mutex);
+                head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+                for (tail = ring->tail; tail != head; tail++) {
+                        record = &ring->records[tail % DEBUG_RING_SIZE];
+                        debug_output(record->level, record->name, record->function, record->file, record->line, &record->timespec, record->message);
+                }
+                __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+                dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+                if (dropped != ring->reported) {
+                        clock_gettime(CLOCK_REALTIME, &timespec);
+                        debug_output(MEDUSA_DEBUG_LEVEL_WARNING, MEDUSA_DEBUG_NAME, __FUNCTION__, __FILE__, __LINE__, &timespec, "log records dropped, ring is full");
+                        __atomic_add_fetch(&debug_async_dropped, dropped - ring->reported, __ATOMIC_RELAXED);
+                        ring->reported = dropped;
+                }
+                pthread_mutex_lock(&debug_async_mutex);
+                if (__atomic_load_n(&ring->exited, __ATOMIC_ACQUIRE) &&
+                    __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->tail) {
+                        TAILQ_REMOVE(&debug_async_rings, ring, tailq);
+                        free(ring);
+                }
+        }
+        pthread_mutex_unlock(&debug_async_mutex);
+        if (debug_callback_function == NULL) {
+                fflush(stderr);
+        }
+        pthread_mutex_unlock(&debug_drain_mutex);
+}
+
+static void * debug_async_worker (void *context)
+{
+        struct timespec timespec;
+        (void) context;
+        pthread_mutex_lock(&debug_async_mutex);
+        while (debug_async_running) {
+                clock_gettime(CLOCK_REALTIME, &timespec);
+                timespec.tv_nsec += DEBUG_FLUSH_INTERVAL;
+                if (timespec.tv_nsec >= 1000000000) {
+                        timespec.tv_sec  += 1;
+                        timespec.tv_nsec -= 1000000000;
+                }
+                pthread_cond_timedwait(&debug_async_cond, &debug_async_mutex, &timespec);
+                pthread_mutex_unlock(&debug_async_mutex);
+                debug_async_drain();
+                pthread_mutex_lock(&debug_async_mutex);
+        }
+        pthread_mutex_unlock(&debug_async_mutex);
+        return NULL;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_debug_set_async (int enabled)
+{
+        int rc;
+        int running;
+        sigset_t sigset;
+        sigset_t osigset;
+        pthread_mutex_lock(&debug_async_mutex);
+        running = debug_async_running;
+        if (enabled && !running) {
+                debug_async_running = 1;
+                sigfillset(&sigset);
+                pthread_sigmask(SIG_SETMASK, &sigset, &osigset);
+                rc = pthread_create(&debug_async_thread, NULL, debug_async_worker, NULL);
+                pthread_sigmask(SIG_SETMASK, &osigset, NULL);
+                if (rc != 0) {
+                        debug_async_running = 0;
+                        pthread_mutex_unlock(&debug_async_mutex);
+                        return -rc;
+                }
+        } else if (!enabled && running) {
+                debug_async_running = 0;
+                pthread_cond_signal(&debug_async_cond);
+        }
+        __atomic_store_n(&debug_async, !!enabled, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&debug_async_mutex);
+        if (!enabled && running) {
+                pthread_join(debug_async_thread, NULL);
+                debug_async_drain();
+        }
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_debug_flush (void)
+{
+        debug_async_drain();
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) unsigned long long medusa_debug_get_dropped (void)
+{
+        unsigned long long dropped;
+        struct debug_ring *ring;
+        pthread_mutex_lock(&debug_async_mutex);
+        dropped = __atomic_load_n(&debug_async_dropped, __ATOMIC_RELAXED);
+        TAILQ_FOREACH(ring, &debug_async_rings, tailq) {
+                dropped += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED) - ring->reported;
+        }
+        pthread_mutex_unlock(&debug_async_mutex);
+        return dropped;
+}
+
 int medusa_debug_printf (int level, const char *name, const char *function, const char *file, int line, const char *fmt, ...)
 {
         int rc;
         va_list ap;
 
-        struct timeval timeval;
-        struct tm *tm;
-        time_t seconds;
-        int milliseconds;
-        char date[80];
+        struct timespec timespec;
+
+        if (__atomic_load_n(&debug_async, __ATOMIC_ACQUIRE)) {
+                va_start(ap, fmt);
+                rc = debug_async_vprintf(level, name, function, file, line, fmt, ap);
+                va_end(ap);
+                if (rc == 0) {
+                        return 0;
+                }
+        }
 
         medusa_debug_lock();
 
@@ -95,7 +350,9 @@ int medusa_debug_printf (int level, const char *name, const char *function, cons
                 free(debug_buffer);
                 debug_buffer = malloc(rc + 1);
                 if (debug_buffer == NULL) {
-                        goto bail;
+                        debug_buffer_size = 0;
+                        medusa_debug_unlock();
+                        return -1;
                 }
                 debug_buffer_size = rc + 1;
                 va_start(ap, fmt);
@@ -107,21 +364,9 @@ int medusa_debug_printf (int level, const char *name, const char *function, cons
                 }
         }
 
-        gettimeofday(&timeval, NULL);
-
-        milliseconds = (int) ((timeval.tv_usec / 1000.0) + 0.5);
-        if (milliseconds >= 1000) {
-                milliseconds -= 1000;
-                timeval.tv_sec++;
-        }
-        seconds = timeval.tv_sec;
-        tm = localtime(&seconds);
-        strftime(date, sizeof(date), "%x-%H:%M:%S", tm);
-
-        if (debug_callback_function != NULL) {
-                debug_callback_function(debug_callback_context, "medusa:%s.%03d:%-8s:%-6s: %s (%s %s:%d)\n", date, milliseconds, name, medusa_debug_level_to_string(level), debug_buffer, function, file, line);
-        } else {
-                fprintf(stderr, "medusa:%s.%03d:%-8s:%-6s: %s (%s %s:%d)\n", date, milliseconds, name, medusa_debug_level_to_string(level), debug_buffer, function, file, line);
+        clock_gettime(CLOCK_REALTIME, &timespec);
+        debug_output(level, name, function, file, line, &timespec, debug_buffer);
+        if (debug_callback_function == NULL) {
                 fflush(stderr);
         }
 
@@ -143,6 +388,7 @@ int medusa_debug_set_callback (int (*function) (void *context, const char *forma
 
 __attribute__((destructor)) int medusa_debug_fini (void)
 {
+        medusa_debug_set_async(0);
         if (debug_buffer != NULL) {
                 free(debug_buffer);
         }
@@ -78,6 +78,10 @@ int medusa_debug_level_from_string (const char *string);
 int medusa_debug_printf (int level, const char *name, const char *function, const char *file, int line, const char *fmt, ...) __attribute__((format(printf, 6, 7)));
 int medusa_debug_set_callback (int (*function) (void *context, const char *format, ...), void *context);
 
+int medusa_debug_set_async (int enabled);
+int medusa_debug_flush (void);
+unsigned long long medusa_debug_get_dropped (void);
+
 void medusa_debug_lock (void);
 void medusa_debug_unlock (void);
 
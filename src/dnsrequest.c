@@ -3045,8 +3045,25 @@ __attribute__ ((visibility ("default"))) const char * medusa_dnsrequest_state_st
         return "MEDUSA_DNSREQUEST_STATE_UNKNOWN";
 }
 
+static int dnsrequest_subject_onevent (struct medusa_subject *subject, unsigned int events, void *param)
+{
+        return medusa_dnsrequest_onevent_unlocked((struct medusa_dnsrequest *) subject, events, param);
+}
+
+static int dnsrequest_subject_destroy (struct medusa_subject *subject)
+{
+        return medusa_dnsrequest_onevent_unlocked((struct medusa_dnsrequest *) subject, MEDUSA_DNSREQUEST_EVENT_DESTROY, NULL);
+}
+
+static const struct medusa_subject_type g_subject_type = {
+        .rank    = MEDUSA_SUBJECT_RANK_DNSREQUEST,
+        .onevent = dnsrequest_subject_onevent,
+        .destroy = dnsrequest_subject_destroy
+};
+
 __attribute__ ((constructor)) static void dnsrequest_constructor (void)
 {
+        medusa_monitor_register_subject_type(MEDUSA_SUBJECT_TYPE_DNSREQUEST, &g_subject_type);
 #if defined(MEDUSA_DNSREQUEST_USE_POOL) && (MEDUSA_DNSREQUEST_USE_POOL == 1)
         g_pool = medusa_pool_create("medusa-dnsrequest", sizeof(struct medusa_dnsrequest), 0, 0, MEDUSA_POOL_FLAG_DEFAULT | MEDUSA_POOL_FLAG_THREAD_SAFE, NULL, NULL, NULL);
 #endif
@@ -6,6 +6,7 @@ TAILQ_HEAD(medusa_dnsresolver_entries, medusa_dnsresolver_entry);
 struct medusa_dnsresolver_entry {
         struct timespec then;
         char *name;
+        unsigned int type;
         struct medusa_dnsrequest_reply_answers *answers;
         TAILQ_ENTRY(medusa_dnsresolver_entry) tailq;
 };
@@ -30,7 +31,9 @@ struct medusa_dnsresolver_lookup {
         int retried_count;
         struct medusa_timer *retry_interval_timer;
         struct medusa_timer *resolve_timeout_timer;
-        struct medusa_dnsrequest *dnsrequest;
+        struct medusa_dnsrequest *dnsrequests[2];
+        unsigned int pending;
+        unsigned int answered;
         TAILQ_ENTRY(medusa_dnsresolver_lookup) tailq;
         struct medusa_dnsresolver *dnsresolver;
 };
@@ -894,6 +894,17 @@ __attribute__ ((visibility ("default"))) const char * medusa_dnsresolver_state_s
 static inline unsigned int dnsresolver_lookup_get_state (const struct medusa_dnsresolver_lookup *dnsresolver_lookup);
 static inline int dnsresolver_lookup_set_state (struct medusa_dnsresolver_lookup *dnsresolver_lookup, unsigned int state, unsigned int error);
 
+static unsigned int dnsresolver_lookup_get_types (const struct medusa_dnsresolver_lookup *dnsresolver_lookup, unsigned int types[2]);
+static void dnsresolver_lookup_destroy_requests (struct medusa_dnsresolver_lookup *dnsresolver_lookup);
+
+static int dnsresolver_lookup_answered (struct medusa_dnsresolver_lookup *dnsresolver_lookup, unsigned int type, unsigned int pending)
+{
+        struct medusa_dnsresolver_lookup_event_answered medusa_dnsresolver_lookup_event_answered;
+        medusa_dnsresolver_lookup_event_answered.family  = (type == MEDUSA_DNSREQUEST_RECORD_TYPE_AAAA) ? MEDUSA_DNSRESOLVER_FAMILY_IPV6 : MEDUSA_DNSRESOLVER_FAMILY_IPV4;
+        medusa_dnsresolver_lookup_event_answered.pending = pending;
+        return medusa_dnsresolver_lookup_onevent_unlocked(dnsresolver_lookup, MEDUSA_DNSRESOLVER_LOOKUP_EVENT_ANSWERED, &medusa_dnsresolver_lookup_event_answered);
+}
+
 static int dnsrequest_onevent (struct medusa_dnsrequest *dnsrequest, unsigned int events, void *context, void *param)
 {
         const struct medusa_dnsrequest_reply *dnsrequest_reply;
@@ -902,6 +913,8 @@ static int dnsrequest_onevent (struct medusa_dnsrequest *dnsrequest, unsigned in
         const struct medusa_dnsrequest_reply_answer *dnsrequest_reply_answer;
 
         int rc;
+        unsigned int i;
+        unsigned int types[2];
         struct medusa_dnsresolver_lookup *dnsresolver_lookup = context;
         struct medusa_monitor *monitor = medusa_dnsresolver_lookup_get_monitor(dnsresolver_lookup);
 
@@ -909,6 +922,17 @@ static int dnsrequest_onevent (struct medusa_dnsrequest *dnsrequest, unsigned in
 
         medusa_monitor_lock(monitor);
 
+        i = 0;
+        if (dnsresolver_lookup != NULL) {
+                dnsresolver_lookup_get_types(dnsresolver_lookup, types);
+                while (i < 2 && dnsresolver_lookup->dnsrequests[i] != dnsrequest) {
+                        i++;
+                }
+                if (i >= 2) {
+                        goto out;
+                }
+        }
+
         if (events & MEDUSA_DNSREQUEST_EVENT_RECEIVED) {
                 int ttl;
                 dnsrequest_reply = medusa_dnsrequest_get_reply_unlocked(dnsrequest);
@@ -980,13 +1004,25 @@ static int dnsrequest_onevent (struct medusa_dnsrequest *dnsrequest, unsigned in
                                 dnsresolver_entry_destroy(entry);
                                 goto bail;
                         }
+                        entry->type = types[i];
                         TAILQ_INSERT_TAIL(&dnsresolver_lookup->dnsresolver->entries, entry, tailq);
                 }
-                rc = dnsresolver_lookup_set_state(dnsresolver_lookup, MEDUSA_DNSRESOLVER_LOOKUP_STATE_FINISHED, 0);
+                /* a and aaaa run side by side, each answer is handed out as
+                 * soon as it arrives, lookup finishes with the last one */
+                dnsresolver_lookup->pending &= ~(1U << i);
+                dnsresolver_lookup->answered += 1;
+                rc = dnsresolver_lookup_answered(dnsresolver_lookup, types[i], __builtin_popcount(dnsresolver_lookup->pending));
                 if (rc < 0) {
-                        medusa_errorf("dnsresolver_lookup_set_state failed, rc: %d", rc);
+                        medusa_errorf("dnsresolver_lookup_answered failed, rc: %d", rc);
                         goto bail;
                 }
+                if (dnsresolver_lookup->pending == 0) {
+                        rc = dnsresolver_lookup_set_state(dnsresolver_lookup, MEDUSA_DNSRESOLVER_LOOKUP_STATE_FINISHED, 0);
+                        if (rc < 0) {
+                                medusa_errorf("dnsresolver_lookup_set_state failed, rc: %d", rc);
+                                goto bail;
+                        }
+                }
         }
         if (events & MEDUSA_DNSREQUEST_EVENT_RESOLVE_TIMEOUT) {
                 goto error;
@@ -1002,19 +1038,84 @@ static int dnsrequest_onevent (struct medusa_dnsrequest *dnsrequest, unsigned in
         }
         if (events & MEDUSA_DNSREQUEST_EVENT_DESTROY) {
                 if (dnsresolver_lookup != NULL) {
-                        dnsresolver_lookup->dnsrequest = NULL;
+                        dnsresolver_lookup->dnsrequests[i] = NULL;
                 }
         }
 
-        medusa_monitor_unlock(monitor);
+out:    medusa_monitor_unlock(monitor);
         return 0;
-error:  dnsresolver_lookup_set_state(dnsresolver_lookup, MEDUSA_DNSRESOLVER_LOOKUP_STATE_ERROR, -EIO);
+error:  dnsresolver_lookup->pending &= ~(1U << i);
+        if (dnsresolver_lookup->pending == 0) {
+                if (dnsresolver_lookup->answered > 0) {
+                        dnsresolver_lookup_set_state(dnsresolver_lookup, MEDUSA_DNSRESOLVER_LOOKUP_STATE_FINISHED, 0);
+                } else {
+                        dnsresolver_lookup_set_state(dnsresolver_lookup, MEDUSA_DNSRESOLVER_LOOKUP_STATE_ERROR, -EIO);
+                }
+        }
         medusa_monitor_unlock(monitor);
         return 0;
 bail:   medusa_monitor_unlock(monitor);
         return -1;
 }
 
+static unsigned int dnsresolver_lookup_get_types (const struct medusa_dnsresolver_lookup *dnsresolver_lookup, unsigned int types[2])
+{
+        unsigned int ntypes;
+        ntypes = 0;
+        if (dnsresolver_lookup->family != MEDUSA_DNSRESOLVER_FAMILY_IPV6) {
+                types[ntypes++] = MEDUSA_DNSREQUEST_RECORD_TYPE_A;
+        }
+        if (dnsresolver_lookup->family != MEDUSA_DNSRESOLVER_FAMILY_IPV4) {
+                types[ntypes++] = MEDUSA_DNSREQUEST_RECORD_TYPE_AAAA;
+        }
+        return ntypes;
+}
+
+static int dnsresolver_lookup_request (struct medusa_dnsresolver_lookup *dnsresolver_lookup, unsigned int i, unsigned int type)
+{
+        int rc;
+        struct medusa_dnsrequest_init_options dnsrequest_init_options;
+        if (!MEDUSA_IS_ERR_OR_NULL(dnsresolver_lookup->dnsrequests[i])) {
+                return medusa_dnsrequest_lookup_unlocked(dnsresolver_lookup->dnsrequests[i]);
+        }
+        rc = medusa_dnsrequest_init_options_default(&dnsrequest_init_options);
+        if (rc < 0) {
+                return rc;
+        }
+        dnsrequest_init_options.monitor         = dnsresolver_lookup->subject.monitor;
+        dnsrequest_init_options.onevent         = dnsrequest_onevent;
+        dnsrequest_init_options.context         = dnsresolver_lookup;
+        dnsrequest_init_options.nameserver      = medusa_dnsresolver_lookup_get_nameserver_unlocked(dnsresolver_lookup);
+        dnsrequest_init_options.port            = medusa_dnsresolver_lookup_get_port_unlocked(dnsresolver_lookup);
+        dnsrequest_init_options.type            = type;
+        dnsrequest_init_options.name            = medusa_dnsresolver_lookup_get_name_unlocked(dnsresolver_lookup);
+        dnsrequest_init_options.id              = medusa_dnsresolver_lookup_get_id_unlocked(dnsresolver_lookup);
+        dnsrequest_init_options.resolve_timeout = -1;
+        dnsrequest_init_options.connect_timeout = -1;
+        dnsrequest_init_options.receive_timeout = -1;
+        dnsrequest_init_options.enabled         = 1;
+        dnsresolver_lookup->dnsrequests[i] = medusa_dnsrequest_create_with_options_unlocked(&dnsrequest_init_options);
+        if (MEDUSA_IS_ERR_OR_NULL(dnsresolver_lookup->dnsrequests[i])) {
+                rc = MEDUSA_PTR_ERR(dnsresolver_lookup->dnsrequests[i]);
+                dnsresolver_lookup->dnsrequests[i] = NULL;
+                return rc;
+        }
+        return 0;
+}
+
+static void dnsresolver_lookup_destroy_requests (struct medusa_dnsresolver_lookup *dnsresolver_lookup)
+{
+        unsigned int i;
+        for (i = 0; i < 2; i++) {
+                if (!MEDUSA_IS_ERR_OR_NULL(dnsresolver_lookup->dnsrequests[i])) {
+                        medusa_dnsrequest_set_context_unlocked(dnsresolver_lookup->dnsrequests[i], NULL);
+                        medusa_dnsrequest_destroy_unlocked(dnsresolver_lookup->dnsrequests[i]);
+                        dnsresolver_lookup->dnsrequests[i] = NULL;
+                }
+        }
+        dnsresolver_lookup->pending = 0;
+}
+
 static int retry_interval_timer_onevent (struct medusa_timer *timer, unsigned int events, void *context, void *param)
 {
         struct medusa_dnsresolver_lookup *dnsresolver_lookup = context;
@@ -1028,30 +1129,15 @@ static int retry_interval_timer_onevent (struct medusa_timer *timer, unsigned in
         if (events & MEDUSA_TIMER_EVENT_TIMEOUT) {
                 if (dnsresolver_lookup->retried_count < dnsresolver_lookup->retry_count) {
                         int rc;
-                        struct medusa_dnsrequest_init_options dnsrequest_init_options;
-                        if (MEDUSA_IS_ERR_OR_NULL(dnsresolver_lookup->dnsrequest)) {
-                                rc = medusa_dnsrequest_init_options_default(&dnsrequest_init_options);
-                                if (rc < 0) {
-                                        goto error;
-                                }
-                                dnsrequest_init_options.monitor         = dnsresolver_lookup->subject.monitor;
-                                dnsrequest_init_options.onevent         = dnsrequest_onevent;
-                                dnsrequest_init_options.context         = dnsresolver_lookup;
-                                dnsrequest_init_options.nameserver      = medusa_dnsresolver_lookup_get_nameserver_unlocked(dnsresolver_lookup);
-                                dnsrequest_init_options.port            = medusa_dnsresolver_lookup_get_port_unlocked(dnsresolver_lookup);
-                                dnsrequest_init_options.type            = MEDUSA_DNSREQUEST_RECORD_TYPE_A;
-                                dnsrequest_init_options.name            = medusa_dnsresolver_lookup_get_name_unlocked(dnsresolver_lookup);
-                                dnsrequest_init_options.id              = medusa_dnsresolver_lookup_get_id_unlocked(dnsresolver_lookup);
-                                dnsrequest_init_options.resolve_timeout = -1;
-                                dnsrequest_init_options.connect_timeout = -1;
-                                dnsrequest_init_options.receive_timeout = -1;
-                                dnsrequest_init_options.enabled         = 1;
-                                dnsresolver_lookup->dnsrequest = medusa_dnsrequest_create_with_options_unlocked(&dnsrequest_init_options);
-                                if (MEDUSA_IS_ERR_OR_NULL(dnsresolver_lookup->dnsrequest)) {
-                                        goto error;
+                        unsigned int i;
+                        unsigned int ntypes;
+                        unsigned int types[2];
+                        ntypes = dnsresolver_lookup_get_types(dnsresolver_lookup, types);
+                        for (i = 0; i < ntypes; i++) {
+                                if (!(dnsresolver_lookup->pending & (1U << i))) {
+                                        continue;
                                 }
-                        } else {
-                                rc = medusa_dnsrequest_lookup_unlocked(dnsresolver_lookup->dnsrequest);
+                                rc = dnsresolver_lookup_request(dnsresolver_lookup, i, types[i]);
                                 if (rc < 0) {
                                         goto error;
                                 }
@@ -1114,14 +1200,21 @@ static inline int dnsresolver_lookup_set_state (struct medusa_dnsresolver_lookup
         struct medusa_dnsresolver_lookup_event_state_changed medusa_dnsresolver_lookup_event_state_changed;
 
         if (state == MEDUSA_DNSRESOLVER_LOOKUP_STATE_STARTED) {
+                unsigned int i;
+                unsigned int ntypes;
+                unsigned int types[2];
+                unsigned int cached;
                 struct timespec now;
                 struct medusa_dnsresolver_entry *entry;
                 struct medusa_dnsresolver_entry *nentry;
-                struct medusa_dnsrequest_init_options dnsrequest_init_options;
+                struct medusa_dnsresolver_entry *entries[2];
 
+                ntypes = dnsresolver_lookup_get_types(dnsresolver_lookup, types);
+                cached = 0;
+                entries[0] = NULL;
+                entries[1] = NULL;
                 medusa_clock_monotonic_raw(&now);
                 TAILQ_FOREACH_SAFE(entry, &dnsresolver_lookup->dnsresolver->entries, tailq, nentry) {
-                        const struct medusa_dnsrequest_reply_answer *dnsrequest_reply_answer;
                         if (medusa_timespec_compare(&now, &entry->then, >=)) {
                                 TAILQ_REMOVE(&dnsresolver_lookup->dnsresolver->entries, entry, tailq);
                                 dnsresolver_entry_destroy(entry);
@@ -1130,33 +1223,48 @@ static inline int dnsresolver_lookup_set_state (struct medusa_dnsresolver_lookup
                         if (strcasecmp(entry->name, medusa_dnsresolver_lookup_get_name_unlocked(dnsresolver_lookup)) != 0) {
                                 continue;
                         }
+                        for (i = 0; i < ntypes; i++) {
+                                if (entries[i] == NULL && entry->type == types[i]) {
+                                        entries[i] = entry;
+                                        cached += 1;
+                                }
+                        }
+                }
+                if (cached == ntypes) {
                         rc = medusa_dnsresolver_lookup_onevent_unlocked(dnsresolver_lookup, MEDUSA_DNSRESOLVER_LOOKUP_EVENT_STARTED, NULL);
                         if (rc < 0) {
                                 return rc;
                         }
-                        for (dnsrequest_reply_answer = medusa_dnsrequest_reply_answers_get_first(entry->answers);
-                                dnsrequest_reply_answer != NULL;
-                                dnsrequest_reply_answer = medusa_dnsrequest_reply_answer_get_next(dnsrequest_reply_answer)) {
-                                struct medusa_dnsresolver_lookup_event_entry medusa_dnsresolver_lookup_event_entry;
-                                switch (medusa_dnsrequest_reply_answer_get_type(dnsrequest_reply_answer)) {
-                                        case MEDUSA_DNSREQUEST_RECORD_TYPE_A:
-                                                medusa_dnsresolver_lookup_event_entry.family   = MEDUSA_DNSRESOLVER_FAMILY_IPV4;
-                                                medusa_dnsresolver_lookup_event_entry.addreess = medusa_dnsrequest_reply_answer_a_get_address(dnsrequest_reply_answer);
-                                                medusa_dnsresolver_lookup_event_entry.ttl      = medusa_dnsrequest_reply_answer_get_ttl(dnsrequest_reply_answer);
-                                                rc = medusa_dnsresolver_lookup_onevent_unlocked(dnsresolver_lookup, MEDUSA_DNSRESOLVER_LOOKUP_EVENT_ENTRY, &medusa_dnsresolver_lookup_event_entry);
-                                                if (rc < 0) {
-                                                        return rc;
-                                                }
-                                                break;
-                                        case MEDUSA_DNSREQUEST_RECORD_TYPE_AAAA:
-                                                medusa_dnsresolver_lookup_event_entry.family   = MEDUSA_DNSRESOLVER_FAMILY_IPV6;
-                                                medusa_dnsresolver_lookup_event_entry.addreess = medusa_dnsrequest_reply_answer_aaaa_get_address(dnsrequest_reply_answer);
-                                                medusa_dnsresolver_lookup_event_entry.ttl      = medusa_dnsrequest_reply_answer_get_ttl(dnsrequest_reply_answer);
-                                                rc = medusa_dnsresolver_lookup_onevent_unlocked(dnsresolver_lookup, MEDUSA_DNSRESOLVER_LOOKUP_EVENT_ENTRY, &medusa_dnsresolver_lookup_event_entry);
-                                                if (rc < 0) {
-                                                        return rc;
-                                                }
-                                                break;
+                        for (i = 0; i < ntypes; i++) {
+                                const struct medusa_dnsrequest_reply_answer *dnsrequest_reply_answer;
+                                for (dnsrequest_reply_answer = medusa_dnsrequest_reply_answers_get_first(entries[i]->answers);
+                                        dnsrequest_reply_answer != NULL;
+                                        dnsrequest_reply_answer = medusa_dnsrequest_reply_answer_get_next(dnsrequest_reply_answer)) {
+                                        struct medusa_dnsresolver_lookup_event_entry medusa_dnsresolver_lookup_event_entry;
+                                        switch (medusa_dnsrequest_reply_answer_get_type(dnsrequest_reply_answer)) {
+                                                case MEDUSA_DNSREQUEST_RECORD_TYPE_A:
+                                                        medusa_dnsresolver_lookup_event_entry.family   = MEDUSA_DNSRESOLVER_FAMILY_IPV4;
+                                                        medusa_dnsresolver_lookup_event_entry.addreess = medusa_dnsrequest_reply_answer_a_get_address(dnsrequest_reply_answer);
+                                                        medusa_dnsresolver_lookup_event_entry.ttl      = medusa_dnsrequest_reply_answer_get_ttl(dnsrequest_reply_answer);
+                                                        rc = medusa_dnsresolver_lookup_onevent_unlocked(dnsresolver_lookup, MEDUSA_DNSRESOLVER_LOOKUP_EVENT_ENTRY, &medusa_dnsresolver_lookup_event_entry);
+                                                        if (rc < 0) {
+                                                                return rc;
+                                                        }
+                                                        break;
+                                                case MEDUSA_DNSREQUEST_RECORD_TYPE_AAAA:
+                                                        medusa_dnsresolver_lookup_event_entry.family   = MEDUSA_DNSRESOLVER_FAMILY_IPV6;
+                                                        medusa_dnsresolver_lookup_event_entry.addreess = medusa_dnsrequest_reply_answer_aaaa_get_address(dnsrequest_reply_answer);
+                                                        medusa_dnsresolver_lookup_event_entry.ttl      = medusa_dnsrequest_reply_answer_get_ttl(dnsrequest_reply_answer);
+                                                        rc = medusa_dnsresolver_lookup_onevent_unlocked(dnsresolver_lookup, MEDUSA_DNSRESOLVER_LOOKUP_EVENT_ENTRY, &medusa_dnsresolver_lookup_event_entry);
+                                                        if (rc < 0) {
+                                                                return rc;
+                                                        }
+                                                        break;
+                                        }
+                                }
+                                rc = dnsresolver_lookup_answered(dnsresolver_lookup, types[i], ntypes - i - 1);
+                                if (rc < 0) {
+                                        return rc;
                                 }
                         }
                         rc = dnsresolver_lookup_set_state(dnsresolver_lookup, MEDUSA_DNSRESOLVER_LOOKUP_STATE_FINISHED, 0);
@@ -1166,25 +1274,14 @@ static inline int dnsresolver_lookup_set_state (struct medusa_dnsresolver_lookup
                         return 0;
                 }
 
-                rc = medusa_dnsrequest_init_options_default(&dnsrequest_init_options);
-                if (rc < 0) {
-                        return rc;
-                }
-                dnsrequest_init_options.monitor         = dnsresolver_lookup->subject.monitor;
-                dnsrequest_init_options.onevent         = dnsrequest_onevent;
-                dnsrequest_init_options.context         = dnsresolver_lookup;
-                dnsrequest_init_options.nameserver      = medusa_dnsresolver_lookup_get_nameserver_unlocked(dnsresolver_lookup);
-                dnsrequest_init_options.port            = medusa_dnsresolver_lookup_get_port_unlocked(dnsresolver_lookup);
-                dnsrequest_init_options.type            = MEDUSA_DNSREQUEST_RECORD_TYPE_A;
-                dnsrequest_init_options.name            = medusa_dnsresolver_lookup_get_name_unlocked(dnsresolver_lookup);
-                dnsrequest_init_options.id              = medusa_dnsresolver_lookup_get_id_unlocked(dnsresolver_lookup);;
-                dnsrequest_init_options.resolve_timeout = -1;
-                dnsrequest_init_options.connect_timeout = -1;
-                dnsrequest_init_options.receive_timeout = -1;
-                dnsrequest_init_options.enabled         = 1;
-                dnsresolver_lookup->dnsrequest = medusa_dnsrequest_create_with_options_unlocked(&dnsrequest_init_options);
-                if (MEDUSA_IS_ERR_OR_NULL(dnsresolver_lookup->dnsrequest)) {
-                        return MEDUSA_PTR_ERR(dnsresolver_lookup->dnsrequest);
+                /* a and aaaa are asked at once, not one after the other */
+                dnsresolver_lookup->pending  = (1U << ntypes) - 1;
+                dnsresolver_lookup->answered = 0;
+                for (i = 0; i < ntypes; i++) {
+                        rc = dnsresolver_lookup_request(dnsresolver_lookup, i, types[i]);
+                        if (rc < 0) {
+                                return rc;
+                        }
                 }
                 if (dnsresolver_lookup->retry_interval >= 0) {
                         struct medusa_timer_init_options timer_init_options;
@@ -1240,11 +1337,7 @@ static inline int dnsresolver_lookup_set_state (struct medusa_dnsresolver_lookup
                         medusa_timer_destroy_unlocked(dnsresolver_lookup->retry_interval_timer);
                         dnsresolver_lookup->retry_interval_timer = NULL;
                 }
-                if (!MEDUSA_IS_ERR_OR_NULL(dnsresolver_lookup->dnsrequest)) {
-                        medusa_dnsrequest_set_context_unlocked(dnsresolver_lookup->dnsrequest, NULL);
-                        medusa_dnsrequest_destroy_unlocked(dnsresolver_lookup->dnsrequest);
-                        dnsresolver_lookup->dnsrequest = NULL;
-                }
+                dnsresolver_lookup_destroy_requests(dnsresolver_lookup);
                 rc = medusa_dnsresolver_lookup_onevent_unlocked(dnsresolver_lookup, MEDUSA_DNSRESOLVER_LOOKUP_EVENT_STOPPED, NULL);
                 if (rc < 0) {
                         return rc;
@@ -1260,11 +1353,7 @@ static inline int dnsresolver_lookup_set_state (struct medusa_dnsresolver_lookup
                         medusa_timer_destroy_unlocked(dnsresolver_lookup->retry_interval_timer);
                         dnsresolver_lookup->retry_interval_timer = NULL;
                 }
-                if (!MEDUSA_IS_ERR_OR_NULL(dnsresolver_lookup->dnsrequest)) {
-                        medusa_dnsrequest_set_context_unlocked(dnsresolver_lookup->dnsrequest, NULL);
-                        medusa_dnsrequest_destroy_unlocked(dnsresolver_lookup->dnsrequest);
-                        dnsresolver_lookup->dnsrequest = NULL;
-                }
+                dnsresolver_lookup_destroy_requests(dnsresolver_lookup);
                 rc = medusa_dnsresolver_lookup_onevent_unlocked(dnsresolver_lookup, MEDUSA_DNSRESOLVER_LOOKUP_EVENT_FINISHED, NULL);
                 if (rc < 0) {
                         return rc;
@@ -1280,11 +1369,7 @@ static inline int dnsresolver_lookup_set_state (struct medusa_dnsresolver_lookup
                         medusa_timer_destroy_unlocked(dnsresolver_lookup->retry_interval_timer);
                         dnsresolver_lookup->retry_interval_timer = NULL;
                 }
-                if (!MEDUSA_IS_ERR_OR_NULL(dnsresolver_lookup->dnsrequest)) {
-                        medusa_dnsrequest_set_context_unlocked(dnsresolver_lookup->dnsrequest, NULL);
-                        medusa_dnsrequest_destroy_unlocked(dnsresolver_lookup->dnsrequest);
-                        dnsresolver_lookup->dnsrequest = NULL;
-                }
+                dnsresolver_lookup_destroy_requests(dnsresolver_lookup);
                 rc = medusa_dnsresolver_lookup_onevent_unlocked(dnsresolver_lookup, MEDUSA_DNSRESOLVER_LOOKUP_EVENT_TIMEDOUT, NULL);
                 if (rc < 0) {
                         return rc;
@@ -1301,11 +1386,7 @@ static inline int dnsresolver_lookup_set_state (struct medusa_dnsresolver_lookup
                         medusa_timer_destroy_unlocked(dnsresolver_lookup->retry_interval_timer);
                         dnsresolver_lookup->retry_interval_timer = NULL;
                 }
-                if (!MEDUSA_IS_ERR_OR_NULL(dnsresolver_lookup->dnsrequest)) {
-                        medusa_dnsrequest_set_context_unlocked(dnsresolver_lookup->dnsrequest, NULL);
-                        medusa_dnsrequest_destroy_unlocked(dnsresolver_lookup->dnsrequest);
-                        dnsresolver_lookup->dnsrequest = NULL;
-                }
+                dnsresolver_lookup_destroy_requests(dnsresolver_lookup);
                 medusa_dnsresolver_event_error.state = dnsresolver_lookup->state;
                 medusa_dnsresolver_event_error.error = error;
                 rc = medusa_dnsresolver_lookup_onevent_unlocked(dnsresolver_lookup, MEDUSA_DNSRESOLVER_LOOKUP_EVENT_ERROR, &medusa_dnsresolver_event_error);
@@ -2065,11 +2146,7 @@ __attribute__ ((visibility ("default"))) int medusa_dnsresolver_lookup_onevent_u
                         medusa_timer_destroy_unlocked(dnsresolver_lookup->retry_interval_timer);
                         dnsresolver_lookup->retry_interval_timer = NULL;
                 }
-                if (!MEDUSA_IS_ERR_OR_NULL(dnsresolver_lookup->dnsrequest)) {
-                        medusa_dnsrequest_set_context_unlocked(dnsresolver_lookup->dnsrequest, NULL);
-                        medusa_dnsrequest_destroy_unlocked(dnsresolver_lookup->dnsrequest);
-                        dnsresolver_lookup->dnsrequest = NULL;
-                }
+                dnsresolver_lookup_destroy_requests(dnsresolver_lookup);
                 if (dnsresolver_lookup->dnsresolver != NULL) {
                         TAILQ_REMOVE(&dnsresolver_lookup->dnsresolver->lookups, dnsresolver_lookup, tailq);
                         dnsresolver_lookup->dnsresolver = NULL;
@@ -2191,6 +2268,7 @@ __attribute__ ((visibility ("default"))) const char * medusa_dnsresolver_lookup_
         if (events == MEDUSA_DNSRESOLVER_LOOKUP_EVENT_ERROR)            return "MEDUSA_DNSRESOLVER_LOOKUP_EVENT_ERROR";
         if (events == MEDUSA_DNSRESOLVER_LOOKUP_EVENT_STATE_CHANGED)    return "MEDUSA_DNSRESOLVER_LOOKUP_EVENT_STATE_CHANGED";
         if (events == MEDUSA_DNSRESOLVER_LOOKUP_EVENT_DESTROY)          return "MEDUSA_DNSRESOLVER_LOOKUP_EVENT_DESTROY";
+        if (events == MEDUSA_DNSRESOLVER_LOOKUP_EVENT_ANSWERED)         return "MEDUSA_DNSRESOLVER_LOOKUP_EVENT_ANSWERED";
         return "MEDUSA_DNSRESOLVER_LOOKUP_EVENT_UNKNOWN";
 }
 
@@ -2203,8 +2281,42 @@ __attribute__ ((visibility ("default"))) const char * medusa_dnsresolver_lookup_
         return "MEDUSA_DNSRESOLVER_LOOKUP_STATE_UNKNOWN";
 }
 
+static int dnsresolver_subject_onevent (struct medusa_subject *subject, unsigned int events, void *param)
+{
+        return medusa_dnsresolver_onevent_unlocked((struct medusa_dnsresolver *) subject, events, param);
+}
+
+static int dnsresolver_subject_destroy (struct medusa_subject *subject)
+{
+        return medusa_dnsresolver_onevent_unlocked((struct medusa_dnsresolver *) subject, MEDUSA_DNSRESOLVER_EVENT_DESTROY, NULL);
+}
+
+static const struct medusa_subject_type g_subject_type_dnsresolver = {
+        .rank    = MEDUSA_SUBJECT_RANK_DNSRESOLVER,
+        .onevent = dnsresolver_subject_onevent,
+        .destroy = dnsresolver_subject_destroy
+};
+
+static int dnsresolver_lookup_subject_onevent (struct medusa_subject *subject, unsigned int events, void *param)
+{
+        return medusa_dnsresolver_lookup_onevent_unlocked((struct medusa_dnsresolver_lookup *) subject, events, param);
+}
+
+static int dnsresolver_lookup_subject_destroy (struct medusa_subject *subject)
+{
+        return medusa_dnsresolver_lookup_onevent_unlocked((struct medusa_dnsresolver_lookup *) subject, MEDUSA_DNSRESOLVER_LOOKUP_EVENT_DESTROY, NULL);
+}
+
+static const struct medusa_subject_type g_subject_type_dnsresolver_lookup = {
+        .rank    = MEDUSA_SUBJECT_RANK_DNSRESOLVER_LOOKUP,
+        .onevent = dnsresolver_lookup_subject_onevent,
+        .destroy = dnsresolver_lookup_subject_destroy
+};
+
 __attribute__ ((constructor)) static void dnsresolver_constructor (void)
 {
+        medusa_monitor_register_subject_type(MEDUSA_SUBJECT_TYPE_DNSRESOLVER, &g_subject_type_dnsresolver);
+        medusa_monitor_register_subject_type(MEDUSA_SUBJECT_TYPE_DNSRESOLVER_LOOKUP, &g_subject_type_dnsresolver_lookup);
 #if defined(MEDUSA_DNSRESOLVER_USE_POOL) && (MEDUSA_DNSRESOLVER_USE_POOL == 1)
         g_pool_dnsresolver = medusa_pool_create("medusa-dnsresolver", sizeof(struct medusa_dnsresolver), 0, 0, MEDUSA_POOL_FLAG_DEFAULT | MEDUSA_POOL_FLAG_THREAD_SAFE, NULL, NULL, NULL);
         g_pool_dnsresolver_lookup = medusa_pool_create("medusa-dnsresolver-lookup", sizeof(struct medusa_dnsresolver_lookup), 0, 0, MEDUSA_POOL_FLAG_DEFAULT | MEDUSA_POOL_FLAG_THREAD_SAFE, NULL, NULL, NULL);
@@ -47,7 +47,8 @@ enum {
         MEDUSA_DNSRESOLVER_LOOKUP_EVENT_TIMEDOUT        = (1 << 4),
         MEDUSA_DNSRESOLVER_LOOKUP_EVENT_ERROR           = (1 << 5),
         MEDUSA_DNSRESOLVER_LOOKUP_EVENT_STATE_CHANGED   = (1 << 6),
-        MEDUSA_DNSRESOLVER_LOOKUP_EVENT_DESTROY         = (1 << 7)
+        MEDUSA_DNSRESOLVER_LOOKUP_EVENT_DESTROY         = (1 << 7),
+        MEDUSA_DNSRESOLVER_LOOKUP_EVENT_ANSWERED        = (1 << 8)
 #define MEDUSA_DNSRESOLVER_LOOKUP_EVENT_STARTED         MEDUSA_DNSRESOLVER_LOOKUP_EVENT_STARTED
 #define MEDUSA_DNSRESOLVER_LOOKUP_EVENT_STOPPED         MEDUSA_DNSRESOLVER_LOOKUP_EVENT_STOPPED
 #define MEDUSA_DNSRESOLVER_LOOKUP_EVENT_ENTRY           MEDUSA_DNSRESOLVER_LOOKUP_EVENT_ENTRY
@@ -56,6 +57,7 @@ enum {
 #define MEDUSA_DNSRESOLVER_LOOKUP_EVENT_ERROR           MEDUSA_DNSRESOLVER_LOOKUP_EVENT_ERROR
 #define MEDUSA_DNSRESOLVER_LOOKUP_EVENT_STATE_CHANGED   MEDUSA_DNSRESOLVER_LOOKUP_EVENT_STATE_CHANGED
 #define MEDUSA_DNSRESOLVER_LOOKUP_EVENT_DESTROY         MEDUSA_DNSRESOLVER_LOOKUP_EVENT_DESTROY
+#define MEDUSA_DNSRESOLVER_LOOKUP_EVENT_ANSWERED        MEDUSA_DNSRESOLVER_LOOKUP_EVENT_ANSWERED
 };
 
 enum {
@@ -118,6 +120,13 @@ struct medusa_dnsresolver_lookup_event_entry {
         int ttl;
 };
 
+/* raised after the entries of one record type, pending is the number of
+ * record types still outstanding */
+struct medusa_dnsresolver_lookup_event_answered {
+        unsigned int family;
+        unsigned int pending;
+};
+
 struct medusa_dnsresolver_lookup_event_error {
         unsigned int state;
         unsigned int error;
@@ -14,6 +14,12 @@ int medusa_exec_get_wstatus_unlocked (const struct medusa_exec *exec);
 int medusa_exec_set_enabled_unlocked (struct medusa_exec *exec, int enabled);
 int medusa_exec_get_enabled_unlocked (const struct medusa_exec *exec);
 
+struct medusa_buffer * medusa_exec_get_stdin_buffer_unlocked (struct medusa_exec *exec);
+struct medusa_buffer * medusa_exec_get_stdout_buffer_unlocked (struct medusa_exec *exec);
+struct medusa_buffer * medusa_exec_get_stderr_buffer_unlocked (struct medusa_exec *exec);
+
+int medusa_exec_close_stdin_unlocked (struct medusa_exec *exec);
+
 int medusa_exec_set_context_unlocked (struct medusa_exec *exec, void *context);
 void * medusa_exec_get_context_unlocked (struct medusa_exec *exec);
 
@@ -19,7 +19,13 @@ struct medusa_exec {
         void *context;
         pid_t pid;
         int wstatus;
-        struct medusa_timer *timer;
+        unsigned int stdio;
+        int stdin_close;
+        struct medusa_io *sio[3];
+        struct medusa_buffer *sbuffer[3];
+        struct medusa_io *io;
+        int wfd;
+        TAILQ_ENTRY(medusa_exec) sigchld;
         void *userdata;
 };
 
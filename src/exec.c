@@ -14,6 +14,11 @@
 
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <signal.h>
+#include <sched.h>
+#include <poll.h>
 
 #include <sys/prctl.h>
 
@@ -25,10 +30,16 @@
 #include "error.h"
 #include "pool.h"
 #include "queue.h"
-#include "timer.h"
-#include "timer-private.h"
+#include "iovec.h"
+#include "buffer.h"
+#include "pipe.h"
+#include "io.h"
+#include "io-private.h"
 #include "monitor.h"
 #include "monitor-private.h"
+#if defined(MEDUSA_SIGNAL_SIGNALFD_ENABLE) && (MEDUSA_SIGNAL_SIGNALFD_ENABLE == 1)
+#include "signal-signalfd.h"
+#endif
 
 #include "subject-struct.h"
 #include "exec-struct.h"
@@ -57,6 +68,100 @@ static inline void exec_set_enabled (struct medusa_exec *exec, unsigned int enab
                       ((enabled & MEDUSA_EXEC_ENABLE_MASK) << MEDUSA_EXEC_ENABLE_SHIFT);
 }
 
+#define MEDUSA_EXEC_SPAWN_STACK_SIZE      (256 * 1024)
+#define MEDUSA_EXEC_STDIO_READ_SIZE       (16 * 1024)
+
+struct exec_spawn {
+        char * const *args;
+        char * const *env;
+        int *io;
+        int null;
+        int uid;
+        int gid;
+        sigset_t sigmask;
+};
+
+/* runs in the child, which shares the address space of the parent when it
+ * is created with clone(CLONE_VM | CLONE_VFORK); so only async signal safe
+ * calls are allowed here, and nothing that touches parent memory. */
+static int exec_spawn_child (void *context)
+{
+        int i;
+        int rc;
+        struct sigaction sa;
+        struct sigaction osa;
+        struct exec_spawn *spawn = (struct exec_spawn *) context;
+        memset(&sa, 0, sizeof(struct sigaction));
+        sa.sa_handler = SIG_DFL;
+        sigemptyset(&sa.sa_mask);
+        for (i = 1; i < NSIG; i++) {
+                rc = sigaction(i, NULL, &osa);
+                if (rc < 0) {
+                        continue;
+                }
+                if (!(osa.sa_flags & SA_SIGINFO) &&
+                    (osa.sa_handler == SIG_DFL || osa.sa_handler == SIG_IGN)) {
+                        continue;
+                }
+                sigaction(i, &sa, NULL);
+        }
+        sigprocmask(SIG_SETMASK, &spawn->sigmask, NULL);
+        /* the libc wrappers of setgid() and setuid() would try to apply
+         * the change to every thread of the parent. */
+        if (spawn->gid >= 0) {
+                rc = syscall(SYS_setgid, spawn->gid);
+                if (rc < 0) {
+                        _exit(-1);
+                }
+        }
+        if (spawn->uid >= 0) {
+                rc = syscall(SYS_setuid, spawn->uid);
+                if (rc < 0) {
+                        _exit(-1);
+                }
+        }
+        setpgid(0, 0);
+        for (i = 0; i < 3; i++) {
+                /* dup2() onto itself keeps close on exec set, clear it by
+                 * hand when the descriptor is already in place */
+                if (spawn->io == NULL ||
+                    spawn->io[i] < 0) {
+                        if (spawn->null == i) {
+                                rc = fcntl(i, F_SETFD, 0);
+                        } else {
+                                rc = dup2(spawn->null, i);
+                        }
+                        if (rc < 0) {
+                                _exit(-1);
+                        }
+                } else if (spawn->io[i] != i) {
+                        rc = dup2(spawn->io[i], i);
+                        if (rc < 0) {
+                                _exit(-1);
+                        }
+                        close(spawn->io[i]);
+                } else {
+                        rc = fcntl(i, F_SETFD, 0);
+                        if (rc < 0) {
+                                _exit(-1);
+                        }
+                }
+        }
+        if (spawn->null > 2) {
+                close(spawn->null);
+        }
+        rc = prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if (rc == -1) {
+                _exit(-1);
+        }
+        if (getppid() == 1) {
+                _exit(-1);
+        }
+        execvpe(spawn->args[0], spawn->args, (spawn->env != NULL) ? (spawn->env) : (environ));
+        _exit(-1);
+        return -1;
+}
+
 static pid_t exec_exec (char * const *args, char * const *environment, int *io, int uid, int gid)
 {
         int i;
@@ -64,7 +169,14 @@ static pid_t exec_exec (char * const *args, char * const *environment, int *io,
         int n;
         const char **env;
         pid_t pid;
+        sigset_t set;
+        sigset_t oset;
+        struct exec_spawn spawn;
+#if defined(__linux__)
+        void *stack;
+#endif
 
+        pid = -1;
         n = -1;
         env = NULL;
 
@@ -102,7 +214,7 @@ static pid_t exec_exec (char * const *args, char * const *environment, int *io,
         for (i = 0; i < 3; i++) {
                 if (io == NULL ||
                     io[i] < 0) {
-                        n = open("/dev/null", O_RDWR);
+                        n = open("/dev/null", O_RDWR | O_CLOEXEC);
                         if (n < 0) {
                                 goto bail;
                         }
@@ -110,130 +222,621 @@ static pid_t exec_exec (char * const *args, char * const *environment, int *io,
                 }
         }
 
-        if ((pid = fork()) > 0) {
-                if (env != NULL) {
-                        free(env);
+        spawn.args = args;
+        spawn.env  = (char * const *) env;
+        spawn.io   = io;
+        spawn.null = n;
+        spawn.uid  = uid;
+        spawn.gid  = gid;
+
+        /* signal handlers must not run in the child before they are reset,
+         * so everything is blocked until then. */
+        sigfillset(&set);
+        pthread_sigmask(SIG_SETMASK, &set, &oset);
+        spawn.sigmask = oset;
+#if defined(MEDUSA_SIGNAL_SIGNALFD_ENABLE) && (MEDUSA_SIGNAL_SIGNALFD_ENABLE == 1)
+        /* signals blocked for signalfd belong to the monitor, not to the
+         * program that is started */
+        medusa_signal_signalfd_sigmask_child(&spawn.sigmask);
+#endif
+#if defined(__linux__)
+        stack = mmap(NULL, MEDUSA_EXEC_SPAWN_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+        if (stack != MAP_FAILED) {
+                pid = clone(exec_spawn_child, (char *) stack + MEDUSA_EXEC_SPAWN_STACK_SIZE, CLONE_VM | CLONE_VFORK | SIGCHLD, &spawn);
+                munmap(stack, MEDUSA_EXEC_SPAWN_STACK_SIZE);
+        } else {
+                /* no memory for a child stack, copy the parent instead */
+                pid = fork();
+                if (pid == 0) {
+                        exec_spawn_child(&spawn);
                 }
+        }
+#else
+        pid = fork();
+        if (pid == 0) {
+                exec_spawn_child(&spawn);
+        }
+#endif
+        pthread_sigmask(SIG_SETMASK, &oset, NULL);
+
+bail:   if (n >= 0) {
                 close(n);
-                return pid;
-        } else if (pid == 0) {
-                int i;
-                int rc;
-                if (uid >= 0) {
-                        rc = setuid(uid);
-                        if (rc < 0) {
-                                exit(-1);
-                        }
+        }
+        if (env != NULL) {
+                free(env);
+        }
+        return pid;
+}
+
+static pid_t exec_waitpid (pid_t pid, int *status)
+{
+        return waitpid(pid, status, WNOHANG);
+}
+
+static int exec_kill (pid_t pid, int sig)
+{
+        return kill((pid < 0) ? pid : -pid, sig);
+}
+
+static int exec_pidfd_open (pid_t pid)
+{
+#if defined(SYS_pidfd_open)
+        return syscall(SYS_pidfd_open, pid, 0);
+#elif defined(__NR_pidfd_open)
+        return syscall(__NR_pidfd_open, pid, 0);
+#else
+        (void) pid;
+        errno = ENOSYS;
+        return -1;
+#endif
+}
+
+/* kernels without pidfd_open() get a process wide SIGCHLD handler. the
+ * handler only sets a pending flag and kicks one global wakeup pipe, no
+ * locks, no list walks. a helper thread waits on that pipe and kicks the
+ * wakeup pipe of every exec waiting for a child. the helper runs while
+ * there are execs to wake, and is joined when the last one goes away. the
+ * pipe is created once and kept for the life of the process, so a handler
+ * still running after the old action is restored never sees a closed
+ * descriptor. */
+
+TAILQ_HEAD(exec_sigchld_list, medusa_exec);
+static struct exec_sigchld_list g_sigchld_list = TAILQ_HEAD_INITIALIZER(g_sigchld_list);
+static pthread_mutex_t g_sigchld_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t g_sigchld_worker_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t g_sigchld_worker;
+static struct sigaction g_sigchld_sa;
+static int g_sigchld_pending;
+static int g_sigchld_stop;
+static int g_sigchld_wakeup_fds[2] = { -1, -1 };
+static int g_sigchld_wakeup_write_fd = -1;
+
+static void exec_sigchld_handler (int number, siginfo_t *info, void *ucontext)
+{
+        int rc;
+        int fd;
+        int error;
+        error = errno;
+        if (__atomic_exchange_n(&g_sigchld_pending, 1, __ATOMIC_ACQ_REL) == 0) {
+                fd = __atomic_load_n(&g_sigchld_wakeup_write_fd, __ATOMIC_ACQUIRE);
+                if (fd >= 0) {
+                        rc = write(fd, "c", 1);
+                        (void) rc;
                 }
-                if (gid >= 0) {
-                        rc = setgid(gid);
-                        if (rc < 0) {
-                                exit(-1);
-                        }
+        }
+        if (g_sigchld_sa.sa_flags & SA_SIGINFO) {
+                if (g_sigchld_sa.sa_sigaction != NULL) {
+                        g_sigchld_sa.sa_sigaction(number, info, ucontext);
                 }
-                setpgid(0, 0);
-                setvbuf(stdout, NULL, _IONBF, 0);
-                setvbuf(stderr, NULL, _IONBF, 0);
-                fflush(stdin);
-                fflush(stdout);
-                fflush(stderr);
-                for (i = 0; i < 3; i++) {
-                        if (io == NULL ||
-                            io[i] < 0) {
-                                rc = dup2(n, i);
-                                if (rc < 0) {
-                                        exit(-1);
-                                }
-                        } else {
-                                rc = dup2(io[i], i);
-                                if (rc < 0) {
-                                        exit(-1);
-                                }
-                                close(io[i]);
+        } else if ((g_sigchld_sa.sa_handler != SIG_DFL) &&
+                   (g_sigchld_sa.sa_handler != SIG_IGN)) {
+                g_sigchld_sa.sa_handler(number);
+        }
+        errno = error;
+}
+
+static void * exec_sigchld_worker (void *arg)
+{
+        int rc;
+        unsigned char c[64];
+        struct pollfd pfd;
+        struct medusa_exec *exec;
+        (void) arg;
+        pfd.fd     = g_sigchld_wakeup_fds[0];
+        pfd.events = POLLIN;
+        while (1) {
+                rc = poll(&pfd, 1, -1);
+                if (rc < 0 && errno != EINTR) {
+                        break;
+                }
+                while (read(g_sigchld_wakeup_fds[0], c, sizeof(c)) > 0) {
+                        ;
+                }
+                if (__atomic_load_n(&g_sigchld_stop, __ATOMIC_ACQUIRE)) {
+                        break;
+                }
+                /* cleared before the walk, a child exiting meanwhile kicks
+                 * the pipe again */
+                __atomic_store_n(&g_sigchld_pending, 0, __ATOMIC_RELEASE);
+                pthread_mutex_lock(&g_sigchld_mutex);
+                TAILQ_FOREACH(exec, &g_sigchld_list, sigchld) {
+                        rc = write(exec->wfd, "", 1);
+                        (void) rc;
+                }
+                pthread_mutex_unlock(&g_sigchld_mutex);
+        }
+        return NULL;
+}
+
+static int exec_sigchld_worker_start (void)
+{
+        int rc;
+        sigset_t set;
+        sigset_t oset;
+        if (g_sigchld_wakeup_fds[0] < 0) {
+                rc = medusa_pipe2(g_sigchld_wakeup_fds, MEDUSA_PIPE_FLAG_NONBLOCK | MEDUSA_PIPE_FLAG_CLOEXEC);
+                if (rc != 0) {
+                        g_sigchld_wakeup_fds[0] = -1;
+                        g_sigchld_wakeup_fds[1] = -1;
+                        return -errno;
+                }
+                __atomic_store_n(&g_sigchld_wakeup_write_fd, g_sigchld_wakeup_fds[1], __ATOMIC_RELEASE);
+        }
+        __atomic_store_n(&g_sigchld_stop, 0, __ATOMIC_RELEASE);
+        /* the worker must not take signals meant for the monitor */
+        sigfillset(&set);
+        pthread_sigmask(SIG_SETMASK, &set, &oset);
+        rc = pthread_create(&g_sigchld_worker, NULL, exec_sigchld_worker, NULL);
+        pthread_sigmask(SIG_SETMASK, &oset, NULL);
+        if (rc != 0) {
+                return -rc;
+        }
+        return 0;
+}
+
+static void exec_sigchld_worker_stop (void)
+{
+        int rc;
+        __atomic_store_n(&g_sigchld_stop, 1, __ATOMIC_RELEASE);
+        rc = write(g_sigchld_wakeup_fds[1], "s", 1);
+        (void) rc;
+        pthread_join(g_sigchld_worker, NULL);
+}
+
+static int exec_sigchld_add (struct medusa_exec *exec)
+{
+        int rc;
+        struct sigaction sa;
+        /* the list only changes with the worker mutex held, the worker
+         * itself takes just the list mutex, so it can be joined here */
+        pthread_mutex_lock(&g_sigchld_worker_mutex);
+        if (TAILQ_EMPTY(&g_sigchld_list)) {
+                rc = exec_sigchld_worker_start();
+                if (rc < 0) {
+                        goto bail;
+                }
+                memset(&sa, 0, sizeof(struct sigaction));
+                sa.sa_sigaction = exec_sigchld_handler;
+                sa.sa_flags     = SA_SIGINFO | SA_RESTART | SA_NOCLDSTOP;
+                sigemptyset(&sa.sa_mask);
+                rc = sigaction(SIGCHLD, &sa, &g_sigchld_sa);
+                if (rc < 0) {
+                        rc = -errno;
+                        exec_sigchld_worker_stop();
+                        goto bail;
+                }
+        }
+        pthread_mutex_lock(&g_sigchld_mutex);
+        TAILQ_INSERT_TAIL(&g_sigchld_list, exec, sigchld);
+        pthread_mutex_unlock(&g_sigchld_mutex);
+        pthread_mutex_unlock(&g_sigchld_worker_mutex);
+        return 0;
+bail:   pthread_mutex_unlock(&g_sigchld_worker_mutex);
+        return rc;
+}
+
+static void exec_sigchld_del (struct medusa_exec *exec)
+{
+        pthread_mutex_lock(&g_sigchld_worker_mutex);
+        pthread_mutex_lock(&g_sigchld_mutex);
+        TAILQ_REMOVE(&g_sigchld_list, exec, sigchld);
+        pthread_mutex_unlock(&g_sigchld_mutex);
+        if (TAILQ_EMPTY(&g_sigchld_list)) {
+                sigaction(SIGCHLD, &g_sigchld_sa, NULL);
+                exec_sigchld_worker_stop();
+        }
+        pthread_mutex_unlock(&g_sigchld_worker_mutex);
+}
+
+static ssize_t exec_stdio_write (int fd, const void *data, size_t length)
+{
+        int error;
+        ssize_t rc;
+        sigset_t set;
+        sigset_t oset;
+        sigset_t pending;
+        struct timespec timespec;
+        sigemptyset(&set);
+        sigaddset(&set, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &set, &oset);
+        sigpending(&pending);
+        rc = write(fd, data, length);
+        error = errno;
+        if (rc < 0 && error == EPIPE && !sigismember(&pending, SIGPIPE)) {
+                timespec.tv_sec  = 0;
+                timespec.tv_nsec = 0;
+                sigtimedwait(&set, NULL, &timespec);
+        }
+        pthread_sigmask(SIG_SETMASK, &oset, NULL);
+        errno = error;
+        return rc;
+}
+
+static void exec_stdio_close (struct medusa_exec *exec, int i)
+{
+        if (!MEDUSA_IS_ERR_OR_NULL(exec->sio[i])) {
+                medusa_io_destroy_unlocked(exec->sio[i]);
+                exec->sio[i] = NULL;
+        }
+}
+
+static void exec_stdio_stop (struct medusa_exec *exec)
+{
+        exec_stdio_close(exec, 0);
+        exec_stdio_close(exec, 1);
+        exec_stdio_close(exec, 2);
+}
+
+static int exec_stdin_commit (struct medusa_exec *exec)
+{
+        int64_t blength;
+        if (MEDUSA_IS_ERR_OR_NULL(exec->sio[0])) {
+                return 0;
+        }
+        blength = medusa_buffer_get_length(exec->sbuffer[0]);
+        if (blength < 0) {
+                return blength;
+        }
+        if (blength > 0) {
+                return medusa_io_add_events_unlocked(exec->sio[0], MEDUSA_IO_EVENT_OUT);
+        }
+        if (exec->stdin_close) {
+                exec_stdio_close(exec, 0);
+                return 0;
+        }
+        return medusa_io_del_events_unlocked(exec->sio[0], MEDUSA_IO_EVENT_OUT);
+}
+
+static int exec_stdin_write (struct medusa_exec *exec)
+{
+        int rc;
+        ssize_t wlength;
+        int64_t niovecs;
+        int64_t clength;
+        struct medusa_iovec iovec;
+        while (1) {
+                niovecs = medusa_buffer_peekv(exec->sbuffer[0], 0, -1, &iovec, 1);
+                if (niovecs < 0) {
+                        return niovecs;
+                }
+                if (niovecs == 0) {
+                        break;
+                }
+                wlength = exec_stdio_write(medusa_io_get_fd_unlocked(exec->sio[0]), iovec.iov_base, iovec.iov_len);
+                if (wlength < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        if (errno == EAGAIN ||
+                            errno == EWOULDBLOCK) {
+                                return 0;
                         }
+                        exec_stdio_close(exec, 0);
+                        return 0;
                 }
-                close(n);
-                rc = prctl(PR_SET_PDEATHSIG, SIGKILL);
-                if (rc == -1) {
-                        perror(0);
-                        exit(-1);
+                clength = medusa_buffer_choke(exec->sbuffer[0], 0, wlength);
+                if (clength != wlength) {
+                        return -EIO;
                 }
-                if (getppid() == 1) {
-                        exit(-1);
+        }
+        rc = exec_stdin_commit(exec);
+        if (rc < 0) {
+                return rc;
+        }
+        return medusa_exec_onevent_unlocked(exec, MEDUSA_EXEC_EVENT_STDIN_WRITE_FINISHED, NULL);
+}
+
+static int exec_stdio_read (struct medusa_exec *exec, int i)
+{
+        int eof;
+        ssize_t rlength;
+        int64_t niovecs;
+        int64_t clength;
+        int64_t tlength;
+        struct medusa_iovec iovec;
+        eof = 0;
+        tlength = 0;
+        while (eof == 0) {
+                niovecs = medusa_buffer_reservev(exec->sbuffer[i], MEDUSA_EXEC_STDIO_READ_SIZE, &iovec, 1);
+                if (niovecs < 0) {
+                        return niovecs;
                 }
-                execvpe(args[0], args, (env != NULL) ? ((char * const *) env) : (environ));
-                if (env != NULL) {
-                        free(env);
+                if (niovecs == 0) {
+                        return -EIO;
+                }
+                rlength = read(medusa_io_get_fd_unlocked(exec->sio[i]), iovec.iov_base, iovec.iov_len);
+                if (rlength < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        if (errno == EAGAIN ||
+                            errno == EWOULDBLOCK) {
+                                break;
+                        }
+                        eof = 1;
+                } else if (rlength == 0) {
+                        eof = 1;
+                } else {
+                        iovec.iov_len = rlength;
+                        clength = medusa_buffer_commitv(exec->sbuffer[i], &iovec, 1);
+                        if (clength != 1) {
+                                return -EIO;
+                        }
+                        tlength += rlength;
                 }
-                exit(-1);
         }
+        if (eof) {
+                exec_stdio_close(exec, i);
+        }
+        if (tlength > 0) {
+                return medusa_exec_onevent_unlocked(exec, (i == 1) ? MEDUSA_EXEC_EVENT_STDOUT_READ : MEDUSA_EXEC_EVENT_STDERR_READ, NULL);
+        }
+        return 0;
+}
 
-bail:   if (io == NULL) {
-                close(n);
+static int exec_stdio_onevent (struct medusa_io *io, unsigned int events, void *context, void *param)
+{
+        int i;
+        int rc;
+        struct medusa_monitor *monitor;
+        struct medusa_exec *exec = (struct medusa_exec *) context;
+        (void) param;
+        if (events & MEDUSA_IO_EVENT_DESTROY) {
+                return 0;
         }
-        if (env != NULL) {
-                free(env);
+        monitor = medusa_io_get_monitor(io);
+        medusa_monitor_lock(monitor);
+        for (i = 0; i < 3; i++) {
+                if (exec->sio[i] == io) {
+                        break;
+                }
         }
-        return -1;
+        rc = 0;
+        if (i == 0) {
+                if (events & (MEDUSA_IO_EVENT_ERR | MEDUSA_IO_EVENT_HUP)) {
+                        exec_stdio_close(exec, 0);
+                } else if (events & MEDUSA_IO_EVENT_OUT) {
+                        rc = exec_stdin_write(exec);
+                }
+        } else if (i < 3) {
+                if (events & (MEDUSA_IO_EVENT_IN | MEDUSA_IO_EVENT_ERR | MEDUSA_IO_EVENT_HUP)) {
+                        rc = exec_stdio_read(exec, i);
+                }
+        }
+        medusa_monitor_unlock(monitor);
+        if (rc < 0) {
+                medusa_errorf("exec stdio failed, rc: %d", rc);
+                return rc;
+        }
+        return 0;
 }
 
-static pid_t exec_waitpid (pid_t pid, int *status)
+static int exec_stdin_onevent (struct medusa_buffer *buffer, unsigned int events, void *context, void *param)
 {
-        return waitpid(pid, status, WNOHANG);
+        struct medusa_exec *exec = (struct medusa_exec *) context;
+        (void) buffer;
+        (void) param;
+        if (events & MEDUSA_BUFFER_EVENT_WRITE) {
+                return exec_stdin_commit(exec);
+        }
+        return 0;
 }
 
-static int exec_kill (pid_t pid, int sig)
+/* creates a pipe for each of the requested stdio streams, the child ends
+ * are returned through iov, and must be closed after the spawn. */
+static int exec_stdio_start (struct medusa_exec *exec, int *iov)
 {
-        return kill((pid < 0) ? pid : -pid, sig);
+        int i;
+        int rc;
+        int fds[2];
+        int pfd;
+        struct medusa_io_init_options io_init_options;
+        for (i = 0; i < 3; i++) {
+                iov[i] = -1;
+        }
+        for (i = 0; i < 3; i++) {
+                if (!(exec->stdio & (1 << i))) {
+                        continue;
+                }
+                rc = medusa_pipe2(fds, MEDUSA_PIPE_FLAG_CLOEXEC);
+                if (rc != 0) {
+                        rc = -errno;
+                        goto bail;
+                }
+                pfd    = (i == 0) ? fds[1] : fds[0];
+                iov[i] = (i == 0) ? fds[0] : fds[1];
+                fcntl(pfd, F_SETFL, fcntl(pfd, F_GETFL) | O_NONBLOCK);
+                rc = medusa_io_init_options_default(&io_init_options);
+                if (rc < 0) {
+                        close(pfd);
+                        goto bail;
+                }
+                io_init_options.monitor    = exec->subject.monitor;
+                io_init_options.fd         = pfd;
+                io_init_options.onevent    = exec_stdio_onevent;
+                io_init_options.context    = exec;
+                io_init_options.events     = (i == 0) ? MEDUSA_IO_EVENT_NONE : MEDUSA_IO_EVENT_IN;
+                io_init_options.clodestroy = 1;
+                io_init_options.enabled    = 1;
+                exec->sio[i] = medusa_io_create_with_options_unlocked(&io_init_options);
+                if (MEDUSA_IS_ERR_OR_NULL(exec->sio[i])) {
+                        rc = MEDUSA_PTR_ERR(exec->sio[i]);
+                        exec->sio[i] = NULL;
+                        close(pfd);
+                        goto bail;
+                }
+                if (i != 0) {
+                        medusa_buffer_reset(exec->sbuffer[i]);
+                }
+        }
+        return 0;
+bail:   for (i = 0; i < 3; i++) {
+                if (iov[i] >= 0) {
+                        close(iov[i]);
+                        iov[i] = -1;
+                }
+        }
+        exec_stdio_stop(exec);
+        return rc;
 }
 
-static int exec_timer_onevent (struct medusa_timer *timer, unsigned int events, void *context, void *param)
+static void exec_watch_stop (struct medusa_exec *exec)
 {
+        if (exec->wfd >= 0) {
+                exec_sigchld_del(exec);
+                close(exec->wfd);
+                exec->wfd = -1;
+        }
+        if (!MEDUSA_IS_ERR_OR_NULL(exec->io)) {
+                medusa_io_destroy_unlocked(exec->io);
+                exec->io = NULL;
+        }
+}
+
+static int exec_io_onevent (struct medusa_io *io, unsigned int events, void *context, void *param)
+{
+        int i;
         int rc;
         pid_t pid;
         int status;
+        unsigned char c[64];
+        struct medusa_monitor *monitor;
         struct medusa_exec *exec = (struct medusa_exec *) context;
         (void) param;
-        if (events & MEDUSA_TIMER_EVENT_DESTROY) {
+        if (events & MEDUSA_IO_EVENT_DESTROY) {
                 return 0;
         }
-        if (events & MEDUSA_TIMER_EVENT_TIMEOUT) {
+        monitor = medusa_io_get_monitor(io);
+        medusa_monitor_lock(monitor);
+        if (events & MEDUSA_IO_EVENT_IN) {
+                if (exec->wfd >= 0) {
+                        while (read(medusa_io_get_fd_unlocked(io), c, sizeof(c)) > 0) {
+                                ;
+                        }
+                }
+                status = 0;
                 pid = exec_waitpid(exec->pid, &status);
-                if (pid < 0) {
-                        if (errno == ECHILD) {
-                                medusa_timer_destroy(timer);
-                                exec->pid = -1;
-                                exec->timer = NULL;
-                                exec->wstatus = status;
-                                rc = medusa_exec_onevent(exec, MEDUSA_EXEC_EVENT_STOPPED, NULL);
+                if (pid == 0) {
+                        goto out;
+                }
+                if (pid < 0 && errno != ECHILD) {
+                        medusa_errorf("waitpid failed, errno: %d", errno);
+                        goto bail;
+                }
+                for (i = 1; i < 3; i++) {
+                        if (!MEDUSA_IS_ERR_OR_NULL(exec->sio[i])) {
+                                rc = exec_stdio_read(exec, i);
                                 if (rc < 0) {
-                                        medusa_errorf("medusa_exec_onevent failed, rc: %d", rc);
-                                        return rc;
+                                        medusa_errorf("exec_stdio_read failed, rc: %d", rc);
+                                        goto bail;
                                 }
-                                return 0;
-                        } else {
-                                return -EIO;
-                        }
-                } else if (pid == 0) {
-                        return 0;
-                } else {
-                        medusa_timer_destroy(timer);
-                        exec->pid = -1;
-                        exec->timer = NULL;
-                        exec->wstatus = status;
-                        rc = medusa_exec_onevent(exec, MEDUSA_EXEC_EVENT_STOPPED, NULL);
-                        if (rc < 0) {
-                                medusa_errorf("medusa_exec_onevent failed, rc: %d", rc);
-                                return rc;
                         }
-                        return 0;
                 }
+                exec_stdio_stop(exec);
+                exec_watch_stop(exec);
+                exec->pid = -1;
+                exec->wstatus = status;
+                /* a close request applies to one run only, the next start
+                 * gets an open stdin again */
+                exec->stdin_close = 0;
+                rc = medusa_exec_onevent_unlocked(exec, MEDUSA_EXEC_EVENT_STOPPED, NULL);
+                if (rc < 0) {
+                        medusa_errorf("medusa_exec_onevent_unlocked failed, rc: %d", rc);
+                        goto bail;
+                }
+        }
+out:    medusa_monitor_unlock(monitor);
+        return 0;
+bail:   medusa_monitor_unlock(monitor);
+        return -EIO;
+}
+
+/* the child is watched through a pidfd, which becomes readable once it
+ * exits. without one, a wakeup pipe kicked from SIGCHLD is watched instead,
+ * and kicked once right away for a child that may have exited already. */
+static int exec_watch_start (struct medusa_exec *exec)
+{
+        int rc;
+        int fd;
+        int fds[2];
+        struct medusa_io_init_options io_init_options;
+        fds[0] = -1;
+        fds[1] = -1;
+        fd = exec_pidfd_open(exec->pid);
+        if (fd < 0) {
+                rc = medusa_pipe2(fds, MEDUSA_PIPE_FLAG_NONBLOCK | MEDUSA_PIPE_FLAG_CLOEXEC);
+                if (rc != 0) {
+                        return -errno;
+                }
+                fd = fds[0];
+        }
+        rc = medusa_io_init_options_default(&io_init_options);
+        if (rc < 0) {
+                goto bail;
+        }
+        io_init_options.monitor    = exec->subject.monitor;
+        io_init_options.fd         = fd;
+        io_init_options.onevent    = exec_io_onevent;
+        io_init_options.context    = exec;
+        io_init_options.events     = MEDUSA_IO_EVENT_IN;
+        io_init_options.clodestroy = 1;
+        io_init_options.enabled    = 1;
+        exec->io = medusa_io_create_with_options_unlocked(&io_init_options);
+        if (MEDUSA_IS_ERR_OR_NULL(exec->io)) {
+                rc = MEDUSA_PTR_ERR(exec->io);
+                exec->io = NULL;
+                goto bail;
+        }
+        fd = -1;
+        if (fds[1] >= 0) {
+                exec->wfd = fds[1];
+                fds[1] = -1;
+                rc = exec_sigchld_add(exec);
+                if (rc < 0) {
+                        close(exec->wfd);
+                        exec->wfd = -1;
+                        goto bail;
+                }
+                rc = write(exec->wfd, "", 1);
+                (void) rc;
         }
         return 0;
+bail:   if (fd >= 0) {
+                close(fd);
+        }
+        if (fds[1] >= 0) {
+                close(fds[1]);
+        }
+        if (!MEDUSA_IS_ERR_OR_NULL(exec->io)) {
+                medusa_io_destroy_unlocked(exec->io);
+                exec->io = NULL;
+        }
+        return rc;
 }
 
 static int exec_init_with_options_unlocked (struct medusa_exec *exec, const struct medusa_exec_init_options *options)
 {
+        int i;
         int rc;
         int ret;
         int argc;
@@ -264,6 +867,7 @@ static int exec_init_with_options_unlocked (struct medusa_exec *exec, const stru
         }
         memset(exec, 0, sizeof(struct medusa_exec));
         exec->pid = -1;
+        exec->wfd = -1;
         exec->uid = options->uid;
         exec->gid = options->gid;
         exec->interval = options->interval;
@@ -307,6 +911,28 @@ static int exec_init_with_options_unlocked (struct medusa_exec *exec, const stru
                 }
                 exec->envv[envc++] = NULL;
         }
+        exec->stdio = options->stdio & MEDUSA_EXEC_STDIO_ALL;
+        for (i = 0; i < 3; i++) {
+                struct medusa_buffer_init_options buffer_init_options;
+                if (!(exec->stdio & (1 << i))) {
+                        continue;
+                }
+                rc = medusa_buffer_init_options_default(&buffer_init_options);
+                if (rc < 0) {
+                        ret = rc;
+                        goto bail;
+                }
+                if (i == 0) {
+                        buffer_init_options.onevent = exec_stdin_onevent;
+                        buffer_init_options.context = exec;
+                }
+                exec->sbuffer[i] = medusa_buffer_create_with_options(&buffer_init_options);
+                if (MEDUSA_IS_ERR_OR_NULL(exec->sbuffer[i])) {
+                        ret = MEDUSA_PTR_ERR(exec->sbuffer[i]);
+                        exec->sbuffer[i] = NULL;
+                        goto bail;
+                }
+        }
         exec->onevent = options->onevent;
         exec->context = options->context;
         exec_set_enabled(exec, 0);
@@ -335,6 +961,12 @@ bail:   for (argc = 0; options->argv != NULL && options->argv[argc] != NULL; arg
         }
         free(exec->envv);
         exec->envv = NULL;
+        for (i = 0; i < 3; i++) {
+                if (!MEDUSA_IS_ERR_OR_NULL(exec->sbuffer[i])) {
+                        medusa_buffer_destroy(exec->sbuffer[i]);
+                        exec->sbuffer[i] = NULL;
+                }
+        }
         return ret;
 }
 
@@ -494,8 +1126,10 @@ __attribute__ ((visibility ("default"))) int medusa_exec_get_wstatus (const stru
 
 __attribute__ ((visibility ("default"))) int medusa_exec_set_enabled_unlocked (struct medusa_exec *exec, int enabled)
 {
+        int i;
         int rc;
-        struct medusa_timer_init_options timer_init_options;
+        int iov[3];
+        int siov[3];
         if (MEDUSA_IS_ERR_OR_NULL(exec)) {
                 return -EINVAL;
         }
@@ -506,25 +1140,39 @@ __attribute__ ((visibility ("default"))) int medusa_exec_set_enabled_unlocked (s
                 if (exec->pid >= 0) {
                         return -EAGAIN;
                 }
-                if (!MEDUSA_IS_ERR_OR_NULL(exec->timer)) {
+                if (!MEDUSA_IS_ERR_OR_NULL(exec->io)) {
                         return -EIO;
                 }
                 exec->wstatus = 0;
-                medusa_timer_init_options_default(&timer_init_options);
-                timer_init_options.interval   = exec->interval;
-                timer_init_options.singleshot = 0;
-                timer_init_options.enabled    = 1;
-                timer_init_options.monitor    = exec->subject.monitor;
-                timer_init_options.onevent    = exec_timer_onevent;
-                timer_init_options.context    = exec;
-                exec->timer = medusa_timer_create_with_options_unlocked(&timer_init_options);
-                if (MEDUSA_IS_ERR_OR_NULL(exec->timer)) {
-                        return MEDUSA_PTR_ERR(exec->timer);
-                }
-                exec->pid = exec_exec(exec->argv, exec->envv, exec->iov, exec->uid, exec->gid);
+                rc = exec_stdio_start(exec, siov);
+                if (rc < 0) {
+                        return rc;
+                }
+                for (i = 0; i < 3; i++) {
+                        iov[i] = (siov[i] >= 0) ? siov[i] : exec->iov[i];
+                }
+                exec->pid = exec_exec(exec->argv, exec->envv, iov, exec->uid, exec->gid);
+                for (i = 0; i < 3; i++) {
+                        if (siov[i] >= 0) {
+                                close(siov[i]);
+                        }
+                }
                 if (exec->pid < 0) {
+                        exec_stdio_stop(exec);
                         return -EIO;
                 }
+                rc = exec_watch_start(exec);
+                if (rc < 0) {
+                        exec_kill(exec->pid, SIGKILL);
+                        waitpid(exec->pid, NULL, 0);
+                        exec->pid = -1;
+                        exec_stdio_stop(exec);
+                        return rc;
+                }
+                rc = exec_stdin_commit(exec);
+                if (rc < 0) {
+                        return rc;
+                }
                 rc = medusa_exec_onevent_unlocked(exec, MEDUSA_EXEC_EVENT_STARTED, NULL);
                 if (rc < 0) {
                         return rc;
@@ -591,6 +1239,99 @@ __attribute__ ((visibility ("default"))) int medusa_exec_stop (struct medusa_exe
         return medusa_exec_set_enabled(exec, 0);
 }
 
+__attribute__ ((visibility ("default"))) struct medusa_buffer * medusa_exec_get_stdin_buffer_unlocked (struct medusa_exec *exec)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(exec)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        if (exec->sbuffer[0] == NULL) {
+                return MEDUSA_ERR_PTR(-ENOENT);
+        }
+        return exec->sbuffer[0];
+}
+
+__attribute__ ((visibility ("default"))) struct medusa_buffer * medusa_exec_get_stdin_buffer (struct medusa_exec *exec)
+{
+        struct medusa_buffer *rc;
+        if (MEDUSA_IS_ERR_OR_NULL(exec)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        medusa_monitor_lock(exec->subject.monitor);
+        rc = medusa_exec_get_stdin_buffer_unlocked(exec);
+        medusa_monitor_unlock(exec->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) struct medusa_buffer * medusa_exec_get_stdout_buffer_unlocked (struct medusa_exec *exec)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(exec)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        if (exec->sbuffer[1] == NULL) {
+                return MEDUSA_ERR_PTR(-ENOENT);
+        }
+        return exec->sbuffer[1];
+}
+
+__attribute__ ((visibility ("default"))) struct medusa_buffer * medusa_exec_get_stdout_buffer (struct medusa_exec *exec)
+{
+        struct medusa_buffer *rc;
+        if (MEDUSA_IS_ERR_OR_NULL(exec)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        medusa_monitor_lock(exec->subject.monitor);
+        rc = medusa_exec_get_stdout_buffer_unlocked(exec);
+        medusa_monitor_unlock(exec->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) struct medusa_buffer * medusa_exec_get_stderr_buffer_unlocked (struct medusa_exec *exec)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(exec)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        if (exec->sbuffer[2] == NULL) {
+                return MEDUSA_ERR_PTR(-ENOENT);
+        }
+        return exec->sbuffer[2];
+}
+
+__attribute__ ((visibility ("default"))) struct medusa_buffer * medusa_exec_get_stderr_buffer (struct medusa_exec *exec)
+{
+        struct medusa_buffer *rc;
+        if (MEDUSA_IS_ERR_OR_NULL(exec)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        medusa_monitor_lock(exec->subject.monitor);
+        rc = medusa_exec_get_stderr_buffer_unlocked(exec);
+        medusa_monitor_unlock(exec->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_exec_close_stdin_unlocked (struct medusa_exec *exec)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(exec)) {
+                return -EINVAL;
+        }
+        if (exec->sbuffer[0] == NULL) {
+                return -ENOENT;
+        }
+        exec->stdin_close = 1;
+        return exec_stdin_commit(exec);
+}
+
+__attribute__ ((visibility ("default"))) int medusa_exec_close_stdin (struct medusa_exec *exec)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(exec)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(exec->subject.monitor);
+        rc = medusa_exec_close_stdin_unlocked(exec);
+        medusa_monitor_unlock(exec->subject.monitor);
+        return rc;
+}
+
 __attribute__ ((visibility ("default"))) int medusa_exec_set_context_unlocked (struct medusa_exec *exec, void *context)
 {
         if (MEDUSA_IS_ERR_OR_NULL(exec)) {
@@ -755,6 +1496,7 @@ __attribute__ ((visibility ("default"))) struct medusa_monitor * medusa_exec_get
 
 __attribute__ ((visibility ("default"))) int medusa_exec_onevent_unlocked (struct medusa_exec *exec, unsigned int events, void *param)
 {
+        int i;
         int rc;
         struct medusa_monitor *monitor;
         rc = 0;
@@ -774,8 +1516,12 @@ __attribute__ ((visibility ("default"))) int medusa_exec_onevent_unlocked (struc
                 if (exec->pid >= 0) {
                         exec_kill(exec->pid, SIGKILL);
                 }
-                if (!MEDUSA_IS_ERR_OR_NULL(exec->timer)) {
-                        medusa_timer_destroy_unlocked(exec->timer);
+                exec_stdio_stop(exec);
+                exec_watch_stop(exec);
+                for (i = 0; i < 3; i++) {
+                        if (!MEDUSA_IS_ERR_OR_NULL(exec->sbuffer[i])) {
+                                medusa_buffer_destroy(exec->sbuffer[i]);
+                        }
                 }
                 if (exec->argv != NULL) {
                         char **ptr;
@@ -832,11 +1578,31 @@ __attribute__ ((visibility ("default"))) const char * medusa_exec_event_string (
         if (events == MEDUSA_EXEC_EVENT_STARTED)  return "MEDUSA_EXEC_EVENT_STARTED";
         if (events == MEDUSA_EXEC_EVENT_STOPPED)  return "MEDUSA_EXEC_EVENT_STOPPED";
         if (events == MEDUSA_EXEC_EVENT_DESTROY)  return "MEDUSA_EXEC_EVENT_DESTROY";
+        if (events == MEDUSA_EXEC_EVENT_STDOUT_READ)           return "MEDUSA_EXEC_EVENT_STDOUT_READ";
+        if (events == MEDUSA_EXEC_EVENT_STDERR_READ)           return "MEDUSA_EXEC_EVENT_STDERR_READ";
+        if (events == MEDUSA_EXEC_EVENT_STDIN_WRITE_FINISHED)  return "MEDUSA_EXEC_EVENT_STDIN_WRITE_FINISHED";
         return "MEDUSA_IO_EVENT_UNKNOWN";
 }
 
+static int exec_subject_onevent (struct medusa_subject *subject, unsigned int events, void *param)
+{
+        return medusa_exec_onevent_unlocked((struct medusa_exec *) subject, events, param);
+}
+
+static int exec_subject_destroy (struct medusa_subject *subject)
+{
+        return medusa_exec_onevent_unlocked((struct medusa_exec *) subject, MEDUSA_EXEC_EVENT_DESTROY, NULL);
+}
+
+static const struct medusa_subject_type g_subject_type = {
+        .rank    = MEDUSA_SUBJECT_RANK_EXEC,
+        .onevent = exec_subject_onevent,
+        .destroy = exec_subject_destroy
+};
+
 __attribute__ ((constructor)) static void exec_constructor (void)
 {
+        medusa_monitor_register_subject_type(MEDUSA_SUBJECT_TYPE_EXEC, &g_subject_type);
 #if defined(MEDUSA_EXEC_USE_POOL) && (MEDUSA_EXEC_USE_POOL == 1)
         g_pool = medusa_pool_create("medusa-exec", sizeof(struct medusa_exec), 0, 0, MEDUSA_POOL_FLAG_DEFAULT | MEDUSA_POOL_FLAG_THREAD_SAFE, NULL, NULL, NULL);
 #endif
@@ -3,17 +3,37 @@
 #define MEDUSA_EXEC_H
 
 struct medusa_exec;
+struct medusa_buffer;
 struct medusa_monitor;
 
 enum {
         MEDUSA_EXEC_EVENT_NONE          = 0x00000000,
         MEDUSA_EXEC_EVENT_STARTED       = 0x00000001,
         MEDUSA_EXEC_EVENT_STOPPED       = 0x00000002,
-        MEDUSA_EXEC_EVENT_DESTROY       = 0x00000004
+        MEDUSA_EXEC_EVENT_DESTROY       = 0x00000004,
+        MEDUSA_EXEC_EVENT_STDOUT_READ   = 0x00000008,
+        MEDUSA_EXEC_EVENT_STDERR_READ   = 0x00000010,
+        MEDUSA_EXEC_EVENT_STDIN_WRITE_FINISHED = 0x00000020
 #define MEDUSA_EXEC_EVENT_NONE          MEDUSA_EXEC_EVENT_NONE
 #define MEDUSA_EXEC_EVENT_STARTED       MEDUSA_EXEC_EVENT_STARTED
 #define MEDUSA_EXEC_EVENT_STOPPED       MEDUSA_EXEC_EVENT_STOPPED
 #define MEDUSA_EXEC_EVENT_DESTROY MEDUSA_EXEC_EVENT_DESTROY
+#define MEDUSA_EXEC_EVENT_STDOUT_READ   MEDUSA_EXEC_EVENT_STDOUT_READ
+#define MEDUSA_EXEC_EVENT_STDERR_READ   MEDUSA_EXEC_EVENT_STDERR_READ
+#define MEDUSA_EXEC_EVENT_STDIN_WRITE_FINISHED MEDUSA_EXEC_EVENT_STDIN_WRITE_FINISHED
+};
+
+enum {
+        MEDUSA_EXEC_STDIO_NONE          = 0x00000000,
+        MEDUSA_EXEC_STDIO_STDIN         = 0x00000001,
+        MEDUSA_EXEC_STDIO_STDOUT        = 0x00000002,
+        MEDUSA_EXEC_STDIO_STDERR        = 0x00000004,
+        MEDUSA_EXEC_STDIO_ALL           = 0x00000007
+#define MEDUSA_EXEC_STDIO_NONE          MEDUSA_EXEC_STDIO_NONE
+#define MEDUSA_EXEC_STDIO_STDIN         MEDUSA_EXEC_STDIO_STDIN
+#define MEDUSA_EXEC_STDIO_STDOUT        MEDUSA_EXEC_STDIO_STDOUT
+#define MEDUSA_EXEC_STDIO_STDERR        MEDUSA_EXEC_STDIO_STDERR
+#define MEDUSA_EXEC_STDIO_ALL           MEDUSA_EXEC_STDIO_ALL
 };
 
 struct medusa_exec_init_options {
@@ -26,6 +46,7 @@ struct medusa_exec_init_options {
         int uid;
         int gid;
         double interval;
+        unsigned int stdio;
         int enabled;
 };
 
@@ -52,6 +73,12 @@ int medusa_exec_disable (struct medusa_exec *exec);
 int medusa_exec_start (struct medusa_exec *exec);
 int medusa_exec_stop (struct medusa_exec *exec);
 
+struct medusa_buffer * medusa_exec_get_stdin_buffer (struct medusa_exec *exec);
+struct medusa_buffer * medusa_exec_get_stdout_buffer (struct medusa_exec *exec);
+struct medusa_buffer * medusa_exec_get_stderr_buffer (struct medusa_exec *exec);
+
+int medusa_exec_close_stdin (struct medusa_exec *exec);
+
 int medusa_exec_set_context (struct medusa_exec *exec, void *context);
 void * medusa_exec_get_context (struct medusa_exec *exec);
 
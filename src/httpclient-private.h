@@ -0,0 +1,40 @@
+
+#if !defined(MEDUSA_HTTPCLIENT_PRIVATE_H)
+#define MEDUSA_HTTPCLIENT_PRIVATE_H
+
+struct medusa_httpclient;
+struct medusa_httpclient_connection;
+struct medusa_httprequest;
+
+struct medusa_httpclient * medusa_httpclient_create_unlocked (struct medusa_monitor *monitor, int (*onevent) (struct medusa_httpclient *httpclient, unsigned int events, void *context, void *param), void *context);
+struct medusa_httpclient * medusa_httpclient_create_with_options_unlocked (const struct medusa_httpclient_init_options *options);
+void medusa_httpclient_destroy_unlocked (struct medusa_httpclient *httpclient);
+
+int medusa_httpclient_set_max_connections_per_host_unlocked (struct medusa_httpclient *httpclient, unsigned int max);
+unsigned int medusa_httpclient_get_max_connections_per_host_unlocked (const struct medusa_httpclient *httpclient);
+
+int medusa_httpclient_set_idle_timeout_unlocked (struct medusa_httpclient *httpclient, double timeout);
+double medusa_httpclient_get_idle_timeout_unlocked (const struct medusa_httpclient *httpclient);
+
+int medusa_httpclient_set_pipelining_depth_unlocked (struct medusa_httpclient *httpclient, unsigned int depth);
+unsigned int medusa_httpclient_get_pipelining_depth_unlocked (const struct medusa_httpclient *httpclient);
+
+int64_t medusa_httpclient_get_connection_count_unlocked (const struct medusa_httpclient *httpclient);
+int64_t medusa_httpclient_get_idle_count_unlocked (const struct medusa_httpclient *httpclient);
+int64_t medusa_httpclient_get_pending_count_unlocked (const struct medusa_httpclient *httpclient);
+
+int medusa_httpclient_onevent_unlocked (struct medusa_httpclient *httpclient, unsigned int events, void *param);
+
+int medusa_httpclient_set_context_unlocked (struct medusa_httpclient *httpclient, void *context);
+void * medusa_httpclient_get_context_unlocked (struct medusa_httpclient *httpclient);
+
+int medusa_httpclient_set_userdata_unlocked (struct medusa_httpclient *httpclient, void *userdata);
+void * medusa_httpclient_get_userdata_unlocked (struct medusa_httpclient *httpclient);
+
+struct medusa_monitor * medusa_httpclient_get_monitor_unlocked (struct medusa_httpclient *httpclient);
+
+int medusa_httpclient_acquire_unlocked (struct medusa_httpclient *httpclient, struct medusa_httprequest *httprequest, const char *origin, struct medusa_httpclient_connection **connection);
+struct medusa_httprequest * medusa_httpclient_release_unlocked (struct medusa_httpclient_connection *connection, struct medusa_httprequest *httprequest, int reuse);
+void medusa_httpclient_cancel_unlocked (struct medusa_httprequest *httprequest);
+
+#endif
@@ -0,0 +1,48 @@
+
+#if !defined(MEDUSA_HTTPCLIENT_STRUCT_H)
+#define MEDUSA_HTTPCLIENT_STRUCT_H
+
+struct medusa_httprequest;
+
+TAILQ_HEAD(medusa_httpclient_requests, medusa_httprequest);
+
+TAILQ_HEAD(medusa_httpclient_connections, medusa_httpclient_connection);
+struct medusa_httpclient_connection {
+        TAILQ_ENTRY(medusa_httpclient_connection) list;
+        struct medusa_httpclient_origin *origin;
+        struct medusa_tcpsocket *tcpsocket;
+        struct medusa_httpclient_requests inflights;
+        unsigned int ninflights;
+        int draining;
+};
+
+TAILQ_HEAD(medusa_httpclient_origins, medusa_httpclient_origin);
+struct medusa_httpclient_origin {
+        TAILQ_ENTRY(medusa_httpclient_origin) list;
+        char *key;
+        unsigned int nconnections;
+        struct medusa_httpclient_connections busies;
+        struct medusa_httpclient_connections idles;
+        struct medusa_httpclient_requests pendings;
+        struct medusa_httpclient *httpclient;
+};
+
+struct medusa_httpclient {
+        struct medusa_subject subject;
+        int (*onevent) (struct medusa_httpclient *httpclient, unsigned int events, void *context, void *param);
+        void *context;
+        unsigned int max_connections_per_host;
+        double idle_timeout;
+        unsigned int pipelining_depth;
+        int64_t nconnections;
+        int64_t nidles;
+        int64_t npendings;
+        struct medusa_httpclient_origins origins;
+        void *userdata;
+};
+
+int medusa_httpclient_init (struct medusa_httpclient *httpclient, struct medusa_monitor *monitor, int (*onevent) (struct medusa_httpclient *httpclient, unsigned int events, void *context, void *param), void *context);
+int medusa_httpclient_init_with_options (struct medusa_httpclient *httpclient, const struct medusa_httpclient_init_options *options);
+void medusa_httpclient_uninit (struct medusa_httpclient *httpclient);
+
+#endif
@@ -0,0 +1,930 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+
+#define MEDUSA_DEBUG_NAME       "httpclient"
+
+#include "../3rdparty/http-parser/http_parser.h"
+
+#include "debug.h"
+#include "error.h"
+#include "pool.h"
+#include "queue.h"
+#include "buffer.h"
+#include "subject-struct.h"
+#include "tcpsocket.h"
+#include "tcpsocket-private.h"
+#include "httprequest.h"
+#include "httprequest-private.h"
+#include "httprequest-struct.h"
+#include "httpclient.h"
+#include "httpclient-private.h"
+#include "httpclient-struct.h"
+#include "monitor-private.h"
+
+#define MEDUSA_HTTPCLIENT_USE_POOL              1
+
+#if defined(MEDUSA_HTTPCLIENT_USE_POOL) && (MEDUSA_HTTPCLIENT_USE_POOL == 1)
+static struct medusa_pool *g_pool;
+#endif
+
+static void httpclient_origin_destroy (struct medusa_httpclient_origin *origin)
+{
+        if (origin == NULL) {
+                return;
+        }
+        if (origin->key != NULL) {
+                free(origin->key);
+        }
+        free(origin);
+}
+
+static struct medusa_httpclient_origin * httpclient_origin_create (struct medusa_httpclient *httpclient, const char *key)
+{
+        struct medusa_httpclient_origin *origin;
+        origin = malloc(sizeof(struct medusa_httpclient_origin));
+        if (origin == NULL) {
+                return MEDUSA_ERR_PTR(-ENOMEM);
+        }
+        memset(origin, 0, sizeof(struct medusa_httpclient_origin));
+        TAILQ_INIT(&origin->busies);
+        TAILQ_INIT(&origin->idles);
+        TAILQ_INIT(&origin->pendings);
+        origin->key = strdup(key);
+        if (origin->key == NULL) {
+                httpclient_origin_destroy(origin);
+                return MEDUSA_ERR_PTR(-ENOMEM);
+        }
+        origin->httpclient = httpclient;
+        return origin;
+}
+
+static struct medusa_httpclient_origin * httpclient_origin_find (struct medusa_httpclient *httpclient, const char *key)
+{
+        struct medusa_httpclient_origin *origin;
+        TAILQ_FOREACH(origin, &httpclient->origins, list) {
+                if (strcmp(origin->key, key) == 0) {
+                        return origin;
+                }
+        }
+        return NULL;
+}
+
+static void httpclient_origin_check (struct medusa_httpclient_origin *origin)
+{
+        if (origin->nconnections == 0 &&
+            TAILQ_EMPTY(&origin->pendings)) {
+                TAILQ_REMOVE(&origin->httpclient->origins, origin, list);
+                httpclient_origin_destroy(origin);
+        }
+}
+
+static struct medusa_httpclient_connection * httpclient_connection_create (struct medusa_httpclient_origin *origin)
+{
+        struct medusa_httpclient_connection *connection;
+        connection = malloc(sizeof(struct medusa_httpclient_connection));
+        if (connection == NULL) {
+                return MEDUSA_ERR_PTR(-ENOMEM);
+        }
+        memset(connection, 0, sizeof(struct medusa_httpclient_connection));
+        TAILQ_INIT(&connection->inflights);
+        connection->origin = origin;
+        TAILQ_INSERT_TAIL(&origin->busies, connection, list);
+        origin->nconnections += 1;
+        origin->httpclient->nconnections += 1;
+        return connection;
+}
+
+static void httpclient_connection_destroy (struct medusa_httpclient_connection *connection)
+{
+        if (!MEDUSA_IS_ERR_OR_NULL(connection->tcpsocket)) {
+                medusa_tcpsocket_destroy_unlocked(connection->tcpsocket);
+                connection->tcpsocket = NULL;
+        }
+        if (connection->origin != NULL) {
+                connection->origin->nconnections -= 1;
+                connection->origin->httpclient->nconnections -= 1;
+        }
+        free(connection);
+}
+
+static struct medusa_httprequest * httpclient_origin_pop_pending (struct medusa_httpclient_origin *origin)
+{
+        struct medusa_httprequest *httprequest;
+        TAILQ_FOREACH(httprequest, &origin->pendings, pending) {
+                /* requests that are being deleted are cancelled from their own destroy */
+                if (medusa_subject_is_active(&httprequest->subject)) {
+                        break;
+                }
+        }
+        if (httprequest == NULL) {
+                return NULL;
+        }
+        TAILQ_REMOVE(&origin->pendings, httprequest, pending);
+        httprequest->origin = NULL;
+        origin->httpclient->npendings -= 1;
+        return httprequest;
+}
+
+static int httpclient_request_is_pipelinable (const struct medusa_httprequest *httprequest)
+{
+        /* responses are matched in request order, only requests that are safe
+         * to replay on another connection are queued behind others */
+        return httprequest->method == NULL ||
+               strcasecmp(httprequest->method, "GET") == 0;
+}
+
+static struct medusa_httpclient_connection * httpclient_origin_select (struct medusa_httpclient_origin *origin, struct medusa_httprequest *httprequest)
+{
+        struct medusa_httpclient *httpclient;
+        struct medusa_httpclient_connection *connection;
+        struct medusa_httpclient_connection *pconnection;
+
+        httpclient = origin->httpclient;
+        connection = NULL;
+
+        if (!TAILQ_EMPTY(&origin->idles)) {
+                /* most recently used first, it is the least likely to be closed by the peer */
+                connection = TAILQ_FIRST(&origin->idles);
+                TAILQ_REMOVE(&origin->idles, connection, list);
+                TAILQ_INSERT_TAIL(&origin->busies, connection, list);
+                httpclient->nidles -= 1;
+        } else if (httpclient->max_connections_per_host == 0 ||
+                   origin->nconnections < httpclient->max_connections_per_host) {
+                connection = httpclient_connection_create(origin);
+                if (MEDUSA_IS_ERR_OR_NULL(connection)) {
+                        return connection;
+                }
+        } else if (httpclient->pipelining_depth > 1 &&
+                   httpclient_request_is_pipelinable(httprequest)) {
+                TAILQ_FOREACH(pconnection, &origin->busies, list) {
+                        if (pconnection->draining ||
+                            MEDUSA_IS_ERR_OR_NULL(pconnection->tcpsocket) ||
+                            pconnection->ninflights == 0 ||
+                            pconnection->ninflights >= httpclient->pipelining_depth ||
+                            !httpclient_request_is_pipelinable(TAILQ_FIRST(&pconnection->inflights))) {
+                                continue;
+                        }
+                        if (connection == NULL ||
+                            pconnection->ninflights < connection->ninflights) {
+                                connection = pconnection;
+                        }
+                }
+        }
+        if (connection == NULL) {
+                return NULL;
+        }
+        TAILQ_INSERT_TAIL(&connection->inflights, httprequest, inflight);
+        connection->ninflights += 1;
+        return connection;
+}
+
+static void httpclient_origin_dispatch (struct medusa_httpclient_origin *origin)
+{
+        struct medusa_httprequest *httprequest;
+        struct medusa_httpclient_connection *connection;
+        while (medusa_subject_is_active(&origin->httpclient->subject)) {
+                httprequest = httpclient_origin_pop_pending(origin);
+                if (httprequest == NULL) {
+                        break;
+                }
+                connection = httpclient_origin_select(origin, httprequest);
+                if (connection == NULL) {
+                        TAILQ_INSERT_HEAD(&origin->pendings, httprequest, pending);
+                        httprequest->origin = origin;
+                        origin->httpclient->npendings += 1;
+                        break;
+                }
+                if (MEDUSA_IS_ERR(connection)) {
+                        medusa_httprequest_dispatch_unlocked(httprequest, NULL);
+                } else {
+                        medusa_httprequest_dispatch_unlocked(httprequest, connection);
+                }
+        }
+}
+
+static void httpclient_connection_requeue (struct medusa_httpclient_connection *connection, struct medusa_httprequest *after, struct medusa_httpclient_requests *failed)
+{
+        struct medusa_httprequest *httprequest;
+        struct medusa_httpclient_origin *origin;
+        origin = connection->origin;
+        /* nothing behind the head has been answered yet, walk backwards so
+         * that the requests keep their order in front of the pending queue */
+        while ((httprequest = TAILQ_LAST(&connection->inflights, medusa_httpclient_requests)) != NULL &&
+               httprequest != after) {
+                TAILQ_REMOVE(&connection->inflights, httprequest, inflight);
+                connection->ninflights -= 1;
+                httprequest->connection = NULL;
+                httprequest->tcpsocket  = NULL;
+                if (origin != NULL &&
+                    medusa_subject_is_active(&origin->httpclient->subject)) {
+                        TAILQ_INSERT_HEAD(&origin->pendings, httprequest, pending);
+                        httprequest->origin = origin;
+                        origin->httpclient->npendings += 1;
+                } else {
+                        TAILQ_INSERT_HEAD(failed, httprequest, pending);
+                }
+        }
+}
+
+static int httpclient_connection_tcpsocket_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
+{
+        struct medusa_monitor *monitor;
+        struct medusa_httpclient_origin *origin;
+        struct medusa_httpclient_connection *connection = context;
+
+        (void) param;
+
+        if (events & MEDUSA_TCPSOCKET_EVENT_DESTROY) {
+                return 0;
+        }
+
+        monitor = medusa_tcpsocket_get_monitor(tcpsocket);
+        medusa_monitor_lock(monitor);
+
+        if (events & (MEDUSA_TCPSOCKET_EVENT_BUFFERED_READ |
+                      MEDUSA_TCPSOCKET_EVENT_BUFFERED_READ_TIMEOUT |
+                      MEDUSA_TCPSOCKET_EVENT_DISCONNECTED |
+                      MEDUSA_TCPSOCKET_EVENT_ERROR)) {
+                /* an idle connection must stay silent, anything else means
+                 * the peer closed it, sent garbage or the idle timeout hit */
+                origin = connection->origin;
+                TAILQ_REMOVE(&origin->idles, connection, list);
+                origin->httpclient->nidles -= 1;
+                httpclient_connection_destroy(connection);
+                httpclient_origin_check(origin);
+        }
+
+        medusa_monitor_unlock(monitor);
+        return 0;
+}
+
+static int httpclient_init_with_options_unlocked (struct medusa_httpclient *httpclient, const struct medusa_httpclient_init_options *options)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return -EINVAL;
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(options)) {
+                return -EINVAL;
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(options->monitor)) {
+                return -EINVAL;
+        }
+        memset(httpclient, 0, sizeof(struct medusa_httpclient));
+        TAILQ_INIT(&httpclient->origins);
+        medusa_subject_set_type(&httpclient->subject, MEDUSA_SUBJECT_TYPE_HTTPCLIENT);
+        httpclient->subject.monitor = NULL;
+        httpclient->onevent = options->onevent;
+        httpclient->context = options->context;
+        httpclient->max_connections_per_host = options->max_connections_per_host;
+        httpclient->idle_timeout = options->idle_timeout;
+        httpclient->pipelining_depth = options->pipelining_depth;
+        rc = medusa_monitor_add_unlocked(options->monitor, &httpclient->subject);
+        if (rc < 0) {
+                return rc;
+        }
+        return 0;
+}
+
+static void httpclient_uninit_unlocked (struct medusa_httpclient *httpclient)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return;
+        }
+        if (httpclient->subject.monitor != NULL) {
+                medusa_monitor_del_unlocked(&httpclient->subject);
+        } else {
+                medusa_httpclient_onevent_unlocked(httpclient, MEDUSA_HTTPCLIENT_EVENT_DESTROY, NULL);
+        }
+}
+
+__attribute__ ((visibility ("default"))) int medusa_httpclient_init_options_default (struct medusa_httpclient_init_options *options)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(options)) {
+                return -EINVAL;
+        }
+        memset(options, 0, sizeof(struct medusa_httpclient_init_options));
+        options->max_connections_per_host = 6;
+        options->idle_timeout             = 30.0;
+        options->pipelining_depth         = 1;
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) struct medusa_httpclient * medusa_httpclient_create_unlocked (struct medusa_monitor *monitor, int (*onevent) (struct medusa_httpclient *httpclient, unsigned int events, void *context, void *param), void *context)
+{
+        int rc;
+        struct medusa_httpclient_init_options options;
+        rc = medusa_httpclient_init_options_default(&options);
+        if (rc < 0) {
+                return MEDUSA_ERR_PTR(rc);
+        }
+        options.monitor = monitor;
+        options.onevent = onevent;
+        options.context = context;
+        return medusa_httpclient_create_with_options_unlocked(&options);
+}
+
+__attribute__ ((visibility ("default"))) struct medusa_httpclient * medusa_httpclient_create (struct medusa_monitor *monitor, int (*onevent) (struct medusa_httpclient *httpclient, unsigned int events, void *context, void *param), void *context)
+{
+        struct medusa_httpclient *rc;
+        if (MEDUSA_IS_ERR_OR_NULL(monitor)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        medusa_monitor_lock(monitor);
+        rc = medusa_httpclient_create_unlocked(monitor, onevent, context);
+        medusa_monitor_unlock(monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) struct medusa_httpclient * medusa_httpclient_create_with_options_unlocked (const struct medusa_httpclient_init_options *options)
+{
+        int rc;
+        struct medusa_httpclient *httpclient;
+        if (MEDUSA_IS_ERR_OR_NULL(options)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(options->monitor)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+#if defined(MEDUSA_HTTPCLIENT_USE_POOL) && (MEDUSA_HTTPCLIENT_USE_POOL == 1)
+        httpclient = medusa_pool_malloc(g_pool);
+#else
+        httpclient = malloc(sizeof(struct medusa_httpclient));
+#endif
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return MEDUSA_ERR_PTR(-ENOMEM);
+        }
+        memset(httpclient, 0, sizeof(struct medusa_httpclient));
+        rc = httpclient_init_with_options_unlocked(httpclient, options);
+        if (rc < 0) {
+                medusa_httpclient_destroy_unlocked(httpclient);
+                return MEDUSA_ERR_PTR(rc);
+        }
+        return httpclient;
+}
+
+__attribute__ ((visibility ("default"))) struct medusa_httpclient * medusa_httpclient_create_with_options (const struct medusa_httpclient_init_options *options)
+{
+        struct medusa_httpclient *rc;
+        if (MEDUSA_IS_ERR_OR_NULL(options)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(options->monitor)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        medusa_monitor_lock(options->monitor);
+        rc = medusa_httpclient_create_with_options_unlocked(options);
+        medusa_monitor_unlock(options->monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) void medusa_httpclient_destroy_unlocked (struct medusa_httpclient *httpclient)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return;
+        }
+        httpclient_uninit_unlocked(httpclient);
+}
+
+__attribute__ ((visibility ("default"))) void medusa_httpclient_destroy (struct medusa_httpclient *httpclient)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return;
+        }
+        medusa_monitor_lock(httpclient->subject.monitor);
+        medusa_httpclient_destroy_unlocked(httpclient);
+        medusa_monitor_unlock(httpclient->subject.monitor);
+}
+
+__attribute__ ((visibility ("default"))) int medusa_httpclient_set_max_connections_per_host_unlocked (struct medusa_httpclient *httpclient, unsigned int max)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return -EINVAL;
+        }
+        httpclient->max_connections_per_host = max;
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_httpclient_set_max_connections_per_host (struct medusa_httpclient *httpclient, unsigned int max)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(httpclient->subject.monitor);
+        rc = medusa_httpclient_set_max_connections_per_host_unlocked(httpclient, max);
+        medusa_monitor_unlock(httpclient->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) unsigned int medusa_httpclient_get_max_connections_per_host_unlocked (const struct medusa_httpclient *httpclient)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return 0;
+        }
+        return httpclient->max_connections_per_host;
+}
+
+__attribute__ ((visibility ("default"))) unsigned int medusa_httpclient_get_max_connections_per_host (const struct medusa_httpclient *httpclient)
+{
+        unsigned int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return 0;
+        }
+        medusa_monitor_lock(httpclient->subject.monitor);
+        rc = medusa_httpclient_get_max_connections_per_host_unlocked(httpclient);
+        medusa_monitor_unlock(httpclient->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_httpclient_set_idle_timeout_unlocked (struct medusa_httpclient *httpclient, double timeout)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return -EINVAL;
+        }
+        httpclient->idle_timeout = timeout;
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_httpclient_set_idle_timeout (struct medusa_httpclient *httpclient, double timeout)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(httpclient->subject.monitor);
+        rc = medusa_httpclient_set_idle_timeout_unlocked(httpclient, timeout);
+        medusa_monitor_unlock(httpclient->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) double medusa_httpclient_get_idle_timeout_unlocked (const struct medusa_httpclient *httpclient)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return -EINVAL;
+        }
+        return httpclient->idle_timeout;
+}
+
+__attribute__ ((visibility ("default"))) double medusa_httpclient_get_idle_timeout (const struct medusa_httpclient *httpclient)
+{
+        double rc;
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(httpclient->subject.monitor);
+        rc = medusa_httpclient_get_idle_timeout_unlocked(httpclient);
+        medusa_monitor_unlock(httpclient->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_httpclient_set_pipelining_depth_unlocked (struct medusa_httpclient *httpclient, unsigned int depth)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return -EINVAL;
+        }
+        httpclient->pipelining_depth = depth;
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_httpclient_set_pipelining_depth (struct medusa_httpclient *httpclient, unsigned int depth)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(httpclient->subject.monitor);
+        rc = medusa_httpclient_set_pipelining_depth_unlocked(httpclient, depth);
+        medusa_monitor_unlock(httpclient->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) unsigned int medusa_httpclient_get_pipelining_depth_unlocked (const struct medusa_httpclient *httpclient)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return 0;
+        }
+        return httpclient->pipelining_depth;
+}
+
+__attribute__ ((visibility ("default"))) unsigned int medusa_httpclient_get_pipelining_depth (const struct medusa_httpclient *httpclient)
+{
+        unsigned int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return 0;
+        }
+        medusa_monitor_lock(httpclient->subject.monitor);
+        rc = medusa_httpclient_get_pipelining_depth_unlocked(httpclient);
+        medusa_monitor_unlock(httpclient->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int64_t medusa_httpclient_get_connection_count_unlocked (const struct medusa_httpclient *httpclient)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return -EINVAL;
+        }
+        return httpclient->nconnections;
+}
+
+__attribute__ ((visibility ("default"))) int64_t medusa_httpclient_get_connection_count (const struct medusa_httpclient *httpclient)
+{
+        int64_t rc;
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(httpclient->subject.monitor);
+        rc = medusa_httpclient_get_connection_count_unlocked(httpclient);
+        medusa_monitor_unlock(httpclient->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int64_t medusa_httpclient_get_idle_count_unlocked (const struct medusa_httpclient *httpclient)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return -EINVAL;
+        }
+        return httpclient->nidles;
+}
+
+__attribute__ ((visibility ("default"))) int64_t medusa_httpclient_get_idle_count (const struct medusa_httpclient *httpclient)
+{
+        int64_t rc;
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(httpclient->subject.monitor);
+        rc = medusa_httpclient_get_idle_count_unlocked(httpclient);
+        medusa_monitor_unlock(httpclient->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int64_t medusa_httpclient_get_pending_count_unlocked (const struct medusa_httpclient *httpclient)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return -EINVAL;
+        }
+        return httpclient->npendings;
+}
+
+__attribute__ ((visibility ("default"))) int64_t medusa_httpclient_get_pending_count (const struct medusa_httpclient *httpclient)
+{
+        int64_t rc;
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(httpclient->subject.monitor);
+        rc = medusa_httpclient_get_pending_count_unlocked(httpclient);
+        medusa_monitor_unlock(httpclient->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_httpclient_acquire_unlocked (struct medusa_httpclient *httpclient, struct medusa_httprequest *httprequest, const char *key, struct medusa_httpclient_connection **connection)
+{
+        struct medusa_httpclient_origin *origin;
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return -EINVAL;
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(httprequest)) {
+                return -EINVAL;
+        }
+        if (key == NULL) {
+                return -EINVAL;
+        }
+        if (connection == NULL) {
+                return -EINVAL;
+        }
+        *connection = NULL;
+        origin = httpclient_origin_find(httpclient, key);
+        if (origin == NULL) {
+                origin = httpclient_origin_create(httpclient, key);
+                if (MEDUSA_IS_ERR_OR_NULL(origin)) {
+                        return MEDUSA_PTR_ERR(origin);
+                }
+                TAILQ_INSERT_TAIL(&httpclient->origins, origin, list);
+        }
+        *connection = httpclient_origin_select(origin, httprequest);
+        if (MEDUSA_IS_ERR(*connection)) {
+                int rc = MEDUSA_PTR_ERR(*connection);
+                *connection = NULL;
+                httpclient_origin_check(origin);
+                return rc;
+        }
+        if (*connection == NULL) {
+                TAILQ_INSERT_TAIL(&origin->pendings, httprequest, pending);
+                httprequest->origin = origin;
+                httpclient->npendings += 1;
+        }
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) struct medusa_httprequest * medusa_httpclient_release_unlocked (struct medusa_httpclient_connection *connection, struct medusa_httprequest *httprequest, int reuse)
+{
+        int rc;
+        struct medusa_httprequest *next;
+        struct medusa_httpclient *httpclient;
+        struct medusa_httpclient_origin *origin;
+        struct medusa_httpclient_requests failed;
+
+        if (MEDUSA_IS_ERR_OR_NULL(connection)) {
+                return NULL;
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(httprequest)) {
+                return NULL;
+        }
+        TAILQ_INIT(&failed);
+
+        origin     = connection->origin;
+        httpclient = (origin != NULL) ? origin->httpclient : NULL;
+
+        if (httprequest != TAILQ_FIRST(&connection->inflights)) {
+                /* a request behind the head went away while its response is
+                 * still due. the ones ahead of it are served as usual, the
+                 * ones behind it are moved to another connection, and this
+                 * one is closed once it is drained */
+                next = TAILQ_PREV(httprequest, medusa_httpclient_requests, inflight);
+                TAILQ_REMOVE(&connection->inflights, httprequest, inflight);
+                connection->ninflights -= 1;
+                connection->draining = 1;
+                httpclient_connection_requeue(connection, next, &failed);
+                goto out;
+        }
+
+        TAILQ_REMOVE(&connection->inflights, httprequest, inflight);
+        connection->ninflights -= 1;
+
+        if (reuse &&
+            !MEDUSA_IS_ERR_OR_NULL(connection->tcpsocket) &&
+            (httpclient == NULL || medusa_subject_is_active(&httpclient->subject))) {
+                next = TAILQ_FIRST(&connection->inflights);
+                if (next != NULL) {
+                        rc = medusa_httprequest_promote_unlocked(next);
+                        if (rc == 0) {
+                                if (origin != NULL) {
+                                        httpclient_origin_dispatch(origin);
+                                }
+                                return next;
+                        }
+                } else if (origin != NULL && !connection->draining) {
+                        next = httpclient_origin_pop_pending(origin);
+                        if (next != NULL) {
+                                TAILQ_INSERT_TAIL(&connection->inflights, next, inflight);
+                                connection->ninflights += 1;
+                                medusa_httprequest_dispatch_unlocked(next, connection);
+                                httpclient_origin_dispatch(origin);
+                                return NULL;
+                        }
+                        rc  = medusa_tcpsocket_set_onevent_unlocked(connection->tcpsocket, httpclient_connection_tcpsocket_onevent, connection);
+                        rc |= medusa_tcpsocket_set_read_timeout_unlocked(connection->tcpsocket, httpclient->idle_timeout);
+                        if (rc == 0) {
+                                TAILQ_REMOVE(&origin->busies, connection, list);
+                                TAILQ_INSERT_HEAD(&origin->idles, connection, list);
+                                httpclient->nidles += 1;
+                                return NULL;
+                        }
+                }
+        }
+
+        httpclient_connection_requeue(connection, NULL, &failed);
+        if (origin != NULL) {
+                TAILQ_REMOVE(&origin->busies, connection, list);
+        }
+        httpclient_connection_destroy(connection);
+
+out:    while ((next = TAILQ_FIRST(&failed)) != NULL) {
+                TAILQ_REMOVE(&failed, next, pending);
+                medusa_httprequest_dispatch_unlocked(next, NULL);
+        }
+        if (origin != NULL) {
+                httpclient_origin_dispatch(origin);
+                httpclient_origin_check(origin);
+        }
+        return NULL;
+}
+
+__attribute__ ((visibility ("default"))) void medusa_httpclient_cancel_unlocked (struct medusa_httprequest *httprequest)
+{
+        struct medusa_httpclient_origin *origin;
+        struct medusa_httpclient_connection *connection;
+        if (MEDUSA_IS_ERR_OR_NULL(httprequest)) {
+                return;
+        }
+        origin = httprequest->origin;
+        if (origin != NULL) {
+                TAILQ_REMOVE(&origin->pendings, httprequest, pending);
+                httprequest->origin = NULL;
+                origin->httpclient->npendings -= 1;
+                httpclient_origin_check(origin);
+                return;
+        }
+        connection = httprequest->connection;
+        if (connection != NULL) {
+                httprequest->connection = NULL;
+                httprequest->tcpsocket  = NULL;
+                medusa_httpclient_release_unlocked(connection, httprequest, 0);
+        }
+}
+
+__attribute__ ((visibility ("default"))) int medusa_httpclient_onevent_unlocked (struct medusa_httpclient *httpclient, unsigned int events, void *param)
+{
+        int ret;
+        struct medusa_monitor *monitor;
+        ret = 0;
+        monitor = httpclient->subject.monitor;
+        if (httpclient->onevent != NULL) {
+                if ((medusa_subject_is_active(&httpclient->subject)) ||
+                    (events & MEDUSA_HTTPCLIENT_EVENT_DESTROY)) {
+                        medusa_monitor_unlock(monitor);
+                        ret = httpclient->onevent(httpclient, events, httpclient->context, param);
+                        if (ret < 0) {
+                                medusa_errorf("httpclient->onevent failed, ret: %d", ret);
+                        }
+                        medusa_monitor_lock(monitor);
+                }
+        }
+        if (events & MEDUSA_HTTPCLIENT_EVENT_DESTROY) {
+                struct medusa_httprequest *httprequest;
+                struct medusa_httpclient_origin *origin;
+                struct medusa_httpclient_connection *connection;
+                while ((origin = TAILQ_FIRST(&httpclient->origins)) != NULL) {
+                        while ((connection = TAILQ_FIRST(&origin->idles)) != NULL) {
+                                TAILQ_REMOVE(&origin->idles, connection, list);
+                                httpclient_connection_destroy(connection);
+                        }
+                        while ((connection = TAILQ_FIRST(&origin->busies)) != NULL) {
+                                TAILQ_REMOVE(&origin->busies, connection, list);
+                                connection->origin = NULL;
+                        }
+                        while ((httprequest = TAILQ_FIRST(&origin->pendings)) != NULL) {
+                                TAILQ_REMOVE(&origin->pendings, httprequest, pending);
+                                httprequest->origin = NULL;
+                                medusa_httprequest_dispatch_unlocked(httprequest, NULL);
+                        }
+                        TAILQ_REMOVE(&httpclient->origins, origin, list);
+                        httpclient_origin_destroy(origin);
+                }
+#if defined(MEDUSA_HTTPCLIENT_USE_POOL) && (MEDUSA_HTTPCLIENT_USE_POOL == 1)
+                medusa_pool_free(httpclient);
+#else
+                free(httpclient);
+#endif
+        }
+        return ret;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_httpclient_onevent (struct medusa_httpclient *httpclient, unsigned int events, void *param)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(httpclient->subject.monitor);
+        rc = medusa_httpclient_onevent_unlocked(httpclient, events, param);
+        medusa_monitor_unlock(httpclient->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_httpclient_set_context_unlocked (struct medusa_httpclient *httpclient, void *context)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return -EINVAL;
+        }
+        httpclient->context = context;
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_httpclient_set_context (struct medusa_httpclient *httpclient, void *context)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(httpclient->subject.monitor);
+        rc = medusa_httpclient_set_context_unlocked(httpclient, context);
+        medusa_monitor_unlock(httpclient->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) void * medusa_httpclient_get_context_unlocked (struct medusa_httpclient *httpclient)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        return httpclient->context;
+}
+
+__attribute__ ((visibility ("default"))) void * medusa_httpclient_get_context (struct medusa_httpclient *httpclient)
+{
+        void *rc;
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        medusa_monitor_lock(httpclient->subject.monitor);
+        rc = medusa_httpclient_get_context_unlocked(httpclient);
+        medusa_monitor_unlock(httpclient->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_httpclient_set_userdata_unlocked (struct medusa_httpclient *httpclient, void *userdata)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return -EINVAL;
+        }
+        httpclient->userdata = userdata;
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_httpclient_set_userdata (struct medusa_httpclient *httpclient, void *userdata)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(httpclient->subject.monitor);
+        rc = medusa_httpclient_set_userdata_unlocked(httpclient, userdata);
+        medusa_monitor_unlock(httpclient->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) void * medusa_httpclient_get_userdata_unlocked (struct medusa_httpclient *httpclient)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        return httpclient->userdata;
+}
+
+__attribute__ ((visibility ("default"))) void * medusa_httpclient_get_userdata (struct medusa_httpclient *httpclient)
+{
+        void *rc;
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        medusa_monitor_lock(httpclient->subject.monitor);
+        rc = medusa_httpclient_get_userdata_unlocked(httpclient);
+        medusa_monitor_unlock(httpclient->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) struct medusa_monitor * medusa_httpclient_get_monitor_unlocked (struct medusa_httpclient *httpclient)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        return httpclient->subject.monitor;
+}
+
+__attribute__ ((visibility ("default"))) struct medusa_monitor * medusa_httpclient_get_monitor (struct medusa_httpclient *httpclient)
+{
+        struct medusa_monitor *rc;
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        medusa_monitor_lock(httpclient->subject.monitor);
+        rc = medusa_httpclient_get_monitor_unlocked(httpclient);
+        medusa_monitor_unlock(httpclient->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) const char * medusa_httpclient_event_string (unsigned int events)
+{
+        if (events == MEDUSA_HTTPCLIENT_EVENT_DESTROY)          return "MEDUSA_HTTPCLIENT_EVENT_DESTROY";
+        return "MEDUSA_HTTPCLIENT_EVENT_UNKNOWN";
+}
+
+static int httpclient_subject_onevent (struct medusa_subject *subject, unsigned int events, void *param)
+{
+        return medusa_httpclient_onevent_unlocked((struct medusa_httpclient *) subject, events, param);
+}
+
+static int httpclient_subject_destroy (struct medusa_subject *subject)
+{
+        return medusa_httpclient_onevent_unlocked((struct medusa_httpclient *) subject, MEDUSA_HTTPCLIENT_EVENT_DESTROY, NULL);
+}
+
+static const struct medusa_subject_type g_subject_type = {
+        .rank    = MEDUSA_SUBJECT_RANK_HTTPCLIENT,
+        .onevent = httpclient_subject_onevent,
+        .destroy = httpclient_subject_destroy
+};
+
+__attribute__ ((constructor)) static void httpclient_constructor (void)
+{
+        medusa_monitor_register_subject_type(MEDUSA_SUBJECT_TYPE_HTTPCLIENT, &g_subject_type);
+#if defined(MEDUSA_HTTPCLIENT_USE_POOL) && (MEDUSA_HTTPCLIENT_USE_POOL == 1)
+        g_pool = medusa_pool_create("medusa-httpclient", sizeof(struct medusa_httpclient), 0, 0, MEDUSA_POOL_FLAG_DEFAULT | MEDUSA_POOL_FLAG_THREAD_SAFE, NULL, NULL, NULL);
+#endif
+}
+
+__attribute__ ((destructor)) static void httpclient_destructor (void)
+{
+#if defined(MEDUSA_HTTPCLIENT_USE_POOL) && (MEDUSA_HTTPCLIENT_USE_POOL == 1)
+        if (g_pool != NULL) {
+                medusa_pool_destroy(g_pool);
+        }
+#endif
+}
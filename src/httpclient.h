@@ -0,0 +1,62 @@
+
+#if !defined(MEDUSA_HTTPCLIENT_H)
+#define MEDUSA_HTTPCLIENT_H
+
+struct medusa_monitor;
+struct medusa_httpclient;
+
+enum {
+        MEDUSA_HTTPCLIENT_EVENT_DESTROY                 = (1 <<  0)  /* 0x00000001 */
+#define MEDUSA_HTTPCLIENT_EVENT_DESTROY                 MEDUSA_HTTPCLIENT_EVENT_DESTROY
+};
+
+struct medusa_httpclient_init_options {
+        struct medusa_monitor *monitor;
+        unsigned int max_connections_per_host;
+        double idle_timeout;
+        unsigned int pipelining_depth;
+        int (*onevent) (struct medusa_httpclient *httpclient, unsigned int events, void *context, void *param);
+        void *context;
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+int medusa_httpclient_init_options_default (struct medusa_httpclient_init_options *options);
+
+struct medusa_httpclient * medusa_httpclient_create (struct medusa_monitor *monitor, int (*onevent) (struct medusa_httpclient *httpclient, unsigned int events, void *context, void *param), void *context);
+struct medusa_httpclient * medusa_httpclient_create_with_options (const struct medusa_httpclient_init_options *options);
+void medusa_httpclient_destroy (struct medusa_httpclient *httpclient);
+
+int medusa_httpclient_set_max_connections_per_host (struct medusa_httpclient *httpclient, unsigned int max);
+unsigned int medusa_httpclient_get_max_connections_per_host (const struct medusa_httpclient *httpclient);
+
+int medusa_httpclient_set_idle_timeout (struct medusa_httpclient *httpclient, double timeout);
+double medusa_httpclient_get_idle_timeout (const struct medusa_httpclient *httpclient);
+
+int medusa_httpclient_set_pipelining_depth (struct medusa_httpclient *httpclient, unsigned int depth);
+unsigned int medusa_httpclient_get_pipelining_depth (const struct medusa_httpclient *httpclient);
+
+int64_t medusa_httpclient_get_connection_count (const struct medusa_httpclient *httpclient);
+int64_t medusa_httpclient_get_idle_count (const struct medusa_httpclient *httpclient);
+int64_t medusa_httpclient_get_pending_count (const struct medusa_httpclient *httpclient);
+
+int medusa_httpclient_onevent (struct medusa_httpclient *httpclient, unsigned int events, void *param);
+
+int medusa_httpclient_set_context (struct medusa_httpclient *httpclient, void *context);
+void * medusa_httpclient_get_context (struct medusa_httpclient *httpclient);
+
+int medusa_httpclient_set_userdata (struct medusa_httpclient *httpclient, void *userdata);
+void * medusa_httpclient_get_userdata (struct medusa_httpclient *httpclient);
+
+struct medusa_monitor * medusa_httpclient_get_monitor (struct medusa_httpclient *httpclient);
+
+const char * medusa_httpclient_event_string (unsigned int events);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -3,6 +3,8 @@
 #define MEDUSA_HTTPREQUEST_PRIVATE_H
 
 struct medusa_httprequest;
+struct medusa_httpclient;
+struct medusa_httpclient_connection;
 
 struct medusa_httprequest * medusa_httprequest_create_unlocked (struct medusa_monitor *monitor, int (*onevent) (struct medusa_httprequest *httprequest, unsigned int events, void *context, void *param), void *context);
 struct medusa_httprequest * medusa_httprequest_create_with_options_unlocked (const struct medusa_httprequest_init_options *options);
@@ -10,6 +12,9 @@ void medusa_httprequest_destroy_unlocked (struct medusa_httprequest *httprequest
 
 unsigned int medusa_httprequest_get_state_unlocked (const struct medusa_httprequest *httprequest);
 
+int medusa_httprequest_set_httpclient_unlocked (struct medusa_httprequest *httprequest, struct medusa_httpclient *httpclient);
+struct medusa_httpclient * medusa_httprequest_get_httpclient_unlocked (const struct medusa_httprequest *httprequest);
+
 int medusa_httprequest_set_resolve_timeout_unlocked (struct medusa_httprequest *httprequest, double timeout);
 double medusa_httprequest_get_resolve_timeout_unlocked (const struct medusa_httprequest *httprequest);
 
@@ -19,6 +24,15 @@ double medusa_httprequest_get_connect_timeout_unlocked (const struct medusa_http
 int medusa_httprequest_set_read_timeout_unlocked (struct medusa_httprequest *httprequest, double timeout);
 double medusa_httprequest_get_read_timeout_unlocked (const struct medusa_httprequest *httprequest);
 
+int medusa_httprequest_set_body_fd_unlocked (struct medusa_httprequest *httprequest, int fd);
+int medusa_httprequest_get_body_fd_unlocked (const struct medusa_httprequest *httprequest);
+
+int medusa_httprequest_set_body_buffer_unlocked (struct medusa_httprequest *httprequest, struct medusa_buffer *buffer);
+struct medusa_buffer * medusa_httprequest_get_body_buffer_unlocked (const struct medusa_httprequest *httprequest);
+
+int medusa_httprequest_set_body_stream_unlocked (struct medusa_httprequest *httprequest, int enabled);
+int medusa_httprequest_get_body_stream_unlocked (const struct medusa_httprequest *httprequest);
+
 int medusa_httprequest_set_method_unlocked (struct medusa_httprequest *httprequest, const char *method);
 
 int medusa_httprequest_set_url_unlocked (struct medusa_httprequest *httprequest, const char *url, ...) __attribute__((format(printf, 2, 3)));
@@ -47,6 +61,9 @@ int medusa_httprequest_make_post_unlocked (struct medusa_httprequest *httpreques
 int medusa_httprequest_make_postf_unlocked (struct medusa_httprequest *httprequest, const char *data, ...) __attribute__((format(printf, 2, 3)));
 int medusa_httprequest_make_postv_unlocked (struct medusa_httprequest *httprequest, const char *data, va_list va);
 
+int medusa_httprequest_dispatch_unlocked (struct medusa_httprequest *httprequest, struct medusa_httpclient_connection *connection);
+int medusa_httprequest_promote_unlocked (struct medusa_httprequest *httprequest);
+
 int medusa_httprequest_onevent_unlocked (struct medusa_httprequest *httprequest, unsigned int events, void *param);
 
 int medusa_httprequest_set_context_unlocked (struct medusa_httprequest *httprequest, void *context);
@@ -13,9 +13,19 @@ struct medusa_httprequest {
         struct medusa_buffer *headers;
         struct medusa_tcpsocket *tcpsocket;
         struct medusa_dnsresolver *dnsresolver;
+        struct medusa_httpclient *httpclient;
+        struct medusa_httpclient_origin *origin;
+        struct medusa_httpclient_connection *connection;
+        TAILQ_ENTRY(medusa_httprequest) pending;
+        TAILQ_ENTRY(medusa_httprequest) inflight;
+        struct medusa_buffer *request;
+        int keepalive;
         double resolve_timeout;
         double connect_timeout;
         double read_timeout;
+        int body_fd;
+        struct medusa_buffer *body_buffer;
+        int body_stream;
         http_parser http_parser;
         http_parser_settings http_parser_settings;
         struct medusa_httprequest_reply *reply;
@@ -29,18 +29,45 @@
 #include "httprequest.h"
 #include "httprequest-private.h"
 #include "httprequest-struct.h"
+#include "httpclient.h"
+#include "httpclient-private.h"
+#include "httpclient-struct.h"
 #include "monitor-private.h"
 
 #if !defined(MIN)
 #define MIN(a, b)                               (((a) < (b)) ? (a) : (b))
 #endif
 
+#if !defined(MAX)
+#define MAX(a, b)                               (((a) > (b)) ? (a) : (b))
+#endif
+
 #define MEDUSA_HTTPREQUEST_USE_POOL             1
 
 #if defined(MEDUSA_HTTPREQUEST_USE_POOL) && (MEDUSA_HTTPREQUEST_USE_POOL == 1)
 static struct medusa_pool *g_pool;
 #endif
 
+#define MEDUSA_HTTPREQUEST_REPLY_ARENA_BLOCK_SIZE        4096
+
+/* status line and headers are carved out of per reply blocks and released all
+ * at once with the reply. the parser may hand a token over in fragments, the
+ * most recently carved string is extended in place while it is still at the
+ * tail of the current block */
+
+struct medusa_httprequest_reply_arena_block {
+        struct medusa_httprequest_reply_arena_block *next;
+        size_t size;
+        size_t used;
+        char data[];
+};
+
+struct medusa_httprequest_reply_arena {
+        struct medusa_httprequest_reply_arena_block *blocks;
+        char *last;
+        size_t nlast;
+};
+
 TAILQ_HEAD(medusa_httprequest_reply_headers_list, medusa_httprequest_reply_header);
 struct medusa_httprequest_reply_header {
         TAILQ_ENTRY(medusa_httprequest_reply_header) list;
@@ -60,17 +87,96 @@ struct medusa_httprequest_reply_headers {
 
 struct medusa_httprequest_reply_body {
         int64_t length;
+        int64_t size;
         void *value;
 };
 
 struct medusa_httprequest_reply {
+        struct medusa_httprequest_reply_arena arena;
         struct medusa_httprequest_reply_status status;
         struct medusa_httprequest_reply_headers headers;
         struct medusa_httprequest_reply_body body;
 };
 
-static int medusa_httprequest_reply_header_set_key (struct medusa_httprequest_reply_header *header, const char *key, int64_t length)
+static void * medusa_httprequest_reply_arena_alloc (struct medusa_httprequest_reply_arena *arena, size_t size, size_t align)
+{
+        size_t used;
+        struct medusa_httprequest_reply_arena_block *block;
+        block = arena->blocks;
+        if (block != NULL) {
+                used = (block->used + align - 1) & ~(align - 1);
+                if (used + size <= block->size) {
+                        block->used = used + size;
+                        arena->last = NULL;
+                        return block->data + used;
+                }
+        }
+        block = malloc(sizeof(struct medusa_httprequest_reply_arena_block) + MAX(size, MEDUSA_HTTPREQUEST_REPLY_ARENA_BLOCK_SIZE));
+        if (block == NULL) {
+                return NULL;
+        }
+        block->size = MAX(size, MEDUSA_HTTPREQUEST_REPLY_ARENA_BLOCK_SIZE);
+        block->used = size;
+        block->next = arena->blocks;
+        arena->blocks = block;
+        arena->last = NULL;
+        return block->data;
+}
+
+static char * medusa_httprequest_reply_arena_strncat (struct medusa_httprequest_reply_arena *arena, char *string, const char *at, size_t length)
+{
+        char *tmp;
+        size_t slength;
+        struct medusa_httprequest_reply_arena_block *block;
+        if (string == NULL) {
+                slength = 0;
+        } else if (string == arena->last) {
+                slength = arena->nlast;
+                block = arena->blocks;
+                if (block->used + length <= block->size) {
+                        memcpy(string + slength, at, length);
+                        string[slength + length] = '\0';
+                        block->used  += length;
+                        arena->nlast += length;
+                        return string;
+                }
+        } else {
+                slength = strlen(string);
+        }
+        tmp = medusa_httprequest_reply_arena_alloc(arena, slength + length + 1, 1);
+        if (tmp == NULL) {
+                return NULL;
+        }
+        if (slength > 0) {
+                memcpy(tmp, string, slength);
+        }
+        memcpy(tmp + slength, at, length);
+        tmp[slength + length] = '\0';
+        arena->last  = tmp;
+        arena->nlast = slength + length;
+        return tmp;
+}
+
+static void medusa_httprequest_reply_arena_uninit (struct medusa_httprequest_reply_arena *arena)
+{
+        struct medusa_httprequest_reply_arena_block *block;
+        while (arena->blocks != NULL) {
+                block = arena->blocks;
+                arena->blocks = block->next;
+                free(block);
+        }
+        arena->last  = NULL;
+        arena->nlast = 0;
+}
+
+static void medusa_httprequest_reply_arena_init (struct medusa_httprequest_reply_arena *arena)
 {
+        memset(arena, 0, sizeof(struct medusa_httprequest_reply_arena));
+}
+
+static int medusa_httprequest_reply_header_set_key (struct medusa_httprequest_reply *reply, struct medusa_httprequest_reply_header *header, const char *key, int64_t length)
+{
+        char *tmp;
         if (header == NULL) {
                 return -EINVAL;
         }
@@ -80,24 +186,17 @@ static int medusa_httprequest_reply_header_set_key (struct medusa_httprequest_re
         if (length <= 0) {
                 return -EINVAL;
         }
-        if (header->key != NULL) {
-                char *tmp = realloc(header->key, strlen(header->key) + length + 1);
-                if (tmp == NULL) {
-                        return -ENOMEM;
-                }
-                header->key = tmp;
-                strncat(header->key, key, length);
-        } else {
-                header->key = medusa_strndup(key, length);
-                if (header->key == NULL) {
-                        return -ENOMEM;
-                }
+        tmp = medusa_httprequest_reply_arena_strncat(&reply->arena, header->key, key, length);
+        if (tmp == NULL) {
+                return -ENOMEM;
         }
+        header->key = tmp;
         return 0;
 }
 
-static int medusa_httprequest_reply_header_set_value (struct medusa_httprequest_reply_header *header, const char *value, int64_t length)
+static int medusa_httprequest_reply_header_set_value (struct medusa_httprequest_reply *reply, struct medusa_httprequest_reply_header *header, const char *value, int64_t length)
 {
+        char *tmp;
         if (header == NULL) {
                 return -EINVAL;
         }
@@ -107,40 +206,18 @@ static int medusa_httprequest_reply_header_set_value (struct medusa_httprequest_
         if (length <= 0) {
                 return 0;
         }
-        if (header->value != NULL) {
-                char *tmp = realloc(header->value, strlen(header->value) + length + 1);
-                if (tmp == NULL) {
-                        return -ENOMEM;
-                }
-                header->value = tmp;
-                strncat(header->value, value, length);
-        } else {
-                header->value = medusa_strndup(value, length);
-                if (header->value == NULL) {
-                        return -ENOMEM;
-                }
+        tmp = medusa_httprequest_reply_arena_strncat(&reply->arena, header->value, value, length);
+        if (tmp == NULL) {
+                return -ENOMEM;
         }
+        header->value = tmp;
         return 0;
 }
 
-static void medusa_httprequest_reply_header_destroy (struct medusa_httprequest_reply_header *header)
-{
-        if (header == NULL) {
-                return;
-        }
-        if (header->key != NULL) {
-                free(header->key);
-        }
-        if (header->value != NULL) {
-                free(header->value);
-        }
-        free(header);
-}
-
-static struct medusa_httprequest_reply_header * medusa_httprequest_reply_header_create (void)
+static struct medusa_httprequest_reply_header * medusa_httprequest_reply_header_create (struct medusa_httprequest_reply *reply)
 {
         struct medusa_httprequest_reply_header *header;
-        header = malloc(sizeof(struct medusa_httprequest_reply_header));
+        header = medusa_httprequest_reply_arena_alloc(&reply->arena, sizeof(struct medusa_httprequest_reply_header), sizeof(void *));
         if (header == NULL) {
                 return MEDUSA_ERR_PTR(-ENOMEM);
         }
@@ -151,6 +228,7 @@ static struct medusa_httprequest_reply_header * medusa_httprequest_reply_header_
 static void medusa_httprequest_reply_body_uninit (struct medusa_httprequest_reply_body *body)
 {
         body->length = 0;
+        body->size   = 0;
         if (body->value != NULL) {
                 free(body->value);
         }
@@ -162,14 +240,30 @@ static void medusa_httprequest_reply_body_init (struct medusa_httprequest_reply_
         body->length = 0;
 }
 
-static void medusa_httprequest_reply_headers_uninit (struct medusa_httprequest_reply_headers *headers)
+static int medusa_httprequest_reply_body_append (struct medusa_httprequest_reply_body *body, const void *data, int64_t length)
 {
-        struct medusa_httprequest_reply_header *header;
-        struct medusa_httprequest_reply_header *nheader;
-        TAILQ_FOREACH_SAFE(header, &headers->list, list, nheader) {
-                TAILQ_REMOVE(&headers->list, header, list);
-                medusa_httprequest_reply_header_destroy(header);
+        if (body->length + length + 1 > body->size) {
+                void *tmp;
+                int64_t size;
+                size = MAX(body->size, 1024);
+                while (size < body->length + length + 1) {
+                        size *= 2;
+                }
+                tmp = realloc(body->value, size);
+                if (tmp == NULL) {
+                        return -ENOMEM;
+                }
+                body->value = tmp;
+                body->size  = size;
         }
+        memcpy(((char *) body->value) + body->length, data, length);
+        ((char *) body->value)[body->length + length] = '\0';
+        return 0;
+}
+
+static void medusa_httprequest_reply_headers_uninit (struct medusa_httprequest_reply_headers *headers)
+{
+        TAILQ_INIT(&headers->list);
         headers->count = 0;
 }
 
@@ -182,10 +276,8 @@ static void medusa_httprequest_reply_headers_init (struct medusa_httprequest_rep
 
 static void medusa_httprequest_reply_status_uninit (struct medusa_httprequest_reply_status *status)
 {
-        status->code = 0;
-        if (status->value != NULL) {
-                free(status->value);
-        }
+        status->code  = 0;
+        status->value = NULL;
 }
 
 static void medusa_httprequest_reply_status_init (struct medusa_httprequest_reply_status *status)
@@ -202,6 +294,7 @@ static void medusa_httprequest_reply_destroy (struct medusa_httprequest_reply *r
         medusa_httprequest_reply_body_uninit(&reply->body);
         medusa_httprequest_reply_headers_uninit(&reply->headers);
         medusa_httprequest_reply_status_uninit(&reply->status);
+        medusa_httprequest_reply_arena_uninit(&reply->arena);
         free(reply);
 }
 
@@ -213,6 +306,7 @@ static struct medusa_httprequest_reply * medusa_httprequest_reply_create (void)
                 return MEDUSA_ERR_PTR(-ENOMEM);
         }
         memset(reply, 0, sizeof(struct medusa_httprequest_reply));
+        medusa_httprequest_reply_arena_init(&reply->arena);
         medusa_httprequest_reply_status_init(&reply->status);
         medusa_httprequest_reply_headers_init(&reply->headers);
         medusa_httprequest_reply_body_init(&reply->body);
@@ -335,6 +429,13 @@ static inline int httprequest_set_state (struct medusa_httprequest *httprequest,
         struct medusa_httprequest_event_state_changed medusa_httprequest_event_state_changed;
 
         if (state == MEDUSA_HTTPREQUEST_STATE_DISCONNECTED) {
+                if (httprequest->connection != NULL) {
+                        struct medusa_httpclient_connection *connection;
+                        connection = httprequest->connection;
+                        httprequest->connection = NULL;
+                        httprequest->tcpsocket  = NULL;
+                        medusa_httpclient_release_unlocked(connection, httprequest, 0);
+                }
                 if (!MEDUSA_IS_ERR_OR_NULL(httprequest->tcpsocket)) {
                         medusa_tcpsocket_destroy_unlocked(httprequest->tcpsocket);
                         httprequest->tcpsocket = NULL;
@@ -379,24 +480,17 @@ static int httprequest_httpparser_on_url (http_parser *http_parser, const char *
 
 static int httprequest_httpparser_on_status (http_parser *http_parser, const char *at, size_t length)
 {
+        char *tmp;
         struct medusa_httprequest *httprequest = http_parser->data;
         httprequest->reply->status.code = http_parser->status_code;
         if (length == 0) {
                 return 0;
         }
-        if (httprequest->reply->status.value != NULL) {
-                char *tmp = realloc(httprequest->reply->status.value, strlen(httprequest->reply->status.value) + length + 1);
-                if (tmp == NULL) {
-                        return -ENOMEM;
-                }
-                httprequest->reply->status.value = tmp;
-                strncat(httprequest->reply->status.value, at, length);
-        } else {
-                httprequest->reply->status.value = medusa_strndup(at, length);
-                if (httprequest->reply->status.value == NULL) {
-                        return -ENOMEM;
-                }
+        tmp = medusa_httprequest_reply_arena_strncat(&httprequest->reply->arena, httprequest->reply->status.value, at, length);
+        if (tmp == NULL) {
+                return -ENOMEM;
         }
+        httprequest->reply->status.value = tmp;
         return 0;
 }
 
@@ -415,13 +509,12 @@ static int httprequest_httpparser_on_header_field (http_parser *http_parser, con
                         return rc;
                 }
         }
-        header = medusa_httprequest_reply_header_create();
+        header = medusa_httprequest_reply_header_create(httprequest->reply);
         if (MEDUSA_IS_ERR_OR_NULL(header)) {
                 return MEDUSA_PTR_ERR(header);
         }
-        rc = medusa_httprequest_reply_header_set_key(header, at, length);
+        rc = medusa_httprequest_reply_header_set_key(httprequest->reply, header, at, length);
         if (rc < 0) {
-                medusa_httprequest_reply_header_destroy(header);
                 return rc;
         }
         TAILQ_INSERT_TAIL(&httprequest->reply->headers.list, header, list);
@@ -438,7 +531,7 @@ static int httprequest_httpparser_on_header_value (http_parser *http_parser, con
         if (MEDUSA_IS_ERR_OR_NULL(header)) {
                 return MEDUSA_PTR_ERR(header);
         }
-        rc = medusa_httprequest_reply_header_set_value(header, at, length);
+        rc = medusa_httprequest_reply_header_set_value(httprequest->reply, header, at, length);
         if (rc < 0) {
                 return rc;
         }
@@ -483,23 +576,51 @@ static int httprequest_httpparser_on_headers_complete (http_parser *http_parser)
 
 static int httprequest_httpparser_on_body (http_parser *http_parser, const char *at, size_t length)
 {
-        void *tmp;
+        int rc;
         struct medusa_httprequest *httprequest = http_parser->data;
-        tmp = realloc(httprequest->reply->body.value, httprequest->reply->body.length + length + 1);
-        if (tmp == NULL) {
-                tmp = malloc(httprequest->reply->body.length + length + 1);
-                if (tmp == NULL) {
+        if (httprequest->body_fd >= 0) {
+                size_t written;
+                ssize_t wlength;
+                for (written = 0; written < length; ) {
+                        wlength = write(httprequest->body_fd, at + written, length - written);
+                        if (wlength < 0) {
+                                if (errno == EINTR) {
+                                        continue;
+                                }
+                                medusa_errorf("write failed, errno: %d", errno);
+                                return -errno;
+                        }
+                        written += wlength;
+                }
+        }
+        if (!MEDUSA_IS_ERR_OR_NULL(httprequest->body_buffer)) {
+                int64_t alength;
+                alength = medusa_buffer_append(httprequest->body_buffer, at, length);
+                if (alength != (int64_t) length) {
+                        medusa_errorf("medusa_buffer_append failed, alength: %d / %d", (int) alength, (int) length);
                         return -ENOMEM;
                 }
-                memcpy(tmp, httprequest->reply->body.value, httprequest->reply->body.length);
-                free(httprequest->reply->body.value);
-                httprequest->reply->body.value = tmp;
-        } else {
-                httprequest->reply->body.value = tmp;
         }
-        memcpy(httprequest->reply->body.value +  httprequest->reply->body.length, at, length);
+        if (httprequest->body_fd < 0 &&
+            MEDUSA_IS_ERR_OR_NULL(httprequest->body_buffer) &&
+            httprequest->body_stream == 0) {
+                rc = medusa_httprequest_reply_body_append(&httprequest->reply->body, at, length);
+                if (rc < 0) {
+                        return rc;
+                }
+        }
         httprequest->reply->body.length += length;
-        ((char *) httprequest->reply->body.value)[httprequest->reply->body.length] = '\0';
+        {
+                struct medusa_httprequest_event_received_body medusa_httprequest_event_received_body;
+                medusa_httprequest_event_received_body.data   = at;
+                medusa_httprequest_event_received_body.length = length;
+                rc = medusa_httprequest_onevent_unlocked(httprequest, MEDUSA_HTTPREQUEST_EVENT_RECEIVED_BODY, &medusa_httprequest_event_received_body);
+                if (rc < 0) {
+                        medusa_errorf("medusa_httprequest_onevent_unlocked failed, rc: %d", rc);
+                        httprequest->onevent_error = rc;
+                        return rc;
+                }
+        }
         return 0;
 }
 
@@ -507,6 +628,12 @@ static int httprequest_httpparser_on_message_complete (http_parser *http_parser)
 {
         int rc;
         struct medusa_httprequest *httprequest = http_parser->data;
+        if (httprequest->connection != NULL &&
+            http_should_keep_alive(http_parser)) {
+                /* stop right after this message, the connection goes back to the pool */
+                httprequest->keepalive = 1;
+                http_parser_pause(http_parser, 1);
+        }
         rc = httprequest_set_state(httprequest, MEDUSA_HTTPREQUEST_STATE_RECEIVED);
         if (rc < 0) {
                 medusa_errorf("httprequest_set_state failed, rc: %d", rc);
@@ -540,6 +667,24 @@ static int httprequest_httpparser_on_chunk_complete (http_parser *http_parser)
         return 0;
 }
 
+static void httprequest_httpparser_init (struct medusa_httprequest *httprequest)
+{
+        http_parser_settings_init(&httprequest->http_parser_settings);
+        httprequest->http_parser_settings.on_message_begin      = httprequest_httpparser_on_message_begin;
+        httprequest->http_parser_settings.on_url                = httprequest_httpparser_on_url;
+        httprequest->http_parser_settings.on_status             = httprequest_httpparser_on_status;
+        httprequest->http_parser_settings.on_header_field       = httprequest_httpparser_on_header_field;
+        httprequest->http_parser_settings.on_header_value       = httprequest_httpparser_on_header_value;
+        httprequest->http_parser_settings.on_headers_complete   = httprequest_httpparser_on_headers_complete;
+        httprequest->http_parser_settings.on_body               = httprequest_httpparser_on_body;
+        httprequest->http_parser_settings.on_message_complete   = httprequest_httpparser_on_message_complete;
+        httprequest->http_parser_settings.on_chunk_header       = httprequest_httpparser_on_chunk_header;
+        httprequest->http_parser_settings.on_chunk_complete     = httprequest_httpparser_on_chunk_complete;
+        http_parser_init(&httprequest->http_parser, HTTP_RESPONSE);
+        httprequest->http_parser.data = httprequest;
+        httprequest->keepalive = 0;
+}
+
 static int httprequest_tcpsocket_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
 {
         int rc;
@@ -610,19 +755,7 @@ static int httprequest_tcpsocket_onevent (struct medusa_tcpsocket *tcpsocket, un
                         medusa_errorf("medusa_httprequest_onevent_unlocked failed, rc: %d", rc);
                         goto bail;
                 }
-                http_parser_settings_init(&httprequest->http_parser_settings);
-                httprequest->http_parser_settings.on_message_begin      = httprequest_httpparser_on_message_begin;
-                httprequest->http_parser_settings.on_url                = httprequest_httpparser_on_url;
-                httprequest->http_parser_settings.on_status             = httprequest_httpparser_on_status;
-                httprequest->http_parser_settings.on_header_field       = httprequest_httpparser_on_header_field;
-                httprequest->http_parser_settings.on_header_value       = httprequest_httpparser_on_header_value;
-                httprequest->http_parser_settings.on_headers_complete   = httprequest_httpparser_on_headers_complete;
-                httprequest->http_parser_settings.on_body               = httprequest_httpparser_on_body;
-                httprequest->http_parser_settings.on_message_complete   = httprequest_httpparser_on_message_complete;
-                httprequest->http_parser_settings.on_chunk_header       = httprequest_httpparser_on_chunk_header;
-                httprequest->http_parser_settings.on_chunk_complete     = httprequest_httpparser_on_chunk_complete;
-                http_parser_init(&httprequest->http_parser, HTTP_RESPONSE);
-                httprequest->http_parser.data = httprequest;
+                httprequest_httpparser_init(httprequest);
         }
         if (events & MEDUSA_TCPSOCKET_EVENT_CONNECT_TIMEOUT) {
                 rc = httprequest_set_state(httprequest, MEDUSA_HTTPREQUEST_STATE_DISCONNECTED);
@@ -665,6 +798,7 @@ static int httprequest_tcpsocket_onevent (struct medusa_tcpsocket *tcpsocket, un
                 }
         }
         if (events & MEDUSA_TCPSOCKET_EVENT_BUFFERED_READ) {
+receive:
                 if (httprequest_get_state(httprequest) == MEDUSA_HTTPREQUEST_STATE_REQUESTED) {
                         rc = httprequest_set_state(httprequest, MEDUSA_HTTPREQUEST_STATE_RECEIVING);
                         if (rc < 0) {
@@ -709,6 +843,14 @@ static int httprequest_tcpsocket_onevent (struct medusa_tcpsocket *tcpsocket, un
                                 medusa_errorf("medusa_httprequest_onevent_unlocked failed, rc: %d", httprequest->onevent_error);
                                 goto bail;
                         }
+                        if (httprequest->keepalive) {
+                                clength = medusa_buffer_choke(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), 0, nparsed);
+                                if (clength != (int64_t) nparsed) {
+                                        medusa_errorf("medusa_buffer_choke failed, clength: %d / %d", (int) clength, (int) nparsed);
+                                        goto bail;
+                                }
+                                break;
+                        }
                         if (httprequest->http_parser.http_errno != HPE_OK) {
                                 struct medusa_httprequest_event_error medusa_httprequest_event_error;
                                 medusa_httprequest_event_error.state  = httprequest->state;
@@ -734,6 +876,42 @@ static int httprequest_tcpsocket_onevent (struct medusa_tcpsocket *tcpsocket, un
                                 goto bail;
                         }
                 }
+
+                if (httprequest->keepalive) {
+                        int reuse;
+                        struct medusa_httprequest *next;
+                        struct medusa_httpclient_connection *connection;
+                        /* bytes past the response belong to the next pipelined
+                         * request, if there is none the peer is out of sync */
+                        next  = TAILQ_NEXT(httprequest, inflight);
+                        reuse = medusa_buffer_get_length(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket)) == 0 || next != NULL;
+                        if (events & (MEDUSA_TCPSOCKET_EVENT_DISCONNECTED | MEDUSA_TCPSOCKET_EVENT_ERROR)) {
+                                reuse = 0;
+                        }
+                        connection = httprequest->connection;
+                        httprequest->connection = NULL;
+                        httprequest->tcpsocket  = NULL;
+                        httprequest->keepalive  = 0;
+                        next = medusa_httpclient_release_unlocked(connection, httprequest, reuse);
+                        rc = httprequest_set_state(httprequest, MEDUSA_HTTPREQUEST_STATE_DISCONNECTED);
+                        if (rc < 0) {
+                                medusa_errorf("httprequest_set_state failed, rc: %d", rc);
+                                goto bail;
+                        }
+                        rc = medusa_httprequest_onevent_unlocked(httprequest, MEDUSA_HTTPREQUEST_EVENT_DISCONNECTED, NULL);
+                        if (rc < 0) {
+                                medusa_errorf("medusa_httprequest_onevent_unlocked failed, rc: %d", rc);
+                                goto bail;
+                        }
+                        if (next != NULL &&
+                            next->tcpsocket == tcpsocket &&
+                            medusa_buffer_get_length(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket)) > 0) {
+                                httprequest = next;
+                                goto receive;
+                        }
+                        medusa_monitor_unlock(monitor);
+                        return 0;
+                }
         }
         if (events & MEDUSA_TCPSOCKET_EVENT_BUFFERED_READ_TIMEOUT) {
                 rc = medusa_httprequest_onevent_unlocked(httprequest, MEDUSA_HTTPREQUEST_EVENT_RECEIVE_TIMEOUT, NULL);
@@ -821,9 +999,13 @@ static int httprequest_init_with_options_unlocked (struct medusa_httprequest *ht
         httprequest->onevent = options->onevent;
         httprequest->context = options->context;
         httprequest->dnsresolver     = options->dnsresolver;
+        httprequest->httpclient      = options->httpclient;
         httprequest->resolve_timeout = -1;
         httprequest->connect_timeout = -1;
         httprequest->read_timeout    = -1;
+        httprequest->body_fd         = options->body_fd;
+        httprequest->body_buffer     = options->body_buffer;
+        httprequest->body_stream     = !!options->body_stream;
         httprequest->method          = NULL;
         httprequest->headers = medusa_buffer_create(MEDUSA_BUFFER_TYPE_DEFAULT);
         if (MEDUSA_IS_ERR_OR_NULL(httprequest->headers)) {
@@ -893,6 +1075,9 @@ __attribute__ ((visibility ("default"))) int medusa_httprequest_init_options_def
         options->resolve_timeout = -1;
         options->connect_timeout = -1;
         options->read_timeout    = -1;
+        options->body_fd         = -1;
+        options->body_buffer     = NULL;
+        options->body_stream     = 0;
         options->method          = "GET";
         options->url             = NULL;
         options->host            = NULL;
@@ -1014,6 +1199,54 @@ __attribute__ ((visibility ("default"))) unsigned int medusa_httprequest_get_sta
         return rc;
 }
 
+__attribute__ ((visibility ("default"))) int medusa_httprequest_set_httpclient_unlocked (struct medusa_httprequest *httprequest, struct medusa_httpclient *httpclient)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(httprequest)) {
+                return -EINVAL;
+        }
+        if (httprequest_get_state(httprequest) != MEDUSA_HTTPREQUEST_STATE_DISCONNECTED) {
+                return -EINVAL;
+        }
+        if (httprequest->origin != NULL ||
+            httprequest->connection != NULL) {
+                return -EINVAL;
+        }
+        httprequest->httpclient = httpclient;
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_httprequest_set_httpclient (struct medusa_httprequest *httprequest, struct medusa_httpclient *httpclient)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(httprequest)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(httprequest->subject.monitor);
+        rc = medusa_httprequest_set_httpclient_unlocked(httprequest, httpclient);
+        medusa_monitor_unlock(httprequest->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) struct medusa_httpclient * medusa_httprequest_get_httpclient_unlocked (const struct medusa_httprequest *httprequest)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(httprequest)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        return httprequest->httpclient;
+}
+
+__attribute__ ((visibility ("default"))) struct medusa_httpclient * medusa_httprequest_get_httpclient (const struct medusa_httprequest *httprequest)
+{
+        struct medusa_httpclient *rc;
+        if (MEDUSA_IS_ERR_OR_NULL(httprequest)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        medusa_monitor_lock(httprequest->subject.monitor);
+        rc = medusa_httprequest_get_httpclient_unlocked(httprequest);
+        medusa_monitor_unlock(httprequest->subject.monitor);
+        return rc;
+}
+
 __attribute__ ((visibility ("default"))) int medusa_httprequest_set_resolve_timeout_unlocked (struct medusa_httprequest *httprequest, double timeout)
 {
         if (MEDUSA_IS_ERR_OR_NULL(httprequest)) {
@@ -1137,6 +1370,129 @@ __attribute__ ((visibility ("default"))) double medusa_httprequest_get_read_time
         return rc;
 }
 
+__attribute__ ((visibility ("default"))) int medusa_httprequest_set_body_fd_unlocked (struct medusa_httprequest *httprequest, int fd)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(httprequest)) {
+                return -EINVAL;
+        }
+        httprequest->body_fd = fd;
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_httprequest_set_body_fd (struct medusa_httprequest *httprequest, int fd)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(httprequest)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(httprequest->subject.monitor);
+        rc = medusa_httprequest_set_body_fd_unlocked(httprequest, fd);
+        medusa_monitor_unlock(httprequest->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_httprequest_get_body_fd_unlocked (const struct medusa_httprequest *httprequest)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(httprequest)) {
+                return -EINVAL;
+        }
+        return httprequest->body_fd;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_httprequest_get_body_fd (const struct medusa_httprequest *httprequest)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(httprequest)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(httprequest->subject.monitor);
+        rc = medusa_httprequest_get_body_fd_unlocked(httprequest);
+        medusa_monitor_unlock(httprequest->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_httprequest_set_body_buffer_unlocked (struct medusa_httprequest *httprequest, struct medusa_buffer *buffer)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(httprequest)) {
+                return -EINVAL;
+        }
+        httprequest->body_buffer = buffer;
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_httprequest_set_body_buffer (struct medusa_httprequest *httprequest, struct medusa_buffer *buffer)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(httprequest)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(httprequest->subject.monitor);
+        rc = medusa_httprequest_set_body_buffer_unlocked(httprequest, buffer);
+        medusa_monitor_unlock(httprequest->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) struct medusa_buffer * medusa_httprequest_get_body_buffer_unlocked (const struct medusa_httprequest *httprequest)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(httprequest)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        return httprequest->body_buffer;
+}
+
+__attribute__ ((visibility ("default"))) struct medusa_buffer * medusa_httprequest_get_body_buffer (const struct medusa_httprequest *httprequest)
+{
+        struct medusa_buffer *rc;
+        if (MEDUSA_IS_ERR_OR_NULL(httprequest)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        medusa_monitor_lock(httprequest->subject.monitor);
+        rc = medusa_httprequest_get_body_buffer_unlocked(httprequest);
+        medusa_monitor_unlock(httprequest->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_httprequest_set_body_stream_unlocked (struct medusa_httprequest *httprequest, int enabled)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(httprequest)) {
+                return -EINVAL;
+        }
+        httprequest->body_stream = !!enabled;
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_httprequest_set_body_stream (struct medusa_httprequest *httprequest, int enabled)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(httprequest)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(httprequest->subject.monitor);
+        rc = medusa_httprequest_set_body_stream_unlocked(httprequest, enabled);
+        medusa_monitor_unlock(httprequest->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_httprequest_get_body_stream_unlocked (const struct medusa_httprequest *httprequest)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(httprequest)) {
+                return -EINVAL;
+        }
+        return httprequest->body_stream;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_httprequest_get_body_stream (const struct medusa_httprequest *httprequest)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(httprequest)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(httprequest->subject.monitor);
+        rc = medusa_httprequest_get_body_stream_unlocked(httprequest);
+        medusa_monitor_unlock(httprequest->subject.monitor);
+        return rc;
+}
+
 __attribute__ ((visibility ("default"))) int medusa_httprequest_set_method_unlocked (struct medusa_httprequest *httprequest, const char *method)
 {
         int i;
@@ -1618,13 +1974,44 @@ __attribute__ ((visibility ("default"))) int medusa_httprequest_add_raw_headerv
         return rc;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_httprequest_make_request_unlocked (struct medusa_httprequest *httprequest, const void *data, int64_t length)
+static int httprequest_connect_unlocked (struct medusa_httprequest *httprequest, struct medusa_url *url)
 {
         int rc;
-        int ret;
-        struct medusa_url *url;
         struct medusa_tcpsocket_connect_options medusa_tcpsocket_connect_options;
 
+        rc = medusa_tcpsocket_connect_options_default(&medusa_tcpsocket_connect_options);
+        if (rc < 0) {
+                return rc;
+        }
+        medusa_tcpsocket_connect_options.monitor         = httprequest->subject.monitor;
+        medusa_tcpsocket_connect_options.dnsresolver     = httprequest->dnsresolver;
+        medusa_tcpsocket_connect_options.onevent         = httprequest_tcpsocket_onevent;
+        medusa_tcpsocket_connect_options.context         = httprequest;
+        medusa_tcpsocket_connect_options.protocol        = MEDUSA_TCPSOCKET_PROTOCOL_ANY;
+        medusa_tcpsocket_connect_options.address         = medusa_url_get_host(url);
+        medusa_tcpsocket_connect_options.port            = medusa_url_get_port(url);
+        medusa_tcpsocket_connect_options.resolve_timeout = httprequest->resolve_timeout;
+        medusa_tcpsocket_connect_options.connect_timeout = httprequest->connect_timeout;
+        medusa_tcpsocket_connect_options.read_timeout    = httprequest->read_timeout;
+        medusa_tcpsocket_connect_options.nonblocking     = 1;
+        medusa_tcpsocket_connect_options.nodelay         = 1;
+        medusa_tcpsocket_connect_options.buffered        = 1;
+        medusa_tcpsocket_connect_options.ssl             = medusa_url_get_scheme(url) && strcasecmp(medusa_url_get_scheme(url), "https") == 0;
+        medusa_tcpsocket_connect_options.ssl_hostname    = httprequest->host;
+        medusa_tcpsocket_connect_options.enabled         = 1;
+        httprequest->tcpsocket = medusa_tcpsocket_connect_with_options_unlocked(&medusa_tcpsocket_connect_options);
+        if (MEDUSA_IS_ERR_OR_NULL(httprequest->tcpsocket)) {
+                return MEDUSA_PTR_ERR(httprequest->tcpsocket);
+        }
+        rc = medusa_tcpsocket_set_ssl_unlocked(httprequest->tcpsocket, medusa_url_get_scheme(url) && strcasecmp(medusa_url_get_scheme(url), "https") == 0);
+        if (rc < 0) {
+                return rc;
+        }
+        return 0;
+}
+
+static int httprequest_flush_unlocked (struct medusa_httprequest *httprequest)
+{
         int64_t i;
         int64_t olen;
         int64_t rlen;
@@ -1632,6 +2019,142 @@ __attribute__ ((visibility ("default"))) int medusa_httprequest_make_request_unl
         int64_t niovecs;
         struct medusa_iovec iovecs[16];
 
+        olen = 0;
+        while (1) {
+                niovecs = medusa_buffer_peekv(httprequest->request, olen, -1, iovecs, sizeof(iovecs) / sizeof(iovecs[0]));
+                if (niovecs < 0) {
+                        return niovecs;
+                }
+                if (niovecs == 0) {
+                        break;
+                }
+                for (rlen = 0, i = 0; i < niovecs; i++) {
+                        rlen += iovecs[i].iov_len;
+                }
+                wlen = medusa_tcpsocket_writev_unlocked(httprequest->tcpsocket, iovecs, niovecs);
+                if (wlen < 0) {
+                        return wlen;
+                }
+                if (wlen != rlen) {
+                        return -EIO;
+                }
+                olen += rlen;
+        }
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_httprequest_dispatch_unlocked (struct medusa_httprequest *httprequest, struct medusa_httpclient_connection *connection)
+{
+        int rc;
+        struct medusa_url *url;
+
+        if (MEDUSA_IS_ERR_OR_NULL(httprequest)) {
+                return -EINVAL;
+        }
+
+        if (connection == NULL) {
+                struct medusa_httprequest_event_error medusa_httprequest_event_error;
+                medusa_httprequest_event_error.state  = httprequest->state;
+                medusa_httprequest_event_error.error  = ECANCELED;
+                medusa_httprequest_event_error.line   = __LINE__;
+                medusa_httprequest_event_error.reason = MEDUSA_HTTPREQUEST_ERROR_REASON_HTTPCLIENT;
+                httprequest_set_state(httprequest, MEDUSA_HTTPREQUEST_STATE_DISCONNECTED);
+                medusa_httprequest_onevent_unlocked(httprequest, MEDUSA_HTTPREQUEST_EVENT_ERROR, &medusa_httprequest_event_error);
+                return -ECANCELED;
+        }
+
+        httprequest->connection = connection;
+
+        if (httprequest != TAILQ_FIRST(&connection->inflights)) {
+                /* pipelined, the request goes out right away but the socket
+                 * stays with the head until the responses ahead are read */
+                httprequest->tcpsocket = connection->tcpsocket;
+                rc = httprequest_flush_unlocked(httprequest);
+                if (rc < 0) {
+                        goto bail;
+                }
+                return 0;
+        }
+
+        if (connection->tcpsocket != NULL) {
+                httprequest->tcpsocket = connection->tcpsocket;
+                rc = medusa_tcpsocket_set_onevent_unlocked(httprequest->tcpsocket, httprequest_tcpsocket_onevent, httprequest);
+                if (rc < 0) {
+                        goto bail;
+                }
+                rc = medusa_tcpsocket_set_read_timeout_unlocked(httprequest->tcpsocket, httprequest->read_timeout);
+                if (rc < 0) {
+                        goto bail;
+                }
+                rc = httprequest_set_state(httprequest, MEDUSA_HTTPREQUEST_STATE_CONNECTED);
+                if (rc < 0) {
+                        goto bail;
+                }
+                rc = medusa_httprequest_onevent_unlocked(httprequest, MEDUSA_HTTPREQUEST_EVENT_CONNECTED, NULL);
+                if (rc < 0) {
+                        goto bail;
+                }
+                httprequest_httpparser_init(httprequest);
+        } else {
+                url = medusa_url_parse(httprequest->url);
+                if (MEDUSA_IS_ERR_OR_NULL(url)) {
+                        rc = -EINVAL;
+                        goto bail;
+                }
+                rc = httprequest_connect_unlocked(httprequest, url);
+                medusa_url_destroy(url);
+                if (!MEDUSA_IS_ERR_OR_NULL(httprequest->tcpsocket)) {
+                        connection->tcpsocket = httprequest->tcpsocket;
+                }
+                if (rc < 0) {
+                        goto bail;
+                }
+        }
+
+        rc = httprequest_flush_unlocked(httprequest);
+        if (rc < 0) {
+                goto bail;
+        }
+        return 0;
+bail:   httprequest_set_state(httprequest, MEDUSA_HTTPREQUEST_STATE_DISCONNECTED);
+        medusa_httprequest_onevent_unlocked(httprequest, MEDUSA_HTTPREQUEST_EVENT_DISCONNECTED, NULL);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_httprequest_promote_unlocked (struct medusa_httprequest *httprequest)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(httprequest)) {
+                return -EINVAL;
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(httprequest->tcpsocket)) {
+                return -EINVAL;
+        }
+        rc = medusa_tcpsocket_set_onevent_unlocked(httprequest->tcpsocket, httprequest_tcpsocket_onevent, httprequest);
+        if (rc < 0) {
+                return rc;
+        }
+        rc = medusa_tcpsocket_set_read_timeout_unlocked(httprequest->tcpsocket, httprequest->read_timeout);
+        if (rc < 0) {
+                return rc;
+        }
+        httprequest_httpparser_init(httprequest);
+        httprequest_set_state(httprequest, MEDUSA_HTTPREQUEST_STATE_CONNECTED);
+        medusa_httprequest_onevent_unlocked(httprequest, MEDUSA_HTTPREQUEST_EVENT_CONNECTED, NULL);
+        httprequest_set_state(httprequest, MEDUSA_HTTPREQUEST_STATE_REQUESTING);
+        medusa_httprequest_onevent_unlocked(httprequest, MEDUSA_HTTPREQUEST_EVENT_REQUESTING, NULL);
+        httprequest_set_state(httprequest, MEDUSA_HTTPREQUEST_STATE_REQUESTED);
+        medusa_httprequest_onevent_unlocked(httprequest, MEDUSA_HTTPREQUEST_EVENT_REQUESTED, NULL);
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_httprequest_make_request_unlocked (struct medusa_httprequest *httprequest, const void *data, int64_t length)
+{
+        int rc;
+        int ret;
+        struct medusa_url *url;
+        struct medusa_httpclient_connection *connection;
+
         url = NULL;
 
         if (MEDUSA_IS_ERR_OR_NULL(httprequest)) {
@@ -1649,6 +2172,10 @@ __attribute__ ((visibility ("default"))) int medusa_httprequest_make_request_unl
         if (httprequest_get_state(httprequest) != MEDUSA_HTTPREQUEST_STATE_DISCONNECTED) {
                 return -EINVAL;
         }
+        if (httprequest->origin != NULL ||
+            httprequest->connection != NULL) {
+                return -EINVAL;
+        }
         if (httprequest->url == NULL) {
                 return -EINVAL;
         }
@@ -1660,72 +2187,56 @@ __attribute__ ((visibility ("default"))) int medusa_httprequest_make_request_unl
 
         ret = 0;
 
-        rc = medusa_tcpsocket_connect_options_default(&medusa_tcpsocket_connect_options);
-        if (rc < 0) {
-                ret = rc;
-                goto bail;
-        }
-        medusa_tcpsocket_connect_options.monitor         = httprequest->subject.monitor;
-        medusa_tcpsocket_connect_options.dnsresolver     = httprequest->dnsresolver;
-        medusa_tcpsocket_connect_options.onevent         = httprequest_tcpsocket_onevent;
-        medusa_tcpsocket_connect_options.context         = httprequest;
-        medusa_tcpsocket_connect_options.protocol        = MEDUSA_TCPSOCKET_PROTOCOL_ANY;
-        medusa_tcpsocket_connect_options.address         = medusa_url_get_host(url);
-        medusa_tcpsocket_connect_options.port            = medusa_url_get_port(url);
-        medusa_tcpsocket_connect_options.resolve_timeout = httprequest->resolve_timeout;
-        medusa_tcpsocket_connect_options.connect_timeout = httprequest->connect_timeout;
-        medusa_tcpsocket_connect_options.read_timeout    = httprequest->read_timeout;
-        medusa_tcpsocket_connect_options.nonblocking     = 1;
-        medusa_tcpsocket_connect_options.nodelay         = 1;
-        medusa_tcpsocket_connect_options.buffered        = 1;
-        medusa_tcpsocket_connect_options.ssl             = medusa_url_get_scheme(url) && strcasecmp(medusa_url_get_scheme(url), "https") == 0;
-        medusa_tcpsocket_connect_options.ssl_hostname    = httprequest->host;
-        medusa_tcpsocket_connect_options.enabled         = 1;
-        httprequest->tcpsocket = medusa_tcpsocket_connect_with_options_unlocked(&medusa_tcpsocket_connect_options);
-        if (MEDUSA_IS_ERR_OR_NULL(httprequest->tcpsocket)) {
-                ret = MEDUSA_PTR_ERR(httprequest->tcpsocket);
-                goto bail;
+        if (MEDUSA_IS_ERR_OR_NULL(httprequest->request)) {
+                httprequest->request = medusa_buffer_create(MEDUSA_BUFFER_TYPE_DEFAULT);
+                if (MEDUSA_IS_ERR_OR_NULL(httprequest->request)) {
+                        ret = MEDUSA_PTR_ERR(httprequest->request);
+                        httprequest->request = NULL;
+                        goto bail;
+                }
         }
-        rc = medusa_tcpsocket_set_ssl_unlocked(httprequest->tcpsocket, medusa_url_get_scheme(url) && strcasecmp(medusa_url_get_scheme(url), "https") == 0);
+        rc = medusa_buffer_reset(httprequest->request);
         if (rc < 0) {
                 ret = rc;
                 goto bail;
         }
 
-        rc = medusa_tcpsocket_printf_unlocked(httprequest->tcpsocket, "%s /%s HTTP/1.1\r\n", (httprequest->method) ? httprequest->method : "GET", medusa_url_get_path(url) ? medusa_url_get_path(url) : "");
+        rc = medusa_buffer_printf(httprequest->request, "%s /%s HTTP/1.1\r\n", (httprequest->method) ? httprequest->method : "GET", medusa_url_get_path(url) ? medusa_url_get_path(url) : "");
         if (rc < 0) {
                 ret = rc;
                 goto bail;
         }
-        rc = medusa_tcpsocket_printf_unlocked(httprequest->tcpsocket, "Host: %s\r\n", httprequest->host ? httprequest->host : medusa_url_get_host(url));
+        rc = medusa_buffer_printf(httprequest->request, "Host: %s\r\n", httprequest->host ? httprequest->host : medusa_url_get_host(url));
         if (rc < 0) {
                 ret = rc;
                 goto bail;
         }
-        olen = 0;
-        while (1) {
-                niovecs = medusa_buffer_peekv(httprequest->headers, olen, -1, iovecs, sizeof(iovecs) / sizeof(iovecs[0]));
-                if (niovecs < 0) {
-                        goto bail;
-                }
-                if (niovecs == 0) {
-                        break;
-                }
-                for (rlen = 0, i = 0; i < niovecs; i++) {
-                        rlen += iovecs[i].iov_len;
-                }
-                wlen = medusa_tcpsocket_writev_unlocked(httprequest->tcpsocket, iovecs, niovecs);
-                if (wlen < 0) {
-                        goto bail;
-                }
-                if (wlen != rlen) {
-                        goto bail;
+        {
+                int64_t olen;
+                int64_t niovecs;
+                struct medusa_iovec iovecs[16];
+                olen = 0;
+                while (1) {
+                        niovecs = medusa_buffer_peekv(httprequest->headers, olen, -1, iovecs, sizeof(iovecs) / sizeof(iovecs[0]));
+                        if (niovecs < 0) {
+                                ret = niovecs;
+                                goto bail;
+                        }
+                        if (niovecs == 0) {
+                                break;
+                        }
+                        rc = medusa_buffer_appendv(httprequest->request, iovecs, niovecs);
+                        if (rc < 0) {
+                                ret = rc;
+                                goto bail;
+                        }
+                        olen += rc;
                 }
-                olen += rlen;
         }
-        if (medusa_buffer_strcasecmp(httprequest->headers, 0, "Connection:") != 0 &&
+        if (httprequest->httpclient == NULL &&
+            medusa_buffer_strcasecmp(httprequest->headers, 0, "Connection:") != 0 &&
             medusa_buffer_strcasestr(httprequest->headers, 0, "\r\nConnection:") == -ENOENT) {
-                rc = medusa_tcpsocket_printf_unlocked(httprequest->tcpsocket, "Connection: close\r\n");
+                rc = medusa_buffer_printf(httprequest->request, "Connection: close\r\n");
                 if (rc < 0) {
                         ret = rc;
                         goto bail;
@@ -1734,24 +2245,59 @@ __attribute__ ((visibility ("default"))) int medusa_httprequest_make_request_unl
         if (httprequest->method &&  strcasecmp(httprequest->method, "POST") == 0) {
                 if (medusa_buffer_strcasecmp(httprequest->headers, 0, "Content-Length:") != 0 &&
                     medusa_buffer_strcasestr(httprequest->headers, 0, "\r\nContent-Length:") == -ENOENT) {
-                        rc = medusa_tcpsocket_printf_unlocked(httprequest->tcpsocket, "Content-Length: %ld\r\n", (long int) length);
+                        rc = medusa_buffer_printf(httprequest->request, "Content-Length: %ld\r\n", (long int) length);
                         if (rc < 0) {
                                 ret = rc;
                                 goto bail;
                         }
                 }
         }
-        rc = medusa_tcpsocket_printf_unlocked(httprequest->tcpsocket, "\r\n");
+        rc = medusa_buffer_printf(httprequest->request, "\r\n");
         if (rc < 0) {
+                ret = rc;
                 goto bail;
         }
         if (length > 0) {
-                rc = medusa_tcpsocket_write_unlocked(httprequest->tcpsocket, data, length);
+                rc = medusa_buffer_append(httprequest->request, data, length);
                 if (rc != length) {
+                        ret = (rc < 0) ? rc : -EIO;
                         goto bail;
                 }
         }
 
+        if (httprequest->httpclient == NULL) {
+                rc = httprequest_connect_unlocked(httprequest, url);
+                if (rc < 0) {
+                        ret = rc;
+                        goto bail;
+                }
+                rc = httprequest_flush_unlocked(httprequest);
+                if (rc < 0) {
+                        ret = rc;
+                        goto bail;
+                }
+        } else {
+                char origin[512];
+                rc = snprintf(origin, sizeof(origin), "%s://%s:%d@%s",
+                                medusa_url_get_scheme(url) ? medusa_url_get_scheme(url) : "http",
+                                medusa_url_get_host(url) ? medusa_url_get_host(url) : "",
+                                medusa_url_get_port(url),
+                                httprequest->host ? httprequest->host : "");
+                if (rc < 0 || rc >= (int) sizeof(origin)) {
+                        ret = -ENAMETOOLONG;
+                        goto bail;
+                }
+                rc = medusa_httpclient_acquire_unlocked(httprequest->httpclient, httprequest, origin, &connection);
+                if (rc < 0) {
+                        ret = rc;
+                        goto bail;
+                }
+                if (connection != NULL) {
+                        medusa_url_destroy(url);
+                        return medusa_httprequest_dispatch_unlocked(httprequest, connection);
+                }
+        }
+
         medusa_url_destroy(url);
         return 0;
 bail:   medusa_url_destroy(url);
@@ -1943,10 +2489,18 @@ __attribute__ ((visibility ("default"))) int medusa_httprequest_onevent_unlocked
                         medusa_buffer_destroy(httprequest->headers);
                         httprequest->headers = NULL;
                 }
+                if (httprequest->origin != NULL ||
+                    httprequest->connection != NULL) {
+                        medusa_httpclient_cancel_unlocked(httprequest);
+                }
                 if (!MEDUSA_IS_ERR_OR_NULL(httprequest->tcpsocket)) {
                         medusa_tcpsocket_destroy_unlocked(httprequest->tcpsocket);
                         httprequest->tcpsocket = NULL;
                 }
+                if (!MEDUSA_IS_ERR_OR_NULL(httprequest->request)) {
+                        medusa_buffer_destroy(httprequest->request);
+                        httprequest->request = NULL;
+                }
                 if (!MEDUSA_IS_ERR_OR_NULL(httprequest->reply)) {
                         medusa_httprequest_reply_destroy(httprequest->reply);
                         httprequest->reply = NULL;
@@ -2154,6 +2708,7 @@ __attribute__ ((visibility ("default"))) const char * medusa_httprequest_event_s
         if (events == MEDUSA_HTTPREQUEST_EVENT_ERROR)           return "MEDUSA_HTTPREQUEST_EVENT_ERROR";
         if (events == MEDUSA_HTTPREQUEST_EVENT_STATE_CHANGED)   return "MEDUSA_HTTPREQUEST_EVENT_STATE_CHANGED";
         if (events == MEDUSA_HTTPREQUEST_EVENT_DESTROY)         return "MEDUSA_HTTPREQUEST_EVENT_DESTROY";
+        if (events == MEDUSA_HTTPREQUEST_EVENT_RECEIVED_BODY)   return "MEDUSA_HTTPREQUEST_EVENT_RECEIVED_BODY";
         return "MEDUSA_HTTPREQUEST_EVENT_UNKNOWN";
 }
 
@@ -2172,8 +2727,25 @@ __attribute__ ((visibility ("default"))) const char * medusa_httprequest_state_s
         return "MEDUSA_HTTPREQUEST_STATE_UNKNOWN";
 }
 
+static int httprequest_subject_onevent (struct medusa_subject *subject, unsigned int events, void *param)
+{
+        return medusa_httprequest_onevent_unlocked((struct medusa_httprequest *) subject, events, param);
+}
+
+static int httprequest_subject_destroy (struct medusa_subject *subject)
+{
+        return medusa_httprequest_onevent_unlocked((struct medusa_httprequest *) subject, MEDUSA_HTTPREQUEST_EVENT_DESTROY, NULL);
+}
+
+static const struct medusa_subject_type g_subject_type = {
+        .rank    = MEDUSA_SUBJECT_RANK_HTTPREQUEST,
+        .onevent = httprequest_subject_onevent,
+        .destroy = httprequest_subject_destroy
+};
+
 __attribute__ ((constructor)) static void httprequest_constructor (void)
 {
+        medusa_monitor_register_subject_type(MEDUSA_SUBJECT_TYPE_HTTPREQUEST, &g_subject_type);
 #if defined(MEDUSA_HTTPREQUEST_USE_POOL) && (MEDUSA_HTTPREQUEST_USE_POOL == 1)
         g_pool = medusa_pool_create("medusa-httprequest", sizeof(struct medusa_httprequest), 0, 0, MEDUSA_POOL_FLAG_DEFAULT | MEDUSA_POOL_FLAG_THREAD_SAFE, NULL, NULL, NULL);
 #endif
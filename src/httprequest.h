@@ -3,6 +3,8 @@
 #define MEDUSA_HTTPREQUEST_H
 
 struct medusa_monitor;
+struct medusa_buffer;
+struct medusa_httpclient;
 struct medusa_httprequest;
 struct medusa_httprequest_reply;
 struct medusa_httprequest_reply_header;
@@ -37,6 +39,7 @@ enum {
         MEDUSA_HTTPREQUEST_EVENT_ERROR                  = (1 << 15), /* 0x00008000 */
         MEDUSA_HTTPREQUEST_EVENT_STATE_CHANGED          = (1 << 16), /* 0x00010000 */
         MEDUSA_HTTPREQUEST_EVENT_DESTROY                = (1 << 17), /* 0x00020000 */
+        MEDUSA_HTTPREQUEST_EVENT_RECEIVED_BODY          = (1 << 18), /* 0x00040000 */
 #define MEDUSA_HTTPREQUEST_EVENT_RESOLVING              MEDUSA_HTTPREQUEST_EVENT_RESOLVING
 #define MEDUSA_HTTPREQUEST_EVENT_RESOLVE_TIMEOUT        MEDUSA_HTTPREQUEST_EVENT_RESOLVE_TIMEOUT
 #define MEDUSA_HTTPREQUEST_EVENT_RESOLVED               MEDUSA_HTTPREQUEST_EVENT_RESOLVED
@@ -55,6 +58,7 @@ enum {
 #define MEDUSA_HTTPREQUEST_EVENT_ERROR                  MEDUSA_HTTPREQUEST_EVENT_ERROR
 #define MEDUSA_HTTPREQUEST_EVENT_STATE_CHANGED          MEDUSA_HTTPREQUEST_EVENT_STATE_CHANGED
 #define MEDUSA_HTTPREQUEST_EVENT_DESTROY                MEDUSA_HTTPREQUEST_EVENT_DESTROY
+#define MEDUSA_HTTPREQUEST_EVENT_RECEIVED_BODY          MEDUSA_HTTPREQUEST_EVENT_RECEIVED_BODY
 };
 
 enum {
@@ -83,9 +87,13 @@ enum {
 struct medusa_httprequest_init_options {
         struct medusa_monitor *monitor;
         struct medusa_dnsresolver *dnsresolver;
+        struct medusa_httpclient *httpclient;
         double resolve_timeout;
         double connect_timeout;
         double read_timeout;
+        int body_fd;
+        struct medusa_buffer *body_buffer;
+        int body_stream;
         const char *method;
         const char *url;
         const char *host;
@@ -100,9 +108,11 @@ struct medusa_httprequest_event_state_changed {
 
 enum {
         MEDUSA_HTTPREQUEST_ERROR_REASON_PARSER          = 0,
-        MEDUSA_HTTPREQUEST_ERROR_REASON_TCPSOCKET       = 1
+        MEDUSA_HTTPREQUEST_ERROR_REASON_TCPSOCKET       = 1,
+        MEDUSA_HTTPREQUEST_ERROR_REASON_HTTPCLIENT      = 2
 #define MEDUSA_HTTPREQUEST_ERROR_REASON_PARSER          MEDUSA_HTTPREQUEST_ERROR_REASON_PARSER
 #define MEDUSA_HTTPREQUEST_ERROR_REASON_TCPSOCKET       MEDUSA_HTTPREQUEST_ERROR_REASON_TCPSOCKET
+#define MEDUSA_HTTPREQUEST_ERROR_REASON_HTTPCLIENT      MEDUSA_HTTPREQUEST_ERROR_REASON_HTTPCLIENT
 };
 
 struct medusa_httprequest_event_error {
@@ -130,6 +140,11 @@ struct medusa_httprequest_event_received_headers {
         const struct medusa_httprequest_reply_headers *headers;
 };
 
+struct medusa_httprequest_event_received_body {
+        const void *data;
+        int64_t length;
+};
+
 struct medusa_httprequest_event_received {
         const struct medusa_httprequest_reply *reply;
 };
@@ -147,6 +162,9 @@ void medusa_httprequest_destroy (struct medusa_httprequest *httprequest);
 
 unsigned int medusa_httprequest_get_state (const struct medusa_httprequest *httprequest);
 
+int medusa_httprequest_set_httpclient (struct medusa_httprequest *httprequest, struct medusa_httpclient *httpclient);
+struct medusa_httpclient * medusa_httprequest_get_httpclient (const struct medusa_httprequest *httprequest);
+
 int medusa_httprequest_set_resolve_timeout (struct medusa_httprequest *httprequest, double timeout);
 double medusa_httprequest_get_resolve_timeout (const struct medusa_httprequest *httprequest);
 
@@ -156,6 +174,15 @@ double medusa_httprequest_get_connect_timeout (const struct medusa_httprequest *
 int medusa_httprequest_set_read_timeout (struct medusa_httprequest *httprequest, double timeout);
 double medusa_httprequest_get_read_timeout (const struct medusa_httprequest *httprequest);
 
+int medusa_httprequest_set_body_fd (struct medusa_httprequest *httprequest, int fd);
+int medusa_httprequest_get_body_fd (const struct medusa_httprequest *httprequest);
+
+int medusa_httprequest_set_body_buffer (struct medusa_httprequest *httprequest, struct medusa_buffer *buffer);
+struct medusa_buffer * medusa_httprequest_get_body_buffer (const struct medusa_httprequest *httprequest);
+
+int medusa_httprequest_set_body_stream (struct medusa_httprequest *httprequest, int enabled);
+int medusa_httprequest_get_body_stream (const struct medusa_httprequest *httprequest);
+
 int medusa_httprequest_set_method (struct medusa_httprequest *httprequest, const char *method);
 
 int medusa_httprequest_set_url (struct medusa_httprequest *httprequest, const char *url, ...) __attribute__((format(printf, 2, 3)));
@@ -16,6 +16,7 @@ int medusa_httpserver_get_error_unlocked (const struct medusa_httpserver *httpse
 int medusa_httpserver_get_protocol_unlocked (struct medusa_httpserver *httpserver);
 int medusa_httpserver_get_sockport_unlocked (const struct medusa_httpserver *httpserver);
 int medusa_httpserver_get_sockname_unlocked (const struct medusa_httpserver *httpserver, struct sockaddr_storage *sockaddr);
+int medusa_httpserver_get_stats_unlocked (const struct medusa_httpserver *httpserver, struct medusa_tcpsocket_stats *stats);
 
 int medusa_httpserver_set_enabled_unlocked (struct medusa_httpserver *httpserver, int enabled);
 int medusa_httpserver_get_enabled_unlocked (const struct medusa_httpserver *httpserver);
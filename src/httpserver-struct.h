@@ -34,6 +34,7 @@ struct medusa_httpserver {
         unsigned short port;
         int backlog;
         struct medusa_tcpsocket *tcpsocket;
+        struct medusa_tcpsocket_stats tcpsocket_stats;
         struct medusa_httpserver_clients clients;
 };
 
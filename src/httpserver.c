@@ -47,10 +47,12 @@ static struct medusa_pool *g_pool_httpserver_client;
 enum {
         MEDUSA_HTTPSERVER_FLAG_NONE             = (1 << 0),
         MEDUSA_HTTPSERVER_FLAG_ENABLED          = (1 << 1),
-        MEDUSA_HTTPSERVER_FLAG_REUSEPORT        = (1 << 2)
+        MEDUSA_HTTPSERVER_FLAG_REUSEPORT        = (1 << 2),
+        MEDUSA_HTTPSERVER_FLAG_STATS            = (1 << 3)
 #define MEDUSA_HTTPSERVER_FLAG_NONE             MEDUSA_HTTPSERVER_FLAG_NONE
 #define MEDUSA_HTTPSERVER_FLAG_ENABLED          MEDUSA_HTTPSERVER_FLAG_ENABLED
 #define MEDUSA_HTTPSERVER_FLAG_REUSEPORT        MEDUSA_HTTPSERVER_FLAG_REUSEPORT
+#define MEDUSA_HTTPSERVER_FLAG_STATS            MEDUSA_HTTPSERVER_FLAG_STATS
 };
 
 static inline void httpserver_set_flag (struct medusa_httpserver *httpserver, unsigned int flag)
@@ -204,6 +206,9 @@ static int httpserver_init_with_options_unlocked (struct medusa_httpserver *http
         if (options->reuseport) {
                 httpserver_add_flag(httpserver, MEDUSA_HTTPSERVER_FLAG_REUSEPORT);
         }
+        if (options->stats) {
+                httpserver_add_flag(httpserver, MEDUSA_HTTPSERVER_FLAG_STATS);
+        }
         httpserver->onevent = options->onevent;
         httpserver->context = options->context;
         rc = medusa_monitor_add_unlocked(options->monitor, &httpserver->subject);
@@ -480,6 +485,46 @@ __attribute__ ((visibility ("default"))) int medusa_httpserver_get_sockname (con
         return rc;
 }
 
+__attribute__ ((visibility ("default"))) int medusa_httpserver_get_stats_unlocked (const struct medusa_httpserver *httpserver, struct medusa_tcpsocket_stats *stats)
+{
+        int rc;
+        struct medusa_tcpsocket_stats client;
+        struct medusa_httpserver_client *httpserver_client;
+        if (MEDUSA_IS_ERR_OR_NULL(httpserver)) {
+                return -EINVAL;
+        }
+        if (stats == NULL) {
+                return -EINVAL;
+        }
+        /* closed clients are folded in when their socket goes away */
+        *stats = httpserver->tcpsocket_stats;
+        stats->rtt    = -1;
+        stats->rttvar = -1;
+        TAILQ_FOREACH(httpserver_client, &httpserver->clients, list) {
+                if (MEDUSA_IS_ERR_OR_NULL(httpserver_client->tcpsocket)) {
+                        continue;
+                }
+                rc = medusa_tcpsocket_get_stats_unlocked(httpserver_client->tcpsocket, &client);
+                if (rc < 0) {
+                        return rc;
+                }
+                medusa_tcpsocket_stats_merge(stats, &client);
+        }
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_httpserver_get_stats (const struct medusa_httpserver *httpserver, struct medusa_tcpsocket_stats *stats)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(httpserver)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(httpserver->subject.monitor);
+        rc = medusa_httpserver_get_stats_unlocked(httpserver, stats);
+        medusa_monitor_unlock(httpserver->subject.monitor);
+        return rc;
+}
+
 __attribute__ ((visibility ("default"))) int medusa_httpserver_set_enabled_unlocked (struct medusa_httpserver *httpserver, int enabled)
 {
         int rc;
@@ -588,6 +633,7 @@ __attribute__ ((visibility ("default"))) int medusa_httpserver_set_started_unloc
                 medusa_tcpsocket_bind_options.nonblocking = 1;
                 medusa_tcpsocket_bind_options.reuseaddr   = 1;
                 medusa_tcpsocket_bind_options.reuseport   = httpserver_has_flag(httpserver, MEDUSA_HTTPSERVER_FLAG_REUSEPORT);
+                medusa_tcpsocket_bind_options.stats       = httpserver_has_flag(httpserver, MEDUSA_HTTPSERVER_FLAG_STATS);
                 medusa_tcpsocket_bind_options.enabled     = 1;
                 medusa_tcpsocket_bind_options.monitor     = httpserver->subject.monitor;
                 medusa_tcpsocket_bind_options.context     = httpserver;
@@ -1133,6 +1179,21 @@ static inline int httpserver_client_has_flag (const struct medusa_httpserver_cli
         return !!(httpserver_client->flags & flag);
 }
 
+static void httpserver_client_destroy_tcpsocket (struct medusa_httpserver_client *httpserver_client)
+{
+        struct medusa_tcpsocket_stats stats;
+        if (MEDUSA_IS_ERR_OR_NULL(httpserver_client->tcpsocket)) {
+                return;
+        }
+        /* keep the server totals once the client is gone */
+        if (httpserver_client->httpserver != NULL &&
+            medusa_tcpsocket_get_stats_unlocked(httpserver_client->tcpsocket, &stats) == 0) {
+                medusa_tcpsocket_stats_merge(&httpserver_client->httpserver->tcpsocket_stats, &stats);
+        }
+        medusa_tcpsocket_destroy_unlocked(httpserver_client->tcpsocket);
+        httpserver_client->tcpsocket = NULL;
+}
+
 static inline int httpserver_client_set_state (struct medusa_httpserver_client *httpserver_client, unsigned int state)
 {
         int rc;
@@ -1210,10 +1271,7 @@ static inline int httpserver_client_set_state (struct medusa_httpserver_client *
                 }
         }
         if (state == MEDUSA_HTTPSERVER_CLIENT_STATE_DISCONNECTED) {
-                if (!MEDUSA_IS_ERR_OR_NULL(httpserver_client->tcpsocket)) {
-                        medusa_tcpsocket_destroy_unlocked(httpserver_client->tcpsocket);
-                        httpserver_client->tcpsocket = NULL;
-                }
+                httpserver_client_destroy_tcpsocket(httpserver_client);
         }
         httpserver_client->state = state;
         return 0;
@@ -3167,10 +3225,7 @@ __attribute__ ((visibility ("default"))) int medusa_httpserver_client_onevent_un
                         medusa_httpserver_client_request_destroy(httpserver_client->request);
                         httpserver_client->request = NULL;
                 }
-                if (!MEDUSA_IS_ERR_OR_NULL(httpserver_client->tcpsocket)) {
-                        medusa_tcpsocket_destroy_unlocked(httpserver_client->tcpsocket);
-                        httpserver_client->tcpsocket = NULL;
-                }
+                httpserver_client_destroy_tcpsocket(httpserver_client);
                 if (httpserver_client->httpserver != NULL) {
                         TAILQ_REMOVE(&httpserver_client->httpserver->clients, httpserver_client, list);
                         httpserver_client->httpserver = NULL;
@@ -3246,8 +3301,42 @@ __attribute__ ((visibility ("default"))) const char * medusa_httpserver_client_s
         return "MEDUSA_HTTPSERVER_CLIENT_STATE_UNKNOWN";
 }
 
+static int httpserver_subject_onevent (struct medusa_subject *subject, unsigned int events, void *param)
+{
+        return medusa_httpserver_onevent_unlocked((struct medusa_httpserver *) subject, events, param);
+}
+
+static int httpserver_subject_destroy (struct medusa_subject *subject)
+{
+        return medusa_httpserver_onevent_unlocked((struct medusa_httpserver *) subject, MEDUSA_HTTPSERVER_EVENT_DESTROY, NULL);
+}
+
+static const struct medusa_subject_type g_subject_type_httpserver = {
+        .rank    = MEDUSA_SUBJECT_RANK_HTTPSERVER,
+        .onevent = httpserver_subject_onevent,
+        .destroy = httpserver_subject_destroy
+};
+
+static int httpserver_client_subject_onevent (struct medusa_subject *subject, unsigned int events, void *param)
+{
+        return medusa_httpserver_client_onevent_unlocked((struct medusa_httpserver_client *) subject, events, param);
+}
+
+static int httpserver_client_subject_destroy (struct medusa_subject *subject)
+{
+        return medusa_httpserver_client_onevent_unlocked((struct medusa_httpserver_client *) subject, MEDUSA_HTTPSERVER_CLIENT_EVENT_DESTROY, NULL);
+}
+
+static const struct medusa_subject_type g_subject_type_httpserver_client = {
+        .rank    = MEDUSA_SUBJECT_RANK_HTTPSERVER_CLIENT,
+        .onevent = httpserver_client_subject_onevent,
+        .destroy = httpserver_client_subject_destroy
+};
+
 __attribute__ ((constructor)) static void httpserver_constructor (void)
 {
+        medusa_monitor_register_subject_type(MEDUSA_SUBJECT_TYPE_HTTPSERVER, &g_subject_type_httpserver);
+        medusa_monitor_register_subject_type(MEDUSA_SUBJECT_TYPE_HTTPSERVER_CLIENT, &g_subject_type_httpserver_client);
 #if defined(MEDUSA_HTTPSERVER_USE_POOL) && (MEDUSA_HTTPSERVER_USE_POOL == 1)
         g_pool_httpserver = medusa_pool_create("medusa-httpserver", sizeof(struct medusa_httpserver), 0, 0, MEDUSA_POOL_FLAG_DEFAULT | MEDUSA_POOL_FLAG_THREAD_SAFE, NULL, NULL, NULL);
         g_pool_httpserver_client = medusa_pool_create("medusa-httpserver-client", sizeof(struct medusa_httpserver_client), 0, 0, MEDUSA_POOL_FLAG_DEFAULT | MEDUSA_POOL_FLAG_THREAD_SAFE, NULL, NULL, NULL);
@@ -5,6 +5,7 @@
 struct sockaddr_storage;
 
 struct medusa_monitor;
+struct medusa_tcpsocket_stats;
 struct medusa_httpserver;
 struct medusa_httpserver_client;
 struct medusa_httpserver_client_request;
@@ -114,6 +115,7 @@ struct medusa_httpserver_init_options {
         unsigned short port;
         int reuseport;
         int backlog;
+        int stats;
         int enabled;
         int started;
         int (*onevent) (struct medusa_httpserver *httpserver, unsigned int events, void *context, void *param);
@@ -175,6 +177,7 @@ int medusa_httpserver_get_error (const struct medusa_httpserver *httpserver);
 int medusa_httpserver_get_protocol (struct medusa_httpserver *httpserver);
 int medusa_httpserver_get_sockport (const struct medusa_httpserver *httpserver);
 int medusa_httpserver_get_sockname (const struct medusa_httpserver *httpserver, struct sockaddr_storage *sockaddr);
+int medusa_httpserver_get_stats (const struct medusa_httpserver *httpserver, struct medusa_tcpsocket_stats *stats);
 
 int medusa_httpserver_set_enabled (struct medusa_httpserver *httpserver, int enabled);
 int medusa_httpserver_get_enabled (const struct medusa_httpserver *httpserver);
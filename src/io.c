@@ -843,8 +843,25 @@ __attribute__ ((visibility ("default"))) const char * medusa_io_events_string (u
         return g_io_events_strings[events];
 }
 
+static int io_subject_onevent (struct medusa_subject *subject, unsigned int events, void *param)
+{
+        return medusa_io_onevent_unlocked((struct medusa_io *) subject, events, param);
+}
+
+static int io_subject_destroy (struct medusa_subject *subject)
+{
+        return medusa_io_onevent_unlocked((struct medusa_io *) subject, MEDUSA_IO_EVENT_DESTROY, NULL);
+}
+
+static const struct medusa_subject_type g_subject_type = {
+        .rank    = MEDUSA_SUBJECT_RANK_BASE,
+        .onevent = io_subject_onevent,
+        .destroy = io_subject_destroy
+};
+
 __attribute__ ((constructor)) static void io_constructor (void)
 {
+        medusa_monitor_register_subject_type(MEDUSA_SUBJECT_TYPE_IO, &g_subject_type);
 #if defined(MEDUSA_IO_USE_POOL) && (MEDUSA_IO_USE_POOL == 1)
         g_pool = medusa_pool_create("medusa-io", sizeof(struct medusa_io), 0, 0, MEDUSA_POOL_FLAG_DEFAULT | MEDUSA_POOL_FLAG_THREAD_SAFE, NULL, NULL, NULL);
 #endif
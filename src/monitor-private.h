@@ -3,7 +3,9 @@
 #define MEDUSA_MONITOR_PRIVATE_H
 
 struct medusa_subject;
+struct medusa_subject_type;
 struct medusa_monitor;
+struct medusa_resolver;
 
 int medusa_monitor_lock (struct medusa_monitor *monitor);
 int medusa_monitor_unlock (struct medusa_monitor *monitor);
@@ -16,7 +18,15 @@ int medusa_monitor_add_unlocked (struct medusa_monitor *monitor, struct medusa_s
 int medusa_monitor_mod_unlocked (struct medusa_subject *subject);
 int medusa_monitor_del_unlocked (struct medusa_subject *subject);
 
+int medusa_monitor_register_subject_type (unsigned int type, const struct medusa_subject_type *subject_type);
+
+struct medusa_resolver * medusa_monitor_get_resolver_unlocked (struct medusa_monitor *monitor);
+
 struct medusa_subject * medusa_monitor_get_first_subject_unlocked (struct medusa_monitor *monitor);
 struct medusa_subject * medusa_monitor_get_next_subject_unlocked (struct medusa_subject *subject);
 
+/* dispatches an event of a subject that is raised by a backend rather than
+ * by the loop itself, so it is counted and watched like the others */
+int medusa_monitor_onevent_unlocked (struct medusa_subject *subject, unsigned int events, void *param);
+
 #endif
@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <pthread.h>
@@ -16,8 +17,9 @@
 #endif
 
 #include "queue.h"
-#include "pqueue.h"
+#include "timerheap.h"
 #include "pipe.h"
+#include "watchdog.h"
 
 #define MEDUSA_DEBUG_NAME "monitor"
 #include "debug.h"
@@ -31,24 +33,7 @@
 #include "signal-private.h"
 #include "condition.h"
 #include "condition-private.h"
-#include "tcpsocket.h"
-#include "tcpsocket-private.h"
-#include "udpsocket.h"
-#include "udpsocket-private.h"
-#include "exec.h"
-#include "exec-private.h"
-#include "httprequest.h"
-#include "httprequest-private.h"
-#include "dnsrequest.h"
-#include "dnsrequest-private.h"
-#include "dnsresolver.h"
-#include "dnsresolver-private.h"
-#include "websocketclient.h"
-#include "websocketclient-private.h"
-#include "websocketserver.h"
-#include "websocketserver-private.h"
-#include "httpserver.h"
-#include "httpserver-private.h"
+#include "resolver.h"
 #include "monitor.h"
 #include "monitor-private.h"
 
@@ -66,6 +51,9 @@
 #include "poll-backend.h"
 
 #include "signal-sigaction.h"
+#if defined(MEDUSA_SIGNAL_SIGNALFD_ENABLE) && (MEDUSA_SIGNAL_SIGNALFD_ENABLE == 1)
+#include "signal-signalfd.h"
+#endif
 #include "signal-null.h"
 #include "signal-backend.h"
 
@@ -87,15 +75,22 @@ struct medusa_monitor {
         unsigned int flags;
         struct medusa_subjects actives;
         struct medusa_subjects changes;
-        struct medusa_subjects deletes;
+        struct medusa_subjects deletes[MEDUSA_SUBJECT_RANK_COUNT];
+        unsigned int deletes_pending;
         struct medusa_subjects rogues;
         struct medusa_subjects whole;
+        struct {
+                struct timespec now;
+                int valid;
+        } clock;
         struct {
                 struct medusa_poll_backend *backend;
         } poll;
         struct {
                 struct medusa_timer_backend *backend;
-                struct medusa_pqueue_head *pqueue;
+                struct medusa_timerheap *heap;
+                uint64_t slack;
+                uint64_t armed;
                 int fired;
                 int dirty;
                 int valid;
@@ -113,13 +108,40 @@ struct medusa_monitor {
                 int fired;
                 struct medusa_io *io;
         } wakeup;
+        struct medusa_resolver *resolver;
+        struct medusa_watchdog *watchdog;
         struct {
                 int (*callback) (struct medusa_monitor *monitor, unsigned int events, void *context, void *param);
                 void *context;
         } onevent;
+        struct {
+                unsigned long long wakeups;
+                unsigned long long timer_wakeups;
+                unsigned long long window_wakeups;
+                uint64_t window;
+                double wakeups_per_second;
+                unsigned long long stalls;
+#if defined(MEDUSA_MONITOR_STATS_ENABLE) && (MEDUSA_MONITOR_STATS_ENABLE == 1)
+                unsigned long long iterations;
+                unsigned long long wait_time;
+                unsigned long long busy_time;
+                unsigned long long changes;
+                unsigned long long deletes;
+                unsigned long long timers;
+                unsigned long long events[MEDUSA_MONITOR_STATS_SUBJECT_COUNT];
+                struct medusa_monitor_stats_histogram callback[MEDUSA_MONITOR_STATS_SUBJECT_COUNT];
+                struct medusa_monitor_stats_histogram lateness;
+                uint64_t dispatched;
+                unsigned int depth;
+                uint64_t interval;
+                uint64_t reported;
+#endif
+        } stats;
         pthread_mutex_t mutex;
 };
 
+static const struct medusa_subject_type *g_subject_types[MEDUSA_SUBJECT_TYPE_MASK + 1];
+
 static const struct medusa_monitor_init_options g_init_options = {
         .flags  = MEDUSA_MONITOR_FLAG_DEFAULT,
         .poll   = {
@@ -128,7 +150,8 @@ static const struct medusa_monitor_init_options g_init_options = {
         },
         .timer  = {
                 .type   = MEDUSA_MONITOR_TIMER_DEFAULT,
-                .u      = { }
+                .u      = { },
+                .slack  = 0.0
         },
         .signal = {
                 .type   = MEDUSA_MONITOR_SIGNAL_DEFAULT,
@@ -137,6 +160,13 @@ static const struct medusa_monitor_init_options g_init_options = {
         .onevent = {
                 .callback       = NULL,
                 .context        = NULL
+        },
+        .stats  = {
+                .interval       = 0.0
+        },
+        .watchdog = {
+                .threshold      = 0.0,
+                .backtrace      = 0
         }
 };
 
@@ -222,7 +252,9 @@ static int monitor_signal_io_onevent (struct medusa_io *io, unsigned int events,
         (void) io;
         (void) param;
         if (events & MEDUSA_IO_EVENT_IN) {
+                medusa_monitor_lock(monitor);
                 rc = monitor->signal.backend->run(monitor->signal.backend);
+                medusa_monitor_unlock(monitor);
                 if (rc < 0) {
                         return rc;
                 }
@@ -253,28 +285,126 @@ static int monitor_signal (struct medusa_monitor *monitor, unsigned int reason)
 bail:   return -1;
 }
 
-static int monitor_timer_subject_compare (void *a, void *b)
+#define MONITOR_TIMER_DISARMED  UINT64_MAX
+
+static inline uint64_t monitor_timespec_nsecs (const struct timespec *timespec)
+{
+        return ((uint64_t) timespec->tv_sec) * 1000000000ULL + (uint64_t) timespec->tv_nsec;
+}
+
+static inline uint64_t monitor_timer_deadline (const struct medusa_monitor *monitor, const struct medusa_timer *timer)
+{
+        uint64_t deadline;
+        unsigned int resolution;
+        deadline = monitor_timespec_nsecs(&timer->_timespec);
+        if (monitor->timer.slack == 0) {
+                return deadline;
+        }
+        /* coarse timers are rounded up to the end of their slack window, so
+         * every timer falling into the same window expires in one wakeup */
+        resolution = medusa_timer_get_resolution_unlocked(timer);
+        if (resolution == MEDUSA_TIMER_RESOLUTION_MILLISECONDS ||
+            resolution == MEDUSA_TIMER_RESOLUTION_SECONDS) {
+                deadline += monitor->timer.slack - 1;
+                deadline -= deadline % monitor->timer.slack;
+        }
+        return deadline;
+}
+
+#if defined(MEDUSA_MONITOR_STATS_ENABLE) && (MEDUSA_MONITOR_STATS_ENABLE == 1)
+static inline uint64_t monitor_stats_clock (void)
+{
+        struct timespec timespec;
+        if (medusa_clock_monotonic(&timespec) != 0) {
+                return 0;
+        }
+        return monitor_timespec_nsecs(&timespec);
+}
+
+static inline unsigned int monitor_stats_histogram_index (uint64_t value)
+{
+        unsigned int msb;
+        unsigned int index;
+        if (value < 4) {
+                return value;
+        }
+        msb   = 63 - __builtin_clzll(value);
+        index = (msb - 1) * 4 + ((value >> (msb - 2)) & 3);
+        return (index < MEDUSA_MONITOR_STATS_HISTOGRAM_BUCKETS) ? index : MEDUSA_MONITOR_STATS_HISTOGRAM_BUCKETS - 1;
+}
+
+static inline void monitor_stats_histogram_add (struct medusa_monitor_stats_histogram *histogram, uint64_t value)
+{
+        histogram->count += 1;
+        histogram->sum   += value;
+        if (value > histogram->max) {
+                histogram->max = value;
+        }
+        histogram->buckets[monitor_stats_histogram_index(value)] += 1;
+}
+
+static inline void monitor_stats_onevent (struct medusa_monitor *monitor, struct medusa_subject *subject, uint64_t started)
 {
-        struct medusa_timer *ta = a;
-        struct medusa_timer *tb = b;
-        return medusa_timespec_compare(&ta->_timespec, &tb->_timespec, >);
+        uint64_t elapsed;
+        unsigned int index;
+        switch (medusa_subject_get_type(subject)) {
+                case MEDUSA_SUBJECT_TYPE_IO:            index = MEDUSA_MONITOR_STATS_SUBJECT_IO;        break;
+                case MEDUSA_SUBJECT_TYPE_TIMER:         index = MEDUSA_MONITOR_STATS_SUBJECT_TIMER;     break;
+                case MEDUSA_SUBJECT_TYPE_CONDITION:     index = MEDUSA_MONITOR_STATS_SUBJECT_CONDITION; break;
+                case MEDUSA_SUBJECT_TYPE_SIGNAL:        index = MEDUSA_MONITOR_STATS_SUBJECT_SIGNAL;    break;
+                default:                                index = MEDUSA_MONITOR_STATS_SUBJECT_OTHER;     break;
+        }
+        elapsed = monitor_stats_clock() - started;
+        monitor->stats.events[index] += 1;
+        /* signals are dispatched from within the signal io, only the
+         * outermost dispatch is taken out of the wait time */
+        if (--monitor->stats.depth == 0) {
+                monitor->stats.dispatched += elapsed;
+        }
+        monitor_stats_histogram_add(&monitor->stats.callback[index], elapsed);
 }
+#endif
 
-static void monitor_timer_subject_set_position (void *entry, unsigned int position)
+static void * monitor_subject_callback (struct medusa_subject *subject)
 {
-        struct medusa_timer *timer = entry;
-        timer->_position = position;
+        switch (medusa_subject_get_type(subject)) {
+                case MEDUSA_SUBJECT_TYPE_IO:            return (void *) ((struct medusa_io *) subject)->onevent;
+                case MEDUSA_SUBJECT_TYPE_TIMER:         return (void *) ((struct medusa_timer *) subject)->onevent;
+                case MEDUSA_SUBJECT_TYPE_CONDITION:     return (void *) ((struct medusa_condition *) subject)->onevent;
+                case MEDUSA_SUBJECT_TYPE_SIGNAL:        return (void *) ((struct medusa_signal *) subject)->onevent;
+        }
+        return NULL;
 }
 
-static unsigned int monitor_timer_subject_get_position (void *entry)
+/* stalls are reported from the loop thread once the callback returned, the
+ * watchdog thread only logs while it is still running */
+static void monitor_watchdog_leave (struct medusa_monitor *monitor)
 {
-        struct medusa_timer *timer = entry;
-        return timer->_position;
+        struct medusa_watchdog_stall stall;
+        struct medusa_monitor_event_error medusa_monitor_event_error;
+        if (medusa_watchdog_leave(monitor->watchdog, &stall) <= 0) {
+                return;
+        }
+        monitor->stats.stalls += 1;
+        if (monitor->onevent.callback == NULL) {
+                return;
+        }
+        medusa_monitor_event_error.type = MEDUSA_MONITOR_ERROR_TYPE_SUBJECT_STALL;
+        medusa_monitor_event_error.u.subject_stall.subject_type    = stall.subject_type;
+        medusa_monitor_event_error.u.subject_stall.callback        = stall.callback;
+        medusa_monitor_event_error.u.subject_stall.duration        = stall.duration;
+        medusa_monitor_event_error.u.subject_stall.backtrace       = stall.backtrace;
+        medusa_monitor_event_error.u.subject_stall.backtrace_count = stall.backtrace_count;
+        monitor->onevent.callback(monitor, MEDUSA_MONITOR_EVENT_ERROR, monitor->onevent.context, &medusa_monitor_event_error);
 }
 
 static int monitor_subject_onevent (struct medusa_monitor *monitor, struct medusa_subject *subject, unsigned int events, void *param)
 {
         int rc;
+        const struct medusa_subject_type *type;
+#if defined(MEDUSA_MONITOR_STATS_ENABLE) && (MEDUSA_MONITOR_STATS_ENABLE == 1)
+        uint64_t started;
+#endif
         if (MEDUSA_IS_ERR_OR_NULL(monitor)) {
                 medusa_errorf("monitor: %p is invalid", monitor);
                 rc = -EINVAL;
@@ -285,61 +415,24 @@ static int monitor_subject_onevent (struct medusa_monitor *monitor, struct medus
                 rc = -EINVAL;
                 goto bail;
         }
-        switch (medusa_subject_get_type(subject)) {
-                case MEDUSA_SUBJECT_TYPE_IO:
-                        rc = medusa_io_onevent_unlocked((struct medusa_io *) subject, events, param);
-                        break;
-                case MEDUSA_SUBJECT_TYPE_TIMER:
-                        rc = medusa_timer_onevent_unlocked((struct medusa_timer *) subject, events, param);
-                        break;
-                case MEDUSA_SUBJECT_TYPE_SIGNAL:
-                        rc = medusa_signal_onevent_unlocked((struct medusa_signal *) subject, events, param);
-                        break;
-                case MEDUSA_SUBJECT_TYPE_CONDITION:
-                        rc = medusa_condition_onevent_unlocked((struct medusa_condition *) subject, events, param);
-                        break;
-                case MEDUSA_SUBJECT_TYPE_TCPSOCKET:
-                        rc = medusa_tcpsocket_onevent_unlocked((struct medusa_tcpsocket *) subject, events, param);
-                        break;
-                case MEDUSA_SUBJECT_TYPE_UDPSOCKET:
-                        rc = medusa_udpsocket_onevent_unlocked((struct medusa_udpsocket *) subject, events, param);
-                        break;
-                case MEDUSA_SUBJECT_TYPE_EXEC:
-#if defined(MEDUSA_EXEC_ENABLE) && (MEDUSA_EXEC_ENABLE == 1)
-                        rc = medusa_exec_onevent_unlocked((struct medusa_exec *) subject, events, param);
-#else
-                        rc = -ENOTSUP;
+        type = g_subject_types[medusa_subject_get_type(subject)];
+        if (monitor->watchdog != NULL) {
+                medusa_watchdog_enter(monitor->watchdog, medusa_subject_get_type(subject), monitor_subject_callback(subject));
+        }
+#if defined(MEDUSA_MONITOR_STATS_ENABLE) && (MEDUSA_MONITOR_STATS_ENABLE == 1)
+        monitor->stats.depth += 1;
+        started = monitor_stats_clock();
 #endif
-                        break;
-                case MEDUSA_SUBJECT_TYPE_HTTPREQUEST:
-                        rc = medusa_httprequest_onevent_unlocked((struct medusa_httprequest *) subject, events, param);
-                        break;
-                case MEDUSA_SUBJECT_TYPE_DNSREQUEST:
-                        rc = medusa_dnsrequest_onevent_unlocked((struct medusa_dnsrequest *) subject, events, param);
-                        break;
-                case MEDUSA_SUBJECT_TYPE_DNSRESOLVER:
-                        rc = medusa_dnsresolver_onevent_unlocked((struct medusa_dnsresolver *) subject, events, param);
-                        break;
-                case MEDUSA_SUBJECT_TYPE_DNSRESOLVER_LOOKUP:
-                        rc = medusa_dnsresolver_lookup_onevent_unlocked((struct medusa_dnsresolver_lookup *) subject, events, param);
-                        break;
-                case MEDUSA_SUBJECT_TYPE_WEBSOCKETCLIENT:
-                        rc = medusa_websocketclient_onevent_unlocked((struct medusa_websocketclient *) subject, events, param);
-                        break;
-                case MEDUSA_SUBJECT_TYPE_WEBSOCKETSERVER:
-                        rc = medusa_websocketserver_onevent_unlocked((struct medusa_websocketserver *) subject, events, param);
-                        break;
-                case MEDUSA_SUBJECT_TYPE_WEBSOCKETSERVER_CLIENT:
-                        rc = medusa_websocketserver_client_onevent_unlocked((struct medusa_websocketserver_client *) subject, events, param);
-                        break;
-                case MEDUSA_SUBJECT_TYPE_HTTPSERVER:
-                        rc = medusa_httpserver_onevent_unlocked((struct medusa_httpserver *) subject, events, param);
-                        break;
-                case MEDUSA_SUBJECT_TYPE_HTTPSERVER_CLIENT:
-                        rc = medusa_httpserver_client_onevent_unlocked((struct medusa_httpserver_client *) subject, events, param);
-                        break;
-                default:
-                        rc = -ENOENT;
+        if (type != NULL) {
+                rc = type->onevent(subject, events, param);
+        } else {
+                rc = -ENOENT;
+        }
+#if defined(MEDUSA_MONITOR_STATS_ENABLE) && (MEDUSA_MONITOR_STATS_ENABLE == 1)
+        monitor_stats_onevent(monitor, subject, started);
+#endif
+        if (monitor->watchdog != NULL) {
+                monitor_watchdog_leave(monitor);
         }
         if (rc < 0) {
                 struct medusa_monitor_event_error medusa_monitor_event_error;
@@ -368,204 +461,96 @@ static int monitor_poll_io_onevent (struct medusa_poll_backend *backend, struct
         return rc;
 }
 
-static int monitor_process_deletes (struct medusa_monitor *monitor)
+static inline unsigned int monitor_subject_get_rank (struct medusa_subject *subject)
 {
-        int rc;
+        const struct medusa_subject_type *type;
+        type = g_subject_types[medusa_subject_get_type(subject)];
+        return (type != NULL) ? type->rank : MEDUSA_SUBJECT_RANK_BASE;
+}
+
+static struct medusa_subject * monitor_pop_delete (struct medusa_monitor *monitor)
+{
+        unsigned int rank;
         struct medusa_subject *subject;
-        struct medusa_subject *nsubject;
-        TAILQ_FOREACH_SAFE(subject, &monitor->deletes, hook, nsubject) {
-                if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_HTTPSERVER_CLIENT) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        rc = monitor_subject_onevent(monitor, subject, MEDUSA_HTTPSERVER_CLIENT_EVENT_DESTROY, NULL);
-                        if (rc < 0) {
-                                goto bail;
-                        }
-                }
-        }
-        TAILQ_FOREACH_SAFE(subject, &monitor->deletes, hook, nsubject) {
-                if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_HTTPSERVER) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        rc = monitor_subject_onevent(monitor, subject, MEDUSA_HTTPSERVER_EVENT_DESTROY, NULL);
-                        if (rc < 0) {
-                                goto bail;
-                        }
-                }
-        }
-        TAILQ_FOREACH_SAFE(subject, &monitor->deletes, hook, nsubject) {
-                if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_WEBSOCKETCLIENT) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        rc = monitor_subject_onevent(monitor, subject, MEDUSA_WEBSOCKETCLIENT_EVENT_DESTROY, NULL);
-                        if (rc < 0) {
-                                goto bail;
-                        }
-                }
+        if (monitor->deletes_pending == 0) {
+                return NULL;
         }
-        TAILQ_FOREACH_SAFE(subject, &monitor->deletes, hook, nsubject) {
-                if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_WEBSOCKETSERVER_CLIENT) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        rc = monitor_subject_onevent(monitor, subject, MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_DESTROY, NULL);
-                        if (rc < 0) {
-                                goto bail;
-                        }
-                }
-        }
-        TAILQ_FOREACH_SAFE(subject, &monitor->deletes, hook, nsubject) {
-                if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_WEBSOCKETSERVER) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        rc = monitor_subject_onevent(monitor, subject, MEDUSA_WEBSOCKETSERVER_EVENT_DESTROY, NULL);
-                        if (rc < 0) {
-                                goto bail;
-                        }
-                }
-        }
-        TAILQ_FOREACH_SAFE(subject, &monitor->deletes, hook, nsubject) {
-                if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_DNSRESOLVER_LOOKUP) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        rc = monitor_subject_onevent(monitor, subject, MEDUSA_DNSRESOLVER_LOOKUP_EVENT_DESTROY, NULL);
-                        if (rc < 0) {
-                                goto bail;
-                        }
-                }
+        rank = __builtin_ctz(monitor->deletes_pending);
+        subject = TAILQ_FIRST(&monitor->deletes[rank]);
+        TAILQ_REMOVE(&monitor->deletes[rank], subject, hook);
+        if (TAILQ_EMPTY(&monitor->deletes[rank])) {
+                monitor->deletes_pending &= ~(1U << rank);
         }
-        TAILQ_FOREACH_SAFE(subject, &monitor->deletes, hook, nsubject) {
-                if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_DNSRESOLVER) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        rc = monitor_subject_onevent(monitor, subject, MEDUSA_DNSRESOLVER_EVENT_DESTROY, NULL);
-                        if (rc < 0) {
-                                goto bail;
-                        }
-                }
-        }
-        TAILQ_FOREACH_SAFE(subject, &monitor->deletes, hook, nsubject) {
-                if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_DNSREQUEST) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        rc = monitor_subject_onevent(monitor, subject, MEDUSA_DNSREQUEST_EVENT_DESTROY, NULL);
-                        if (rc < 0) {
-                                goto bail;
-                        }
-                }
+        TAILQ_REMOVE(&monitor->whole, subject, list);
+        return subject;
+}
+
+static int monitor_subject_detach (struct medusa_monitor *monitor, struct medusa_subject *subject)
+{
+        int rc;
+        if (!(subject->flags & MEDUSA_SUBJECT_FLAG_HEAP)) {
+                return 0;
         }
-        TAILQ_FOREACH_SAFE(subject, &monitor->deletes, hook, nsubject) {
-                if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_HTTPREQUEST) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        rc = monitor_subject_onevent(monitor, subject, MEDUSA_HTTPREQUEST_EVENT_DESTROY, NULL);
-                        if (rc < 0) {
-                                goto bail;
-                        }
-                }
+        rc = 0;
+        switch (medusa_subject_get_type(subject)) {
+                case MEDUSA_SUBJECT_TYPE_IO:
+                        rc = monitor->poll.backend->del(monitor->poll.backend, (struct medusa_io *) subject);
+                        break;
+                case MEDUSA_SUBJECT_TYPE_TIMER:
+                        rc = medusa_timerheap_del(monitor->timer.heap, (struct medusa_timer *) subject);
+                        monitor->timer.dirty = 1;
+                        break;
+                case MEDUSA_SUBJECT_TYPE_SIGNAL:
+                        rc = monitor->signal.backend->del(monitor->signal.backend, (struct medusa_signal *) subject);
+                        break;
+                case MEDUSA_SUBJECT_TYPE_CONDITION:
+                        TAILQ_REMOVE(&monitor->condition.signalled, (struct medusa_condition *) subject, _signalled);
+                        break;
         }
-        TAILQ_FOREACH_SAFE(subject, &monitor->deletes, hook, nsubject) {
-                if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_EXEC) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        rc = monitor_subject_onevent(monitor, subject, MEDUSA_EXEC_EVENT_DESTROY, NULL);
-                        if (rc < 0) {
-                                goto bail;
-                        }
-                }
+        subject->flags &= ~MEDUSA_SUBJECT_FLAG_HEAP;
+        return rc;
+}
+
+static int monitor_subject_destroy (struct medusa_monitor *monitor, struct medusa_subject *subject)
+{
+        int rc;
+        const struct medusa_subject_type *type;
+        type = g_subject_types[medusa_subject_get_type(subject)];
+        if (type == NULL) {
+                return -ENOENT;
         }
-        TAILQ_FOREACH_SAFE(subject, &monitor->deletes, hook, nsubject) {
-                if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_TCPSOCKET) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        rc = monitor_subject_onevent(monitor, subject, MEDUSA_TCPSOCKET_EVENT_DESTROY, NULL);
-                        if (rc < 0) {
-                                goto bail;
-                        }
+        rc = type->destroy(subject);
+        if (rc < 0) {
+                struct medusa_monitor_event_error medusa_monitor_event_error;
+                if (monitor->onevent.callback == NULL) {
+                        return rc;
                 }
-        }
-        TAILQ_FOREACH_SAFE(subject, &monitor->deletes, hook, nsubject) {
-                if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_UDPSOCKET) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        rc = monitor_subject_onevent(monitor, subject, MEDUSA_UDPSOCKET_EVENT_DESTROY, NULL);
-                        if (rc < 0) {
-                                goto bail;
-                        }
+                medusa_monitor_event_error.type = MEDUSA_MONITOR_ERROR_TYPE_SUBJECT_ONEVENT;
+                medusa_monitor_event_error.u.subject_onevent.subject_type = medusa_subject_get_type(subject);
+                rc = monitor->onevent.callback(monitor, MEDUSA_MONITOR_EVENT_ERROR, monitor->onevent.context, &medusa_monitor_event_error);
+                if (rc < 0) {
+                        return rc;
                 }
         }
-        TAILQ_FOREACH_SAFE(subject, &monitor->deletes, hook, nsubject) {
-                if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_IO) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        if (subject->flags & MEDUSA_SUBJECT_FLAG_HEAP) {
-                                rc = monitor->poll.backend->del(monitor->poll.backend, (struct medusa_io *) subject);
-                                if (rc != 0) {
-                                        goto bail;
-                                }
-                                subject->flags &= ~MEDUSA_SUBJECT_FLAG_HEAP;
-                        }
-                        rc = monitor_subject_onevent(monitor, subject, MEDUSA_IO_EVENT_DESTROY, NULL);
-                        if (rc < 0) {
-                                goto bail;
-                        }
-                } else if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_TIMER) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        if (subject->flags & MEDUSA_SUBJECT_FLAG_HEAP) {
-                                rc = medusa_pqueue_del(monitor->timer.pqueue, (struct medusa_timer *) subject);
-                                if (rc != 0) {
-                                        goto bail;
-                                }
-                                subject->flags &= ~MEDUSA_SUBJECT_FLAG_HEAP;
-                                monitor->timer.dirty = 1;
-                        }
-                        rc = monitor_subject_onevent(monitor, subject, MEDUSA_TIMER_EVENT_DESTROY, NULL);
-                        if (rc < 0) {
-                                goto bail;
-                        }
-                } else if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_SIGNAL) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        if (subject->flags & MEDUSA_SUBJECT_FLAG_HEAP) {
-                                rc = monitor->signal.backend->del(monitor->signal.backend, (struct medusa_signal *) subject);
-                                if (rc != 0) {
-                                        goto bail;
-                                }
-                                subject->flags &= ~MEDUSA_SUBJECT_FLAG_HEAP;
-                        }
-                        rc = monitor_subject_onevent(monitor, subject, MEDUSA_SIGNAL_EVENT_DESTROY, NULL);
-                        if (rc < 0) {
-                                goto bail;
-                        }
-                } else if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_CONDITION) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        if (subject->flags & MEDUSA_SUBJECT_FLAG_HEAP) {
-                                TAILQ_REMOVE(&monitor->condition.signalled, (struct medusa_condition *) subject, _signalled);
-                                subject->flags &= ~MEDUSA_SUBJECT_FLAG_HEAP;
-                        }
-                        rc = monitor_subject_onevent(monitor, subject, MEDUSA_CONDITION_EVENT_DESTROY, NULL);
-                        if (rc < 0) {
-                                goto bail;
-                        }
-                } else if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_DNSRESOLVER_LOOKUP) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        rc = monitor_subject_onevent(monitor, subject, MEDUSA_DNSRESOLVER_LOOKUP_EVENT_DESTROY, NULL);
-                        if (rc < 0) {
-                                goto bail;
-                        }
-                } else if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_DNSREQUEST) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        rc = monitor_subject_onevent(monitor, subject, MEDUSA_DNSREQUEST_EVENT_DESTROY, NULL);
-                        if (rc < 0) {
-                                goto bail;
-                        }
+        return 0;
+}
+
+/* deletes are bucketed by rank when they are queued, and the lowest
+ * pending rank is always served first; so subjects deleted while another
+ * one is being destroyed are handled in the same pass. */
+static int monitor_process_deletes (struct medusa_monitor *monitor)
+{
+        int rc;
+        struct medusa_subject *subject;
+        while ((subject = monitor_pop_delete(monitor)) != NULL) {
+#if defined(MEDUSA_MONITOR_STATS_ENABLE) && (MEDUSA_MONITOR_STATS_ENABLE == 1)
+                monitor->stats.deletes += 1;
+#endif
+                rc = monitor_subject_detach(monitor, subject);
+                if (rc != 0) {
+                        goto bail;
                 }
-        }
-        if (!TAILQ_EMPTY(&monitor->deletes)) {
-                rc = monitor_signal(monitor, WAKEUP_REASON_SUBJECT_DEL);
+                rc = monitor_subject_destroy(monitor, subject);
                 if (rc < 0) {
                         goto bail;
                 }
@@ -574,17 +559,38 @@ static int monitor_process_deletes (struct medusa_monitor *monitor)
 bail:   return -EIO;
 }
 
+static int monitor_get_clock (struct medusa_monitor *monitor, struct timespec *now)
+{
+        int rc;
+        if (monitor->clock.valid == 0) {
+                rc = medusa_clock_monotonic(&monitor->clock.now);
+                if (rc < 0) {
+                        return rc;
+                }
+                monitor->clock.valid = 1;
+        }
+        *now = monitor->clock.now;
+        return 0;
+}
+
+static inline void monitor_subject_set_rogue (struct medusa_monitor *monitor, struct medusa_subject *subject)
+{
+        if (!(subject->flags & MEDUSA_SUBJECT_FLAG_ROGUE)) {
+                TAILQ_REMOVE(&monitor->actives, subject, hook);
+                TAILQ_INSERT_TAIL(&monitor->rogues, subject, hook);
+                subject->flags |= MEDUSA_SUBJECT_FLAG_ROGUE;
+        }
+}
+
 static int monitor_process_changes (struct medusa_monitor *monitor)
 {
         int rc;
         struct timespec now;
         struct medusa_subject *subject;
-        struct medusa_subject *nsubject;
-        rc = medusa_clock_monotonic(&now);
-        if (rc < 0) {
-                goto bail;
-        }
-        TAILQ_FOREACH_SAFE(subject, &monitor->changes, hook, nsubject) {
+        while ((subject = TAILQ_FIRST(&monitor->changes)) != NULL) {
+#if defined(MEDUSA_MONITOR_STATS_ENABLE) && (MEDUSA_MONITOR_STATS_ENABLE == 1)
+                monitor->stats.changes += 1;
+#endif
                 if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_IO) {
                         struct medusa_io *io;
                         io = (struct medusa_io *) subject;
@@ -595,16 +601,17 @@ static int monitor_process_changes (struct medusa_monitor *monitor)
                                                 goto bail;
                                         }
                                 }
-                                TAILQ_REMOVE(&monitor->changes, subject, hook);
-                                TAILQ_INSERT_TAIL(&monitor->rogues, subject, hook);
-                                subject->flags &= ~MEDUSA_SUBJECT_FLAG_MOD;
+                                monitor_subject_set_rogue(monitor, subject);
                                 subject->flags &= ~MEDUSA_SUBJECT_FLAG_HEAP;
-                                subject->flags |= MEDUSA_SUBJECT_FLAG_ROGUE;
                         } else {
+                                unsigned int events;
+                                events = medusa_io_get_events_unlocked(io);
                                 if (subject->flags & MEDUSA_SUBJECT_FLAG_HEAP) {
-                                        rc = monitor->poll.backend->mod(monitor->poll.backend, io);
-                                        if (rc != 0) {
-                                                goto bail;
+                                        if (io->_events != events) {
+                                                rc = monitor->poll.backend->mod(monitor->poll.backend, io);
+                                                if (rc != 0) {
+                                                        goto bail;
+                                                }
                                         }
                                 } else {
                                         rc = monitor->poll.backend->add(monitor->poll.backend, io);
@@ -612,10 +619,7 @@ static int monitor_process_changes (struct medusa_monitor *monitor)
                                                 goto bail;
                                         }
                                 }
-                                TAILQ_REMOVE(&monitor->changes, subject, hook);
-                                TAILQ_INSERT_TAIL(&monitor->actives, subject, hook);
-                                subject->flags &= ~MEDUSA_SUBJECT_FLAG_MOD;
-                                subject->flags &= ~MEDUSA_SUBJECT_FLAG_ROGUE;
+                                io->_events = events;
                                 subject->flags |= MEDUSA_SUBJECT_FLAG_HEAP;
                         }
                 } else if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_TIMER) {
@@ -623,40 +627,35 @@ static int monitor_process_changes (struct medusa_monitor *monitor)
                         timer = (struct medusa_timer *) subject;
                         if (!medusa_timer_is_valid_unlocked(timer)) {
                                 if (subject->flags & MEDUSA_SUBJECT_FLAG_HEAP) {
-                                        rc = medusa_pqueue_del(monitor->timer.pqueue, timer);
+                                        rc = medusa_timerheap_del(monitor->timer.heap, timer);
                                         if (rc != 0) {
                                                 goto bail;
                                         }
                                         monitor->timer.dirty = 1;
                                 }
                                 medusa_timespec_clear(&timer->_timespec);
-                                TAILQ_REMOVE(&monitor->changes, subject, hook);
-                                TAILQ_INSERT_TAIL(&monitor->rogues, subject, hook);
-                                subject->flags &= ~MEDUSA_SUBJECT_FLAG_MOD;
+                                monitor_subject_set_rogue(monitor, subject);
                                 subject->flags &= ~MEDUSA_SUBJECT_FLAG_HEAP;
-                                subject->flags |= MEDUSA_SUBJECT_FLAG_ROGUE;
                         } else {
-                                struct timespec _timespec;
-                                _timespec = timer->_timespec;
+                                rc = monitor_get_clock(monitor, &now);
+                                if (rc < 0) {
+                                        goto bail;
+                                }
                                 rc = medusa_timer_update_timespec_unlocked(timer, &now);
                                 if (rc < 0) {
                                         goto bail;
                                 }
                                 if (subject->flags & MEDUSA_SUBJECT_FLAG_HEAP) {
-                                        rc = medusa_pqueue_mod(monitor->timer.pqueue, timer, medusa_timespec_compare(&_timespec, &timer->_timespec, >));
+                                        rc = medusa_timerheap_mod(monitor->timer.heap, timer, monitor_timer_deadline(monitor, timer));
                                         if (rc != 0) {
                                                 goto bail;
                                         }
                                 } else {
-                                        rc = medusa_pqueue_add(monitor->timer.pqueue, subject);
+                                        rc = medusa_timerheap_add(monitor->timer.heap, timer, monitor_timer_deadline(monitor, timer));
                                         if (rc != 0) {
                                                 goto bail;
                                         }
                                 }
-                                TAILQ_REMOVE(&monitor->changes, subject, hook);
-                                TAILQ_INSERT_TAIL(&monitor->actives, subject, hook);
-                                subject->flags &= ~MEDUSA_SUBJECT_FLAG_MOD;
-                                subject->flags &= ~MEDUSA_SUBJECT_FLAG_ROGUE;
                                 subject->flags |= MEDUSA_SUBJECT_FLAG_HEAP;
                                 monitor->timer.dirty = 1;
                         }
@@ -670,11 +669,8 @@ static int monitor_process_changes (struct medusa_monitor *monitor)
                                                 goto bail;
                                         }
                                 }
-                                TAILQ_REMOVE(&monitor->changes, subject, hook);
-                                TAILQ_INSERT_TAIL(&monitor->rogues, subject, hook);
-                                subject->flags &= ~MEDUSA_SUBJECT_FLAG_MOD;
+                                monitor_subject_set_rogue(monitor, subject);
                                 subject->flags &= ~MEDUSA_SUBJECT_FLAG_HEAP;
-                                subject->flags |= MEDUSA_SUBJECT_FLAG_ROGUE;
                         } else {
                                 if (!(subject->flags & MEDUSA_SUBJECT_FLAG_HEAP)) {
                                         rc = monitor->signal.backend->add(monitor->signal.backend, signal);
@@ -682,10 +678,6 @@ static int monitor_process_changes (struct medusa_monitor *monitor)
                                                 goto bail;
                                         }
                                 }
-                                TAILQ_REMOVE(&monitor->changes, subject, hook);
-                                TAILQ_INSERT_TAIL(&monitor->actives, subject, hook);
-                                subject->flags &= ~MEDUSA_SUBJECT_FLAG_MOD;
-                                subject->flags &= ~MEDUSA_SUBJECT_FLAG_ROGUE;
                                 subject->flags |= MEDUSA_SUBJECT_FLAG_HEAP;
                         }
                 } else if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_CONDITION) {
@@ -695,86 +687,21 @@ static int monitor_process_changes (struct medusa_monitor *monitor)
                                 if (subject->flags & MEDUSA_SUBJECT_FLAG_HEAP) {
                                         TAILQ_REMOVE(&monitor->condition.signalled, condition, _signalled);
                                 }
-                                TAILQ_REMOVE(&monitor->changes, subject, hook);
-                                TAILQ_INSERT_TAIL(&monitor->rogues, subject, hook);
-                                subject->flags &= ~MEDUSA_SUBJECT_FLAG_MOD;
+                                monitor_subject_set_rogue(monitor, subject);
                                 subject->flags &= ~MEDUSA_SUBJECT_FLAG_HEAP;
-                                subject->flags |= MEDUSA_SUBJECT_FLAG_ROGUE;
                         } else {
                                 if (subject->flags & MEDUSA_SUBJECT_FLAG_HEAP) {
                                         TAILQ_REMOVE(&monitor->condition.signalled, condition, _signalled);
                                         subject->flags &= ~MEDUSA_SUBJECT_FLAG_HEAP;
                                 }
-                                TAILQ_REMOVE(&monitor->changes, subject, hook);
-                                TAILQ_INSERT_TAIL(&monitor->actives, subject, hook);
-                                subject->flags &= ~MEDUSA_SUBJECT_FLAG_MOD;
-                                subject->flags &= ~MEDUSA_SUBJECT_FLAG_ROGUE;
                                 if (medusa_condition_get_signalled_unlocked(condition) > 0) {
                                         TAILQ_INSERT_TAIL(&monitor->condition.signalled, condition, _signalled);
                                         subject->flags |= MEDUSA_SUBJECT_FLAG_HEAP;
                                 }
                         }
-                } else if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_TCPSOCKET) {
-                        TAILQ_REMOVE(&monitor->changes, subject, hook);
-                        TAILQ_INSERT_TAIL(&monitor->actives, subject, hook);
-                        subject->flags &= ~MEDUSA_SUBJECT_FLAG_MOD;
-                        subject->flags &= ~MEDUSA_SUBJECT_FLAG_ROGUE;
-                } else if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_UDPSOCKET) {
-                        TAILQ_REMOVE(&monitor->changes, subject, hook);
-                        TAILQ_INSERT_TAIL(&monitor->actives, subject, hook);
-                        subject->flags &= ~MEDUSA_SUBJECT_FLAG_MOD;
-                        subject->flags &= ~MEDUSA_SUBJECT_FLAG_ROGUE;
-                } else if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_EXEC) {
-                        TAILQ_REMOVE(&monitor->changes, subject, hook);
-                        TAILQ_INSERT_TAIL(&monitor->actives, subject, hook);
-                        subject->flags &= ~MEDUSA_SUBJECT_FLAG_MOD;
-                        subject->flags &= ~MEDUSA_SUBJECT_FLAG_ROGUE;
-                } else if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_HTTPREQUEST) {
-                        TAILQ_REMOVE(&monitor->changes, subject, hook);
-                        TAILQ_INSERT_TAIL(&monitor->actives, subject, hook);
-                        subject->flags &= ~MEDUSA_SUBJECT_FLAG_MOD;
-                        subject->flags &= ~MEDUSA_SUBJECT_FLAG_ROGUE;
-                } else if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_DNSRESOLVER_LOOKUP) {
-                        TAILQ_REMOVE(&monitor->changes, subject, hook);
-                        TAILQ_INSERT_TAIL(&monitor->actives, subject, hook);
-                        subject->flags &= ~MEDUSA_SUBJECT_FLAG_MOD;
-                        subject->flags &= ~MEDUSA_SUBJECT_FLAG_ROGUE;
-                } else if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_DNSRESOLVER) {
-                        TAILQ_REMOVE(&monitor->changes, subject, hook);
-                        TAILQ_INSERT_TAIL(&monitor->actives, subject, hook);
-                        subject->flags &= ~MEDUSA_SUBJECT_FLAG_MOD;
-                        subject->flags &= ~MEDUSA_SUBJECT_FLAG_ROGUE;
-                } else if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_DNSREQUEST) {
-                        TAILQ_REMOVE(&monitor->changes, subject, hook);
-                        TAILQ_INSERT_TAIL(&monitor->actives, subject, hook);
-                        subject->flags &= ~MEDUSA_SUBJECT_FLAG_MOD;
-                        subject->flags &= ~MEDUSA_SUBJECT_FLAG_ROGUE;
-                } else if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_HTTPSERVER) {
-                        TAILQ_REMOVE(&monitor->changes, subject, hook);
-                        TAILQ_INSERT_TAIL(&monitor->actives, subject, hook);
-                        subject->flags &= ~MEDUSA_SUBJECT_FLAG_MOD;
-                        subject->flags &= ~MEDUSA_SUBJECT_FLAG_ROGUE;
-                } else if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_HTTPSERVER_CLIENT) {
-                        TAILQ_REMOVE(&monitor->changes, subject, hook);
-                        TAILQ_INSERT_TAIL(&monitor->actives, subject, hook);
-                        subject->flags &= ~MEDUSA_SUBJECT_FLAG_MOD;
-                        subject->flags &= ~MEDUSA_SUBJECT_FLAG_ROGUE;
-                } else if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_WEBSOCKETCLIENT) {
-                        TAILQ_REMOVE(&monitor->changes, subject, hook);
-                        TAILQ_INSERT_TAIL(&monitor->actives, subject, hook);
-                        subject->flags &= ~MEDUSA_SUBJECT_FLAG_MOD;
-                        subject->flags &= ~MEDUSA_SUBJECT_FLAG_ROGUE;
-                } else if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_WEBSOCKETSERVER) {
-                        TAILQ_REMOVE(&monitor->changes, subject, hook);
-                        TAILQ_INSERT_TAIL(&monitor->actives, subject, hook);
-                        subject->flags &= ~MEDUSA_SUBJECT_FLAG_MOD;
-                        subject->flags &= ~MEDUSA_SUBJECT_FLAG_ROGUE;
-                } else if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_WEBSOCKETSERVER_CLIENT) {
-                        TAILQ_REMOVE(&monitor->changes, subject, hook);
-                        TAILQ_INSERT_TAIL(&monitor->actives, subject, hook);
-                        subject->flags &= ~MEDUSA_SUBJECT_FLAG_MOD;
-                        subject->flags &= ~MEDUSA_SUBJECT_FLAG_ROGUE;
                 }
+                TAILQ_REMOVE(&monitor->changes, subject, change);
+                subject->flags &= ~MEDUSA_SUBJECT_FLAG_MOD;
         }
         return 0;
 bail:   return rc;
@@ -783,12 +710,22 @@ bail:   return rc;
 static int monitor_setup_timer (struct medusa_monitor *monitor, struct timespec *remaining)
 {
         int rc;
+        uint64_t deadline;
+        struct timespec timespec;
         struct medusa_timer *timer;
         if (monitor->timer.dirty != 0) {
-                timer = medusa_pqueue_peek(monitor->timer.pqueue);
-                rc = monitor->timer.backend->set(monitor->timer.backend, (timer) ? &timer->_timespec : NULL);
-                if (rc != 0) {
-                        goto bail;
+                timer = medusa_timerheap_peek(monitor->timer.heap, &deadline);
+                if (timer == NULL) {
+                        deadline = MONITOR_TIMER_DISARMED;
+                }
+                if (deadline != monitor->timer.armed) {
+                        timespec.tv_sec  = deadline / 1000000000ULL;
+                        timespec.tv_nsec = deadline % 1000000000ULL;
+                        rc = monitor->timer.backend->set(monitor->timer.backend, (timer) ? &timespec : NULL);
+                        if (rc != 0) {
+                                goto bail;
+                        }
+                        monitor->timer.armed = deadline;
                 }
                 monitor->timer.dirty = 0;
                 monitor->timer.valid = (timer) ? 1 : 0;
@@ -805,29 +742,17 @@ static int monitor_setup_timer (struct medusa_monitor *monitor, struct timespec
 bail:   return -1;
 }
 
-static __attribute__ ((__unused__))  int monitor_hit_timer (void *context, void *a)
-{
-        int rc;
-        struct medusa_timer *timer = a;
-        struct medusa_monitor *monitor = context;
-        (void) monitor;
-        rc = monitor_subject_onevent(monitor, &timer->subject, MEDUSA_TIMER_EVENT_TIMEOUT, NULL);
-        if (rc != 0) {
-                goto bail;
-        }
-        rc = medusa_monitor_mod_unlocked(&timer->subject);
-        if (rc != 0) {
-                goto bail;
-        }
-        return 0;
-bail:   return -1;
-}
-
 static int monitor_check_timer (struct medusa_monitor *monitor)
 {
         int rc;
+        uint64_t deadline;
         struct timespec now;
         struct timespec rem;
+        struct medusa_timer *timer;
+#if defined(MEDUSA_MONITOR_STATS_ENABLE) && (MEDUSA_MONITOR_STATS_ENABLE == 1)
+        uint64_t fired;
+        uint64_t late;
+#endif
         if (monitor->timer.backend->fd == NULL && monitor->timer.valid == 1) {
                 rc = monitor->timer.backend->get(monitor->timer.backend, &rem);
                 if (rc < 0) {
@@ -839,26 +764,24 @@ static int monitor_check_timer (struct medusa_monitor *monitor)
                 }
         }
         if (monitor->timer.fired != 0) {
-                rc = medusa_clock_monotonic(&now);
+                monitor->stats.timer_wakeups += 1;
+                monitor->timer.armed = MONITOR_TIMER_DISARMED;
+                monitor->timer.dirty = 1;
+                rc = monitor_get_clock(monitor, &now);
                 if (rc < 0) {
                         goto bail;
                 }
-#if 0
-                struct medusa_timer *timer;
-                while (1) {
-                        timer = medusa_pqueue_peek(monitor->timer.pqueue);
-                        if (timer == NULL) {
-                                break;
-                        }
-                        if (medusa_timespec_compare(&timer->_timespec, &now, >)) {
-                                break;
-                        }
-                        timer = medusa_pqueue_pop(monitor->timer.pqueue);
-                        if (timer == NULL) {
-                                break;
-                        }
+                /* expired timers leave the heap before their callbacks run,
+                 * rearmed ones are added back when the changes are processed */
+                deadline = monitor_timespec_nsecs(&now);
+                while ((timer = medusa_timerheap_pop_expired(monitor->timer.heap, deadline)) != NULL) {
                         timer->subject.flags &= ~MEDUSA_SUBJECT_FLAG_HEAP;
-                        monitor->timer.dirty = 1;
+#if defined(MEDUSA_MONITOR_STATS_ENABLE) && (MEDUSA_MONITOR_STATS_ENABLE == 1)
+                        monitor->stats.timers += 1;
+                        fired = monitor_stats_clock();
+                        late  = monitor_timespec_nsecs(&timer->_timespec);
+                        monitor_stats_histogram_add(&monitor->stats.lateness, (fired > late) ? fired - late : 0);
+#endif
                         rc = monitor_subject_onevent(monitor, &timer->subject, MEDUSA_TIMER_EVENT_TIMEOUT, NULL);
                         if (rc != 0) {
                                 goto bail;
@@ -868,21 +791,34 @@ static int monitor_check_timer (struct medusa_monitor *monitor)
                                 goto bail;
                         }
                 }
-#else
-                struct medusa_timer tk;
-                memset(&tk, 0, sizeof(struct medusa_timer));
-                tk._timespec = now;
-                rc = medusa_pqueue_search(monitor->timer.pqueue, &tk, monitor_hit_timer, monitor);
-                if (rc != 0) {
-                        goto bail;
-                }
-#endif
                 monitor->timer.fired = 0;
         }
         return 0;
 bail:   return -1;
 }
 
+static int monitor_count_wakeup (struct medusa_monitor *monitor)
+{
+        int rc;
+        uint64_t now;
+        struct timespec timespec;
+        rc = monitor_get_clock(monitor, &timespec);
+        if (rc < 0) {
+                return rc;
+        }
+        now = monitor_timespec_nsecs(&timespec);
+        monitor->stats.wakeups += 1;
+        monitor->stats.window_wakeups += 1;
+        if (monitor->stats.window == 0) {
+                monitor->stats.window = now;
+        } else if (now - monitor->stats.window >= 1000000000ULL) {
+                monitor->stats.wakeups_per_second = monitor->stats.window_wakeups * 1e9 / (now - monitor->stats.window);
+                monitor->stats.window = now;
+                monitor->stats.window_wakeups = 0;
+        }
+        return 0;
+}
+
 static int monitor_check_condition (struct medusa_monitor *monitor)
 {
         int rc;
@@ -926,6 +862,37 @@ __attribute__ ((visibility ("default"))) int medusa_monitor_unlock (struct medus
         return 0;
 }
 
+__attribute__ ((visibility ("default"))) struct medusa_resolver * medusa_monitor_get_resolver_unlocked (struct medusa_monitor *monitor)
+{
+        struct medusa_resolver *resolver;
+        if (MEDUSA_IS_ERR_OR_NULL(monitor)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        if (monitor->resolver == NULL) {
+                resolver = medusa_resolver_create_unlocked(monitor);
+                if (MEDUSA_IS_ERR_OR_NULL(resolver)) {
+                        return resolver;
+                }
+                monitor->resolver = resolver;
+        }
+        return monitor->resolver;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_monitor_register_subject_type (unsigned int type, const struct medusa_subject_type *subject_type)
+{
+        if (type > MEDUSA_SUBJECT_TYPE_MASK) {
+                return -EINVAL;
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(subject_type)) {
+                return -EINVAL;
+        }
+        if (subject_type->rank >= MEDUSA_SUBJECT_RANK_COUNT) {
+                return -EINVAL;
+        }
+        g_subject_types[type] = subject_type;
+        return 0;
+}
+
 __attribute__ ((visibility ("default"))) int medusa_monitor_add_unlocked (struct medusa_monitor *monitor, struct medusa_subject *subject)
 {
         int rc;
@@ -943,10 +910,13 @@ __attribute__ ((visibility ("default"))) int medusa_monitor_add_unlocked (struct
                         return -ENOENT;
                 }
         }
-        TAILQ_INSERT_TAIL(&monitor->changes, subject, hook);
+        TAILQ_INSERT_TAIL(&monitor->actives, subject, hook);
         TAILQ_INSERT_TAIL(&monitor->whole, subject, list);
         subject->monitor = monitor;
-        subject->flags |= MEDUSA_SUBJECT_FLAG_MOD;
+        if (monitor_subject_get_rank(subject) == MEDUSA_SUBJECT_RANK_BASE) {
+                TAILQ_INSERT_TAIL(&monitor->changes, subject, change);
+                subject->flags |= MEDUSA_SUBJECT_FLAG_MOD;
+        }
         rc = monitor_signal(monitor, WAKEUP_REASON_SUBJECT_ADD);
         if (rc < 0) {
                 return rc;
@@ -982,16 +952,20 @@ __attribute__ ((visibility ("default"))) int medusa_monitor_mod_unlocked (struct
                 return -EINVAL;
         }
         if (subject->flags & MEDUSA_SUBJECT_FLAG_DEL) {
-        } else if (subject->flags & MEDUSA_SUBJECT_FLAG_MOD) {
-        } else if (subject->flags & MEDUSA_SUBJECT_FLAG_ROGUE) {
-                TAILQ_REMOVE(&subject->monitor->rogues, subject, hook);
-                TAILQ_INSERT_TAIL(&subject->monitor->changes, subject, hook);
-                subject->flags &= ~MEDUSA_SUBJECT_FLAG_ROGUE;
         } else {
-                TAILQ_REMOVE(&subject->monitor->actives, subject, hook);
-                TAILQ_INSERT_TAIL(&subject->monitor->changes, subject, hook);
+                if (subject->flags & MEDUSA_SUBJECT_FLAG_ROGUE) {
+                        TAILQ_REMOVE(&subject->monitor->rogues, subject, hook);
+                        TAILQ_INSERT_TAIL(&subject->monitor->actives, subject, hook);
+                        subject->flags &= ~MEDUSA_SUBJECT_FLAG_ROGUE;
+                }
+                /* queued once per iteration however often it is modified,
+                 * only base subjects have anything for process_changes to do */
+                if (!(subject->flags & MEDUSA_SUBJECT_FLAG_MOD) &&
+                    monitor_subject_get_rank(subject) == MEDUSA_SUBJECT_RANK_BASE) {
+                        TAILQ_INSERT_TAIL(&subject->monitor->changes, subject, change);
+                        subject->flags |= MEDUSA_SUBJECT_FLAG_MOD;
+                }
         }
-        subject->flags |= MEDUSA_SUBJECT_FLAG_MOD;
         rc = 0;
         if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_IO) {
                 struct medusa_io *io;
@@ -1010,7 +984,7 @@ __attribute__ ((visibility ("default"))) int medusa_monitor_mod_unlocked (struct
                 timer = (struct medusa_timer *) subject;
                 if (!medusa_timer_is_valid_unlocked(timer) &&
                     (subject->flags & MEDUSA_SUBJECT_FLAG_HEAP)) {
-                        rc = medusa_pqueue_del(subject->monitor->timer.pqueue, timer);
+                        rc = medusa_timerheap_del(subject->monitor->timer.heap, timer);
                         if (rc < 0) {
                                 goto out;
                         }
@@ -1070,16 +1044,21 @@ __attribute__ ((visibility ("default"))) int medusa_monitor_del_unlocked (struct
                 return -EINVAL;
         }
         if (subject->flags & MEDUSA_SUBJECT_FLAG_DEL) {
-        } else if (subject->flags & MEDUSA_SUBJECT_FLAG_MOD) {
-                TAILQ_REMOVE(&subject->monitor->changes, subject, hook);
-                TAILQ_INSERT_TAIL(&subject->monitor->deletes, subject, hook);
-        } else if (subject->flags & MEDUSA_SUBJECT_FLAG_ROGUE) {
-                TAILQ_REMOVE(&subject->monitor->rogues, subject, hook);
-                TAILQ_INSERT_TAIL(&subject->monitor->deletes, subject, hook);
-                subject->flags &= ~MEDUSA_SUBJECT_FLAG_ROGUE;
         } else {
-                TAILQ_REMOVE(&subject->monitor->actives, subject, hook);
-                TAILQ_INSERT_TAIL(&subject->monitor->deletes, subject, hook);
+                unsigned int rank;
+                if (subject->flags & MEDUSA_SUBJECT_FLAG_MOD) {
+                        TAILQ_REMOVE(&subject->monitor->changes, subject, change);
+                        subject->flags &= ~MEDUSA_SUBJECT_FLAG_MOD;
+                }
+                if (subject->flags & MEDUSA_SUBJECT_FLAG_ROGUE) {
+                        TAILQ_REMOVE(&subject->monitor->rogues, subject, hook);
+                        subject->flags &= ~MEDUSA_SUBJECT_FLAG_ROGUE;
+                } else {
+                        TAILQ_REMOVE(&subject->monitor->actives, subject, hook);
+                }
+                rank = monitor_subject_get_rank(subject);
+                TAILQ_INSERT_TAIL(&subject->monitor->deletes[rank], subject, hook);
+                subject->monitor->deletes_pending |= (1U << rank);
         }
         subject->flags |= MEDUSA_SUBJECT_FLAG_DEL;
         rc = 0;
@@ -1097,7 +1076,7 @@ __attribute__ ((visibility ("default"))) int medusa_monitor_del_unlocked (struct
                 struct medusa_timer *timer;
                 timer = (struct medusa_timer *) subject;
                 if (subject->flags & MEDUSA_SUBJECT_FLAG_HEAP) {
-                        rc = medusa_pqueue_del(subject->monitor->timer.pqueue, timer);
+                        rc = medusa_timerheap_del(subject->monitor->timer.heap, timer);
                         if (rc < 0) {
                                 goto out;
                         }
@@ -1156,6 +1135,7 @@ bail:   return -EIO;
 
 __attribute__ ((visibility ("default"))) struct medusa_monitor * medusa_monitor_create_with_options (const struct medusa_monitor_init_options *options)
 {
+        int i;
         int rc;
         struct medusa_monitor *monitor;
         monitor = NULL;
@@ -1170,7 +1150,9 @@ __attribute__ ((visibility ("default"))) struct medusa_monitor * medusa_monitor_
         memset(monitor, 0, sizeof(struct medusa_monitor));
         TAILQ_INIT(&monitor->actives);
         TAILQ_INIT(&monitor->changes);
-        TAILQ_INIT(&monitor->deletes);
+        for (i = 0; i < MEDUSA_SUBJECT_RANK_COUNT; i++) {
+                TAILQ_INIT(&monitor->deletes[i]);
+        }
         TAILQ_INIT(&monitor->rogues);
         TAILQ_INIT(&monitor->whole);
         monitor->flags = options->flags;
@@ -1304,12 +1286,39 @@ __attribute__ ((visibility ("default"))) struct medusa_monitor * medusa_monitor_
                 goto bail;
         }
         monitor->timer.backend->monitor = monitor;
-        monitor->timer.pqueue = medusa_pqueue_create(0, 64, monitor_timer_subject_compare, monitor_timer_subject_set_position, monitor_timer_subject_get_position);
-        if (monitor->timer.pqueue == NULL) {
-                medusa_errorf("can not create timer pqueue");
+        if (options->timer.slack < 0) {
+                medusa_errorf("invalid timer slack: %f", options->timer.slack);
+                goto bail;
+        }
+        monitor->timer.slack = options->timer.slack * 1e9;
+        monitor->timer.armed = MONITOR_TIMER_DISARMED;
+        if (options->watchdog.threshold < 0) {
+                medusa_errorf("invalid watchdog threshold: %f", options->watchdog.threshold);
+                goto bail;
+        }
+        if (options->watchdog.threshold > 0) {
+                monitor->watchdog = medusa_watchdog_create(options->watchdog.threshold, options->watchdog.backtrace);
+                if (monitor->watchdog == NULL) {
+                        medusa_errorf("can not create watchdog");
+                        goto bail;
+                }
+        }
+        if (options->stats.interval < 0) {
+                medusa_errorf("invalid stats interval: %f", options->stats.interval);
+                goto bail;
+        }
+#if defined(MEDUSA_MONITOR_STATS_ENABLE) && (MEDUSA_MONITOR_STATS_ENABLE == 1)
+        monitor->stats.interval = options->stats.interval * 1e9;
+#endif
+        monitor->timer.heap = medusa_timerheap_create(64, offsetof(struct medusa_timer, _position));
+        if (monitor->timer.heap == NULL) {
+                medusa_errorf("can not create timer heap");
                 goto bail;
         }
         if (options->signal.type == MEDUSA_MONITOR_SIGNAL_DEFAULT) {
+                /* signalfd blocks the signals it watches, and the mask is
+                 * inherited by every thread and child created later; it is
+                 * only used when asked for */
                 do {
 #if defined(MEDUSA_SIGNAL_SIGACTION_ENABLE) && (MEDUSA_SIGNAL_SIGACTION_ENABLE == 1)
                         monitor->signal.backend = medusa_signal_sigaction_create(NULL);
@@ -1328,6 +1337,10 @@ __attribute__ ((visibility ("default"))) struct medusa_monitor * medusa_monitor_
         } else if (options->signal.type == MEDUSA_MONITOR_SIGNAL_SIGACTION) {
                 monitor->signal.backend = medusa_signal_sigaction_create(NULL);
 #endif
+#if defined(MEDUSA_SIGNAL_SIGNALFD_ENABLE) && (MEDUSA_SIGNAL_SIGNALFD_ENABLE == 1)
+        } else if (options->signal.type == MEDUSA_MONITOR_SIGNAL_SIGNALFD) {
+                monitor->signal.backend = medusa_signal_signalfd_create(NULL);
+#endif
 #if defined(MEDUSA_SIGNAL_NULL_ENABLE) && (MEDUSA_SIGNAL_NULL_ENABLE == 1)
         } else if (options->signal.type == MEDUSA_MONITOR_SIGNAL_NULL) {
                 monitor->signal.backend = medusa_signal_null_create(NULL);
@@ -1429,7 +1442,7 @@ __attribute__ ((visibility ("default"))) struct medusa_monitor * medusa_monitor_
 __attribute__ ((visibility ("default"))) void medusa_monitor_destroy (struct medusa_monitor *monitor)
 {
         struct medusa_subject *subject;
-        struct medusa_subject *nsubject;
+        const struct medusa_subject_type *type;
         if (monitor == NULL) {
                 return;
         }
@@ -1447,134 +1460,22 @@ __attribute__ ((visibility ("default"))) void medusa_monitor_destroy (struct med
                 subject = TAILQ_FIRST(&monitor->rogues);
                 medusa_monitor_del_unlocked(subject);
         }
-        while (!TAILQ_EMPTY(&monitor->changes)) {
-                subject = TAILQ_FIRST(&monitor->changes);
-                medusa_monitor_del_unlocked(subject);
-        }
         while (!TAILQ_EMPTY(&monitor->actives)) {
                 subject = TAILQ_FIRST(&monitor->actives);
                 medusa_monitor_del_unlocked(subject);
         }
-        TAILQ_FOREACH_SAFE(subject, &monitor->deletes, hook, nsubject) {
-                if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_HTTPSERVER_CLIENT) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        medusa_httpserver_client_onevent_unlocked((struct medusa_httpserver_client *) subject, MEDUSA_HTTPSERVER_CLIENT_EVENT_DESTROY, NULL);
+        while ((subject = monitor_pop_delete(monitor)) != NULL) {
+                monitor_subject_detach(monitor, subject);
+                type = g_subject_types[medusa_subject_get_type(subject)];
+                if (type != NULL) {
+                        type->destroy(subject);
                 }
         }
-        TAILQ_FOREACH_SAFE(subject, &monitor->deletes, hook, nsubject) {
-                if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_HTTPSERVER) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        medusa_httpserver_onevent_unlocked((struct medusa_httpserver *) subject, MEDUSA_HTTPSERVER_EVENT_DESTROY, NULL);
-                }
+        if (monitor->resolver != NULL) {
+                medusa_resolver_destroy_unlocked(monitor->resolver);
         }
-        TAILQ_FOREACH_SAFE(subject, &monitor->deletes, hook, nsubject) {
-                if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_WEBSOCKETCLIENT) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        medusa_websocketclient_onevent_unlocked((struct medusa_websocketclient *) subject, MEDUSA_WEBSOCKETCLIENT_EVENT_DESTROY, NULL);
-                }
-        }
-        TAILQ_FOREACH_SAFE(subject, &monitor->deletes, hook, nsubject) {
-                if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_WEBSOCKETSERVER_CLIENT) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        medusa_websocketserver_client_onevent_unlocked((struct medusa_websocketserver_client *) subject, MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_DESTROY, NULL);
-                }
-        }
-        TAILQ_FOREACH_SAFE(subject, &monitor->deletes, hook, nsubject) {
-                if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_WEBSOCKETSERVER) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        medusa_websocketserver_onevent_unlocked((struct medusa_websocketserver *) subject, MEDUSA_WEBSOCKETSERVER_EVENT_DESTROY, NULL);
-                }
-        }
-        TAILQ_FOREACH_SAFE(subject, &monitor->deletes, hook, nsubject) {
-                if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_HTTPREQUEST) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        medusa_httprequest_onevent_unlocked((struct medusa_httprequest *) subject, MEDUSA_HTTPREQUEST_EVENT_DESTROY, NULL);
-                }
-        }
-        TAILQ_FOREACH_SAFE(subject, &monitor->deletes, hook, nsubject) {
-                if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_DNSRESOLVER_LOOKUP) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        medusa_dnsresolver_lookup_onevent_unlocked((struct medusa_dnsresolver_lookup *) subject, MEDUSA_DNSRESOLVER_LOOKUP_EVENT_DESTROY, NULL);
-                }
-        }
-        TAILQ_FOREACH_SAFE(subject, &monitor->deletes, hook, nsubject) {
-                if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_DNSRESOLVER) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        medusa_dnsresolver_onevent_unlocked((struct medusa_dnsresolver *) subject, MEDUSA_DNSRESOLVER_EVENT_DESTROY, NULL);
-                }
-        }
-        TAILQ_FOREACH_SAFE(subject, &monitor->deletes, hook, nsubject) {
-                if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_DNSREQUEST) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        medusa_dnsrequest_onevent_unlocked((struct medusa_dnsrequest *) subject, MEDUSA_DNSREQUEST_EVENT_DESTROY, NULL);
-                }
-        }
-#if defined(MEDUSA_EXEC_ENABLE) && (MEDUSA_EXEC_ENABLE == 1)
-        TAILQ_FOREACH_SAFE(subject, &monitor->deletes, hook, nsubject) {
-                if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_EXEC) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        medusa_exec_onevent_unlocked((struct medusa_exec *) subject, MEDUSA_EXEC_EVENT_DESTROY, NULL);
-                }
-        }
-#endif
-        TAILQ_FOREACH_SAFE(subject, &monitor->deletes, hook, nsubject) {
-                if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_TCPSOCKET) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        medusa_tcpsocket_onevent_unlocked((struct medusa_tcpsocket *) subject, MEDUSA_TCPSOCKET_EVENT_DESTROY, NULL);
-                }
-        }
-        TAILQ_FOREACH_SAFE(subject, &monitor->deletes, hook, nsubject) {
-                if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_UDPSOCKET) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        medusa_udpsocket_onevent_unlocked((struct medusa_udpsocket *) subject, MEDUSA_UDPSOCKET_EVENT_DESTROY, NULL);
-                }
-        }
-        TAILQ_FOREACH_SAFE(subject, &monitor->deletes, hook, nsubject) {
-                if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_IO) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        if (subject->flags & MEDUSA_SUBJECT_FLAG_HEAP) {
-                                monitor->poll.backend->del(monitor->poll.backend, (struct medusa_io *) subject);
-                                subject->flags &= ~MEDUSA_SUBJECT_FLAG_HEAP;
-                        }
-                        medusa_io_onevent_unlocked((struct medusa_io *) subject, MEDUSA_IO_EVENT_DESTROY, NULL);
-                } else if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_TIMER) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        if (subject->flags & MEDUSA_SUBJECT_FLAG_HEAP) {
-                                medusa_pqueue_del(monitor->timer.pqueue, (struct medusa_timer *) subject);
-                                subject->flags &= ~MEDUSA_SUBJECT_FLAG_HEAP;
-                        }
-                        medusa_timer_onevent_unlocked((struct medusa_timer *) subject, MEDUSA_TIMER_EVENT_DESTROY, NULL);
-                } else if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_SIGNAL) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        if (subject->flags & MEDUSA_SUBJECT_FLAG_HEAP) {
-                                monitor->signal.backend->del(monitor->signal.backend, (struct medusa_signal *) subject);
-                                subject->flags &= ~MEDUSA_SUBJECT_FLAG_HEAP;
-                        }
-                        medusa_signal_onevent_unlocked((struct medusa_signal *) subject, MEDUSA_SIGNAL_EVENT_DESTROY, NULL);
-                } else if (medusa_subject_get_type(subject) == MEDUSA_SUBJECT_TYPE_CONDITION) {
-                        TAILQ_REMOVE(&monitor->deletes, subject, hook);
-                        TAILQ_REMOVE(&monitor->whole, subject, list);
-                        if (subject->flags & MEDUSA_SUBJECT_FLAG_HEAP) {
-                                TAILQ_REMOVE(&subject->monitor->condition.signalled, (struct medusa_condition *) subject, _signalled);
-                                subject->flags &= ~MEDUSA_SUBJECT_FLAG_HEAP;
-                        }
-                        medusa_condition_onevent_unlocked((struct medusa_condition *) subject, MEDUSA_CONDITION_EVENT_DESTROY, NULL);
-                }
+        if (monitor->watchdog != NULL) {
+                medusa_watchdog_destroy(monitor->watchdog);
         }
         if (monitor->poll.backend != NULL) {
                 monitor->poll.backend->destroy(monitor->poll.backend);
@@ -1591,8 +1492,8 @@ __attribute__ ((visibility ("default"))) void medusa_monitor_destroy (struct med
         if (monitor->wakeup.fds[1] >= 0) {
                 close(monitor->wakeup.fds[1]);
         }
-        if (monitor->timer.pqueue != NULL) {
-                medusa_pqueue_destroy(monitor->timer.pqueue);
+        if (monitor->timer.heap != NULL) {
+                medusa_timerheap_destroy(monitor->timer.heap);
         }
         medusa_monitor_unlock(monitor);
         if (monitor->flags & MEDUSA_MONITOR_FLAG_THREAD_SAFE) {
@@ -1613,6 +1514,145 @@ __attribute__ ((visibility ("default"))) int medusa_monitor_get_running (struct
         return running;
 }
 
+__attribute__ ((visibility ("default"))) int medusa_monitor_set_timer_slack (struct medusa_monitor *monitor, double slack)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(monitor)) {
+                return -EINVAL;
+        }
+        if (slack < 0) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(monitor);
+        monitor->timer.slack = slack * 1e9;
+        medusa_monitor_unlock(monitor);
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) double medusa_monitor_get_timer_slack (struct medusa_monitor *monitor)
+{
+        double slack;
+        if (MEDUSA_IS_ERR_OR_NULL(monitor)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(monitor);
+        slack = monitor->timer.slack / 1e9;
+        medusa_monitor_unlock(monitor);
+        return slack;
+}
+
+static void monitor_stats_get (const struct medusa_monitor *monitor, struct medusa_monitor_stats *stats, uint64_t now)
+{
+        memset(stats, 0, sizeof(struct medusa_monitor_stats));
+        stats->wakeups            = monitor->stats.wakeups;
+        stats->timer_wakeups      = monitor->stats.timer_wakeups;
+        stats->wakeups_per_second = monitor->stats.wakeups_per_second;
+        stats->stalls             = monitor->stats.stalls;
+        if (monitor->stats.window != 0 &&
+            now - monitor->stats.window >= 1000000000ULL) {
+                stats->wakeups_per_second = monitor->stats.window_wakeups * 1e9 / (now - monitor->stats.window);
+        }
+#if defined(MEDUSA_MONITOR_STATS_ENABLE) && (MEDUSA_MONITOR_STATS_ENABLE == 1)
+        stats->enabled    = 1;
+        stats->iterations = monitor->stats.iterations;
+        stats->wait_time  = monitor->stats.wait_time;
+        stats->busy_time  = monitor->stats.busy_time;
+        stats->changes    = monitor->stats.changes;
+        stats->deletes    = monitor->stats.deletes;
+        stats->timers     = monitor->stats.timers;
+        memcpy(stats->events, monitor->stats.events, sizeof(stats->events));
+        memcpy(stats->callback, monitor->stats.callback, sizeof(stats->callback));
+        memcpy(&stats->lateness, &monitor->stats.lateness, sizeof(stats->lateness));
+#endif
+}
+
+#if defined(MEDUSA_MONITOR_STATS_ENABLE) && (MEDUSA_MONITOR_STATS_ENABLE == 1)
+/* called locked at the end of an iteration; the callback runs unlocked so
+ * it may query the monitor */
+static int monitor_stats_report (struct medusa_monitor *monitor, uint64_t now)
+{
+        int rc;
+        struct medusa_monitor_stats stats;
+        if (monitor->stats.interval == 0 ||
+            monitor->onevent.callback == NULL) {
+                return 0;
+        }
+        if (monitor->stats.reported == 0) {
+                monitor->stats.reported = now;
+                return 0;
+        }
+        if (now - monitor->stats.reported < monitor->stats.interval) {
+                return 0;
+        }
+        monitor->stats.reported = now;
+        monitor_stats_get(monitor, &stats, now);
+        medusa_monitor_unlock(monitor);
+        rc = monitor->onevent.callback(monitor, MEDUSA_MONITOR_EVENT_STATS, monitor->onevent.context, &stats);
+        medusa_monitor_lock(monitor);
+        return rc;
+}
+#endif
+
+__attribute__ ((visibility ("default"))) int medusa_monitor_get_stats (struct medusa_monitor *monitor, struct medusa_monitor_stats *stats)
+{
+        int rc;
+        uint64_t now;
+        struct timespec timespec;
+        if (MEDUSA_IS_ERR_OR_NULL(monitor)) {
+                return -EINVAL;
+        }
+        if (stats == NULL) {
+                return -EINVAL;
+        }
+        rc = medusa_clock_monotonic(&timespec);
+        if (rc < 0) {
+                return rc;
+        }
+        now = monitor_timespec_nsecs(&timespec);
+        medusa_monitor_lock(monitor);
+        monitor_stats_get(monitor, stats, now);
+        medusa_monitor_unlock(monitor);
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) unsigned long long medusa_monitor_stats_histogram_percentile (const struct medusa_monitor_stats_histogram *histogram, double percentile)
+{
+        unsigned int i;
+        unsigned int shift;
+        unsigned long long value;
+        unsigned long long target;
+        unsigned long long count;
+        if (histogram == NULL) {
+                return 0;
+        }
+        if (histogram->count == 0) {
+                return 0;
+        }
+        if (percentile <= 0) {
+                percentile = 0;
+        } else if (percentile > 100) {
+                percentile = 100;
+        }
+        target = (histogram->count * percentile + 99) / 100;
+        if (target == 0) {
+                target = 1;
+        }
+        count = 0;
+        for (i = 0; i < MEDUSA_MONITOR_STATS_HISTOGRAM_BUCKETS; i++) {
+                count += histogram->buckets[i];
+                if (count >= target) {
+                        break;
+                }
+        }
+        /* upper edge of the bucket, never above what was recorded */
+        if (i < 4) {
+                value = i;
+        } else {
+                shift = i / 4 - 1;
+                value = ((4ULL + (i % 4) + 1) << shift) - 1;
+        }
+        return (value < histogram->max) ? value : histogram->max;
+}
+
 __attribute__ ((visibility ("default"))) int medusa_monitor_break (struct medusa_monitor *monitor)
 {
         int rc;
@@ -1643,6 +1683,12 @@ __attribute__ ((visibility ("default"))) int medusa_monitor_run_timeout (struct
         struct timespec *timespec;
         struct timespec _timespec;
         struct timespec remaining;
+#if defined(MEDUSA_MONITOR_STATS_ENABLE) && (MEDUSA_MONITOR_STATS_ENABLE == 1)
+        uint64_t started;
+        uint64_t polled;
+        uint64_t waited;
+        uint64_t finished;
+#endif
 
         if (MEDUSA_IS_ERR_OR_NULL(monitor)) {
                 return -EINVAL;
@@ -1650,6 +1696,11 @@ __attribute__ ((visibility ("default"))) int medusa_monitor_run_timeout (struct
 
         medusa_monitor_lock(monitor);
 
+        monitor->clock.valid = 0;
+#if defined(MEDUSA_MONITOR_STATS_ENABLE) && (MEDUSA_MONITOR_STATS_ENABLE == 1)
+        started = monitor_stats_clock();
+#endif
+
         /*
          * monitor: reprocess changes after condition signals to avoid event delay
          *
@@ -1696,6 +1747,12 @@ __attribute__ ((visibility ("default"))) int medusa_monitor_run_timeout (struct
                 timespec->tv_nsec = (timeout - timespec->tv_sec) * 1e9;
         }
 
+#if defined(MEDUSA_MONITOR_STATS_ENABLE) && (MEDUSA_MONITOR_STATS_ENABLE == 1)
+        /* io callbacks run inside the backend, their time is taken off the wait */
+        monitor->stats.dispatched = 0;
+        polled = monitor_stats_clock();
+#endif
+
         medusa_monitor_unlock(monitor);
 
         if (monitor->timer.backend->fd == NULL && monitor->timer.valid == 1) {
@@ -1716,6 +1773,17 @@ __attribute__ ((visibility ("default"))) int medusa_monitor_run_timeout (struct
 
         medusa_monitor_lock(monitor);
 
+        monitor->clock.valid = 0;
+#if defined(MEDUSA_MONITOR_STATS_ENABLE) && (MEDUSA_MONITOR_STATS_ENABLE == 1)
+        polled = monitor_stats_clock() - polled;
+        waited = (polled > monitor->stats.dispatched) ? polled - monitor->stats.dispatched : 0;
+#endif
+
+        if (rc < 0) {
+                goto bail;
+        }
+
+        rc = monitor_count_wakeup(monitor);
         if (rc < 0) {
                 goto bail;
         }
@@ -1725,6 +1793,17 @@ __attribute__ ((visibility ("default"))) int medusa_monitor_run_timeout (struct
                 goto bail;
         }
 
+#if defined(MEDUSA_MONITOR_STATS_ENABLE) && (MEDUSA_MONITOR_STATS_ENABLE == 1)
+        finished = monitor_stats_clock();
+        monitor->stats.iterations += 1;
+        monitor->stats.wait_time  += waited;
+        monitor->stats.busy_time  += (finished - started > waited) ? finished - started - waited : 0;
+        rc = monitor_stats_report(monitor, finished);
+        if (rc < 0) {
+                goto bail;
+        }
+#endif
+
         rc = monitor->running;
 
 bail:   medusa_monitor_unlock(monitor);
@@ -1775,6 +1854,14 @@ __attribute__ ((visibility ("default"))) struct medusa_subject * medusa_monitor_
         return TAILQ_NEXT(subject, list);
 }
 
+__attribute__ ((visibility ("default"))) int medusa_monitor_onevent_unlocked (struct medusa_subject *subject, unsigned int events, void *param)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(subject)) {
+                return -EINVAL;
+        }
+        return monitor_subject_onevent(subject->monitor, subject, events, param);
+}
+
 __attribute__ ((visibility ("default"))) int medusa_monitor_poll_type_value (const char *value)
 {
         if (value == NULL) {
@@ -1881,6 +1968,10 @@ __attribute__ ((visibility ("default"))) int medusa_monitor_signal_type_value (c
             strcasecmp(value, "NULL") == 0) {
                 return MEDUSA_MONITOR_SIGNAL_NULL;
         }
+        if (strcasecmp(value, "MEDUSA_MONITOR_SIGNAL_SIGNALFD") == 0 ||
+            strcasecmp(value, "SIGNALFD") == 0) {
+                return MEDUSA_MONITOR_SIGNAL_SIGNALFD;
+        }
         return -EINVAL;
 }
 
@@ -1895,6 +1986,9 @@ __attribute__ ((visibility ("default"))) const char * medusa_monitor_signal_type
         if (type == MEDUSA_MONITOR_SIGNAL_NULL) {
                 return "MEDUSA_MONITOR_SIGNAL_NULL";
         }
+        if (type == MEDUSA_MONITOR_SIGNAL_SIGNALFD) {
+                return "MEDUSA_MONITOR_SIGNAL_SIGNALFD";
+        }
         return "MEDUSA_MONITOR_SIGNAL_UNKNOWN";
 }
 
@@ -1902,5 +1996,6 @@ __attribute__ ((visibility ("default"))) const char * medusa_monitor_event_strin
 {
         if (event == MEDUSA_MONITOR_EVENT_ERROR)        return "MEDUSA_MONITOR_EVENT_ERROR";
         if (event == MEDUSA_MONITOR_EVENT_DESTROY)      return "MEDUSA_MONITOR_EVENT_DESTROY";
+        if (event == MEDUSA_MONITOR_EVENT_STATS)        return "MEDUSA_MONITOR_EVENT_STATS";
         return "MEDUSA_MONITOR_EVENT_UNKNOWN";
 }
@@ -36,10 +36,12 @@ enum {
 enum {
         MEDUSA_MONITOR_SIGNAL_DEFAULT   = 0,
         MEDUSA_MONITOR_SIGNAL_SIGACTION = 1,
-        MEDUSA_MONITOR_SIGNAL_NULL      = 2
+        MEDUSA_MONITOR_SIGNAL_NULL      = 2,
+        MEDUSA_MONITOR_SIGNAL_SIGNALFD  = 3
 #define MEDUSA_MONITOR_SIGNAL_DEFAULT   MEDUSA_MONITOR_SIGNAL_DEFAULT
 #define MEDUSA_MONITOR_SIGNAL_SIGACTION MEDUSA_MONITOR_SIGNAL_SIGACTION
 #define MEDUSA_MONITOR_SIGNAL_NULL      MEDUSA_MONITOR_SIGNAL_NULL
+#define MEDUSA_MONITOR_SIGNAL_SIGNALFD  MEDUSA_MONITOR_SIGNAL_SIGNALFD
 };
 
 enum {
@@ -54,8 +56,10 @@ enum {
 enum {
         MEDUSA_MONITOR_EVENT_ERROR      = (1 << 0), /* 0x00000001 */
         MEDUSA_MONITOR_EVENT_DESTROY    = (1 << 1), /* 0x00000002 */
+        MEDUSA_MONITOR_EVENT_STATS      = (1 << 2), /* 0x00000004 */
 #define MEDUSA_MONITOR_EVENT_ERROR      MEDUSA_MONITOR_EVENT_ERROR
 #define MEDUSA_MONITOR_EVENT_DESTROY    MEDUSA_MONITOR_EVENT_DESTROY
+#define MEDUSA_MONITOR_EVENT_STATS      MEDUSA_MONITOR_EVENT_STATS
 };
 
 struct medusa_monitor_init_options {
@@ -84,6 +88,7 @@ struct medusa_monitor_init_options {
                                 int foo;
                         } timerfd;
                 } u;
+                double slack;
         } timer;
         struct {
                 unsigned int type;
@@ -97,26 +102,97 @@ struct medusa_monitor_init_options {
                 int (*callback) (struct medusa_monitor *monitor, unsigned int events, void *context, void *param);
                 void *context;
         } onevent;
+        struct {
+                double interval;
+        } stats;
+        /* a dispatch of a base subject (io, timer, signal) that runs longer
+         * than threshold seconds is reported as a subject stall error.
+         * backtrace claims SIGURG for the process, unless it is already in
+         * use, and samples the loop thread from a signal handler; this is
+         * best effort, backtrace() is not async signal safe. */
+        struct {
+                double threshold;
+                int backtrace;
+        } watchdog;
 };
 
 enum {
         MEDUSA_MONITOR_ERROR_TYPE_UNKNOWN               = 0,
-        MEDUSA_MONITOR_ERROR_TYPE_SUBJECT_ONEVENT       = 1
+        MEDUSA_MONITOR_ERROR_TYPE_SUBJECT_ONEVENT       = 1,
+        MEDUSA_MONITOR_ERROR_TYPE_SUBJECT_STALL         = 2
 #define MEDUSA_MONITOR_ERROR_TYPE_UNKNOWN               MEDUSA_MONITOR_ERROR_TYPE_UNKNOWN
 #define MEDUSA_MONITOR_ERROR_TYPE_SUBJECT_ONEVENT       MEDUSA_MONITOR_ERROR_TYPE_SUBJECT_ONEVENT
+#define MEDUSA_MONITOR_ERROR_TYPE_SUBJECT_STALL         MEDUSA_MONITOR_ERROR_TYPE_SUBJECT_STALL
 };
 
 struct medusa_monitor_event_error_subject_onevent {
         unsigned int subject_type;
 };
 
+/* callback is the onevent of the base subject that was dispatched, for
+ * sockets, clients and servers this is the library handler that wraps the
+ * user callback (e.g. tcpsocket_io_onevent); backtrace, when present,
+ * shows the user frame below it. */
+struct medusa_monitor_event_error_subject_stall {
+        unsigned int subject_type;
+        void *callback;
+        unsigned long long duration;
+        void * const *backtrace;
+        int backtrace_count;
+};
+
 struct medusa_monitor_event_error {
         unsigned int type;
         union {
                 struct medusa_monitor_event_error_subject_onevent subject_onevent;
+                struct medusa_monitor_event_error_subject_stall subject_stall;
         } u;
 };
 
+/* sockets, clients and servers are driven by the io and timer subjects
+ * they own and show up there, any other subject type is counted as other */
+enum {
+        MEDUSA_MONITOR_STATS_SUBJECT_IO         = 0,
+        MEDUSA_MONITOR_STATS_SUBJECT_TIMER      = 1,
+        MEDUSA_MONITOR_STATS_SUBJECT_CONDITION  = 2,
+        MEDUSA_MONITOR_STATS_SUBJECT_SIGNAL     = 3,
+        MEDUSA_MONITOR_STATS_SUBJECT_OTHER      = 4,
+        MEDUSA_MONITOR_STATS_SUBJECT_COUNT      = 5
+#define MEDUSA_MONITOR_STATS_SUBJECT_IO         MEDUSA_MONITOR_STATS_SUBJECT_IO
+#define MEDUSA_MONITOR_STATS_SUBJECT_TIMER      MEDUSA_MONITOR_STATS_SUBJECT_TIMER
+#define MEDUSA_MONITOR_STATS_SUBJECT_CONDITION  MEDUSA_MONITOR_STATS_SUBJECT_CONDITION
+#define MEDUSA_MONITOR_STATS_SUBJECT_SIGNAL     MEDUSA_MONITOR_STATS_SUBJECT_SIGNAL
+#define MEDUSA_MONITOR_STATS_SUBJECT_OTHER      MEDUSA_MONITOR_STATS_SUBJECT_OTHER
+#define MEDUSA_MONITOR_STATS_SUBJECT_COUNT      MEDUSA_MONITOR_STATS_SUBJECT_COUNT
+};
+
+/* log-linear buckets of nanoseconds, four per power of two */
+#define MEDUSA_MONITOR_STATS_HISTOGRAM_BUCKETS  160
+
+struct medusa_monitor_stats_histogram {
+        unsigned long long count;
+        unsigned long long sum;
+        unsigned long long max;
+        unsigned long long buckets[MEDUSA_MONITOR_STATS_HISTOGRAM_BUCKETS];
+};
+
+struct medusa_monitor_stats {
+        unsigned long long wakeups;
+        unsigned long long timer_wakeups;
+        double wakeups_per_second;
+        unsigned long long stalls;
+        int enabled;
+        unsigned long long iterations;
+        unsigned long long wait_time;
+        unsigned long long busy_time;
+        unsigned long long changes;
+        unsigned long long deletes;
+        unsigned long long timers;
+        unsigned long long events[MEDUSA_MONITOR_STATS_SUBJECT_COUNT];
+        struct medusa_monitor_stats_histogram callback[MEDUSA_MONITOR_STATS_SUBJECT_COUNT];
+        struct medusa_monitor_stats_histogram lateness;
+};
+
 int medusa_monitor_init_options_default (struct medusa_monitor_init_options *options);
 
 struct medusa_monitor * medusa_monitor_create_with_options (const struct medusa_monitor_init_options *options);
@@ -129,6 +205,12 @@ int medusa_monitor_run_timeout (struct medusa_monitor *monitor, double timeout);
 
 int medusa_monitor_get_running (struct medusa_monitor *monitor);
 
+int medusa_monitor_set_timer_slack (struct medusa_monitor *monitor, double slack);
+double medusa_monitor_get_timer_slack (struct medusa_monitor *monitor);
+
+int medusa_monitor_get_stats (struct medusa_monitor *monitor, struct medusa_monitor_stats *stats);
+unsigned long long medusa_monitor_stats_histogram_percentile (const struct medusa_monitor_stats_histogram *histogram, double percentile);
+
 int medusa_monitor_break (struct medusa_monitor *monitor);
 int medusa_monitor_continue (struct medusa_monitor *monitor);
 
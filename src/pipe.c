@@ -161,6 +161,10 @@ __attribute__ ((visibility ("default"))) int medusa_pipe2 (int pipefd[2], unsign
 		fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
 		fcntl(pipefd[1], F_SETFL, O_NONBLOCK);
 	}
+	if (flags & MEDUSA_PIPE_FLAG_CLOEXEC) {
+		fcntl(pipefd[0], F_SETFD, FD_CLOEXEC);
+		fcntl(pipefd[1], F_SETFD, FD_CLOEXEC);
+	}
 	return 0;
 }
 
@@ -173,6 +177,9 @@ __attribute__ ((visibility ("default"))) int medusa_pipe2 (int pipefd[2], unsign
         if (flags & MEDUSA_PIPE_FLAG_NONBLOCK) {
                 options |= O_NONBLOCK;
         }
+        if (flags & MEDUSA_PIPE_FLAG_CLOEXEC) {
+                options |= O_CLOEXEC;
+        }
         return pipe2(pipefd, options);
 }
 
@@ -4,9 +4,11 @@
 
 enum {
         MEDUSA_PIPE_FLAG_NONE           = 0x00000000,
-        MEDUSA_PIPE_FLAG_NONBLOCK       = 0x00000001
+        MEDUSA_PIPE_FLAG_NONBLOCK       = 0x00000001,
+        MEDUSA_PIPE_FLAG_CLOEXEC        = 0x00000002
 #define MEDUSA_PIPE_FLAG_NONE           MEDUSA_PIPE_FLAG_NONE
 #define MEDUSA_PIPE_FLAG_NONBLOCK       MEDUSA_PIPE_FLAG_NONBLOCK
+#define MEDUSA_PIPE_FLAG_CLOEXEC        MEDUSA_PIPE_FLAG_CLOEXEC
 };
 
 int medusa_pipe (int pipefd[2]);
@@ -28,12 +28,30 @@ struct internal {
         struct pollfd *rpfds;
         int nrpfds;
         int srpfds;
+        int dirty;
         struct medusa_io **ios;
+        int *slots;
         int nios;
         int (*onevent) (struct medusa_poll_backend *backend, struct medusa_io *io, unsigned int events, void *context, void *param);
         void *context;
 };
 
+static short internal_events (unsigned int events)
+{
+        short pevents;
+        pevents = 0;
+        if (events & MEDUSA_IO_EVENT_IN) {
+                pevents |= POLLIN;
+        }
+        if (events & MEDUSA_IO_EVENT_OUT) {
+                pevents |= POLLOUT;
+        }
+        if (events & MEDUSA_IO_EVENT_PRI) {
+                pevents |= POLLPRI;
+        }
+        return pevents;
+}
+
 static int internal_add (struct medusa_poll_backend *backend, struct medusa_io *io)
 {
         unsigned int events;
@@ -53,10 +71,12 @@ static int internal_add (struct medusa_poll_backend *backend, struct medusa_io *
                 goto bail;
         }
         if (internal->npfds + 1 >= internal->spfds) {
+                int spfds;
                 struct pollfd *tmp;
-                tmp = (struct pollfd *) realloc(internal->pfds, sizeof(struct pollfd) * (internal->spfds + 64));
+                spfds = MAX(internal->spfds * 2, internal->spfds + 64);
+                tmp = (struct pollfd *) realloc(internal->pfds, sizeof(struct pollfd) * spfds);
                 if (tmp == NULL) {
-                        tmp = (struct pollfd *) malloc(sizeof(struct pollfd) * (internal->spfds + 64));
+                        tmp = (struct pollfd *) malloc(sizeof(struct pollfd) * spfds);
                         if (tmp == NULL) {
                                 goto bail;
                         }
@@ -66,10 +86,12 @@ static int internal_add (struct medusa_poll_backend *backend, struct medusa_io *
                         free(internal->pfds);
                 }
                 internal->pfds = tmp;
-                internal->spfds = internal->spfds + 64;
+                internal->spfds = spfds;
         }
         if (io->fd + 1 > internal->nios) {
+                int i;
                 int nios;
+                int *slots;
                 struct medusa_io **tmp;
                 nios = MAX(io->fd + 1, internal->nios + 64);
                 tmp = (struct medusa_io **) realloc(internal->ios, sizeof(struct medusa_io *) * nios);
@@ -85,29 +107,34 @@ static int internal_add (struct medusa_poll_backend *backend, struct medusa_io *
                 }
                 memset(&tmp[internal->nios], 0, sizeof(struct medusa_io *) * (nios - internal->nios));
                 internal->ios = tmp;
+                slots = (int *) realloc(internal->slots, sizeof(int) * nios);
+                if (slots == NULL) {
+                        goto bail;
+                }
+                for (i = internal->nios; i < nios; i++) {
+                        slots[i] = -1;
+                }
+                internal->slots = slots;
                 internal->nios = nios;
         }
-        pfd = &internal->pfds[internal->npfds];
-        pfd->events = 0;
-        if (events & MEDUSA_IO_EVENT_IN) {
-                pfd->events |= POLLIN;
-        }
-        if (events & MEDUSA_IO_EVENT_OUT) {
-                pfd->events |= POLLOUT;
-        }
-        if (events & MEDUSA_IO_EVENT_PRI) {
-                pfd->events |= POLLPRI;
+        if (internal->slots[io->fd] >= 0) {
+                goto bail;
         }
-        pfd->fd = io->fd;
-        internal->ios[io->fd] = io;
+        pfd = &internal->pfds[internal->npfds];
+        pfd->fd      = io->fd;
+        pfd->events  = internal_events(events);
+        pfd->revents = 0;
+        internal->ios[io->fd]   = io;
+        internal->slots[io->fd] = internal->npfds;
         internal->npfds += 1;
+        internal->dirty = 1;
         return 0;
 bail:   return -1;
 }
 
 static int internal_mod (struct medusa_poll_backend *backend, struct medusa_io *io)
 {
-        int i;
+        short pevents;
         unsigned int events;
         struct pollfd *pfd;
         struct internal *internal = (struct internal *) backend;
@@ -117,31 +144,21 @@ static int internal_mod (struct medusa_poll_backend *backend, struct medusa_io *
         if (io == NULL) {
                 goto bail;
         }
-        if (io->fd < 0) {
+        if (io->fd < 0 || io->fd >= internal->nios) {
                 goto bail;
         }
         events = medusa_io_get_events_unlocked(io);
         if (events == 0) {
                 goto bail;
         }
-        for (i = 0; i < internal->npfds; i++) {
-                if (io->fd == internal->pfds[i].fd) {
-                        break;
-                }
-        }
-        if (i >= internal->npfds) {
+        if (internal->slots[io->fd] < 0) {
                 goto bail;
         }
-        pfd = &internal->pfds[i];
-        pfd->events = 0;
-        if (events & MEDUSA_IO_EVENT_IN) {
-                pfd->events |= POLLIN;
-        }
-        if (events & MEDUSA_IO_EVENT_OUT) {
-                pfd->events |= POLLOUT;
-        }
-        if (events & MEDUSA_IO_EVENT_PRI) {
-                pfd->events |= POLLPRI;
+        pfd = &internal->pfds[internal->slots[io->fd]];
+        pevents = internal_events(events);
+        if (pfd->events != pevents) {
+                pfd->events = pevents;
+                internal->dirty = 1;
         }
         return 0;
 bail:   return -1;
@@ -149,7 +166,7 @@ bail:   return -1;
 
 static int internal_del (struct medusa_poll_backend *backend, struct medusa_io *io)
 {
-        int i;
+        int slot;
         struct internal *internal = (struct internal *) backend;
         if (internal == NULL) {
                 goto bail;
@@ -157,20 +174,22 @@ static int internal_del (struct medusa_poll_backend *backend, struct medusa_io *
         if (io == NULL) {
                 goto bail;
         }
-        if (io->fd < 0) {
+        if (io->fd < 0 || io->fd >= internal->nios) {
                 goto bail;
         }
-        for (i = 0; i < internal->npfds; i++) {
-                if (io->fd == internal->pfds[i].fd) {
-                        break;
-                }
-        }
-        if (i >= internal->npfds) {
+        slot = internal->slots[io->fd];
+        if (slot < 0) {
                 goto bail;
         }
-        memmove(&internal->pfds[i], &internal->pfds[i + 1], sizeof(struct pollfd) * (internal->npfds - i - 1));
+        /* move the last entry into the hole, order of pollfds does not matter */
         internal->npfds -= 1;
-        internal->ios[io->fd] = NULL;
+        if (slot != internal->npfds) {
+                internal->pfds[slot] = internal->pfds[internal->npfds];
+                internal->slots[internal->pfds[slot].fd] = slot;
+        }
+        internal->ios[io->fd]   = NULL;
+        internal->slots[io->fd] = -1;
+        internal->dirty = 1;
         return 0;
 bail:   return -1;
 }
@@ -180,6 +199,7 @@ static int internal_run (struct medusa_poll_backend *backend, struct timespec *t
         int i;
         int rc;
         int count;
+        int ready;
         int timeout;
         unsigned int events;
         struct medusa_io *io;
@@ -192,10 +212,32 @@ static int internal_run (struct medusa_poll_backend *backend, struct timespec *t
         } else {
                 timeout = timespec->tv_sec * 1000 + timespec->tv_nsec / 1000000;
         }
-        for (i = 0; i < internal->npfds; i++) {
-                internal->pfds[i].revents = 0;
+        /* poll works on a private copy, so callbacks are free to add, modify,
+         * and delete ios while the results are dispatched. the copy is only
+         * refreshed when the set of ios or their events have changed */
+        if (internal->dirty) {
+                if (internal->npfds > internal->srpfds) {
+                        int srpfds;
+                        struct pollfd *tmp;
+                        srpfds = MAX(internal->npfds, internal->srpfds + 64);
+                        tmp = (struct pollfd *) realloc(internal->rpfds, sizeof(struct pollfd) * srpfds);
+                        if (tmp == NULL) {
+                                tmp = (struct pollfd *) malloc(sizeof(struct pollfd) * srpfds);
+                                if (tmp == NULL) {
+                                        goto bail;
+                                }
+                                free(internal->rpfds);
+                        }
+                        internal->rpfds = tmp;
+                        internal->srpfds = srpfds;
+                }
+                if (internal->npfds > 0) {
+                        memcpy(internal->rpfds, internal->pfds, sizeof(struct pollfd) * internal->npfds);
+                }
+                internal->nrpfds = internal->npfds;
+                internal->dirty = 0;
         }
-        count = poll(internal->pfds, internal->npfds, timeout);
+        count = poll(internal->rpfds, internal->nrpfds, timeout);
         if (count == 0) {
                 return 0;
         }
@@ -205,32 +247,11 @@ static int internal_run (struct medusa_poll_backend *backend, struct timespec *t
                 }
                 goto bail;
         }
-        if (internal->npfds > internal->srpfds) {
-                int srpfds;
-                struct pollfd *tmp;
-                /* the ready set is rebuilt from scratch on every run, so the
-                 * old entries are not preserved on the realloc fallback path */
-                srpfds = MAX(internal->npfds, internal->srpfds + 64);
-                tmp = (struct pollfd *) realloc(internal->rpfds, sizeof(struct pollfd) * srpfds);
-                if (tmp == NULL) {
-                        tmp = (struct pollfd *) malloc(sizeof(struct pollfd) * srpfds);
-                        if (tmp == NULL) {
-                                goto bail;
-                        }
-                        free(internal->rpfds);
-                }
-                internal->rpfds = tmp;
-                internal->srpfds = srpfds;
-        }
-        internal->nrpfds = 0;
-        for (i = 0; i < internal->npfds && internal->nrpfds < internal->srpfds; i++) {
-                if (internal->pfds[i].revents == 0) {
+        for (i = 0, ready = 0; i < internal->nrpfds && ready < count; i++) {
+                if (internal->rpfds[i].revents == 0) {
                         continue;
                 }
-                internal->rpfds[internal->nrpfds] = internal->pfds[i];
-                internal->nrpfds += 1;
-        }
-        for (i = 0; i < internal->nrpfds; i++) {
+                ready += 1;
                 events = 0;
                 if (internal->rpfds[i].revents & POLLIN) {
                         events |= MEDUSA_IO_EVENT_IN;
@@ -274,6 +295,9 @@ static void internal_destroy (struct medusa_poll_backend *backend)
         if (internal->ios != NULL) {
                 free(internal->ios);
         }
+        if (internal->slots != NULL) {
+                free(internal->slots);
+        }
         if (internal->rpfds != NULL) {
                 free(internal->rpfds);
         }
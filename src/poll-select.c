@@ -186,6 +186,7 @@ static int internal_run (struct medusa_poll_backend *backend, struct timespec *t
         }
         if (count < 0) {
                 if (errno == EINTR) {
+                        count = 0;
                         goto out;
                 }
                 goto bail;
@@ -0,0 +1,575 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+
+#if defined(__WINDOWS__)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#endif
+
+#include "queue.h"
+#include "pipe.h"
+#include "clock.h"
+
+#define MEDUSA_DEBUG_NAME "resolver"
+#include "debug.h"
+#include "error.h"
+#include "io.h"
+#include "io-private.h"
+#include "monitor.h"
+#include "monitor-private.h"
+#include "resolver.h"
+
+#include "subject-struct.h"
+#include "io-struct.h"
+
+#define RESOLVER_WORKERS_MAX            4
+#define RESOLVER_WORKER_IDLE_TIMEOUT    30
+#define RESOLVER_CACHE_COUNT            128
+#define RESOLVER_CACHE_TTL              30000000000ULL
+#define RESOLVER_CACHE_NEGATIVE_TTL     5000000000ULL
+
+enum {
+        RESOLVER_QUERY_STATE_QUEUED,
+        RESOLVER_QUERY_STATE_RUNNING,
+        RESOLVER_QUERY_STATE_DONE
+#define RESOLVER_QUERY_STATE_QUEUED     RESOLVER_QUERY_STATE_QUEUED
+#define RESOLVER_QUERY_STATE_RUNNING    RESOLVER_QUERY_STATE_RUNNING
+#define RESOLVER_QUERY_STATE_DONE       RESOLVER_QUERY_STATE_DONE
+};
+
+TAILQ_HEAD(medusa_resolver_lookups, medusa_resolver_lookup);
+struct medusa_resolver_lookup {
+        TAILQ_ENTRY(medusa_resolver_lookup) list;
+        struct medusa_resolver_query *query;
+        int (*onevent) (struct medusa_resolver_lookup *lookup, int error, const struct addrinfo *result, void *context);
+        void *context;
+};
+
+TAILQ_HEAD(medusa_resolver_queries, medusa_resolver_query);
+struct medusa_resolver_query {
+        TAILQ_ENTRY(medusa_resolver_query) list;
+        TAILQ_ENTRY(medusa_resolver_query) work;
+        struct medusa_resolver *resolver;
+        struct medusa_resolver_lookups lookups;
+        unsigned int state;
+        int family;
+        int socktype;
+        int error;
+        struct addrinfo *result;
+        char name[0];
+};
+
+TAILQ_HEAD(medusa_resolver_caches, medusa_resolver_cache);
+struct medusa_resolver_cache {
+        TAILQ_ENTRY(medusa_resolver_cache) list;
+        uint64_t expire;
+        int family;
+        int socktype;
+        int error;
+        struct addrinfo *result;
+        char name[0];
+};
+
+struct medusa_resolver {
+        struct medusa_monitor *monitor;
+        struct medusa_io *io;
+        int fds[2];
+        struct medusa_resolver_queries queries;
+        struct medusa_resolver_queries dones;
+        struct medusa_resolver_caches caches;
+        unsigned int ncaches;
+};
+
+/*
+ * workers are shared by every monitor in the process, queries and
+ * completions are handed over under g_mutex
+ */
+static pthread_mutex_t g_mutex                  = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_cond                    = PTHREAD_COND_INITIALIZER;
+static pthread_once_t g_once                    = PTHREAD_ONCE_INIT;
+static struct medusa_resolver_queries g_queue   = TAILQ_HEAD_INITIALIZER(g_queue);
+static unsigned int g_nqueue;
+static unsigned int g_workers;
+static unsigned int g_idles;
+
+static uint64_t resolver_now (void)
+{
+        struct timespec now;
+        medusa_clock_monotonic(&now);
+        return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static int resolver_error (int rc)
+{
+        if (rc == 0) {
+                return 0;
+        } else if (rc == EAI_NONAME) {
+                return -ENOENT;
+#if defined(EAI_NODATA) && (EAI_NODATA != EAI_NONAME)
+        } else if (rc == EAI_NODATA) {
+                return -ENOENT;
+#endif
+        } else if (rc == EAI_AGAIN) {
+                return -EAGAIN;
+        } else if (rc == EAI_MEMORY) {
+                return -ENOMEM;
+        }
+        return -EIO;
+}
+
+static void resolver_query_destroy (struct medusa_resolver_query *query)
+{
+        if (query->result != NULL) {
+                freeaddrinfo(query->result);
+        }
+        free(query);
+}
+
+static void resolver_cache_destroy (struct medusa_resolver_cache *cache)
+{
+        if (cache->result != NULL) {
+                freeaddrinfo(cache->result);
+        }
+        free(cache);
+}
+
+static void * resolver_worker (void *arg)
+{
+        int rc;
+        unsigned char byte;
+        struct timespec timeout;
+        struct addrinfo hints;
+        struct addrinfo *result;
+        struct medusa_resolver *resolver;
+        struct medusa_resolver_query *query;
+
+        (void) arg;
+
+        pthread_mutex_lock(&g_mutex);
+        while (1) {
+                query = TAILQ_FIRST(&g_queue);
+                if (query == NULL) {
+                        medusa_clock_realtime(&timeout);
+                        timeout.tv_sec += RESOLVER_WORKER_IDLE_TIMEOUT;
+                        g_idles += 1;
+                        rc = pthread_cond_timedwait(&g_cond, &g_mutex, &timeout);
+                        g_idles -= 1;
+                        if (rc == ETIMEDOUT && TAILQ_EMPTY(&g_queue)) {
+                                break;
+                        }
+                        continue;
+                }
+                TAILQ_REMOVE(&g_queue, query, work);
+                g_nqueue -= 1;
+                query->state = RESOLVER_QUERY_STATE_RUNNING;
+                pthread_mutex_unlock(&g_mutex);
+
+                memset(&hints, 0, sizeof(struct addrinfo));
+                hints.ai_family   = query->family;
+                hints.ai_socktype = query->socktype;
+                result = NULL;
+                rc = getaddrinfo(query->name, NULL, &hints, &result);
+
+                pthread_mutex_lock(&g_mutex);
+                query->state  = RESOLVER_QUERY_STATE_DONE;
+                query->error  = resolver_error(rc);
+                query->result = (rc == 0) ? result : NULL;
+                resolver = query->resolver;
+                if (resolver == NULL) {
+                        /* owner is gone while getaddrinfo was running */
+                        resolver_query_destroy(query);
+                        continue;
+                }
+                TAILQ_INSERT_TAIL(&resolver->dones, query, work);
+                byte = 1;
+#if defined(__WINDOWS__)
+                rc = send(resolver->fds[1], (void *) &byte, sizeof(byte), 0);
+#else
+                rc = write(resolver->fds[1], (void *) &byte, sizeof(byte));
+#endif
+                (void) rc;
+        }
+        g_workers -= 1;
+        pthread_mutex_unlock(&g_mutex);
+        return NULL;
+}
+
+static void resolver_atfork_prepare (void)
+{
+        pthread_mutex_lock(&g_mutex);
+}
+
+static void resolver_atfork_parent (void)
+{
+        pthread_mutex_unlock(&g_mutex);
+}
+
+static void resolver_atfork_child (void)
+{
+        /* workers do not survive fork, queued queries respawn them */
+        g_workers = 0;
+        g_idles   = 0;
+        pthread_mutex_unlock(&g_mutex);
+}
+
+static void resolver_once (void)
+{
+        pthread_atfork(resolver_atfork_prepare, resolver_atfork_parent, resolver_atfork_child);
+}
+
+static int resolver_worker_spawn (void)
+{
+        int rc;
+        pthread_t thread;
+        pthread_attr_t attr;
+#if !defined(__WINDOWS__)
+        sigset_t set;
+        sigset_t oset;
+#endif
+
+        rc = pthread_attr_init(&attr);
+        if (rc != 0) {
+                return -rc;
+        }
+        rc = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (rc != 0) {
+                pthread_attr_destroy(&attr);
+                return -rc;
+        }
+#if !defined(__WINDOWS__)
+        /* workers must not take signals meant for the monitor */
+        sigfillset(&set);
+        pthread_sigmask(SIG_SETMASK, &set, &oset);
+#endif
+        rc = pthread_create(&thread, &attr, resolver_worker, NULL);
+#if !defined(__WINDOWS__)
+        pthread_sigmask(SIG_SETMASK, &oset, NULL);
+#endif
+        pthread_attr_destroy(&attr);
+        if (rc != 0) {
+                return -rc;
+        }
+        g_workers += 1;
+        return 0;
+}
+
+static int resolver_submit (struct medusa_resolver_query *query)
+{
+        int rc;
+        pthread_once(&g_once, resolver_once);
+        pthread_mutex_lock(&g_mutex);
+        TAILQ_INSERT_TAIL(&g_queue, query, work);
+        g_nqueue += 1;
+        if (g_nqueue > g_idles &&
+            g_workers < RESOLVER_WORKERS_MAX) {
+                rc = resolver_worker_spawn();
+                if (rc < 0 && g_workers == 0) {
+                        TAILQ_REMOVE(&g_queue, query, work);
+                        g_nqueue -= 1;
+                        pthread_mutex_unlock(&g_mutex);
+                        return rc;
+                }
+        }
+        pthread_cond_signal(&g_cond);
+        pthread_mutex_unlock(&g_mutex);
+        return 0;
+}
+
+static struct medusa_resolver_cache * resolver_cache_add (struct medusa_resolver *resolver, struct medusa_resolver_query *query)
+{
+        struct medusa_resolver_cache *cache;
+        if (query->error != 0 &&
+            query->error != -ENOENT) {
+                return NULL;
+        }
+        cache = malloc(sizeof(struct medusa_resolver_cache) + strlen(query->name) + 1);
+        if (cache == NULL) {
+                return NULL;
+        }
+        cache->expire   = resolver_now() + ((query->error == 0) ? RESOLVER_CACHE_TTL : RESOLVER_CACHE_NEGATIVE_TTL);
+        cache->family   = query->family;
+        cache->socktype = query->socktype;
+        cache->error    = query->error;
+        cache->result   = query->result;
+        strcpy(cache->name, query->name);
+        query->result   = NULL;
+        if (resolver->ncaches >= RESOLVER_CACHE_COUNT) {
+                struct medusa_resolver_cache *oldest;
+                oldest = TAILQ_FIRST(&resolver->caches);
+                TAILQ_REMOVE(&resolver->caches, oldest, list);
+                resolver->ncaches -= 1;
+                resolver_cache_destroy(oldest);
+        }
+        TAILQ_INSERT_TAIL(&resolver->caches, cache, list);
+        resolver->ncaches += 1;
+        return cache;
+}
+
+static int resolver_io_onevent (struct medusa_io *io, unsigned int events, void *context, void *param)
+{
+        int rc;
+        unsigned char bytes[64];
+        const struct addrinfo *result;
+        struct medusa_resolver_cache *cache;
+        struct medusa_resolver_query *query;
+        struct medusa_resolver_lookup *lookup;
+        struct medusa_resolver_queries dones;
+        struct medusa_resolver *resolver = (struct medusa_resolver *) context;
+
+        (void) param;
+
+        if (resolver == NULL) {
+                return 0;
+        }
+        if (events & MEDUSA_IO_EVENT_IN) {
+                while (1) {
+#if defined(__WINDOWS__)
+                        rc = recv(io->fd, (void *) bytes, sizeof(bytes), 0);
+#else
+                        rc = read(io->fd, (void *) bytes, sizeof(bytes));
+#endif
+                        if (rc <= 0) {
+                                break;
+                        }
+                }
+
+                medusa_monitor_lock(resolver->monitor);
+                TAILQ_INIT(&dones);
+                pthread_mutex_lock(&g_mutex);
+                TAILQ_CONCAT(&dones, &resolver->dones, work);
+                pthread_mutex_unlock(&g_mutex);
+                while ((query = TAILQ_FIRST(&dones)) != NULL) {
+                        TAILQ_REMOVE(&dones, query, work);
+                        TAILQ_REMOVE(&resolver->queries, query, list);
+                        cache = resolver_cache_add(resolver, query);
+                        result = (cache != NULL) ? cache->result : query->result;
+                        while ((lookup = TAILQ_FIRST(&query->lookups)) != NULL) {
+                                TAILQ_REMOVE(&query->lookups, lookup, list);
+                                lookup->query = NULL;
+                                rc = lookup->onevent(lookup, query->error, result, lookup->context);
+                                if (rc < 0) {
+                                        medusa_errorf("lookup->onevent failed, rc: %d", rc);
+                                }
+                                free(lookup);
+                        }
+                        resolver_query_destroy(query);
+                }
+                medusa_monitor_unlock(resolver->monitor);
+        }
+        if (events & MEDUSA_IO_EVENT_DESTROY) {
+                medusa_monitor_lock(resolver->monitor);
+                resolver->io = NULL;
+                medusa_monitor_unlock(resolver->monitor);
+        }
+        return 0;
+}
+
+struct medusa_resolver * medusa_resolver_create_unlocked (struct medusa_monitor *monitor)
+{
+        int rc;
+        struct medusa_resolver *resolver;
+
+        if (MEDUSA_IS_ERR_OR_NULL(monitor)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+
+        resolver = malloc(sizeof(struct medusa_resolver));
+        if (resolver == NULL) {
+                return MEDUSA_ERR_PTR(-ENOMEM);
+        }
+        memset(resolver, 0, sizeof(struct medusa_resolver));
+        resolver->monitor = monitor;
+        resolver->fds[0]  = -1;
+        resolver->fds[1]  = -1;
+        TAILQ_INIT(&resolver->queries);
+        TAILQ_INIT(&resolver->dones);
+        TAILQ_INIT(&resolver->caches);
+
+        rc = medusa_pipe2(resolver->fds, MEDUSA_PIPE_FLAG_NONBLOCK);
+        if (rc < 0) {
+                goto bail;
+        }
+        resolver->io = medusa_io_create_unlocked(monitor, resolver->fds[0], resolver_io_onevent, resolver);
+        if (MEDUSA_IS_ERR_OR_NULL(resolver->io)) {
+                rc = MEDUSA_PTR_ERR(resolver->io);
+                resolver->io = NULL;
+                goto bail;
+        }
+        rc = medusa_io_set_events_unlocked(resolver->io, MEDUSA_IO_EVENT_IN);
+        if (rc < 0) {
+                goto bail;
+        }
+        rc = medusa_io_set_enabled_unlocked(resolver->io, 1);
+        if (rc < 0) {
+                goto bail;
+        }
+
+        return resolver;
+bail:   medusa_resolver_destroy_unlocked(resolver);
+        return MEDUSA_ERR_PTR(rc);
+}
+
+void medusa_resolver_destroy_unlocked (struct medusa_resolver *resolver)
+{
+        struct medusa_resolver_cache *cache;
+        struct medusa_resolver_query *query;
+        struct medusa_resolver_lookup *lookup;
+
+        if (MEDUSA_IS_ERR_OR_NULL(resolver)) {
+                return;
+        }
+
+        pthread_mutex_lock(&g_mutex);
+        while ((query = TAILQ_FIRST(&resolver->queries)) != NULL) {
+                TAILQ_REMOVE(&resolver->queries, query, list);
+                while ((lookup = TAILQ_FIRST(&query->lookups)) != NULL) {
+                        TAILQ_REMOVE(&query->lookups, lookup, list);
+                        free(lookup);
+                }
+                if (query->state == RESOLVER_QUERY_STATE_QUEUED) {
+                        TAILQ_REMOVE(&g_queue, query, work);
+                        g_nqueue -= 1;
+                        resolver_query_destroy(query);
+                } else if (query->state == RESOLVER_QUERY_STATE_RUNNING) {
+                        query->resolver = NULL;
+                } else {
+                        TAILQ_REMOVE(&resolver->dones, query, work);
+                        resolver_query_destroy(query);
+                }
+        }
+        pthread_mutex_unlock(&g_mutex);
+
+        if (resolver->io != NULL) {
+                medusa_io_set_context_unlocked(resolver->io, NULL);
+                medusa_io_destroy_unlocked(resolver->io);
+                resolver->io = NULL;
+        }
+        if (resolver->fds[0] >= 0) {
+                close(resolver->fds[0]);
+        }
+        if (resolver->fds[1] >= 0) {
+                close(resolver->fds[1]);
+        }
+        while ((cache = TAILQ_FIRST(&resolver->caches)) != NULL) {
+                TAILQ_REMOVE(&resolver->caches, cache, list);
+                resolver_cache_destroy(cache);
+        }
+        free(resolver);
+}
+
+int medusa_resolver_cached_unlocked (struct medusa_resolver *resolver, const char *name, int family, int socktype, const struct addrinfo **result)
+{
+        uint64_t now;
+        struct medusa_resolver_cache *cache;
+        struct medusa_resolver_cache *ncache;
+        if (MEDUSA_IS_ERR_OR_NULL(resolver)) {
+                return -EINVAL;
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(name)) {
+                return -EINVAL;
+        }
+        now = resolver_now();
+        TAILQ_FOREACH_SAFE(cache, &resolver->caches, list, ncache) {
+                if (medusa_time_before_eq(cache->expire, now)) {
+                        TAILQ_REMOVE(&resolver->caches, cache, list);
+                        resolver->ncaches -= 1;
+                        resolver_cache_destroy(cache);
+                        continue;
+                }
+                if (cache->family != family ||
+                    cache->socktype != socktype ||
+                    strcmp(cache->name, name) != 0) {
+                        continue;
+                }
+                if (cache->error != 0) {
+                        return cache->error;
+                }
+                if (result != NULL) {
+                        *result = cache->result;
+                }
+                return 1;
+        }
+        return 0;
+}
+
+struct medusa_resolver_lookup * medusa_resolver_lookup_unlocked (struct medusa_resolver *resolver, const char *name, int family, int socktype, int (*onevent) (struct medusa_resolver_lookup *lookup, int error, const struct addrinfo *result, void *context), void *context)
+{
+        int rc;
+        struct medusa_resolver_query *query;
+        struct medusa_resolver_lookup *lookup;
+
+        if (MEDUSA_IS_ERR_OR_NULL(resolver)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(name)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(onevent)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+
+        lookup = malloc(sizeof(struct medusa_resolver_lookup));
+        if (lookup == NULL) {
+                return MEDUSA_ERR_PTR(-ENOMEM);
+        }
+        lookup->onevent = onevent;
+        lookup->context = context;
+
+        /* join a query for the same name that is already in flight */
+        TAILQ_FOREACH(query, &resolver->queries, list) {
+                if (query->family == family &&
+                    query->socktype == socktype &&
+                    strcmp(query->name, name) == 0) {
+                        break;
+                }
+        }
+        if (query == NULL) {
+                query = malloc(sizeof(struct medusa_resolver_query) + strlen(name) + 1);
+                if (query == NULL) {
+                        free(lookup);
+                        return MEDUSA_ERR_PTR(-ENOMEM);
+                }
+                memset(query, 0, sizeof(struct medusa_resolver_query));
+                TAILQ_INIT(&query->lookups);
+                query->resolver = resolver;
+                query->state    = RESOLVER_QUERY_STATE_QUEUED;
+                query->family   = family;
+                query->socktype = socktype;
+                strcpy(query->name, name);
+                TAILQ_INSERT_TAIL(&resolver->queries, query, list);
+                rc = resolver_submit(query);
+                if (rc < 0) {
+                        TAILQ_REMOVE(&resolver->queries, query, list);
+                        free(query);
+                        free(lookup);
+                        return MEDUSA_ERR_PTR(rc);
+                }
+        }
+        lookup->query = query;
+        TAILQ_INSERT_TAIL(&query->lookups, lookup, list);
+        return lookup;
+}
+
+void medusa_resolver_lookup_cancel_unlocked (struct medusa_resolver_lookup *lookup)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(lookup)) {
+                return;
+        }
+        /* query keeps running so that its result still lands in the cache */
+        if (lookup->query != NULL) {
+                TAILQ_REMOVE(&lookup->query->lookups, lookup, list);
+        }
+        free(lookup);
+}
@@ -0,0 +1,18 @@
+
+#if !defined(MEDUSA_RESOLVER_H)
+#define MEDUSA_RESOLVER_H
+
+struct addrinfo;
+struct medusa_monitor;
+struct medusa_resolver;
+struct medusa_resolver_lookup;
+
+struct medusa_resolver * medusa_resolver_create_unlocked (struct medusa_monitor *monitor);
+void medusa_resolver_destroy_unlocked (struct medusa_resolver *resolver);
+
+int medusa_resolver_cached_unlocked (struct medusa_resolver *resolver, const char *name, int family, int socktype, const struct addrinfo **result);
+
+struct medusa_resolver_lookup * medusa_resolver_lookup_unlocked (struct medusa_resolver *resolver, const char *name, int family, int socktype, int (*onevent) (struct medusa_resolver_lookup *lookup, int error, const struct addrinfo *result, void *context), void *context);
+void medusa_resolver_lookup_cancel_unlocked (struct medusa_resolver_lookup *lookup);
+
+#endif
@@ -17,6 +17,7 @@
 #include "subject-struct.h"
 #include "signal-struct.h"
 #include "signal-private.h"
+#include "monitor-private.h"
 
 #include "signal-sigaction.h"
 
@@ -33,18 +34,39 @@ struct internal {
         struct items items;
 };
 
+#define PENDING_BITS    (sizeof(unsigned long) * 8)
+#define PENDING_WORDS   ((NSIG + PENDING_BITS - 1) / PENDING_BITS)
+
+/* the handler only touches these through atomics, no locks, no
+ * allocation. a signal arriving again before the loop picked up the
+ * first one just stays set, only the first one writes to the pipe. */
 static int g_signal_handler_wakeup_write_fd = -1;
+static unsigned long g_signal_handler_pending[PENDING_WORDS];
 static pthread_mutex_t g_signal_handler_wakeup_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 static void internal_signal_handler (int number)
 {
         int rc;
-        pthread_mutex_lock(&g_signal_handler_wakeup_mutex);
-        if (g_signal_handler_wakeup_write_fd >= 0) {
-                rc = write(g_signal_handler_wakeup_write_fd, &number, sizeof(int));
+        int fd;
+        int error;
+        unsigned long bit;
+        unsigned long pending;
+        if (number <= 0 ||
+            number >= NSIG) {
+                return;
+        }
+        bit = 1UL << (number % PENDING_BITS);
+        pending = __atomic_fetch_or(&g_signal_handler_pending[number / PENDING_BITS], bit, __ATOMIC_ACQ_REL);
+        if (pending & bit) {
+                return;
+        }
+        fd = __atomic_load_n(&g_signal_handler_wakeup_write_fd, __ATOMIC_ACQUIRE);
+        if (fd >= 0) {
+                error = errno;
+                rc = write(fd, "s", 1);
                 (void) rc;
+                errno = error;
         }
-        pthread_mutex_unlock(&g_signal_handler_wakeup_mutex);
 }
 
 static int internal_fd (struct medusa_signal_backend *backend)
@@ -68,7 +90,8 @@ static int internal_add (struct medusa_signal_backend *backend, struct medusa_si
         if (MEDUSA_IS_ERR_OR_NULL(signal)) {
                 return -EINVAL;
         }
-        if (signal->number <= 0) {
+        if (signal->number <= 0 ||
+            signal->number >= NSIG) {
                 return -EINVAL;
         }
         TAILQ_FOREACH(item, &internal->items, list) {
@@ -78,7 +101,7 @@ static int internal_add (struct medusa_signal_backend *backend, struct medusa_si
         }
         pthread_mutex_lock(&g_signal_handler_wakeup_mutex);
         if (g_signal_handler_wakeup_write_fd == -1) {
-                g_signal_handler_wakeup_write_fd = internal->sfd[1];
+                __atomic_store_n(&g_signal_handler_wakeup_write_fd, internal->sfd[1], __ATOMIC_RELEASE);
         } else if (g_signal_handler_wakeup_write_fd != internal->sfd[1]) {
                 pthread_mutex_unlock(&g_signal_handler_wakeup_mutex);
                 return -EBUSY;
@@ -111,7 +134,8 @@ static int internal_del (struct medusa_signal_backend *backend, struct medusa_si
         if (MEDUSA_IS_ERR_OR_NULL(signal)) {
                 return -EINVAL;
         }
-        if (signal->number <= 0) {
+        if (signal->number <= 0 ||
+            signal->number >= NSIG) {
                 return -EINVAL;
         }
         TAILQ_FOREACH(item, &internal->items, list) {
@@ -135,26 +159,44 @@ static int internal_run (struct medusa_signal_backend *backend)
 {
         int rc;
         int number;
+        unsigned int i;
+        unsigned long pending;
+        char bytes[64];
         struct item *item;
-        struct item *nitem;
         struct internal *internal = (struct internal *) backend;
         if (MEDUSA_IS_ERR_OR_NULL(internal)) {
                 return -EINVAL;
         }
-        rc = read(internal->sfd[0], &number, sizeof(int));
-        if (rc < 0) {
-                if (errno == EINTR) {
-                        return 0;
-                } else {
-                        return -errno;
+        while (1) {
+                rc = read(internal->sfd[0], bytes, sizeof(bytes));
+                if (rc < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        } else if (errno == EAGAIN ||
+                                   errno == EWOULDBLOCK) {
+                                break;
+                        } else {
+                                return -errno;
+                        }
+                }
+                if (rc < (int) sizeof(bytes)) {
+                        break;
                 }
         }
-        if (rc != sizeof(int)) {
-                return -EIO;
-        }
-        TAILQ_FOREACH_SAFE(item, &internal->items, list, nitem) {
-                if (item->signal->number == (int) number) {
-                        rc = medusa_signal_onevent(item->signal, MEDUSA_SIGNAL_EVENT_FIRED, NULL);
+        for (i = 0; i < PENDING_WORDS; i++) {
+                pending = __atomic_exchange_n(&g_signal_handler_pending[i], 0, __ATOMIC_ACQ_REL);
+                while (pending != 0) {
+                        number = i * PENDING_BITS + __builtin_ctzl(pending);
+                        pending &= pending - 1;
+                        TAILQ_FOREACH(item, &internal->items, list) {
+                                if (item->signal->number == number) {
+                                        break;
+                                }
+                        }
+                        if (item == NULL) {
+                                continue;
+                        }
+                        rc = medusa_monitor_onevent_unlocked(&item->signal->subject, MEDUSA_SIGNAL_EVENT_FIRED, NULL);
                         if (rc < 0) {
                                 return rc;
                         }
@@ -171,23 +213,22 @@ static void internal_destroy (struct medusa_signal_backend *backend)
         if (internal == NULL) {
                 return;
         }
+        TAILQ_FOREACH_SAFE(item, &internal->items, list, nitem) {
+                sigaction(item->signal->number, &item->sa, NULL);
+                TAILQ_REMOVE(&internal->items, item, list);
+                free(item);
+        }
         pthread_mutex_lock(&g_signal_handler_wakeup_mutex);
         if (g_signal_handler_wakeup_write_fd == internal->sfd[1]) {
-                g_signal_handler_wakeup_write_fd = -1;
+                __atomic_store_n(&g_signal_handler_wakeup_write_fd, -1, __ATOMIC_RELEASE);
         }
         pthread_mutex_unlock(&g_signal_handler_wakeup_mutex);
-        g_signal_handler_wakeup_write_fd = -1;
         if (internal->sfd[0] >= 0) {
                 close(internal->sfd[0]);
         }
         if (internal->sfd[1] >= 0) {
                 close(internal->sfd[1]);
         }
-        TAILQ_FOREACH_SAFE(item, &internal->items, list, nitem) {
-                sigaction(item->signal->number, &item->sa, NULL);
-                TAILQ_REMOVE(&internal->items, item, list);
-                free(item);
-        }
         free(internal);
 }
 
@@ -208,7 +249,9 @@ struct medusa_signal_backend * medusa_signal_sigaction_create (const struct medu
         }
         memset(internal, 0, sizeof(struct internal));
         TAILQ_INIT(&internal->items);
-        rc = medusa_pipe(internal->sfd);
+        internal->sfd[0] = -1;
+        internal->sfd[1] = -1;
+        rc = medusa_pipe2(internal->sfd, MEDUSA_PIPE_FLAG_NONBLOCK);
         if (rc < 0) {
                 pthread_mutex_unlock(&g_signal_handler_wakeup_mutex);
                 internal_destroy(&internal->backend);
@@ -220,7 +263,8 @@ struct medusa_signal_backend * medusa_signal_sigaction_create (const struct medu
         internal->backend.del     = internal_del;
         internal->backend.run     = internal_run;
         internal->backend.destroy = internal_destroy;
-        g_signal_handler_wakeup_write_fd = internal->sfd[1];
+        memset(g_signal_handler_pending, 0, sizeof(g_signal_handler_pending));
+        __atomic_store_n(&g_signal_handler_wakeup_write_fd, internal->sfd[1], __ATOMIC_RELEASE);
         pthread_mutex_unlock(&g_signal_handler_wakeup_mutex);
         return &internal->backend;
 }
@@ -6,6 +6,8 @@
 #include <fcntl.h>
 #include <signal.h>
 #include <errno.h>
+#include <time.h>
+#include <pthread.h>
 
 #include <sys/signalfd.h>
 
@@ -17,6 +19,7 @@
 #include "subject-struct.h"
 #include "signal-struct.h"
 #include "signal-private.h"
+#include "monitor-private.h"
 
 #include "signal-signalfd.h"
 
@@ -33,6 +36,88 @@ struct internal {
         struct entries entries;
 };
 
+/* signalfd only sees signals that are blocked in the reading thread.
+ * the first backend watching a number installs a handler for threads that
+ * did not block it, the handler sends it on to the thread that watches
+ * it, where it stays pending for the fd. masks of threads the library
+ * does not own are never changed. */
+static pthread_mutex_t g_stray_mutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int g_stray_refs[NSIG];
+static pthread_t g_stray_owners[NSIG];
+static struct sigaction g_stray_actions[NSIG];
+
+static void internal_stray_handler (int number, siginfo_t *info, void *context)
+{
+        int error;
+        (void) info;
+        (void) context;
+        error = errno;
+        pthread_kill(g_stray_owners[number], number);
+        errno = error;
+}
+
+static int internal_stray_get (int number)
+{
+        int rc;
+        sigset_t sigset;
+        struct sigaction sa;
+        pthread_mutex_lock(&g_stray_mutex);
+        if (g_stray_refs[number] == 0) {
+                memset(&sa, 0, sizeof(struct sigaction));
+                sa.sa_sigaction = internal_stray_handler;
+                sa.sa_flags = SA_SIGINFO | SA_RESTART;
+                rc = sigaction(number, &sa, &g_stray_actions[number]);
+                if (rc < 0) {
+                        pthread_mutex_unlock(&g_stray_mutex);
+                        return -errno;
+                }
+        }
+        g_stray_refs[number] += 1;
+        g_stray_owners[number] = pthread_self();
+        pthread_mutex_unlock(&g_stray_mutex);
+        sigemptyset(&sigset);
+        sigaddset(&sigset, number);
+        rc = pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+        if (rc != 0) {
+                return -rc;
+        }
+        return 0;
+}
+
+static void internal_stray_put (int number)
+{
+        sigset_t sigset;
+        struct timespec timespec;
+        pthread_mutex_lock(&g_stray_mutex);
+        if (g_stray_refs[number] > 0 &&
+            --g_stray_refs[number] == 0) {
+                /* consume what is still pending, unblocking would run the
+                 * default action for it */
+                sigemptyset(&sigset);
+                sigaddset(&sigset, number);
+                timespec.tv_sec  = 0;
+                timespec.tv_nsec = 0;
+                while (sigtimedwait(&sigset, NULL, &timespec) == number) {
+                }
+                sigaction(number, &g_stray_actions[number], NULL);
+                pthread_sigmask(SIG_UNBLOCK, &sigset, NULL);
+        }
+        pthread_mutex_unlock(&g_stray_mutex);
+}
+
+int medusa_signal_signalfd_sigmask_child (sigset_t *sigmask)
+{
+        int i;
+        pthread_mutex_lock(&g_stray_mutex);
+        for (i = 1; i < NSIG; i++) {
+                if (g_stray_refs[i] > 0) {
+                        sigdelset(sigmask, i);
+                }
+        }
+        pthread_mutex_unlock(&g_stray_mutex);
+        return 0;
+}
+
 static int internal_fd (struct medusa_signal_backend *backend)
 {
         struct internal *internal = (struct internal *) backend;
@@ -53,7 +138,8 @@ static int internal_add (struct medusa_signal_backend *backend, struct medusa_si
         if (MEDUSA_IS_ERR_OR_NULL(signal)) {
                 return -EINVAL;
         }
-        if (signal->number <= 0) {
+        if (signal->number <= 0 ||
+            signal->number >= NSIG) {
                 return -EINVAL;
         }
         rc = sigismember(&internal->sigset, signal->number);
@@ -62,23 +148,25 @@ static int internal_add (struct medusa_signal_backend *backend, struct medusa_si
         } else if (rc != 0) {
                 return -EEXIST;
         }
-        rc = sigaddset(&internal->sigset, signal->number);
-        if (rc < 0) {
-                return -errno;
-        }
-        rc = sigprocmask(SIG_BLOCK, &internal->sigset, NULL);
-        if (rc < 0) {
-                return -errno;
-        }
-        rc = signalfd(internal->sfd, &internal->sigset, SFD_NONBLOCK);
-        if (rc < 0) {
-                return -errno;
-        }
         entry = malloc(sizeof(struct entry));
         if (entry == NULL) {
                 return -ENOMEM;
         }
         entry->signal = signal;
+        rc = internal_stray_get(signal->number);
+        if (rc < 0) {
+                free(entry);
+                return rc;
+        }
+        sigaddset(&internal->sigset, signal->number);
+        rc = signalfd(internal->sfd, &internal->sigset, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (rc < 0) {
+                rc = -errno;
+                sigdelset(&internal->sigset, signal->number);
+                internal_stray_put(signal->number);
+                free(entry);
+                return rc;
+        }
         TAILQ_INSERT_TAIL(&internal->entries, entry, list);
         return 0;
 }
@@ -86,7 +174,6 @@ static int internal_add (struct medusa_signal_backend *backend, struct medusa_si
 static int internal_del (struct medusa_signal_backend *backend, struct medusa_signal *signal)
 {
         int rc;
-        sigset_t sigset;
         struct entry *entry;
         struct entry *nentry;
         struct internal *internal = (struct internal *) backend;
@@ -96,7 +183,8 @@ static int internal_del (struct medusa_signal_backend *backend, struct medusa_si
         if (MEDUSA_IS_ERR_OR_NULL(signal)) {
                 return -EINVAL;
         }
-        if (signal->number <= 0) {
+        if (signal->number <= 0 ||
+            signal->number >= NSIG) {
                 return -EINVAL;
         }
         rc = sigismember(&internal->sigset, signal->number);
@@ -105,23 +193,14 @@ static int internal_del (struct medusa_signal_backend *backend, struct medusa_si
         } else if (rc == 0) {
                 return -ENOENT;
         }
-        rc = signalfd(internal->sfd, &internal->sigset, 0);
+        sigdelset(&internal->sigset, signal->number);
+        rc = signalfd(internal->sfd, &internal->sigset, SFD_NONBLOCK | SFD_CLOEXEC);
         if (rc < 0) {
-                return -errno;
-        }
-        sigemptyset(&sigset);
-        rc = sigaddset(&sigset, signal->number);
-        if (rc < 0) {
-                return -errno;
-        }
-        rc = sigprocmask(SIG_UNBLOCK, &sigset, NULL);
-        if (rc < 0) {
-                return -errno;
-        }
-        rc = sigdelset(&internal->sigset, signal->number);
-        if (rc < 0) {
-                return -errno;
+                rc = -errno;
+                sigaddset(&internal->sigset, signal->number);
+                return rc;
         }
+        internal_stray_put(signal->number);
         TAILQ_FOREACH_SAFE(entry, &internal->entries, list, nentry) {
                 if (entry->signal->number == signal->number) {
                         TAILQ_REMOVE(&internal->entries, entry, list);
@@ -134,34 +213,58 @@ static int internal_del (struct medusa_signal_backend *backend, struct medusa_si
 static int internal_run (struct medusa_signal_backend *backend)
 {
         int rc;
+        int number;
+        unsigned int i;
+        sigset_t fired;
         struct entry *entry;
-        struct entry *nentry;
-        struct signalfd_siginfo signalfd_siginfo;
+        struct signalfd_siginfo signalfd_siginfos[16];
         struct internal *internal = (struct internal *) backend;
         if (MEDUSA_IS_ERR_OR_NULL(internal)) {
                 return -EINVAL;
         }
-        if (MEDUSA_IS_ERR_OR_NULL(signal)) {
-                return -EINVAL;
-        }
-        rc = read(internal->sfd, &signalfd_siginfo, sizeof(struct signalfd_siginfo));
-        if (rc < 0) {
-                if (errno == EINTR) {
-                        return 0;
-                } else {
-                        return -errno;
+        /* drain in batches, a burst of the same signal fires once */
+        sigemptyset(&fired);
+        while (1) {
+                rc = read(internal->sfd, signalfd_siginfos, sizeof(signalfd_siginfos));
+                if (rc < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        } else if (errno == EAGAIN ||
+                                   errno == EWOULDBLOCK) {
+                                break;
+                        } else {
+                                return -errno;
+                        }
+                }
+                if (rc == 0 ||
+                    (rc % sizeof(struct signalfd_siginfo)) != 0) {
+                        return -EIO;
+                }
+                for (i = 0; i < rc / sizeof(struct signalfd_siginfo); i++) {
+                        if (signalfd_siginfos[i].ssi_signo < NSIG) {
+                                sigaddset(&fired, signalfd_siginfos[i].ssi_signo);
+                        }
+                }
+                if ((size_t) rc < sizeof(signalfd_siginfos)) {
+                        break;
                 }
         }
-        if (rc != sizeof(struct signalfd_siginfo)) {
-                return -EIO;
-        }
-        TAILQ_FOREACH_SAFE(entry, &internal->entries, list, nentry) {
-                if (entry->signal->number == (int) signalfd_siginfo.ssi_signo) {
-                        rc = medusa_signal_onevent(entry->signal, MEDUSA_SIGNAL_EVENT_FIRED, NULL);
-                        if (rc < 0) {
-                                return rc;
+        for (number = 1; number < NSIG; number++) {
+                if (sigismember(&fired, number) != 1) {
+                        continue;
+                }
+                TAILQ_FOREACH(entry, &internal->entries, list) {
+                        if (entry->signal->number == number) {
+                                break;
                         }
                 }
+                if (entry == NULL) {
+                        continue;
+                }
+                rc = medusa_monitor_onevent_unlocked(&entry->signal->subject, MEDUSA_SIGNAL_EVENT_FIRED, NULL);
+                if (rc < 0) {
+                        return rc;
+                }
         }
         return 0;
 }
@@ -178,6 +281,7 @@ static void internal_destroy (struct medusa_signal_backend *backend)
                 close(internal->sfd);
         }
         TAILQ_FOREACH_SAFE(entry, &internal->entries, list, nentry) {
+                internal_stray_put(entry->signal->number);
                 TAILQ_REMOVE(&internal->entries, entry, list);
                 free(entry);
         }
@@ -191,18 +295,16 @@ struct medusa_signal_backend * medusa_signal_signalfd_create (const struct medus
         (void) options;
         internal = (struct internal *) malloc(sizeof(struct internal));
         if (internal == NULL) {
-                goto bail;
+                return MEDUSA_ERR_PTR(-ENOMEM);
         }
         memset(internal, 0, sizeof(struct internal));
         TAILQ_INIT(&internal->entries);
         sigemptyset(&internal->sigset);
-        rc = sigprocmask(SIG_BLOCK, &internal->sigset, NULL);
-        if (rc < 0) {
-                return MEDUSA_ERR_PTR(-errno);
-        }
-        internal->sfd = signalfd(-1, &internal->sigset, SFD_NONBLOCK);
+        internal->sfd = signalfd(-1, &internal->sigset, SFD_NONBLOCK | SFD_CLOEXEC);
         if (internal->sfd < 0) {
-                goto bail;
+                rc = -errno;
+                internal_destroy(&internal->backend);
+                return MEDUSA_ERR_PTR(rc);
         }
         internal->backend.name    = "signalfd";
         internal->backend.fd      = internal_fd;
@@ -211,8 +313,4 @@ struct medusa_signal_backend * medusa_signal_signalfd_create (const struct medus
         internal->backend.run     = internal_run;
         internal->backend.destroy = internal_destroy;
         return &internal->backend;
-bail:   if (internal != NULL) {
-                internal_destroy(&internal->backend);
-        }
-        return NULL;
 }
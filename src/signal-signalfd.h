@@ -8,4 +8,7 @@ struct medusa_signal_signalfd_init_options {
 
 struct medusa_signal_backend * medusa_signal_signalfd_create (const struct medusa_signal_signalfd_init_options *options);
 
+/* drops the signals signalfd backends block from a child process mask */
+int medusa_signal_signalfd_sigmask_child (sigset_t *sigmask);
+
 #endif
@@ -611,8 +611,25 @@ __attribute__ ((visibility ("default"))) const char * medusa_signal_event_string
         return "MEDUSA_SIGNAL_EVENT_UNKNOWN";
 }
 
+static int signal_subject_onevent (struct medusa_subject *subject, unsigned int events, void *param)
+{
+        return medusa_signal_onevent_unlocked((struct medusa_signal *) subject, events, param);
+}
+
+static int signal_subject_destroy (struct medusa_subject *subject)
+{
+        return medusa_signal_onevent_unlocked((struct medusa_signal *) subject, MEDUSA_SIGNAL_EVENT_DESTROY, NULL);
+}
+
+static const struct medusa_subject_type g_subject_type = {
+        .rank    = MEDUSA_SUBJECT_RANK_BASE,
+        .onevent = signal_subject_onevent,
+        .destroy = signal_subject_destroy
+};
+
 __attribute__ ((constructor)) static void signal_constructor (void)
 {
+        medusa_monitor_register_subject_type(MEDUSA_SUBJECT_TYPE_SIGNAL, &g_subject_type);
 #if defined(MEDUSA_SIGNAL_USE_POOL) && (MEDUSA_SIGNAL_USE_POOL == 1)
         g_pool = medusa_pool_create("medusa-signal", sizeof(struct medusa_signal), 0, 0, MEDUSA_POOL_FLAG_DEFAULT | MEDUSA_POOL_FLAG_THREAD_SAFE, NULL, NULL, NULL);
 #endif
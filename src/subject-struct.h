@@ -33,7 +33,8 @@ enum {
         MEDUSA_SUBJECT_TYPE_WEBSOCKETSERVER             = 13,
         MEDUSA_SUBJECT_TYPE_WEBSOCKETSERVER_CLIENT      = 14,
         MEDUSA_SUBJECT_TYPE_HTTPSERVER                  = 15,
-        MEDUSA_SUBJECT_TYPE_HTTPSERVER_CLIENT           = 16
+        MEDUSA_SUBJECT_TYPE_HTTPSERVER_CLIENT           = 16,
+        MEDUSA_SUBJECT_TYPE_HTTPCLIENT                  = 17
 #define MEDUSA_SUBJECT_TYPE_UNKNOWN                     MEDUSA_SUBJECT_TYPE_UNKNOWN
 #define MEDUSA_SUBJECT_TYPE_IO                          MEDUSA_SUBJECT_TYPE_IO
 #define MEDUSA_SUBJECT_TYPE_TIMER                       MEDUSA_SUBJECT_TYPE_TIMER
@@ -51,14 +52,57 @@ enum {
 #define MEDUSA_SUBJECT_TYPE_WEBSOCKETSERVER_CLIENT      MEDUSA_SUBJECT_TYPE_WEBSOCKETSERVER_CLIENT
 #define MEDUSA_SUBJECT_TYPE_HTTPSERVER                  MEDUSA_SUBJECT_TYPE_HTTPSERVER
 #define MEDUSA_SUBJECT_TYPE_HTTPSERVER_CLIENT           MEDUSA_SUBJECT_TYPE_HTTPSERVER_CLIENT
+#define MEDUSA_SUBJECT_TYPE_HTTPCLIENT                  MEDUSA_SUBJECT_TYPE_HTTPCLIENT
+};
+
+enum {
+        MEDUSA_SUBJECT_RANK_HTTPSERVER_CLIENT           = 0,
+        MEDUSA_SUBJECT_RANK_HTTPSERVER                  = 1,
+        MEDUSA_SUBJECT_RANK_WEBSOCKETCLIENT             = 2,
+        MEDUSA_SUBJECT_RANK_WEBSOCKETSERVER_CLIENT      = 3,
+        MEDUSA_SUBJECT_RANK_WEBSOCKETSERVER             = 4,
+        MEDUSA_SUBJECT_RANK_HTTPREQUEST                 = 5,
+        MEDUSA_SUBJECT_RANK_HTTPCLIENT                  = 6,
+        MEDUSA_SUBJECT_RANK_DNSRESOLVER_LOOKUP          = 7,
+        MEDUSA_SUBJECT_RANK_DNSRESOLVER                 = 8,
+        MEDUSA_SUBJECT_RANK_DNSREQUEST                  = 9,
+        MEDUSA_SUBJECT_RANK_EXEC                        = 10,
+        MEDUSA_SUBJECT_RANK_TCPSOCKET                   = 11,
+        MEDUSA_SUBJECT_RANK_UDPSOCKET                   = 12,
+        MEDUSA_SUBJECT_RANK_BASE                        = 13,
+        MEDUSA_SUBJECT_RANK_COUNT                       = 14
+#define MEDUSA_SUBJECT_RANK_HTTPSERVER_CLIENT           MEDUSA_SUBJECT_RANK_HTTPSERVER_CLIENT
+#define MEDUSA_SUBJECT_RANK_HTTPSERVER                  MEDUSA_SUBJECT_RANK_HTTPSERVER
+#define MEDUSA_SUBJECT_RANK_WEBSOCKETCLIENT             MEDUSA_SUBJECT_RANK_WEBSOCKETCLIENT
+#define MEDUSA_SUBJECT_RANK_WEBSOCKETSERVER_CLIENT      MEDUSA_SUBJECT_RANK_WEBSOCKETSERVER_CLIENT
+#define MEDUSA_SUBJECT_RANK_WEBSOCKETSERVER             MEDUSA_SUBJECT_RANK_WEBSOCKETSERVER
+#define MEDUSA_SUBJECT_RANK_HTTPREQUEST                 MEDUSA_SUBJECT_RANK_HTTPREQUEST
+#define MEDUSA_SUBJECT_RANK_HTTPCLIENT                  MEDUSA_SUBJECT_RANK_HTTPCLIENT
+#define MEDUSA_SUBJECT_RANK_DNSRESOLVER_LOOKUP          MEDUSA_SUBJECT_RANK_DNSRESOLVER_LOOKUP
+#define MEDUSA_SUBJECT_RANK_DNSRESOLVER                 MEDUSA_SUBJECT_RANK_DNSRESOLVER
+#define MEDUSA_SUBJECT_RANK_DNSREQUEST                  MEDUSA_SUBJECT_RANK_DNSREQUEST
+#define MEDUSA_SUBJECT_RANK_EXEC                        MEDUSA_SUBJECT_RANK_EXEC
+#define MEDUSA_SUBJECT_RANK_TCPSOCKET                   MEDUSA_SUBJECT_RANK_TCPSOCKET
+#define MEDUSA_SUBJECT_RANK_UDPSOCKET                   MEDUSA_SUBJECT_RANK_UDPSOCKET
+#define MEDUSA_SUBJECT_RANK_BASE                        MEDUSA_SUBJECT_RANK_BASE
+#define MEDUSA_SUBJECT_RANK_COUNT                       MEDUSA_SUBJECT_RANK_COUNT
 };
 
 TAILQ_HEAD(medusa_subjects, medusa_subject);
+
+/* registered once per subject type; deleted subjects are destroyed in
+ * rank order, so owners go before the subjects they own. */
+struct medusa_subject_type {
+        unsigned int rank;
+        int (*onevent) (struct medusa_subject *subject, unsigned int events, void *param);
+        int (*destroy) (struct medusa_subject *subject);
+};
 struct medusa_subject {
         TAILQ_ENTRY(medusa_subject) hook;
         TAILQ_ENTRY(medusa_subject) list;
         unsigned int flags;
         struct medusa_monitor *monitor;
+        TAILQ_ENTRY(medusa_subject) change;
 };
 
 static inline void medusa_subject_set_type (struct medusa_subject *subject, unsigned int type)
@@ -49,9 +49,32 @@ int medusa_tcpsocket_get_reuseport_unlocked (const struct medusa_tcpsocket *tcps
 int medusa_tcpsocket_set_freebind_unlocked (struct medusa_tcpsocket *tcpsocket, int enabled);
 int medusa_tcpsocket_get_freebind_unlocked (const struct medusa_tcpsocket *tcpsocket);
 
+int medusa_tcpsocket_set_fastopen_unlocked (struct medusa_tcpsocket *tcpsocket, int queue);
+int medusa_tcpsocket_get_fastopen_unlocked (const struct medusa_tcpsocket *tcpsocket);
+
+int medusa_tcpsocket_set_defer_accept_unlocked (struct medusa_tcpsocket *tcpsocket, int seconds);
+int medusa_tcpsocket_get_defer_accept_unlocked (const struct medusa_tcpsocket *tcpsocket);
+
+int medusa_tcpsocket_set_incoming_cpu_unlocked (struct medusa_tcpsocket *tcpsocket, int cpu);
+int medusa_tcpsocket_get_incoming_cpu_unlocked (const struct medusa_tcpsocket *tcpsocket);
+
+int medusa_tcpsocket_set_notsent_lowat_unlocked (struct medusa_tcpsocket *tcpsocket, int bytes);
+int medusa_tcpsocket_get_notsent_lowat_unlocked (const struct medusa_tcpsocket *tcpsocket);
+
 int medusa_tcpsocket_set_backlog_unlocked (struct medusa_tcpsocket *tcpsocket, int backlog);
 int medusa_tcpsocket_get_backlog_unlocked (const struct medusa_tcpsocket *tcpsocket);
 
+int medusa_tcpsocket_set_accept_batch_unlocked (struct medusa_tcpsocket *tcpsocket, int batch);
+int medusa_tcpsocket_get_accept_batch_unlocked (const struct medusa_tcpsocket *tcpsocket);
+
+int medusa_tcpsocket_set_max_connections_unlocked (struct medusa_tcpsocket *tcpsocket, int max_connections);
+int medusa_tcpsocket_get_max_connections_unlocked (const struct medusa_tcpsocket *tcpsocket);
+
+int medusa_tcpsocket_set_accept_rate_unlocked (struct medusa_tcpsocket *tcpsocket, double rate, int burst);
+double medusa_tcpsocket_get_accept_rate_unlocked (const struct medusa_tcpsocket *tcpsocket);
+
+int medusa_tcpsocket_get_accept_stats_unlocked (const struct medusa_tcpsocket *tcpsocket, struct medusa_tcpsocket_accept_stats *stats);
+
 int medusa_tcpsocket_set_resolve_timeout_unlocked (struct medusa_tcpsocket *tcpsocket, double timeout);
 double medusa_tcpsocket_get_resolve_timeout_unlocked (const struct medusa_tcpsocket *tcpsocket);
 
@@ -101,6 +124,16 @@ int medusa_tcpsocket_add_events_unlocked (struct medusa_tcpsocket *tcpsocket, un
 int medusa_tcpsocket_del_events_unlocked (struct medusa_tcpsocket *tcpsocket, unsigned int events);
 unsigned int medusa_tcpsocket_get_events_unlocked (const struct medusa_tcpsocket *tcpsocket);
 
+int medusa_tcpsocket_pipe_unlocked (struct medusa_tcpsocket *tcpsocket, struct medusa_tcpsocket *peer, const struct medusa_tcpsocket_pipe_options *options);
+int medusa_tcpsocket_unpipe_unlocked (struct medusa_tcpsocket *tcpsocket);
+int medusa_tcpsocket_get_piped_unlocked (const struct medusa_tcpsocket *tcpsocket);
+int medusa_tcpsocket_get_pipe_stats_unlocked (const struct medusa_tcpsocket *tcpsocket, struct medusa_tcpsocket_pipe_stats *stats);
+
+int medusa_tcpsocket_set_stats_enabled_unlocked (struct medusa_tcpsocket *tcpsocket, int enabled);
+int medusa_tcpsocket_get_stats_enabled_unlocked (const struct medusa_tcpsocket *tcpsocket);
+int medusa_tcpsocket_get_stats_unlocked (const struct medusa_tcpsocket *tcpsocket, struct medusa_tcpsocket_stats *stats);
+int medusa_tcpsocket_stats_merge (struct medusa_tcpsocket_stats *total, const struct medusa_tcpsocket_stats *stats);
+
 int medusa_tcpsocket_get_protocol_unlocked (struct medusa_tcpsocket *tcpsocket);
 int medusa_tcpsocket_get_sockport_unlocked (struct medusa_tcpsocket *tcpsocket);
 int medusa_tcpsocket_get_sockname_unlocked (struct medusa_tcpsocket *tcpsocket, struct sockaddr_storage *sockaddr);
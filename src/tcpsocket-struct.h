@@ -2,6 +2,22 @@
 #if !defined(MEDUSA_TCPSOCKET_STRUCT_H)
 #define MEDUSA_TCPSOCKET_STRUCT_H
 
+struct tcpsocket_stats {
+        int64_t received;
+        int64_t sent;
+        int64_t recv_calls;
+        int64_t send_calls;
+        int64_t recv_eagain;
+        int64_t send_eagain;
+        int64_t wbuffer_highwater;
+        uint64_t wpending;
+        uint64_t wpending_since;
+        uint64_t connect;
+        uint64_t connect_since;
+        uint64_t handshake;
+        uint64_t handshake_since;
+};
+
 struct medusa_tcpsocket {
         struct medusa_subject subject;
         int (*onevent) (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param);
@@ -10,9 +26,17 @@ struct medusa_tcpsocket {
         unsigned int state;
         unsigned int error;
         int backlog;
+        int fastopen;
+        int defer_accept;
+        int incoming_cpu;
+        int notsent_lowat;
         struct medusa_io *io;
         struct medusa_tcpsocket_connect_options *coptions;
         struct medusa_dnsresolver_lookup *clookup;
+        struct medusa_resolver_lookup *rlookup;
+        struct tcpsocket_race *race;
+        struct tcpsocket_listener *listener;
+        struct tcpsocket_fastopen *fastopen_pending;
         struct medusa_timer *ltimer;
         struct medusa_timer *ctimer;
         struct medusa_timer *rtimer;
@@ -21,6 +45,10 @@ struct medusa_tcpsocket {
         struct medusa_buffer *rbuffer;
         int wbuffer_limit;
         int rbuffer_limit;
+        struct tcpsocket_pipe *pipe;
+        int64_t pipe_received;
+        int64_t pipe_sent;
+        struct tcpsocket_stats stats;
 #if defined(MEDUSA_TCPSOCKET_OPENSSL_ENABLE) && (MEDUSA_TCPSOCKET_OPENSSL_ENABLE == 1)
         SSL *ssl;
         SSL_CTX *ssl_ctx;
@@ -1,4 +1,5 @@
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -34,6 +35,7 @@
 
 #include "debug.h"
 #include "error.h"
+#include "clock.h"
 #include "pool.h"
 #include "queue.h"
 #include "iovec.h"
@@ -45,6 +47,8 @@
 #include "timer-private.h"
 #include "dnsresolver.h"
 #include "dnsresolver-private.h"
+#include "resolver.h"
+#include "pipe.h"
 #include "tcpsocket.h"
 #include "tcpsocket-private.h"
 #include "tcpsocket-struct.h"
@@ -57,6 +61,8 @@
 
 #define MEDUSA_TCPSOCKET_DEFAULT_BACKLOG        128
 #define MEDUSA_TCPSOCKET_DEFAULT_IOVECS         4
+#define MEDUSA_TCPSOCKET_DEFAULT_PIPE_SIZE      (64 * 1024)
+#define MEDUSA_TCPSOCKET_RESOLUTION_DELAY       0.050
 
 enum {
         MEDUSA_TCPSOCKET_FLAG_NONE              = (1 <<  0),
@@ -77,7 +83,8 @@ enum {
         MEDUSA_TCPSOCKET_FLAG_SSL_CTX_EXTERNAL  = (1 << 15),
         MEDUSA_TCPSOCKET_FLAG_SSL_EXTERNAL      = (1 << 16),
         MEDUSA_TCPSOCKET_FLAG_SSL_VERIFY        = (1 << 17),
-        MEDUSA_TCPSOCKET_FLAG_SSL_STATE_OK      = (1 << 18)
+        MEDUSA_TCPSOCKET_FLAG_SSL_STATE_OK      = (1 << 18),
+        MEDUSA_TCPSOCKET_FLAG_STATS             = (1 << 19)
 #define MEDUSA_TCPSOCKET_FLAG_NONE              MEDUSA_TCPSOCKET_FLAG_NONE
 #define MEDUSA_TCPSOCKET_FLAG_BIND              MEDUSA_TCPSOCKET_FLAG_BIND
 #define MEDUSA_TCPSOCKET_FLAG_ACCEPT            MEDUSA_TCPSOCKET_FLAG_ACCEPT
@@ -97,6 +104,7 @@ enum {
 #define MEDUSA_TCPSOCKET_FLAG_SSL_EXTERNAL      MEDUSA_TCPSOCKET_FLAG_SSL_EXTERNAL
 #define MEDUSA_TCPSOCKET_FLAG_SSL_VERIFY        MEDUSA_TCPSOCKET_FLAG_SSL_VERIFY
 #define MEDUSA_TCPSOCKET_FLAG_SSL_STATE_OK      MEDUSA_TCPSOCKET_FLAG_SSL_STATE_OK
+#define MEDUSA_TCPSOCKET_FLAG_STATS             MEDUSA_TCPSOCKET_FLAG_STATS
 };
 
 #if defined(MEDUSA_TCPSOCKET_USE_POOL) && (MEDUSA_TCPSOCKET_USE_POOL == 1)
@@ -165,7 +173,7 @@ bail:   if (tcpsocket_addrinfo_entry != NULL) {
         return NULL;
 }
 
-static struct tcpsocket_addrinfo_entry * tcpsocket_addrinfo_entry_create_from_addrinfo (struct addrinfo *entry)
+static struct tcpsocket_addrinfo_entry * tcpsocket_addrinfo_entry_create_from_addrinfo (const struct addrinfo *entry)
 {
         struct tcpsocket_addrinfo_entry *tcpsocket_addrinfo_entry;
 
@@ -256,10 +264,10 @@ bail:   if (tcpsocket_addrinfo != NULL) {
         return NULL;
 }
 
-static struct tcpsocket_addrinfo * tcpsocket_addrinfo_create_from_addrinfo (struct addrinfo *addrinfo)
+static struct tcpsocket_addrinfo * tcpsocket_addrinfo_create_from_addrinfo (const struct addrinfo *addrinfo)
 {
         int rc;
-        struct addrinfo *entry;
+        const struct addrinfo *entry;
         struct tcpsocket_addrinfo *tcpsocket_addrinfo;
         struct tcpsocket_addrinfo_entry *tcpsocket_addrinfo_entry;
 
@@ -289,6 +297,26 @@ bail:   if (tcpsocket_addrinfo != NULL) {
         return NULL;
 }
 
+struct tcpsocket_pipe_direction {
+        struct medusa_tcpsocket *source;
+        struct medusa_tcpsocket *destination;
+        int fds[2];
+        int64_t capacity;
+        int64_t pending;
+        int eof;
+        int shutdown;
+};
+
+struct tcpsocket_pipe {
+        struct tcpsocket_pipe_direction directions[2];
+        int half_close;
+        struct medusa_tcpsocket *failed;
+        int error;
+};
+
+static int tcpsocket_pipe_commit (struct tcpsocket_pipe *pipe);
+static int tcpsocket_pipe_release (struct tcpsocket_pipe *pipe, int restore);
+
 static inline void tcpsocket_closesocket (int fd)
 {
 #if defined(__WINDOWS__)
@@ -298,6 +326,58 @@ static inline void tcpsocket_closesocket (int fd)
 #endif
 }
 
+struct tcpsocket_race_attempt {
+        struct medusa_io *io;
+        struct tcpsocket_race *race;
+        TAILQ_ENTRY(tcpsocket_race_attempt) tailq;
+};
+TAILQ_HEAD(tcpsocket_race_attempts, tcpsocket_race_attempt);
+
+struct tcpsocket_race {
+        struct medusa_tcpsocket *tcpsocket;
+        struct tcpsocket_addrinfo entries;
+        struct tcpsocket_race_attempts attempts;
+        struct medusa_timer *timer;
+        unsigned int protocol;
+        int started;
+        int resolving;
+        int error;
+};
+
+static void tcpsocket_race_attempt_destroy (struct tcpsocket_race_attempt *attempt)
+{
+        if (attempt == NULL) {
+                return;
+        }
+        if (!MEDUSA_IS_ERR_OR_NULL(attempt->io)) {
+                medusa_io_set_context_unlocked(attempt->io, NULL);
+                medusa_io_destroy_unlocked(attempt->io);
+        }
+        free(attempt);
+}
+
+static void tcpsocket_race_destroy (struct tcpsocket_race *race)
+{
+        struct tcpsocket_race_attempt *attempt;
+        struct tcpsocket_addrinfo_entry *addrinfo_entry;
+        if (race == NULL) {
+                return;
+        }
+        while ((attempt = TAILQ_FIRST(&race->attempts)) != NULL) {
+                TAILQ_REMOVE(&race->attempts, attempt, tailq);
+                tcpsocket_race_attempt_destroy(attempt);
+        }
+        while ((addrinfo_entry = TAILQ_FIRST(&race->entries)) != NULL) {
+                TAILQ_REMOVE(&race->entries, addrinfo_entry, tailq);
+                tcpsocket_addrinfo_entry_destroy(addrinfo_entry);
+        }
+        if (!MEDUSA_IS_ERR_OR_NULL(race->timer)) {
+                medusa_timer_set_context_unlocked(race->timer, NULL);
+                medusa_timer_destroy_unlocked(race->timer);
+        }
+        free(race);
+}
+
 static inline void tcpsocket_set_flag (struct medusa_tcpsocket *tcpsocket, unsigned int flag)
 {
         tcpsocket->flags = flag;
@@ -323,12 +403,386 @@ static inline int tcpsocket_get_buffered (const struct medusa_tcpsocket *tcpsock
         return tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BUFFERED);
 }
 
+static inline uint64_t tcpsocket_stats_clock (void)
+{
+        struct timespec timespec;
+        if (medusa_clock_monotonic(&timespec) != 0) {
+                return 0;
+        }
+        return ((uint64_t) timespec.tv_sec) * 1000000000ULL + (uint64_t) timespec.tv_nsec;
+}
+
+/* length is what recv() or send() returned, errno is looked at on failure */
+
+static inline void tcpsocket_stats_recv (struct medusa_tcpsocket *tcpsocket, int64_t length)
+{
+        if (!tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_STATS)) {
+                return;
+        }
+        tcpsocket->stats.recv_calls += 1;
+        if (length > 0) {
+                tcpsocket->stats.received += length;
+        } else if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                tcpsocket->stats.recv_eagain += 1;
+        }
+}
+
+/* spliced bytes never reach user space, only the byte counters move */
+static inline void tcpsocket_stats_splice (struct medusa_tcpsocket *tcpsocket, int64_t received, int64_t sent)
+{
+        if (!tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_STATS)) {
+                return;
+        }
+        tcpsocket->stats.received += received;
+        tcpsocket->stats.sent     += sent;
+}
+
+static inline void tcpsocket_stats_send (struct medusa_tcpsocket *tcpsocket, int64_t length)
+{
+        if (!tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_STATS)) {
+                return;
+        }
+        tcpsocket->stats.send_calls += 1;
+        if (length > 0) {
+                tcpsocket->stats.sent += length;
+        } else if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                tcpsocket->stats.send_eagain += 1;
+        }
+}
+
+/* write pending is the time the write buffer holds data, which is the time
+ * out interest is armed for a buffered socket */
+static inline void tcpsocket_stats_wbuffer (struct medusa_tcpsocket *tcpsocket, int64_t length)
+{
+        if (!tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_STATS)) {
+                return;
+        }
+        if (length > tcpsocket->stats.wbuffer_highwater) {
+                tcpsocket->stats.wbuffer_highwater = length;
+        }
+        if (length > 0) {
+                if (tcpsocket->stats.wpending_since == 0) {
+                        tcpsocket->stats.wpending_since = tcpsocket_stats_clock();
+                }
+        } else if (tcpsocket->stats.wpending_since != 0) {
+                tcpsocket->stats.wpending += tcpsocket_stats_clock() - tcpsocket->stats.wpending_since;
+                tcpsocket->stats.wpending_since = 0;
+        }
+}
+
+static inline void tcpsocket_stats_handshake_start (struct medusa_tcpsocket *tcpsocket)
+{
+        if (!tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_STATS)) {
+                return;
+        }
+        if (tcpsocket->stats.handshake_since == 0) {
+                tcpsocket->stats.handshake_since = tcpsocket_stats_clock();
+        }
+}
+
+static inline void tcpsocket_stats_handshake_done (struct medusa_tcpsocket *tcpsocket)
+{
+        if (!tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_STATS)) {
+                return;
+        }
+        if (tcpsocket->stats.handshake_since != 0) {
+                tcpsocket->stats.handshake = tcpsocket_stats_clock() - tcpsocket->stats.handshake_since;
+                tcpsocket->stats.handshake_since = 0;
+        }
+}
+
+static inline void tcpsocket_stats_state (struct medusa_tcpsocket *tcpsocket, unsigned int state)
+{
+        if (!tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_STATS)) {
+                return;
+        }
+        /* connect time runs from the first attempt, races included */
+        if (state == MEDUSA_TCPSOCKET_STATE_CONNECTING) {
+                if (tcpsocket->stats.connect_since == 0) {
+                        tcpsocket->stats.connect_since = tcpsocket_stats_clock();
+                }
+        } else if (state == MEDUSA_TCPSOCKET_STATE_CONNECTED) {
+                if (tcpsocket->stats.connect_since != 0) {
+                        tcpsocket->stats.connect = tcpsocket_stats_clock() - tcpsocket->stats.connect_since;
+                        tcpsocket->stats.connect_since = 0;
+                }
+        } else {
+                tcpsocket->stats.connect_since   = 0;
+                tcpsocket->stats.handshake_since = 0;
+                tcpsocket_stats_wbuffer(tcpsocket, 0);
+        }
+}
+
+/* accept state of a listener, shared with the sockets it accepted so they
+ * can give their slot back when they close. it is freed when the listener
+ * and all of its accepted sockets are gone. */
+
+enum {
+        TCPSOCKET_LISTENER_PAUSED_LIMIT = (1 << 0),
+        TCPSOCKET_LISTENER_PAUSED_RATE  = (1 << 1)
+};
+
+struct tcpsocket_listener {
+        struct medusa_tcpsocket *tcpsocket;
+        int refcount;
+        int batch;
+        int pending;
+        int pending_nonblocking;
+        int max_connections;
+        double rate;
+        int burst;
+        double tokens;
+        uint64_t refilled;
+        unsigned int paused;
+        struct medusa_timer *timer;
+        struct medusa_tcpsocket_accept_stats stats;
+};
+
+static void tcpsocket_listener_put (struct tcpsocket_listener *listener)
+{
+        listener->refcount -= 1;
+        if (listener->refcount > 0) {
+                return;
+        }
+        if (listener->pending >= 0) {
+                tcpsocket_closesocket(listener->pending);
+        }
+        free(listener);
+}
+
+static struct tcpsocket_listener * tcpsocket_listener_get (struct medusa_tcpsocket *tcpsocket)
+{
+        struct tcpsocket_listener *listener;
+        if (tcpsocket->listener != NULL) {
+                return tcpsocket->listener;
+        }
+        listener = malloc(sizeof(struct tcpsocket_listener));
+        if (listener == NULL) {
+                return MEDUSA_ERR_PTR(-ENOMEM);
+        }
+        memset(listener, 0, sizeof(struct tcpsocket_listener));
+        listener->tcpsocket = tcpsocket;
+        listener->refcount  = 1;
+        listener->pending   = -1;
+        tcpsocket->listener = listener;
+        return listener;
+}
+
+static int tcpsocket_listener_pause (struct tcpsocket_listener *listener, unsigned int reason)
+{
+        int rc;
+        if (listener->paused & reason) {
+                return 0;
+        }
+        if (reason == TCPSOCKET_LISTENER_PAUSED_LIMIT) {
+                listener->stats.limited += 1;
+        } else {
+                listener->stats.ratelimited += 1;
+        }
+        if (listener->paused == 0 &&
+            !MEDUSA_IS_ERR_OR_NULL(listener->tcpsocket->io)) {
+                rc = medusa_io_del_events_unlocked(listener->tcpsocket->io, MEDUSA_IO_EVENT_IN);
+                if (rc < 0) {
+                        return rc;
+                }
+        }
+        listener->paused |= reason;
+        return 0;
+}
+
+static int tcpsocket_listener_resume (struct tcpsocket_listener *listener, unsigned int reason)
+{
+        if (!(listener->paused & reason)) {
+                return 0;
+        }
+        listener->paused &= ~reason;
+        if (listener->paused == 0 &&
+            listener->tcpsocket != NULL &&
+            !MEDUSA_IS_ERR_OR_NULL(listener->tcpsocket->io)) {
+                return medusa_io_add_events_unlocked(listener->tcpsocket->io, MEDUSA_IO_EVENT_IN);
+        }
+        return 0;
+}
+
+static void tcpsocket_listener_refill (struct tcpsocket_listener *listener)
+{
+        uint64_t now;
+        now = tcpsocket_stats_clock();
+        if (listener->refilled != 0) {
+                listener->tokens += listener->rate * ((now - listener->refilled) / 1e9);
+        }
+        if (listener->tokens > listener->burst) {
+                listener->tokens = listener->burst;
+        }
+        listener->refilled = now;
+}
+
+static int tcpsocket_listener_timer_onevent (struct medusa_timer *timer, unsigned int events, void *context, void *param)
+{
+        int rc;
+        struct medusa_monitor *monitor;
+        struct tcpsocket_listener *listener = (struct tcpsocket_listener *) context;
+
+        (void) param;
+
+        if (events & MEDUSA_TIMER_EVENT_TIMEOUT) {
+                monitor = medusa_timer_get_monitor(timer);
+                medusa_monitor_lock(monitor);
+                if (listener == NULL) {
+                        medusa_monitor_unlock(monitor);
+                        return 0;
+                }
+                rc = tcpsocket_listener_resume(listener, TCPSOCKET_LISTENER_PAUSED_RATE);
+                medusa_monitor_unlock(monitor);
+                return rc;
+        }
+        return 0;
+}
+
+/* returns 1 when one more connection may be accepted, 0 when the listener
+ * was paused instead */
+static int tcpsocket_listener_admit (struct tcpsocket_listener *listener)
+{
+        int rc;
+        if (listener->max_connections > 0 &&
+            listener->stats.connections >= listener->max_connections) {
+                rc = tcpsocket_listener_pause(listener, TCPSOCKET_LISTENER_PAUSED_LIMIT);
+                return (rc < 0) ? rc : 0;
+        }
+        if (listener->rate > 0) {
+                tcpsocket_listener_refill(listener);
+                if (listener->tokens < 1) {
+                        if (MEDUSA_IS_ERR_OR_NULL(listener->timer)) {
+                                listener->timer = medusa_timer_create_unlocked(listener->tcpsocket->subject.monitor, tcpsocket_listener_timer_onevent, listener);
+                                if (MEDUSA_IS_ERR_OR_NULL(listener->timer)) {
+                                        return MEDUSA_PTR_ERR(listener->timer);
+                                }
+                                rc = medusa_timer_set_singleshot_unlocked(listener->timer, 1);
+                                if (rc < 0) {
+                                        return rc;
+                                }
+                        }
+                        rc = medusa_timer_set_interval_unlocked(listener->timer, (1 - listener->tokens) / listener->rate);
+                        if (rc < 0) {
+                                return rc;
+                        }
+                        rc = medusa_timer_set_enabled_unlocked(listener->timer, 1);
+                        if (rc < 0) {
+                                return rc;
+                        }
+                        rc = tcpsocket_listener_pause(listener, TCPSOCKET_LISTENER_PAUSED_RATE);
+                        return (rc < 0) ? rc : 0;
+                }
+        }
+        return 1;
+}
+
+/* re-evaluates the pauses after the limits were changed */
+static int tcpsocket_listener_update (struct tcpsocket_listener *listener)
+{
+        int rc;
+        if (listener->max_connections <= 0 ||
+            listener->stats.connections < listener->max_connections) {
+                rc = tcpsocket_listener_resume(listener, TCPSOCKET_LISTENER_PAUSED_LIMIT);
+                if (rc < 0) {
+                        return rc;
+                }
+        }
+        if (listener->rate <= 0) {
+                if (!MEDUSA_IS_ERR_OR_NULL(listener->timer)) {
+                        rc = medusa_timer_set_enabled_unlocked(listener->timer, 0);
+                        if (rc < 0) {
+                                return rc;
+                        }
+                }
+                rc = tcpsocket_listener_resume(listener, TCPSOCKET_LISTENER_PAUSED_RATE);
+                if (rc < 0) {
+                        return rc;
+                }
+        }
+        return 0;
+}
+
+/* called on the listener when it is destroyed, and on an accepted socket
+ * when it leaves the connected state */
+static void tcpsocket_listener_release (struct medusa_tcpsocket *tcpsocket)
+{
+        struct tcpsocket_listener *listener;
+        listener = tcpsocket->listener;
+        if (listener == NULL) {
+                return;
+        }
+        tcpsocket->listener = NULL;
+        if (listener->tcpsocket == tcpsocket) {
+                if (!MEDUSA_IS_ERR_OR_NULL(listener->timer)) {
+                        medusa_timer_set_context_unlocked(listener->timer, NULL);
+                        medusa_timer_destroy_unlocked(listener->timer);
+                        listener->timer = NULL;
+                }
+                if (listener->pending >= 0) {
+                        tcpsocket_closesocket(listener->pending);
+                        listener->pending = -1;
+                }
+                listener->tcpsocket = NULL;
+        } else {
+                listener->stats.connections -= 1;
+                if (listener->tcpsocket != NULL &&
+                    listener->max_connections > 0 &&
+                    listener->stats.connections < listener->max_connections) {
+                        tcpsocket_listener_resume(listener, TCPSOCKET_LISTENER_PAUSED_LIMIT);
+                }
+        }
+        tcpsocket_listener_put(listener);
+}
+
+static inline int tcpsocket_accept_fd (int fd, int nonblocking, int *nonblocked)
+{
+#if defined(__linux__) && defined(SOCK_NONBLOCK) && defined(SOCK_CLOEXEC)
+        /* saves the fcntl() calls of set_nonblocking on the accepted socket */
+        *nonblocked = !!nonblocking;
+        return accept4(fd, NULL, NULL, SOCK_CLOEXEC | (nonblocking ? SOCK_NONBLOCK : 0));
+#else
+        *nonblocked = 0;
+        return accept(fd, NULL, NULL);
+#endif
+}
+
 static inline int tcpsocket_set_state (struct medusa_tcpsocket *tcpsocket, unsigned int state, int error, int line)
 {
         int rc;
         unsigned int pstate;
         struct medusa_tcpsocket_event_state_changed medusa_tcpsocket_event_state_changed;
 
+        tcpsocket_stats_state(tcpsocket, state);
+
+        if ((state == MEDUSA_TCPSOCKET_STATE_DISCONNECTED || state == MEDUSA_TCPSOCKET_STATE_ERROR) &&
+            (tcpsocket->listener != NULL) &&
+            tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_ACCEPT)) {
+                tcpsocket_listener_release(tcpsocket);
+        }
+
+        if ((state != MEDUSA_TCPSOCKET_STATE_RESOLVING) &&
+            (state != MEDUSA_TCPSOCKET_STATE_RESOLVED) &&
+            (state != MEDUSA_TCPSOCKET_STATE_CONNECTING) &&
+            (tcpsocket->race != NULL)) {
+                tcpsocket_race_destroy(tcpsocket->race);
+                tcpsocket->race = NULL;
+        }
+
+        if ((state != MEDUSA_TCPSOCKET_STATE_CONNECTED) &&
+            (tcpsocket->fastopen_pending != NULL)) {
+                free(tcpsocket->fastopen_pending);
+                tcpsocket->fastopen_pending = NULL;
+        }
+
+        if ((state != MEDUSA_TCPSOCKET_STATE_CONNECTED) &&
+            (tcpsocket->pipe != NULL)) {
+                rc = tcpsocket_pipe_release(tcpsocket->pipe, 1);
+                if (rc < 0) {
+                        return rc;
+                }
+        }
+
         if (state == MEDUSA_TCPSOCKET_STATE_DISCONNECTED) {
                 if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->ltimer)) {
                         rc = medusa_timer_set_enabled_unlocked(tcpsocket->ltimer, 0);
@@ -492,6 +946,7 @@ static inline int tcpsocket_set_state (struct medusa_tcpsocket *tcpsocket, unsig
                         if (rc <= 0) {
                                 return -EIO;
                         }
+                        tcpsocket_stats_handshake_start(tcpsocket);
                         ERR_clear_error();
                         if (tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_ACCEPT)) {
                                 rc = SSL_accept(tcpsocket->ssl);
@@ -564,6 +1019,12 @@ static inline int tcpsocket_set_state (struct medusa_tcpsocket *tcpsocket, unsig
                 if (rc < 0) {
                         return rc;
                 }
+                if (tcpsocket->notsent_lowat > 0) {
+                        rc = medusa_tcpsocket_set_notsent_lowat_unlocked(tcpsocket, tcpsocket->notsent_lowat);
+                        if (rc < 0) {
+                                return rc;
+                        }
+                }
         }
 
         medusa_tcpsocket_event_state_changed.pstate = pstate;
@@ -705,6 +1166,9 @@ static int tcpsocket_wbuffer_commit (struct medusa_tcpsocket *tcpsocket)
         if (tcpsocket_get_buffered(tcpsocket) <= 0) {
                 return -EINVAL;
         }
+        if (tcpsocket->pipe != NULL) {
+                return tcpsocket_pipe_commit(tcpsocket->pipe);
+        }
         if ((tcpsocket->state == MEDUSA_TCPSOCKET_STATE_CONNECTED) &&
             (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->io))) {
                 int rc;
@@ -724,6 +1188,7 @@ static int tcpsocket_wbuffer_commit (struct medusa_tcpsocket *tcpsocket)
                                 return rc;
                         }
                 }
+                tcpsocket_stats_wbuffer(tcpsocket, wblength);
                 rblength = medusa_buffer_get_length(tcpsocket->rbuffer);
                 if (rblength < 0) {
                         return rblength;
@@ -768,6 +1233,9 @@ static int tcpsocket_rbuffer_commit (struct medusa_tcpsocket *tcpsocket)
         if (tcpsocket_get_buffered(tcpsocket) <= 0) {
                 return -EINVAL;
         }
+        if (tcpsocket->pipe != NULL) {
+                return tcpsocket_pipe_commit(tcpsocket->pipe);
+        }
         if ((tcpsocket->state == MEDUSA_TCPSOCKET_STATE_CONNECTED) &&
             (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->io))) {
                 int rc;
@@ -787,6 +1255,7 @@ static int tcpsocket_rbuffer_commit (struct medusa_tcpsocket *tcpsocket)
                                 return rc;
                         }
                 }
+                tcpsocket_stats_wbuffer(tcpsocket, wblength);
                 rblength = medusa_buffer_get_length(tcpsocket->rbuffer);
                 if (rblength < 0) {
                         return rblength;
@@ -837,43 +1306,577 @@ static int tcpsocket_rbuffer_onevent (struct medusa_buffer *buffer, unsigned int
         return 0;
 }
 
-static int tcpsocket_io_onevent (struct medusa_io *io, unsigned int events, void *context, void *param)
+static inline int64_t tcpsocket_pipe_splice (int in, int out, int64_t length)
 {
-        int rc;
-        struct medusa_monitor *monitor;
-        struct medusa_tcpsocket *tcpsocket = context;
+#if defined(__linux__)
+        return splice(in, NULL, out, NULL, length, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+#else
+        (void) in;
+        (void) out;
+        (void) length;
+        errno = ENOTSUP;
+        return -1;
+#endif
+}
 
-        (void) param;
+static int tcpsocket_pipe_restart_timer (struct medusa_timer *timer)
+{
+        int rc;
+        double interval;
+        if (MEDUSA_IS_ERR_OR_NULL(timer)) {
+                return 0;
+        }
+        interval = medusa_timer_get_interval_unlocked(timer);
+        if (interval < 0) {
+                return -EIO;
+        }
+        rc = medusa_timer_set_interval_unlocked(timer, interval);
+        if (rc < 0) {
+                return rc;
+        }
+        return medusa_timer_restart_unlocked(timer);
+}
 
-        monitor = medusa_io_get_monitor(io);
-        medusa_monitor_lock(monitor);
+static int64_t tcpsocket_pipe_direction_get_buffered (const struct tcpsocket_pipe_direction *direction)
+{
+        int64_t length;
+        int64_t blength;
+        length = 0;
+        if (tcpsocket_get_buffered(direction->destination) &&
+            !MEDUSA_IS_ERR_OR_NULL(direction->destination->wbuffer)) {
+                blength = medusa_buffer_get_length(direction->destination->wbuffer);
+                if (blength < 0) {
+                        return blength;
+                }
+                length += blength;
+        }
+        if (tcpsocket_get_buffered(direction->source) &&
+            !MEDUSA_IS_ERR_OR_NULL(direction->source->rbuffer)) {
+                blength = medusa_buffer_get_length(direction->source->rbuffer);
+                if (blength < 0) {
+                        return blength;
+                }
+                length += blength;
+        }
+        return length;
+}
 
-        /* hup is reported whether or not it was requested, so it can arrive
-         * while read interest is disabled. run the read path anyway, so any
-         * pending data is drained and the disconnect is classified by read()
-         * rather than being guessed from the hup alone. */
-        if ((events & (MEDUSA_IO_EVENT_HUP | MEDUSA_IO_EVENT_ERR)) &&
-            !(events & MEDUSA_IO_EVENT_IN) &&
-            ((tcpsocket->state == MEDUSA_TCPSOCKET_STATE_CONNECTING) ||
-             (tcpsocket->state == MEDUSA_TCPSOCKET_STATE_CONNECTED))) {
-                events |= MEDUSA_IO_EVENT_IN;
+static void tcpsocket_pipe_set_error (struct tcpsocket_pipe *pipe, struct medusa_tcpsocket *tcpsocket, int error)
+{
+        if (pipe->failed != NULL) {
+                return;
         }
+        pipe->failed = tcpsocket;
+        pipe->error  = error;
+}
 
-        if (events & MEDUSA_IO_EVENT_OUT) {
-                if (tcpsocket->state == MEDUSA_TCPSOCKET_STATE_DISCONNECTED) {
-                } else if (tcpsocket->state == MEDUSA_TCPSOCKET_STATE_CONNECTING) {
-                        int valopt;
-                        socklen_t vallen;
-                        vallen = sizeof(valopt);
-                        rc = getsockopt(medusa_io_get_fd_unlocked(io), SOL_SOCKET, SO_ERROR, (void *) &valopt, &vallen);
-                        if (rc < 0) {
-                                medusa_errorf("getsockopt failed, rc: %d", rc);
-                                goto bail;
+/* bytes that reached user space before the sockets were piped, or that were
+ * written to the destination while piped, are sent out with plain send()
+ * before anything else moves through the kernel pipe, so the stream keeps
+ * its order. returns 1 once the buffer is empty, 0 if the destination would
+ * block, and negative errno on failure. */
+static int tcpsocket_pipe_direction_flush (struct tcpsocket_pipe_direction *direction, struct medusa_buffer *buffer)
+{
+        int rc;
+        int64_t niovecs;
+        int64_t wlength;
+        struct medusa_iovec iovec;
+        while (1) {
+                niovecs = medusa_buffer_peekv(buffer, 0, -1, &iovec, 1);
+                if (niovecs < 0) {
+                        return niovecs;
+                }
+                if (niovecs == 0) {
+                        return 1;
+                }
+                wlength = send(medusa_io_get_fd_unlocked(direction->destination->io), iovec.iov_base, iovec.iov_len, 0);
+                tcpsocket_stats_send(direction->destination, wlength);
+                if (wlength < 0) {
+                        if (errno == EINTR) {
+                                continue;
                         }
-                        if (valopt != 0) {
+                        if (errno == EAGAIN ||
+                            errno == EWOULDBLOCK) {
+                                return 0;
+                        }
+                        return -errno;
+                }
+                rc = medusa_buffer_choke(buffer, 0, wlength);
+                if (rc < 0) {
+                        return rc;
+                }
+                direction->destination->pipe_sent += wlength;
+                rc = tcpsocket_pipe_restart_timer(direction->destination->wtimer);
+                if (rc < 0) {
+                        return rc;
+                }
+        }
+}
+
+/* moves as much as the destination takes out of the kernel pipe, then refills
+ * it from the source with a single splice, so one busy direction can not
+ * starve the rest of the monitor. failures are recorded on the pipe with the
+ * socket they belong to, and reported by tcpsocket_pipe_settle(). */
+static int tcpsocket_pipe_direction_run (struct tcpsocket_pipe *pipe, struct tcpsocket_pipe_direction *direction)
+{
+        int rc;
+        int filled;
+        int64_t length;
+
+        if (direction->shutdown) {
+                return 0;
+        }
+
+        if (tcpsocket_get_buffered(direction->destination) &&
+            !MEDUSA_IS_ERR_OR_NULL(direction->destination->wbuffer)) {
+                rc = tcpsocket_pipe_direction_flush(direction, direction->destination->wbuffer);
+                if (rc < 0) {
+                        tcpsocket_pipe_set_error(pipe, direction->destination, -rc);
+                        return 0;
+                }
+                if (rc == 0) {
+                        return 0;
+                }
+        }
+        if (tcpsocket_get_buffered(direction->source) &&
+            !MEDUSA_IS_ERR_OR_NULL(direction->source->rbuffer)) {
+                rc = tcpsocket_pipe_direction_flush(direction, direction->source->rbuffer);
+                if (rc < 0) {
+                        tcpsocket_pipe_set_error(pipe, direction->destination, -rc);
+                        return 0;
+                }
+                if (rc == 0) {
+                        return 0;
+                }
+        }
+
+        filled = 0;
+        while (1) {
+                while (direction->pending > 0) {
+                        length = tcpsocket_pipe_splice(direction->fds[0], medusa_io_get_fd_unlocked(direction->destination->io), direction->pending);
+                        if (length < 0) {
+                                if (errno == EINTR) {
+                                        continue;
+                                }
+                                if (errno == EAGAIN ||
+                                    errno == EWOULDBLOCK) {
+                                        return 0;
+                                }
+                                tcpsocket_pipe_set_error(pipe, direction->destination, errno);
+                                return 0;
+                        }
+                        if (length == 0) {
+                                tcpsocket_pipe_set_error(pipe, direction->destination, EIO);
+                                return 0;
+                        }
+                        direction->pending -= length;
+                        direction->destination->pipe_sent += length;
+                        tcpsocket_stats_splice(direction->destination, 0, length);
+                        rc = tcpsocket_pipe_restart_timer(direction->destination->wtimer);
+                        if (rc < 0) {
+                                return rc;
+                        }
+                }
+                if (direction->eof) {
+                        if (pipe->half_close) {
+                                rc = shutdown(medusa_io_get_fd_unlocked(direction->destination->io), SHUT_WR);
+                                if (rc < 0 && errno != ENOTCONN) {
+                                        tcpsocket_pipe_set_error(pipe, direction->destination, errno);
+                                        return 0;
+                                }
+                        }
+                        direction->shutdown = 1;
+                        return 0;
+                }
+                if (filled) {
+                        return 0;
+                }
+                length = tcpsocket_pipe_splice(medusa_io_get_fd_unlocked(direction->source->io), direction->fds[1], direction->capacity);
+                if (length < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        if (errno == EAGAIN ||
+                            errno == EWOULDBLOCK) {
+                                return 0;
+                        }
+                        tcpsocket_pipe_set_error(pipe, direction->source, errno);
+                        return 0;
+                }
+                if (length == 0) {
+                        direction->eof = 1;
+                        continue;
+                }
+                filled = 1;
+                direction->pending += length;
+                direction->source->pipe_received += length;
+                tcpsocket_stats_splice(direction->source, length, 0);
+                rc = tcpsocket_pipe_restart_timer(direction->source->rtimer);
+                if (rc < 0) {
+                        return rc;
+                }
+        }
+}
+
+/* reading from a source stops while its bytes are still waiting for the
+ * destination, and writing to a destination is only asked for while there
+ * is something to write, which is all the backpressure a pipe needs. */
+static int tcpsocket_pipe_commit (struct tcpsocket_pipe *pipe)
+{
+        int i;
+        int j;
+        int rc;
+        int64_t buffered;
+        unsigned int events;
+        struct medusa_tcpsocket *tcpsocket;
+        struct tcpsocket_pipe_direction *direction;
+        for (i = 0; i < 2; i++) {
+                tcpsocket = pipe->directions[i].source;
+                if (MEDUSA_IS_ERR_OR_NULL(tcpsocket->io)) {
+                        continue;
+                }
+                events = 0;
+                for (j = 0; j < 2; j++) {
+                        direction = &pipe->directions[j];
+                        buffered = tcpsocket_pipe_direction_get_buffered(direction);
+                        if (buffered < 0) {
+                                return buffered;
+                        }
+                        if ((direction->source == tcpsocket) &&
+                            (direction->eof == 0) &&
+                            (direction->pending == 0) &&
+                            (buffered == 0)) {
+                                events |= MEDUSA_IO_EVENT_IN;
+                        }
+                        if ((direction->destination == tcpsocket) &&
+                            (direction->shutdown == 0) &&
+                            (direction->pending > 0 || buffered > 0)) {
+                                events |= MEDUSA_IO_EVENT_OUT;
+                        }
+                }
+                rc = medusa_io_set_events_unlocked(tcpsocket->io, events);
+                if (rc < 0) {
+                        return rc;
+                }
+        }
+        return 0;
+}
+
+static int tcpsocket_pipe_release (struct tcpsocket_pipe *pipe, int restore)
+{
+        int i;
+        int rc;
+        int error;
+        struct medusa_tcpsocket *tcpsocket;
+        error = 0;
+        for (i = 0; i < 2; i++) {
+                pipe->directions[i].source->pipe = NULL;
+        }
+        for (i = 0; i < 2; i++) {
+                if (pipe->directions[i].fds[0] >= 0) {
+                        close(pipe->directions[i].fds[0]);
+                }
+                if (pipe->directions[i].fds[1] >= 0) {
+                        close(pipe->directions[i].fds[1]);
+                }
+        }
+        for (i = 0; i < 2 && restore; i++) {
+                tcpsocket = pipe->directions[i].source;
+                if ((tcpsocket->state != MEDUSA_TCPSOCKET_STATE_CONNECTED) ||
+                    (MEDUSA_IS_ERR_OR_NULL(tcpsocket->io))) {
+                        continue;
+                }
+                if (tcpsocket_get_buffered(tcpsocket)) {
+                        rc = tcpsocket_wbuffer_commit(tcpsocket);
+                } else {
+                        rc = medusa_io_set_events_unlocked(tcpsocket->io, MEDUSA_IO_EVENT_IN);
+                }
+                if (rc < 0 && error == 0) {
+                        /* keep going, the other socket must be restored too */
+                        error = rc;
+                }
+        }
+        free(pipe);
+        return error;
+}
+
+static struct tcpsocket_pipe * tcpsocket_pipe_create (struct medusa_tcpsocket *tcpsocket, struct medusa_tcpsocket *peer, const struct medusa_tcpsocket_pipe_options *options)
+{
+        int i;
+        int rc;
+        struct tcpsocket_pipe *pipe;
+
+        pipe = malloc(sizeof(struct tcpsocket_pipe));
+        if (pipe == NULL) {
+                return MEDUSA_ERR_PTR(-ENOMEM);
+        }
+        memset(pipe, 0, sizeof(struct tcpsocket_pipe));
+        pipe->half_close = !!options->half_close;
+        pipe->directions[0].source      = tcpsocket;
+        pipe->directions[0].destination = peer;
+        pipe->directions[1].source      = peer;
+        pipe->directions[1].destination = tcpsocket;
+        for (i = 0; i < 2; i++) {
+                pipe->directions[i].fds[0] = -1;
+                pipe->directions[i].fds[1] = -1;
+        }
+        for (i = 0; i < 2; i++) {
+                rc = medusa_pipe2(pipe->directions[i].fds, MEDUSA_PIPE_FLAG_NONBLOCK);
+                if (rc != 0) {
+                        rc = -errno;
+                        goto bail;
+                }
+                pipe->directions[i].capacity = MEDUSA_TCPSOCKET_DEFAULT_PIPE_SIZE;
+#if defined(F_SETPIPE_SZ) && defined(F_GETPIPE_SZ)
+                if (options->pipe_size > 0) {
+                        fcntl(pipe->directions[i].fds[1], F_SETPIPE_SZ, options->pipe_size);
+                }
+                rc = fcntl(pipe->directions[i].fds[1], F_GETPIPE_SZ);
+                if (rc > 0) {
+                        pipe->directions[i].capacity = rc;
+                }
+#endif
+        }
+        return pipe;
+bail:   for (i = 0; i < 2; i++) {
+                if (pipe->directions[i].fds[0] >= 0) {
+                        close(pipe->directions[i].fds[0]);
+                }
+                if (pipe->directions[i].fds[1] >= 0) {
+                        close(pipe->directions[i].fds[1]);
+                }
+        }
+        free(pipe);
+        return MEDUSA_ERR_PTR(rc);
+}
+
+/* the pipe is over once both directions are shut down, or with half close
+ * disabled as soon as the first one is. a failure in either direction ends
+ * it too, reporting the error on the socket it belongs to only, and leaves
+ * the peer connected with its own events restored. */
+static int tcpsocket_pipe_settle (struct tcpsocket_pipe *pipe)
+{
+        int rc;
+        int error;
+        struct medusa_tcpsocket *failed;
+        struct medusa_tcpsocket *tcpsockets[2];
+
+        if (pipe->failed != NULL) {
+                struct medusa_tcpsocket_event_error medusa_tcpsocket_event_error;
+                failed = pipe->failed;
+                error  = pipe->error;
+                rc = tcpsocket_pipe_release(pipe, 1);
+                if (rc < 0) {
+                        return rc;
+                }
+                medusa_tcpsocket_event_error.state = failed->state;
+                medusa_tcpsocket_event_error.error = error;
+                medusa_tcpsocket_event_error.line  = __LINE__;
+                rc = tcpsocket_set_state(failed, MEDUSA_TCPSOCKET_STATE_ERROR, medusa_tcpsocket_event_error.error, __LINE__);
+                if (rc < 0) {
+                        return rc;
+                }
+                return medusa_tcpsocket_onevent_unlocked(failed, MEDUSA_TCPSOCKET_EVENT_ERROR, &medusa_tcpsocket_event_error);
+        }
+
+        if ((pipe->directions[0].shutdown && pipe->directions[1].shutdown) ||
+            (!pipe->half_close && (pipe->directions[0].shutdown || pipe->directions[1].shutdown))) {
+                tcpsockets[0] = pipe->directions[0].source;
+                tcpsockets[1] = pipe->directions[1].source;
+                rc = tcpsocket_pipe_release(pipe, 0);
+                if (rc < 0) {
+                        return rc;
+                }
+                rc = tcpsocket_set_state(tcpsockets[0], MEDUSA_TCPSOCKET_STATE_DISCONNECTED, 0, __LINE__);
+                if (rc < 0) {
+                        return rc;
+                }
+                rc = medusa_tcpsocket_onevent_unlocked(tcpsockets[0], MEDUSA_TCPSOCKET_EVENT_DISCONNECTED, NULL);
+                if (rc < 0) {
+                        return rc;
+                }
+                rc = tcpsocket_set_state(tcpsockets[1], MEDUSA_TCPSOCKET_STATE_DISCONNECTED, 0, __LINE__);
+                if (rc < 0) {
+                        return rc;
+                }
+                return medusa_tcpsocket_onevent_unlocked(tcpsockets[1], MEDUSA_TCPSOCKET_EVENT_DISCONNECTED, NULL);
+        }
+
+        return tcpsocket_pipe_commit(pipe);
+}
+
+static int tcpsocket_pipe_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events)
+{
+        int i;
+        int rc;
+        struct tcpsocket_pipe *pipe;
+        struct tcpsocket_pipe_direction *direction;
+
+        pipe = tcpsocket->pipe;
+
+        if (events & (MEDUSA_IO_EVENT_ERR | MEDUSA_IO_EVENT_HUP)) {
+                int valopt;
+                socklen_t vallen;
+                valopt = 0;
+                vallen = sizeof(valopt);
+                rc = getsockopt(medusa_io_get_fd_unlocked(tcpsocket->io), SOL_SOCKET, SO_ERROR, (void *) &valopt, &vallen);
+                if (rc < 0) {
+                        valopt = (events & MEDUSA_IO_EVENT_ERR) ? EIO : 0;
+                }
+                if (valopt != 0) {
+                        tcpsocket_pipe_set_error(pipe, tcpsocket, valopt);
+                }
+        }
+
+        for (i = 0; i < 2 && pipe->failed == NULL; i++) {
+                direction = &pipe->directions[i];
+                if (((direction->source == tcpsocket) && (events & (MEDUSA_IO_EVENT_IN | MEDUSA_IO_EVENT_ERR | MEDUSA_IO_EVENT_HUP))) ||
+                    ((direction->destination == tcpsocket) && (events & (MEDUSA_IO_EVENT_OUT | MEDUSA_IO_EVENT_ERR | MEDUSA_IO_EVENT_HUP)))) {
+                        rc = tcpsocket_pipe_direction_run(pipe, direction);
+                        if (rc < 0) {
+                                return rc;
+                        }
+                }
+        }
+
+        return tcpsocket_pipe_settle(pipe);
+}
+
+/* one connection event per admitted connection. in batch mode the
+ * connections are accepted here, up to batch of them per readiness event,
+ * and handed to medusa_tcpsocket_accept(). a connection that is not
+ * accepted from its connection event is closed. */
+static int tcpsocket_listener_onevent (struct medusa_tcpsocket *tcpsocket)
+{
+        int i;
+        int rc;
+        int fd;
+        int nonblocked;
+        struct tcpsocket_listener *listener = tcpsocket->listener;
+
+        listener->stats.wakeups += 1;
+        for (i = 0; i < MAX(1, listener->batch); i++) {
+                rc = tcpsocket_listener_admit(listener);
+                if (rc <= 0) {
+                        return rc;
+                }
+                if (listener->batch > 1) {
+                        fd = tcpsocket_accept_fd(medusa_io_get_fd_unlocked(tcpsocket->io), 1, &nonblocked);
+                        if (fd < 0) {
+                                if (errno == ECONNABORTED || errno == EINTR) {
+                                        continue;
+                                }
+                                break;
+                        }
+                        listener->pending             = fd;
+                        listener->pending_nonblocking = nonblocked;
+                }
+                rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_CONNECTION, NULL);
+                if (listener->pending >= 0) {
+                        tcpsocket_closesocket(listener->pending);
+                        listener->pending = -1;
+                        listener->stats.rejected += 1;
+                }
+                if (rc < 0) {
+                        return rc;
+                }
+                if (tcpsocket->listener != listener ||
+                    tcpsocket->state != MEDUSA_TCPSOCKET_STATE_LISTENING ||
+                    MEDUSA_IS_ERR_OR_NULL(tcpsocket->io) ||
+                    !medusa_subject_is_active(&tcpsocket->subject)) {
+                        break;
+                }
+        }
+        return 0;
+}
+
+/* tcp fast open on the client side. connect() is not called, the socket
+ * reports connected right away and the first buffered write goes out with
+ * the syn through sendto(MSG_FASTOPEN). without a cookie for the server the
+ * kernel sends a plain syn, and the data waits for the handshake. */
+struct tcpsocket_fastopen {
+        struct sockaddr_storage sockaddr;
+        socklen_t sockaddr_length;
+};
+
+static int tcpsocket_fastopen_possible (const struct medusa_tcpsocket *tcpsocket, const struct medusa_tcpsocket_connect_options *options)
+{
+#if defined(MSG_FASTOPEN)
+        return tcpsocket->fastopen &&
+               (options->fd < 0) &&
+               tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_NONBLOCKING) &&
+               tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BUFFERED) &&
+               !tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_SSL);
+#else
+        (void) tcpsocket;
+        (void) options;
+        return 0;
+#endif
+}
+
+/* sends data with the syn, or connects as usual when there is no data or
+ * the kernel has fast open disabled for clients. returns like send(), a
+ * handshake in progress is reported as EAGAIN. */
+static int64_t tcpsocket_fastopen_start (struct medusa_tcpsocket *tcpsocket, const void *data, size_t length)
+{
+        int fd;
+        int error;
+        int64_t rc;
+        struct tcpsocket_fastopen *fastopen;
+
+        fastopen = tcpsocket->fastopen_pending;
+        tcpsocket->fastopen_pending = NULL;
+        fd = medusa_io_get_fd_unlocked(tcpsocket->io);
+
+        rc = -1;
+        error = EOPNOTSUPP;
+#if defined(MSG_FASTOPEN)
+        if (data != NULL && length > 0) {
+                rc = sendto(fd, data, length, MSG_FASTOPEN, (const struct sockaddr *) &fastopen->sockaddr, fastopen->sockaddr_length);
+                error = (rc < 0) ? errno : 0;
+        }
+#else
+        (void) data;
+        (void) length;
+#endif
+        if (rc < 0 && error == EOPNOTSUPP) {
+                rc = connect(fd, (const struct sockaddr *) &fastopen->sockaddr, fastopen->sockaddr_length);
+                error = (rc < 0) ? errno : EINPROGRESS;
+                rc = -1;
+        }
+        free(fastopen);
+        if (rc < 0) {
+                errno = (error == EINPROGRESS) ? EAGAIN : error;
+        }
+        return rc;
+}
+
+static int tcpsocket_io_onevent (struct medusa_io *io, unsigned int events, void *context, void *param)
+{
+        int rc;
+        struct medusa_monitor *monitor;
+        struct medusa_tcpsocket *tcpsocket = context;
+
+        (void) param;
+
+        monitor = medusa_io_get_monitor(io);
+        medusa_monitor_lock(monitor);
+
+        /* a fast open socket is not connected until its first write, and
+         * reports hup till then. nothing written from the connected event
+         * means there is nothing to carry with the syn, connect as usual. */
+        if ((events & (MEDUSA_IO_EVENT_IN | MEDUSA_IO_EVENT_OUT | MEDUSA_IO_EVENT_ERR | MEDUSA_IO_EVENT_HUP)) &&
+            (tcpsocket->fastopen_pending != NULL) &&
+            (tcpsocket->state == MEDUSA_TCPSOCKET_STATE_CONNECTED)) {
+                events &= ~(MEDUSA_IO_EVENT_IN | MEDUSA_IO_EVENT_ERR | MEDUSA_IO_EVENT_HUP);
+                if ((tcpsocket->pipe != NULL) ||
+                    (medusa_buffer_get_length(tcpsocket->wbuffer) <= 0)) {
+                        events = 0;
+                        rc = tcpsocket_fastopen_start(tcpsocket, NULL, 0);
+                        if (rc < 0 && errno != EAGAIN) {
                                 struct medusa_tcpsocket_event_error medusa_tcpsocket_event_error;
                                 medusa_tcpsocket_event_error.state = tcpsocket->state;
-                                medusa_tcpsocket_event_error.error = valopt;
+                                medusa_tcpsocket_event_error.error = errno;
                                 medusa_tcpsocket_event_error.line  = __LINE__;
                                 rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_ERROR, medusa_tcpsocket_event_error.error, __LINE__);
                                 if (rc < 0) {
@@ -885,43 +1888,97 @@ static int tcpsocket_io_onevent (struct medusa_io *io, unsigned int events, void
                                         medusa_errorf("medusa_tcpsocket_onevent_unlocked failed, rc: %d", rc);
                                         goto bail;
                                 }
-                        } else {
-                                rc = medusa_io_del_events_unlocked(io, MEDUSA_IO_EVENT_OUT);
-                                if (rc < 0) {
-                                        medusa_errorf("medusa_io_del_events_unlocked failed, rc: %d", rc);
-                                        goto bail;
-                                }
-                                rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_CONNECTED, 0, __LINE__);
-                                if (rc < 0) {
-                                        medusa_errorf("tcpsocket_set_state failed, rc: %d", rc);
-                                        goto bail;
-                                }
-                                rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_CONNECTED, NULL);
-                                if (rc < 0) {
-                                        medusa_errorf("medusa_tcpsocket_onevent_unlocked failed, rc: %d", rc);
-                                        goto bail;
-                                }
                         }
-                } else if (tcpsocket->state == MEDUSA_TCPSOCKET_STATE_CONNECTED) {
-                        if (!tcpsocket_get_buffered(tcpsocket)) {
-                                if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->wtimer)) {
-                                        double interval;
-                                        interval = medusa_timer_get_interval_unlocked(tcpsocket->wtimer);
-                                        if (interval < 0) {
-                                                medusa_errorf("medusa_timer_get_interval_unlocked failed, interval: %d", (int) interval);
-                                                goto bail;
-                                        }
-                                        rc = medusa_timer_set_interval_unlocked(tcpsocket->wtimer, interval);
-                                        if (rc < 0) {
-                                                medusa_errorf("medusa_timer_set_interval_unlocked failed, rc: %d", rc);
-                                                goto bail;
-                                        }
-                                        rc = medusa_timer_restart_unlocked(tcpsocket->wtimer);
-                                        if (rc < 0) {
-                                                medusa_errorf("medusa_timer_restart_unlocked failed, rc: %d", rc);
-                                                return rc;
-                                        }
-                                }
+                } else {
+                        events |= MEDUSA_IO_EVENT_OUT;
+                }
+        }
+
+        /* hup is reported whether or not it was requested, so it can arrive
+         * while read interest is disabled. run the read path anyway, so any
+         * pending data is drained and the disconnect is classified by read()
+         * rather than being guessed from the hup alone. */
+        if ((events & (MEDUSA_IO_EVENT_HUP | MEDUSA_IO_EVENT_ERR)) &&
+            !(events & MEDUSA_IO_EVENT_IN) &&
+            ((tcpsocket->state == MEDUSA_TCPSOCKET_STATE_CONNECTING) ||
+             (tcpsocket->state == MEDUSA_TCPSOCKET_STATE_CONNECTED))) {
+                events |= MEDUSA_IO_EVENT_IN;
+        }
+
+        if ((events & (MEDUSA_IO_EVENT_IN | MEDUSA_IO_EVENT_OUT | MEDUSA_IO_EVENT_ERR | MEDUSA_IO_EVENT_HUP)) &&
+            (tcpsocket->pipe != NULL) &&
+            (tcpsocket->state == MEDUSA_TCPSOCKET_STATE_CONNECTED)) {
+                rc = tcpsocket_pipe_onevent(tcpsocket, events);
+                if (rc < 0) {
+                        medusa_errorf("tcpsocket_pipe_onevent failed, rc: %d", rc);
+                        goto bail;
+                }
+                events &= ~(MEDUSA_IO_EVENT_IN | MEDUSA_IO_EVENT_OUT | MEDUSA_IO_EVENT_ERR | MEDUSA_IO_EVENT_HUP);
+        }
+
+        if (events & MEDUSA_IO_EVENT_OUT) {
+                if (tcpsocket->state == MEDUSA_TCPSOCKET_STATE_DISCONNECTED) {
+                } else if (tcpsocket->state == MEDUSA_TCPSOCKET_STATE_CONNECTING) {
+                        int valopt;
+                        socklen_t vallen;
+                        vallen = sizeof(valopt);
+                        rc = getsockopt(medusa_io_get_fd_unlocked(io), SOL_SOCKET, SO_ERROR, (void *) &valopt, &vallen);
+                        if (rc < 0) {
+                                medusa_errorf("getsockopt failed, rc: %d", rc);
+                                goto bail;
+                        }
+                        if (valopt != 0) {
+                                struct medusa_tcpsocket_event_error medusa_tcpsocket_event_error;
+                                medusa_tcpsocket_event_error.state = tcpsocket->state;
+                                medusa_tcpsocket_event_error.error = valopt;
+                                medusa_tcpsocket_event_error.line  = __LINE__;
+                                rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_ERROR, medusa_tcpsocket_event_error.error, __LINE__);
+                                if (rc < 0) {
+                                        medusa_errorf("tcpsocket_set_state failed, rc: %d", rc);
+                                        goto bail;
+                                }
+                                rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_ERROR, &medusa_tcpsocket_event_error);
+                                if (rc < 0) {
+                                        medusa_errorf("medusa_tcpsocket_onevent_unlocked failed, rc: %d", rc);
+                                        goto bail;
+                                }
+                        } else {
+                                rc = medusa_io_del_events_unlocked(io, MEDUSA_IO_EVENT_OUT);
+                                if (rc < 0) {
+                                        medusa_errorf("medusa_io_del_events_unlocked failed, rc: %d", rc);
+                                        goto bail;
+                                }
+                                rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_CONNECTED, 0, __LINE__);
+                                if (rc < 0) {
+                                        medusa_errorf("tcpsocket_set_state failed, rc: %d", rc);
+                                        goto bail;
+                                }
+                                rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_CONNECTED, NULL);
+                                if (rc < 0) {
+                                        medusa_errorf("medusa_tcpsocket_onevent_unlocked failed, rc: %d", rc);
+                                        goto bail;
+                                }
+                        }
+                } else if (tcpsocket->state == MEDUSA_TCPSOCKET_STATE_CONNECTED) {
+                        if (!tcpsocket_get_buffered(tcpsocket)) {
+                                if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->wtimer)) {
+                                        double interval;
+                                        interval = medusa_timer_get_interval_unlocked(tcpsocket->wtimer);
+                                        if (interval < 0) {
+                                                medusa_errorf("medusa_timer_get_interval_unlocked failed, interval: %d", (int) interval);
+                                                goto bail;
+                                        }
+                                        rc = medusa_timer_set_interval_unlocked(tcpsocket->wtimer, interval);
+                                        if (rc < 0) {
+                                                medusa_errorf("medusa_timer_set_interval_unlocked failed, rc: %d", rc);
+                                                goto bail;
+                                        }
+                                        rc = medusa_timer_restart_unlocked(tcpsocket->wtimer);
+                                        if (rc < 0) {
+                                                medusa_errorf("medusa_timer_restart_unlocked failed, rc: %d", rc);
+                                                return rc;
+                                        }
+                                }
                                 rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_OUT, NULL);
                                 if (rc < 0) {
                                         goto bail;
@@ -1010,6 +2067,7 @@ static int tcpsocket_io_onevent (struct medusa_io *io, unsigned int events, void
                                                 if (!tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_SSL_STATE_OK) &&
                                                     SSL_get_state(tcpsocket->ssl) == TLS_ST_OK) {
                                                         tcpsocket_add_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_SSL_STATE_OK);
+                                                        tcpsocket_stats_handshake_done(tcpsocket);
                                                         rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_CONNECTED_SSL, NULL);
                                                         if (rc < 0) {
                                                                 medusa_errorf("medusa_tcpsocket_onevent_unlocked failed, rc: %d", rc);
@@ -1018,7 +2076,9 @@ static int tcpsocket_io_onevent (struct medusa_io *io, unsigned int events, void
                                                 }
                                         } else
 #endif
-                                        {
+                                        if (tcpsocket->fastopen_pending != NULL) {
+                                                wlength = tcpsocket_fastopen_start(tcpsocket, iovec.iov_base, iovec.iov_len);
+                                        } else {
                                                 wlength = send(medusa_io_get_fd_unlocked(io), iovec.iov_base, iovec.iov_len, 0);
                                         }
                                         if (wlength < 0) {
@@ -1032,6 +2092,7 @@ static int tcpsocket_io_onevent (struct medusa_io *io, unsigned int events, void
                                                         }
                                                 }
 #endif
+                                                tcpsocket_stats_send(tcpsocket, wlength);
                                                 if (errno != EINTR &&
                                                     errno != EAGAIN &&
                                                     errno != EWOULDBLOCK) {
@@ -1052,6 +2113,7 @@ static int tcpsocket_io_onevent (struct medusa_io *io, unsigned int events, void
                                                 }
                                                 break;
                                         } else if (wlength == 0) {
+                                                tcpsocket_stats_send(tcpsocket, wlength);
                                                 rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_DISCONNECTED, 0, __LINE__);
                                                 if (rc < 0) {
                                                         medusa_errorf("tcpsocket_set_state failed, rc: %d", rc);
@@ -1065,6 +2127,7 @@ static int tcpsocket_io_onevent (struct medusa_io *io, unsigned int events, void
                                                 break;
                                         } else {
                                                 struct medusa_tcpsocket_event_buffered_write medusa_tcpsocket_event_buffered_write;
+                                                tcpsocket_stats_send(tcpsocket, wlength);
                                                 clength = medusa_buffer_choke(tcpsocket->wbuffer, 0, wlength);
                                                 if (clength < 0) {
                                                         medusa_errorf("medusa_buffer_choke failed, clength: %d, wlength: %d, blength: %d", (int) clength, (int) wlength, (int) medusa_buffer_get_length(tcpsocket->wbuffer));
@@ -1089,6 +2152,7 @@ static int tcpsocket_io_onevent (struct medusa_io *io, unsigned int events, void
                                         medusa_errorf("medusa_buffer_get_length failed, blength: %d", (int) blength);
                                         goto bail;
                                 }
+                                tcpsocket_stats_wbuffer(tcpsocket, blength);
                                 if (blength == 0) {
                                         rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_BUFFERED_WRITE_FINISHED, NULL);
                                         if (rc < 0) {
@@ -1105,7 +2169,11 @@ static int tcpsocket_io_onevent (struct medusa_io *io, unsigned int events, void
         if (events & MEDUSA_IO_EVENT_IN) {
                 if (tcpsocket->state == MEDUSA_TCPSOCKET_STATE_DISCONNECTED) {
                 } else if (tcpsocket->state == MEDUSA_TCPSOCKET_STATE_LISTENING) {
-                        rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_CONNECTION, NULL);
+                        if (tcpsocket->listener == NULL) {
+                                rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_CONNECTION, NULL);
+                        } else {
+                                rc = tcpsocket_listener_onevent(tcpsocket);
+                        }
                         if (rc < 0) {
                                 medusa_errorf("medusa_tcpsocket_onevent_unlocked failed, rc: %d", rc);
                                 goto bail;
@@ -1340,6 +2408,7 @@ static int tcpsocket_io_onevent (struct medusa_io *io, unsigned int events, void
                                                 if (!tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_SSL_STATE_OK) &&
                                                     SSL_get_state(tcpsocket->ssl) == TLS_ST_OK) {
                                                         tcpsocket_add_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_SSL_STATE_OK);
+                                                        tcpsocket_stats_handshake_done(tcpsocket);
                                                         rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_CONNECTED_SSL, NULL);
                                                         if (rc < 0) {
                                                                 medusa_errorf("medusa_tcpsocket_onevent_unlocked failed, rc: %d", rc);
@@ -1364,6 +2433,7 @@ static int tcpsocket_io_onevent (struct medusa_io *io, unsigned int events, void
                                                 }
 #endif
                                         }
+                                        tcpsocket_stats_recv(tcpsocket, rlength);
                                         if (rlength < 0) {
                                                 if (errno != EINTR &&
                                                     errno != EAGAIN &&
@@ -1513,1161 +2583,2405 @@ out_err:        ;
                         vallen = sizeof(valopt);
                         rc = getsockopt(medusa_io_get_fd_unlocked(io), SOL_SOCKET, SO_ERROR, (void *) &valopt, &vallen);
                         if (rc < 0) {
-                                valopt = 0;
-                        }
-                        if (valopt == 0) {
-                                rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_DISCONNECTED, 0, __LINE__);
-                                if (rc < 0) {
-                                        medusa_errorf("tcpsocket_set_state failed, rc: %d", rc);
-                                        goto bail;
-                                }
-                                rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_DISCONNECTED, NULL);
-                                if (rc < 0) {
-                                        medusa_errorf("medusa_tcpsocket_onevent_unlocked failed, rc: %d", rc);
-                                        goto bail;
-                                }
-                        } else {
-                                struct medusa_tcpsocket_event_error medusa_tcpsocket_event_error;
-                                medusa_tcpsocket_event_error.state = tcpsocket->state;
-                                medusa_tcpsocket_event_error.error = valopt;
-                                medusa_tcpsocket_event_error.line  = __LINE__;
-                                rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_ERROR, medusa_tcpsocket_event_error.error, __LINE__);
-                                if (rc < 0) {
-                                        medusa_errorf("tcpsocket_set_state failed, rc: %d", rc);
-                                        goto bail;
-                                }
-                                rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_ERROR, &medusa_tcpsocket_event_error);
-                                if (rc < 0) {
-                                        medusa_errorf("medusa_tcpsocket_onevent_unlocked failed, rc: %d", rc);
-                                        goto bail;
-                                }
+                                valopt = 0;
+                        }
+                        if (valopt == 0) {
+                                rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_DISCONNECTED, 0, __LINE__);
+                                if (rc < 0) {
+                                        medusa_errorf("tcpsocket_set_state failed, rc: %d", rc);
+                                        goto bail;
+                                }
+                                rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_DISCONNECTED, NULL);
+                                if (rc < 0) {
+                                        medusa_errorf("medusa_tcpsocket_onevent_unlocked failed, rc: %d", rc);
+                                        goto bail;
+                                }
+                        } else {
+                                struct medusa_tcpsocket_event_error medusa_tcpsocket_event_error;
+                                medusa_tcpsocket_event_error.state = tcpsocket->state;
+                                medusa_tcpsocket_event_error.error = valopt;
+                                medusa_tcpsocket_event_error.line  = __LINE__;
+                                rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_ERROR, medusa_tcpsocket_event_error.error, __LINE__);
+                                if (rc < 0) {
+                                        medusa_errorf("tcpsocket_set_state failed, rc: %d", rc);
+                                        goto bail;
+                                }
+                                rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_ERROR, &medusa_tcpsocket_event_error);
+                                if (rc < 0) {
+                                        medusa_errorf("medusa_tcpsocket_onevent_unlocked failed, rc: %d", rc);
+                                        goto bail;
+                                }
+                        }
+                }
+        }
+        if (events & MEDUSA_IO_EVENT_DESTROY) {
+                medusa_io_set_events_unlocked(io, 0);
+                if (medusa_io_get_clodestroy_unlocked(io) > 0) {
+                        int fd;
+                        fd = medusa_io_get_fd_unlocked(io);
+                        if (fd >= 0) {
+                                tcpsocket_closesocket(fd);
+                                medusa_io_set_clodestroy_unlocked(io, 0);
+                        }
+                }
+        }
+        medusa_monitor_unlock(monitor);
+        return 0;
+bail:   medusa_monitor_unlock(monitor);
+        return -EIO;
+}
+
+static int tcpsocket_init_unlocked (struct medusa_tcpsocket *tcpsocket, struct medusa_monitor *monitor, int (*onevent) (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param), void *context)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(monitor)) {
+                return -EINVAL;
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(onevent)) {
+                return -EINVAL;
+        }
+        memset(tcpsocket, 0, sizeof(struct medusa_tcpsocket));
+        medusa_subject_set_type(&tcpsocket->subject, MEDUSA_SUBJECT_TYPE_TCPSOCKET);
+        tcpsocket->subject.monitor = NULL;
+        tcpsocket->incoming_cpu = -1;
+        tcpsocket_set_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_NONE);
+        rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_DISCONNECTED, 0, __LINE__);
+        if (rc < 0 ) {
+                return rc;
+        }
+        tcpsocket->onevent = onevent;
+        tcpsocket->context = context;
+        return medusa_monitor_add_unlocked(monitor, &tcpsocket->subject);
+}
+
+static void tcpsocket_uninit_unlocked (struct medusa_tcpsocket *tcpsocket)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return;
+        }
+        if (tcpsocket->subject.monitor != NULL) {
+                if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->io)) {
+                        medusa_io_destroy_unlocked(tcpsocket->io);
+                        tcpsocket->io = NULL;
+                }
+                medusa_monitor_del_unlocked(&tcpsocket->subject);
+        } else {
+                medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_DESTROY, NULL);
+        }
+}
+
+static struct medusa_tcpsocket * tcpsocket_create_unlocked (struct medusa_monitor *monitor, int (*onevent) (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param), void *context)
+{
+        int rc;
+        struct medusa_tcpsocket *tcpsocket;
+        if (MEDUSA_IS_ERR_OR_NULL(monitor)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(onevent)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+#if defined(MEDUSA_TCPSOCKET_USE_POOL) && (MEDUSA_TCPSOCKET_USE_POOL == 1)
+        tcpsocket = medusa_pool_malloc(g_pool);
+#else
+        tcpsocket = malloc(sizeof(struct medusa_tcpsocket));
+#endif
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return MEDUSA_ERR_PTR(-ENOMEM);
+        }
+        memset(tcpsocket, 0, sizeof(struct medusa_tcpsocket));
+        rc = tcpsocket_init_unlocked(tcpsocket, monitor, onevent, context);
+        if (rc < 0) {
+                struct medusa_tcpsocket_event_error medusa_tcpsocket_event_error;
+                medusa_tcpsocket_event_error.state = tcpsocket->state;
+                medusa_tcpsocket_event_error.error = -rc;
+                medusa_tcpsocket_event_error.line  = __LINE__;
+                tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_ERROR, medusa_tcpsocket_event_error.error, __LINE__);
+                medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_ERROR, &medusa_tcpsocket_event_error);
+        }
+        return tcpsocket;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_bind_options_default (struct medusa_tcpsocket_bind_options *options)
+{
+        if (options == NULL) {
+                return -EINVAL;
+        }
+        memset(options, 0, sizeof(struct medusa_tcpsocket_bind_options));
+        options->protocol     = MEDUSA_TCPSOCKET_PROTOCOL_ANY;
+        options->backlog      = 128;
+        options->fd           = -1;
+        options->clodestroy   = 1;
+        options->incoming_cpu = -1;
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_bind_with_options_unlocked (const struct medusa_tcpsocket_bind_options *options)
+{
+        int rc;
+        int fd;
+        int ret;
+
+        unsigned int protocol;
+        const char *address;
+        unsigned short port;
+        unsigned int length;
+
+        struct sockaddr *sockaddr;
+        struct sockaddr_in sockaddr_in;
+        struct sockaddr_in6 sockaddr_in6;
+
+        struct medusa_io_init_options io_init_options;
+        struct medusa_tcpsocket *tcpsocket;
+
+        tcpsocket = NULL;
+
+        if (MEDUSA_IS_ERR_OR_NULL(options)) {
+                ret = -EINVAL;
+                goto bail;
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(options->monitor)) {
+                ret = -EINVAL;
+                goto bail;
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(options->onevent)) {
+                ret = -EINVAL;
+                goto bail;
+        }
+
+        protocol = options->protocol;
+        address  = options->address;
+        port     = options->port;
+
+        if (protocol == MEDUSA_TCPSOCKET_PROTOCOL_IPV4) {
+ipv4:
+                memset(&sockaddr_in, 0, sizeof(sockaddr_in));
+                sockaddr_in.sin_family = AF_INET;
+                if (address == NULL) {
+                        address = "0.0.0.0";
+                } else if (strcmp(address, "localhost") == 0) {
+                        address = "127.0.0.1";
+                } else if (strcmp(address, "loopback") == 0) {
+                        address = "127.0.0.1";
+                }
+                rc = inet_pton(AF_INET, address, &sockaddr_in.sin_addr);
+                if (rc == 0) {
+                        ret = -EINVAL;
+                        goto bail;
+                } else if (rc < 0) {
+                        ret = -EINVAL;
+                        goto bail;
+                }
+                sockaddr_in.sin_port = htons(port);
+                sockaddr = (struct sockaddr *) &sockaddr_in;
+                length = sizeof(struct sockaddr_in);
+        } else if (protocol == MEDUSA_TCPSOCKET_PROTOCOL_IPV6) {
+ipv6:
+                memset(&sockaddr_in6, 0, sizeof(sockaddr_in6));
+                sockaddr_in6.sin6_family = AF_INET6;
+                if (address == NULL) {
+                        address = "0.0.0.0";
+                } else if (strcmp(address, "localhost") == 0) {
+                        address = "::1";
+                } else if (strcmp(address, "loopback") == 0) {
+                        address = "::1";
+                }
+                rc = inet_pton(AF_INET6, address, &sockaddr_in6.sin6_addr);
+                if (rc == 0) {
+                        ret = -EINVAL;
+                        goto bail;
+                } else if (rc < 0) {
+                        ret = -EINVAL;
+                        goto bail;
+                }
+                sockaddr_in6.sin6_port = htons(port);
+                sockaddr = (struct sockaddr *) &sockaddr_in6;
+                length = sizeof(struct sockaddr_in6);
+        } else if (address == NULL) {
+                address = "0.0.0.0";
+                goto ipv4;
+        } else if (strcmp(address, "localhost") == 0) {
+                address = "127.0.0.1";
+                goto ipv4;
+        } else if (strcmp(address, "loopback") == 0) {
+                address = "127.0.0.1";
+                goto ipv4;
+        } else {
+                rc = inet_pton(AF_INET, address, &sockaddr_in.sin_addr);
+                if (rc > 0) {
+                        goto ipv4;
+                }
+                rc = inet_pton(AF_INET6, address, &sockaddr_in6.sin6_addr);
+                if (rc > 0) {
+                        goto ipv6;
+                }
+                ret = -EINVAL;
+                goto bail;
+        }
+
+        tcpsocket = tcpsocket_create_unlocked(options->monitor, options->onevent, options->context);
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                ret = MEDUSA_PTR_ERR(tcpsocket);
+                goto bail;
+        }
+        tcpsocket_add_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BIND);
+
+        rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_BINDING, 0, __LINE__);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_BINDING, NULL);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+
+        if (options->fd >= 0) {
+                fd = options->fd;
+        } else {
+                fd = socket(sockaddr->sa_family, SOCK_STREAM, 0);
+        }
+        if (fd < 0) {
+                ret = -errno;
+                goto bail;
+        }
+        {
+                int rc;
+                int on;
+                on = !!options->reuseaddr;
+                rc = setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (void *) &on, sizeof(on));
+                if (rc < 0) {
+                        if (options->fd < 0 ||
+                            options->clodestroy == 1) {
+                                tcpsocket_closesocket(fd);
+                        }
+                        ret = -errno;
+                        goto bail;
+                }
+        }
+        {
+                int rc;
+                int on;
+                on = !!options->reuseport;
+#if defined(SO_REUSEPORT)
+                rc = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (void *) &on, sizeof(on));
+#else
+                (void) on;
+                rc = 0;
+#endif
+                if (rc < 0) {
+                        if (options->fd < 0 ||
+                            options->clodestroy == 1) {
+                                tcpsocket_closesocket(fd);
+                        }
+                        ret = -errno;
+                        goto bail;
+                }
+        }
+        {
+                int rc;
+                int on;
+                on = !!options->freebind;
+#if defined(IP_FREEBIND) || defined(IPV6_FREEBIND)
+                if (sockaddr->sa_family == AF_INET) {
+#if defined(IP_FREEBIND)
+                        rc = setsockopt(fd, IPPROTO_IP, IP_FREEBIND, (void *) &on, sizeof(on));
+#else
+                        rc = 0;
+#endif
+                } else if (sockaddr->sa_family == AF_INET6) {
+#if defined(IPV6_FREEBIND)
+                        rc = setsockopt(fd, IPPROTO_IPV6, IPV6_FREEBIND, (void *) &on, sizeof(on));
+#else
+                        rc = 0;
+#endif
+                } else {
+                        rc = 0;
+                }
+#else
+                (void) on;
+                rc = 0;
+#endif
+                if (rc < 0) {
+                        if (options->fd < 0 ||
+                            options->clodestroy == 1) {
+                                tcpsocket_closesocket(fd);
+                        }
+                        ret = -errno;
+                        goto bail;
+                }
+        }
+        rc = bind(fd, sockaddr , length);
+        if (rc != 0) {
+                if (options->fd < 0 ||
+                    options->clodestroy == 1) {
+                        tcpsocket_closesocket(fd);
+                }
+                ret = -errno;
+                goto bail;
+        }
+
+        rc = medusa_io_init_options_default(&io_init_options);
+        if (rc < 0) {
+                if (options->fd < 0 ||
+                    options->clodestroy == 1) {
+                        tcpsocket_closesocket(fd);
+                }
+                ret = rc;
+                goto bail;
+        }
+        io_init_options.monitor    = tcpsocket->subject.monitor;
+        io_init_options.fd         = fd;
+        io_init_options.events     = MEDUSA_IO_EVENT_IN;
+        io_init_options.onevent    = tcpsocket_io_onevent;
+        io_init_options.context    = tcpsocket;
+        io_init_options.clodestroy = options->clodestroy;
+        io_init_options.enabled    = 0;
+        tcpsocket->io = medusa_io_create_with_options_unlocked(&io_init_options);
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket->io)) {
+                ret = MEDUSA_PTR_ERR(tcpsocket->io);
+                goto bail;
+        }
+
+        rc = medusa_tcpsocket_set_reuseaddr_unlocked(tcpsocket, options->reuseaddr);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_reuseport_unlocked(tcpsocket, options->reuseport);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_freebind_unlocked(tcpsocket, options->freebind);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_fastopen_unlocked(tcpsocket, options->fastopen);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_defer_accept_unlocked(tcpsocket, options->defer_accept);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_incoming_cpu_unlocked(tcpsocket, options->incoming_cpu);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_nonblocking_unlocked(tcpsocket, options->nonblocking);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_nodelay_unlocked(tcpsocket, options->nodelay);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_notsent_lowat_unlocked(tcpsocket, options->notsent_lowat);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_backlog_unlocked(tcpsocket, options->backlog);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_buffered_unlocked(tcpsocket, options->buffered);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        if (medusa_tcpsocket_get_buffered_unlocked(tcpsocket)) {
+                rc = medusa_tcpsocket_set_buffered_read_limit_unlocked(tcpsocket, options->buffered_read_limit);
+                if (rc < 0) {
+                        ret = rc;
+                        goto bail;
+                }
+                rc = medusa_tcpsocket_set_buffered_write_limit_unlocked(tcpsocket, options->buffered_write_limit);
+                if (rc < 0) {
+                        ret = rc;
+                        goto bail;
+                }
+        }
+        rc = medusa_tcpsocket_set_clodestroy_unlocked(tcpsocket, options->clodestroy);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_stats_enabled_unlocked(tcpsocket, options->stats);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_accept_batch_unlocked(tcpsocket, options->accept_batch);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_max_connections_unlocked(tcpsocket, options->max_connections);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_accept_rate_unlocked(tcpsocket, options->accept_rate, options->accept_burst);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_ssl_certificate_unlocked(tcpsocket, options->ssl_certificate, -1);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_ssl_privatekey_unlocked(tcpsocket, options->ssl_privatekey, -1);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_ssl_ca_certificate_unlocked(tcpsocket, options->ssl_ca_certificate, -1);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_ssl_verify_unlocked(tcpsocket, options->ssl_verify);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_ssl_unlocked(tcpsocket, options->ssl);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_enabled_unlocked(tcpsocket, options->enabled);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_BOUND, 0, __LINE__);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_BOUND, NULL);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+
+        if (tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BACKLOG)) {
+                rc = listen(fd, tcpsocket->backlog);
+                if (rc != 0) {
+                        ret = -errno;
+                        goto bail;
+                }
+        }
+
+        rc = medusa_io_set_events_unlocked(tcpsocket->io, MEDUSA_IO_EVENT_IN);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_LISTENING, 0, __LINE__);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_LISTENING, NULL);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+
+        return tcpsocket;
+bail:   if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return MEDUSA_ERR_PTR(ret);
+        }
+        {
+                struct medusa_tcpsocket_event_error medusa_tcpsocket_event_error;
+                medusa_tcpsocket_event_error.state = tcpsocket->state;
+                medusa_tcpsocket_event_error.error = -ret;
+                medusa_tcpsocket_event_error.line  = __LINE__;
+                tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_ERROR, medusa_tcpsocket_event_error.error, __LINE__);
+                medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_ERROR, &medusa_tcpsocket_event_error);
+        }
+        return tcpsocket;
+}
+
+__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_bind_with_options (const struct medusa_tcpsocket_bind_options *options)
+{
+        struct medusa_tcpsocket *rc;
+        if (MEDUSA_IS_ERR_OR_NULL(options)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(options->monitor)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        medusa_monitor_lock(options->monitor);
+        rc = medusa_tcpsocket_bind_with_options_unlocked(options);
+        medusa_monitor_unlock(options->monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_bind_unlocked (struct medusa_monitor *monitor, unsigned int protocol, const char *address, unsigned short port, int (*onevent) (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param), void *context)
+{
+        int rc;
+        struct medusa_tcpsocket_bind_options options;
+        rc = medusa_tcpsocket_bind_options_default(&options);
+        if (rc < 0) {
+                return MEDUSA_ERR_PTR(rc);
+        }
+        options.monitor  = monitor;
+        options.onevent  = onevent;
+        options.context  = context;
+        options.protocol = protocol;
+        options.address  = address;
+        options.port     = port;
+        return medusa_tcpsocket_bind_with_options_unlocked(&options);
+}
+
+__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_bind (struct medusa_monitor *monitor, unsigned int protocol, const char *address, unsigned short port, int (*onevent) (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param), void *context)
+{
+        struct medusa_tcpsocket *tcpsocket;
+        if (MEDUSA_IS_ERR_OR_NULL(monitor)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        medusa_monitor_lock(monitor);
+        tcpsocket = medusa_tcpsocket_bind_unlocked(monitor, protocol, address, port, onevent, context);
+        medusa_monitor_unlock(monitor);
+        return tcpsocket;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_accept_options_default (struct medusa_tcpsocket_accept_options *options)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(options)) {
+                return -EINVAL;
+        }
+        memset(options, 0, sizeof(struct medusa_tcpsocket_accept_options));
+        options->fd         = -1;
+        options->clodestroy = 1;
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_accept_with_options_unlocked (struct medusa_tcpsocket *tcpsocket, const struct medusa_tcpsocket_accept_options *options)
+{
+        int fd;
+        int rc;
+        int ret;
+        int nonblocked;
+        struct medusa_io_init_options io_init_options;
+        struct medusa_tcpsocket *accepted;
+
+        accepted = NULL;
+        nonblocked = 0;
+
+        if (MEDUSA_IS_ERR_OR_NULL(options)) {
+                ret = -EINVAL;
+                goto bail;
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                ret = -EINVAL;
+                goto bail;
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(options->onevent)) {
+                ret = -EINVAL;
+                goto bail;
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket->io)) {
+                ret = -EINVAL;
+                goto bail;
+        }
+        if (options->fd < 0 &&
+            tcpsocket->listener != NULL &&
+            tcpsocket->listener->pending < 0) {
+                rc = tcpsocket_listener_admit(tcpsocket->listener);
+                if (rc <= 0) {
+                        ret = (rc < 0) ? rc : -EAGAIN;
+                        goto bail;
+                }
+        }
+
+        accepted = tcpsocket_create_unlocked(medusa_tcpsocket_get_monitor_unlocked(tcpsocket), options->onevent, options->context);
+        if (MEDUSA_IS_ERR_OR_NULL(accepted)) {
+                ret = MEDUSA_PTR_ERR(accepted);
+                goto bail;
+        }
+        tcpsocket_add_flag(accepted, MEDUSA_TCPSOCKET_FLAG_ACCEPT);
+
+        if (options->fd >= 0) {
+                fd = options->fd;
+        } else if (tcpsocket->listener != NULL &&
+                   tcpsocket->listener->pending >= 0) {
+                fd = tcpsocket->listener->pending;
+                nonblocked = tcpsocket->listener->pending_nonblocking;
+                tcpsocket->listener->pending = -1;
+        } else {
+                fd = tcpsocket_accept_fd(medusa_io_get_fd_unlocked(tcpsocket->io), options->nonblocking, &nonblocked);
+        }
+        if (fd < 0) {
+                ret = -errno;
+                goto bail;
+        }
+        if (options->fd < 0 &&
+            tcpsocket->listener != NULL) {
+                accepted->listener = tcpsocket->listener;
+                accepted->listener->refcount += 1;
+                accepted->listener->stats.connections += 1;
+                accepted->listener->stats.accepted += 1;
+                if (accepted->listener->rate > 0) {
+                        accepted->listener->tokens -= 1;
+                }
+        }
+
+        rc = medusa_io_init_options_default(&io_init_options);
+        if (rc < 0) {
+                if (options->fd < 0 ||
+                    options->clodestroy == 1) {
+                        tcpsocket_closesocket(fd);
+                }
+                ret = rc;
+                goto bail;
+        }
+        io_init_options.monitor    = tcpsocket->subject.monitor;
+        io_init_options.fd         = fd;
+        io_init_options.events     = MEDUSA_IO_EVENT_IN;
+        io_init_options.onevent    = tcpsocket_io_onevent;
+        io_init_options.context    = accepted;
+        io_init_options.clodestroy = options->clodestroy;
+        io_init_options.enabled    = 0;
+        accepted->io = medusa_io_create_with_options_unlocked(&io_init_options);
+        if (MEDUSA_IS_ERR_OR_NULL(accepted->io)) {
+                ret = MEDUSA_PTR_ERR(accepted->io);
+                goto bail;
+        }
+
+        if (nonblocked && options->nonblocking) {
+                tcpsocket_add_flag(accepted, MEDUSA_TCPSOCKET_FLAG_NONBLOCKING);
+        } else {
+                rc = medusa_tcpsocket_set_nonblocking_unlocked(accepted, options->nonblocking);
+                if (rc < 0) {
+                        ret = rc;
+                        goto bail;
+                }
+        }
+        rc = medusa_tcpsocket_set_nodelay_unlocked(accepted, options->nodelay);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_notsent_lowat_unlocked(accepted, (options->notsent_lowat > 0) ? options->notsent_lowat : tcpsocket->notsent_lowat);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_buffered_unlocked(accepted, options->buffered);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        if (medusa_tcpsocket_get_buffered_unlocked(accepted)) {
+                rc = medusa_tcpsocket_set_buffered_read_limit_unlocked(accepted, options->buffered_read_limit);
+                if (rc < 0) {
+                        ret = rc;
+                        goto bail;
+                }
+                rc = medusa_tcpsocket_set_buffered_write_limit_unlocked(accepted, options->buffered_write_limit);
+                if (rc < 0) {
+                        ret = rc;
+                        goto bail;
+                }
+        }
+        rc = medusa_tcpsocket_set_clodestroy_unlocked(accepted, options->clodestroy);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_stats_enabled_unlocked(accepted, options->stats || tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_STATS));
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_enabled_unlocked(accepted, options->enabled);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+
+        rc = medusa_tcpsocket_set_ssl_certificate_unlocked(accepted, medusa_tcpsocket_get_ssl_certificate_unlocked(tcpsocket), -1);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_ssl_privatekey_unlocked(accepted, medusa_tcpsocket_get_ssl_privatekey_unlocked(tcpsocket), -1);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_ssl_ca_certificate_unlocked(accepted, medusa_tcpsocket_get_ssl_ca_certificate_unlocked(tcpsocket), -1);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_ssl_verify_unlocked(accepted, medusa_tcpsocket_get_ssl_verify_unlocked(tcpsocket));
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_ssl_unlocked(accepted, medusa_tcpsocket_get_ssl_unlocked(tcpsocket));
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+
+        rc = tcpsocket_set_state(accepted, MEDUSA_TCPSOCKET_STATE_CONNECTED, 0, __LINE__);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_onevent_unlocked(accepted, MEDUSA_TCPSOCKET_EVENT_CONNECTED, NULL);
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+
+        return accepted;
+bail:   if (MEDUSA_IS_ERR_OR_NULL(accepted)) {
+                return MEDUSA_ERR_PTR(ret);
+        }
+        {
+                struct medusa_tcpsocket_event_error medusa_tcpsocket_event_error;
+                medusa_tcpsocket_event_error.state = tcpsocket->state;
+                medusa_tcpsocket_event_error.error = -ret;
+                medusa_tcpsocket_event_error.line  = __LINE__;
+                tcpsocket_set_state(accepted, MEDUSA_TCPSOCKET_STATE_ERROR, medusa_tcpsocket_event_error.error, __LINE__);
+                medusa_tcpsocket_onevent_unlocked(accepted, MEDUSA_TCPSOCKET_EVENT_ERROR, &medusa_tcpsocket_event_error);
+        }
+        return tcpsocket;
+}
+
+__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_accept_with_options (struct medusa_tcpsocket *tcpsocket, const struct medusa_tcpsocket_accept_options *options)
+{
+        struct medusa_tcpsocket *rc;
+        struct medusa_monitor *monitor;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(options)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        monitor = medusa_tcpsocket_get_monitor(tcpsocket);
+        if (MEDUSA_IS_ERR_OR_NULL(monitor)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        medusa_monitor_lock(monitor);
+        rc = medusa_tcpsocket_accept_with_options_unlocked(tcpsocket, options);
+        medusa_monitor_unlock(monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_accept_unlocked (struct medusa_tcpsocket *tcpsocket, int (*onevent) (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param), void *context)
+{
+        int rc;
+        struct medusa_tcpsocket_accept_options options;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        rc = medusa_tcpsocket_accept_options_default(&options);
+        if (rc < 0) {
+                return MEDUSA_ERR_PTR(rc);
+        }
+        options.onevent     = onevent;
+        options.context     = context;
+        options.buffered    = medusa_tcpsocket_get_buffered_unlocked(tcpsocket);
+        options.nodelay     = medusa_tcpsocket_get_nodelay_unlocked(tcpsocket);
+        options.nonblocking = medusa_tcpsocket_get_nonblocking_unlocked(tcpsocket);
+        return medusa_tcpsocket_accept_with_options_unlocked(tcpsocket, &options);
+}
+
+__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_accept (struct medusa_tcpsocket *tcpsocket, int (*onevent) (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param), void *context)
+{
+        struct medusa_tcpsocket *accepted;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        medusa_monitor_lock(tcpsocket->subject.monitor);
+        accepted = medusa_tcpsocket_accept_unlocked(tcpsocket, onevent, context);
+        medusa_monitor_unlock(tcpsocket->subject.monitor);
+        return accepted;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_connect_options_default (struct medusa_tcpsocket_connect_options *options)
+{
+        if (options == NULL) {
+                return -EINVAL;
+        }
+        memset(options, 0, sizeof(struct medusa_tcpsocket_connect_options));
+        options->protocol   = MEDUSA_TCPSOCKET_PROTOCOL_ANY;
+        options->sprotocol  = MEDUSA_TCPSOCKET_PROTOCOL_ANY;
+        options->resolve_timeout = -1;
+        options->connect_timeout = -1;
+        options->read_timeout    = -1;
+        options->fd              = -1;
+        options->reuseaddr       = 1;
+        options->reuseport       = 1;
+        options->clodestroy      = 1;
+        options->attempt_delay   = 0.250;
+        return 0;
+}
+
+static void medusa_tcpsocket_connect_options_destroy (struct medusa_tcpsocket_connect_options *options)
+{
+        if (options == NULL) {
+                return;
+        }
+        if (options->address != NULL) {
+                free((char *) options->address);
+        }
+        if (options->saddress != NULL) {
+                free((char *) options->saddress);
+        }
+        free(options);
+}
+
+static struct medusa_tcpsocket_connect_options * medusa_tcpsocket_connect_options_duplicate (const struct medusa_tcpsocket_connect_options *source)
+{
+        int rs;
+        struct medusa_tcpsocket_connect_options *options;
+
+        rs = -EIO;
+        options = NULL;
+
+        if (source == NULL) {
+                rs = -EINVAL;
+                goto bail;
+        }
+
+        options = malloc(sizeof(struct medusa_tcpsocket_connect_options));
+        if (options == NULL) {
+                rs = -ENOMEM;
+                goto bail;
+        }
+        memset(options, 0, sizeof(struct medusa_tcpsocket_connect_options));
+
+        options->monitor        = source->monitor;
+        options->dnsresolver    = source->dnsresolver;
+        options->onevent        = source->onevent;
+        options->context        = source->context;
+        options->protocol       = source->protocol;
+        if (source->address != NULL) {
+                options->address = strdup(source->address);
+                if (options->address == NULL) {
+                        rs = -ENOMEM;
+                        goto bail;
+                }
+        }
+        options->port           = source->port;
+        options->sprotocol      = source->sprotocol;
+        if (source->saddress != NULL) {
+                options->saddress = strdup(source->saddress);
+                if (options->saddress == NULL) {
+                        rs = -ENOMEM;
+                        goto bail;
+                }
+        }
+        options->sport           = source->sport;
+        options->resolve_timeout = source->resolve_timeout;
+        options->connect_timeout = source->connect_timeout;
+        options->read_timeout    = source->read_timeout;
+        options->attempt_delay   = source->attempt_delay;
+        options->fd              = source->fd;
+        options->clodestroy      = source->clodestroy;
+        options->reuseaddr       = source->reuseaddr;
+        options->reuseport       = source->reuseport;
+        options->fastopen        = source->fastopen;
+        options->nonblocking     = source->nonblocking;
+        options->nodelay         = source->nodelay;
+        options->notsent_lowat   = source->notsent_lowat;
+        options->buffered        = source->buffered;
+        options->buffered_read_limit  = source->buffered_read_limit;
+        options->buffered_write_limit = source->buffered_write_limit;
+        options->stats           = source->stats;
+        options->enabled         = source->enabled;
+
+        return options;
+bail:   if (options != NULL) {
+                medusa_tcpsocket_connect_options_destroy(options);
+        }
+        return MEDUSA_ERR_PTR(rs);
+}
+
+static int tcpsocket_connect_entry (const struct medusa_tcpsocket_connect_options *options, struct tcpsocket_addrinfo_entry *addrinfo_entry, int deferred, int *pfd, int *perror)
+{
+        int rc;
+        int fd;
+        int ret;
+        void *ptr;
+        char str[MAX(INET_ADDRSTRLEN, INET6_ADDRSTRLEN)];
+        int family;
+        struct sockaddr_in *sockaddr_in;
+        struct sockaddr_in6 *sockaddr_in6;
+
+        *pfd = -1;
+        *perror = -EIO;
+
+        switch (addrinfo_entry->protocol) {
+                case MEDUSA_TCPSOCKET_PROTOCOL_IPV4:
+                        family = AF_INET;
+                        sockaddr_in = (struct sockaddr_in *) &addrinfo_entry->sockaddr;
+                        sockaddr_in->sin_family = AF_INET;
+                        sockaddr_in->sin_port = htons(options->port);
+                        ptr = &sockaddr_in->sin_addr;
+                        break;
+                case MEDUSA_TCPSOCKET_PROTOCOL_IPV6:
+                        family = AF_INET6;
+                        sockaddr_in6 = (struct sockaddr_in6 *) &addrinfo_entry->sockaddr;
+                        sockaddr_in6->sin6_family = AF_INET6;
+                        sockaddr_in6->sin6_port = htons(options->port);
+                        ptr = &sockaddr_in6->sin6_addr;
+                        break;
+                default:
+                        medusa_errorf("unknown addrinfo entry protocol: %d", addrinfo_entry->protocol);
+                        ret = -EIO;
+                        goto bail;
+        }
+        if (inet_ntop(family, ptr, str, sizeof(str)) == NULL) {
+                *perror = -EINVAL;
+                return 0;
+        }
+        if (options->fd >= 0) {
+                fd = options->fd;
+        } else {
+                fd = socket(family, SOCK_STREAM, 0);
+        }
+        if (fd < 0) {
+                medusa_errorf("can not open socket");
+                ret = -errno;
+                goto bail;
+        }
+        {
+                int rc;
+#if defined(__WINDOWS__)
+                unsigned long nonblocking = options->nonblocking ? 1 : 0;
+                rc = ioctlsocket(fd, FIONBIO, &nonblocking);
+#else
+                int flags;
+                flags = fcntl(fd, F_GETFL, 0);
+                if (flags < 0) {
+                        ret = -errno;
+                        if (options->fd < 0 ||
+                            options->clodestroy == 1) {
+                                tcpsocket_closesocket(fd);
+                        }
+                        medusa_errorf("fcntl getfl failed");
+                        goto bail;
+                }
+                flags = (options->nonblocking) ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+                rc = fcntl(fd, F_SETFL, flags);
+#endif
+                if (rc != 0) {
+                        ret = -errno;
+                        if (options->fd < 0 ||
+                            options->clodestroy == 1) {
+                                tcpsocket_closesocket(fd);
+                        }
+                        medusa_errorf("fcntl setfl failed");
+                        goto bail;
+                }
+        }
+        if (options->sport > 0 ||
+            options->saddress != NULL) {
+                unsigned int sprotocol;
+                const char *saddress;
+                unsigned short sport;
+
+                struct sockaddr_storage bind_sockaddr;
+
+                sprotocol = options->sprotocol;
+                saddress  = options->saddress;
+                sport     = options->sport;
+
+                if (sprotocol == MEDUSA_TCPSOCKET_PROTOCOL_IPV4) {
+                        struct sockaddr_in *bind_sockaddr_in;
+bind_ipv4:
+                        bind_sockaddr_in = (struct sockaddr_in *) &bind_sockaddr;
+                        bind_sockaddr_in->sin_family = AF_INET;
+                        if (saddress == NULL) {
+                                saddress = "0.0.0.0";
+                        } else if (strcmp(saddress, "localhost") == 0) {
+                                saddress = "127.0.0.1";
+                        } else if (strcmp(saddress, "loopback") == 0) {
+                                saddress = "127.0.0.1";
+                        }
+                        rc = inet_pton(AF_INET, saddress, &bind_sockaddr_in->sin_addr);
+                        if (rc == 0) {
+                                ret = -EINVAL;
+                                if (options->fd < 0 ||
+                                    options->clodestroy == 1) {
+                                        tcpsocket_closesocket(fd);
+                                }
+                                medusa_errorf("source address: %s is invalid", saddress);
+                                goto bail;
+                        } else if (rc < 0) {
+                                ret = -EINVAL;
+                                if (options->fd < 0 ||
+                                    options->clodestroy == 1) {
+                                        tcpsocket_closesocket(fd);
+                                }
+                                medusa_errorf("source address: %s is invalid", saddress);
+                                goto bail;
+                        }
+                        bind_sockaddr_in->sin_port = htons(sport);
+                } else if (sprotocol == MEDUSA_TCPSOCKET_PROTOCOL_IPV6) {
+                        struct sockaddr_in6 *bind_sockaddr_in6;
+bind_ipv6:
+                        bind_sockaddr_in6 = (struct sockaddr_in6 *) &bind_sockaddr;
+                        bind_sockaddr_in6->sin6_family = AF_INET6;
+                        if (saddress == NULL) {
+                                saddress = "0.0.0.0";
+                        } else if (strcmp(saddress, "localhost") == 0) {
+                                saddress = "::1";
+                        } else if (strcmp(saddress, "loopback") == 0) {
+                                saddress = "::1";
+                        }
+                        rc = inet_pton(AF_INET6, saddress, &bind_sockaddr_in6->sin6_addr);
+                        if (rc == 0) {
+                                ret = -EINVAL;
+                                if (options->fd < 0 ||
+                                    options->clodestroy == 1) {
+                                        tcpsocket_closesocket(fd);
+                                }
+                                medusa_errorf("source address: %s is invalid", saddress);
+                                goto bail;
+                        } else if (rc < 0) {
+                                ret = -EINVAL;
+                                if (options->fd < 0 ||
+                                    options->clodestroy == 1) {
+                                        tcpsocket_closesocket(fd);
+                                }
+                                medusa_errorf("source address: %s is invalid", saddress);
+                                goto bail;
+                        }
+                        bind_sockaddr_in6->sin6_port = htons(sport);
+                } else if (saddress == NULL) {
+                        if (addrinfo_entry->protocol == MEDUSA_TCPSOCKET_PROTOCOL_IPV4) {
+                                saddress = "0.0.0.0";
+                                goto bind_ipv4;
+                        } else if (addrinfo_entry->protocol == MEDUSA_TCPSOCKET_PROTOCOL_IPV6) {
+                                saddress = "::";
+                                goto bind_ipv6;
+                        } else {
+                                medusa_errorf("unknown addrinfo entry protocol: %d", addrinfo_entry->protocol);
+                                ret = -EINVAL;
+                                goto bail;
+                        }
+                } else if (strcmp(saddress, "localhost") == 0) {
+                        saddress = "127.0.0.1";
+                        goto bind_ipv4;
+                } else if (strcmp(saddress, "loopback") == 0) {
+                        saddress = "127.0.0.1";
+                        goto bind_ipv4;
+                } else {
+                        struct sockaddr_in bind_sockaddr_in;
+                        struct sockaddr_in6 bind_sockaddr_in6;
+                        rc = inet_pton(AF_INET, saddress, &bind_sockaddr_in.sin_addr);
+                        if (rc > 0) {
+                                goto bind_ipv4;
+                        }
+                        rc = inet_pton(AF_INET6, saddress, &bind_sockaddr_in6.sin6_addr);
+                        if (rc > 0) {
+                                goto bind_ipv6;
+                        }
+                        ret = -EINVAL;
+                        if (options->fd < 0 ||
+                            options->clodestroy == 1) {
+                                tcpsocket_closesocket(fd);
+                        }
+                        medusa_errorf("source address: %s is invalid", saddress);
+                        goto bail;
+                }
+
+                if (options->reuseaddr != 0) {
+                        int on;
+                        on = 1;
+                        rc = setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (void *) &on, sizeof(on));
+                        if (rc < 0) {
+                                ret = -errno;
+                                if (options->fd < 0 ||
+                                    options->clodestroy == 1) {
+                                        tcpsocket_closesocket(fd);
+                                }
+                                medusa_errorf("setsockopt failed");
+                                goto bail;
+                        }
+                }
+                if (options->reuseport != 0) {
+                        int on;
+                        on = 1;
+#if defined(SO_REUSEPORT)
+                        rc = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (void *) &on, sizeof(on));
+#else
+                        (void) on;
+                        rc = 0;
+#endif
+                        if (rc < 0) {
+                                ret = -errno;
+                                if (options->fd < 0 ||
+                                    options->clodestroy == 1) {
+                                        tcpsocket_closesocket(fd);
+                                }
+                                medusa_errorf("setsockopt failed");
+                                goto bail;
+                        }
+                }
+                rc = bind(fd, (struct sockaddr *) &bind_sockaddr, sizeof(struct sockaddr_storage));
+                if (rc != 0) {
+                        ret = -errno;
+                        if (options->fd < 0 ||
+                            options->clodestroy == 1) {
+                                tcpsocket_closesocket(fd);
+                        }
+                        medusa_errorf("bind failed");
+                        goto bail;
+                }
+        }
+        if (deferred) {
+                /* connected with the first write, see tcpsocket_fastopen_start() */
+                *pfd = fd;
+                *perror = 0;
+                return 0;
+        }
+        rc = connect(fd, (const struct sockaddr *) &addrinfo_entry->sockaddr, addrinfo_entry->sockaddr_length);
+        if (rc != 0) {
+#if defined(__WINDOWS__)
+                if (rc == SOCKET_ERROR) {
+                        switch (WSAGetLastError()) {
+                                case WSAEWOULDBLOCK:    errno = EWOULDBLOCK;    break;
+                                case WSATRY_AGAIN:      errno = EAGAIN;         break;
+                                case WSAEINTR:          errno = EINTR;          break;
+                                case WSAECONNRESET:     errno = ECONNRESET;     break;
+                        }
+                }
+#endif
+                rc = -errno;
+                if (rc != -EINPROGRESS &&
+                    rc != -EALREADY &&
+                    rc != -EWOULDBLOCK &&
+                    rc != -EINTR) {
+                        if (options->fd < 0) {
+                                tcpsocket_closesocket(fd);
+                        }
+                        *perror = rc;
+                        return 0;
+                }
+        }
+        *pfd = fd;
+        *perror = rc;
+        return 0;
+bail:   return ret;
+}
+
+static int tcpsocket_connect_attach (struct medusa_tcpsocket *tcpsocket, const struct medusa_tcpsocket_connect_options *options, int fd, int connected)
+{
+        int rc;
+        int ret;
+
+        struct medusa_io_init_options io_init_options;
+
+        rc = medusa_io_init_options_default(&io_init_options);
+        if (rc < 0) {
+                tcpsocket_closesocket(fd);
+                ret = rc;
+                goto bail;
+        }
+        io_init_options.monitor    = tcpsocket->subject.monitor;
+        io_init_options.fd         = fd;
+        io_init_options.events     = MEDUSA_IO_EVENT_IN;
+        io_init_options.onevent    = tcpsocket_io_onevent;
+        io_init_options.context    = tcpsocket;
+        io_init_options.clodestroy = options->clodestroy;
+        io_init_options.enabled    = 0;
+        tcpsocket->io = medusa_io_create_with_options_unlocked(&io_init_options);
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket->io)) {
+                medusa_errorf("can not create io for tcpsocket");
+                ret = MEDUSA_PTR_ERR(tcpsocket->io);
+                if (options->fd < 0 ||
+                    options->clodestroy == 1) {
+                        tcpsocket_closesocket(fd);
+                }
+                goto bail;
+        }
+
+        rc = medusa_tcpsocket_set_nonblocking_unlocked(tcpsocket, options->nonblocking);
+        if (rc < 0) {
+                medusa_errorf("can not set nonblocking option for tcpsocket");
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_nodelay_unlocked(tcpsocket, options->nodelay);
+        if (rc < 0) {
+                medusa_errorf("can not set nodelay option for tcpsocket");
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_buffered_unlocked(tcpsocket, options->buffered);
+        if (rc < 0) {
+                medusa_errorf("can not set buffered option for tcpsocket");
+                ret = rc;
+                goto bail;
+        }
+        if (medusa_tcpsocket_get_buffered_unlocked(tcpsocket)) {
+                rc = medusa_tcpsocket_set_buffered_read_limit_unlocked(tcpsocket, options->buffered_read_limit);
+                if (rc < 0) {
+                        medusa_errorf("can not set buffered read limit option for tcpsocket");
+                        ret = rc;
+                        goto bail;
+                }
+                rc = medusa_tcpsocket_set_buffered_write_limit_unlocked(tcpsocket, options->buffered_write_limit);
+                if (rc < 0) {
+                        medusa_errorf("can not set buffered write limit option for tcpsocket");
+                        ret = rc;
+                        goto bail;
+                }
+        }
+        rc = medusa_tcpsocket_set_clodestroy_unlocked(tcpsocket, options->clodestroy);
+        if (rc < 0) {
+                medusa_errorf("can not set clodestroy option for tcpsocket");
+                ret = rc;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_set_enabled_unlocked(tcpsocket, options->enabled);
+        if (rc < 0) {
+                medusa_errorf("can not set enabled option for tcpsocket");
+                ret = rc;
+                goto bail;
+        }
+
+        if (connected) {
+                rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_CONNECTED, 0, __LINE__);
+                if (rc < 0) {
+                        medusa_errorf("can not set state to: %d", MEDUSA_TCPSOCKET_STATE_CONNECTED);
+                        ret = rc;
+                        goto bail;
+                }
+                rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_CONNECTED, NULL);
+                if (rc < 0) {
+                        medusa_errorf("tcpsocket onevent failed, rc: %d", rc);
+                        ret = rc;
+                        goto bail;
+                }
+        } else {
+                rc = medusa_io_add_events_unlocked(tcpsocket->io, MEDUSA_IO_EVENT_OUT);
+                if (rc < 0) {
+                        medusa_errorf("can not add io events");
+                        ret = rc;
+                        goto bail;
+                }
+        }
+
+        return 0;
+bail:   return ret;
+}
+
+static int tcpsocket_race_next (struct tcpsocket_race *race);
+static int tcpsocket_set_connecting (struct medusa_tcpsocket *tcpsocket);
+
+static int tcpsocket_race_arm (struct tcpsocket_race *race, double interval)
+{
+        int rc;
+        rc = medusa_timer_set_interval_unlocked(race->timer, interval);
+        if (rc < 0) {
+                return rc;
+        }
+        return medusa_timer_restart_unlocked(race->timer);
+}
+
+static int tcpsocket_race_finish (struct tcpsocket_race *race, int fd)
+{
+        struct medusa_tcpsocket *tcpsocket = race->tcpsocket;
+        tcpsocket->race = NULL;
+        tcpsocket_race_destroy(race);
+        return tcpsocket_connect_attach(tcpsocket, tcpsocket->coptions, fd, 1);
+}
+
+static void tcpsocket_race_error (struct medusa_tcpsocket *tcpsocket, int error, int line)
+{
+        struct medusa_tcpsocket_event_error medusa_tcpsocket_event_error;
+        medusa_tcpsocket_event_error.state = tcpsocket->state;
+        medusa_tcpsocket_event_error.error = -error;
+        medusa_tcpsocket_event_error.line  = line;
+        tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_ERROR, medusa_tcpsocket_event_error.error, line);
+        medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_ERROR, &medusa_tcpsocket_event_error);
+}
+
+static int tcpsocket_race_io_onevent (struct medusa_io *io, unsigned int events, void *context, void *param)
+{
+        int rc;
+        int fd;
+        int valopt;
+        socklen_t vallen;
+        struct medusa_monitor *monitor;
+        struct tcpsocket_race *race;
+        struct medusa_tcpsocket *tcpsocket;
+        struct tcpsocket_race_attempt *attempt = context;
+
+        (void) param;
+
+        if (attempt == NULL) {
+                return 0;
+        }
+        if (!(events & (MEDUSA_IO_EVENT_OUT | MEDUSA_IO_EVENT_ERR | MEDUSA_IO_EVENT_HUP))) {
+                return 0;
+        }
+
+        monitor = medusa_io_get_monitor(io);
+        medusa_monitor_lock(monitor);
+
+        race      = attempt->race;
+        tcpsocket = race->tcpsocket;
+        fd        = medusa_io_get_fd_unlocked(io);
+
+        vallen = sizeof(valopt);
+        rc = getsockopt(fd, SOL_SOCKET, SO_ERROR, (void *) &valopt, &vallen);
+        if (rc < 0) {
+                valopt = errno;
+        }
+        if (valopt != 0) {
+                race->error = -valopt;
+                TAILQ_REMOVE(&race->attempts, attempt, tailq);
+                tcpsocket_race_attempt_destroy(attempt);
+                rc = tcpsocket_race_next(race);
+        } else {
+                medusa_io_set_clodestroy_unlocked(io, 0);
+                TAILQ_REMOVE(&race->attempts, attempt, tailq);
+                tcpsocket_race_attempt_destroy(attempt);
+                rc = tcpsocket_race_finish(race, fd);
+        }
+        if (rc < 0) {
+                tcpsocket_race_error(tcpsocket, rc, __LINE__);
+        }
+
+        medusa_monitor_unlock(monitor);
+        return 0;
+}
+
+static int tcpsocket_race_timer_onevent (struct medusa_timer *timer, unsigned int events, void *context, void *param)
+{
+        int rc;
+        struct medusa_monitor *monitor;
+        struct medusa_tcpsocket *tcpsocket;
+        struct tcpsocket_race *race = context;
+
+        (void) param;
+
+        if (race == NULL) {
+                return 0;
+        }
+
+        if (events & MEDUSA_TIMER_EVENT_TIMEOUT) {
+                monitor = medusa_timer_get_monitor(timer);
+                medusa_monitor_lock(monitor);
+                tcpsocket = race->tcpsocket;
+                if (race->started) {
+                        rc = tcpsocket_race_next(race);
+                } else {
+                        /* resolution delay is over, go with what is there */
+                        rc = tcpsocket_set_connecting(tcpsocket);
+                        if (rc >= 0 && tcpsocket->race == race) {
+                                race->started = 1;
+                                rc = tcpsocket_race_next(race);
+                        }
+                }
+                if (rc < 0) {
+                        tcpsocket_race_error(tcpsocket, rc, __LINE__);
+                }
+                medusa_monitor_unlock(monitor);
+        }
+
+        return 0;
+}
+
+static int tcpsocket_race_next (struct tcpsocket_race *race)
+{
+        int rc;
+        int fd;
+        int error;
+        struct tcpsocket_race_attempt *attempt;
+        struct tcpsocket_addrinfo_entry *addrinfo_entry;
+        struct medusa_io_init_options io_init_options;
+        struct medusa_tcpsocket *tcpsocket = race->tcpsocket;
+
+        while ((addrinfo_entry = TAILQ_FIRST(&race->entries)) != NULL) {
+                TAILQ_REMOVE(&race->entries, addrinfo_entry, tailq);
+                race->protocol = (addrinfo_entry->protocol == MEDUSA_TCPSOCKET_PROTOCOL_IPV4) ? MEDUSA_TCPSOCKET_PROTOCOL_IPV6 : MEDUSA_TCPSOCKET_PROTOCOL_IPV4;
+                rc = tcpsocket_connect_entry(tcpsocket->coptions, addrinfo_entry, 0, &fd, &error);
+                tcpsocket_addrinfo_entry_destroy(addrinfo_entry);
+                if (rc < 0) {
+                        return rc;
+                }
+                if (fd < 0) {
+                        race->error = error;
+                        continue;
+                }
+                if (error == 0) {
+                        return tcpsocket_race_finish(race, fd);
+                }
+
+                attempt = malloc(sizeof(struct tcpsocket_race_attempt));
+                if (attempt == NULL) {
+                        tcpsocket_closesocket(fd);
+                        return -ENOMEM;
+                }
+                memset(attempt, 0, sizeof(struct tcpsocket_race_attempt));
+                attempt->race = race;
+                rc = medusa_io_init_options_default(&io_init_options);
+                if (rc < 0) {
+                        tcpsocket_closesocket(fd);
+                        free(attempt);
+                        return rc;
+                }
+                io_init_options.monitor    = tcpsocket->subject.monitor;
+                io_init_options.fd         = fd;
+                io_init_options.events     = MEDUSA_IO_EVENT_OUT;
+                io_init_options.onevent    = tcpsocket_race_io_onevent;
+                io_init_options.context    = attempt;
+                io_init_options.clodestroy = 1;
+                io_init_options.enabled    = 1;
+                attempt->io = medusa_io_create_with_options_unlocked(&io_init_options);
+                if (MEDUSA_IS_ERR_OR_NULL(attempt->io)) {
+                        rc = MEDUSA_PTR_ERR(attempt->io);
+                        tcpsocket_closesocket(fd);
+                        free(attempt);
+                        return rc;
+                }
+                TAILQ_INSERT_TAIL(&race->attempts, attempt, tailq);
+
+                /* next address gets its chance after the attempt delay, not
+                 * after the whole connect timeout */
+                if (!TAILQ_EMPTY(&race->entries)) {
+                        rc = tcpsocket_race_arm(race, tcpsocket->coptions->attempt_delay);
+                        if (rc < 0) {
+                                return rc;
                         }
                 }
+                return 0;
         }
-        if (events & MEDUSA_IO_EVENT_DESTROY) {
-                medusa_io_set_events_unlocked(io, 0);
-                if (medusa_io_get_clodestroy_unlocked(io) > 0) {
-                        int fd;
-                        fd = medusa_io_get_fd_unlocked(io);
-                        if (fd >= 0) {
-                                tcpsocket_closesocket(fd);
-                                medusa_io_set_clodestroy_unlocked(io, 0);
-                        }
-                }
+        /* answers still on the way may bring more addresses */
+        if (TAILQ_EMPTY(&race->attempts) && !race->resolving) {
+                return race->error;
         }
-        medusa_monitor_unlock(monitor);
         return 0;
-bail:   medusa_monitor_unlock(monitor);
-        return -EIO;
 }
 
-static int tcpsocket_init_unlocked (struct medusa_tcpsocket *tcpsocket, struct medusa_monitor *monitor, int (*onevent) (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param), void *context)
+static struct tcpsocket_race * tcpsocket_race_create (struct medusa_tcpsocket *tcpsocket, const struct medusa_tcpsocket_connect_options *options)
 {
         int rc;
-        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
-                return -EINVAL;
+        struct tcpsocket_race *race;
+
+        if (tcpsocket->coptions == NULL) {
+                tcpsocket->coptions = medusa_tcpsocket_connect_options_duplicate(options);
+                if (MEDUSA_IS_ERR_OR_NULL(tcpsocket->coptions)) {
+                        rc = MEDUSA_PTR_ERR(tcpsocket->coptions);
+                        tcpsocket->coptions = NULL;
+                        return MEDUSA_ERR_PTR(rc);
+                }
         }
-        if (MEDUSA_IS_ERR_OR_NULL(monitor)) {
-                return -EINVAL;
+
+        race = malloc(sizeof(struct tcpsocket_race));
+        if (race == NULL) {
+                return MEDUSA_ERR_PTR(-ENOMEM);
         }
-        if (MEDUSA_IS_ERR_OR_NULL(onevent)) {
-                return -EINVAL;
+        memset(race, 0, sizeof(struct tcpsocket_race));
+        race->tcpsocket = tcpsocket;
+        race->protocol  = MEDUSA_TCPSOCKET_PROTOCOL_ANY;
+        race->error     = -ECONNREFUSED;
+        TAILQ_INIT(&race->entries);
+        TAILQ_INIT(&race->attempts);
+        tcpsocket->race = race;
+
+        race->timer = medusa_timer_create_unlocked(tcpsocket->subject.monitor, tcpsocket_race_timer_onevent, race);
+        if (MEDUSA_IS_ERR_OR_NULL(race->timer)) {
+                rc = MEDUSA_PTR_ERR(race->timer);
+                race->timer = NULL;
+                return MEDUSA_ERR_PTR(rc);
         }
-        memset(tcpsocket, 0, sizeof(struct medusa_tcpsocket));
-        medusa_subject_set_type(&tcpsocket->subject, MEDUSA_SUBJECT_TYPE_TCPSOCKET);
-        tcpsocket->subject.monitor = NULL;
-        tcpsocket_set_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_NONE);
-        rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_DISCONNECTED, 0, __LINE__);
-        if (rc < 0 ) {
-                return rc;
+        rc = medusa_timer_set_singleshot_unlocked(race->timer, 1);
+        if (rc < 0) {
+                return MEDUSA_ERR_PTR(rc);
         }
-        tcpsocket->onevent = onevent;
-        tcpsocket->context = context;
-        return medusa_monitor_add_unlocked(monitor, &tcpsocket->subject);
+        return race;
 }
 
-static void tcpsocket_uninit_unlocked (struct medusa_tcpsocket *tcpsocket)
+static int tcpsocket_race_add (struct tcpsocket_race *race, struct tcpsocket_addrinfo *addrinfo)
 {
-        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
-                return;
+        unsigned int protocol;
+        struct tcpsocket_addrinfo entries;
+        struct tcpsocket_addrinfo_entry *addrinfo_entry;
+
+        if (addrinfo == NULL || TAILQ_EMPTY(addrinfo)) {
+                return 0;
         }
-        if (tcpsocket->subject.monitor != NULL) {
-                if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->io)) {
-                        medusa_io_destroy_unlocked(tcpsocket->io);
-                        tcpsocket->io = NULL;
+
+        /* addresses still waiting for their turn are merged with the new
+         * ones, and families alternate again from where the race is */
+        TAILQ_INIT(&entries);
+        while ((addrinfo_entry = TAILQ_FIRST(&race->entries)) != NULL) {
+                TAILQ_REMOVE(&race->entries, addrinfo_entry, tailq);
+                TAILQ_INSERT_TAIL(&entries, addrinfo_entry, tailq);
+        }
+        while ((addrinfo_entry = TAILQ_FIRST(addrinfo)) != NULL) {
+                TAILQ_REMOVE(addrinfo, addrinfo_entry, tailq);
+                TAILQ_INSERT_TAIL(&entries, addrinfo_entry, tailq);
+        }
+        protocol = (race->protocol != MEDUSA_TCPSOCKET_PROTOCOL_ANY) ? race->protocol : TAILQ_FIRST(&entries)->protocol;
+        while (!TAILQ_EMPTY(&entries)) {
+                TAILQ_FOREACH(addrinfo_entry, &entries, tailq) {
+                        if (addrinfo_entry->protocol == protocol) {
+                                break;
+                        }
                 }
-                medusa_monitor_del_unlocked(&tcpsocket->subject);
-        } else {
-                medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_DESTROY, NULL);
+                if (addrinfo_entry == NULL) {
+                        addrinfo_entry = TAILQ_FIRST(&entries);
+                }
+                TAILQ_REMOVE(&entries, addrinfo_entry, tailq);
+                TAILQ_INSERT_TAIL(&race->entries, addrinfo_entry, tailq);
+                protocol = (addrinfo_entry->protocol == MEDUSA_TCPSOCKET_PROTOCOL_IPV4) ? MEDUSA_TCPSOCKET_PROTOCOL_IPV6 : MEDUSA_TCPSOCKET_PROTOCOL_IPV4;
+        }
+
+        if (!race->started) {
+                return 0;
         }
+        /* a race that ran dry goes on at once, otherwise the attempts in
+         * flight get their delay first */
+        if (TAILQ_EMPTY(&race->attempts)) {
+                return tcpsocket_race_next(race);
+        }
+        if (!medusa_timer_get_enabled_unlocked(race->timer)) {
+                return tcpsocket_race_arm(race, race->tcpsocket->coptions->attempt_delay);
+        }
+        return 0;
 }
 
-static struct medusa_tcpsocket * tcpsocket_create_unlocked (struct medusa_monitor *monitor, int (*onevent) (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param), void *context)
+static int tcpsocket_race_start (struct medusa_tcpsocket *tcpsocket, const struct medusa_tcpsocket_connect_options *options, struct tcpsocket_addrinfo *addrinfo, int resolving)
 {
         int rc;
-        struct medusa_tcpsocket *tcpsocket;
-        if (MEDUSA_IS_ERR_OR_NULL(monitor)) {
-                return MEDUSA_ERR_PTR(-EINVAL);
-        }
-        if (MEDUSA_IS_ERR_OR_NULL(onevent)) {
-                return MEDUSA_ERR_PTR(-EINVAL);
+        struct tcpsocket_race *race;
+
+        race = tcpsocket->race;
+        if (race == NULL) {
+                race = tcpsocket_race_create(tcpsocket, options);
+                if (MEDUSA_IS_ERR_OR_NULL(race)) {
+                        return MEDUSA_PTR_ERR(race);
+                }
         }
-#if defined(MEDUSA_TCPSOCKET_USE_POOL) && (MEDUSA_TCPSOCKET_USE_POOL == 1)
-        tcpsocket = medusa_pool_malloc(g_pool);
-#else
-        tcpsocket = malloc(sizeof(struct medusa_tcpsocket));
-#endif
-        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
-                return MEDUSA_ERR_PTR(-ENOMEM);
+        rc = medusa_timer_set_enabled_unlocked(race->timer, 0);
+        if (rc < 0) {
+                return rc;
         }
-        memset(tcpsocket, 0, sizeof(struct medusa_tcpsocket));
-        rc = tcpsocket_init_unlocked(tcpsocket, monitor, onevent, context);
+        race->resolving = resolving;
+        rc = tcpsocket_race_add(race, addrinfo);
         if (rc < 0) {
-                struct medusa_tcpsocket_event_error medusa_tcpsocket_event_error;
-                medusa_tcpsocket_event_error.state = tcpsocket->state;
-                medusa_tcpsocket_event_error.error = -rc;
-                medusa_tcpsocket_event_error.line  = __LINE__;
-                tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_ERROR, medusa_tcpsocket_event_error.error, __LINE__);
-                medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_ERROR, &medusa_tcpsocket_event_error);
+                return rc;
         }
-        return tcpsocket;
+        race->started = 1;
+        return tcpsocket_race_next(race);
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_bind_options_default (struct medusa_tcpsocket_bind_options *options)
+/* the last answer is in, nothing more will join the race */
+static int tcpsocket_race_resolved (struct tcpsocket_race *race, struct tcpsocket_addrinfo *addrinfo)
 {
-        if (options == NULL) {
-                return -EINVAL;
+        int rc;
+        race->resolving = 0;
+        rc = tcpsocket_race_add(race, addrinfo);
+        if (rc < 0) {
+                return rc;
+        }
+        if (TAILQ_EMPTY(&race->attempts) && TAILQ_EMPTY(&race->entries)) {
+                return race->error;
         }
-        memset(options, 0, sizeof(struct medusa_tcpsocket_bind_options));
-        options->protocol   = MEDUSA_TCPSOCKET_PROTOCOL_ANY;
-        options->backlog    = 128;
-        options->fd         = -1;
-        options->clodestroy = 1;
         return 0;
 }
 
-__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_bind_with_options_unlocked (const struct medusa_tcpsocket_bind_options *options)
+static int tcpsocket_race_possible (const struct medusa_tcpsocket *tcpsocket, const struct medusa_tcpsocket_connect_options *options)
 {
-        int rc;
-        int fd;
-        int ret;
-
-        unsigned int protocol;
-        const char *address;
-        unsigned short port;
-        unsigned int length;
-
-        struct sockaddr *sockaddr;
-        struct sockaddr_in sockaddr_in;
-        struct sockaddr_in6 sockaddr_in6;
-
-        struct medusa_io_init_options io_init_options;
-        struct medusa_tcpsocket *tcpsocket;
-
-        tcpsocket = NULL;
+        /* nothing goes out before the first write with fast open, there is
+         * nothing to race */
+        return (tcpsocket_fastopen_possible(tcpsocket, options) == 0) &&
+               (options->fd < 0) &&
+               (options->nonblocking) &&
+               (options->attempt_delay >= 0);
+}
 
-        if (MEDUSA_IS_ERR_OR_NULL(options)) {
-                ret = -EINVAL;
-                goto bail;
+static int tcpsocket_set_connecting (struct medusa_tcpsocket *tcpsocket)
+{
+        int rc;
+        rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_RESOLVED, 0, __LINE__);
+        if (rc < 0) {
+                medusa_errorf("can not set state to: %d", MEDUSA_TCPSOCKET_STATE_RESOLVED);
+                return rc;
         }
-        if (MEDUSA_IS_ERR_OR_NULL(options->monitor)) {
-                ret = -EINVAL;
-                goto bail;
+        rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_RESOLVED, NULL);
+        if (rc < 0) {
+                medusa_errorf("tcpsocket onevent failed, rc: %d", rc);
+                return rc;
         }
-        if (MEDUSA_IS_ERR_OR_NULL(options->onevent)) {
-                ret = -EINVAL;
-                goto bail;
+        rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_CONNECTING, 0, __LINE__);
+        if (rc < 0) {
+                medusa_errorf("can not set state to: %d", MEDUSA_TCPSOCKET_STATE_CONNECTING);
+                return rc;
         }
-
-        protocol = options->protocol;
-        address  = options->address;
-        port     = options->port;
-
-        if (protocol == MEDUSA_TCPSOCKET_PROTOCOL_IPV4) {
-ipv4:
-                memset(&sockaddr_in, 0, sizeof(sockaddr_in));
-                sockaddr_in.sin_family = AF_INET;
-                if (address == NULL) {
-                        address = "0.0.0.0";
-                } else if (strcmp(address, "localhost") == 0) {
-                        address = "127.0.0.1";
-                } else if (strcmp(address, "loopback") == 0) {
-                        address = "127.0.0.1";
-                }
-                rc = inet_pton(AF_INET, address, &sockaddr_in.sin_addr);
-                if (rc == 0) {
-                        ret = -EINVAL;
-                        goto bail;
-                } else if (rc < 0) {
-                        ret = -EINVAL;
-                        goto bail;
-                }
-                sockaddr_in.sin_port = htons(port);
-                sockaddr = (struct sockaddr *) &sockaddr_in;
-                length = sizeof(struct sockaddr_in);
-        } else if (protocol == MEDUSA_TCPSOCKET_PROTOCOL_IPV6) {
-ipv6:
-                memset(&sockaddr_in6, 0, sizeof(sockaddr_in6));
-                sockaddr_in6.sin6_family = AF_INET6;
-                if (address == NULL) {
-                        address = "0.0.0.0";
-                } else if (strcmp(address, "localhost") == 0) {
-                        address = "::1";
-                } else if (strcmp(address, "loopback") == 0) {
-                        address = "::1";
-                }
-                rc = inet_pton(AF_INET6, address, &sockaddr_in6.sin6_addr);
-                if (rc == 0) {
-                        ret = -EINVAL;
-                        goto bail;
-                } else if (rc < 0) {
-                        ret = -EINVAL;
-                        goto bail;
-                }
-                sockaddr_in6.sin6_port = htons(port);
-                sockaddr = (struct sockaddr *) &sockaddr_in6;
-                length = sizeof(struct sockaddr_in6);
-        } else if (address == NULL) {
-                address = "0.0.0.0";
-                goto ipv4;
-        } else if (strcmp(address, "localhost") == 0) {
-                address = "127.0.0.1";
-                goto ipv4;
-        } else if (strcmp(address, "loopback") == 0) {
-                address = "127.0.0.1";
-                goto ipv4;
-        } else {
-                rc = inet_pton(AF_INET, address, &sockaddr_in.sin_addr);
-                if (rc > 0) {
-                        goto ipv4;
-                }
-                rc = inet_pton(AF_INET6, address, &sockaddr_in6.sin6_addr);
-                if (rc > 0) {
-                        goto ipv6;
-                }
-                ret = -EINVAL;
-                goto bail;
+        rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_CONNECTING, NULL);
+        if (rc < 0) {
+                medusa_errorf("tcpsocket onevent failed, rc: %d", rc);
+                return rc;
         }
+        return 0;
+}
+
+static int medusa_tcpsocket_connect_resolved (struct medusa_tcpsocket *tcpsocket, const struct medusa_tcpsocket_connect_options *options, struct tcpsocket_addrinfo *addrinfo, int resolving)
+{
+        int rc;
+        int fd;
+        int ret;
+        int error;
+        int fastopen;
 
-        tcpsocket = tcpsocket_create_unlocked(options->monitor, options->onevent, options->context);
-        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
-                ret = MEDUSA_PTR_ERR(tcpsocket);
-                goto bail;
-        }
-        tcpsocket_add_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BIND);
+        struct tcpsocket_addrinfo_entry *addrinfo_entry;
 
-        rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_BINDING, 0, __LINE__);
+        rc = tcpsocket_set_connecting(tcpsocket);
         if (rc < 0) {
                 ret = rc;
                 goto bail;
         }
-        rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_BINDING, NULL);
-        if (rc < 0) {
-                ret = rc;
-                goto bail;
+
+        fastopen = tcpsocket_fastopen_possible(tcpsocket, options);
+
+        if (tcpsocket_race_possible(tcpsocket, options) &&
+            ((resolving) ||
+             (tcpsocket->race != NULL) ||
+             ((TAILQ_FIRST(addrinfo) != NULL) &&
+              (TAILQ_NEXT(TAILQ_FIRST(addrinfo), tailq) != NULL)))) {
+                rc = tcpsocket_race_start(tcpsocket, options, addrinfo, resolving);
+                if (rc < 0) {
+                        medusa_errorf("can not connect to any resolved address, rc: %d, %s", rc, strerror(-rc));
+                        ret = rc;
+                        goto bail;
+                }
+                return 0;
         }
 
-        if (options->fd >= 0) {
-                fd = options->fd;
-        } else {
-                fd = socket(sockaddr->sa_family, SOCK_STREAM, 0);
+        fd = -1;
+        error = -ENOENT;
+        TAILQ_FOREACH(addrinfo_entry, addrinfo, tailq) {
+                rc = tcpsocket_connect_entry(options, addrinfo_entry, fastopen, &fd, &error);
+                if (rc < 0) {
+                        ret = rc;
+                        goto bail;
+                }
+                if (fd >= 0) {
+                        break;
+                }
         }
         if (fd < 0) {
-                ret = -errno;
+                medusa_errorf("can not connect to any resolved address, rc: %d, %s", error, strerror(-error));
+                ret = error;
                 goto bail;
         }
-        {
-                int rc;
-                int on;
-                on = !!options->reuseaddr;
-                rc = setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (void *) &on, sizeof(on));
-                if (rc < 0) {
-                        if (options->fd < 0 ||
-                            options->clodestroy == 1) {
+        if (fastopen) {
+                tcpsocket->fastopen_pending = malloc(sizeof(struct tcpsocket_fastopen));
+                if (tcpsocket->fastopen_pending == NULL) {
+                        if (options->fd < 0) {
                                 tcpsocket_closesocket(fd);
                         }
-                        ret = -errno;
+                        ret = -ENOMEM;
                         goto bail;
                 }
+                memcpy(&tcpsocket->fastopen_pending->sockaddr, &addrinfo_entry->sockaddr, addrinfo_entry->sockaddr_length);
+                tcpsocket->fastopen_pending->sockaddr_length = addrinfo_entry->sockaddr_length;
         }
-        {
-                int rc;
-                int on;
-                on = !!options->reuseport;
-#if defined(SO_REUSEPORT)
-                rc = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (void *) &on, sizeof(on));
-#else
-                (void) on;
-                rc = 0;
-#endif
+
+        rc = tcpsocket_connect_attach(tcpsocket, options, fd, (error == 0));
+        if (rc < 0) {
+                ret = rc;
+                goto bail;
+        }
+
+        return 0;
+bail:   return ret;
+}
+
+static int tcpsocket_dnsresolver_onevent (struct medusa_dnsresolver_lookup *dnsresolver_lookup, unsigned int events, void *context, void *param)
+{
+        int rc;
+        struct tcpsocket_addrinfo *tcpsocket_addrinfo;
+        struct tcpsocket_addrinfo_entry *tcpsocket_addrinfo_entry;
+
+        struct medusa_tcpsocket *tcpsocket = context;
+        struct medusa_monitor *monitor = medusa_tcpsocket_get_monitor(tcpsocket);
+
+        medusa_monitor_lock(monitor);
+
+        if (events & MEDUSA_DNSRESOLVER_LOOKUP_EVENT_ENTRY) {
+                struct medusa_dnsresolver_lookup_event_entry *medusa_dnsresolver_lookup_event_entry = param;
+
+                tcpsocket_addrinfo = medusa_dnsresolver_lookup_get_userdata_ptr_unlocked(dnsresolver_lookup);
+                if (tcpsocket_addrinfo == NULL) {
+                        tcpsocket_addrinfo = tcpsocket_addrinfo_create();
+                        if (tcpsocket_addrinfo == NULL) {
+                                medusa_errorf("can not create addrinfo");
+                                goto error;
+                        }
+                        rc = medusa_dnsresolver_lookup_set_userdata_ptr_unlocked(dnsresolver_lookup, tcpsocket_addrinfo);
+                        if (rc < 0) {
+                                medusa_errorf("can not set userdata ptr");
+                                tcpsocket_addrinfo_destroy(tcpsocket_addrinfo);
+                                goto error;
+                        }
+                }
+
+                tcpsocket_addrinfo_entry = tcpsocket_addrinfo_entry_create_from_dnsresolver(medusa_dnsresolver_lookup_event_entry);
+                if (tcpsocket_addrinfo_entry == NULL) {
+                        medusa_errorf("can not create entry from dnsresolver");
+                        goto error;
+                }
+
+                rc = tcpsocket_addrinfo_add_entry(tcpsocket_addrinfo, tcpsocket_addrinfo_entry);
                 if (rc < 0) {
-                        if (options->fd < 0 ||
-                            options->clodestroy == 1) {
-                                tcpsocket_closesocket(fd);
+                        medusa_errorf("can not add addrinfo entry");
+                        tcpsocket_addrinfo_entry_destroy(tcpsocket_addrinfo_entry);
+                        goto error;
+                }
+        }
+        if (events & MEDUSA_DNSRESOLVER_LOOKUP_EVENT_ANSWERED) {
+                struct medusa_dnsresolver_lookup_event_answered *medusa_dnsresolver_lookup_event_answered = param;
+
+                /* happy eyeballs, rfc 8305 section 3: an aaaa answer starts
+                 * the race at once, an a answer waits for the resolution
+                 * delay, later answers join the race that is running */
+                tcpsocket_addrinfo = medusa_dnsresolver_lookup_get_userdata_ptr_unlocked(dnsresolver_lookup);
+                if (((medusa_dnsresolver_lookup_event_answered->pending > 0) || (tcpsocket->race != NULL)) &&
+                    (tcpsocket_addrinfo != NULL) &&
+                    (!TAILQ_EMPTY(tcpsocket_addrinfo)) &&
+                    (tcpsocket_race_possible(tcpsocket, tcpsocket->coptions)) &&
+                    ((tcpsocket->race != NULL) || (tcpsocket->state == MEDUSA_TCPSOCKET_STATE_RESOLVING))) {
+                        medusa_dnsresolver_lookup_set_userdata_ptr_unlocked(dnsresolver_lookup, NULL);
+                        if (tcpsocket->race != NULL && tcpsocket->race->started) {
+                                rc = tcpsocket_race_add(tcpsocket->race, tcpsocket_addrinfo);
+                        } else if (medusa_dnsresolver_lookup_event_answered->family == MEDUSA_DNSRESOLVER_FAMILY_IPV6) {
+                                if (tcpsocket->race != NULL) {
+                                        tcpsocket->race->protocol = MEDUSA_TCPSOCKET_PROTOCOL_IPV6;
+                                }
+                                rc = medusa_tcpsocket_connect_resolved(tcpsocket, tcpsocket->coptions, tcpsocket_addrinfo, 1);
+                        } else if (tcpsocket->race != NULL) {
+                                rc = tcpsocket_race_add(tcpsocket->race, tcpsocket_addrinfo);
+                        } else {
+                                struct tcpsocket_race *race;
+                                race = tcpsocket_race_create(tcpsocket, tcpsocket->coptions);
+                                if (MEDUSA_IS_ERR_OR_NULL(race)) {
+                                        rc = MEDUSA_PTR_ERR(race);
+                                } else {
+                                        race->resolving = 1;
+                                        rc = tcpsocket_race_add(race, tcpsocket_addrinfo);
+                                        if (rc >= 0) {
+                                                rc = tcpsocket_race_arm(race, MEDUSA_TCPSOCKET_RESOLUTION_DELAY);
+                                        }
+                                }
+                        }
+                        tcpsocket_addrinfo_destroy(tcpsocket_addrinfo);
+                        if (rc < 0) {
+                                medusa_errorf("can not connect to resolved");
+                                goto error;
                         }
-                        ret = -errno;
-                        goto bail;
                 }
         }
-        {
-                int rc;
-                int on;
-                on = !!options->freebind;
-#if defined(IP_FREEBIND) || defined(IPV6_FREEBIND)
-                if (sockaddr->sa_family == AF_INET) {
-#if defined(IP_FREEBIND)
-                        rc = setsockopt(fd, IPPROTO_IP, IP_FREEBIND, (void *) &on, sizeof(on));
-#else
-                        rc = 0;
-#endif
-                } else if (sockaddr->sa_family == AF_INET6) {
-#if defined(IPV6_FREEBIND)
-                        rc = setsockopt(fd, IPPROTO_IPV6, IPV6_FREEBIND, (void *) &on, sizeof(on));
-#else
+        if (events & (MEDUSA_DNSRESOLVER_LOOKUP_EVENT_FINISHED | MEDUSA_DNSRESOLVER_LOOKUP_EVENT_TIMEDOUT)) {
+                if (events & MEDUSA_DNSRESOLVER_LOOKUP_EVENT_TIMEDOUT) {
+                        medusa_debugf("dnsresolver lookup timeout");
+                }
+                tcpsocket_addrinfo = medusa_dnsresolver_lookup_get_userdata_ptr_unlocked(dnsresolver_lookup);
+                medusa_dnsresolver_lookup_set_userdata_ptr_unlocked(dnsresolver_lookup, NULL);
+                if (tcpsocket->race != NULL && tcpsocket->race->started) {
+                        rc = tcpsocket_race_resolved(tcpsocket->race, tcpsocket_addrinfo);
+                        if (rc < 0) {
+                                /* every address has been tried */
+                                tcpsocket_race_error(tcpsocket, rc, __LINE__);
+                                rc = 0;
+                        }
+                } else if (tcpsocket->race != NULL) {
+                        tcpsocket->race->resolving = 0;
+                        rc = medusa_tcpsocket_connect_resolved(tcpsocket, tcpsocket->coptions, tcpsocket_addrinfo, 0);
+                } else if ((events & MEDUSA_DNSRESOLVER_LOOKUP_EVENT_TIMEDOUT) ||
+                           (tcpsocket->state != MEDUSA_TCPSOCKET_STATE_RESOLVING)) {
+                        /* the race is already over */
                         rc = 0;
-#endif
+                } else if (tcpsocket_addrinfo == NULL) {
+                        goto error;
                 } else {
-                        rc = 0;
+                        rc = medusa_tcpsocket_connect_resolved(tcpsocket, tcpsocket->coptions, tcpsocket_addrinfo, 0);
+                }
+                if (tcpsocket_addrinfo != NULL) {
+                        tcpsocket_addrinfo_destroy(tcpsocket_addrinfo);
                 }
-#else
-                (void) on;
-                rc = 0;
-#endif
                 if (rc < 0) {
-                        if (options->fd < 0 ||
-                            options->clodestroy == 1) {
-                                tcpsocket_closesocket(fd);
-                        }
-                        ret = -errno;
-                        goto bail;
+                        medusa_errorf("can not connect to resolved");
+                        goto error;
                 }
         }
-        rc = bind(fd, sockaddr , length);
-        if (rc != 0) {
-                if (options->fd < 0 ||
-                    options->clodestroy == 1) {
-                        tcpsocket_closesocket(fd);
+        if (events & MEDUSA_DNSRESOLVER_LOOKUP_EVENT_ERROR) {
+                medusa_errorf("dnsresolver lookup error");
+                goto error;
+        }
+        if (events & MEDUSA_DNSRESOLVER_LOOKUP_EVENT_DESTROY) {
+                tcpsocket_addrinfo = medusa_dnsresolver_lookup_get_userdata_ptr_unlocked(dnsresolver_lookup);
+                if (tcpsocket_addrinfo != NULL) {
+                        medusa_dnsresolver_lookup_set_userdata_ptr_unlocked(dnsresolver_lookup, NULL);
+                        tcpsocket_addrinfo_destroy(tcpsocket_addrinfo);
+                }
+                if (tcpsocket != NULL) {
+                        tcpsocket->clookup = NULL;
                 }
-                ret = -errno;
-                goto bail;
         }
 
-        rc = medusa_io_init_options_default(&io_init_options);
+        medusa_monitor_unlock(monitor);
+        return 0;
+error:  {
+
+                struct medusa_tcpsocket_event_error medusa_tcpsocket_event_error;
+                medusa_tcpsocket_event_error.state = tcpsocket->state;
+                medusa_tcpsocket_event_error.error = -EIO;
+                medusa_tcpsocket_event_error.line  = __LINE__;
+                tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_ERROR, medusa_tcpsocket_event_error.error, __LINE__);
+                medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_ERROR, &medusa_tcpsocket_event_error);
+        }
+        medusa_monitor_unlock(monitor);
+        return 0;
+}
+
+static int tcpsocket_resolver_onevent (struct medusa_resolver_lookup *lookup, int error, const struct addrinfo *result, void *context)
+{
+        int rc;
+        int line;
+        struct tcpsocket_addrinfo *tcpsocket_addrinfo;
+        struct medusa_tcpsocket *tcpsocket = context;
+
+        (void) lookup;
+
+        tcpsocket->rlookup = NULL;
+        if (!medusa_subject_is_active(&tcpsocket->subject) ||
+            tcpsocket->state != MEDUSA_TCPSOCKET_STATE_RESOLVING) {
+                return 0;
+        }
+        if (error < 0) {
+                rc = error;
+                line = __LINE__;
+                goto bail;
+        }
+        tcpsocket_addrinfo = tcpsocket_addrinfo_create_from_addrinfo(result);
+        if (tcpsocket_addrinfo == NULL) {
+                rc = -ENOMEM;
+                line = __LINE__;
+                goto bail;
+        }
+        rc = medusa_tcpsocket_connect_resolved(tcpsocket, tcpsocket->coptions, tcpsocket_addrinfo, 0);
+        tcpsocket_addrinfo_destroy(tcpsocket_addrinfo);
         if (rc < 0) {
-                if (options->fd < 0 ||
-                    options->clodestroy == 1) {
-                        tcpsocket_closesocket(fd);
-                }
-                ret = rc;
+                line = __LINE__;
                 goto bail;
         }
-        io_init_options.monitor    = tcpsocket->subject.monitor;
-        io_init_options.fd         = fd;
-        io_init_options.events     = MEDUSA_IO_EVENT_IN;
-        io_init_options.onevent    = tcpsocket_io_onevent;
-        io_init_options.context    = tcpsocket;
-        io_init_options.clodestroy = options->clodestroy;
-        io_init_options.enabled    = 0;
-        tcpsocket->io = medusa_io_create_with_options_unlocked(&io_init_options);
-        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket->io)) {
-                ret = MEDUSA_PTR_ERR(tcpsocket->io);
+        return 0;
+bail:   {
+                struct medusa_tcpsocket_event_error medusa_tcpsocket_event_error;
+                medusa_tcpsocket_event_error.state = tcpsocket->state;
+                medusa_tcpsocket_event_error.error = -rc;
+                medusa_tcpsocket_event_error.line  = line;
+                tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_ERROR, medusa_tcpsocket_event_error.error, __LINE__);
+                medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_ERROR, &medusa_tcpsocket_event_error);
+        }
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_connect_with_options_unlocked (const struct medusa_tcpsocket_connect_options *options)
+{
+        int rc;
+        int ret;
+        int line;
+
+        int resolve;
+        unsigned int protocol;
+        const char *address;
+
+        struct tcpsocket_addrinfo *tcpsocket_addrinfo;
+
+        struct medusa_tcpsocket *tcpsocket;
+
+        ret = -EIO;
+        line = __LINE__;
+
+        tcpsocket = NULL;
+        tcpsocket_addrinfo = NULL;
+
+        if (MEDUSA_IS_ERR_OR_NULL(options)) {
+                ret = -EINVAL;
+                line = __LINE__;
                 goto bail;
         }
 
-        rc = medusa_tcpsocket_set_reuseaddr_unlocked(tcpsocket, options->reuseaddr);
-        if (rc < 0) {
-                ret = rc;
+        protocol = options->protocol;
+        address  = options->address;
+        if (address == NULL) {
+                ret = -EINVAL;
+                line = __LINE__;
                 goto bail;
         }
-        rc = medusa_tcpsocket_set_reuseport_unlocked(tcpsocket, options->reuseport);
-        if (rc < 0) {
-                ret = rc;
+        if (options->port == 0) {
+                ret = -EINVAL;
+                line = __LINE__;
                 goto bail;
         }
-        rc = medusa_tcpsocket_set_freebind_unlocked(tcpsocket, options->freebind);
-        if (rc < 0) {
-                ret = rc;
+
+        tcpsocket = tcpsocket_create_unlocked(options->monitor, options->onevent, options->context);
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                ret = MEDUSA_PTR_ERR(tcpsocket);
+                line = __LINE__;
                 goto bail;
         }
+
+        tcpsocket_add_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_CONNECT);
+        if (options->fd >= 0) {
+                tcpsocket_add_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_ATTACH);
+        }
+
         rc = medusa_tcpsocket_set_nonblocking_unlocked(tcpsocket, options->nonblocking);
         if (rc < 0) {
                 ret = rc;
+                line = __LINE__;
                 goto bail;
         }
         rc = medusa_tcpsocket_set_nodelay_unlocked(tcpsocket, options->nodelay);
         if (rc < 0) {
                 ret = rc;
+                line = __LINE__;
                 goto bail;
         }
-        rc = medusa_tcpsocket_set_backlog_unlocked(tcpsocket, options->backlog);
+        rc = medusa_tcpsocket_set_notsent_lowat_unlocked(tcpsocket, options->notsent_lowat);
         if (rc < 0) {
                 ret = rc;
+                line = __LINE__;
                 goto bail;
         }
+        tcpsocket->fastopen = !!options->fastopen;
         rc = medusa_tcpsocket_set_buffered_unlocked(tcpsocket, options->buffered);
         if (rc < 0) {
                 ret = rc;
+                line = __LINE__;
                 goto bail;
         }
         if (medusa_tcpsocket_get_buffered_unlocked(tcpsocket)) {
                 rc = medusa_tcpsocket_set_buffered_read_limit_unlocked(tcpsocket, options->buffered_read_limit);
                 if (rc < 0) {
                         ret = rc;
+                        line = __LINE__;
                         goto bail;
                 }
                 rc = medusa_tcpsocket_set_buffered_write_limit_unlocked(tcpsocket, options->buffered_write_limit);
                 if (rc < 0) {
                         ret = rc;
+                        line = __LINE__;
                         goto bail;
                 }
         }
         rc = medusa_tcpsocket_set_clodestroy_unlocked(tcpsocket, options->clodestroy);
         if (rc < 0) {
                 ret = rc;
+                line = __LINE__;
                 goto bail;
         }
-        rc = medusa_tcpsocket_set_ssl_certificate_unlocked(tcpsocket, options->ssl_certificate, -1);
+        rc = medusa_tcpsocket_set_stats_enabled_unlocked(tcpsocket, options->stats);
         if (rc < 0) {
                 ret = rc;
+                line = __LINE__;
                 goto bail;
         }
-        rc = medusa_tcpsocket_set_ssl_privatekey_unlocked(tcpsocket, options->ssl_privatekey, -1);
+        rc = medusa_tcpsocket_set_ssl_certificate_unlocked(tcpsocket, options->ssl_certificate, -1);
         if (rc < 0) {
                 ret = rc;
+                line = __LINE__;
                 goto bail;
         }
-        rc = medusa_tcpsocket_set_ssl_ca_certificate_unlocked(tcpsocket, options->ssl_ca_certificate, -1);
+        rc = medusa_tcpsocket_set_ssl_privatekey_unlocked(tcpsocket, options->ssl_privatekey, -1);
         if (rc < 0) {
                 ret = rc;
+                line = __LINE__;
                 goto bail;
         }
-        rc = medusa_tcpsocket_set_ssl_verify_unlocked(tcpsocket, options->ssl_verify);
+        rc = medusa_tcpsocket_set_ssl_ca_certificate_unlocked(tcpsocket, options->ssl_ca_certificate, -1);
         if (rc < 0) {
                 ret = rc;
+                line = __LINE__;
                 goto bail;
         }
-        rc = medusa_tcpsocket_set_ssl_unlocked(tcpsocket, options->ssl);
+        rc = medusa_tcpsocket_set_ssl_verify_unlocked(tcpsocket, options->ssl_verify);
         if (rc < 0) {
                 ret = rc;
+                line = __LINE__;
                 goto bail;
         }
-        rc = medusa_tcpsocket_set_enabled_unlocked(tcpsocket, options->enabled);
+        rc = medusa_tcpsocket_set_ssl_hostname_unlocked(tcpsocket, options->ssl_hostname ? options->ssl_hostname : address);
         if (rc < 0) {
                 ret = rc;
+                line = __LINE__;
                 goto bail;
         }
-        rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_BOUND, 0, __LINE__);
+        rc = medusa_tcpsocket_set_ssl_unlocked(tcpsocket, options->ssl);
         if (rc < 0) {
                 ret = rc;
+                line = __LINE__;
                 goto bail;
         }
-        rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_BOUND, NULL);
+        rc = medusa_tcpsocket_set_enabled_unlocked(tcpsocket, options->enabled);
         if (rc < 0) {
                 ret = rc;
+                line = __LINE__;
                 goto bail;
         }
 
-        if (tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BACKLOG)) {
-                rc = listen(fd, tcpsocket->backlog);
-                if (rc != 0) {
-                        ret = -errno;
+        if (options->resolve_timeout > 0) {
+                rc = medusa_tcpsocket_set_resolve_timeout_unlocked(tcpsocket, options->resolve_timeout);
+                if (rc < 0) {
+                        ret = rc;
+                        line = __LINE__;
                         goto bail;
                 }
         }
-
-        rc = medusa_io_set_events_unlocked(tcpsocket->io, MEDUSA_IO_EVENT_IN);
-        if (rc < 0) {
-                ret = rc;
-                goto bail;
+        if (options->connect_timeout > 0) {
+                rc = medusa_tcpsocket_set_connect_timeout_unlocked(tcpsocket, options->connect_timeout);
+                if (rc < 0) {
+                        ret = rc;
+                        line = __LINE__;
+                        goto bail;
+                }
         }
-        rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_LISTENING, 0, __LINE__);
-        if (rc < 0) {
-                ret = rc;
-                goto bail;
+        if (options->read_timeout > 0) {
+                rc = medusa_tcpsocket_set_read_timeout_unlocked(tcpsocket, options->read_timeout);
+                if (rc < 0) {
+                        ret = rc;
+                        line = __LINE__;
+                        goto bail;
+                }
         }
-        rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_LISTENING, NULL);
+
+        rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_RESOLVING, 0, __LINE__);
         if (rc < 0) {
                 ret = rc;
+                line = __LINE__;
                 goto bail;
         }
-
-        return tcpsocket;
-bail:   if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
-                return MEDUSA_ERR_PTR(ret);
-        }
-        {
-                struct medusa_tcpsocket_event_error medusa_tcpsocket_event_error;
-                medusa_tcpsocket_event_error.state = tcpsocket->state;
-                medusa_tcpsocket_event_error.error = -ret;
-                medusa_tcpsocket_event_error.line  = __LINE__;
-                tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_ERROR, medusa_tcpsocket_event_error.error, __LINE__);
-                medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_ERROR, &medusa_tcpsocket_event_error);
-        }
-        return tcpsocket;
-}
-
-__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_bind_with_options (const struct medusa_tcpsocket_bind_options *options)
-{
-        struct medusa_tcpsocket *rc;
-        if (MEDUSA_IS_ERR_OR_NULL(options)) {
-                return MEDUSA_ERR_PTR(-EINVAL);
-        }
-        if (MEDUSA_IS_ERR_OR_NULL(options->monitor)) {
-                return MEDUSA_ERR_PTR(-EINVAL);
-        }
-        medusa_monitor_lock(options->monitor);
-        rc = medusa_tcpsocket_bind_with_options_unlocked(options);
-        medusa_monitor_unlock(options->monitor);
-        return rc;
-}
-
-__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_bind_unlocked (struct medusa_monitor *monitor, unsigned int protocol, const char *address, unsigned short port, int (*onevent) (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param), void *context)
-{
-        int rc;
-        struct medusa_tcpsocket_bind_options options;
-        rc = medusa_tcpsocket_bind_options_default(&options);
+        rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_RESOLVING, NULL);
         if (rc < 0) {
-                return MEDUSA_ERR_PTR(rc);
-        }
-        options.monitor  = monitor;
-        options.onevent  = onevent;
-        options.context  = context;
-        options.protocol = protocol;
-        options.address  = address;
-        options.port     = port;
-        return medusa_tcpsocket_bind_with_options_unlocked(&options);
-}
-
-__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_bind (struct medusa_monitor *monitor, unsigned int protocol, const char *address, unsigned short port, int (*onevent) (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param), void *context)
-{
-        struct medusa_tcpsocket *tcpsocket;
-        if (MEDUSA_IS_ERR_OR_NULL(monitor)) {
-                return MEDUSA_ERR_PTR(-EINVAL);
-        }
-        medusa_monitor_lock(monitor);
-        tcpsocket = medusa_tcpsocket_bind_unlocked(monitor, protocol, address, port, onevent, context);
-        medusa_monitor_unlock(monitor);
-        return tcpsocket;
-}
-
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_accept_options_default (struct medusa_tcpsocket_accept_options *options)
-{
-        if (MEDUSA_IS_ERR_OR_NULL(options)) {
-                return -EINVAL;
-        }
-        memset(options, 0, sizeof(struct medusa_tcpsocket_accept_options));
-        options->fd         = -1;
-        options->clodestroy = 1;
-        return 0;
-}
-
-__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_accept_with_options_unlocked (struct medusa_tcpsocket *tcpsocket, const struct medusa_tcpsocket_accept_options *options)
-{
-        int fd;
-        int rc;
-        int ret;
-        struct medusa_io_init_options io_init_options;
-        struct medusa_tcpsocket *accepted;
-
-        accepted = NULL;
-
-        if (MEDUSA_IS_ERR_OR_NULL(options)) {
-                ret = -EINVAL;
-                goto bail;
-        }
-        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
-                ret = -EINVAL;
-                goto bail;
-        }
-        if (MEDUSA_IS_ERR_OR_NULL(options->onevent)) {
-                ret = -EINVAL;
-                goto bail;
-        }
-        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket->io)) {
-                ret = -EINVAL;
-                goto bail;
-        }
-
-        accepted = tcpsocket_create_unlocked(medusa_tcpsocket_get_monitor_unlocked(tcpsocket), options->onevent, options->context);
-        if (MEDUSA_IS_ERR_OR_NULL(accepted)) {
-                ret = MEDUSA_PTR_ERR(accepted);
+                ret = rc;
+                line = __LINE__;
                 goto bail;
         }
-        tcpsocket_add_flag(accepted, MEDUSA_TCPSOCKET_FLAG_ACCEPT);
 
-        if (options->fd >= 0) {
-                fd = options->fd;
+        resolve = 1;
+        if (protocol == MEDUSA_TCPSOCKET_PROTOCOL_IPV4) {
+                struct sockaddr_in sockaddr_in;
+ipv4:
+                memset(&sockaddr_in, 0, sizeof(sockaddr_in));
+                sockaddr_in.sin_family = AF_INET;
+                if (address == NULL) {
+                        address = "0.0.0.0";
+                } else if (strcmp(address, "localhost") == 0) {
+                        address = "127.0.0.1";
+                } else if (strcmp(address, "loopback") == 0) {
+                        address = "127.0.0.1";
+                }
+                rc = inet_pton(AF_INET, address, &sockaddr_in.sin_addr);
+                if (rc == 1) {
+                        resolve = 0;
+                }
+        } else if (protocol == MEDUSA_TCPSOCKET_PROTOCOL_IPV6) {
+                struct sockaddr_in6 sockaddr_in6;
+ipv6:
+                memset(&sockaddr_in6, 0, sizeof(sockaddr_in6));
+                sockaddr_in6.sin6_family = AF_INET6;
+                if (address == NULL) {
+                        address = "::";
+                } else if (strcmp(address, "localhost") == 0) {
+                        address = "::1";
+                } else if (strcmp(address, "loopback") == 0) {
+                        address = "::1";
+                }
+                rc = inet_pton(AF_INET6, address, &sockaddr_in6.sin6_addr);
+                if (rc == 1) {
+                        resolve = 0;
+                }
+        } else if (address == NULL) {
+                address = "0.0.0.0";
+                goto ipv4;
+        } else if (strcmp(address, "localhost") == 0) {
+                address = "127.0.0.1";
+                goto ipv4;
+        } else if (strcmp(address, "loopback") == 0) {
+                address = "127.0.0.1";
+                goto ipv4;
         } else {
-                fd = accept(medusa_io_get_fd_unlocked(tcpsocket->io), NULL, NULL);
-        }
-        if (fd < 0) {
-                ret = -errno;
-                goto bail;
+                struct sockaddr_in sockaddr_in;
+                struct sockaddr_in6 sockaddr_in6;
+                rc = inet_pton(AF_INET, address, &sockaddr_in.sin_addr);
+                if (rc == 1) {
+                        line = __LINE__;
+                        goto ipv4;
+                }
+                rc = inet_pton(AF_INET6, address, &sockaddr_in6.sin6_addr);
+                if (rc == 1) {
+                        line = __LINE__;
+                        goto ipv6;
+                }
         }
 
-        rc = medusa_io_init_options_default(&io_init_options);
-        if (rc < 0) {
-                if (options->fd < 0 ||
-                    options->clodestroy == 1) {
-                        tcpsocket_closesocket(fd);
+        if (resolve == 0) {
+                struct addrinfo hints;
+                struct addrinfo *result;
+
+                result = NULL;
+
+                memset(&hints, 0, sizeof(struct addrinfo));
+                if (protocol == MEDUSA_TCPSOCKET_PROTOCOL_IPV4) {
+                        hints.ai_family = AF_INET;
+                        hints.ai_socktype = SOCK_STREAM;
+                } else if (protocol == MEDUSA_TCPSOCKET_PROTOCOL_IPV6) {
+                        hints.ai_family = AF_INET6;
+                        hints.ai_socktype = SOCK_STREAM;
+                } else {
+                        hints.ai_family = AF_UNSPEC;
+                        hints.ai_socktype = SOCK_STREAM;
                 }
-                ret = rc;
-                goto bail;
-        }
-        io_init_options.monitor    = tcpsocket->subject.monitor;
-        io_init_options.fd         = fd;
-        io_init_options.events     = MEDUSA_IO_EVENT_IN;
-        io_init_options.onevent    = tcpsocket_io_onevent;
-        io_init_options.context    = accepted;
-        io_init_options.clodestroy = options->clodestroy;
-        io_init_options.enabled    = 0;
-        accepted->io = medusa_io_create_with_options_unlocked(&io_init_options);
-        if (MEDUSA_IS_ERR_OR_NULL(accepted->io)) {
-                ret = MEDUSA_PTR_ERR(accepted->io);
-                goto bail;
-        }
 
-        rc = medusa_tcpsocket_set_nonblocking_unlocked(accepted, options->nonblocking);
-        if (rc < 0) {
-                ret = rc;
-                goto bail;
-        }
-        rc = medusa_tcpsocket_set_nodelay_unlocked(accepted, options->nodelay);
-        if (rc < 0) {
-                ret = rc;
-                goto bail;
-        }
-        rc = medusa_tcpsocket_set_buffered_unlocked(accepted, options->buffered);
-        if (rc < 0) {
-                ret = rc;
-                goto bail;
-        }
-        if (medusa_tcpsocket_get_buffered_unlocked(accepted)) {
-                rc = medusa_tcpsocket_set_buffered_read_limit_unlocked(accepted, options->buffered_read_limit);
+                rc = getaddrinfo(address, NULL, &hints, &result);
+                if (rc != 0) {
+                        if (rc == EAI_NONAME) {
+                                ret = -ENOENT;
+                        } else if (rc == EAI_AGAIN) {
+                                ret = -EAGAIN;
+                        } else {
+                                ret = -EIO;
+                        }
+                        line = __LINE__;
+                        goto bail;
+                }
+                tcpsocket_addrinfo = tcpsocket_addrinfo_create_from_addrinfo(result);
+                if (tcpsocket_addrinfo == NULL) {
+                        ret = -ENOMEM;
+                        line = __LINE__;
+                        freeaddrinfo(result);
+                        goto bail;
+                }
+                rc = medusa_tcpsocket_connect_resolved(tcpsocket, options, tcpsocket_addrinfo, 0);
                 if (rc < 0) {
                         ret = rc;
+                        line = __LINE__;
+                        freeaddrinfo(result);
                         goto bail;
                 }
-                rc = medusa_tcpsocket_set_buffered_write_limit_unlocked(accepted, options->buffered_write_limit);
+                freeaddrinfo(result);
+        } else if (MEDUSA_IS_ERR_OR_NULL(options->dnsresolver) ||
+                   medusa_dnsresolver_get_enabled_unlocked(options->dnsresolver) != 1) {
+                int family;
+                const struct addrinfo *cached;
+                struct medusa_resolver *resolver;
+
+                /* names go to the resolver workers, getaddrinfo may block for seconds */
+                family = (protocol == MEDUSA_TCPSOCKET_PROTOCOL_IPV4) ? AF_INET :
+                         (protocol == MEDUSA_TCPSOCKET_PROTOCOL_IPV6) ? AF_INET6 :
+                         AF_UNSPEC;
+                resolver = medusa_monitor_get_resolver_unlocked(tcpsocket->subject.monitor);
+                if (MEDUSA_IS_ERR_OR_NULL(resolver)) {
+                        ret = MEDUSA_PTR_ERR(resolver);
+                        line = __LINE__;
+                        goto bail;
+                }
+                cached = NULL;
+                rc = medusa_resolver_cached_unlocked(resolver, address, family, SOCK_STREAM, &cached);
                 if (rc < 0) {
                         ret = rc;
+                        line = __LINE__;
+                        goto bail;
+                } else if (rc > 0) {
+                        tcpsocket_addrinfo = tcpsocket_addrinfo_create_from_addrinfo(cached);
+                        if (tcpsocket_addrinfo == NULL) {
+                                ret = -ENOMEM;
+                                line = __LINE__;
+                                goto bail;
+                        }
+                        rc = medusa_tcpsocket_connect_resolved(tcpsocket, options, tcpsocket_addrinfo, 0);
+                        if (rc < 0) {
+                                ret = rc;
+                                line = __LINE__;
+                                goto bail;
+                        }
+                } else {
+                        tcpsocket->coptions = medusa_tcpsocket_connect_options_duplicate(options);
+                        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket->coptions)) {
+                                ret = MEDUSA_PTR_ERR(tcpsocket->coptions);
+                                tcpsocket->coptions = NULL;
+                                line = __LINE__;
+                                goto bail;
+                        }
+                        tcpsocket->rlookup = medusa_resolver_lookup_unlocked(resolver, address, family, SOCK_STREAM, tcpsocket_resolver_onevent, tcpsocket);
+                        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket->rlookup)) {
+                                ret = MEDUSA_PTR_ERR(tcpsocket->rlookup);
+                                tcpsocket->rlookup = NULL;
+                                line = __LINE__;
+                                goto bail;
+                        }
+                }
+        } else {
+                struct medusa_dnsresolver_lookup_options dnsresolver_lookup_options;
+                tcpsocket->coptions = medusa_tcpsocket_connect_options_duplicate(options);
+                if (MEDUSA_IS_ERR_OR_NULL(tcpsocket->coptions)) {
+                        ret = MEDUSA_PTR_ERR(tcpsocket->coptions);
+                        line = __LINE__;
+                        goto bail;
+                }
+                rc = medusa_dnsresolver_lookup_options_default(&dnsresolver_lookup_options);
+                if (rc < 0) {
+                        ret = rc;
+                        line = __LINE__;
+                        goto bail;
+                }
+                dnsresolver_lookup_options.onevent              = tcpsocket_dnsresolver_onevent;
+                dnsresolver_lookup_options.context              = tcpsocket;
+                dnsresolver_lookup_options.nameserver           = NULL;
+                dnsresolver_lookup_options.family               = (protocol == MEDUSA_TCPSOCKET_PROTOCOL_IPV4) ? MEDUSA_DNSRESOLVER_FAMILY_IPV4 :
+                                                                  (protocol == MEDUSA_TCPSOCKET_PROTOCOL_IPV6) ? MEDUSA_DNSRESOLVER_FAMILY_IPV6 :
+                                                                  MEDUSA_DNSRESOLVER_FAMILY_ANY;
+                dnsresolver_lookup_options.name                 = address;
+                dnsresolver_lookup_options.retry_count          = -1;
+                dnsresolver_lookup_options.retry_interval       = -1;
+                dnsresolver_lookup_options.resolve_timeout      = -1;
+                dnsresolver_lookup_options.enabled              = -1;
+                tcpsocket->clookup = medusa_dnsresolver_lookup_with_options_unlocked(options->dnsresolver, &dnsresolver_lookup_options);
+                if (MEDUSA_IS_ERR_OR_NULL(tcpsocket->clookup)) {
+                        ret = MEDUSA_PTR_ERR(tcpsocket->clookup);
+                        line = __LINE__;
                         goto bail;
                 }
-        }
-        rc = medusa_tcpsocket_set_clodestroy_unlocked(accepted, options->clodestroy);
-        if (rc < 0) {
-                ret = rc;
-                goto bail;
-        }
-        rc = medusa_tcpsocket_set_enabled_unlocked(accepted, options->enabled);
-        if (rc < 0) {
-                ret = rc;
-                goto bail;
-        }
-
-        rc = medusa_tcpsocket_set_ssl_certificate_unlocked(accepted, medusa_tcpsocket_get_ssl_certificate_unlocked(tcpsocket), -1);
-        if (rc < 0) {
-                ret = rc;
-                goto bail;
-        }
-        rc = medusa_tcpsocket_set_ssl_privatekey_unlocked(accepted, medusa_tcpsocket_get_ssl_privatekey_unlocked(tcpsocket), -1);
-        if (rc < 0) {
-                ret = rc;
-                goto bail;
-        }
-        rc = medusa_tcpsocket_set_ssl_ca_certificate_unlocked(accepted, medusa_tcpsocket_get_ssl_ca_certificate_unlocked(tcpsocket), -1);
-        if (rc < 0) {
-                ret = rc;
-                goto bail;
-        }
-        rc = medusa_tcpsocket_set_ssl_verify_unlocked(accepted, medusa_tcpsocket_get_ssl_verify_unlocked(tcpsocket));
-        if (rc < 0) {
-                ret = rc;
-                goto bail;
-        }
-        rc = medusa_tcpsocket_set_ssl_unlocked(accepted, medusa_tcpsocket_get_ssl_unlocked(tcpsocket));
-        if (rc < 0) {
-                ret = rc;
-                goto bail;
         }
 
-        rc = tcpsocket_set_state(accepted, MEDUSA_TCPSOCKET_STATE_CONNECTED, 0, __LINE__);
-        if (rc < 0) {
-                ret = rc;
-                goto bail;
+        if (tcpsocket_addrinfo != NULL) {
+                tcpsocket_addrinfo_destroy(tcpsocket_addrinfo);
         }
-        rc = medusa_tcpsocket_onevent_unlocked(accepted, MEDUSA_TCPSOCKET_EVENT_CONNECTED, NULL);
-        if (rc < 0) {
-                ret = rc;
-                goto bail;
+        return tcpsocket;
+bail:   if (tcpsocket_addrinfo != NULL) {
+                tcpsocket_addrinfo_destroy(tcpsocket_addrinfo);
         }
-
-        return accepted;
-bail:   if (MEDUSA_IS_ERR_OR_NULL(accepted)) {
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return MEDUSA_ERR_PTR(ret);
         }
         {
                 struct medusa_tcpsocket_event_error medusa_tcpsocket_event_error;
                 medusa_tcpsocket_event_error.state = tcpsocket->state;
                 medusa_tcpsocket_event_error.error = -ret;
-                medusa_tcpsocket_event_error.line  = __LINE__;
-                tcpsocket_set_state(accepted, MEDUSA_TCPSOCKET_STATE_ERROR, medusa_tcpsocket_event_error.error, __LINE__);
-                medusa_tcpsocket_onevent_unlocked(accepted, MEDUSA_TCPSOCKET_EVENT_ERROR, &medusa_tcpsocket_event_error);
-        }
-        return tcpsocket;
-}
-
-__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_accept_with_options (struct medusa_tcpsocket *tcpsocket, const struct medusa_tcpsocket_accept_options *options)
-{
-        struct medusa_tcpsocket *rc;
-        struct medusa_monitor *monitor;
-        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
-                return MEDUSA_ERR_PTR(-EINVAL);
-        }
-        if (MEDUSA_IS_ERR_OR_NULL(options)) {
-                return MEDUSA_ERR_PTR(-EINVAL);
-        }
-        monitor = medusa_tcpsocket_get_monitor(tcpsocket);
-        if (MEDUSA_IS_ERR_OR_NULL(monitor)) {
-                return MEDUSA_ERR_PTR(-EINVAL);
-        }
-        medusa_monitor_lock(monitor);
-        rc = medusa_tcpsocket_accept_with_options_unlocked(tcpsocket, options);
-        medusa_monitor_unlock(monitor);
-        return rc;
-}
-
-__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_accept_unlocked (struct medusa_tcpsocket *tcpsocket, int (*onevent) (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param), void *context)
-{
-        int rc;
-        struct medusa_tcpsocket_accept_options options;
-        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
-                return MEDUSA_ERR_PTR(-EINVAL);
-        }
-        rc = medusa_tcpsocket_accept_options_default(&options);
-        if (rc < 0) {
-                return MEDUSA_ERR_PTR(rc);
-        }
-        options.onevent     = onevent;
-        options.context     = context;
-        options.buffered    = medusa_tcpsocket_get_buffered_unlocked(tcpsocket);
-        options.nodelay     = medusa_tcpsocket_get_nodelay_unlocked(tcpsocket);
-        options.nonblocking = medusa_tcpsocket_get_nonblocking_unlocked(tcpsocket);
-        return medusa_tcpsocket_accept_with_options_unlocked(tcpsocket, &options);
-}
-
-__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_accept (struct medusa_tcpsocket *tcpsocket, int (*onevent) (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param), void *context)
-{
-        struct medusa_tcpsocket *accepted;
-        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
-                return MEDUSA_ERR_PTR(-EINVAL);
-        }
-        medusa_monitor_lock(tcpsocket->subject.monitor);
-        accepted = medusa_tcpsocket_accept_unlocked(tcpsocket, onevent, context);
-        medusa_monitor_unlock(tcpsocket->subject.monitor);
-        return accepted;
-}
-
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_connect_options_default (struct medusa_tcpsocket_connect_options *options)
-{
-        if (options == NULL) {
-                return -EINVAL;
-        }
-        memset(options, 0, sizeof(struct medusa_tcpsocket_connect_options));
-        options->protocol   = MEDUSA_TCPSOCKET_PROTOCOL_ANY;
-        options->sprotocol  = MEDUSA_TCPSOCKET_PROTOCOL_ANY;
-        options->resolve_timeout = -1;
-        options->connect_timeout = -1;
-        options->read_timeout    = -1;
-        options->fd              = -1;
-        options->reuseaddr       = 1;
-        options->reuseport       = 1;
-        options->clodestroy      = 1;
-        return 0;
+                medusa_tcpsocket_event_error.line  = line;
+                tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_ERROR, medusa_tcpsocket_event_error.error, __LINE__);
+                medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_ERROR, &medusa_tcpsocket_event_error);
+        }
+        return tcpsocket;
 }
 
-static void medusa_tcpsocket_connect_options_destroy (struct medusa_tcpsocket_connect_options *options)
+__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_connect_with_options (const struct medusa_tcpsocket_connect_options *options)
 {
-        if (options == NULL) {
-                return;
-        }
-        if (options->address != NULL) {
-                free((char *) options->address);
+        struct medusa_tcpsocket *tcpsocket;
+        if (MEDUSA_IS_ERR_OR_NULL(options)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
         }
-        if (options->saddress != NULL) {
-                free((char *) options->saddress);
+        if (MEDUSA_IS_ERR_OR_NULL(options->monitor)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
         }
-        free(options);
+        medusa_monitor_lock(options->monitor);
+        tcpsocket = medusa_tcpsocket_connect_with_options_unlocked(options);
+        medusa_monitor_unlock(options->monitor);
+        return tcpsocket;
 }
 
-static struct medusa_tcpsocket_connect_options * medusa_tcpsocket_connect_options_duplicate (const struct medusa_tcpsocket_connect_options *source)
+__attribute__ ((visibility ("default")))struct medusa_tcpsocket * medusa_tcpsocket_connect_unlocked (struct medusa_monitor *monitor, unsigned int protocol, const char *address, unsigned short port, int (*onevent) (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param), void *context)
 {
-        int rs;
-        struct medusa_tcpsocket_connect_options *options;
-
-        rs = -EIO;
-        options = NULL;
-
-        if (source == NULL) {
-                rs = -EINVAL;
-                goto bail;
-        }
-
-        options = malloc(sizeof(struct medusa_tcpsocket_connect_options));
-        if (options == NULL) {
-                rs = -ENOMEM;
-                goto bail;
+        int rc;
+        struct medusa_tcpsocket_connect_options options;
+        rc = medusa_tcpsocket_connect_options_default(&options);
+        if (rc < 0) {
+                return MEDUSA_ERR_PTR(rc);
         }
-        memset(options, 0, sizeof(struct medusa_tcpsocket_connect_options));
+        options.monitor  = monitor;
+        options.onevent  = onevent;
+        options.context  = context;
+        options.protocol = protocol;
+        options.address  = address;
+        options.port     = port;
+        return medusa_tcpsocket_connect_with_options_unlocked(&options);
+}
 
-        options->monitor        = source->monitor;
-        options->dnsresolver    = source->dnsresolver;
-        options->onevent        = source->onevent;
-        options->context        = source->context;
-        options->protocol       = source->protocol;
-        if (source->address != NULL) {
-                options->address = strdup(source->address);
-                if (options->address == NULL) {
-                        rs = -ENOMEM;
-                        goto bail;
-                }
-        }
-        options->port           = source->port;
-        options->sprotocol      = source->sprotocol;
-        if (source->saddress != NULL) {
-                options->saddress = strdup(source->saddress);
-                if (options->saddress == NULL) {
-                        rs = -ENOMEM;
-                        goto bail;
-                }
+__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_connect (struct medusa_monitor *monitor, unsigned int protocol, const char *address, unsigned short port, int (*onevent) (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param), void *context)
+{
+        struct medusa_tcpsocket *tcpsocket;
+        if (MEDUSA_IS_ERR_OR_NULL(monitor)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
         }
-        options->sport           = source->sport;
-        options->resolve_timeout = source->resolve_timeout;
-        options->connect_timeout = source->connect_timeout;
-        options->read_timeout    = source->read_timeout;
-        options->fd              = source->fd;
-        options->clodestroy      = source->clodestroy;
-        options->reuseaddr       = source->reuseaddr;
-        options->reuseport       = source->reuseport;
-        options->nonblocking     = source->nonblocking;
-        options->nodelay         = source->nodelay;
-        options->buffered        = source->buffered;
-        options->enabled         = source->enabled;
+        medusa_monitor_lock(monitor);
+        tcpsocket = medusa_tcpsocket_connect_unlocked(monitor, protocol, address, port, onevent, context);
+        medusa_monitor_unlock(monitor);
+        return tcpsocket;
+}
 
-        return options;
-bail:   if (options != NULL) {
-                medusa_tcpsocket_connect_options_destroy(options);
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_attach_options_default (struct medusa_tcpsocket_attach_options *options)
+{
+        if (options == NULL) {
+                return -EINVAL;
         }
-        return MEDUSA_ERR_PTR(rs);
+        memset(options, 0, sizeof(struct medusa_tcpsocket_attach_options));
+        options->fd         = -1;
+        options->bound      = 0;
+        options->clodestroy = 1;
+        return 0;
 }
 
-static int medusa_tcpsocket_connect_resolved (struct medusa_tcpsocket *tcpsocket, const struct medusa_tcpsocket_connect_options *options, struct tcpsocket_addrinfo *addrinfo)
+__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_attach_with_options_unlocked (const struct medusa_tcpsocket_attach_options *options)
 {
         int rc;
         int fd;
         int ret;
-        int connected;
-
-        struct tcpsocket_addrinfo_entry *addrinfo_entry;
 
         struct medusa_io_init_options io_init_options;
+        struct medusa_tcpsocket *tcpsocket;
 
-        rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_RESOLVED, 0, __LINE__);
-        if (rc < 0) {
-                medusa_errorf("can not set state to: %d", MEDUSA_TCPSOCKET_STATE_RESOLVED);
-                ret = rc;
-                goto bail;
-        }
-        rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_RESOLVED, NULL);
-        if (rc < 0) {
-                medusa_errorf("tcpsocket onevent failed, rc: %d", rc);
-                ret = rc;
-                goto bail;
-        }
+        tcpsocket = NULL;
 
-        rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_CONNECTING, 0, __LINE__);
-        if (rc < 0) {
-                medusa_errorf("can not set state to: %d", MEDUSA_TCPSOCKET_STATE_CONNECTING);
-                ret = rc;
+        if (MEDUSA_IS_ERR_OR_NULL(options)) {
+                ret = -EINVAL;
                 goto bail;
         }
-        rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_CONNECTING, NULL);
-        if (rc < 0) {
-                medusa_errorf("tcpsocket onevent failed, rc: %d", rc);
-                ret = rc;
+        fd = options->fd;
+        if (fd < 0) {
+                ret = -EINVAL;
                 goto bail;
         }
 
-        rc = -1;
-        fd = -1;
-        TAILQ_FOREACH(addrinfo_entry, addrinfo, tailq) {
-                void *ptr;
-                char str[MAX(INET_ADDRSTRLEN, INET6_ADDRSTRLEN)];
-                int family;
-                struct sockaddr_in *sockaddr_in;
-                struct sockaddr_in6 *sockaddr_in6;
-                switch (addrinfo_entry->protocol) {
-                        case MEDUSA_TCPSOCKET_PROTOCOL_IPV4:
-                                family = AF_INET;
-                                sockaddr_in = (struct sockaddr_in *) &addrinfo_entry->sockaddr;
-                                sockaddr_in->sin_family = AF_INET;
-                                sockaddr_in->sin_port = htons(options->port);
-                                ptr = &sockaddr_in->sin_addr;
-                                break;
-                        case MEDUSA_TCPSOCKET_PROTOCOL_IPV6:
-                                family = AF_INET6;
-                                sockaddr_in6 = (struct sockaddr_in6 *) &addrinfo_entry->sockaddr;
-                                sockaddr_in6->sin6_family = AF_INET6;
-                                sockaddr_in6->sin6_port = htons(options->port);
-                                ptr = &sockaddr_in6->sin6_addr;
-                                break;
-                        default:
-                                medusa_errorf("unknown addrinfo entry protocol: %d", addrinfo_entry->protocol);
-                                ret = -EIO;
-                                goto bail;
-                }
-                if (inet_ntop(family, ptr, str, sizeof(str)) == NULL) {
-                        continue;
-                }
-                if (options->fd >= 0) {
-                        fd = options->fd;
-                } else {
-                        fd = socket(family, SOCK_STREAM, 0);
-                }
-                if (fd < 0) {
-                        medusa_errorf("can not open socket");
-                        ret = -errno;
-                        goto bail;
-                }
-                {
-                        int rc;
-#if defined(__WINDOWS__)
-                        unsigned long nonblocking = options->nonblocking ? 1 : 0;
-                        rc = ioctlsocket(fd, FIONBIO, &nonblocking);
-#else
-                        int flags;
-                        flags = fcntl(fd, F_GETFL, 0);
-                        if (flags < 0) {
-                                ret = -errno;
-                                if (options->fd < 0 ||
-                                    options->clodestroy == 1) {
-                                        tcpsocket_closesocket(fd);
-                                }
-                                medusa_errorf("fcntl getfl failed");
-                                goto bail;
-                        }
-                        flags = (options->nonblocking) ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
-                        rc = fcntl(fd, F_SETFL, flags);
-#endif
-                        if (rc != 0) {
-                                ret = -errno;
-                                if (options->fd < 0 ||
-                                    options->clodestroy == 1) {
-                                        tcpsocket_closesocket(fd);
-                                }
-                                medusa_errorf("fcntl setfl failed");
-                                goto bail;
-                        }
-                }
-                if (options->sport > 0 ||
-                    options->saddress != NULL) {
-                        unsigned int sprotocol;
-                        const char *saddress;
-                        unsigned short sport;
-
-                        struct sockaddr_storage bind_sockaddr;
-
-                        sprotocol = options->sprotocol;
-                        saddress  = options->saddress;
-                        sport     = options->sport;
-
-                        if (sprotocol == MEDUSA_TCPSOCKET_PROTOCOL_IPV4) {
-                                struct sockaddr_in *bind_sockaddr_in;
-bind_ipv4:
-                                bind_sockaddr_in = (struct sockaddr_in *) &bind_sockaddr;
-                                bind_sockaddr_in->sin_family = AF_INET;
-                                if (saddress == NULL) {
-                                        saddress = "0.0.0.0";
-                                } else if (strcmp(saddress, "localhost") == 0) {
-                                        saddress = "127.0.0.1";
-                                } else if (strcmp(saddress, "loopback") == 0) {
-                                        saddress = "127.0.0.1";
-                                }
-                                rc = inet_pton(AF_INET, saddress, &bind_sockaddr_in->sin_addr);
-                                if (rc == 0) {
-                                        ret = -EINVAL;
-                                        if (options->fd < 0 ||
-                                            options->clodestroy == 1) {
-                                                tcpsocket_closesocket(fd);
-                                        }
-                                        medusa_errorf("source address: %s is invalid", saddress);
-                                        goto bail;
-                                } else if (rc < 0) {
-                                        ret = -EINVAL;
-                                        if (options->fd < 0 ||
-                                            options->clodestroy == 1) {
-                                                tcpsocket_closesocket(fd);
-                                        }
-                                        medusa_errorf("source address: %s is invalid", saddress);
-                                        goto bail;
-                                }
-                                bind_sockaddr_in->sin_port = htons(sport);
-                        } else if (sprotocol == MEDUSA_TCPSOCKET_PROTOCOL_IPV6) {
-                                struct sockaddr_in6 *bind_sockaddr_in6;
-bind_ipv6:
-                                bind_sockaddr_in6 = (struct sockaddr_in6 *) &bind_sockaddr;
-                                bind_sockaddr_in6->sin6_family = AF_INET6;
-                                if (saddress == NULL) {
-                                        saddress = "0.0.0.0";
-                                } else if (strcmp(saddress, "localhost") == 0) {
-                                        saddress = "::1";
-                                } else if (strcmp(saddress, "loopback") == 0) {
-                                        saddress = "::1";
-                                }
-                                rc = inet_pton(AF_INET6, saddress, &bind_sockaddr_in6->sin6_addr);
-                                if (rc == 0) {
-                                        ret = -EINVAL;
-                                        if (options->fd < 0 ||
-                                            options->clodestroy == 1) {
-                                                tcpsocket_closesocket(fd);
-                                        }
-                                        medusa_errorf("source address: %s is invalid", saddress);
-                                        goto bail;
-                                } else if (rc < 0) {
-                                        ret = -EINVAL;
-                                        if (options->fd < 0 ||
-                                            options->clodestroy == 1) {
-                                                tcpsocket_closesocket(fd);
-                                        }
-                                        medusa_errorf("source address: %s is invalid", saddress);
-                                        goto bail;
-                                }
-                                bind_sockaddr_in6->sin6_port = htons(sport);
-                        } else if (saddress == NULL) {
-                                if (addrinfo_entry->protocol == MEDUSA_TCPSOCKET_PROTOCOL_IPV4) {
-                                        saddress = "0.0.0.0";
-                                        goto bind_ipv4;
-                                } else if (addrinfo_entry->protocol == MEDUSA_TCPSOCKET_PROTOCOL_IPV6) {
-                                        saddress = "::";
-                                        goto bind_ipv6;
-                                } else {
-                                        medusa_errorf("unknown addrinfo entry protocol: %d", addrinfo_entry->protocol);
-                                        ret = -EINVAL;
-                                        goto bail;
-                                }
-                        } else if (strcmp(saddress, "localhost") == 0) {
-                                saddress = "127.0.0.1";
-                                goto bind_ipv4;
-                        } else if (strcmp(saddress, "loopback") == 0) {
-                                saddress = "127.0.0.1";
-                                goto bind_ipv4;
-                        } else {
-                                struct sockaddr_in bind_sockaddr_in;
-                                struct sockaddr_in6 bind_sockaddr_in6;
-                                rc = inet_pton(AF_INET, saddress, &bind_sockaddr_in.sin_addr);
-                                if (rc > 0) {
-                                        goto bind_ipv4;
-                                }
-                                rc = inet_pton(AF_INET6, saddress, &bind_sockaddr_in6.sin6_addr);
-                                if (rc > 0) {
-                                        goto bind_ipv6;
-                                }
-                                ret = -EINVAL;
-                                if (options->fd < 0 ||
-                                    options->clodestroy == 1) {
-                                        tcpsocket_closesocket(fd);
-                                }
-                                medusa_errorf("source address: %s is invalid", saddress);
-                                goto bail;
-                        }
-
-                        if (options->reuseaddr != 0) {
-                                int on;
-                                on = 1;
-                                rc = setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (void *) &on, sizeof(on));
-                                if (rc < 0) {
-                                        ret = -errno;
-                                        if (options->fd < 0 ||
-                                            options->clodestroy == 1) {
-                                                tcpsocket_closesocket(fd);
-                                        }
-                                        medusa_errorf("setsockopt failed");
-                                        goto bail;
-                                }
-                        }
-                        if (options->reuseport != 0) {
-                                int on;
-                                on = 1;
-#if defined(SO_REUSEPORT)
-                                rc = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (void *) &on, sizeof(on));
-#else
-                                (void) on;
-                                rc = 0;
-#endif
-                                if (rc < 0) {
-                                        ret = -errno;
-                                        if (options->fd < 0 ||
-                                            options->clodestroy == 1) {
-                                                tcpsocket_closesocket(fd);
-                                        }
-                                        medusa_errorf("setsockopt failed");
-                                        goto bail;
-                                }
-                        }
-                        rc = bind(fd, (struct sockaddr *) &bind_sockaddr, sizeof(struct sockaddr_storage));
-                        if (rc != 0) {
-                                ret = -errno;
-                                if (options->fd < 0 ||
-                                    options->clodestroy == 1) {
-                                        tcpsocket_closesocket(fd);
-                                }
-                                medusa_errorf("bind failed");
-                                goto bail;
-                        }
-                }
-                rc = connect(fd, (const struct sockaddr *) &addrinfo_entry->sockaddr, addrinfo_entry->sockaddr_length);
-                if (rc != 0) {
-#if defined(__WINDOWS__)
-                        if (rc == SOCKET_ERROR) {
-                                switch (WSAGetLastError()) {
-                                        case WSAEWOULDBLOCK:    errno = EWOULDBLOCK;    break;
-                                        case WSATRY_AGAIN:      errno = EAGAIN;         break;
-                                        case WSAEINTR:          errno = EINTR;          break;
-                                        case WSAECONNRESET:     errno = ECONNRESET;     break;
-                                }
-                        }
-#endif
-                        if (errno != EINPROGRESS &&
-                            errno != EALREADY &&
-                            errno != EWOULDBLOCK &&
-                            errno != EINTR) {
-                                if (options->fd < 0) {
-                                        tcpsocket_closesocket(fd);
-                                }
-                                fd = -1;
-                                rc = -errno;
-                                continue;
-                        }
-                        rc = -errno;
-                }
-                break;
-        }
-        if ((addrinfo_entry == NULL) ||
-            (fd == -1) ||
-            (rc != 0 &&
-             rc != -EINPROGRESS &&
-             rc != -EALREADY &&
-             rc != -EWOULDBLOCK &&
-             rc != -EINTR)) {
-                ret = rc;
-                if (options->fd < 0 ||
-                    options->clodestroy == 1) {
-                        tcpsocket_closesocket(fd);
-                }
-                medusa_errorf("can not connect to any resolved address, rc: %d, %s", rc, strerror(rc));
+        tcpsocket = tcpsocket_create_unlocked(options->monitor, options->onevent, options->context);
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                ret = MEDUSA_PTR_ERR(tcpsocket);
                 goto bail;
         }
-        connected = (rc == 0);
+        tcpsocket_add_flag(tcpsocket, (options->bound) ? MEDUSA_TCPSOCKET_FLAG_BIND | MEDUSA_TCPSOCKET_FLAG_ATTACH : MEDUSA_TCPSOCKET_FLAG_ATTACH);
 
         rc = medusa_io_init_options_default(&io_init_options);
         if (rc < 0) {
@@ -2684,1530 +4998,1384 @@ bind_ipv6:
         io_init_options.enabled    = 0;
         tcpsocket->io = medusa_io_create_with_options_unlocked(&io_init_options);
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket->io)) {
-                medusa_errorf("can not create io for tcpsocket");
                 ret = MEDUSA_PTR_ERR(tcpsocket->io);
-                if (options->fd < 0 ||
-                    options->clodestroy == 1) {
-                        tcpsocket_closesocket(fd);
-                }
                 goto bail;
         }
 
         rc = medusa_tcpsocket_set_nonblocking_unlocked(tcpsocket, options->nonblocking);
         if (rc < 0) {
-                medusa_errorf("can not set nonblocking option for tcpsocket");
                 ret = rc;
                 goto bail;
         }
         rc = medusa_tcpsocket_set_nodelay_unlocked(tcpsocket, options->nodelay);
         if (rc < 0) {
-                medusa_errorf("can not set nodelay option for tcpsocket");
                 ret = rc;
                 goto bail;
         }
         rc = medusa_tcpsocket_set_buffered_unlocked(tcpsocket, options->buffered);
         if (rc < 0) {
-                medusa_errorf("can not set buffered option for tcpsocket");
                 ret = rc;
                 goto bail;
         }
         if (medusa_tcpsocket_get_buffered_unlocked(tcpsocket)) {
                 rc = medusa_tcpsocket_set_buffered_read_limit_unlocked(tcpsocket, options->buffered_read_limit);
                 if (rc < 0) {
-                        medusa_errorf("can not set buffered read limit option for tcpsocket");
                         ret = rc;
                         goto bail;
                 }
                 rc = medusa_tcpsocket_set_buffered_write_limit_unlocked(tcpsocket, options->buffered_write_limit);
                 if (rc < 0) {
-                        medusa_errorf("can not set buffered write limit option for tcpsocket");
                         ret = rc;
                         goto bail;
                 }
         }
         rc = medusa_tcpsocket_set_clodestroy_unlocked(tcpsocket, options->clodestroy);
         if (rc < 0) {
-                medusa_errorf("can not set clodestroy option for tcpsocket");
                 ret = rc;
                 goto bail;
         }
         rc = medusa_tcpsocket_set_enabled_unlocked(tcpsocket, options->enabled);
         if (rc < 0) {
-                medusa_errorf("can not set enabled option for tcpsocket");
                 ret = rc;
                 goto bail;
         }
 
-        if (connected) {
-                rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_CONNECTED, 0, __LINE__);
+        if (tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BIND)) {
+                rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_BINDING, 0, __LINE__);
                 if (rc < 0) {
-                        medusa_errorf("can not set state to: %d", MEDUSA_TCPSOCKET_STATE_CONNECTED);
                         ret = rc;
                         goto bail;
                 }
-                rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_CONNECTED, NULL);
+                rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_BOUND, 0, __LINE__);
                 if (rc < 0) {
-                        medusa_errorf("tcpsocket onevent failed, rc: %d", rc);
                         ret = rc;
                         goto bail;
                 }
-        } else {
-                rc = medusa_io_add_events_unlocked(tcpsocket->io, MEDUSA_IO_EVENT_OUT);
+                rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_LISTENING, 0, __LINE__);
                 if (rc < 0) {
-                        medusa_errorf("can not add io events");
                         ret = rc;
                         goto bail;
                 }
-        }
-
-        return 0;
-bail:   return ret;
-}
-
-static int tcpsocket_dnsresolver_onevent (struct medusa_dnsresolver_lookup *dnsresolver_lookup, unsigned int events, void *context, void *param)
-{
-        int rc;
-        struct tcpsocket_addrinfo *tcpsocket_addrinfo;
-        struct tcpsocket_addrinfo_entry *tcpsocket_addrinfo_entry;
-
-        struct medusa_tcpsocket *tcpsocket = context;
-        struct medusa_monitor *monitor = medusa_tcpsocket_get_monitor(tcpsocket);
-
-        medusa_monitor_lock(monitor);
-
-        if (events & MEDUSA_DNSRESOLVER_LOOKUP_EVENT_ENTRY) {
-                struct medusa_dnsresolver_lookup_event_entry *medusa_dnsresolver_lookup_event_entry = param;
-
-                tcpsocket_addrinfo = medusa_dnsresolver_lookup_get_userdata_ptr_unlocked(dnsresolver_lookup);
-                if (tcpsocket_addrinfo == NULL) {
-                        tcpsocket_addrinfo = tcpsocket_addrinfo_create();
-                        if (tcpsocket_addrinfo == NULL) {
-                                medusa_errorf("can not create addrinfo");
-                                goto error;
-                        }
-                        rc = medusa_dnsresolver_lookup_set_userdata_ptr_unlocked(dnsresolver_lookup, tcpsocket_addrinfo);
-                        if (rc < 0) {
-                                medusa_errorf("can not set userdata ptr");
-                                tcpsocket_addrinfo_destroy(tcpsocket_addrinfo);
-                                goto error;
-                        }
+                rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_LISTENING, NULL);
+                if (rc < 0) {
+                        ret = rc;
+                        goto bail;
                 }
-
-                tcpsocket_addrinfo_entry = tcpsocket_addrinfo_entry_create_from_dnsresolver(medusa_dnsresolver_lookup_event_entry);
-                if (tcpsocket_addrinfo_entry == NULL) {
-                        medusa_errorf("can not create entry from dnsresolver");
-                        goto error;
+        } else {
+                rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_RESOLVING, 0, __LINE__);
+                if (rc < 0) {
+                        ret = rc;
+                        goto bail;
                 }
-
-                rc = tcpsocket_addrinfo_add_entry(tcpsocket_addrinfo, tcpsocket_addrinfo_entry);
+                rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_RESOLVED, 0, __LINE__);
                 if (rc < 0) {
-                        medusa_errorf("can not add addrinfo entry");
-                        tcpsocket_addrinfo_entry_destroy(tcpsocket_addrinfo_entry);
-                        goto error;
+                        ret = rc;
+                        goto bail;
                 }
-        }
-        if (events & MEDUSA_DNSRESOLVER_LOOKUP_EVENT_FINISHED) {
-                tcpsocket_addrinfo = medusa_dnsresolver_lookup_get_userdata_ptr_unlocked(dnsresolver_lookup);
-                if (tcpsocket_addrinfo == NULL) {
-                        goto error;
-                } else {
-                        rc = medusa_tcpsocket_connect_resolved(tcpsocket, tcpsocket->coptions, tcpsocket_addrinfo);
-                        medusa_dnsresolver_lookup_set_userdata_ptr_unlocked(dnsresolver_lookup, NULL);
-                        tcpsocket_addrinfo_destroy(tcpsocket_addrinfo);
-                        if (rc < 0) {
-                                medusa_errorf("can not connect to resolved");
-                                goto error;
-                        }
+                rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_CONNECTING, 0, __LINE__);
+                if (rc < 0) {
+                        ret = rc;
+                        goto bail;
                 }
-        }
-        if (events & MEDUSA_DNSRESOLVER_LOOKUP_EVENT_TIMEDOUT) {
-                medusa_debugf("dnsresolver lookup timeout");
-        }
-        if (events & MEDUSA_DNSRESOLVER_LOOKUP_EVENT_ERROR) {
-                medusa_errorf("dnsresolver lookup error");
-                goto error;
-        }
-        if (events & MEDUSA_DNSRESOLVER_LOOKUP_EVENT_DESTROY) {
-                tcpsocket_addrinfo = medusa_dnsresolver_lookup_get_userdata_ptr_unlocked(dnsresolver_lookup);
-                if (tcpsocket_addrinfo != NULL) {
-                        medusa_dnsresolver_lookup_set_userdata_ptr_unlocked(dnsresolver_lookup, NULL);
-                        tcpsocket_addrinfo_destroy(tcpsocket_addrinfo);
+                rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_CONNECTED, 0, __LINE__);
+                if (rc < 0) {
+                        ret = rc;
+                        goto bail;
                 }
-                if (tcpsocket != NULL) {
-                        tcpsocket->clookup = NULL;
+                rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_CONNECTED, NULL);
+                if (rc < 0) {
+                        ret = rc;
+                        goto bail;
                 }
         }
 
-        medusa_monitor_unlock(monitor);
-        return 0;
-error:  {
-
+        return tcpsocket;
+bail:   if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return MEDUSA_ERR_PTR(ret);
+        }
+        {
                 struct medusa_tcpsocket_event_error medusa_tcpsocket_event_error;
                 medusa_tcpsocket_event_error.state = tcpsocket->state;
-                medusa_tcpsocket_event_error.error = -EIO;
+                medusa_tcpsocket_event_error.error = -ret;
                 medusa_tcpsocket_event_error.line  = __LINE__;
                 tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_ERROR, medusa_tcpsocket_event_error.error, __LINE__);
                 medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_ERROR, &medusa_tcpsocket_event_error);
         }
-        medusa_monitor_unlock(monitor);
-        return 0;
+        return tcpsocket;
 }
 
-__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_connect_with_options_unlocked (const struct medusa_tcpsocket_connect_options *options)
+__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_attach_with_options (const struct medusa_tcpsocket_attach_options *options)
 {
-        int rc;
-        int ret;
-        int line;
-
-        int resolve;
-        unsigned int protocol;
-        const char *address;
-
-        struct tcpsocket_addrinfo *tcpsocket_addrinfo;
-
         struct medusa_tcpsocket *tcpsocket;
-
-        ret = -EIO;
-        line = __LINE__;
-
-        tcpsocket = NULL;
-        tcpsocket_addrinfo = NULL;
-
         if (MEDUSA_IS_ERR_OR_NULL(options)) {
-                ret = -EINVAL;
-                line = __LINE__;
-                goto bail;
-        }
-
-        protocol = options->protocol;
-        address  = options->address;
-        if (address == NULL) {
-                ret = -EINVAL;
-                line = __LINE__;
-                goto bail;
-        }
-        if (options->port == 0) {
-                ret = -EINVAL;
-                line = __LINE__;
-                goto bail;
-        }
-
-        tcpsocket = tcpsocket_create_unlocked(options->monitor, options->onevent, options->context);
-        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
-                ret = MEDUSA_PTR_ERR(tcpsocket);
-                line = __LINE__;
-                goto bail;
+                return MEDUSA_ERR_PTR(-EINVAL);
         }
-
-        tcpsocket_add_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_CONNECT);
-        if (options->fd >= 0) {
-                tcpsocket_add_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_ATTACH);
+        if (MEDUSA_IS_ERR_OR_NULL(options->monitor)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
         }
+        medusa_monitor_lock(options->monitor);
+        tcpsocket = medusa_tcpsocket_attach_with_options_unlocked(options);
+        medusa_monitor_unlock(options->monitor);
+        return tcpsocket;
+}
 
-        rc = medusa_tcpsocket_set_nonblocking_unlocked(tcpsocket, options->nonblocking);
-        if (rc < 0) {
-                ret = rc;
-                line = __LINE__;
-                goto bail;
-        }
-        rc = medusa_tcpsocket_set_nodelay_unlocked(tcpsocket, options->nodelay);
+__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_attach_unlocked (struct medusa_monitor *monitor, int fd, int (*onevent) (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param), void *context)
+{
+        int rc;
+        struct medusa_tcpsocket_attach_options options;
+        rc = medusa_tcpsocket_attach_options_default(&options);
         if (rc < 0) {
-                ret = rc;
-                line = __LINE__;
-                goto bail;
+                return MEDUSA_ERR_PTR(rc);
         }
-        rc = medusa_tcpsocket_set_buffered_unlocked(tcpsocket, options->buffered);
-        if (rc < 0) {
-                ret = rc;
-                line = __LINE__;
-                goto bail;
+        options.monitor = monitor;
+        options.onevent = onevent;
+        options.context = context;
+        options.fd      = fd;
+        return medusa_tcpsocket_attach_with_options_unlocked(&options);
+}
+
+__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_attach (struct medusa_monitor *monitor, int fd, int (*onevent) (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param), void *context)
+{
+        struct medusa_tcpsocket *tcpsocket;
+        if (MEDUSA_IS_ERR_OR_NULL(monitor)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
         }
-        if (medusa_tcpsocket_get_buffered_unlocked(tcpsocket)) {
-                rc = medusa_tcpsocket_set_buffered_read_limit_unlocked(tcpsocket, options->buffered_read_limit);
-                if (rc < 0) {
-                        ret = rc;
-                        line = __LINE__;
-                        goto bail;
-                }
-                rc = medusa_tcpsocket_set_buffered_write_limit_unlocked(tcpsocket, options->buffered_write_limit);
-                if (rc < 0) {
-                        ret = rc;
-                        line = __LINE__;
-                        goto bail;
-                }
+        if (fd < 0) {
+                return MEDUSA_ERR_PTR(-EINVAL);
         }
-        rc = medusa_tcpsocket_set_clodestroy_unlocked(tcpsocket, options->clodestroy);
-        if (rc < 0) {
-                ret = rc;
-                line = __LINE__;
-                goto bail;
+        medusa_monitor_lock(monitor);
+        tcpsocket = medusa_tcpsocket_attach_unlocked(monitor, fd, onevent, context);
+        medusa_monitor_unlock(monitor);
+        return tcpsocket;
+}
+
+__attribute__ ((visibility ("default"))) void medusa_tcpsocket_destroy_unlocked (struct medusa_tcpsocket *tcpsocket)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return;
         }
-        rc = medusa_tcpsocket_set_ssl_certificate_unlocked(tcpsocket, options->ssl_certificate, -1);
-        if (rc < 0) {
-                ret = rc;
-                line = __LINE__;
-                goto bail;
+        tcpsocket_uninit_unlocked(tcpsocket);
+}
+
+__attribute__ ((visibility ("default"))) void medusa_tcpsocket_destroy (struct medusa_tcpsocket *tcpsocket)
+{
+        struct medusa_monitor *monitor;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return;
         }
-        rc = medusa_tcpsocket_set_ssl_privatekey_unlocked(tcpsocket, options->ssl_privatekey, -1);
-        if (rc < 0) {
-                ret = rc;
-                line = __LINE__;
-                goto bail;
+        monitor = tcpsocket->subject.monitor;
+        if (monitor != NULL) {
+                medusa_monitor_lock(monitor);
         }
-        rc = medusa_tcpsocket_set_ssl_ca_certificate_unlocked(tcpsocket, options->ssl_ca_certificate, -1);
-        if (rc < 0) {
-                ret = rc;
-                line = __LINE__;
-                goto bail;
+        medusa_tcpsocket_destroy_unlocked(tcpsocket);
+        if (monitor != NULL) {
+                medusa_monitor_unlock(monitor);
         }
-        rc = medusa_tcpsocket_set_ssl_verify_unlocked(tcpsocket, options->ssl_verify);
-        if (rc < 0) {
-                ret = rc;
-                line = __LINE__;
-                goto bail;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_state_unlocked (const struct medusa_tcpsocket *tcpsocket)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
         }
-        rc = medusa_tcpsocket_set_ssl_hostname_unlocked(tcpsocket, options->ssl_hostname ? options->ssl_hostname : address);
-        if (rc < 0) {
-                ret = rc;
-                line = __LINE__;
-                goto bail;
+        return tcpsocket->state;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_state (const struct medusa_tcpsocket *tcpsocket)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
         }
-        rc = medusa_tcpsocket_set_ssl_unlocked(tcpsocket, options->ssl);
-        if (rc < 0) {
-                ret = rc;
-                line = __LINE__;
-                goto bail;
+        medusa_monitor_lock(tcpsocket->subject.monitor);
+        rc = medusa_tcpsocket_get_state_unlocked(tcpsocket);
+        medusa_monitor_unlock(tcpsocket->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_error_unlocked (const struct medusa_tcpsocket *tcpsocket)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
         }
-        rc = medusa_tcpsocket_set_enabled_unlocked(tcpsocket, options->enabled);
-        if (rc < 0) {
-                ret = rc;
-                line = __LINE__;
-                goto bail;
+        return tcpsocket->error;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_error (const struct medusa_tcpsocket *tcpsocket)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
         }
+        medusa_monitor_lock(tcpsocket->subject.monitor);
+        rc = medusa_tcpsocket_get_error_unlocked(tcpsocket);
+        medusa_monitor_unlock(tcpsocket->subject.monitor);
+        return rc;
+}
 
-        if (options->resolve_timeout > 0) {
-                rc = medusa_tcpsocket_set_resolve_timeout_unlocked(tcpsocket, options->resolve_timeout);
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_enabled_unlocked (struct medusa_tcpsocket *tcpsocket, int enabled)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
+        }
+        if (enabled) {
+                tcpsocket_add_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_ENABLED);
+        } else {
+                tcpsocket_del_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_ENABLED);
+        }
+        if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->io)) {
+                rc = medusa_io_set_enabled_unlocked(tcpsocket->io, enabled);
                 if (rc < 0) {
-                        ret = rc;
-                        line = __LINE__;
-                        goto bail;
+                        return rc;
                 }
         }
-        if (options->connect_timeout > 0) {
-                rc = medusa_tcpsocket_set_connect_timeout_unlocked(tcpsocket, options->connect_timeout);
-                if (rc < 0) {
-                        ret = rc;
-                        line = __LINE__;
-                        goto bail;
+#if defined(MEDUSA_TCPSOCKET_OPENSSL_ENABLE) && (MEDUSA_TCPSOCKET_OPENSSL_ENABLE == 1)
+        if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->ssl) &&
+            !tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_SSL_STATE_OK) &&
+            !tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BIND) &&
+            tcpsocket->state == MEDUSA_TCPSOCKET_STATE_CONNECTED &&
+            tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_ENABLED)) {
+                rc = SSL_set_fd(tcpsocket->ssl, medusa_tcpsocket_get_fd_unlocked(tcpsocket));
+                if (rc <= 0) {
+                        return -EIO;
+                }
+                tcpsocket_stats_handshake_start(tcpsocket);
+                ERR_clear_error();
+                if (tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_ACCEPT)) {
+                        rc = SSL_accept(tcpsocket->ssl);
+                } else {
+                        rc = SSL_connect(tcpsocket->ssl);
+                }
+                if (rc <= 0) {
+                        int error;
+                        error = SSL_get_error(tcpsocket->ssl, rc);
+                        if (error == SSL_ERROR_WANT_READ) {
+                                tcpsocket->ssl_wantread = 1;
+                        } else if (error == SSL_ERROR_WANT_WRITE) {
+                                tcpsocket->ssl_wantwrite = 1;
+                                if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->io)) {
+                                        rc = medusa_io_add_events_unlocked(tcpsocket->io, MEDUSA_IO_EVENT_OUT);
+                                        if (rc < 0) {
+                                                medusa_errorf("medusa_io_add_events_unlocked failed, rc: %d", rc);
+                                                return -EIO;
+                                        }
+                                }
+                        } else if (error == SSL_ERROR_SYSCALL) {
+                                tcpsocket->ssl_wantread = 1;
+                        } else {
+                                return -EIO;
+                        }
                 }
         }
-        if (options->read_timeout > 0) {
-                rc = medusa_tcpsocket_set_read_timeout_unlocked(tcpsocket, options->read_timeout);
-                if (rc < 0) {
-                        ret = rc;
-                        line = __LINE__;
-                        goto bail;
+#endif
+        if (enabled) {
+                if (medusa_tcpsocket_get_buffered_unlocked(tcpsocket) > 0 &&
+                    medusa_buffer_get_length(tcpsocket->rbuffer) > 0) {
+                        struct medusa_tcpsocket_event_buffered_read medusa_tcpsocket_event_buffered_read;
+                        medusa_tcpsocket_event_buffered_read.length    = 0;
+                        medusa_tcpsocket_event_buffered_read.remaining = medusa_buffer_get_length(tcpsocket->rbuffer);
+                        rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_BUFFERED_READ, &medusa_tcpsocket_event_buffered_read);
+                        if (rc < 0) {
+                                return rc;
+                        }
                 }
         }
 
-        rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_RESOLVING, 0, __LINE__);
-        if (rc < 0) {
-                ret = rc;
-                line = __LINE__;
-                goto bail;
-        }
-        rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_RESOLVING, NULL);
-        if (rc < 0) {
-                ret = rc;
-                line = __LINE__;
-                goto bail;
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_enabled (struct medusa_tcpsocket *tcpsocket, int enabled)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
         }
+        medusa_monitor_lock(tcpsocket->subject.monitor);
+        rc = medusa_tcpsocket_set_enabled_unlocked(tcpsocket, enabled);
+        medusa_monitor_unlock(tcpsocket->subject.monitor);
+        return rc;
+}
 
-        resolve = 1;
-        if (protocol == MEDUSA_TCPSOCKET_PROTOCOL_IPV4) {
-                struct sockaddr_in sockaddr_in;
-ipv4:
-                memset(&sockaddr_in, 0, sizeof(sockaddr_in));
-                sockaddr_in.sin_family = AF_INET;
-                if (address == NULL) {
-                        address = "0.0.0.0";
-                } else if (strcmp(address, "localhost") == 0) {
-                        address = "127.0.0.1";
-                } else if (strcmp(address, "loopback") == 0) {
-                        address = "127.0.0.1";
-                }
-                rc = inet_pton(AF_INET, address, &sockaddr_in.sin_addr);
-                if (rc == 1) {
-                        resolve = 0;
-                }
-        } else if (protocol == MEDUSA_TCPSOCKET_PROTOCOL_IPV6) {
-                struct sockaddr_in6 sockaddr_in6;
-ipv6:
-                memset(&sockaddr_in6, 0, sizeof(sockaddr_in6));
-                sockaddr_in6.sin6_family = AF_INET6;
-                if (address == NULL) {
-                        address = "::";
-                } else if (strcmp(address, "localhost") == 0) {
-                        address = "::1";
-                } else if (strcmp(address, "loopback") == 0) {
-                        address = "::1";
-                }
-                rc = inet_pton(AF_INET6, address, &sockaddr_in6.sin6_addr);
-                if (rc == 1) {
-                        resolve = 0;
-                }
-        } else if (address == NULL) {
-                address = "0.0.0.0";
-                goto ipv4;
-        } else if (strcmp(address, "localhost") == 0) {
-                address = "127.0.0.1";
-                goto ipv4;
-        } else if (strcmp(address, "loopback") == 0) {
-                address = "127.0.0.1";
-                goto ipv4;
-        } else {
-                struct sockaddr_in sockaddr_in;
-                struct sockaddr_in6 sockaddr_in6;
-                rc = inet_pton(AF_INET, address, &sockaddr_in.sin_addr);
-                if (rc == 1) {
-                        line = __LINE__;
-                        goto ipv4;
-                }
-                rc = inet_pton(AF_INET6, address, &sockaddr_in6.sin6_addr);
-                if (rc == 1) {
-                        line = __LINE__;
-                        goto ipv6;
-                }
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_enabled_unlocked (const struct medusa_tcpsocket *tcpsocket)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
         }
+        return tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_ENABLED);
+}
 
-        if (resolve == 0 ||
-            MEDUSA_IS_ERR_OR_NULL(options->dnsresolver) ||
-            medusa_dnsresolver_get_enabled_unlocked(options->dnsresolver) != 1) {
-                struct addrinfo hints;
-                struct addrinfo *result;
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_enabled (const struct medusa_tcpsocket *tcpsocket)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(tcpsocket->subject.monitor);
+        rc = medusa_tcpsocket_get_enabled_unlocked(tcpsocket);
+        medusa_monitor_unlock(tcpsocket->subject.monitor);
+        return rc;
+}
 
-                result = NULL;
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_enable (struct medusa_tcpsocket *tcpsocket)
+{
+        return medusa_tcpsocket_set_enabled(tcpsocket, 1);
+}
 
-                memset(&hints, 0, sizeof(struct addrinfo));
-                if (protocol == MEDUSA_TCPSOCKET_PROTOCOL_IPV4) {
-                        hints.ai_family = AF_INET;
-                        hints.ai_socktype = SOCK_STREAM;
-                } else if (protocol == MEDUSA_TCPSOCKET_PROTOCOL_IPV6) {
-                        hints.ai_family = AF_INET6;
-                        hints.ai_socktype = SOCK_STREAM;
-                } else {
-                        hints.ai_family = AF_UNSPEC;
-                        hints.ai_socktype = SOCK_STREAM;
-                }
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_disable (struct medusa_tcpsocket *tcpsocket)
+{
+        return medusa_tcpsocket_set_enabled(tcpsocket, 0);
+}
 
-                rc = getaddrinfo(address, NULL, &hints, &result);
-                if (rc != 0) {
-                        if (rc == EAI_NONAME) {
-                                ret = -ENOENT;
-                        } else if (rc == EAI_AGAIN) {
-                                ret = -EAGAIN;
-                        } else {
-                                ret = -EIO;
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_buffered_unlocked (struct medusa_tcpsocket *tcpsocket, int enabled)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
+        }
+        if (enabled) {
+                tcpsocket_add_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BUFFERED);
+                if (MEDUSA_IS_ERR_OR_NULL(tcpsocket->wbuffer)) {
+                        struct medusa_buffer_init_options buffer_init_options;
+                        rc = medusa_buffer_init_options_default(&buffer_init_options);
+                        if (rc != 0) {
+                                return rc;
+                        }
+                        buffer_init_options.onevent = tcpsocket_wbuffer_onevent;
+                        buffer_init_options.context = tcpsocket;
+                        tcpsocket->wbuffer = medusa_buffer_create_with_options(&buffer_init_options);
+                        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket->wbuffer)) {
+                                return MEDUSA_PTR_ERR(tcpsocket->wbuffer);
                         }
-                        line = __LINE__;
-                        goto bail;
-                }
-                tcpsocket_addrinfo = tcpsocket_addrinfo_create_from_addrinfo(result);
-                if (tcpsocket_addrinfo == NULL) {
-                        ret = -ENOMEM;
-                        line = __LINE__;
-                        freeaddrinfo(result);
-                        goto bail;
                 }
-                rc = medusa_tcpsocket_connect_resolved(tcpsocket, options, tcpsocket_addrinfo);
-                if (rc < 0) {
-                        ret = rc;
-                        line = __LINE__;
-                        freeaddrinfo(result);
-                        goto bail;
+                if (MEDUSA_IS_ERR_OR_NULL(tcpsocket->rbuffer)) {
+                        struct medusa_buffer_init_options buffer_init_options;
+                        rc = medusa_buffer_init_options_default(&buffer_init_options);
+                        if (rc != 0) {
+                                return rc;
+                        }
+                        buffer_init_options.onevent = tcpsocket_rbuffer_onevent;
+                        buffer_init_options.context = tcpsocket;
+                        tcpsocket->rbuffer = medusa_buffer_create_with_options(&buffer_init_options);
+                        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket->rbuffer)) {
+                                return MEDUSA_PTR_ERR(tcpsocket->rbuffer);
+                        }
+                } else {
+                        rc = medusa_buffer_reset(tcpsocket->rbuffer);
+                        if (rc != 0) {
+                                return rc;
+                        }
                 }
-                freeaddrinfo(result);
         } else {
-                struct medusa_dnsresolver_lookup_options dnsresolver_lookup_options;
-                tcpsocket->coptions = medusa_tcpsocket_connect_options_duplicate(options);
-                if (MEDUSA_IS_ERR_OR_NULL(tcpsocket->coptions)) {
-                        ret = MEDUSA_PTR_ERR(tcpsocket->coptions);
-                        line = __LINE__;
-                        goto bail;
-                }
-                rc = medusa_dnsresolver_lookup_options_default(&dnsresolver_lookup_options);
-                if (rc < 0) {
-                        ret = rc;
-                        line = __LINE__;
-                        goto bail;
+                tcpsocket_del_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BUFFERED);
+                if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->wbuffer)) {
+                        medusa_buffer_destroy(tcpsocket->wbuffer);
+                        tcpsocket->wbuffer = NULL;
                 }
-                dnsresolver_lookup_options.onevent              = tcpsocket_dnsresolver_onevent;
-                dnsresolver_lookup_options.context              = tcpsocket;
-                dnsresolver_lookup_options.nameserver           = NULL;
-                dnsresolver_lookup_options.family               = (protocol == MEDUSA_TCPSOCKET_PROTOCOL_IPV4) ? MEDUSA_DNSRESOLVER_FAMILY_IPV4 :
-                                                                  (protocol == MEDUSA_TCPSOCKET_PROTOCOL_IPV6) ? MEDUSA_DNSRESOLVER_FAMILY_IPV6 :
-                                                                  MEDUSA_DNSRESOLVER_FAMILY_ANY;
-                dnsresolver_lookup_options.name                 = address;
-                dnsresolver_lookup_options.retry_count          = -1;
-                dnsresolver_lookup_options.retry_interval       = -1;
-                dnsresolver_lookup_options.resolve_timeout      = -1;
-                dnsresolver_lookup_options.enabled              = -1;
-                tcpsocket->clookup = medusa_dnsresolver_lookup_with_options_unlocked(options->dnsresolver, &dnsresolver_lookup_options);
-                if (MEDUSA_IS_ERR_OR_NULL(tcpsocket->clookup)) {
-                        ret = MEDUSA_PTR_ERR(tcpsocket->clookup);
-                        line = __LINE__;
-                        goto bail;
+                if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->rbuffer)) {
+                        medusa_buffer_destroy(tcpsocket->rbuffer);
+                        tcpsocket->rbuffer = NULL;
                 }
         }
+        return 0;
+}
 
-        if (tcpsocket_addrinfo != NULL) {
-                tcpsocket_addrinfo_destroy(tcpsocket_addrinfo);
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_buffered (struct medusa_tcpsocket *tcpsocket, int enabled)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
         }
-        return tcpsocket;
-bail:   if (tcpsocket_addrinfo != NULL) {
-                tcpsocket_addrinfo_destroy(tcpsocket_addrinfo);
+        medusa_monitor_lock(tcpsocket->subject.monitor);
+        rc = medusa_tcpsocket_set_buffered_unlocked(tcpsocket, enabled);
+        medusa_monitor_unlock(tcpsocket->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_buffered_unlocked (const struct medusa_tcpsocket *tcpsocket)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
         }
+        return tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BUFFERED);
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_buffered (const struct medusa_tcpsocket *tcpsocket)
+{
+        int rc;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
-                return MEDUSA_ERR_PTR(ret);
+                return -EINVAL;
         }
-        {
-                struct medusa_tcpsocket_event_error medusa_tcpsocket_event_error;
-                medusa_tcpsocket_event_error.state = tcpsocket->state;
-                medusa_tcpsocket_event_error.error = -ret;
-                medusa_tcpsocket_event_error.line  = line;
-                tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_ERROR, medusa_tcpsocket_event_error.error, __LINE__);
-                medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_ERROR, &medusa_tcpsocket_event_error);
+        medusa_monitor_lock(tcpsocket->subject.monitor);
+        rc = medusa_tcpsocket_get_buffered_unlocked(tcpsocket);
+        medusa_monitor_unlock(tcpsocket->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_buffered_read_limit_unlocked (struct medusa_tcpsocket *tcpsocket, int limit)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
         }
-        return tcpsocket;
+        if (!tcpsocket_get_buffered(tcpsocket)) {
+                return -EINVAL;
+        }
+        tcpsocket->rbuffer_limit = limit;
+        return 0;
 }
 
-__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_connect_with_options (const struct medusa_tcpsocket_connect_options *options)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_buffered_read_limit (struct medusa_tcpsocket *tcpsocket, int limit)
 {
-        struct medusa_tcpsocket *tcpsocket;
-        if (MEDUSA_IS_ERR_OR_NULL(options)) {
-                return MEDUSA_ERR_PTR(-EINVAL);
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
         }
-        if (MEDUSA_IS_ERR_OR_NULL(options->monitor)) {
-                return MEDUSA_ERR_PTR(-EINVAL);
+        medusa_monitor_lock(tcpsocket->subject.monitor);
+        rc = medusa_tcpsocket_set_buffered_read_limit_unlocked(tcpsocket, limit);
+        medusa_monitor_unlock(tcpsocket->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_buffered_read_limit_unlocked (const struct medusa_tcpsocket *tcpsocket)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
         }
-        medusa_monitor_lock(options->monitor);
-        tcpsocket = medusa_tcpsocket_connect_with_options_unlocked(options);
-        medusa_monitor_unlock(options->monitor);
-        return tcpsocket;
+        if (!tcpsocket_get_buffered(tcpsocket)) {
+                return -EINVAL;
+        }
+        return tcpsocket->rbuffer_limit;
 }
 
-__attribute__ ((visibility ("default")))struct medusa_tcpsocket * medusa_tcpsocket_connect_unlocked (struct medusa_monitor *monitor, unsigned int protocol, const char *address, unsigned short port, int (*onevent) (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param), void *context)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_buffered_read_limit (const struct medusa_tcpsocket *tcpsocket)
 {
         int rc;
-        struct medusa_tcpsocket_connect_options options;
-        rc = medusa_tcpsocket_connect_options_default(&options);
-        if (rc < 0) {
-                return MEDUSA_ERR_PTR(rc);
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
         }
-        options.monitor  = monitor;
-        options.onevent  = onevent;
-        options.context  = context;
-        options.protocol = protocol;
-        options.address  = address;
-        options.port     = port;
-        return medusa_tcpsocket_connect_with_options_unlocked(&options);
+        medusa_monitor_lock(tcpsocket->subject.monitor);
+        rc = medusa_tcpsocket_get_buffered_read_limit_unlocked(tcpsocket);
+        medusa_monitor_unlock(tcpsocket->subject.monitor);
+        return rc;
 }
 
-__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_connect (struct medusa_monitor *monitor, unsigned int protocol, const char *address, unsigned short port, int (*onevent) (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param), void *context)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_buffered_write_limit_unlocked (struct medusa_tcpsocket *tcpsocket, int limit)
 {
-        struct medusa_tcpsocket *tcpsocket;
-        if (MEDUSA_IS_ERR_OR_NULL(monitor)) {
-                return MEDUSA_ERR_PTR(-EINVAL);
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
         }
-        medusa_monitor_lock(monitor);
-        tcpsocket = medusa_tcpsocket_connect_unlocked(monitor, protocol, address, port, onevent, context);
-        medusa_monitor_unlock(monitor);
-        return tcpsocket;
+        if (!tcpsocket_get_buffered(tcpsocket)) {
+                return -EINVAL;
+        }
+        tcpsocket->wbuffer_limit = limit;
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_buffered_write_limit (struct medusa_tcpsocket *tcpsocket, int limit)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(tcpsocket->subject.monitor);
+        rc = medusa_tcpsocket_set_buffered_write_limit_unlocked(tcpsocket, limit);
+        medusa_monitor_unlock(tcpsocket->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_buffered_write_limit_unlocked (const struct medusa_tcpsocket *tcpsocket)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
+        }
+        if (!tcpsocket_get_buffered(tcpsocket)) {
+                return -EINVAL;
+        }
+        return tcpsocket->wbuffer_limit;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_buffered_write_limit (const struct medusa_tcpsocket *tcpsocket)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(tcpsocket->subject.monitor);
+        rc = medusa_tcpsocket_get_buffered_write_limit_unlocked(tcpsocket);
+        medusa_monitor_unlock(tcpsocket->subject.monitor);
+        return rc;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_attach_options_default (struct medusa_tcpsocket_attach_options *options)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_clodestroy_unlocked (struct medusa_tcpsocket *tcpsocket, int enabled)
 {
-        if (options == NULL) {
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
-        memset(options, 0, sizeof(struct medusa_tcpsocket_attach_options));
-        options->fd         = -1;
-        options->bound      = 0;
-        options->clodestroy = 1;
+        if (enabled) {
+                tcpsocket_add_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_CLODESTROY);
+        } else {
+                tcpsocket_del_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_CLODESTROY);
+        }
+        if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->io)) {
+                int rc;
+                rc = medusa_io_set_clodestroy_unlocked(tcpsocket->io, enabled);
+                if (rc != 0) {
+                        return rc;
+                }
+        }
         return 0;
 }
 
-__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_attach_with_options_unlocked (const struct medusa_tcpsocket_attach_options *options)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_clodestroy (struct medusa_tcpsocket *tcpsocket, int enabled)
 {
         int rc;
-        int fd;
-        int ret;
-
-        struct medusa_io_init_options io_init_options;
-        struct medusa_tcpsocket *tcpsocket;
-
-        tcpsocket = NULL;
-
-        if (MEDUSA_IS_ERR_OR_NULL(options)) {
-                ret = -EINVAL;
-                goto bail;
-        }
-        fd = options->fd;
-        if (fd < 0) {
-                ret = -EINVAL;
-                goto bail;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
         }
+        medusa_monitor_lock(tcpsocket->subject.monitor);
+        rc = medusa_tcpsocket_set_clodestroy_unlocked(tcpsocket, enabled);
+        medusa_monitor_unlock(tcpsocket->subject.monitor);
+        return rc;
+}
 
-        tcpsocket = tcpsocket_create_unlocked(options->monitor, options->onevent, options->context);
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_clodestroy_unlocked (const struct medusa_tcpsocket *tcpsocket)
+{
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
-                ret = MEDUSA_PTR_ERR(tcpsocket);
-                goto bail;
+                return -EINVAL;
         }
-        tcpsocket_add_flag(tcpsocket, (options->bound) ? MEDUSA_TCPSOCKET_FLAG_BIND | MEDUSA_TCPSOCKET_FLAG_ATTACH : MEDUSA_TCPSOCKET_FLAG_ATTACH);
+        return tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_CLODESTROY);
+}
 
-        rc = medusa_io_init_options_default(&io_init_options);
-        if (rc < 0) {
-                tcpsocket_closesocket(fd);
-                ret = rc;
-                goto bail;
-        }
-        io_init_options.monitor    = tcpsocket->subject.monitor;
-        io_init_options.fd         = fd;
-        io_init_options.events     = MEDUSA_IO_EVENT_IN;
-        io_init_options.onevent    = tcpsocket_io_onevent;
-        io_init_options.context    = tcpsocket;
-        io_init_options.clodestroy = options->clodestroy;
-        io_init_options.enabled    = 0;
-        tcpsocket->io = medusa_io_create_with_options_unlocked(&io_init_options);
-        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket->io)) {
-                ret = MEDUSA_PTR_ERR(tcpsocket->io);
-                goto bail;
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_clodestroy (const struct medusa_tcpsocket *tcpsocket)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
         }
+        medusa_monitor_lock(tcpsocket->subject.monitor);
+        rc = medusa_tcpsocket_get_clodestroy_unlocked(tcpsocket);
+        medusa_monitor_unlock(tcpsocket->subject.monitor);
+        return rc;
+}
 
-        rc = medusa_tcpsocket_set_nonblocking_unlocked(tcpsocket, options->nonblocking);
-        if (rc < 0) {
-                ret = rc;
-                goto bail;
-        }
-        rc = medusa_tcpsocket_set_nodelay_unlocked(tcpsocket, options->nodelay);
-        if (rc < 0) {
-                ret = rc;
-                goto bail;
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_nonblocking_unlocked (struct medusa_tcpsocket *tcpsocket, int enabled)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
         }
-        rc = medusa_tcpsocket_set_buffered_unlocked(tcpsocket, options->buffered);
-        if (rc < 0) {
-                ret = rc;
-                goto bail;
+        if (enabled) {
+                tcpsocket_add_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_NONBLOCKING);
+        } else {
+                tcpsocket_del_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_NONBLOCKING);
         }
-        if (medusa_tcpsocket_get_buffered_unlocked(tcpsocket)) {
-                rc = medusa_tcpsocket_set_buffered_read_limit_unlocked(tcpsocket, options->buffered_read_limit);
-                if (rc < 0) {
-                        ret = rc;
-                        goto bail;
+        if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->io)) {
+                int rc;
+#if defined(__WINDOWS__)
+                unsigned long nonblocking = enabled ? 1 : 0;
+                rc = ioctlsocket(medusa_io_get_fd_unlocked(tcpsocket->io), FIONBIO, &nonblocking);
+#else
+                int flags;
+                flags = fcntl(medusa_io_get_fd_unlocked(tcpsocket->io), F_GETFL, 0);
+                if (flags < 0) {
+                        return -errno;
                 }
-                rc = medusa_tcpsocket_set_buffered_write_limit_unlocked(tcpsocket, options->buffered_write_limit);
-                if (rc < 0) {
-                        ret = rc;
-                        goto bail;
+                flags = (tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_NONBLOCKING)) ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+                rc = fcntl(medusa_io_get_fd_unlocked(tcpsocket->io), F_SETFL, flags);
+#endif
+                if (rc != 0) {
+                        return -errno;
                 }
         }
-        rc = medusa_tcpsocket_set_clodestroy_unlocked(tcpsocket, options->clodestroy);
-        if (rc < 0) {
-                ret = rc;
-                goto bail;
-        }
-        rc = medusa_tcpsocket_set_enabled_unlocked(tcpsocket, options->enabled);
-        if (rc < 0) {
-                ret = rc;
-                goto bail;
-        }
+        return 0;
+}
 
-        if (tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BIND)) {
-                rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_BINDING, 0, __LINE__);
-                if (rc < 0) {
-                        ret = rc;
-                        goto bail;
-                }
-                rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_BOUND, 0, __LINE__);
-                if (rc < 0) {
-                        ret = rc;
-                        goto bail;
-                }
-                rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_LISTENING, 0, __LINE__);
-                if (rc < 0) {
-                        ret = rc;
-                        goto bail;
-                }
-                rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_LISTENING, NULL);
-                if (rc < 0) {
-                        ret = rc;
-                        goto bail;
-                }
-        } else {
-                rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_RESOLVING, 0, __LINE__);
-                if (rc < 0) {
-                        ret = rc;
-                        goto bail;
-                }
-                rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_RESOLVED, 0, __LINE__);
-                if (rc < 0) {
-                        ret = rc;
-                        goto bail;
-                }
-                rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_CONNECTING, 0, __LINE__);
-                if (rc < 0) {
-                        ret = rc;
-                        goto bail;
-                }
-                rc = tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_CONNECTED, 0, __LINE__);
-                if (rc < 0) {
-                        ret = rc;
-                        goto bail;
-                }
-                rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_CONNECTED, NULL);
-                if (rc < 0) {
-                        ret = rc;
-                        goto bail;
-                }
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_nonblocking (struct medusa_tcpsocket *tcpsocket, int enabled)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
         }
+        medusa_monitor_lock(tcpsocket->subject.monitor);
+        rc = medusa_tcpsocket_set_nonblocking_unlocked(tcpsocket, enabled);
+        medusa_monitor_unlock(tcpsocket->subject.monitor);
+        return rc;
+}
 
-        return tcpsocket;
-bail:   if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
-                return MEDUSA_ERR_PTR(ret);
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_nonblocking_unlocked (const struct medusa_tcpsocket *tcpsocket)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
         }
-        {
-                struct medusa_tcpsocket_event_error medusa_tcpsocket_event_error;
-                medusa_tcpsocket_event_error.state = tcpsocket->state;
-                medusa_tcpsocket_event_error.error = -ret;
-                medusa_tcpsocket_event_error.line  = __LINE__;
-                tcpsocket_set_state(tcpsocket, MEDUSA_TCPSOCKET_STATE_ERROR, medusa_tcpsocket_event_error.error, __LINE__);
-                medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_ERROR, &medusa_tcpsocket_event_error);
+        return tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_NONBLOCKING);
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_nonblocking (const struct medusa_tcpsocket *tcpsocket)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
         }
-        return tcpsocket;
+        medusa_monitor_lock(tcpsocket->subject.monitor);
+        rc = medusa_tcpsocket_get_nonblocking_unlocked(tcpsocket);
+        medusa_monitor_unlock(tcpsocket->subject.monitor);
+        return rc;
 }
 
-__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_attach_with_options (const struct medusa_tcpsocket_attach_options *options)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_nodelay_unlocked (struct medusa_tcpsocket *tcpsocket, int enabled)
 {
-        struct medusa_tcpsocket *tcpsocket;
-        if (MEDUSA_IS_ERR_OR_NULL(options)) {
-                return MEDUSA_ERR_PTR(-EINVAL);
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
         }
-        if (MEDUSA_IS_ERR_OR_NULL(options->monitor)) {
-                return MEDUSA_ERR_PTR(-EINVAL);
+        if (enabled) {
+                tcpsocket_add_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_NODELAY);
+        } else {
+                tcpsocket_del_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_NODELAY);
         }
-        medusa_monitor_lock(options->monitor);
-        tcpsocket = medusa_tcpsocket_attach_with_options_unlocked(options);
-        medusa_monitor_unlock(options->monitor);
-        return tcpsocket;
+        if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->io) &&
+            (tcpsocket->state == MEDUSA_TCPSOCKET_STATE_LISTENING || tcpsocket->state == MEDUSA_TCPSOCKET_STATE_CONNECTED)) {
+                int rc;
+                int on;
+                on = !!tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_NODELAY);
+                rc = setsockopt(medusa_io_get_fd_unlocked(tcpsocket->io), IPPROTO_TCP, TCP_NODELAY, (void *) &on, sizeof(on));
+                if (rc != 0) {
+                        if (errno != EOPNOTSUPP &&
+                            errno != EINVAL) {
+                                return -errno;
+                        }
+                }
+        }
+        return 0;
 }
 
-__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_attach_unlocked (struct medusa_monitor *monitor, int fd, int (*onevent) (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param), void *context)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_nodelay (struct medusa_tcpsocket *tcpsocket, int enabled)
 {
         int rc;
-        struct medusa_tcpsocket_attach_options options;
-        rc = medusa_tcpsocket_attach_options_default(&options);
-        if (rc < 0) {
-                return MEDUSA_ERR_PTR(rc);
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
         }
-        options.monitor = monitor;
-        options.onevent = onevent;
-        options.context = context;
-        options.fd      = fd;
-        return medusa_tcpsocket_attach_with_options_unlocked(&options);
+        medusa_monitor_lock(tcpsocket->subject.monitor);
+        rc = medusa_tcpsocket_set_nodelay_unlocked(tcpsocket, enabled);
+        medusa_monitor_unlock(tcpsocket->subject.monitor);
+        return rc;
 }
 
-__attribute__ ((visibility ("default"))) struct medusa_tcpsocket * medusa_tcpsocket_attach (struct medusa_monitor *monitor, int fd, int (*onevent) (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param), void *context)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_nodelay_unlocked (const struct medusa_tcpsocket *tcpsocket)
 {
-        struct medusa_tcpsocket *tcpsocket;
-        if (MEDUSA_IS_ERR_OR_NULL(monitor)) {
-                return MEDUSA_ERR_PTR(-EINVAL);
-        }
-        if (fd < 0) {
-                return MEDUSA_ERR_PTR(-EINVAL);
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
         }
-        medusa_monitor_lock(monitor);
-        tcpsocket = medusa_tcpsocket_attach_unlocked(monitor, fd, onevent, context);
-        medusa_monitor_unlock(monitor);
-        return tcpsocket;
+        return tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_NODELAY);
 }
 
-__attribute__ ((visibility ("default"))) void medusa_tcpsocket_destroy_unlocked (struct medusa_tcpsocket *tcpsocket)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_nodelay (const struct medusa_tcpsocket *tcpsocket)
 {
+        int rc;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
-                return;
+                return -EINVAL;
         }
-        tcpsocket_uninit_unlocked(tcpsocket);
+        medusa_monitor_lock(tcpsocket->subject.monitor);
+        rc = medusa_tcpsocket_get_nodelay_unlocked(tcpsocket);
+        medusa_monitor_unlock(tcpsocket->subject.monitor);
+        return rc;
 }
 
-__attribute__ ((visibility ("default"))) void medusa_tcpsocket_destroy (struct medusa_tcpsocket *tcpsocket)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_reuseaddr_unlocked (struct medusa_tcpsocket *tcpsocket, int enabled)
 {
-        struct medusa_monitor *monitor;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
-                return;
+                return -EINVAL;
         }
-        monitor = tcpsocket->subject.monitor;
-        if (monitor != NULL) {
-                medusa_monitor_lock(monitor);
+        if (!tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BIND)) {
+                return -EINVAL;
         }
-        medusa_tcpsocket_destroy_unlocked(tcpsocket);
-        if (monitor != NULL) {
-                medusa_monitor_unlock(monitor);
+        if (enabled) {
+                tcpsocket_add_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_REUSEADDR);
+        } else {
+                tcpsocket_del_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_REUSEADDR);
         }
-}
-
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_state_unlocked (const struct medusa_tcpsocket *tcpsocket)
-{
-        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
-                return -EINVAL;
+        if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->io)) {
+                int rc;
+                int on;
+                on = !!enabled;
+                rc = setsockopt(medusa_io_get_fd_unlocked(tcpsocket->io), SOL_SOCKET, SO_REUSEADDR, (void *) &on, sizeof(on));
+                if (rc < 0) {
+                        return -errno;
+                }
         }
-        return tcpsocket->state;
+        return 0;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_state (const struct medusa_tcpsocket *tcpsocket)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_reuseaddr (struct medusa_tcpsocket *tcpsocket, int enabled)
 {
         int rc;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
         medusa_monitor_lock(tcpsocket->subject.monitor);
-        rc = medusa_tcpsocket_get_state_unlocked(tcpsocket);
+        rc = medusa_tcpsocket_set_reuseaddr_unlocked(tcpsocket, enabled);
         medusa_monitor_unlock(tcpsocket->subject.monitor);
         return rc;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_error_unlocked (const struct medusa_tcpsocket *tcpsocket)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_reuseaddr_unlocked (const struct medusa_tcpsocket *tcpsocket)
 {
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
-        return tcpsocket->error;
+        return tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_REUSEADDR);
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_error (const struct medusa_tcpsocket *tcpsocket)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_reuseaddr (const struct medusa_tcpsocket *tcpsocket)
 {
         int rc;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
         medusa_monitor_lock(tcpsocket->subject.monitor);
-        rc = medusa_tcpsocket_get_error_unlocked(tcpsocket);
+        rc = medusa_tcpsocket_get_reuseaddr_unlocked(tcpsocket);
         medusa_monitor_unlock(tcpsocket->subject.monitor);
         return rc;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_enabled_unlocked (struct medusa_tcpsocket *tcpsocket, int enabled)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_reuseport_unlocked (struct medusa_tcpsocket *tcpsocket, int enabled)
 {
-        int rc;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
+        if (!tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BIND)) {
+                return -EINVAL;
+        }
         if (enabled) {
-                tcpsocket_add_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_ENABLED);
+                tcpsocket_add_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_REUSEPORT);
         } else {
-                tcpsocket_del_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_ENABLED);
+                tcpsocket_del_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_REUSEPORT);
         }
         if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->io)) {
-                rc = medusa_io_set_enabled_unlocked(tcpsocket->io, enabled);
-                if (rc < 0) {
-                        return rc;
-                }
-        }
-#if defined(MEDUSA_TCPSOCKET_OPENSSL_ENABLE) && (MEDUSA_TCPSOCKET_OPENSSL_ENABLE == 1)
-        if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->ssl) &&
-            !tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_SSL_STATE_OK) &&
-            !tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BIND) &&
-            tcpsocket->state == MEDUSA_TCPSOCKET_STATE_CONNECTED &&
-            tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_ENABLED)) {
-                rc = SSL_set_fd(tcpsocket->ssl, medusa_tcpsocket_get_fd_unlocked(tcpsocket));
-                if (rc <= 0) {
-                        return -EIO;
-                }
-                ERR_clear_error();
-                if (tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_ACCEPT)) {
-                        rc = SSL_accept(tcpsocket->ssl);
-                } else {
-                        rc = SSL_connect(tcpsocket->ssl);
-                }
-                if (rc <= 0) {
-                        int error;
-                        error = SSL_get_error(tcpsocket->ssl, rc);
-                        if (error == SSL_ERROR_WANT_READ) {
-                                tcpsocket->ssl_wantread = 1;
-                        } else if (error == SSL_ERROR_WANT_WRITE) {
-                                tcpsocket->ssl_wantwrite = 1;
-                                if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->io)) {
-                                        rc = medusa_io_add_events_unlocked(tcpsocket->io, MEDUSA_IO_EVENT_OUT);
-                                        if (rc < 0) {
-                                                medusa_errorf("medusa_io_add_events_unlocked failed, rc: %d", rc);
-                                                return -EIO;
-                                        }
-                                }
-                        } else if (error == SSL_ERROR_SYSCALL) {
-                                tcpsocket->ssl_wantread = 1;
-                        } else {
-                                return -EIO;
-                        }
-                }
-        }
+                int rc;
+                int on;
+                on = !!enabled;
+#if defined(SO_REUSEPORT)
+                rc = setsockopt(medusa_io_get_fd_unlocked(tcpsocket->io), SOL_SOCKET, SO_REUSEPORT, (void *) &on, sizeof(on));
+#else
+                (void) on;
+                rc = 0;
 #endif
-        if (enabled) {
-                if (medusa_tcpsocket_get_buffered_unlocked(tcpsocket) > 0 &&
-                    medusa_buffer_get_length(tcpsocket->rbuffer) > 0) {
-                        struct medusa_tcpsocket_event_buffered_read medusa_tcpsocket_event_buffered_read;
-                        medusa_tcpsocket_event_buffered_read.length    = 0;
-                        medusa_tcpsocket_event_buffered_read.remaining = medusa_buffer_get_length(tcpsocket->rbuffer);
-                        rc = medusa_tcpsocket_onevent_unlocked(tcpsocket, MEDUSA_TCPSOCKET_EVENT_BUFFERED_READ, &medusa_tcpsocket_event_buffered_read);
-                        if (rc < 0) {
-                                return rc;
-                        }
+                if (rc < 0) {
+                        return -errno;
                 }
         }
-
         return 0;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_enabled (struct medusa_tcpsocket *tcpsocket, int enabled)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_reuseport (struct medusa_tcpsocket *tcpsocket, int enabled)
 {
         int rc;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
         medusa_monitor_lock(tcpsocket->subject.monitor);
-        rc = medusa_tcpsocket_set_enabled_unlocked(tcpsocket, enabled);
+        rc = medusa_tcpsocket_set_reuseport_unlocked(tcpsocket, enabled);
         medusa_monitor_unlock(tcpsocket->subject.monitor);
         return rc;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_enabled_unlocked (const struct medusa_tcpsocket *tcpsocket)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_reuseport_unlocked (const struct medusa_tcpsocket *tcpsocket)
 {
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
-        return tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_ENABLED);
+        return tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_REUSEPORT);
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_enabled (const struct medusa_tcpsocket *tcpsocket)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_reuseport (const struct medusa_tcpsocket *tcpsocket)
 {
         int rc;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
         medusa_monitor_lock(tcpsocket->subject.monitor);
-        rc = medusa_tcpsocket_get_enabled_unlocked(tcpsocket);
+        rc = medusa_tcpsocket_get_reuseport_unlocked(tcpsocket);
         medusa_monitor_unlock(tcpsocket->subject.monitor);
         return rc;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_enable (struct medusa_tcpsocket *tcpsocket)
-{
-        return medusa_tcpsocket_set_enabled(tcpsocket, 1);
-}
-
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_disable (struct medusa_tcpsocket *tcpsocket)
-{
-        return medusa_tcpsocket_set_enabled(tcpsocket, 0);
-}
-
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_buffered_unlocked (struct medusa_tcpsocket *tcpsocket, int enabled)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_freebind_unlocked (struct medusa_tcpsocket *tcpsocket, int enabled)
 {
-        int rc;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
+        if (!tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BIND)) {
+                return -EINVAL;
+        }
         if (enabled) {
-                tcpsocket_add_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BUFFERED);
-                if (MEDUSA_IS_ERR_OR_NULL(tcpsocket->wbuffer)) {
-                        struct medusa_buffer_init_options buffer_init_options;
-                        rc = medusa_buffer_init_options_default(&buffer_init_options);
-                        if (rc != 0) {
-                                return rc;
-                        }
-                        buffer_init_options.onevent = tcpsocket_wbuffer_onevent;
-                        buffer_init_options.context = tcpsocket;
-                        tcpsocket->wbuffer = medusa_buffer_create_with_options(&buffer_init_options);
-                        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket->wbuffer)) {
-                                return MEDUSA_PTR_ERR(tcpsocket->wbuffer);
-                        }
-                }
-                if (MEDUSA_IS_ERR_OR_NULL(tcpsocket->rbuffer)) {
-                        struct medusa_buffer_init_options buffer_init_options;
-                        rc = medusa_buffer_init_options_default(&buffer_init_options);
-                        if (rc != 0) {
-                                return rc;
-                        }
-                        buffer_init_options.onevent = tcpsocket_rbuffer_onevent;
-                        buffer_init_options.context = tcpsocket;
-                        tcpsocket->rbuffer = medusa_buffer_create_with_options(&buffer_init_options);
-                        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket->rbuffer)) {
-                                return MEDUSA_PTR_ERR(tcpsocket->rbuffer);
-                        }
-                } else {
-                        rc = medusa_buffer_reset(tcpsocket->rbuffer);
-                        if (rc != 0) {
-                                return rc;
-                        }
-                }
+                tcpsocket_add_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_FREEBIND);
         } else {
-                tcpsocket_del_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BUFFERED);
-                if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->wbuffer)) {
-                        medusa_buffer_destroy(tcpsocket->wbuffer);
-                        tcpsocket->wbuffer = NULL;
-                }
-                if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->rbuffer)) {
-                        medusa_buffer_destroy(tcpsocket->rbuffer);
-                        tcpsocket->rbuffer = NULL;
+                tcpsocket_del_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_FREEBIND);
+        }
+        if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->io)) {
+#if defined(IP_FREEBIND) || defined(IPV6_FREEBIND)
+                int rc;
+                int on;
+                int fd;
+                struct sockaddr_storage sockaddr;
+                socklen_t sockaddr_length;
+
+                rc = 0;
+                on = !!enabled;
+                fd = medusa_io_get_fd_unlocked(tcpsocket->io);
+                sockaddr_length = sizeof(sockaddr);
+                if (fd >= 0 && getsockname(fd, (struct sockaddr *) &sockaddr, &sockaddr_length) == 0) {
+                        if (((struct sockaddr *) &sockaddr)->sa_family == AF_INET) {
+#if defined(IP_FREEBIND)
+                                rc = setsockopt(fd, IPPROTO_IP, IP_FREEBIND, (void *) &on, sizeof(on));
+#endif
+                        } else if (((struct sockaddr *) &sockaddr)->sa_family == AF_INET6) {
+#if defined(IPV6_FREEBIND)
+                                rc = setsockopt(fd, IPPROTO_IPV6, IPV6_FREEBIND, (void *) &on, sizeof(on));
+#endif
+                        }
                 }
+                if (rc < 0) {
+                        return -errno;
+                }
+#else
+                (void) enabled;
+#endif
         }
         return 0;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_buffered (struct medusa_tcpsocket *tcpsocket, int enabled)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_freebind (struct medusa_tcpsocket *tcpsocket, int enabled)
 {
         int rc;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
         medusa_monitor_lock(tcpsocket->subject.monitor);
-        rc = medusa_tcpsocket_set_buffered_unlocked(tcpsocket, enabled);
+        rc = medusa_tcpsocket_set_freebind_unlocked(tcpsocket, enabled);
         medusa_monitor_unlock(tcpsocket->subject.monitor);
         return rc;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_buffered_unlocked (const struct medusa_tcpsocket *tcpsocket)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_freebind_unlocked (const struct medusa_tcpsocket *tcpsocket)
 {
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
-        return tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BUFFERED);
+        return tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_FREEBIND);
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_buffered (const struct medusa_tcpsocket *tcpsocket)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_freebind (const struct medusa_tcpsocket *tcpsocket)
 {
         int rc;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
         medusa_monitor_lock(tcpsocket->subject.monitor);
-        rc = medusa_tcpsocket_get_buffered_unlocked(tcpsocket);
+        rc = medusa_tcpsocket_get_freebind_unlocked(tcpsocket);
         medusa_monitor_unlock(tcpsocket->subject.monitor);
         return rc;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_buffered_read_limit_unlocked (struct medusa_tcpsocket *tcpsocket, int limit)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_fastopen_unlocked (struct medusa_tcpsocket *tcpsocket, int queue)
 {
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
-        if (!tcpsocket_get_buffered(tcpsocket)) {
+        if (!tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BIND)) {
                 return -EINVAL;
         }
-        tcpsocket->rbuffer_limit = limit;
-        return 0;
-}
-
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_buffered_read_limit (struct medusa_tcpsocket *tcpsocket, int limit)
-{
-        int rc;
-        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+        if (queue < 0) {
                 return -EINVAL;
         }
-        medusa_monitor_lock(tcpsocket->subject.monitor);
-        rc = medusa_tcpsocket_set_buffered_read_limit_unlocked(tcpsocket, limit);
-        medusa_monitor_unlock(tcpsocket->subject.monitor);
-        return rc;
-}
-
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_buffered_read_limit_unlocked (const struct medusa_tcpsocket *tcpsocket)
-{
-        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
-                return -EINVAL;
+        if (queue == tcpsocket->fastopen) {
+                return 0;
         }
-        if (!tcpsocket_get_buffered(tcpsocket)) {
-                return -EINVAL;
+        tcpsocket->fastopen = queue;
+        if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->io)) {
+#if defined(TCP_FASTOPEN)
+                int rc;
+                rc = setsockopt(medusa_io_get_fd_unlocked(tcpsocket->io), IPPROTO_TCP, TCP_FASTOPEN, (void *) &queue, sizeof(queue));
+                if (rc < 0) {
+                        if (errno != EOPNOTSUPP &&
+                            errno != ENOPROTOOPT) {
+                                return -errno;
+                        }
+                }
+#endif
         }
-        return tcpsocket->rbuffer_limit;
+        return 0;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_buffered_read_limit (const struct medusa_tcpsocket *tcpsocket)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_fastopen (struct medusa_tcpsocket *tcpsocket, int queue)
 {
         int rc;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
         medusa_monitor_lock(tcpsocket->subject.monitor);
-        rc = medusa_tcpsocket_get_buffered_read_limit_unlocked(tcpsocket);
+        rc = medusa_tcpsocket_set_fastopen_unlocked(tcpsocket, queue);
         medusa_monitor_unlock(tcpsocket->subject.monitor);
         return rc;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_buffered_write_limit_unlocked (struct medusa_tcpsocket *tcpsocket, int limit)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_fastopen_unlocked (const struct medusa_tcpsocket *tcpsocket)
 {
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
-        if (!tcpsocket_get_buffered(tcpsocket)) {
-                return -EINVAL;
-        }
-        tcpsocket->wbuffer_limit = limit;
-        return 0;
+        return tcpsocket->fastopen;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_buffered_write_limit (struct medusa_tcpsocket *tcpsocket, int limit)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_fastopen (const struct medusa_tcpsocket *tcpsocket)
 {
         int rc;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
         medusa_monitor_lock(tcpsocket->subject.monitor);
-        rc = medusa_tcpsocket_set_buffered_write_limit_unlocked(tcpsocket, limit);
+        rc = medusa_tcpsocket_get_fastopen_unlocked(tcpsocket);
         medusa_monitor_unlock(tcpsocket->subject.monitor);
         return rc;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_buffered_write_limit_unlocked (const struct medusa_tcpsocket *tcpsocket)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_defer_accept_unlocked (struct medusa_tcpsocket *tcpsocket, int seconds)
 {
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
-        if (!tcpsocket_get_buffered(tcpsocket)) {
-                return -EINVAL;
-        }
-        return tcpsocket->wbuffer_limit;
-}
-
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_buffered_write_limit (const struct medusa_tcpsocket *tcpsocket)
-{
-        int rc;
-        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+        if (!tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BIND)) {
                 return -EINVAL;
         }
-        medusa_monitor_lock(tcpsocket->subject.monitor);
-        rc = medusa_tcpsocket_get_buffered_write_limit_unlocked(tcpsocket);
-        medusa_monitor_unlock(tcpsocket->subject.monitor);
-        return rc;
-}
-
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_clodestroy_unlocked (struct medusa_tcpsocket *tcpsocket, int enabled)
-{
-        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+        if (seconds < 0) {
                 return -EINVAL;
         }
-        if (enabled) {
-                tcpsocket_add_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_CLODESTROY);
-        } else {
-                tcpsocket_del_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_CLODESTROY);
+        if (seconds == tcpsocket->defer_accept) {
+                return 0;
         }
+        tcpsocket->defer_accept = seconds;
         if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->io)) {
+#if defined(TCP_DEFER_ACCEPT)
                 int rc;
-                rc = medusa_io_set_clodestroy_unlocked(tcpsocket->io, enabled);
-                if (rc != 0) {
-                        return rc;
+                rc = setsockopt(medusa_io_get_fd_unlocked(tcpsocket->io), IPPROTO_TCP, TCP_DEFER_ACCEPT, (void *) &seconds, sizeof(seconds));
+                if (rc < 0) {
+                        return -errno;
                 }
+#endif
         }
         return 0;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_clodestroy (struct medusa_tcpsocket *tcpsocket, int enabled)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_defer_accept (struct medusa_tcpsocket *tcpsocket, int seconds)
 {
         int rc;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
         medusa_monitor_lock(tcpsocket->subject.monitor);
-        rc = medusa_tcpsocket_set_clodestroy_unlocked(tcpsocket, enabled);
+        rc = medusa_tcpsocket_set_defer_accept_unlocked(tcpsocket, seconds);
         medusa_monitor_unlock(tcpsocket->subject.monitor);
         return rc;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_clodestroy_unlocked (const struct medusa_tcpsocket *tcpsocket)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_defer_accept_unlocked (const struct medusa_tcpsocket *tcpsocket)
 {
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
-        return tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_CLODESTROY);
+        return tcpsocket->defer_accept;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_clodestroy (const struct medusa_tcpsocket *tcpsocket)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_defer_accept (const struct medusa_tcpsocket *tcpsocket)
 {
         int rc;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
         medusa_monitor_lock(tcpsocket->subject.monitor);
-        rc = medusa_tcpsocket_get_clodestroy_unlocked(tcpsocket);
+        rc = medusa_tcpsocket_get_defer_accept_unlocked(tcpsocket);
         medusa_monitor_unlock(tcpsocket->subject.monitor);
         return rc;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_nonblocking_unlocked (struct medusa_tcpsocket *tcpsocket, int enabled)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_incoming_cpu_unlocked (struct medusa_tcpsocket *tcpsocket, int cpu)
 {
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
-        if (enabled) {
-                tcpsocket_add_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_NONBLOCKING);
-        } else {
-                tcpsocket_del_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_NONBLOCKING);
+        if (!tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BIND)) {
+                return -EINVAL;
+        }
+        if (cpu < -1) {
+                return -EINVAL;
+        }
+        if (cpu == tcpsocket->incoming_cpu) {
+                return 0;
         }
+        tcpsocket->incoming_cpu = cpu;
         if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->io)) {
+#if defined(SO_INCOMING_CPU)
                 int rc;
-#if defined(__WINDOWS__)
-                unsigned long nonblocking = enabled ? 1 : 0;
-                rc = ioctlsocket(medusa_io_get_fd_unlocked(tcpsocket->io), FIONBIO, &nonblocking);
-#else
-                int flags;
-                flags = fcntl(medusa_io_get_fd_unlocked(tcpsocket->io), F_GETFL, 0);
-                if (flags < 0) {
+                rc = setsockopt(medusa_io_get_fd_unlocked(tcpsocket->io), SOL_SOCKET, SO_INCOMING_CPU, (void *) &cpu, sizeof(cpu));
+                if (rc < 0) {
                         return -errno;
                 }
-                flags = (tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_NONBLOCKING)) ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
-                rc = fcntl(medusa_io_get_fd_unlocked(tcpsocket->io), F_SETFL, flags);
 #endif
-                if (rc != 0) {
-                        return -errno;
-                }
         }
         return 0;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_nonblocking (struct medusa_tcpsocket *tcpsocket, int enabled)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_incoming_cpu (struct medusa_tcpsocket *tcpsocket, int cpu)
 {
         int rc;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
         medusa_monitor_lock(tcpsocket->subject.monitor);
-        rc = medusa_tcpsocket_set_nonblocking_unlocked(tcpsocket, enabled);
+        rc = medusa_tcpsocket_set_incoming_cpu_unlocked(tcpsocket, cpu);
         medusa_monitor_unlock(tcpsocket->subject.monitor);
         return rc;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_nonblocking_unlocked (const struct medusa_tcpsocket *tcpsocket)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_incoming_cpu_unlocked (const struct medusa_tcpsocket *tcpsocket)
 {
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
-        return tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_NONBLOCKING);
+        return tcpsocket->incoming_cpu;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_nonblocking (const struct medusa_tcpsocket *tcpsocket)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_incoming_cpu (const struct medusa_tcpsocket *tcpsocket)
 {
         int rc;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
         medusa_monitor_lock(tcpsocket->subject.monitor);
-        rc = medusa_tcpsocket_get_nonblocking_unlocked(tcpsocket);
+        rc = medusa_tcpsocket_get_incoming_cpu_unlocked(tcpsocket);
         medusa_monitor_unlock(tcpsocket->subject.monitor);
         return rc;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_nodelay_unlocked (struct medusa_tcpsocket *tcpsocket, int enabled)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_notsent_lowat_unlocked (struct medusa_tcpsocket *tcpsocket, int bytes)
 {
+        int pbytes;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
-        if (enabled) {
-                tcpsocket_add_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_NODELAY);
-        } else {
-                tcpsocket_del_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_NODELAY);
+        if (bytes < 0) {
+                return -EINVAL;
         }
+        pbytes = tcpsocket->notsent_lowat;
+        tcpsocket->notsent_lowat = bytes;
         if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->io) &&
+            (bytes > 0 || pbytes > 0) &&
             (tcpsocket->state == MEDUSA_TCPSOCKET_STATE_LISTENING || tcpsocket->state == MEDUSA_TCPSOCKET_STATE_CONNECTED)) {
+#if defined(TCP_NOTSENT_LOWAT)
                 int rc;
-                int on;
-                on = !!tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_NODELAY);
-                rc = setsockopt(medusa_io_get_fd_unlocked(tcpsocket->io), IPPROTO_TCP, TCP_NODELAY, (void *) &on, sizeof(on));
-                if (rc != 0) {
+                /* zero falls back to the system wide default */
+                rc = setsockopt(medusa_io_get_fd_unlocked(tcpsocket->io), IPPROTO_TCP, TCP_NOTSENT_LOWAT, (void *) &bytes, sizeof(bytes));
+                if (rc < 0) {
                         if (errno != EOPNOTSUPP &&
-                            errno != EINVAL) {
+                            errno != ENOPROTOOPT) {
                                 return -errno;
                         }
                 }
+#endif
         }
         return 0;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_nodelay (struct medusa_tcpsocket *tcpsocket, int enabled)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_notsent_lowat (struct medusa_tcpsocket *tcpsocket, int bytes)
 {
         int rc;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
         medusa_monitor_lock(tcpsocket->subject.monitor);
-        rc = medusa_tcpsocket_set_nodelay_unlocked(tcpsocket, enabled);
+        rc = medusa_tcpsocket_set_notsent_lowat_unlocked(tcpsocket, bytes);
         medusa_monitor_unlock(tcpsocket->subject.monitor);
         return rc;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_nodelay_unlocked (const struct medusa_tcpsocket *tcpsocket)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_notsent_lowat_unlocked (const struct medusa_tcpsocket *tcpsocket)
 {
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
-        return tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_NODELAY);
+        return tcpsocket->notsent_lowat;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_nodelay (const struct medusa_tcpsocket *tcpsocket)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_notsent_lowat (const struct medusa_tcpsocket *tcpsocket)
 {
         int rc;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
         medusa_monitor_lock(tcpsocket->subject.monitor);
-        rc = medusa_tcpsocket_get_nodelay_unlocked(tcpsocket);
+        rc = medusa_tcpsocket_get_notsent_lowat_unlocked(tcpsocket);
         medusa_monitor_unlock(tcpsocket->subject.monitor);
         return rc;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_reuseaddr_unlocked (struct medusa_tcpsocket *tcpsocket, int enabled)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_backlog_unlocked (struct medusa_tcpsocket *tcpsocket, int backlog)
 {
+        int rc;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
         if (!tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BIND)) {
                 return -EINVAL;
         }
-        if (enabled) {
-                tcpsocket_add_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_REUSEADDR);
-        } else {
-                tcpsocket_del_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_REUSEADDR);
-        }
-        if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->io)) {
-                int rc;
-                int on;
-                on = !!enabled;
-                rc = setsockopt(medusa_io_get_fd_unlocked(tcpsocket->io), SOL_SOCKET, SO_REUSEADDR, (void *) &on, sizeof(on));
-                if (rc < 0) {
+        tcpsocket->backlog = backlog;
+        tcpsocket_add_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BACKLOG);
+        if (tcpsocket->state == MEDUSA_TCPSOCKET_STATE_LISTENING) {
+                rc = listen(medusa_io_get_fd_unlocked(tcpsocket->io), backlog);
+                if (rc != 0) {
                         return -errno;
                 }
         }
         return 0;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_reuseaddr (struct medusa_tcpsocket *tcpsocket, int enabled)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_backlog (struct medusa_tcpsocket *tcpsocket, int backlog)
 {
         int rc;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
         medusa_monitor_lock(tcpsocket->subject.monitor);
-        rc = medusa_tcpsocket_set_reuseaddr_unlocked(tcpsocket, enabled);
+        rc = medusa_tcpsocket_set_backlog_unlocked(tcpsocket, backlog);
         medusa_monitor_unlock(tcpsocket->subject.monitor);
         return rc;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_reuseaddr_unlocked (const struct medusa_tcpsocket *tcpsocket)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_backlog_unlocked (const struct medusa_tcpsocket *tcpsocket)
 {
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
-        return tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_REUSEADDR);
+        if (tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BACKLOG)) {
+                return tcpsocket->backlog;
+        }
+        return 0;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_reuseaddr (const struct medusa_tcpsocket *tcpsocket)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_backlog (const struct medusa_tcpsocket *tcpsocket)
 {
         int rc;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
         medusa_monitor_lock(tcpsocket->subject.monitor);
-        rc = medusa_tcpsocket_get_reuseaddr_unlocked(tcpsocket);
+        rc = medusa_tcpsocket_get_backlog_unlocked(tcpsocket);
         medusa_monitor_unlock(tcpsocket->subject.monitor);
         return rc;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_reuseport_unlocked (struct medusa_tcpsocket *tcpsocket, int enabled)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_accept_batch_unlocked (struct medusa_tcpsocket *tcpsocket, int batch)
 {
+        struct tcpsocket_listener *listener;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
         if (!tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BIND)) {
                 return -EINVAL;
         }
-        if (enabled) {
-                tcpsocket_add_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_REUSEPORT);
-        } else {
-                tcpsocket_del_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_REUSEPORT);
+        if (batch < 0) {
+                return -EINVAL;
         }
-        if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->io)) {
-                int rc;
-                int on;
-                on = !!enabled;
-#if defined(SO_REUSEPORT)
-                rc = setsockopt(medusa_io_get_fd_unlocked(tcpsocket->io), SOL_SOCKET, SO_REUSEPORT, (void *) &on, sizeof(on));
-#else
-                (void) on;
-                rc = 0;
-#endif
-                if (rc < 0) {
-                        return -errno;
-                }
+        if (batch <= 1 && tcpsocket->listener == NULL) {
+                return 0;
+        }
+        listener = tcpsocket_listener_get(tcpsocket);
+        if (MEDUSA_IS_ERR_OR_NULL(listener)) {
+                return MEDUSA_PTR_ERR(listener);
         }
+        listener->batch = batch;
         return 0;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_reuseport (struct medusa_tcpsocket *tcpsocket, int enabled)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_accept_batch (struct medusa_tcpsocket *tcpsocket, int batch)
 {
         int rc;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
         medusa_monitor_lock(tcpsocket->subject.monitor);
-        rc = medusa_tcpsocket_set_reuseport_unlocked(tcpsocket, enabled);
+        rc = medusa_tcpsocket_set_accept_batch_unlocked(tcpsocket, batch);
         medusa_monitor_unlock(tcpsocket->subject.monitor);
         return rc;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_reuseport_unlocked (const struct medusa_tcpsocket *tcpsocket)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_accept_batch_unlocked (const struct medusa_tcpsocket *tcpsocket)
 {
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
-        return tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_REUSEPORT);
+        if (!tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BIND)) {
+                return -EINVAL;
+        }
+        return (tcpsocket->listener == NULL) ? 0 : tcpsocket->listener->batch;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_reuseport (const struct medusa_tcpsocket *tcpsocket)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_accept_batch (const struct medusa_tcpsocket *tcpsocket)
 {
         int rc;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
         medusa_monitor_lock(tcpsocket->subject.monitor);
-        rc = medusa_tcpsocket_get_reuseport_unlocked(tcpsocket);
+        rc = medusa_tcpsocket_get_accept_batch_unlocked(tcpsocket);
         medusa_monitor_unlock(tcpsocket->subject.monitor);
         return rc;
 }
-
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_freebind_unlocked (struct medusa_tcpsocket *tcpsocket, int enabled)
-{
-        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
-                return -EINVAL;
-        }
-        if (!tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BIND)) {
-                return -EINVAL;
-        }
-        if (enabled) {
-                tcpsocket_add_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_FREEBIND);
-        } else {
-                tcpsocket_del_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_FREEBIND);
-        }
-        if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->io)) {
-#if defined(IP_FREEBIND) || defined(IPV6_FREEBIND)
-                int rc;
-                int on;
-                int fd;
-                struct sockaddr_storage sockaddr;
-                socklen_t sockaddr_length;
-
-                rc = 0;
-                on = !!enabled;
-                fd = medusa_io_get_fd_unlocked(tcpsocket->io);
-                sockaddr_length = sizeof(sockaddr);
-                if (fd >= 0 && getsockname(fd, (struct sockaddr *) &sockaddr, &sockaddr_length) == 0) {
-                        if (((struct sockaddr *) &sockaddr)->sa_family == AF_INET) {
-#if defined(IP_FREEBIND)
-                                rc = setsockopt(fd, IPPROTO_IP, IP_FREEBIND, (void *) &on, sizeof(on));
-#endif
-                        } else if (((struct sockaddr *) &sockaddr)->sa_family == AF_INET6) {
-#if defined(IPV6_FREEBIND)
-                                rc = setsockopt(fd, IPPROTO_IPV6, IPV6_FREEBIND, (void *) &on, sizeof(on));
-#endif
-                        }
-                }
-                if (rc < 0) {
-                        return -errno;
-                }
-#else
-                (void) enabled;
-#endif
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_max_connections_unlocked (struct medusa_tcpsocket *tcpsocket, int max_connections)
+{
+        struct tcpsocket_listener *listener;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
         }
-        return 0;
+        if (!tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BIND)) {
+                return -EINVAL;
+        }
+        if (max_connections < 0) {
+                return -EINVAL;
+        }
+        if (max_connections == 0 && tcpsocket->listener == NULL) {
+                return 0;
+        }
+        listener = tcpsocket_listener_get(tcpsocket);
+        if (MEDUSA_IS_ERR_OR_NULL(listener)) {
+                return MEDUSA_PTR_ERR(listener);
+        }
+        listener->max_connections = max_connections;
+        return tcpsocket_listener_update(listener);
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_freebind (struct medusa_tcpsocket *tcpsocket, int enabled)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_max_connections (struct medusa_tcpsocket *tcpsocket, int max_connections)
 {
         int rc;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
         medusa_monitor_lock(tcpsocket->subject.monitor);
-        rc = medusa_tcpsocket_set_freebind_unlocked(tcpsocket, enabled);
+        rc = medusa_tcpsocket_set_max_connections_unlocked(tcpsocket, max_connections);
         medusa_monitor_unlock(tcpsocket->subject.monitor);
         return rc;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_freebind_unlocked (const struct medusa_tcpsocket *tcpsocket)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_max_connections_unlocked (const struct medusa_tcpsocket *tcpsocket)
 {
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
-        return tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_FREEBIND);
+        if (!tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BIND)) {
+                return -EINVAL;
+        }
+        return (tcpsocket->listener == NULL) ? 0 : tcpsocket->listener->max_connections;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_freebind (const struct medusa_tcpsocket *tcpsocket)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_max_connections (const struct medusa_tcpsocket *tcpsocket)
 {
         int rc;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
         medusa_monitor_lock(tcpsocket->subject.monitor);
-        rc = medusa_tcpsocket_get_freebind_unlocked(tcpsocket);
+        rc = medusa_tcpsocket_get_max_connections_unlocked(tcpsocket);
         medusa_monitor_unlock(tcpsocket->subject.monitor);
         return rc;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_backlog_unlocked (struct medusa_tcpsocket *tcpsocket, int backlog)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_accept_rate_unlocked (struct medusa_tcpsocket *tcpsocket, double rate, int burst)
 {
-        int rc;
+        struct tcpsocket_listener *listener;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
         if (!tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BIND)) {
                 return -EINVAL;
         }
-        tcpsocket->backlog = backlog;
-        tcpsocket_add_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BACKLOG);
-        if (tcpsocket->state == MEDUSA_TCPSOCKET_STATE_LISTENING) {
-                rc = listen(medusa_io_get_fd_unlocked(tcpsocket->io), backlog);
-                if (rc != 0) {
-                        return -errno;
-                }
+        if (rate < 0 || burst < 0) {
+                return -EINVAL;
         }
-        return 0;
+        if (rate == 0 && tcpsocket->listener == NULL) {
+                return 0;
+        }
+        listener = tcpsocket_listener_get(tcpsocket);
+        if (MEDUSA_IS_ERR_OR_NULL(listener)) {
+                return MEDUSA_PTR_ERR(listener);
+        }
+        listener->rate     = rate;
+        listener->burst    = MAX(1, burst);
+        listener->tokens   = listener->burst;
+        listener->refilled = 0;
+        return tcpsocket_listener_update(listener);
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_backlog (struct medusa_tcpsocket *tcpsocket, int backlog)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_accept_rate (struct medusa_tcpsocket *tcpsocket, double rate, int burst)
 {
         int rc;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
         medusa_monitor_lock(tcpsocket->subject.monitor);
-        rc = medusa_tcpsocket_set_backlog_unlocked(tcpsocket, backlog);
+        rc = medusa_tcpsocket_set_accept_rate_unlocked(tcpsocket, rate, burst);
         medusa_monitor_unlock(tcpsocket->subject.monitor);
         return rc;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_backlog_unlocked (const struct medusa_tcpsocket *tcpsocket)
+__attribute__ ((visibility ("default"))) double medusa_tcpsocket_get_accept_rate_unlocked (const struct medusa_tcpsocket *tcpsocket)
 {
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
-        if (tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BACKLOG)) {
-                return tcpsocket->backlog;
+        if (!tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BIND)) {
+                return -EINVAL;
+        }
+        return (tcpsocket->listener == NULL) ? 0 : tcpsocket->listener->rate;
+}
+
+__attribute__ ((visibility ("default"))) double medusa_tcpsocket_get_accept_rate (const struct medusa_tcpsocket *tcpsocket)
+{
+        double rc;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(tcpsocket->subject.monitor);
+        rc = medusa_tcpsocket_get_accept_rate_unlocked(tcpsocket);
+        medusa_monitor_unlock(tcpsocket->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_accept_stats_unlocked (const struct medusa_tcpsocket *tcpsocket, struct medusa_tcpsocket_accept_stats *stats)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
+        }
+        if (stats == NULL) {
+                return -EINVAL;
+        }
+        if (!tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_BIND)) {
+                return -EINVAL;
+        }
+        if (tcpsocket->listener == NULL) {
+                memset(stats, 0, sizeof(struct medusa_tcpsocket_accept_stats));
+        } else {
+                memcpy(stats, &tcpsocket->listener->stats, sizeof(struct medusa_tcpsocket_accept_stats));
         }
         return 0;
 }
 
-__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_backlog (const struct medusa_tcpsocket *tcpsocket)
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_accept_stats (const struct medusa_tcpsocket *tcpsocket, struct medusa_tcpsocket_accept_stats *stats)
 {
         int rc;
         if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
                 return -EINVAL;
         }
         medusa_monitor_lock(tcpsocket->subject.monitor);
-        rc = medusa_tcpsocket_get_backlog_unlocked(tcpsocket);
+        rc = medusa_tcpsocket_get_accept_stats_unlocked(tcpsocket, stats);
         medusa_monitor_unlock(tcpsocket->subject.monitor);
         return rc;
 }
@@ -4648,6 +6816,7 @@ __attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_ssl_unlocked (
                         if (rc <= 0) {
                                 return -EIO;
                         }
+                        tcpsocket_stats_handshake_start(tcpsocket);
                         ERR_clear_error();
                         if (tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_ACCEPT)) {
                                 rc = SSL_accept(tcpsocket->ssl);
@@ -5642,6 +7811,305 @@ __attribute__ ((visibility ("default"))) unsigned int medusa_tcpsocket_get_event
         return rc;
 }
 
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_pipe_options_default (struct medusa_tcpsocket_pipe_options *options)
+{
+        if (options == NULL) {
+                return -EINVAL;
+        }
+        memset(options, 0, sizeof(struct medusa_tcpsocket_pipe_options));
+        options->pipe_size  = 0;
+        options->half_close = 1;
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_pipe_unlocked (struct medusa_tcpsocket *tcpsocket, struct medusa_tcpsocket *peer, const struct medusa_tcpsocket_pipe_options *options)
+{
+        int rc;
+        struct tcpsocket_pipe *pipe;
+        struct medusa_tcpsocket_pipe_options pipe_options;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(peer)) {
+                return -EINVAL;
+        }
+        if (tcpsocket == peer) {
+                return -EINVAL;
+        }
+        if (tcpsocket->subject.monitor != peer->subject.monitor) {
+                return -EINVAL;
+        }
+        if ((tcpsocket->state != MEDUSA_TCPSOCKET_STATE_CONNECTED) ||
+            (peer->state != MEDUSA_TCPSOCKET_STATE_CONNECTED)) {
+                return -EINVAL;
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket->io) ||
+            MEDUSA_IS_ERR_OR_NULL(peer->io)) {
+                return -EINVAL;
+        }
+        if ((tcpsocket->pipe != NULL) ||
+            (peer->pipe != NULL)) {
+                return -EBUSY;
+        }
+        if ((medusa_tcpsocket_get_ssl_unlocked(tcpsocket) > 0) ||
+            (medusa_tcpsocket_get_ssl_unlocked(peer) > 0)) {
+                return -EINVAL;
+        }
+#if !defined(__linux__)
+        (void) rc;
+        (void) pipe;
+        (void) options;
+        (void) pipe_options;
+        return -ENOTSUP;
+#else
+        if (options == NULL) {
+                rc = medusa_tcpsocket_pipe_options_default(&pipe_options);
+                if (rc < 0) {
+                        return rc;
+                }
+                options = &pipe_options;
+        }
+        pipe = tcpsocket_pipe_create(tcpsocket, peer, options);
+        if (MEDUSA_IS_ERR_OR_NULL(pipe)) {
+                return MEDUSA_PTR_ERR(pipe);
+        }
+        tcpsocket->pipe          = pipe;
+        tcpsocket->pipe_received = 0;
+        tcpsocket->pipe_sent     = 0;
+        peer->pipe               = pipe;
+        peer->pipe_received      = 0;
+        peer->pipe_sent          = 0;
+        rc = tcpsocket_pipe_commit(pipe);
+        if (rc < 0) {
+                tcpsocket_pipe_release(pipe, 1);
+                return rc;
+        }
+        return 0;
+#endif
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_pipe (struct medusa_tcpsocket *tcpsocket, struct medusa_tcpsocket *peer, const struct medusa_tcpsocket_pipe_options *options)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(tcpsocket->subject.monitor);
+        rc = medusa_tcpsocket_pipe_unlocked(tcpsocket, peer, options);
+        medusa_monitor_unlock(tcpsocket->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_unpipe_unlocked (struct medusa_tcpsocket *tcpsocket)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
+        }
+        if (tcpsocket->pipe == NULL) {
+                return -EINVAL;
+        }
+        return tcpsocket_pipe_release(tcpsocket->pipe, 1);
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_unpipe (struct medusa_tcpsocket *tcpsocket)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(tcpsocket->subject.monitor);
+        rc = medusa_tcpsocket_unpipe_unlocked(tcpsocket);
+        medusa_monitor_unlock(tcpsocket->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_piped_unlocked (const struct medusa_tcpsocket *tcpsocket)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
+        }
+        return (tcpsocket->pipe != NULL) ? 1 : 0;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_piped (const struct medusa_tcpsocket *tcpsocket)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(tcpsocket->subject.monitor);
+        rc = medusa_tcpsocket_get_piped_unlocked(tcpsocket);
+        medusa_monitor_unlock(tcpsocket->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_pipe_stats_unlocked (const struct medusa_tcpsocket *tcpsocket, struct medusa_tcpsocket_pipe_stats *stats)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
+        }
+        if (stats == NULL) {
+                return -EINVAL;
+        }
+        stats->received = tcpsocket->pipe_received;
+        stats->sent     = tcpsocket->pipe_sent;
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_pipe_stats (const struct medusa_tcpsocket *tcpsocket, struct medusa_tcpsocket_pipe_stats *stats)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(tcpsocket->subject.monitor);
+        rc = medusa_tcpsocket_get_pipe_stats_unlocked(tcpsocket, stats);
+        medusa_monitor_unlock(tcpsocket->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_stats_enabled_unlocked (struct medusa_tcpsocket *tcpsocket, int enabled)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
+        }
+        if (!!enabled == tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_STATS)) {
+                return 0;
+        }
+        memset(&tcpsocket->stats, 0, sizeof(struct tcpsocket_stats));
+        if (enabled) {
+                tcpsocket_add_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_STATS);
+                if (tcpsocket->state == MEDUSA_TCPSOCKET_STATE_CONNECTED &&
+                    tcpsocket_get_buffered(tcpsocket) &&
+                    !MEDUSA_IS_ERR_OR_NULL(tcpsocket->wbuffer)) {
+                        tcpsocket_stats_wbuffer(tcpsocket, medusa_buffer_get_length(tcpsocket->wbuffer));
+                }
+        } else {
+                tcpsocket_del_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_STATS);
+        }
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_set_stats_enabled (struct medusa_tcpsocket *tcpsocket, int enabled)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(tcpsocket->subject.monitor);
+        rc = medusa_tcpsocket_set_stats_enabled_unlocked(tcpsocket, enabled);
+        medusa_monitor_unlock(tcpsocket->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_stats_enabled_unlocked (const struct medusa_tcpsocket *tcpsocket)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
+        }
+        return tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_STATS);
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_stats_enabled (const struct medusa_tcpsocket *tcpsocket)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(tcpsocket->subject.monitor);
+        rc = medusa_tcpsocket_get_stats_enabled_unlocked(tcpsocket);
+        medusa_monitor_unlock(tcpsocket->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_stats_unlocked (const struct medusa_tcpsocket *tcpsocket, struct medusa_tcpsocket_stats *stats)
+{
+        uint64_t now;
+        uint64_t wpending;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
+        }
+        if (stats == NULL) {
+                return -EINVAL;
+        }
+        memset(stats, 0, sizeof(struct medusa_tcpsocket_stats));
+        stats->rtt    = -1;
+        stats->rttvar = -1;
+        if (!tcpsocket_has_flag(tcpsocket, MEDUSA_TCPSOCKET_FLAG_STATS)) {
+                return 0;
+        }
+        now = tcpsocket_stats_clock();
+        wpending = tcpsocket->stats.wpending;
+        if (tcpsocket->stats.wpending_since != 0) {
+                wpending += now - tcpsocket->stats.wpending_since;
+        }
+        stats->sockets           = 1;
+        stats->received          = tcpsocket->stats.received;
+        stats->sent              = tcpsocket->stats.sent;
+        stats->recv_calls        = tcpsocket->stats.recv_calls;
+        stats->send_calls        = tcpsocket->stats.send_calls;
+        stats->recv_eagain       = tcpsocket->stats.recv_eagain;
+        stats->send_eagain       = tcpsocket->stats.send_eagain;
+        stats->wbuffer_highwater = tcpsocket->stats.wbuffer_highwater;
+        stats->wpending          = wpending / 1e9;
+        stats->connect           = tcpsocket->stats.connect / 1e9;
+        stats->handshake         = tcpsocket->stats.handshake / 1e9;
+#if defined(__linux__) && defined(TCP_INFO)
+        /* sampled now rather than tracked, it costs a syscall */
+        if (tcpsocket->state == MEDUSA_TCPSOCKET_STATE_CONNECTED &&
+            !MEDUSA_IS_ERR_OR_NULL(tcpsocket->io)) {
+                int rc;
+                socklen_t length;
+                struct tcp_info tcp_info;
+                length = sizeof(struct tcp_info);
+                rc = getsockopt(medusa_io_get_fd_unlocked(tcpsocket->io), IPPROTO_TCP, TCP_INFO, &tcp_info, &length);
+                if (rc == 0) {
+                        stats->rtt    = tcp_info.tcpi_rtt / 1e6;
+                        stats->rttvar = tcp_info.tcpi_rttvar / 1e6;
+                }
+        }
+#endif
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_get_stats (const struct medusa_tcpsocket *tcpsocket, struct medusa_tcpsocket_stats *stats)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(tcpsocket->subject.monitor);
+        rc = medusa_tcpsocket_get_stats_unlocked(tcpsocket, stats);
+        medusa_monitor_unlock(tcpsocket->subject.monitor);
+        return rc;
+}
+
+/* adds stats into total, for servers to sum up their clients. high water
+ * mark and round trip times keep the worst of the two */
+__attribute__ ((visibility ("default"))) int medusa_tcpsocket_stats_merge (struct medusa_tcpsocket_stats *total, const struct medusa_tcpsocket_stats *stats)
+{
+        if (total == NULL) {
+                return -EINVAL;
+        }
+        if (stats == NULL) {
+                return -EINVAL;
+        }
+        total->sockets     += stats->sockets;
+        total->received    += stats->received;
+        total->sent        += stats->sent;
+        total->recv_calls  += stats->recv_calls;
+        total->send_calls  += stats->send_calls;
+        total->recv_eagain += stats->recv_eagain;
+        total->send_eagain += stats->send_eagain;
+        total->wpending    += stats->wpending;
+        total->connect     += stats->connect;
+        total->handshake   += stats->handshake;
+        total->wbuffer_highwater = MAX(total->wbuffer_highwater, stats->wbuffer_highwater);
+        total->rtt               = MAX(total->rtt, stats->rtt);
+        total->rttvar            = MAX(total->rttvar, stats->rttvar);
+        return 0;
+}
+
 __attribute__ ((visibility ("default"))) int medusa_tcpsocket_onevent_unlocked (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *param)
 {
         int ret;
@@ -5660,11 +8128,29 @@ __attribute__ ((visibility ("default"))) int medusa_tcpsocket_onevent_unlocked (
                 }
         }
         if (events & MEDUSA_TCPSOCKET_EVENT_DESTROY) {
+                if (tcpsocket->pipe != NULL) {
+                        tcpsocket_pipe_release(tcpsocket->pipe, 1);
+                }
                 if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->clookup)) {
                         medusa_dnsresolver_lookup_set_context_unlocked(tcpsocket->clookup, NULL);
                         medusa_dnsresolver_lookup_destroy_unlocked(tcpsocket->clookup);
                         tcpsocket->clookup = NULL;
                 }
+                if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->rlookup)) {
+                        medusa_resolver_lookup_cancel_unlocked(tcpsocket->rlookup);
+                        tcpsocket->rlookup = NULL;
+                }
+                if (tcpsocket->race != NULL) {
+                        tcpsocket_race_destroy(tcpsocket->race);
+                        tcpsocket->race = NULL;
+                }
+                if (tcpsocket->listener != NULL) {
+                        tcpsocket_listener_release(tcpsocket);
+                }
+                if (tcpsocket->fastopen_pending != NULL) {
+                        free(tcpsocket->fastopen_pending);
+                        tcpsocket->fastopen_pending = NULL;
+                }
                 if (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->coptions)) {
                         medusa_tcpsocket_connect_options_destroy(tcpsocket->coptions);
                 }
@@ -5732,6 +8218,7 @@ __attribute__ ((visibility ("default"))) int medusa_tcpsocket_onevent_unlocked (
         } else {
                 if ((tcpsocket->state == MEDUSA_TCPSOCKET_STATE_CONNECTED) &&
                     (tcpsocket_get_buffered(tcpsocket) > 0) &&
+                    (tcpsocket->pipe == NULL) &&
                     (!MEDUSA_IS_ERR_OR_NULL(tcpsocket->io))) {
                         int rc;
                         int64_t wblength;
@@ -5753,6 +8240,7 @@ __attribute__ ((visibility ("default"))) int medusa_tcpsocket_onevent_unlocked (
                                         goto out;
                                 }
                         }
+                        tcpsocket_stats_wbuffer(tcpsocket, wblength);
                         rblength = medusa_buffer_get_length(tcpsocket->rbuffer);
                         if (rblength < 0) {
                                 ret = rblength;
@@ -6206,6 +8694,7 @@ __attribute__ ((visibility ("default"))) int64_t medusa_tcpsocket_read_unlocked
                         return fd;
                 }
                 rc = recv(fd, data, length, 0);
+                tcpsocket_stats_recv(tcpsocket, rc);
                 if (rc < 0) {
                         rc = -errno;
                 }
@@ -6264,6 +8753,7 @@ __attribute__ ((visibility ("default"))) int64_t medusa_tcpsocket_write_unlocked
                         return fd;
                 }
                 rc = send(fd, data, length, 0);
+                tcpsocket_stats_send(tcpsocket, rc);
                 if (rc < 0) {
                         rc = -errno;
                 }
@@ -6326,6 +8816,7 @@ __attribute__ ((visibility ("default"))) int64_t medusa_tcpsocket_writev_unlocke
                 rc = 0;
                 for (i = 0; i < niovecs; i++) {
                         sr = send(fd, iovecs[i].iov_base, iovecs[i].iov_len, 0);
+                        tcpsocket_stats_send(tcpsocket, sr);
                         if (sr < 0) {
                                 rc = -errno;
                                 break;
@@ -6407,6 +8898,7 @@ __attribute__ ((visibility ("default"))) int64_t medusa_tcpsocket_vprintf_unlock
                         return -EIO;
                 }
                 rc = send(fd, buffer, length, 0);
+                tcpsocket_stats_send(tcpsocket, rc);
                 if (rc < 0) {
                         rc = -errno;
                 }
@@ -6491,8 +8983,25 @@ __attribute__ ((visibility ("default"))) const char * medusa_tcpsocket_event_str
         return "MEDUSA_TCPSOCKET_EVENT_UNKNOWN";
 }
 
+static int tcpsocket_subject_onevent (struct medusa_subject *subject, unsigned int events, void *param)
+{
+        return medusa_tcpsocket_onevent_unlocked((struct medusa_tcpsocket *) subject, events, param);
+}
+
+static int tcpsocket_subject_destroy (struct medusa_subject *subject)
+{
+        return medusa_tcpsocket_onevent_unlocked((struct medusa_tcpsocket *) subject, MEDUSA_TCPSOCKET_EVENT_DESTROY, NULL);
+}
+
+static const struct medusa_subject_type g_subject_type = {
+        .rank    = MEDUSA_SUBJECT_RANK_TCPSOCKET,
+        .onevent = tcpsocket_subject_onevent,
+        .destroy = tcpsocket_subject_destroy
+};
+
 __attribute__ ((constructor)) static void tcpsocket_constructor (void)
 {
+        medusa_monitor_register_subject_type(MEDUSA_SUBJECT_TYPE_TCPSOCKET, &g_subject_type);
 #if defined(MEDUSA_TCPSOCKET_USE_POOL) && (MEDUSA_TCPSOCKET_USE_POOL == 1)
         g_pool = medusa_pool_create("medusa-tcpsocket", sizeof(struct medusa_tcpsocket), 0, 0, MEDUSA_POOL_FLAG_DEFAULT | MEDUSA_POOL_FLAG_THREAD_SAFE, NULL, NULL, NULL);
 #endif
@@ -107,8 +107,12 @@ struct medusa_tcpsocket_bind_options {
         int reuseaddr;
         int reuseport;
         int freebind;
+        int fastopen;
+        int defer_accept;
+        int incoming_cpu;
         int nonblocking;
         int nodelay;
+        int notsent_lowat;
         int backlog;
         int buffered;
         int buffered_read_limit;
@@ -118,6 +122,11 @@ struct medusa_tcpsocket_bind_options {
         const char *ssl_privatekey;
         const char *ssl_ca_certificate;
         int ssl_verify;
+        int stats;
+        int accept_batch;
+        int max_connections;
+        double accept_rate;
+        int accept_burst;
         int enabled;
 };
 
@@ -128,9 +137,11 @@ struct medusa_tcpsocket_accept_options {
         int clodestroy;
         int nonblocking;
         int nodelay;
+        int notsent_lowat;
         int buffered;
         int buffered_read_limit;
         int buffered_write_limit;
+        int stats;
         int enabled;
 };
 
@@ -148,12 +159,15 @@ struct medusa_tcpsocket_connect_options {
         double resolve_timeout;
         double connect_timeout;
         double read_timeout;
+        double attempt_delay;
         int fd;
         int clodestroy;
         int reuseaddr;
         int reuseport;
+        int fastopen;
         int nonblocking;
         int nodelay;
+        int notsent_lowat;
         int buffered;
         int buffered_read_limit;
         int buffered_write_limit;
@@ -163,6 +177,7 @@ struct medusa_tcpsocket_connect_options {
         const char *ssl_privatekey;
         const char *ssl_ca_certificate;
         int ssl_verify;
+        int stats;
         int enabled;
 };
 
@@ -181,6 +196,44 @@ struct medusa_tcpsocket_attach_options {
         int enabled;
 };
 
+struct medusa_tcpsocket_pipe_options {
+        int pipe_size;
+        int half_close;
+};
+
+struct medusa_tcpsocket_pipe_stats {
+        int64_t received;
+        int64_t sent;
+};
+
+struct medusa_tcpsocket_stats {
+        int64_t sockets;
+        int64_t received;
+        int64_t sent;
+        int64_t recv_calls;
+        int64_t send_calls;
+        int64_t recv_eagain;
+        int64_t send_eagain;
+        int64_t wbuffer_highwater;
+        double wpending;
+        double connect;
+        double handshake;
+        double rtt;
+        double rttvar;
+};
+
+/* counters of a listener, kept while any of accept batch, max connections
+ * or accept rate is set. limited and ratelimited count the times the
+ * listener stopped polling for connections. */
+struct medusa_tcpsocket_accept_stats {
+        int64_t connections;
+        int64_t accepted;
+        int64_t wakeups;
+        int64_t rejected;
+        int64_t limited;
+        int64_t ratelimited;
+};
+
 struct medusa_tcpsocket_event_buffered_read {
         int64_t length;
         int64_t remaining;
@@ -263,9 +316,32 @@ int medusa_tcpsocket_get_reuseport (const struct medusa_tcpsocket *tcpsocket);
 int medusa_tcpsocket_set_freebind (struct medusa_tcpsocket *tcpsocket, int enabled);
 int medusa_tcpsocket_get_freebind (const struct medusa_tcpsocket *tcpsocket);
 
+int medusa_tcpsocket_set_fastopen (struct medusa_tcpsocket *tcpsocket, int queue);
+int medusa_tcpsocket_get_fastopen (const struct medusa_tcpsocket *tcpsocket);
+
+int medusa_tcpsocket_set_defer_accept (struct medusa_tcpsocket *tcpsocket, int seconds);
+int medusa_tcpsocket_get_defer_accept (const struct medusa_tcpsocket *tcpsocket);
+
+int medusa_tcpsocket_set_incoming_cpu (struct medusa_tcpsocket *tcpsocket, int cpu);
+int medusa_tcpsocket_get_incoming_cpu (const struct medusa_tcpsocket *tcpsocket);
+
+int medusa_tcpsocket_set_notsent_lowat (struct medusa_tcpsocket *tcpsocket, int bytes);
+int medusa_tcpsocket_get_notsent_lowat (const struct medusa_tcpsocket *tcpsocket);
+
 int medusa_tcpsocket_set_backlog (struct medusa_tcpsocket *tcpsocket, int backlog);
 int medusa_tcpsocket_get_backlog (const struct medusa_tcpsocket *tcpsocket);
 
+int medusa_tcpsocket_set_accept_batch (struct medusa_tcpsocket *tcpsocket, int batch);
+int medusa_tcpsocket_get_accept_batch (const struct medusa_tcpsocket *tcpsocket);
+
+int medusa_tcpsocket_set_max_connections (struct medusa_tcpsocket *tcpsocket, int max_connections);
+int medusa_tcpsocket_get_max_connections (const struct medusa_tcpsocket *tcpsocket);
+
+int medusa_tcpsocket_set_accept_rate (struct medusa_tcpsocket *tcpsocket, double rate, int burst);
+double medusa_tcpsocket_get_accept_rate (const struct medusa_tcpsocket *tcpsocket);
+
+int medusa_tcpsocket_get_accept_stats (const struct medusa_tcpsocket *tcpsocket, struct medusa_tcpsocket_accept_stats *stats);
+
 int medusa_tcpsocket_set_resolve_timeout (struct medusa_tcpsocket *tcpsocket, double timeout);
 double medusa_tcpsocket_get_resolve_timeout (const struct medusa_tcpsocket *tcpsocket);
 
@@ -315,6 +391,16 @@ int medusa_tcpsocket_add_events (struct medusa_tcpsocket *tcpsocket, unsigned in
 int medusa_tcpsocket_del_events (struct medusa_tcpsocket *tcpsocket, unsigned int events);
 unsigned int medusa_tcpsocket_get_events (const struct medusa_tcpsocket *tcpsocket);
 
+int medusa_tcpsocket_pipe_options_default (struct medusa_tcpsocket_pipe_options *options);
+int medusa_tcpsocket_pipe (struct medusa_tcpsocket *tcpsocket, struct medusa_tcpsocket *peer, const struct medusa_tcpsocket_pipe_options *options);
+int medusa_tcpsocket_unpipe (struct medusa_tcpsocket *tcpsocket);
+int medusa_tcpsocket_get_piped (const struct medusa_tcpsocket *tcpsocket);
+int medusa_tcpsocket_get_pipe_stats (const struct medusa_tcpsocket *tcpsocket, struct medusa_tcpsocket_pipe_stats *stats);
+
+int medusa_tcpsocket_set_stats_enabled (struct medusa_tcpsocket *tcpsocket, int enabled);
+int medusa_tcpsocket_get_stats_enabled (const struct medusa_tcpsocket *tcpsocket);
+int medusa_tcpsocket_get_stats (const struct medusa_tcpsocket *tcpsocket, struct medusa_tcpsocket_stats *stats);
+
 int medusa_tcpsocket_get_protocol (struct medusa_tcpsocket *tcpsocket);
 int medusa_tcpsocket_get_sockport (struct medusa_tcpsocket *tcpsocket);
 int medusa_tcpsocket_get_sockname (struct medusa_tcpsocket *tcpsocket, struct sockaddr_storage *sockaddr);
@@ -1274,8 +1274,25 @@ __attribute__ ((visibility ("default"))) const char * medusa_timer_event_string
         return "MEDUSA_TIMER_EVENT_UNKNOWN";
 }
 
+static int timer_subject_onevent (struct medusa_subject *subject, unsigned int events, void *param)
+{
+        return medusa_timer_onevent_unlocked((struct medusa_timer *) subject, events, param);
+}
+
+static int timer_subject_destroy (struct medusa_subject *subject)
+{
+        return medusa_timer_onevent_unlocked((struct medusa_timer *) subject, MEDUSA_TIMER_EVENT_DESTROY, NULL);
+}
+
+static const struct medusa_subject_type g_subject_type = {
+        .rank    = MEDUSA_SUBJECT_RANK_BASE,
+        .onevent = timer_subject_onevent,
+        .destroy = timer_subject_destroy
+};
+
 __attribute__ ((constructor)) static void timer_constructor (void)
 {
+        medusa_monitor_register_subject_type(MEDUSA_SUBJECT_TYPE_TIMER, &g_subject_type);
 #if defined(MEDUSA_TIMER_USE_POOL) && (MEDUSA_TIMER_USE_POOL == 1)
         g_pool = medusa_pool_create("medusa-timer", sizeof(struct medusa_timer), 0, 0, MEDUSA_POOL_FLAG_DEFAULT | MEDUSA_POOL_FLAG_THREAD_SAFE, NULL, NULL, NULL);
 #endif
@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "timerheap.h"
+
+#if !defined(MAX)
+#define MAX(a, b)               (((a) > (b)) ? (a) : (b))
+#endif
+
+/* 4-ary heap, rooted at 0. deadlines are kept next to the entry pointers so
+ * that sifting only touches the heap array, and the position of each entry is
+ * written through a fixed offset into the entry instead of a callback */
+
+#define TIMERHEAP_ARITY                 4
+#define timerheap_child(i)              ((TIMERHEAP_ARITY * (i)) + 1)
+#define timerheap_parent(i)             (((i) - 1) / TIMERHEAP_ARITY)
+
+#define TIMERHEAP_POSITION_INVALID      ((unsigned int) -1)
+
+struct medusa_timerheap_entry {
+        uint64_t deadline;
+        void *entry;
+};
+
+struct medusa_timerheap {
+        struct medusa_timerheap_entry *entries;
+        unsigned int count;
+        unsigned int size;
+        unsigned int offset;
+};
+
+static inline unsigned int * timerheap_position (const struct medusa_timerheap *heap, void *entry)
+{
+        return (unsigned int *) (((char *) entry) + heap->offset);
+}
+
+static inline void timerheap_place (struct medusa_timerheap *heap, unsigned int i, const struct medusa_timerheap_entry *e)
+{
+        heap->entries[i] = *e;
+        *timerheap_position(heap, e->entry) = i;
+}
+
+static inline void timerheap_shift_up (struct medusa_timerheap *heap, unsigned int i)
+{
+        unsigned int p;
+        struct medusa_timerheap_entry e;
+        e = heap->entries[i];
+        while (i > 0) {
+                p = timerheap_parent(i);
+                if (heap->entries[p].deadline <= e.deadline) {
+                        break;
+                }
+                timerheap_place(heap, i, &heap->entries[p]);
+                i = p;
+        }
+        timerheap_place(heap, i, &e);
+}
+
+static inline void timerheap_shift_down (struct medusa_timerheap *heap, unsigned int i)
+{
+        unsigned int c;
+        unsigned int m;
+        unsigned int l;
+        struct medusa_timerheap_entry e;
+        e = heap->entries[i];
+        while (1) {
+                c = timerheap_child(i);
+                if (c >= heap->count) {
+                        break;
+                }
+                l = c + TIMERHEAP_ARITY;
+                if (l > heap->count) {
+                        l = heap->count;
+                }
+                for (m = c++; c < l; c++) {
+                        if (heap->entries[c].deadline < heap->entries[m].deadline) {
+                                m = c;
+                        }
+                }
+                if (e.deadline <= heap->entries[m].deadline) {
+                        break;
+                }
+                timerheap_place(heap, i, &heap->entries[m]);
+                i = m;
+        }
+        timerheap_place(heap, i, &e);
+}
+
+static inline void timerheap_remove (struct medusa_timerheap *heap, unsigned int i)
+{
+        uint64_t deadline;
+        *timerheap_position(heap, heap->entries[i].entry) = TIMERHEAP_POSITION_INVALID;
+        heap->count -= 1;
+        if (i == heap->count) {
+                return;
+        }
+        deadline = heap->entries[i].deadline;
+        heap->entries[i] = heap->entries[heap->count];
+        if (heap->entries[i].deadline < deadline) {
+                timerheap_shift_up(heap, i);
+        } else {
+                timerheap_shift_down(heap, i);
+        }
+}
+
+struct medusa_timerheap * medusa_timerheap_create (unsigned int size, unsigned int offset)
+{
+        struct medusa_timerheap *heap;
+        heap = malloc(sizeof(struct medusa_timerheap));
+        if (heap == NULL) {
+                goto bail;
+        }
+        memset(heap, 0, sizeof(struct medusa_timerheap));
+        heap->offset = offset;
+        if (size > 0) {
+                heap->entries = malloc(sizeof(struct medusa_timerheap_entry) * size);
+                if (heap->entries == NULL) {
+                        goto bail;
+                }
+                heap->size = size;
+        }
+        return heap;
+bail:   if (heap != NULL) {
+                medusa_timerheap_destroy(heap);
+        }
+        return NULL;
+}
+
+void medusa_timerheap_destroy (struct medusa_timerheap *heap)
+{
+        if (heap == NULL) {
+                return;
+        }
+        if (heap->entries != NULL) {
+                free(heap->entries);
+        }
+        free(heap);
+}
+
+unsigned int medusa_timerheap_count (const struct medusa_timerheap *heap)
+{
+        return heap->count;
+}
+
+int medusa_timerheap_add (struct medusa_timerheap *heap, void *entry, uint64_t deadline)
+{
+        unsigned int i;
+        if (heap->count + 1 > heap->size) {
+                unsigned int size;
+                struct medusa_timerheap_entry *tmp;
+                size = MAX(heap->size * 2, 64);
+                tmp = realloc(heap->entries, sizeof(struct medusa_timerheap_entry) * size);
+                if (tmp == NULL) {
+                        return -ENOMEM;
+                }
+                heap->entries = tmp;
+                heap->size = size;
+        }
+        i = heap->count++;
+        heap->entries[i].deadline = deadline;
+        heap->entries[i].entry    = entry;
+        timerheap_shift_up(heap, i);
+        return 0;
+}
+
+int medusa_timerheap_mod (struct medusa_timerheap *heap, void *entry, uint64_t deadline)
+{
+        unsigned int i;
+        uint64_t pdeadline;
+        i = *timerheap_position(heap, entry);
+        if (i >= heap->count || heap->entries[i].entry != entry) {
+                return -ENOENT;
+        }
+        pdeadline = heap->entries[i].deadline;
+        heap->entries[i].deadline = deadline;
+        if (deadline < pdeadline) {
+                timerheap_shift_up(heap, i);
+        } else if (deadline > pdeadline) {
+                timerheap_shift_down(heap, i);
+        }
+        return 0;
+}
+
+int medusa_timerheap_del (struct medusa_timerheap *heap, void *entry)
+{
+        unsigned int i;
+        i = *timerheap_position(heap, entry);
+        if (i >= heap->count || heap->entries[i].entry != entry) {
+                return -ENOENT;
+        }
+        timerheap_remove(heap, i);
+        return 0;
+}
+
+int medusa_timerheap_verify (const struct medusa_timerheap *heap)
+{
+        unsigned int i;
+        for (i = 0; i < heap->count; i++) {
+                if (*timerheap_position(heap, heap->entries[i].entry) != i) {
+                        return 0;
+                }
+                if (i > 0 && heap->entries[timerheap_parent(i)].deadline > heap->entries[i].deadline) {
+                        return 0;
+                }
+        }
+        return 1;
+}
+
+void * medusa_timerheap_peek (const struct medusa_timerheap *heap, uint64_t *deadline)
+{
+        if (heap->count == 0) {
+                return NULL;
+        }
+        if (deadline != NULL) {
+                *deadline = heap->entries[0].deadline;
+        }
+        return heap->entries[0].entry;
+}
+
+void * medusa_timerheap_pop (struct medusa_timerheap *heap, uint64_t *deadline)
+{
+        void *entry;
+        if (heap->count == 0) {
+                return NULL;
+        }
+        entry = heap->entries[0].entry;
+        if (deadline != NULL) {
+                *deadline = heap->entries[0].deadline;
+        }
+        timerheap_remove(heap, 0);
+        return entry;
+}
+
+void * medusa_timerheap_pop_expired (struct medusa_timerheap *heap, uint64_t now)
+{
+        void *entry;
+        if (heap->count == 0 ||
+            heap->entries[0].deadline > now) {
+                return NULL;
+        }
+        entry = heap->entries[0].entry;
+        timerheap_remove(heap, 0);
+        return entry;
+}
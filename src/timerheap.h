@@ -0,0 +1,20 @@
+#if !defined(MEDUSA_TIMERHEAP_H)
+#define MEDUSA_TIMERHEAP_H
+
+struct medusa_timerheap;
+
+struct medusa_timerheap * medusa_timerheap_create (unsigned int size, unsigned int offset);
+void medusa_timerheap_destroy (struct medusa_timerheap *heap);
+
+unsigned int medusa_timerheap_count (const struct medusa_timerheap *heap);
+
+int medusa_timerheap_add (struct medusa_timerheap *heap, void *entry, uint64_t deadline);
+int medusa_timerheap_mod (struct medusa_timerheap *heap, void *entry, uint64_t deadline);
+int medusa_timerheap_del (struct medusa_timerheap *heap, void *entry);
+int medusa_timerheap_verify (const struct medusa_timerheap *heap);
+
+void * medusa_timerheap_peek (const struct medusa_timerheap *heap, uint64_t *deadline);
+void * medusa_timerheap_pop (struct medusa_timerheap *heap, uint64_t *deadline);
+void * medusa_timerheap_pop_expired (struct medusa_timerheap *heap, uint64_t now);
+
+#endif
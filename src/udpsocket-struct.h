@@ -12,6 +12,7 @@ struct medusa_udpsocket {
         struct medusa_io *io;
         struct medusa_udpsocket_connect_options *coptions;
         struct medusa_dnsresolver_lookup *clookup;
+        struct medusa_resolver_lookup *rlookup;
         struct medusa_timer *ltimer;
         struct medusa_timer *rtimer;
         void *userdata;
@@ -33,6 +33,7 @@
 #include "timer-private.h"
 #include "dnsresolver.h"
 #include "dnsresolver-private.h"
+#include "resolver.h"
 #include "udpsocket.h"
 #include "udpsocket-private.h"
 #include "udpsocket-struct.h"
@@ -138,7 +139,7 @@ bail:   if (udpsocket_addrinfo_entry != NULL) {
         return NULL;
 }
 
-static struct udpsocket_addrinfo_entry * udpsocket_addrinfo_entry_create_from_addrinfo (struct addrinfo *entry)
+static struct udpsocket_addrinfo_entry * udpsocket_addrinfo_entry_create_from_addrinfo (const struct addrinfo *entry)
 {
         struct udpsocket_addrinfo_entry *udpsocket_addrinfo_entry;
 
@@ -229,10 +230,10 @@ bail:   if (udpsocket_addrinfo != NULL) {
         return NULL;
 }
 
-static struct udpsocket_addrinfo * udpsocket_addrinfo_create_from_addrinfo (struct addrinfo *addrinfo)
+static struct udpsocket_addrinfo * udpsocket_addrinfo_create_from_addrinfo (const struct addrinfo *addrinfo)
 {
         int rc;
-        struct addrinfo *entry;
+        const struct addrinfo *entry;
         struct udpsocket_addrinfo *udpsocket_addrinfo;
         struct udpsocket_addrinfo_entry *udpsocket_addrinfo_entry;
 
@@ -1724,6 +1725,49 @@ error:  {
         return 0;
 }
 
+static int udpsocket_resolver_onevent (struct medusa_resolver_lookup *lookup, int error, const struct addrinfo *result, void *context)
+{
+        int rc;
+        int line;
+        struct udpsocket_addrinfo *udpsocket_addrinfo;
+        struct medusa_udpsocket *udpsocket = context;
+
+        (void) lookup;
+
+        udpsocket->rlookup = NULL;
+        if (!medusa_subject_is_active(&udpsocket->subject) ||
+            udpsocket->state != MEDUSA_UDPSOCKET_STATE_RESOLVING) {
+                return 0;
+        }
+        if (error < 0) {
+                rc = error;
+                line = __LINE__;
+                goto bail;
+        }
+        udpsocket_addrinfo = udpsocket_addrinfo_create_from_addrinfo(result);
+        if (udpsocket_addrinfo == NULL) {
+                rc = -ENOMEM;
+                line = __LINE__;
+                goto bail;
+        }
+        rc = medusa_udpsocket_connect_resolved(udpsocket, udpsocket->coptions, udpsocket_addrinfo);
+        udpsocket_addrinfo_destroy(udpsocket_addrinfo);
+        if (rc < 0) {
+                line = __LINE__;
+                goto bail;
+        }
+        return 0;
+bail:   {
+                struct medusa_udpsocket_event_error medusa_udpsocket_event_error;
+                medusa_udpsocket_event_error.state = udpsocket->state;
+                medusa_udpsocket_event_error.error = -rc;
+                medusa_udpsocket_event_error.line  = line;
+                udpsocket_set_state(udpsocket, MEDUSA_UDPSOCKET_STATE_ERROR, medusa_udpsocket_event_error.error);
+                medusa_udpsocket_onevent_unlocked(udpsocket, MEDUSA_UDPSOCKET_EVENT_ERROR, &medusa_udpsocket_event_error);
+        }
+        return 0;
+}
+
 __attribute__ ((visibility ("default"))) struct medusa_udpsocket * medusa_udpsocket_connect_with_options_unlocked (const struct medusa_udpsocket_connect_options *options)
 {
         int rc;
@@ -1873,9 +1917,7 @@ ipv6:
                 }
         }
 
-        if (resolve == 0 ||
-            MEDUSA_IS_ERR_OR_NULL(options->dnsresolver) ||
-            medusa_dnsresolver_get_enabled_unlocked(options->dnsresolver) != 1) {
+        if (resolve == 0) {
                 struct addrinfo hints;
                 struct addrinfo *result;
 
@@ -1920,6 +1962,57 @@ ipv6:
                         goto bail;
                 }
                 freeaddrinfo(result);
+        } else if (MEDUSA_IS_ERR_OR_NULL(options->dnsresolver) ||
+                   medusa_dnsresolver_get_enabled_unlocked(options->dnsresolver) != 1) {
+                int family;
+                const struct addrinfo *cached;
+                struct medusa_resolver *resolver;
+
+                /* names go to the resolver workers, getaddrinfo may block for seconds */
+                family = (protocol == MEDUSA_UDPSOCKET_PROTOCOL_IPV4) ? AF_INET :
+                         (protocol == MEDUSA_UDPSOCKET_PROTOCOL_IPV6) ? AF_INET6 :
+                         AF_UNSPEC;
+                resolver = medusa_monitor_get_resolver_unlocked(udpsocket->subject.monitor);
+                if (MEDUSA_IS_ERR_OR_NULL(resolver)) {
+                        ret = MEDUSA_PTR_ERR(resolver);
+                        line = __LINE__;
+                        goto bail;
+                }
+                cached = NULL;
+                rc = medusa_resolver_cached_unlocked(resolver, address, family, SOCK_DGRAM, &cached);
+                if (rc < 0) {
+                        ret = rc;
+                        line = __LINE__;
+                        goto bail;
+                } else if (rc > 0) {
+                        udpsocket_addrinfo = udpsocket_addrinfo_create_from_addrinfo(cached);
+                        if (udpsocket_addrinfo == NULL) {
+                                ret = -ENOMEM;
+                                line = __LINE__;
+                                goto bail;
+                        }
+                        rc = medusa_udpsocket_connect_resolved(udpsocket, options, udpsocket_addrinfo);
+                        if (rc < 0) {
+                                ret = rc;
+                                line = __LINE__;
+                                goto bail;
+                        }
+                } else {
+                        udpsocket->coptions = medusa_udpsocket_connect_options_duplicate(options);
+                        if (MEDUSA_IS_ERR_OR_NULL(udpsocket->coptions)) {
+                                ret = MEDUSA_PTR_ERR(udpsocket->coptions);
+                                udpsocket->coptions = NULL;
+                                line = __LINE__;
+                                goto bail;
+                        }
+                        udpsocket->rlookup = medusa_resolver_lookup_unlocked(resolver, address, family, SOCK_DGRAM, udpsocket_resolver_onevent, udpsocket);
+                        if (MEDUSA_IS_ERR_OR_NULL(udpsocket->rlookup)) {
+                                ret = MEDUSA_PTR_ERR(udpsocket->rlookup);
+                                udpsocket->rlookup = NULL;
+                                line = __LINE__;
+                                goto bail;
+                        }
+                }
         } else {
                 struct medusa_dnsresolver_lookup_options dnsresolver_lookup_options;
                 udpsocket->coptions = medusa_udpsocket_connect_options_duplicate(options);
@@ -2934,6 +3027,10 @@ __attribute__ ((visibility ("default"))) int medusa_udpsocket_onevent_unlocked (
                         medusa_dnsresolver_lookup_destroy_unlocked(udpsocket->clookup);
                         udpsocket->clookup = NULL;
                 }
+                if (!MEDUSA_IS_ERR_OR_NULL(udpsocket->rlookup)) {
+                        medusa_resolver_lookup_cancel_unlocked(udpsocket->rlookup);
+                        udpsocket->rlookup = NULL;
+                }
                 if (!MEDUSA_IS_ERR_OR_NULL(udpsocket->coptions)) {
                         medusa_udpsocket_connect_options_destroy(udpsocket->coptions);
                 }
@@ -3314,8 +3411,25 @@ __attribute__ ((visibility ("default"))) const char * medusa_udpsocket_event_str
         return "MEDUSA_UDPSOCKET_EVENT_UNKNOWN";
 }
 
+static int udpsocket_subject_onevent (struct medusa_subject *subject, unsigned int events, void *param)
+{
+        return medusa_udpsocket_onevent_unlocked((struct medusa_udpsocket *) subject, events, param);
+}
+
+static int udpsocket_subject_destroy (struct medusa_subject *subject)
+{
+        return medusa_udpsocket_onevent_unlocked((struct medusa_udpsocket *) subject, MEDUSA_UDPSOCKET_EVENT_DESTROY, NULL);
+}
+
+static const struct medusa_subject_type g_subject_type = {
+        .rank    = MEDUSA_SUBJECT_RANK_UDPSOCKET,
+        .onevent = udpsocket_subject_onevent,
+        .destroy = udpsocket_subject_destroy
+};
+
 __attribute__ ((constructor)) static void udpsocket_constructor (void)
 {
+        medusa_monitor_register_subject_type(MEDUSA_SUBJECT_TYPE_UDPSOCKET, &g_subject_type);
 #if defined(MEDUSA_UDPSOCKET_USE_POOL) && (MEDUSA_UDPSOCKET_USE_POOL == 1)
         g_pool = medusa_pool_create("medusa-udpsocket", sizeof(struct medusa_udpsocket), 0, 0, MEDUSA_POOL_FLAG_DEFAULT | MEDUSA_POOL_FLAG_THREAD_SAFE, NULL, NULL, NULL);
 #endif
@@ -0,0 +1,300 @@
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+
+#if defined(__LINUX__) && defined(__GLIBC__)
+#include <execinfo.h>
+#define WATCHDOG_BACKTRACE_ENABLE       1
+#endif
+
+#define MEDUSA_DEBUG_NAME "watchdog"
+#include "debug.h"
+#include "clock.h"
+#include "watchdog.h"
+
+/* backtraces are taken on the loop thread from a SIGURG handler, the
+ * process wide handler is installed on first use and only if nobody else
+ * owns the signal. backtrace() is not on the async signal safe list, it
+ * is warmed up once outside of the handler and only ever interrupts the
+ * loop thread while it is inside a stalled callback; this is why it is
+ * opt-in. */
+#define WATCHDOG_BACKTRACE_SIGNAL       SIGURG
+#define WATCHDOG_BACKTRACE_FRAMES       32
+
+/* the loop thread publishes the dispatch it is in with a release store of
+ * started, the watchdog thread reads it back with acquire loads and checks
+ * started again to detect that the loop moved on while it was looking */
+
+struct medusa_watchdog {
+        uint64_t threshold;
+        int backtrace;
+        unsigned int depth;
+        unsigned int generation;
+        uint64_t started;
+        unsigned int subject_type;
+        void *callback;
+#if defined(WATCHDOG_BACKTRACE_ENABLE)
+        pthread_t loop;
+#endif
+        uint64_t noticed;
+        uint64_t captured;
+        int nframes;
+        void *frames[WATCHDOG_BACKTRACE_FRAMES];
+        int stop;
+        int running;
+        pthread_t thread;
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+};
+
+#if defined(WATCHDOG_BACKTRACE_ENABLE)
+static pthread_once_t g_once = PTHREAD_ONCE_INIT;
+static int g_installed;
+/* set by the loop thread for the length of a watched dispatch, a signal
+ * that arrives late finds it cleared or on a later generation */
+static __thread struct medusa_watchdog *g_current;
+#endif
+
+static inline uint64_t watchdog_clock (void)
+{
+        struct timespec timespec;
+        if (medusa_clock_monotonic(&timespec) != 0) {
+                return 0;
+        }
+        return ((uint64_t) timespec.tv_sec) * 1000000000ULL + (uint64_t) timespec.tv_nsec;
+}
+
+#if defined(WATCHDOG_BACKTRACE_ENABLE)
+
+static void watchdog_signal_handler (int signum, siginfo_t *info, void *ucontext)
+{
+        int error;
+        struct medusa_watchdog *watchdog;
+        (void) signum;
+        (void) ucontext;
+        if (info == NULL || info->si_code != SI_QUEUE) {
+                return;
+        }
+        watchdog = g_current;
+        if (watchdog == NULL) {
+                return;
+        }
+        if ((unsigned int) info->si_value.sival_int != watchdog->generation) {
+                return;
+        }
+        /* runs on the loop thread, so started can not change under us */
+        error = errno;
+        watchdog->nframes = backtrace(watchdog->frames, WATCHDOG_BACKTRACE_FRAMES);
+        __atomic_store_n(&watchdog->captured, watchdog->started, __ATOMIC_RELEASE);
+        errno = error;
+}
+
+static void watchdog_once (void)
+{
+        void *frame;
+        struct sigaction sa;
+        struct sigaction osa;
+        /* first backtrace() loads the unwinder, do it outside of the handler */
+        backtrace(&frame, 1);
+        if (sigaction(WATCHDOG_BACKTRACE_SIGNAL, NULL, &osa) != 0) {
+                return;
+        }
+        if ((osa.sa_flags & SA_SIGINFO) ||
+            (osa.sa_handler != SIG_DFL && osa.sa_handler != SIG_IGN)) {
+                medusa_errorf("signal: %d is in use, backtraces are disabled", WATCHDOG_BACKTRACE_SIGNAL);
+                return;
+        }
+        memset(&sa, 0, sizeof(struct sigaction));
+        sa.sa_sigaction = watchdog_signal_handler;
+        sa.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        if (sigaction(WATCHDOG_BACKTRACE_SIGNAL, &sa, NULL) != 0) {
+                return;
+        }
+        g_installed = 1;
+}
+
+#endif
+
+static void watchdog_check (struct medusa_watchdog *watchdog)
+{
+        uint64_t now;
+        uint64_t started;
+        void *callback;
+        unsigned int subject_type;
+        unsigned int generation;
+#if defined(WATCHDOG_BACKTRACE_ENABLE)
+        pthread_t loop;
+#endif
+        started = __atomic_load_n(&watchdog->started, __ATOMIC_ACQUIRE);
+        if (started == 0 || started == watchdog->noticed) {
+                return;
+        }
+        now = watchdog_clock();
+        if (now - started < watchdog->threshold) {
+                return;
+        }
+        subject_type = __atomic_load_n(&watchdog->subject_type, __ATOMIC_ACQUIRE);
+        callback     = __atomic_load_n(&watchdog->callback, __ATOMIC_ACQUIRE);
+        generation   = __atomic_load_n(&watchdog->generation, __ATOMIC_ACQUIRE);
+#if defined(WATCHDOG_BACKTRACE_ENABLE)
+        loop         = __atomic_load_n(&watchdog->loop, __ATOMIC_ACQUIRE);
+#endif
+        if (__atomic_load_n(&watchdog->started, __ATOMIC_ACQUIRE) != started) {
+                return;
+        }
+        watchdog->noticed = started;
+        medusa_errorf("subject type: %u, callback: %p is running for %.3f ms", subject_type, callback, (now - started) / 1e6);
+#if defined(WATCHDOG_BACKTRACE_ENABLE)
+        if (watchdog->backtrace && g_installed) {
+                union sigval value;
+                value.sival_int = (int) generation;
+                pthread_sigqueue(loop, WATCHDOG_BACKTRACE_SIGNAL, value);
+        }
+#endif
+}
+
+static void * watchdog_thread (void *arg)
+{
+        uint64_t period;
+        struct timespec timeout;
+        struct medusa_watchdog *watchdog = arg;
+
+        /* look twice per threshold, so a stall is noticed before it is
+         * one and a half thresholds long */
+        period = watchdog->threshold / 2;
+        if (period < 1000000ULL) {
+                period = 1000000ULL;
+        }
+
+        pthread_mutex_lock(&watchdog->mutex);
+        while (watchdog->stop == 0) {
+                medusa_clock_realtime(&timeout);
+                timeout.tv_sec  += period / 1000000000ULL;
+                timeout.tv_nsec += period % 1000000000ULL;
+                if (timeout.tv_nsec >= 1000000000L) {
+                        timeout.tv_sec  += 1;
+                        timeout.tv_nsec -= 1000000000L;
+                }
+                pthread_cond_timedwait(&watchdog->cond, &watchdog->mutex, &timeout);
+                if (watchdog->stop != 0) {
+                        break;
+                }
+                watchdog_check(watchdog);
+        }
+        pthread_mutex_unlock(&watchdog->mutex);
+        return NULL;
+}
+
+struct medusa_watchdog * medusa_watchdog_create (double threshold, int backtrace)
+{
+        int rc;
+        struct medusa_watchdog *watchdog;
+#if !defined(__WINDOWS__)
+        sigset_t set;
+        sigset_t oset;
+#endif
+        if (threshold <= 0) {
+                return NULL;
+        }
+        watchdog = malloc(sizeof(struct medusa_watchdog));
+        if (watchdog == NULL) {
+                return NULL;
+        }
+        memset(watchdog, 0, sizeof(struct medusa_watchdog));
+        watchdog->threshold = threshold * 1e9;
+        watchdog->backtrace = !!backtrace;
+        pthread_mutex_init(&watchdog->mutex, NULL);
+        pthread_cond_init(&watchdog->cond, NULL);
+#if defined(WATCHDOG_BACKTRACE_ENABLE)
+        if (watchdog->backtrace) {
+                pthread_once(&g_once, watchdog_once);
+        }
+#endif
+#if !defined(__WINDOWS__)
+        /* watchdog must not take signals meant for the monitor */
+        sigfillset(&set);
+        pthread_sigmask(SIG_SETMASK, &set, &oset);
+#endif
+        rc = pthread_create(&watchdog->thread, NULL, watchdog_thread, watchdog);
+#if !defined(__WINDOWS__)
+        pthread_sigmask(SIG_SETMASK, &oset, NULL);
+#endif
+        if (rc != 0) {
+                medusa_errorf("can not create watchdog thread");
+                pthread_cond_destroy(&watchdog->cond);
+                pthread_mutex_destroy(&watchdog->mutex);
+                free(watchdog);
+                return NULL;
+        }
+        watchdog->running = 1;
+        return watchdog;
+}
+
+void medusa_watchdog_destroy (struct medusa_watchdog *watchdog)
+{
+        if (watchdog == NULL) {
+                return;
+        }
+        if (watchdog->running) {
+                pthread_mutex_lock(&watchdog->mutex);
+                watchdog->stop = 1;
+                pthread_cond_signal(&watchdog->cond);
+                pthread_mutex_unlock(&watchdog->mutex);
+                pthread_join(watchdog->thread, NULL);
+        }
+        pthread_cond_destroy(&watchdog->cond);
+        pthread_mutex_destroy(&watchdog->mutex);
+        free(watchdog);
+}
+
+void medusa_watchdog_enter (struct medusa_watchdog *watchdog, unsigned int subject_type, void *callback)
+{
+        /* only the outermost dispatch is watched */
+        if (watchdog->depth++ != 0) {
+                return;
+        }
+        __atomic_store_n(&watchdog->subject_type, subject_type, __ATOMIC_RELAXED);
+        __atomic_store_n(&watchdog->callback, callback, __ATOMIC_RELAXED);
+        __atomic_store_n(&watchdog->generation, watchdog->generation + 1, __ATOMIC_RELAXED);
+#if defined(WATCHDOG_BACKTRACE_ENABLE)
+        __atomic_store_n(&watchdog->loop, pthread_self(), __ATOMIC_RELAXED);
+        g_current = watchdog;
+#endif
+        __atomic_store_n(&watchdog->started, watchdog_clock(), __ATOMIC_RELEASE);
+}
+
+int medusa_watchdog_leave (struct medusa_watchdog *watchdog, struct medusa_watchdog_stall *stall)
+{
+        uint64_t started;
+        uint64_t duration;
+        if (--watchdog->depth != 0) {
+                return 0;
+        }
+        started  = watchdog->started;
+        duration = watchdog_clock() - started;
+        __atomic_store_n(&watchdog->started, 0, __ATOMIC_RELEASE);
+#if defined(WATCHDOG_BACKTRACE_ENABLE)
+        g_current = NULL;
+#endif
+        if (duration < watchdog->threshold) {
+                return 0;
+        }
+        stall->subject_type    = watchdog->subject_type;
+        stall->callback        = watchdog->callback;
+        stall->duration        = duration;
+        stall->backtrace       = NULL;
+        stall->backtrace_count = 0;
+        if (__atomic_load_n(&watchdog->captured, __ATOMIC_ACQUIRE) == started) {
+                stall->backtrace       = watchdog->frames;
+                stall->backtrace_count = watchdog->nframes;
+        }
+        return 1;
+}
@@ -0,0 +1,20 @@
+#if !defined(MEDUSA_WATCHDOG_H)
+#define MEDUSA_WATCHDOG_H
+
+struct medusa_watchdog;
+
+struct medusa_watchdog_stall {
+        unsigned int subject_type;
+        void *callback;
+        unsigned long long duration;
+        void * const *backtrace;
+        int backtrace_count;
+};
+
+struct medusa_watchdog * medusa_watchdog_create (double threshold, int backtrace);
+void medusa_watchdog_destroy (struct medusa_watchdog *watchdog);
+
+void medusa_watchdog_enter (struct medusa_watchdog *watchdog, unsigned int subject_type, void *callback);
+int medusa_watchdog_leave (struct medusa_watchdog *watchdog, struct medusa_watchdog_stall *stall);
+
+#endif
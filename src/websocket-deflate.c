@@ -0,0 +1,529 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include <pthread.h>
+
+#if defined(MEDUSA_WEBSOCKET_DEFLATE_ENABLE) && (MEDUSA_WEBSOCKET_DEFLATE_ENABLE == 1)
+#include <zlib.h>
+#endif
+
+#include "error.h"
+#include "iovec.h"
+#include "buffer.h"
+#include "websocket-deflate.h"
+
+#define MEDUSA_WEBSOCKET_DEFLATE_POOL_MAX       64
+#define MEDUSA_WEBSOCKET_DEFLATE_CHUNK          4096
+
+#if defined(MEDUSA_WEBSOCKET_DEFLATE_ENABLE) && (MEDUSA_WEBSOCKET_DEFLATE_ENABLE == 1)
+
+static const uint8_t g_websocket_deflate_tail[4] = { 0x00, 0x00, 0xff, 0xff };
+
+struct medusa_websocket_deflate {
+        z_stream stream;
+        unsigned int type;
+        int window_bits;
+        int level;
+        struct medusa_websocket_deflate *next;
+};
+
+static pthread_mutex_t g_websocket_deflate_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct medusa_websocket_deflate *g_websocket_deflate_pool;
+static unsigned int g_websocket_deflate_pool_count;
+
+#endif
+
+static const char * websocket_deflate_skip_space (const char *p, const char *e)
+{
+        while (p < e && isspace((unsigned char) *p)) {
+                p++;
+        }
+        return p;
+}
+
+static const char * websocket_deflate_trim_space (const char *p, const char *e)
+{
+        while (e > p && isspace((unsigned char) e[-1])) {
+                e--;
+        }
+        return e;
+}
+
+static int websocket_deflate_token_equal (const char *p, const char *e, const char *token)
+{
+        size_t length;
+        length = strlen(token);
+        if ((size_t) (e - p) != length) {
+                return 0;
+        }
+        return (strncasecmp(p, token, length) == 0) ? 1 : 0;
+}
+
+static int websocket_deflate_window_bits (const char *p, const char *e)
+{
+        int value;
+        if (p < e && *p == '"') {
+                p++;
+                if (e > p && e[-1] == '"') {
+                        e--;
+                }
+        }
+        if (p == e || e - p > 2) {
+                return -EINVAL;
+        }
+        value = 0;
+        while (p < e) {
+                if (!isdigit((unsigned char) *p)) {
+                        return -EINVAL;
+                }
+                value = value * 10 + (*p - '0');
+                p++;
+        }
+        if (value < 8 || value > 15) {
+                return -EINVAL;
+        }
+        return value;
+}
+
+static int websocket_deflate_params_parse_element (struct medusa_websocket_deflate_params *params, const char *p, const char *e)
+{
+        int rc;
+        const char *n;
+        const char *ne;
+        const char *v;
+        const char *ve;
+        const char *s;
+
+        memset(params, 0, sizeof(struct medusa_websocket_deflate_params));
+
+        s = memchr(p, ';', e - p);
+        n  = websocket_deflate_skip_space(p, e);
+        ne = websocket_deflate_trim_space(n, (s != NULL) ? s : e);
+        if (!websocket_deflate_token_equal(n, ne, "permessage-deflate")) {
+                return 0;
+        }
+
+        while (s != NULL) {
+                p = s + 1;
+                s = memchr(p, ';', e - p);
+                n  = websocket_deflate_skip_space(p, (s != NULL) ? s : e);
+                ve = websocket_deflate_trim_space(n, (s != NULL) ? s : e);
+                v  = memchr(n, '=', ve - n);
+                if (v != NULL) {
+                        ne = websocket_deflate_trim_space(n, v);
+                        v  = websocket_deflate_skip_space(v + 1, ve);
+                } else {
+                        ne = ve;
+                }
+                if (websocket_deflate_token_equal(n, ne, "server_no_context_takeover")) {
+                        if (v != NULL || params->server_no_context_takeover) {
+                                return -EINVAL;
+                        }
+                        params->server_no_context_takeover = 1;
+                } else if (websocket_deflate_token_equal(n, ne, "client_no_context_takeover")) {
+                        if (v != NULL || params->client_no_context_takeover) {
+                                return -EINVAL;
+                        }
+                        params->client_no_context_takeover = 1;
+                } else if (websocket_deflate_token_equal(n, ne, "server_max_window_bits")) {
+                        if (v == NULL || params->server_max_window_bits != 0) {
+                                return -EINVAL;
+                        }
+                        rc = websocket_deflate_window_bits(v, ve);
+                        if (rc < 0) {
+                                return rc;
+                        }
+                        params->server_max_window_bits = rc;
+                } else if (websocket_deflate_token_equal(n, ne, "client_max_window_bits")) {
+                        if (params->client_max_window_bits != 0) {
+                                return -EINVAL;
+                        }
+                        if (v == NULL) {
+                                params->client_max_window_bits = -1;
+                        } else {
+                                rc = websocket_deflate_window_bits(v, ve);
+                                if (rc < 0) {
+                                        return rc;
+                                }
+                                params->client_max_window_bits = rc;
+                        }
+                } else {
+                        return -EINVAL;
+                }
+        }
+        return 1;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_websocket_deflate_supported (void)
+{
+#if defined(MEDUSA_WEBSOCKET_DEFLATE_ENABLE) && (MEDUSA_WEBSOCKET_DEFLATE_ENABLE == 1)
+        return 1;
+#else
+        return 0;
+#endif
+}
+
+__attribute__ ((visibility ("default"))) int medusa_websocket_deflate_params_parse (struct medusa_websocket_deflate_params *params, const char *extensions)
+{
+        int rc;
+        const char *p;
+        const char *e;
+        const char *c;
+        if (params == NULL) {
+                return -EINVAL;
+        }
+        if (extensions == NULL) {
+                return -EINVAL;
+        }
+        /* pick the first acceptable permessage-deflate offer, invalid offers
+         * are skipped as the peer may list alternatives */
+        p = extensions;
+        e = extensions + strlen(extensions);
+        while (p < e) {
+                c = memchr(p, ',', e - p);
+                if (c == NULL) {
+                        c = e;
+                }
+                rc = websocket_deflate_params_parse_element(params, p, c);
+                if (rc == 1) {
+                        return 1;
+                }
+                p = c + 1;
+        }
+        memset(params, 0, sizeof(struct medusa_websocket_deflate_params));
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_websocket_deflate_params_format (const struct medusa_websocket_deflate_params *params, char *string, int length)
+{
+        int rc;
+        char server_max_window_bits[48];
+        char client_max_window_bits[48];
+        if (params == NULL) {
+                return -EINVAL;
+        }
+        if (string == NULL || length <= 0) {
+                return -EINVAL;
+        }
+        server_max_window_bits[0] = '\0';
+        if (params->server_max_window_bits > 0) {
+                snprintf(server_max_window_bits, sizeof(server_max_window_bits), "; server_max_window_bits=%d", params->server_max_window_bits);
+        }
+        client_max_window_bits[0] = '\0';
+        if (params->client_max_window_bits > 0) {
+                snprintf(client_max_window_bits, sizeof(client_max_window_bits), "; client_max_window_bits=%d", params->client_max_window_bits);
+        } else if (params->client_max_window_bits < 0) {
+                snprintf(client_max_window_bits, sizeof(client_max_window_bits), "; client_max_window_bits");
+        }
+        rc = snprintf(string, length, "permessage-deflate%s%s%s%s",
+                (params->server_no_context_takeover) ? "; server_no_context_takeover" : "",
+                (params->client_no_context_takeover) ? "; client_no_context_takeover" : "",
+                server_max_window_bits,
+                client_max_window_bits);
+        if (rc < 0 || rc >= length) {
+                return -ENOSPC;
+        }
+        return rc;
+}
+
+#if defined(MEDUSA_WEBSOCKET_DEFLATE_ENABLE) && (MEDUSA_WEBSOCKET_DEFLATE_ENABLE == 1)
+
+static void websocket_deflate_destroy (struct medusa_websocket_deflate *deflate)
+{
+        if (deflate->type == MEDUSA_WEBSOCKET_DEFLATE_TYPE_COMPRESS) {
+                deflateEnd(&deflate->stream);
+        } else {
+                inflateEnd(&deflate->stream);
+        }
+        free(deflate);
+}
+
+__attribute__ ((visibility ("default"))) struct medusa_websocket_deflate * medusa_websocket_deflate_acquire (unsigned int type, int window_bits, int level)
+{
+        int rc;
+        struct medusa_websocket_deflate *deflate;
+        struct medusa_websocket_deflate **pdeflate;
+        if (type != MEDUSA_WEBSOCKET_DEFLATE_TYPE_COMPRESS &&
+            type != MEDUSA_WEBSOCKET_DEFLATE_TYPE_DECOMPRESS) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        if (window_bits == 0) {
+                window_bits = MEDUSA_WEBSOCKET_DEFLATE_WINDOW_BITS_MAX;
+        }
+        if (type == MEDUSA_WEBSOCKET_DEFLATE_TYPE_DECOMPRESS && window_bits == 8) {
+                /* inflating with a larger window is always safe */
+                window_bits = MEDUSA_WEBSOCKET_DEFLATE_WINDOW_BITS_MIN;
+        }
+        if (window_bits < MEDUSA_WEBSOCKET_DEFLATE_WINDOW_BITS_MIN ||
+            window_bits > MEDUSA_WEBSOCKET_DEFLATE_WINDOW_BITS_MAX) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        if (type == MEDUSA_WEBSOCKET_DEFLATE_TYPE_DECOMPRESS) {
+                level = 0;
+        } else if (level < 0 || level > 9) {
+                level = Z_DEFAULT_COMPRESSION;
+        }
+
+        pthread_mutex_lock(&g_websocket_deflate_mutex);
+        for (pdeflate = &g_websocket_deflate_pool; *pdeflate != NULL; pdeflate = &(*pdeflate)->next) {
+                if ((*pdeflate)->type == type &&
+                    (*pdeflate)->window_bits == window_bits &&
+                    (*pdeflate)->level == level) {
+                        break;
+                }
+        }
+        deflate = *pdeflate;
+        if (deflate != NULL) {
+                *pdeflate = deflate->next;
+                g_websocket_deflate_pool_count -= 1;
+        }
+        pthread_mutex_unlock(&g_websocket_deflate_mutex);
+        if (deflate != NULL) {
+                deflate->next = NULL;
+                return deflate;
+        }
+
+        deflate = malloc(sizeof(struct medusa_websocket_deflate));
+        if (deflate == NULL) {
+                return MEDUSA_ERR_PTR(-ENOMEM);
+        }
+        memset(deflate, 0, sizeof(struct medusa_websocket_deflate));
+        deflate->type        = type;
+        deflate->window_bits = window_bits;
+        deflate->level       = level;
+        if (type == MEDUSA_WEBSOCKET_DEFLATE_TYPE_COMPRESS) {
+                rc = deflateInit2(&deflate->stream, level, Z_DEFLATED, -window_bits, 8, Z_DEFAULT_STRATEGY);
+        } else {
+                rc = inflateInit2(&deflate->stream, -window_bits);
+        }
+        if (rc != Z_OK) {
+                free(deflate);
+                return MEDUSA_ERR_PTR((rc == Z_MEM_ERROR) ? -ENOMEM : -EIO);
+        }
+        return deflate;
+}
+
+__attribute__ ((visibility ("default"))) void medusa_websocket_deflate_release (struct medusa_websocket_deflate *deflate)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(deflate)) {
+                return;
+        }
+        if (medusa_websocket_deflate_reset(deflate) < 0) {
+                websocket_deflate_destroy(deflate);
+                return;
+        }
+        pthread_mutex_lock(&g_websocket_deflate_mutex);
+        if (g_websocket_deflate_pool_count < MEDUSA_WEBSOCKET_DEFLATE_POOL_MAX) {
+                deflate->next = g_websocket_deflate_pool;
+                g_websocket_deflate_pool = deflate;
+                g_websocket_deflate_pool_count += 1;
+                deflate = NULL;
+        }
+        pthread_mutex_unlock(&g_websocket_deflate_mutex);
+        if (deflate != NULL) {
+                websocket_deflate_destroy(deflate);
+        }
+}
+
+__attribute__ ((visibility ("default"))) int medusa_websocket_deflate_reset (struct medusa_websocket_deflate *deflate)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(deflate)) {
+                return -EINVAL;
+        }
+        if (deflate->type == MEDUSA_WEBSOCKET_DEFLATE_TYPE_COMPRESS) {
+                rc = deflateReset(&deflate->stream);
+        } else {
+                rc = inflateReset(&deflate->stream);
+        }
+        if (rc != Z_OK) {
+                return -EIO;
+        }
+        return 0;
+}
+
+static int64_t websocket_deflate_run (struct medusa_websocket_deflate *websocket_deflate, const void *data, int64_t length, struct medusa_buffer *output)
+{
+        int rc;
+        int64_t produced;
+        int64_t niovecs;
+        struct medusa_iovec iovec;
+
+        websocket_deflate->stream.next_in  = (Bytef *) data;
+        websocket_deflate->stream.avail_in = length;
+        produced = 0;
+        while (1) {
+                niovecs = medusa_buffer_reservev(output, (length / 2 > MEDUSA_WEBSOCKET_DEFLATE_CHUNK) ? (length / 2) : MEDUSA_WEBSOCKET_DEFLATE_CHUNK, &iovec, 1);
+                if (niovecs < 0) {
+                        return niovecs;
+                }
+                if (niovecs != 1) {
+                        return -EIO;
+                }
+                websocket_deflate->stream.next_out  = iovec.iov_base;
+                websocket_deflate->stream.avail_out = iovec.iov_len;
+                if (websocket_deflate->type == MEDUSA_WEBSOCKET_DEFLATE_TYPE_COMPRESS) {
+                        rc = deflate(&websocket_deflate->stream, Z_SYNC_FLUSH);
+                } else {
+                        rc = inflate(&websocket_deflate->stream, Z_SYNC_FLUSH);
+                }
+                if (rc != Z_OK && rc != Z_BUF_ERROR && rc != Z_STREAM_END) {
+                        return -EIO;
+                }
+                iovec.iov_len -= websocket_deflate->stream.avail_out;
+                niovecs = medusa_buffer_commitv(output, &iovec, 1);
+                if (niovecs < 0) {
+                        return niovecs;
+                }
+                produced += iovec.iov_len;
+                if (websocket_deflate->stream.avail_out != 0 || rc == Z_STREAM_END) {
+                        break;
+                }
+        }
+        if (websocket_deflate->stream.avail_in != 0) {
+                return -EIO;
+        }
+        return produced;
+}
+
+__attribute__ ((visibility ("default"))) int64_t medusa_websocket_deflate_compress (struct medusa_websocket_deflate *deflate, const void *data, int64_t length, struct medusa_buffer *output)
+{
+        int rc;
+        int64_t produced;
+        int64_t olength;
+        uint8_t tail[4];
+        if (MEDUSA_IS_ERR_OR_NULL(deflate)) {
+                return -EINVAL;
+        }
+        if (deflate->type != MEDUSA_WEBSOCKET_DEFLATE_TYPE_COMPRESS) {
+                return -EINVAL;
+        }
+        if (data == NULL && length > 0) {
+                return -EINVAL;
+        }
+        if (length < 0) {
+                return -EINVAL;
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(output)) {
+                return -EINVAL;
+        }
+        produced = websocket_deflate_run(deflate, data, length, output);
+        if (produced < 0) {
+                return produced;
+        }
+        /* rfc 7692 7.2.1, remove the empty block appended by the sync flush */
+        olength = medusa_buffer_get_length(output);
+        if (produced < 4 || olength < 4) {
+                return -EIO;
+        }
+        rc = medusa_buffer_peek_data(output, olength - 4, tail, 4);
+        if (rc < 0) {
+                return rc;
+        }
+        if (memcmp(tail, g_websocket_deflate_tail, 4) != 0) {
+                return -EIO;
+        }
+        rc = medusa_buffer_choke(output, olength - 4, 4);
+        if (rc < 0) {
+                return rc;
+        }
+        return produced - 4;
+}
+
+__attribute__ ((visibility ("default"))) int64_t medusa_websocket_deflate_decompress (struct medusa_websocket_deflate *deflate, const void *data, int64_t length, int final, struct medusa_buffer *output)
+{
+        int64_t rc;
+        int64_t produced;
+        if (MEDUSA_IS_ERR_OR_NULL(deflate)) {
+                return -EINVAL;
+        }
+        if (deflate->type != MEDUSA_WEBSOCKET_DEFLATE_TYPE_DECOMPRESS) {
+                return -EINVAL;
+        }
+        if (data == NULL && length > 0) {
+                return -EINVAL;
+        }
+        if (length < 0) {
+                return -EINVAL;
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(output)) {
+                return -EINVAL;
+        }
+        produced = 0;
+        if (length > 0) {
+                rc = websocket_deflate_run(deflate, data, length, output);
+                if (rc < 0) {
+                        return rc;
+                }
+                produced += rc;
+        }
+        if (final) {
+                rc = websocket_deflate_run(deflate, g_websocket_deflate_tail, sizeof(g_websocket_deflate_tail), output);
+                if (rc < 0) {
+                        return rc;
+                }
+                produced += rc;
+        }
+        return produced;
+}
+
+__attribute__ ((destructor)) static void websocket_deflate_destructor (void)
+{
+        struct medusa_websocket_deflate *deflate;
+        pthread_mutex_lock(&g_websocket_deflate_mutex);
+        while ((deflate = g_websocket_deflate_pool) != NULL) {
+                g_websocket_deflate_pool = deflate->next;
+                websocket_deflate_destroy(deflate);
+        }
+        g_websocket_deflate_pool_count = 0;
+        pthread_mutex_unlock(&g_websocket_deflate_mutex);
+}
+
+#else
+
+__attribute__ ((visibility ("default"))) struct medusa_websocket_deflate * medusa_websocket_deflate_acquire (unsigned int type, int window_bits, int level)
+{
+        (void) type;
+        (void) window_bits;
+        (void) level;
+        return MEDUSA_ERR_PTR(-ENOTSUP);
+}
+
+__attribute__ ((visibility ("default"))) void medusa_websocket_deflate_release (struct medusa_websocket_deflate *deflate)
+{
+        (void) deflate;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_websocket_deflate_reset (struct medusa_websocket_deflate *deflate)
+{
+        (void) deflate;
+        return -ENOTSUP;
+}
+
+__attribute__ ((visibility ("default"))) int64_t medusa_websocket_deflate_compress (struct medusa_websocket_deflate *deflate, const void *data, int64_t length, struct medusa_buffer *output)
+{
+        (void) deflate;
+        (void) data;
+        (void) length;
+        (void) output;
+        return -ENOTSUP;
+}
+
+__attribute__ ((visibility ("default"))) int64_t medusa_websocket_deflate_decompress (struct medusa_websocket_deflate *deflate, const void *data, int64_t length, int final, struct medusa_buffer *output)
+{
+        (void) deflate;
+        (void) data;
+        (void) length;
+        (void) final;
+        (void) output;
+        return -ENOTSUP;
+}
+
+#endif
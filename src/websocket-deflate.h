@@ -0,0 +1,49 @@
+#if !defined(MEDUSA_WEBSOCKET_DEFLATE_H)
+#define MEDUSA_WEBSOCKET_DEFLATE_H
+
+struct medusa_buffer;
+struct medusa_websocket_deflate;
+
+enum {
+        MEDUSA_WEBSOCKET_DEFLATE_TYPE_COMPRESS          = 0,
+        MEDUSA_WEBSOCKET_DEFLATE_TYPE_DECOMPRESS        = 1
+#define MEDUSA_WEBSOCKET_DEFLATE_TYPE_COMPRESS          MEDUSA_WEBSOCKET_DEFLATE_TYPE_COMPRESS
+#define MEDUSA_WEBSOCKET_DEFLATE_TYPE_DECOMPRESS        MEDUSA_WEBSOCKET_DEFLATE_TYPE_DECOMPRESS
+};
+
+enum {
+        MEDUSA_WEBSOCKET_DEFLATE_WINDOW_BITS_MIN        = 9,
+        MEDUSA_WEBSOCKET_DEFLATE_WINDOW_BITS_MAX        = 15
+#define MEDUSA_WEBSOCKET_DEFLATE_WINDOW_BITS_MIN        MEDUSA_WEBSOCKET_DEFLATE_WINDOW_BITS_MIN
+#define MEDUSA_WEBSOCKET_DEFLATE_WINDOW_BITS_MAX        MEDUSA_WEBSOCKET_DEFLATE_WINDOW_BITS_MAX
+};
+
+struct medusa_websocket_deflate_params {
+        int server_no_context_takeover;
+        int client_no_context_takeover;
+        int server_max_window_bits;
+        int client_max_window_bits;
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+int medusa_websocket_deflate_supported (void);
+
+int medusa_websocket_deflate_params_parse (struct medusa_websocket_deflate_params *params, const char *extensions);
+int medusa_websocket_deflate_params_format (const struct medusa_websocket_deflate_params *params, char *string, int length);
+
+struct medusa_websocket_deflate * medusa_websocket_deflate_acquire (unsigned int type, int window_bits, int level);
+void medusa_websocket_deflate_release (struct medusa_websocket_deflate *deflate);
+int medusa_websocket_deflate_reset (struct medusa_websocket_deflate *deflate);
+
+int64_t medusa_websocket_deflate_compress (struct medusa_websocket_deflate *deflate, const void *data, int64_t length, struct medusa_buffer *output);
+int64_t medusa_websocket_deflate_decompress (struct medusa_websocket_deflate *deflate, const void *data, int64_t length, int final, struct medusa_buffer *output);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,244 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <errno.h>
+
+#include "error.h"
+#include "iovec.h"
+#include "buffer.h"
+#include "websocket-mask.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define MEDUSA_WEBSOCKET_MASK_X86       1
+#include <immintrin.h>
+#endif
+
+#define MEDUSA_WEBSOCKET_MASK_IOVECS    8
+
+typedef void (*websocket_mask_fn) (uint8_t *data, int64_t length, const uint8_t *key);
+
+static void websocket_mask_byte (uint8_t *data, int64_t length, const uint8_t *key)
+{
+        int64_t i;
+        for (i = 0; i < length; i++) {
+                data[i] ^= key[i & 3];
+        }
+}
+
+static void websocket_mask_word (uint8_t *data, int64_t length, const uint8_t *key)
+{
+        uint64_t v;
+        uint64_t k;
+        uint8_t k8[8];
+        memcpy(&k8[0], key, 4);
+        memcpy(&k8[4], key, 4);
+        memcpy(&k, k8, sizeof(k));
+        while (length >= 8) {
+                memcpy(&v, data, sizeof(v));
+                v ^= k;
+                memcpy(data, &v, sizeof(v));
+                data   += 8;
+                length -= 8;
+        }
+        websocket_mask_byte(data, length, key);
+}
+
+#if defined(MEDUSA_WEBSOCKET_MASK_X86)
+
+__attribute__ ((target ("sse2"))) static void websocket_mask_sse2 (uint8_t *data, int64_t length, const uint8_t *key)
+{
+        int32_t k32;
+        __m128i k;
+        __m128i v;
+        memcpy(&k32, key, sizeof(k32));
+        k = _mm_set1_epi32(k32);
+        while (length >= 16) {
+                v = _mm_loadu_si128((const __m128i *) data);
+                v = _mm_xor_si128(v, k);
+                _mm_storeu_si128((__m128i *) data, v);
+                data   += 16;
+                length -= 16;
+        }
+        websocket_mask_word(data, length, key);
+}
+
+__attribute__ ((target ("avx2"))) static void websocket_mask_avx2 (uint8_t *data, int64_t length, const uint8_t *key)
+{
+        int32_t k32;
+        __m256i k;
+        __m256i v0;
+        __m256i v1;
+        memcpy(&k32, key, sizeof(k32));
+        k = _mm256_set1_epi32(k32);
+        while (length >= 64) {
+                v0 = _mm256_loadu_si256((const __m256i *) (data + 0));
+                v1 = _mm256_loadu_si256((const __m256i *) (data + 32));
+                v0 = _mm256_xor_si256(v0, k);
+                v1 = _mm256_xor_si256(v1, k);
+                _mm256_storeu_si256((__m256i *) (data + 0), v0);
+                _mm256_storeu_si256((__m256i *) (data + 32), v1);
+                data   += 64;
+                length -= 64;
+        }
+        while (length >= 32) {
+                v0 = _mm256_loadu_si256((const __m256i *) data);
+                v0 = _mm256_xor_si256(v0, k);
+                _mm256_storeu_si256((__m256i *) data, v0);
+                data   += 32;
+                length -= 32;
+        }
+        websocket_mask_word(data, length, key);
+}
+
+#endif
+
+static websocket_mask_fn g_websocket_mask = websocket_mask_word;
+
+static websocket_mask_fn websocket_mask_get (unsigned int type)
+{
+        if (type == MEDUSA_WEBSOCKET_MASK_TYPE_DEFAULT) {
+                return g_websocket_mask;
+        }
+        if (type == MEDUSA_WEBSOCKET_MASK_TYPE_BYTE) {
+                return websocket_mask_byte;
+        }
+        if (type == MEDUSA_WEBSOCKET_MASK_TYPE_WORD) {
+                return websocket_mask_word;
+        }
+#if defined(MEDUSA_WEBSOCKET_MASK_X86)
+        if (type == MEDUSA_WEBSOCKET_MASK_TYPE_SSE2) {
+                if (__builtin_cpu_supports("sse2")) {
+                        return websocket_mask_sse2;
+                }
+        }
+        if (type == MEDUSA_WEBSOCKET_MASK_TYPE_AVX2) {
+                if (__builtin_cpu_supports("avx2")) {
+                        return websocket_mask_avx2;
+                }
+        }
+#endif
+        return NULL;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_websocket_mask_type_supported (unsigned int type)
+{
+        return (websocket_mask_get(type) != NULL) ? 1 : 0;
+}
+
+__attribute__ ((visibility ("default"))) const char * medusa_websocket_mask_type_string (unsigned int type)
+{
+        if (type == MEDUSA_WEBSOCKET_MASK_TYPE_DEFAULT) {
+                return "MEDUSA_WEBSOCKET_MASK_TYPE_DEFAULT";
+        }
+        if (type == MEDUSA_WEBSOCKET_MASK_TYPE_BYTE) {
+                return "MEDUSA_WEBSOCKET_MASK_TYPE_BYTE";
+        }
+        if (type == MEDUSA_WEBSOCKET_MASK_TYPE_WORD) {
+                return "MEDUSA_WEBSOCKET_MASK_TYPE_WORD";
+        }
+        if (type == MEDUSA_WEBSOCKET_MASK_TYPE_SSE2) {
+                return "MEDUSA_WEBSOCKET_MASK_TYPE_SSE2";
+        }
+        if (type == MEDUSA_WEBSOCKET_MASK_TYPE_AVX2) {
+                return "MEDUSA_WEBSOCKET_MASK_TYPE_AVX2";
+        }
+        return "MEDUSA_WEBSOCKET_MASK_TYPE_UNKNOWN";
+}
+
+__attribute__ ((visibility ("default"))) unsigned int medusa_websocket_mask_with_type (unsigned int type, void *data, int64_t length, const uint8_t *mask, unsigned int offset)
+{
+        uint8_t key[4];
+        websocket_mask_fn fn;
+        if (data == NULL || mask == NULL || length <= 0) {
+                return offset & 3;
+        }
+        fn = websocket_mask_get(type);
+        if (fn == NULL) {
+                fn = websocket_mask_word;
+        }
+        /* rotate the mask so that key[0] applies to data[0] */
+        key[0] = mask[(offset + 0) & 3];
+        key[1] = mask[(offset + 1) & 3];
+        key[2] = mask[(offset + 2) & 3];
+        key[3] = mask[(offset + 3) & 3];
+        fn(data, length, key);
+        return (offset + length) & 3;
+}
+
+__attribute__ ((visibility ("default"))) unsigned int medusa_websocket_mask (void *data, int64_t length, const uint8_t *mask, unsigned int offset)
+{
+        return medusa_websocket_mask_with_type(MEDUSA_WEBSOCKET_MASK_TYPE_DEFAULT, data, length, mask, offset);
+}
+
+__attribute__ ((visibility ("default"))) int medusa_websocket_mask_buffer (struct medusa_buffer *buffer, int64_t offset, int64_t length, const uint8_t *mask)
+{
+        int ret;
+        int64_t i;
+        int64_t niovecs;
+        int64_t masked;
+        unsigned int phase;
+        struct medusa_iovec *iovecs;
+        struct medusa_iovec _iovecs[MEDUSA_WEBSOCKET_MASK_IOVECS];
+        if (MEDUSA_IS_ERR_OR_NULL(buffer)) {
+                return -EINVAL;
+        }
+        if (mask == NULL) {
+                return -EINVAL;
+        }
+        if (length < 0) {
+                return -EINVAL;
+        }
+        if (length == 0) {
+                return 0;
+        }
+        niovecs = medusa_buffer_peekv(buffer, offset, length, NULL, 0);
+        if (niovecs < 0) {
+                return niovecs;
+        }
+        if (niovecs > (int64_t) (sizeof(_iovecs) / sizeof(_iovecs[0]))) {
+                iovecs = malloc(sizeof(struct medusa_iovec) * niovecs);
+                if (iovecs == NULL) {
+                        return -ENOMEM;
+                }
+        } else {
+                iovecs = _iovecs;
+        }
+        niovecs = medusa_buffer_peekv(buffer, offset, length, iovecs, niovecs);
+        if (niovecs < 0) {
+                ret = niovecs;
+                goto out;
+        }
+        ret    = 0;
+        phase  = 0;
+        masked = 0;
+        for (i = 0; i < niovecs && masked < length; i++) {
+                int64_t l;
+                l = length - masked;
+                if (l > (int64_t) iovecs[i].iov_len) {
+                        l = iovecs[i].iov_len;
+                }
+                phase = medusa_websocket_mask(iovecs[i].iov_base, l, mask, phase);
+                masked += l;
+        }
+        if (masked < length) {
+                ret = -EIO;
+        }
+out:    if (iovecs != _iovecs) {
+                free(iovecs);
+        }
+        return ret;
+}
+
+__attribute__ ((constructor)) static void websocket_mask_constructor (void)
+{
+#if defined(MEDUSA_WEBSOCKET_MASK_X86)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+                g_websocket_mask = websocket_mask_avx2;
+        } else if (__builtin_cpu_supports("sse2")) {
+                g_websocket_mask = websocket_mask_sse2;
+        }
+#endif
+}
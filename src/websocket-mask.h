@@ -0,0 +1,37 @@
+
+#if !defined(MEDUSA_WEBSOCKET_MASK_H)
+#define MEDUSA_WEBSOCKET_MASK_H
+
+struct medusa_buffer;
+
+enum {
+        MEDUSA_WEBSOCKET_MASK_TYPE_DEFAULT      = 0,
+        MEDUSA_WEBSOCKET_MASK_TYPE_BYTE         = 1,
+        MEDUSA_WEBSOCKET_MASK_TYPE_WORD         = 2,
+        MEDUSA_WEBSOCKET_MASK_TYPE_SSE2         = 3,
+        MEDUSA_WEBSOCKET_MASK_TYPE_AVX2         = 4
+#define MEDUSA_WEBSOCKET_MASK_TYPE_DEFAULT      MEDUSA_WEBSOCKET_MASK_TYPE_DEFAULT
+#define MEDUSA_WEBSOCKET_MASK_TYPE_BYTE         MEDUSA_WEBSOCKET_MASK_TYPE_BYTE
+#define MEDUSA_WEBSOCKET_MASK_TYPE_WORD         MEDUSA_WEBSOCKET_MASK_TYPE_WORD
+#define MEDUSA_WEBSOCKET_MASK_TYPE_SSE2         MEDUSA_WEBSOCKET_MASK_TYPE_SSE2
+#define MEDUSA_WEBSOCKET_MASK_TYPE_AVX2         MEDUSA_WEBSOCKET_MASK_TYPE_AVX2
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+int medusa_websocket_mask_type_supported (unsigned int type);
+const char * medusa_websocket_mask_type_string (unsigned int type);
+
+unsigned int medusa_websocket_mask_with_type (unsigned int type, void *data, int64_t length, const uint8_t *mask, unsigned int offset);
+unsigned int medusa_websocket_mask (void *data, int64_t length, const uint8_t *mask, unsigned int offset);
+
+int medusa_websocket_mask_buffer (struct medusa_buffer *buffer, int64_t offset, int64_t length, const uint8_t *mask);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
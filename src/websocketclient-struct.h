@@ -19,11 +19,39 @@ struct medusa_websocketclient {
         char *sec_websocket_protocol;
         char *sec_websocket_key;
         char *sec_websocket_accept;
+        char *sec_websocket_extensions;
         char *host;
         unsigned int frame_state;
         unsigned int frame_mask_offset;
         unsigned int frame_payload_offset;
-        unsigned int frame_payload_length;
+        int64_t frame_payload_length;
+        int64_t frame_payload_consumed;
+        uint8_t frame_opcode;
+        uint8_t frame_mask[4];
+        unsigned int message_mode;
+        int64_t max_message_size;
+        struct {
+                unsigned int type;
+                int64_t length;
+                struct medusa_buffer *buffer;
+        } message;
+        struct {
+                int enabled;
+                int offered;
+                int level;
+                int window_bits;
+                int no_context_takeover;
+                int64_t threshold;
+                int message;
+                int compress_window_bits;
+                int compress_no_context_takeover;
+                int decompress_window_bits;
+                int decompress_no_context_takeover;
+                struct medusa_websocket_deflate *compress;
+                struct medusa_websocket_deflate *decompress;
+                struct medusa_buffer *rbuffer;
+                struct medusa_buffer *wbuffer;
+        } deflate;
 };
 
 #endif
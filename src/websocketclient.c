@@ -15,6 +15,8 @@
 #include "pool.h"
 #include "base64.h"
 #include "sha1.h"
+#include "websocket-mask.h"
+#include "websocket-deflate.h"
 #include "queue.h"
 #include "subject-struct.h"
 #include "iovec.h"
@@ -72,11 +74,13 @@ enum {
         MEDUSA_WEBSOCKETCLIENT_FRAME_STATE_START         = 0,
         MEDUSA_WEBSOCKETCLIENT_FRAME_STATE_HEADER        = 1,
         MEDUSA_WEBSOCKETCLIENT_FRAME_STATE_PAYLOAD       = 2,
-        MEDUSA_WEBSOCKETCLIENT_FRAME_STATE_FINISH        = 3
+        MEDUSA_WEBSOCKETCLIENT_FRAME_STATE_FINISH        = 3,
+        MEDUSA_WEBSOCKETCLIENT_FRAME_STATE_STREAM        = 4
 #define MEDUSA_WEBSOCKETCLIENT_FRAME_STATE_START         MEDUSA_WEBSOCKETCLIENT_FRAME_STATE_START
 #define MEDUSA_WEBSOCKETCLIENT_FRAME_STATE_HEADER        MEDUSA_WEBSOCKETCLIENT_FRAME_STATE_HEADER
 #define MEDUSA_WEBSOCKETCLIENT_FRAME_STATE_PAYLOAD       MEDUSA_WEBSOCKETCLIENT_FRAME_STATE_PAYLOAD
 #define MEDUSA_WEBSOCKETCLIENT_FRAME_STATE_FINISH        MEDUSA_WEBSOCKETCLIENT_FRAME_STATE_FINISH
+#define MEDUSA_WEBSOCKETCLIENT_FRAME_STATE_STREAM        MEDUSA_WEBSOCKETCLIENT_FRAME_STATE_STREAM
 };
 
 static inline void websocketclient_set_flag (struct medusa_websocketclient *websocketclient, unsigned int flag)
@@ -130,6 +134,237 @@ static inline int websocketclient_set_state (struct medusa_websocketclient *webs
         return 0;
 }
 
+static int websocketclient_add_extensions (struct medusa_websocketclient *websocketclient, const char *value)
+{
+        char *tmp;
+        if (websocketclient->sec_websocket_extensions == NULL) {
+                websocketclient->sec_websocket_extensions = strdup(value);
+                if (websocketclient->sec_websocket_extensions == NULL) {
+                        return -ENOMEM;
+                }
+                return 0;
+        }
+        tmp = realloc(websocketclient->sec_websocket_extensions, strlen(websocketclient->sec_websocket_extensions) + strlen(", ") + strlen(value) + 1);
+        if (tmp == NULL) {
+                return -ENOMEM;
+        }
+        websocketclient->sec_websocket_extensions = tmp;
+        strcat(websocketclient->sec_websocket_extensions, ", ");
+        strcat(websocketclient->sec_websocket_extensions, value);
+        return 0;
+}
+
+static int websocketclient_deflate_offer (struct medusa_websocketclient *websocketclient, char *extensions, int length)
+{
+        int rc;
+        struct medusa_websocket_deflate_params offer;
+        extensions[0] = '\0';
+        if (!websocketclient->deflate.offered) {
+                return 0;
+        }
+        memset(&offer, 0, sizeof(struct medusa_websocket_deflate_params));
+        offer.client_no_context_takeover = websocketclient->deflate.no_context_takeover;
+        offer.client_max_window_bits     = (websocketclient->deflate.window_bits < MEDUSA_WEBSOCKET_DEFLATE_WINDOW_BITS_MAX) ? websocketclient->deflate.window_bits : -1;
+        rc = medusa_websocket_deflate_params_format(&offer, extensions, length);
+        if (rc < 0) {
+                return rc;
+        }
+        return 1;
+}
+
+static int websocketclient_deflate_negotiate (struct medusa_websocketclient *websocketclient)
+{
+        int rc;
+        struct medusa_websocket_deflate_params response;
+        if (websocketclient->sec_websocket_extensions == NULL) {
+                return 0;
+        }
+        rc = medusa_websocket_deflate_params_parse(&response, websocketclient->sec_websocket_extensions);
+        if (rc < 0) {
+                return rc;
+        }
+        if (rc == 0 || !websocketclient->deflate.offered) {
+                /* server accepted an extension that was not offered */
+                return -EPERM;
+        }
+        if (response.client_max_window_bits < 0) {
+                return -EPERM;
+        }
+        websocketclient->deflate.compress_window_bits           = websocketclient->deflate.window_bits;
+        if (response.client_max_window_bits > 0 && response.client_max_window_bits < websocketclient->deflate.compress_window_bits) {
+                websocketclient->deflate.compress_window_bits = response.client_max_window_bits;
+        }
+        if (websocketclient->deflate.compress_window_bits < MEDUSA_WEBSOCKET_DEFLATE_WINDOW_BITS_MIN) {
+                websocketclient->deflate.compress_window_bits = MEDUSA_WEBSOCKET_DEFLATE_WINDOW_BITS_MIN;
+        }
+        websocketclient->deflate.compress_no_context_takeover   = response.client_no_context_takeover || websocketclient->deflate.no_context_takeover;
+        websocketclient->deflate.decompress_window_bits         = (response.server_max_window_bits > 0) ? response.server_max_window_bits : MEDUSA_WEBSOCKET_DEFLATE_WINDOW_BITS_MAX;
+        websocketclient->deflate.decompress_no_context_takeover = response.server_no_context_takeover;
+        if (!websocketclient->deflate.compress_no_context_takeover) {
+                websocketclient->deflate.compress = medusa_websocket_deflate_acquire(MEDUSA_WEBSOCKET_DEFLATE_TYPE_COMPRESS, websocketclient->deflate.compress_window_bits, websocketclient->deflate.level);
+                if (MEDUSA_IS_ERR_OR_NULL(websocketclient->deflate.compress)) {
+                        rc = MEDUSA_PTR_ERR(websocketclient->deflate.compress);
+                        websocketclient->deflate.compress = NULL;
+                        return rc;
+                }
+        }
+        websocketclient->deflate.enabled = 1;
+        return 1;
+}
+
+static void websocketclient_deflate_uninit (struct medusa_websocketclient *websocketclient)
+{
+        if (websocketclient->deflate.compress != NULL) {
+                medusa_websocket_deflate_release(websocketclient->deflate.compress);
+                websocketclient->deflate.compress = NULL;
+        }
+        if (websocketclient->deflate.decompress != NULL) {
+                medusa_websocket_deflate_release(websocketclient->deflate.decompress);
+                websocketclient->deflate.decompress = NULL;
+        }
+        if (!MEDUSA_IS_ERR_OR_NULL(websocketclient->deflate.rbuffer)) {
+                medusa_buffer_destroy(websocketclient->deflate.rbuffer);
+                websocketclient->deflate.rbuffer = NULL;
+        }
+        if (!MEDUSA_IS_ERR_OR_NULL(websocketclient->deflate.wbuffer)) {
+                medusa_buffer_destroy(websocketclient->deflate.wbuffer);
+                websocketclient->deflate.wbuffer = NULL;
+        }
+        websocketclient->deflate.enabled = 0;
+}
+
+static int64_t websocketclient_deflate_message (struct medusa_websocketclient *websocketclient, const void **data, int64_t length)
+{
+        int64_t rc;
+        void *payload;
+        struct medusa_websocket_deflate *deflate;
+        if (websocketclient->deflate.wbuffer == NULL) {
+                websocketclient->deflate.wbuffer = medusa_buffer_create(MEDUSA_BUFFER_TYPE_SIMPLE);
+                if (MEDUSA_IS_ERR_OR_NULL(websocketclient->deflate.wbuffer)) {
+                        websocketclient->deflate.wbuffer = NULL;
+                        return -ENOMEM;
+                }
+        }
+        rc = medusa_buffer_reset(websocketclient->deflate.wbuffer);
+        if (rc < 0) {
+                return rc;
+        }
+        deflate = websocketclient->deflate.compress;
+        if (deflate == NULL) {
+                deflate = medusa_websocket_deflate_acquire(MEDUSA_WEBSOCKET_DEFLATE_TYPE_COMPRESS, websocketclient->deflate.compress_window_bits, websocketclient->deflate.level);
+                if (MEDUSA_IS_ERR_OR_NULL(deflate)) {
+                        return MEDUSA_PTR_ERR(deflate);
+                }
+        }
+        rc = medusa_websocket_deflate_compress(deflate, *data, length, websocketclient->deflate.wbuffer);
+        if (deflate != websocketclient->deflate.compress) {
+                medusa_websocket_deflate_release(deflate);
+        }
+        if (rc < 0) {
+                return rc;
+        }
+        if (rc > 0) {
+                payload = medusa_buffer_linearize(websocketclient->deflate.wbuffer, 0, rc);
+                if (MEDUSA_IS_ERR_OR_NULL(payload)) {
+                        return -EIO;
+                }
+                *data = payload;
+        }
+        return rc;
+}
+
+static unsigned int websocketclient_frame_type (uint8_t opcode)
+{
+        return (opcode == WS_OPCODE_CLOSE) ? MEDUSA_WEBSOCKETCLIENT_FRAME_TYPE_CLOSE :
+               (opcode == WS_OPCODE_PING) ? MEDUSA_WEBSOCKETCLIENT_FRAME_TYPE_PING :
+               (opcode == WS_OPCODE_PONG) ? MEDUSA_WEBSOCKETCLIENT_FRAME_TYPE_PONG :
+               (opcode == WS_OPCODE_TEXT) ? MEDUSA_WEBSOCKETCLIENT_FRAME_TYPE_TEXT :
+               (opcode == WS_OPCODE_BINARY) ? MEDUSA_WEBSOCKETCLIENT_FRAME_TYPE_BINARY :
+               MEDUSA_WEBSOCKETCLIENT_FRAME_TYPE_CONTINUATION;
+}
+
+static int websocketclient_message_begin (struct medusa_websocketclient *websocketclient, uint8_t uint8)
+{
+        int rc;
+        uint8_t opcode;
+
+        opcode = uint8 & 0x0f;
+        if (opcode & 0x08) {
+                /* control frames are never compressed */
+                return (uint8 & 0x40) ? -EIO : 0;
+        }
+        if (opcode != WS_OPCODE_CONTINUE) {
+                if ((uint8 & 0x40) && !websocketclient->deflate.enabled) {
+                        return -EIO;
+                }
+                websocketclient->deflate.message = !!(uint8 & 0x40);
+                websocketclient->message.type    = websocketclient_frame_type(opcode);
+                websocketclient->message.length  = 0;
+                if (websocketclient->message.buffer != NULL) {
+                        rc = medusa_buffer_reset(websocketclient->message.buffer);
+                        if (rc < 0) {
+                                return rc;
+                        }
+                }
+        } else if (uint8 & 0x40) {
+                return -EIO;
+        }
+        return 0;
+}
+
+static int websocketclient_inflate_payload (struct medusa_websocketclient *websocketclient, uint8_t uint8, int final, uint8_t **payload, int64_t *length)
+{
+        int64_t rc;
+        void *data;
+
+        if (uint8 & 0x08) {
+                return 0;
+        }
+        if (!websocketclient->deflate.message) {
+                return 0;
+        }
+
+        if (websocketclient->deflate.rbuffer == NULL) {
+                websocketclient->deflate.rbuffer = medusa_buffer_create(MEDUSA_BUFFER_TYPE_SIMPLE);
+                if (MEDUSA_IS_ERR_OR_NULL(websocketclient->deflate.rbuffer)) {
+                        websocketclient->deflate.rbuffer = NULL;
+                        return -ENOMEM;
+                }
+        }
+        rc = medusa_buffer_reset(websocketclient->deflate.rbuffer);
+        if (rc < 0) {
+                return rc;
+        }
+        if (websocketclient->deflate.decompress == NULL) {
+                websocketclient->deflate.decompress = medusa_websocket_deflate_acquire(MEDUSA_WEBSOCKET_DEFLATE_TYPE_DECOMPRESS, websocketclient->deflate.decompress_window_bits, 0);
+                if (MEDUSA_IS_ERR_OR_NULL(websocketclient->deflate.decompress)) {
+                        rc = MEDUSA_PTR_ERR(websocketclient->deflate.decompress);
+                        websocketclient->deflate.decompress = NULL;
+                        return rc;
+                }
+        }
+        rc = medusa_websocket_deflate_decompress(websocketclient->deflate.decompress, *payload, *length, final, websocketclient->deflate.rbuffer);
+        if (rc < 0) {
+                return rc;
+        }
+        if (final) {
+                websocketclient->deflate.message = 0;
+                if (websocketclient->deflate.decompress_no_context_takeover) {
+                        medusa_websocket_deflate_release(websocketclient->deflate.decompress);
+                        websocketclient->deflate.decompress = NULL;
+                }
+        }
+        if (rc > 0) {
+                data = medusa_buffer_linearize(websocketclient->deflate.rbuffer, 0, rc);
+                if (MEDUSA_IS_ERR_OR_NULL(data)) {
+                        return -EIO;
+                }
+                *payload = data;
+        }
+        *length = rc;
+        return 1;
+}
+
 static int websocketclient_httpparser_on_message_begin (http_parser *http_parser)
 {
         struct medusa_websocketclient *websocketclient = http_parser->data;
@@ -187,6 +422,12 @@ static int websocketclient_httpparser_on_header_field (http_parser *http_parser,
                                 return -ENOMEM;
                         }
                 }
+                if (strcasecmp(websocketclient->http_parser_header_field, "Sec-WebSocket-Extensions") == 0) {
+                        rc = websocketclient_add_extensions(websocketclient, websocketclient->http_parser_header_value);
+                        if (rc < 0) {
+                                return rc;
+                        }
+                }
                 if (websocketclient->http_parser_header_field != NULL) {
                         free(websocketclient->http_parser_header_field);
                         websocketclient->http_parser_header_field = NULL;
@@ -268,6 +509,12 @@ static int websocketclient_httpparser_on_headers_complete (http_parser *http_par
                                 return -ENOMEM;
                         }
                 }
+                if (strcasecmp(websocketclient->http_parser_header_field, "Sec-WebSocket-Extensions") == 0) {
+                        rc = websocketclient_add_extensions(websocketclient, websocketclient->http_parser_header_value);
+                        if (rc < 0) {
+                                return rc;
+                        }
+                }
         }
         if (websocketclient->http_parser_header_field != NULL) {
                 free(websocketclient->http_parser_header_field);
@@ -409,6 +656,7 @@ static int websocketclient_tcpsocket_onevent (struct medusa_tcpsocket *tcpsocket
                 int i;
                 int l;
                 char key_nonce[16];
+                char extensions[128];
 
                 rc = websocketclient_set_state(websocketclient, MEDUSA_WEBSOCKETCLIENT_STATE_SENDING_REQUEST, 0, __LINE__);
                 if (rc < 0) {
@@ -434,6 +682,12 @@ static int websocketclient_tcpsocket_onevent (struct medusa_tcpsocket *tcpsocket
                 }
                 medusa_base64_encode(websocketclient->sec_websocket_key, key_nonce, 16);
 
+                rc = websocketclient_deflate_offer(websocketclient, extensions, sizeof(extensions));
+                if (rc < 0) {
+                        error = rc;
+                        goto bail;
+                }
+
                 rc = medusa_tcpsocket_printf_unlocked(websocketclient->tcpsocket,
                         "GET %s HTTP/1.1\r\n"
                         "Host: %s\r\n"
@@ -441,6 +695,7 @@ static int websocketclient_tcpsocket_onevent (struct medusa_tcpsocket *tcpsocket
                         "Sec-WebSocket-Version: 13\r\n"
                         "Sec-WebSocket-Protocol: %s\r\n"
                         "Sec-WebSocket-Key: %s\r\n"
+                        "%s%s%s"
                         "Connection: keep-alive, upgrade\r\n"
                         "Pragma: no-cache\r\n"
                         "Cache-Control: no-cache\r\n"
@@ -448,7 +703,10 @@ static int websocketclient_tcpsocket_onevent (struct medusa_tcpsocket *tcpsocket
                         (websocketclient->sec_websocket_path) ? websocketclient->sec_websocket_path : "/",
                         websocketclient->host,
                         (websocketclient->sec_websocket_protocol) ? websocketclient->sec_websocket_protocol : "generic",
-			websocketclient->sec_websocket_key);
+			websocketclient->sec_websocket_key,
+                        (extensions[0] != '\0') ? "Sec-WebSocket-Extensions: " : "",
+                        extensions,
+                        (extensions[0] != '\0') ? "\r\n" : "");
                 if (rc < 0) {
                         struct medusa_websocketclient_event_error medusa_websocketclient_event_error;
                         rc = websocketclient_set_state(websocketclient, MEDUSA_WEBSOCKETCLIENT_STATE_ERROR, -rc, __LINE__);
@@ -547,7 +805,8 @@ static int websocketclient_tcpsocket_onevent (struct medusa_tcpsocket *tcpsocket
                         medusa_base64_encode(base64, hash, MEDUSA_SHA1_LENGTH);
 
                         if (websocketclient->sec_websocket_accept == NULL ||
-                            strcasecmp(base64, websocketclient->sec_websocket_accept) != 0) {
+                            strcasecmp(base64, websocketclient->sec_websocket_accept) != 0 ||
+                            websocketclient_deflate_negotiate(websocketclient) < 0) {
                                 struct medusa_websocketclient_event_error medusa_websocketclient_event_error;
                                 rc = websocketclient_set_state(websocketclient, MEDUSA_WEBSOCKETCLIENT_STATE_ERROR, EPERM, __LINE__);
                                 if (rc < 0) {
@@ -588,6 +847,9 @@ static int websocketclient_tcpsocket_onevent (struct medusa_tcpsocket *tcpsocket
                         free(websocketclient->sec_websocket_accept);
                         websocketclient->sec_websocket_accept = NULL;
 
+                        free(websocketclient->sec_websocket_extensions);
+                        websocketclient->sec_websocket_extensions = NULL;
+
                         free(websocketclient->sec_websocket_path);
                         websocketclient->sec_websocket_path = NULL;
 
@@ -658,6 +920,10 @@ restart_buffer:
                                                                 error = rc;
                                                                 goto bail;
                                                         }
+                                                        if (uint64 & 0x8000000000000000ULL) {
+                                                                error = -EIO;
+                                                                goto bail;
+                                                        }
                                                         websocketclient->frame_mask_offset    = 10;
                                                         websocketclient->frame_payload_offset = websocketclient->frame_mask_offset + 4;
                                                         websocketclient->frame_payload_length = uint64;
@@ -673,40 +939,71 @@ restart_buffer:
                                                 websocketclient->frame_mask_offset     = 0;
                                                 websocketclient->frame_payload_offset -= 4;
                                         }
+                                        rc = medusa_buffer_peek_uint8(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), 0, &websocketclient->frame_opcode);
+                                        if (rc < 0) {
+                                                error = rc;
+                                                goto bail;
+                                        }
+                                        rc = websocketclient_message_begin(websocketclient, websocketclient->frame_opcode);
+                                        if (rc < 0) {
+                                                error = rc;
+                                                goto bail;
+                                        }
+                                        if (websocketclient->max_message_size > 0 &&
+                                            !(websocketclient->frame_opcode & 0x08) &&
+                                            !websocketclient->deflate.message &&
+                                            websocketclient->message.length + websocketclient->frame_payload_length > websocketclient->max_message_size) {
+                                                error = -EMSGSIZE;
+                                                goto bail;
+                                        }
+                                        websocketclient->frame_payload_consumed = 0;
                                         websocketclient->frame_state = MEDUSA_WEBSOCKETCLIENT_FRAME_STATE_PAYLOAD;
                                         FALL_THROUGH;
                                 }
                                 case MEDUSA_WEBSOCKETCLIENT_FRAME_STATE_PAYLOAD: {
-                                        unsigned int i;
                                         int64_t rlength;
-                                        uint8_t *payload;
 
                                         rlength = medusa_buffer_get_length(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket));
                                         if (rlength < 0) {
                                                 error = rlength;
                                                 goto bail;
                                         }
+                                        if (websocketclient->message_mode == MEDUSA_WEBSOCKETCLIENT_MESSAGE_MODE_STREAM &&
+                                            !(websocketclient->frame_opcode & 0x08)) {
+                                                /* data frames are delivered as they arrive, drop the header and continue with the payload */
+                                                if (rlength < websocketclient->frame_payload_offset) {
+                                                        goto short_buffer;
+                                                }
+                                                if (websocketclient->frame_mask_offset != 0) {
+                                                        rc = medusa_buffer_peek_data(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), websocketclient->frame_mask_offset, websocketclient->frame_mask, 4);
+                                                        if (rc < 0) {
+                                                                error = rc;
+                                                                goto bail;
+                                                        }
+                                                }
+                                                rlength = medusa_buffer_choke(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), 0, websocketclient->frame_payload_offset);
+                                                if (rlength != websocketclient->frame_payload_offset) {
+                                                        error = -EIO;
+                                                        goto bail;
+                                                }
+                                                websocketclient->frame_state = MEDUSA_WEBSOCKETCLIENT_FRAME_STATE_STREAM;
+                                                goto restart_buffer;
+                                        }
                                         if (rlength < websocketclient->frame_payload_offset + websocketclient->frame_payload_length) {
                                                 goto short_buffer;
                                         }
 
-                                        payload = medusa_buffer_linearize(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), websocketclient->frame_payload_offset, websocketclient->frame_payload_length);
-                                        if (MEDUSA_IS_ERR_OR_NULL(payload)) {
-                                                error = MEDUSA_PTR_ERR(payload);
-                                                goto bail;
-                                        }
                                         if (websocketclient->frame_mask_offset != 0) {
                                                 uint8_t mask[4];
-                                                rc  = medusa_buffer_peek_uint8(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), websocketclient->frame_mask_offset + 0, &mask[0]);
-                                                rc |= medusa_buffer_peek_uint8(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), websocketclient->frame_mask_offset + 1, &mask[1]);
-                                                rc |= medusa_buffer_peek_uint8(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), websocketclient->frame_mask_offset + 2, &mask[2]);
-                                                rc |= medusa_buffer_peek_uint8(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), websocketclient->frame_mask_offset + 3, &mask[3]);
+                                                rc = medusa_buffer_peek_data(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), websocketclient->frame_mask_offset, mask, 4);
                                                 if (rc < 0) {
                                                         error = rc;
                                                         goto bail;
                                                 }
-                                                for (i = 0; i < websocketclient->frame_payload_length; i++) {
-                                                        payload[i] = payload[i] ^ mask[i & 3];
+                                                rc = medusa_websocket_mask_buffer(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), websocketclient->frame_payload_offset, websocketclient->frame_payload_length, mask);
+                                                if (rc < 0) {
+                                                        error = rc;
+                                                        goto bail;
                                                 }
                                         }
 
@@ -717,14 +1014,13 @@ restart_buffer:
                                         uint8_t uint8;
                                         uint8_t opcode;
                                         int64_t clength;
+                                        int64_t plength;
                                         uint8_t *payload;
+                                        unsigned int assembled;
                                         struct medusa_websocketclient_event_message medusa_websocketclient_event_message;
 
-                                        rc = medusa_buffer_peek_uint8(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), 0, &uint8);
-                                        if (rc < 0) {
-                                                error = rc;
-                                                goto bail;
-                                        }
+                                        uint8  = websocketclient->frame_opcode;
+                                        opcode = uint8 & 0x0f;
 
                                         payload = medusa_buffer_linearize(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), websocketclient->frame_payload_offset, websocketclient->frame_payload_length);
                                         if (MEDUSA_IS_ERR_OR_NULL(payload)) {
@@ -732,21 +1028,75 @@ restart_buffer:
                                                 goto bail;
                                         }
 
-                                        opcode = uint8 & 0x0f;
-                                        medusa_websocketclient_event_message.final   = !!(uint8 & 0x80);
-                                        medusa_websocketclient_event_message.type    = (opcode == WS_OPCODE_CLOSE) ? MEDUSA_WEBSOCKETCLIENT_FRAME_TYPE_CLOSE :
-                                                                                              (opcode == WS_OPCODE_PING) ? MEDUSA_WEBSOCKETCLIENT_FRAME_TYPE_PING :
-                                                                                              (opcode == WS_OPCODE_PONG) ? MEDUSA_WEBSOCKETCLIENT_FRAME_TYPE_PONG :
-                                                                                              (opcode == WS_OPCODE_TEXT) ? MEDUSA_WEBSOCKETCLIENT_FRAME_TYPE_TEXT :
-                                                                                              (opcode == WS_OPCODE_BINARY) ? MEDUSA_WEBSOCKETCLIENT_FRAME_TYPE_BINARY :
-                                                                                              MEDUSA_WEBSOCKETCLIENT_FRAME_TYPE_CONTINUATION;
-                                        medusa_websocketclient_event_message.length  = websocketclient->frame_payload_length;
-                                        medusa_websocketclient_event_message.payload = payload;
-                                        rc = medusa_websocketclient_onevent_unlocked(websocketclient, MEDUSA_WEBSOCKETCLIENT_EVENT_MESSAGE, &medusa_websocketclient_event_message);
+                                        plength = websocketclient->frame_payload_length;
+                                        rc = websocketclient_inflate_payload(websocketclient, uint8, !!(uint8 & 0x80), &payload, &plength);
                                         if (rc < 0) {
                                                 error = rc;
                                                 goto bail;
                                         }
+
+                                        medusa_websocketclient_event_message.final   = !!(uint8 & 0x80);
+                                        medusa_websocketclient_event_message.type    = websocketclient_frame_type(opcode);
+                                        medusa_websocketclient_event_message.length  = plength;
+                                        medusa_websocketclient_event_message.payload = payload;
+
+                                        assembled = 0;
+                                        if (!(opcode & 0x08)) {
+                                                if (websocketclient->max_message_size > 0 &&
+                                                    websocketclient->message.length + plength > websocketclient->max_message_size) {
+                                                        error = -EMSGSIZE;
+                                                        goto bail;
+                                                }
+                                                if (websocketclient->message_mode == MEDUSA_WEBSOCKETCLIENT_MESSAGE_MODE_ASSEMBLE &&
+                                                    (opcode == WS_OPCODE_CONTINUE || !(uint8 & 0x80))) {
+                                                        /* fragments are collected until the final one, unfragmented messages are delivered in place */
+                                                        if (websocketclient->message.buffer == NULL) {
+                                                                websocketclient->message.buffer = medusa_buffer_create(MEDUSA_BUFFER_TYPE_SIMPLE);
+                                                                if (MEDUSA_IS_ERR_OR_NULL(websocketclient->message.buffer)) {
+                                                                        error = MEDUSA_PTR_ERR(websocketclient->message.buffer);
+                                                                        websocketclient->message.buffer = NULL;
+                                                                        goto bail;
+                                                                }
+                                                        }
+                                                        if (plength > 0) {
+                                                                rc = medusa_buffer_append(websocketclient->message.buffer, payload, plength);
+                                                                if (rc < 0) {
+                                                                        error = rc;
+                                                                        goto bail;
+                                                                }
+                                                        }
+                                                        assembled = 1;
+                                                }
+                                                websocketclient->message.length += plength;
+                                        }
+
+                                        if (assembled && (uint8 & 0x80)) {
+                                                payload = NULL;
+                                                if (websocketclient->message.length > 0) {
+                                                        payload = medusa_buffer_linearize(websocketclient->message.buffer, 0, websocketclient->message.length);
+                                                        if (MEDUSA_IS_ERR_OR_NULL(payload)) {
+                                                                error = MEDUSA_PTR_ERR(payload);
+                                                                goto bail;
+                                                        }
+                                                }
+                                                medusa_websocketclient_event_message.type    = websocketclient->message.type;
+                                                medusa_websocketclient_event_message.length  = websocketclient->message.length;
+                                                medusa_websocketclient_event_message.payload = payload;
+                                        }
+                                        if (!assembled || (uint8 & 0x80)) {
+                                                rc = medusa_websocketclient_onevent_unlocked(websocketclient, MEDUSA_WEBSOCKETCLIENT_EVENT_MESSAGE, &medusa_websocketclient_event_message);
+                                                if (rc < 0) {
+                                                        error = rc;
+                                                        goto bail;
+                                                }
+                                        }
+                                        if (assembled && (uint8 & 0x80)) {
+                                                rc = medusa_buffer_reset(websocketclient->message.buffer);
+                                                if (rc < 0) {
+                                                        error = rc;
+                                                        goto bail;
+                                                }
+                                        }
                                         clength = medusa_buffer_choke(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), 0, websocketclient->frame_payload_offset + websocketclient->frame_payload_length);
                                         if (clength != websocketclient->frame_payload_offset + websocketclient->frame_payload_length) {
                                                 error = -EIO;
@@ -767,6 +1117,90 @@ restart_buffer:
                                                 goto out;
                                         }
 
+                                        websocketclient->frame_state = MEDUSA_WEBSOCKETCLIENT_FRAME_STATE_START;
+                                        goto restart_buffer;
+                                }
+                                case MEDUSA_WEBSOCKETCLIENT_FRAME_STATE_STREAM: {
+                                        int64_t rlength;
+                                        int64_t clength;
+                                        int64_t plength;
+                                        uint8_t *payload;
+                                        unsigned int final;
+                                        struct medusa_websocketclient_event_message_chunk medusa_websocketclient_event_message_chunk;
+
+                                        rlength = medusa_buffer_get_length(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket));
+                                        if (rlength < 0) {
+                                                error = rlength;
+                                                goto bail;
+                                        }
+                                        clength = websocketclient->frame_payload_length - websocketclient->frame_payload_consumed;
+                                        if (clength > rlength) {
+                                                clength = rlength;
+                                        }
+                                        if (clength == 0 && websocketclient->frame_payload_length != 0) {
+                                                goto short_buffer;
+                                        }
+
+                                        payload = NULL;
+                                        if (clength > 0) {
+                                                if (websocketclient->frame_mask_offset != 0) {
+                                                        unsigned int i;
+                                                        uint8_t mask[4];
+                                                        for (i = 0; i < 4; i++) {
+                                                                mask[i] = websocketclient->frame_mask[(websocketclient->frame_payload_consumed + i) & 3];
+                                                        }
+                                                        rc = medusa_websocket_mask_buffer(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), 0, clength, mask);
+                                                        if (rc < 0) {
+                                                                error = rc;
+                                                                goto bail;
+                                                        }
+                                                }
+                                                payload = medusa_buffer_linearize(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), 0, clength);
+                                                if (MEDUSA_IS_ERR_OR_NULL(payload)) {
+                                                        error = MEDUSA_PTR_ERR(payload);
+                                                        goto bail;
+                                                }
+                                        }
+
+                                        final   = (websocketclient->frame_opcode & 0x80) && (websocketclient->frame_payload_consumed + clength == websocketclient->frame_payload_length);
+                                        plength = clength;
+                                        rc = websocketclient_inflate_payload(websocketclient, websocketclient->frame_opcode, final, &payload, &plength);
+                                        if (rc < 0) {
+                                                error = rc;
+                                                goto bail;
+                                        }
+                                        if (websocketclient->max_message_size > 0 &&
+                                            websocketclient->message.length + plength > websocketclient->max_message_size) {
+                                                error = -EMSGSIZE;
+                                                goto bail;
+                                        }
+
+                                        if (plength > 0 || final) {
+                                                medusa_websocketclient_event_message_chunk.final   = final;
+                                                medusa_websocketclient_event_message_chunk.type    = websocketclient->message.type;
+                                                medusa_websocketclient_event_message_chunk.offset  = websocketclient->message.length;
+                                                medusa_websocketclient_event_message_chunk.length  = plength;
+                                                medusa_websocketclient_event_message_chunk.payload = (plength > 0) ? payload : NULL;
+                                                rc = medusa_websocketclient_onevent_unlocked(websocketclient, MEDUSA_WEBSOCKETCLIENT_EVENT_MESSAGE_CHUNK, &medusa_websocketclient_event_message_chunk);
+                                                if (rc < 0) {
+                                                        error = rc;
+                                                        goto bail;
+                                                }
+                                        }
+                                        websocketclient->message.length += plength;
+
+                                        if (clength > 0) {
+                                                rlength = medusa_buffer_choke(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), 0, clength);
+                                                if (rlength != clength) {
+                                                        error = -EIO;
+                                                        goto bail;
+                                                }
+                                        }
+                                        websocketclient->frame_payload_consumed += clength;
+                                        if (websocketclient->frame_payload_consumed < websocketclient->frame_payload_length) {
+                                                goto short_buffer;
+                                        }
+
                                         websocketclient->frame_state = MEDUSA_WEBSOCKETCLIENT_FRAME_STATE_START;
                                         goto restart_buffer;
                                 }
@@ -877,6 +1311,9 @@ __attribute__ ((visibility ("default"))) int medusa_websocketclient_connect_opti
                 return -EINVAL;
         }
         memset(options, 0, sizeof(struct medusa_websocketclient_connect_options));
+        options->deflate_level       = -1;
+        options->deflate_window_bits = MEDUSA_WEBSOCKET_DEFLATE_WINDOW_BITS_MAX;
+        options->deflate_threshold   = 64;
         return 0;
 }
 
@@ -936,6 +1373,23 @@ __attribute__ ((visibility ("default"))) struct medusa_websocketclient * medusa_
         if (MEDUSA_IS_ERR_OR_NULL(options->address)) {
                 return MEDUSA_ERR_PTR(-EINVAL);
         }
+        if (options->deflate_enabled) {
+                if (!medusa_websocket_deflate_supported()) {
+                        return MEDUSA_ERR_PTR(-ENOTSUP);
+                }
+                if (options->deflate_window_bits < MEDUSA_WEBSOCKET_DEFLATE_WINDOW_BITS_MIN ||
+                    options->deflate_window_bits > MEDUSA_WEBSOCKET_DEFLATE_WINDOW_BITS_MAX) {
+                        return MEDUSA_ERR_PTR(-EINVAL);
+                }
+        }
+        if (options->message_mode != MEDUSA_WEBSOCKETCLIENT_MESSAGE_MODE_FRAME &&
+            options->message_mode != MEDUSA_WEBSOCKETCLIENT_MESSAGE_MODE_STREAM &&
+            options->message_mode != MEDUSA_WEBSOCKETCLIENT_MESSAGE_MODE_ASSEMBLE) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        if (options->max_message_size < 0) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
 
 #if defined(MEDUSA_WEBSOCKETCLIENT_USE_POOL) && (MEDUSA_WEBSOCKETCLIENT_USE_POOL == 1)
         websocketclient = medusa_pool_malloc(g_pool_websocketclient);
@@ -974,6 +1428,13 @@ __attribute__ ((visibility ("default"))) struct medusa_websocketclient * medusa_
         websocketclient->onevent = options->onevent;
         websocketclient->context = options->context;
         websocketclient->frame_state = MEDUSA_WEBSOCKETCLIENT_FRAME_STATE_START;
+        websocketclient->deflate.offered             = !!options->deflate_enabled;
+        websocketclient->deflate.level               = options->deflate_level;
+        websocketclient->deflate.window_bits         = options->deflate_window_bits;
+        websocketclient->deflate.no_context_takeover = !!options->deflate_no_context_takeover;
+        websocketclient->deflate.threshold           = options->deflate_threshold;
+        websocketclient->message_mode                = options->message_mode;
+        websocketclient->max_message_size            = options->max_message_size;
         rc = medusa_monitor_add_unlocked(options->monitor, &websocketclient->subject);
         if (rc < 0) {
                 error = rc;
@@ -1189,13 +1650,30 @@ __attribute__ ((visibility ("default"))) int64_t medusa_websocketclient_write_un
         int rc;
         int error;
         uint8_t uint8;
+        int64_t plength;
+        unsigned int deflated;
 
         if (MEDUSA_IS_ERR_OR_NULL(websocketclient)) {
                 return -EINVAL;
         }
 
+        plength  = length;
+        deflated = 0;
+        if (websocketclient->deflate.enabled &&
+            final &&
+            (type == MEDUSA_WEBSOCKETCLIENT_FRAME_TYPE_TEXT || type == MEDUSA_WEBSOCKETCLIENT_FRAME_TYPE_BINARY) &&
+            length >= websocketclient->deflate.threshold) {
+                plength = websocketclient_deflate_message(websocketclient, &data, length);
+                if (plength < 0) {
+                        error = plength;
+                        goto bail;
+                }
+                deflated = 1;
+        }
+
         uint8  = 0;
         uint8 |= (final) ? 0x80 : 0x00;
+        uint8 |= (deflated) ? 0x40 : 0x00;
         uint8 |= (type == MEDUSA_WEBSOCKETCLIENT_FRAME_TYPE_CONTINUATION) ? 0x00 :
                  (type == MEDUSA_WEBSOCKETCLIENT_FRAME_TYPE_CLOSE)        ? 0x08 :
                  (type == MEDUSA_WEBSOCKETCLIENT_FRAME_TYPE_PING)         ? 0x09 :
@@ -1209,15 +1687,15 @@ __attribute__ ((visibility ("default"))) int64_t medusa_websocketclient_write_un
                 goto bail;
         }
 
-        if (length <= 125) {
+        if (plength <= 125) {
                 uint8  = 0;
-                uint8 |= length;
+                uint8 |= plength;
                 rc = medusa_buffer_append_uint8_be(medusa_tcpsocket_get_write_buffer_unlocked(websocketclient->tcpsocket), uint8);
                 if (rc < 0) {
                         error = rc;
                         goto bail;
                 }
-        } else if (length <= 0xffff) {
+        } else if (plength <= 0xffff) {
                 uint8  = 0;
                 uint8 |= 126;
                 rc = medusa_buffer_append_uint8_be(medusa_tcpsocket_get_write_buffer_unlocked(websocketclient->tcpsocket), uint8);
@@ -1225,7 +1703,7 @@ __attribute__ ((visibility ("default"))) int64_t medusa_websocketclient_write_un
                         error = rc;
                         goto bail;
                 }
-                rc = medusa_buffer_append_uint16_be(medusa_tcpsocket_get_write_buffer_unlocked(websocketclient->tcpsocket), length);
+                rc = medusa_buffer_append_uint16_be(medusa_tcpsocket_get_write_buffer_unlocked(websocketclient->tcpsocket), plength);
                 if (rc < 0) {
                         error = rc;
                         goto bail;
@@ -1238,13 +1716,13 @@ __attribute__ ((visibility ("default"))) int64_t medusa_websocketclient_write_un
                         error = rc;
                         goto bail;
                 }
-                rc = medusa_buffer_append_uint64_be(medusa_tcpsocket_get_write_buffer_unlocked(websocketclient->tcpsocket), length);
+                rc = medusa_buffer_append_uint64_be(medusa_tcpsocket_get_write_buffer_unlocked(websocketclient->tcpsocket), plength);
                 if (rc < 0) {
                         error = rc;
                         goto bail;
                 }
         }
-        rc = medusa_buffer_append(medusa_tcpsocket_get_write_buffer_unlocked(websocketclient->tcpsocket), data, length);
+        rc = medusa_buffer_append(medusa_tcpsocket_get_write_buffer_unlocked(websocketclient->tcpsocket), data, plength);
         if (rc < 0) {
                 error = rc;
                 goto bail;
@@ -1510,6 +1988,15 @@ __attribute__ ((visibility ("default"))) int medusa_websocketclient_onevent_unlo
                         free(websocketclient->sec_websocket_accept);
                         websocketclient->sec_websocket_accept = NULL;
                 }
+                if (websocketclient->sec_websocket_extensions != NULL) {
+                        free(websocketclient->sec_websocket_extensions);
+                        websocketclient->sec_websocket_extensions = NULL;
+                }
+                websocketclient_deflate_uninit(websocketclient);
+                if (websocketclient->message.buffer != NULL) {
+                        medusa_buffer_destroy(websocketclient->message.buffer);
+                        websocketclient->message.buffer = NULL;
+                }
                 if (websocketclient->http_parser_header_field != NULL) {
                         free(websocketclient->http_parser_header_field);
                         websocketclient->http_parser_header_field = NULL;
@@ -1587,6 +2074,7 @@ __attribute__ ((visibility ("default"))) const char * medusa_websocketclient_eve
         if (events == MEDUSA_WEBSOCKETCLIENT_EVENT_DISCONNECTED)                return "MEDUSA_WEBSOCKETCLIENT_EVENT_DISCONNECTED";
         if (events == MEDUSA_WEBSOCKETCLIENT_EVENT_STATE_CHANGED)               return "MEDUSA_WEBSOCKETCLIENT_EVENT_STATE_CHANGED";
         if (events == MEDUSA_WEBSOCKETCLIENT_EVENT_DESTROY)                     return "MEDUSA_WEBSOCKETCLIENT_EVENT_DESTROY";
+        if (events == MEDUSA_WEBSOCKETCLIENT_EVENT_MESSAGE_CHUNK)               return "MEDUSA_WEBSOCKETCLIENT_EVENT_MESSAGE_CHUNK";
         return "MEDUSA_WEBSOCKETCLIENT_EVENT_UNKNOWN";
 }
 
@@ -1617,8 +2105,33 @@ __attribute__ ((visibility ("default"))) const char * medusa_websocketclient_fra
         return "MEDUSA_WEBSOCKETCLIENT_FRAME_TYPE_UNKNOWN";
 }
 
+__attribute__ ((visibility ("default"))) const char * medusa_websocketclient_message_mode_string (unsigned int mode)
+{
+        if (mode == MEDUSA_WEBSOCKETCLIENT_MESSAGE_MODE_FRAME)                  return "MEDUSA_WEBSOCKETCLIENT_MESSAGE_MODE_FRAME";
+        if (mode == MEDUSA_WEBSOCKETCLIENT_MESSAGE_MODE_STREAM)                 return "MEDUSA_WEBSOCKETCLIENT_MESSAGE_MODE_STREAM";
+        if (mode == MEDUSA_WEBSOCKETCLIENT_MESSAGE_MODE_ASSEMBLE)               return "MEDUSA_WEBSOCKETCLIENT_MESSAGE_MODE_ASSEMBLE";
+        return "MEDUSA_WEBSOCKETCLIENT_MESSAGE_MODE_UNKNOWN";
+}
+
+static int websocketclient_subject_onevent (struct medusa_subject *subject, unsigned int events, void *param)
+{
+        return medusa_websocketclient_onevent_unlocked((struct medusa_websocketclient *) subject, events, param);
+}
+
+static int websocketclient_subject_destroy (struct medusa_subject *subject)
+{
+        return medusa_websocketclient_onevent_unlocked((struct medusa_websocketclient *) subject, MEDUSA_WEBSOCKETCLIENT_EVENT_DESTROY, NULL);
+}
+
+static const struct medusa_subject_type g_subject_type = {
+        .rank    = MEDUSA_SUBJECT_RANK_WEBSOCKETCLIENT,
+        .onevent = websocketclient_subject_onevent,
+        .destroy = websocketclient_subject_destroy
+};
+
 __attribute__ ((constructor)) static void websocketclient_constructor (void)
 {
+        medusa_monitor_register_subject_type(MEDUSA_SUBJECT_TYPE_WEBSOCKETCLIENT, &g_subject_type);
 #if defined(MEDUSA_WEBSOCKETCLIENT_USE_POOL) && (MEDUSA_WEBSOCKETCLIENT_USE_POOL == 1)
         g_pool_websocketclient = medusa_pool_create("medusa-websocketclient", sizeof(struct medusa_websocketclient), 0, 0, MEDUSA_POOL_FLAG_DEFAULT | MEDUSA_POOL_FLAG_THREAD_SAFE, NULL, NULL, NULL);
 #endif
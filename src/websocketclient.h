@@ -34,7 +34,8 @@ enum {
         MEDUSA_WEBSOCKETCLIENT_EVENT_BUFFERED_WRITE_FINISHED    = (1 << 14),
         MEDUSA_WEBSOCKETCLIENT_EVENT_DISCONNECTED               = (1 << 15),
         MEDUSA_WEBSOCKETCLIENT_EVENT_STATE_CHANGED              = (1 << 16),
-        MEDUSA_WEBSOCKETCLIENT_EVENT_DESTROY                    = (1 << 17)
+        MEDUSA_WEBSOCKETCLIENT_EVENT_DESTROY                    = (1 << 17),
+        MEDUSA_WEBSOCKETCLIENT_EVENT_MESSAGE_CHUNK              = (1 << 18)
 #define MEDUSA_WEBSOCKETCLIENT_EVENT_ERROR                      MEDUSA_WEBSOCKETCLIENT_EVENT_ERROR
 #define MEDUSA_WEBSOCKETCLIENT_EVENT_RESOLVING                  MEDUSA_WEBSOCKETCLIENT_EVENT_RESOLVING
 #define MEDUSA_WEBSOCKETCLIENT_EVENT_RESOLVE_TIMEOUT            MEDUSA_WEBSOCKETCLIENT_EVENT_RESOLVE_TIMEOUT
@@ -53,6 +54,7 @@ enum {
 #define MEDUSA_WEBSOCKETCLIENT_EVENT_DISCONNECTED               MEDUSA_WEBSOCKETCLIENT_EVENT_DISCONNECTED
 #define MEDUSA_WEBSOCKETCLIENT_EVENT_STATE_CHANGED              MEDUSA_WEBSOCKETCLIENT_EVENT_STATE_CHANGED
 #define MEDUSA_WEBSOCKETCLIENT_EVENT_DESTROY                    MEDUSA_WEBSOCKETCLIENT_EVENT_DESTROY
+#define MEDUSA_WEBSOCKETCLIENT_EVENT_MESSAGE_CHUNK              MEDUSA_WEBSOCKETCLIENT_EVENT_MESSAGE_CHUNK
 };
 
 enum {
@@ -95,6 +97,15 @@ enum {
 #define MEDUSA_WEBSOCKETCLIENT_FRAME_TYPE_BINARY        MEDUSA_WEBSOCKETCLIENT_FRAME_TYPE_BINARY
 };
 
+enum {
+        MEDUSA_WEBSOCKETCLIENT_MESSAGE_MODE_FRAME       = 0,
+        MEDUSA_WEBSOCKETCLIENT_MESSAGE_MODE_STREAM      = 1,
+        MEDUSA_WEBSOCKETCLIENT_MESSAGE_MODE_ASSEMBLE    = 2
+#define MEDUSA_WEBSOCKETCLIENT_MESSAGE_MODE_FRAME       MEDUSA_WEBSOCKETCLIENT_MESSAGE_MODE_FRAME
+#define MEDUSA_WEBSOCKETCLIENT_MESSAGE_MODE_STREAM      MEDUSA_WEBSOCKETCLIENT_MESSAGE_MODE_STREAM
+#define MEDUSA_WEBSOCKETCLIENT_MESSAGE_MODE_ASSEMBLE    MEDUSA_WEBSOCKETCLIENT_MESSAGE_MODE_ASSEMBLE
+};
+
 struct medusa_websocketclient_connect_options {
         struct medusa_monitor *monitor;
         unsigned int protocol;
@@ -109,6 +120,13 @@ struct medusa_websocketclient_connect_options {
         int ssl_verify;
         double resolve_timeout;
         double connect_timeout;
+        int deflate_enabled;
+        int deflate_level;
+        int deflate_window_bits;
+        int deflate_no_context_takeover;
+        int64_t deflate_threshold;
+        unsigned int message_mode;
+        int64_t max_message_size;
         int enabled;
         int (*onevent) (struct medusa_websocketclient *websocketclient, unsigned int events, void *context, void *param);
         void *context;
@@ -133,6 +151,14 @@ struct medusa_websocketclient_event_message {
         const void *payload;
 };
 
+struct medusa_websocketclient_event_message_chunk {
+        unsigned int final;
+        unsigned int type;
+        int64_t offset;
+        int64_t length;
+        const void *payload;
+};
+
 struct medusa_websocketclient_event_buffered_write {
         int64_t length;
         int64_t remaining;
@@ -209,6 +235,7 @@ struct medusa_monitor * medusa_websocketclient_get_monitor (struct medusa_websoc
 const char * medusa_websocketclient_event_string (unsigned int events);
 const char * medusa_websocketclient_state_string (unsigned int state);
 const char * medusa_websocketclient_frame_type_string (unsigned int type);
+const char * medusa_websocketclient_message_mode_string (unsigned int mode);
 
 #ifdef __cplusplus
 }
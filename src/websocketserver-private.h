@@ -16,6 +16,7 @@ int medusa_websocketserver_get_error_unlocked (const struct medusa_websocketserv
 int medusa_websocketserver_get_protocol_unlocked (struct medusa_websocketserver *websocketserver);
 int medusa_websocketserver_get_sockport_unlocked (const struct medusa_websocketserver *websocketserver);
 int medusa_websocketserver_get_sockname_unlocked (const struct medusa_websocketserver *websocketserver, struct sockaddr_storage *sockaddr);
+int medusa_websocketserver_get_stats_unlocked (const struct medusa_websocketserver *websocketserver, struct medusa_tcpsocket_stats *stats);
 
 int medusa_websocketserver_set_enabled_unlocked (struct medusa_websocketserver *websocketserver, int enabled);
 int medusa_websocketserver_get_enabled_unlocked (const struct medusa_websocketserver *websocketserver);
@@ -47,6 +48,9 @@ unsigned int medusa_websocketserver_get_userdata_uint_unlocked (struct medusa_we
 int medusa_websocketserver_onevent_unlocked (struct medusa_websocketserver *websocketserver, unsigned int events, void *param);
 struct medusa_monitor * medusa_websocketserver_get_monitor_unlocked (struct medusa_websocketserver *websocketserver);
 
+int medusa_websocketserver_broadcast_unlocked (struct medusa_websocketserver *websocketserver, unsigned int final, unsigned int type, const void *data, int64_t length);
+int medusa_websocketserver_broadcast_frame_unlocked (struct medusa_websocketserver *websocketserver, struct medusa_websocketserver_frame *frame);
+
 struct medusa_websocketserver_client * medusa_websocketserver_accept_unlocked (struct medusa_websocketserver *websocketserver, int (*onevent) (struct medusa_websocketserver_client *websocketserver_client, unsigned int events, void *context, void *param), void *context);
 struct medusa_websocketserver_client * medusa_websocketserver_accept_with_options_unlocked (struct medusa_websocketserver *websocketserver, struct medusa_websocketserver_accept_options *options);
 void medusa_websocketserver_client_destroy_unlocked (struct medusa_websocketserver_client *websocketserver_client);
@@ -60,6 +64,10 @@ struct medusa_buffer * medusa_websocketserver_client_get_read_buffer_unlocked (c
 struct medusa_buffer * medusa_websocketserver_client_get_write_buffer_unlocked (const struct medusa_websocketserver_client *websocketserver_client);
 
 int64_t medusa_websocketserver_client_write_unlocked (struct medusa_websocketserver_client *websocketserver_client, unsigned int final, unsigned int type, const void *data, int64_t length);
+int64_t medusa_websocketserver_client_write_frame_unlocked (struct medusa_websocketserver_client *websocketserver_client, struct medusa_websocketserver_frame *frame);
+int64_t medusa_websocketserver_client_get_pending_unlocked (const struct medusa_websocketserver_client *websocketserver_client);
+
+int medusa_websocketserver_client_set_backpressure_unlocked (struct medusa_websocketserver_client *websocketserver_client, int64_t limit, unsigned int policy);
 
 int medusa_websocketserver_client_get_sockname_unlocked (struct medusa_websocketserver_client *websocketserver_client, struct sockaddr_storage *sockaddr);
 int medusa_websocketserver_client_get_peername_unlocked (struct medusa_websocketserver_client *websocketserver_client, struct sockaddr_storage *sockaddr);
@@ -2,6 +2,22 @@
 #if !defined(MEDUSA_WEBSOCKETSERVER_STRUCT_H)
 #define MEDUSA_WEBSOCKETSERVER_STRUCT_H
 
+struct medusa_websocketserver_frame {
+        int64_t refcount;
+        unsigned int flags;
+        unsigned int final;
+        unsigned int type;
+        int64_t offset;
+        int64_t length;
+        uint8_t data[];
+};
+
+TAILQ_HEAD(medusa_websocketserver_client_frames, medusa_websocketserver_client_frame);
+struct medusa_websocketserver_client_frame {
+        struct medusa_websocketserver_frame *frame;
+        TAILQ_ENTRY(medusa_websocketserver_client_frame) list;
+};
+
 TAILQ_HEAD(medusa_websocketserver_clients, medusa_websocketserver_client);
 struct medusa_websocketserver_client {
         struct medusa_subject subject;
@@ -18,10 +34,37 @@ struct medusa_websocketserver_client {
         char *http_parser_header_value;
         char *sec_websocket_key;
         char *sec_websocket_protocol;
+        char *sec_websocket_extensions;
+        struct {
+                int enabled;
+                int message;
+                int compress_window_bits;
+                int compress_no_context_takeover;
+                int decompress_window_bits;
+                int decompress_no_context_takeover;
+                struct medusa_websocket_deflate *compress;
+                struct medusa_websocket_deflate *decompress;
+                struct medusa_buffer *buffer;
+        } deflate;
         unsigned int frame_state;
         unsigned int frame_mask_offset;
         unsigned int frame_payload_offset;
-        unsigned int frame_payload_length;
+        int64_t frame_payload_length;
+        int64_t frame_payload_consumed;
+        uint8_t frame_opcode;
+        uint8_t frame_mask[4];
+        unsigned int message_mode;
+        int64_t max_message_size;
+        struct {
+                unsigned int type;
+                int64_t length;
+                struct medusa_buffer *buffer;
+        } message;
+        struct medusa_websocketserver_client_frames frames;
+        int64_t frames_offset;
+        int64_t frames_length;
+        int64_t backpressure_limit;
+        unsigned int backpressure_policy;
         struct medusa_websocketserver *websocketserver;
         TAILQ_ENTRY(medusa_websocketserver_client) list;
 };
@@ -41,7 +84,17 @@ struct medusa_websocketserver {
         int reuseport;
         int backlog;
         int buffered;
+        int stats;
+        struct {
+                int enabled;
+                int level;
+                int window_bits;
+                int no_context_takeover;
+                int64_t threshold;
+                struct medusa_buffer *buffer;
+        } deflate;
         struct medusa_tcpsocket *tcpsocket;
+        struct medusa_tcpsocket_stats tcpsocket_stats;
         struct medusa_websocketserver_clients clients;
 };
 
@@ -16,6 +16,8 @@
 #include "pool.h"
 #include "base64.h"
 #include "sha1.h"
+#include "websocket-mask.h"
+#include "websocket-deflate.h"
 #include "queue.h"
 #include "subject-struct.h"
 #include "iovec.h"
@@ -38,8 +40,11 @@
 #if defined(MEDUSA_WEBSOCKETSERVER_USE_POOL) && (MEDUSA_WEBSOCKETSERVER_USE_POOL == 1)
 static struct medusa_pool *g_pool_websocketserver;
 static struct medusa_pool *g_pool_websocketserver_client;
+static struct medusa_pool *g_pool_websocketserver_client_frame;
 #endif
 
+#define MEDUSA_WEBSOCKETSERVER_CLIENT_FRAMES_WINDOW     (64 * 1024)
+
 #define WS_FRAGMENT_FIN                 0x80
 
 #define WS_NONBLOCK                     0x02
@@ -63,6 +68,15 @@ static struct medusa_pool *g_pool_websocketserver_client;
 #define WS_CLOSE_MESSAGE_TOO_BIG        1009
 #define WS_CLOSE_UNEXPECTED_ERROR       1011
 
+enum {
+        MEDUSA_WEBSOCKETSERVER_FRAME_FLAG_NONE          = (1 << 0),
+        MEDUSA_WEBSOCKETSERVER_FRAME_FLAG_DROPPABLE     = (1 << 1),
+        MEDUSA_WEBSOCKETSERVER_FRAME_FLAG_DEFLATED      = (1 << 2)
+#define MEDUSA_WEBSOCKETSERVER_FRAME_FLAG_NONE          MEDUSA_WEBSOCKETSERVER_FRAME_FLAG_NONE
+#define MEDUSA_WEBSOCKETSERVER_FRAME_FLAG_DROPPABLE     MEDUSA_WEBSOCKETSERVER_FRAME_FLAG_DROPPABLE
+#define MEDUSA_WEBSOCKETSERVER_FRAME_FLAG_DEFLATED      MEDUSA_WEBSOCKETSERVER_FRAME_FLAG_DEFLATED
+};
+
 enum {
         MEDUSA_WEBSOCKETSERVER_FLAG_NONE                = (1 << 0),
         MEDUSA_WEBSOCKETSERVER_FLAG_ENABLED             = (1 << 1)
@@ -238,6 +252,11 @@ __attribute__ ((visibility ("default"))) int medusa_websocketserver_init_options
         options->servername = NULL;
         options->reuseport  = 0;
         options->backlog    = 128;
+        options->deflate_enabled             = 0;
+        options->deflate_level               = -1;
+        options->deflate_window_bits         = MEDUSA_WEBSOCKET_DEFLATE_WINDOW_BITS_MAX;
+        options->deflate_no_context_takeover = 0;
+        options->deflate_threshold           = 64;
         return 0;
 }
 
@@ -325,6 +344,24 @@ __attribute__ ((visibility ("default"))) struct medusa_websocketserver * medusa_
         websocketserver->protocol  = options->protocol;
         websocketserver->reuseport = options->reuseport;
         websocketserver->backlog   = options->backlog;
+        websocketserver->stats     = !!options->stats;
+        if (options->deflate_enabled) {
+                if (!medusa_websocket_deflate_supported()) {
+                        error = -ENOTSUP;
+                        goto bail;
+                }
+                if (options->deflate_window_bits != 0 &&
+                    (options->deflate_window_bits < MEDUSA_WEBSOCKET_DEFLATE_WINDOW_BITS_MIN ||
+                     options->deflate_window_bits > MEDUSA_WEBSOCKET_DEFLATE_WINDOW_BITS_MAX)) {
+                        error = -EINVAL;
+                        goto bail;
+                }
+                websocketserver->deflate.enabled             = 1;
+                websocketserver->deflate.level               = options->deflate_level;
+                websocketserver->deflate.window_bits         = (options->deflate_window_bits != 0) ? options->deflate_window_bits : MEDUSA_WEBSOCKET_DEFLATE_WINDOW_BITS_MAX;
+                websocketserver->deflate.no_context_takeover = options->deflate_no_context_takeover;
+                websocketserver->deflate.threshold           = options->deflate_threshold;
+        }
         if (options->enabled != 0) {
                 rc = medusa_websocketserver_set_enabled_unlocked(websocketserver, options->enabled);
                 if (rc < 0) {
@@ -490,6 +527,46 @@ __attribute__ ((visibility ("default"))) int medusa_websocketserver_get_sockname
         return rc;
 }
 
+__attribute__ ((visibility ("default"))) int medusa_websocketserver_get_stats_unlocked (const struct medusa_websocketserver *websocketserver, struct medusa_tcpsocket_stats *stats)
+{
+        int rc;
+        struct medusa_tcpsocket_stats client;
+        struct medusa_websocketserver_client *websocketserver_client;
+        if (MEDUSA_IS_ERR_OR_NULL(websocketserver)) {
+                return -EINVAL;
+        }
+        if (stats == NULL) {
+                return -EINVAL;
+        }
+        /* closed clients are folded in when their socket goes away */
+        *stats = websocketserver->tcpsocket_stats;
+        stats->rtt    = -1;
+        stats->rttvar = -1;
+        TAILQ_FOREACH(websocketserver_client, &websocketserver->clients, list) {
+                if (MEDUSA_IS_ERR_OR_NULL(websocketserver_client->tcpsocket)) {
+                        continue;
+                }
+                rc = medusa_tcpsocket_get_stats_unlocked(websocketserver_client->tcpsocket, &client);
+                if (rc < 0) {
+                        return rc;
+                }
+                medusa_tcpsocket_stats_merge(stats, &client);
+        }
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_websocketserver_get_stats (const struct medusa_websocketserver *websocketserver, struct medusa_tcpsocket_stats *stats)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(websocketserver)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(websocketserver->subject.monitor);
+        rc = medusa_websocketserver_get_stats_unlocked(websocketserver, stats);
+        medusa_monitor_unlock(websocketserver->subject.monitor);
+        return rc;
+}
+
 __attribute__ ((visibility ("default"))) int medusa_websocketserver_set_enabled_unlocked (struct medusa_websocketserver *websocketserver, int enabled)
 {
         int rc;
@@ -598,6 +675,7 @@ __attribute__ ((visibility ("default"))) int medusa_websocketserver_set_started_
                 medusa_tcpsocket_bind_options.reuseaddr   = 1;
                 medusa_tcpsocket_bind_options.reuseport   = websocketserver->reuseport;
                 medusa_tcpsocket_bind_options.backlog     = websocketserver->backlog;
+                medusa_tcpsocket_bind_options.stats       = websocketserver->stats;
                 medusa_tcpsocket_bind_options.enabled     = 1;
                 medusa_tcpsocket_bind_options.monitor     = websocketserver->subject.monitor;
                 medusa_tcpsocket_bind_options.context     = websocketserver;
@@ -850,6 +928,10 @@ __attribute__ ((visibility ("default"))) int medusa_websocketserver_onevent_unlo
                 if (websocketserver->servername != NULL) {
                         free(websocketserver->servername);
                 }
+                if (!MEDUSA_IS_ERR_OR_NULL(websocketserver->deflate.buffer)) {
+                        medusa_buffer_destroy(websocketserver->deflate.buffer);
+                        websocketserver->deflate.buffer = NULL;
+                }
                 if (!MEDUSA_IS_ERR_OR_NULL(websocketserver->tcpsocket)) {
                         medusa_tcpsocket_destroy_unlocked(websocketserver->tcpsocket);
                         websocketserver->tcpsocket = NULL;
@@ -931,11 +1013,13 @@ enum {
         MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_STATE_START         = 0,
         MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_STATE_HEADER        = 1,
         MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_STATE_PAYLOAD       = 2,
-        MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_STATE_FINISH        = 3
+        MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_STATE_FINISH        = 3,
+        MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_STATE_STREAM        = 4
 #define MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_STATE_START         MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_STATE_START
 #define MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_STATE_HEADER        MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_STATE_HEADER
 #define MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_STATE_PAYLOAD       MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_STATE_PAYLOAD
 #define MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_STATE_FINISH        MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_STATE_FINISH
+#define MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_STATE_STREAM        MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_STATE_STREAM
 };
 
 static inline void websocketserver_client_set_flag (struct medusa_websocketserver_client *websocketserver_client, unsigned int flag)
@@ -958,6 +1042,21 @@ static inline int websocketserver_client_has_flag (const struct medusa_websocket
         return !!(websocketserver_client->flags & flag);
 }
 
+static void websocketserver_client_destroy_tcpsocket (struct medusa_websocketserver_client *websocketserver_client)
+{
+        struct medusa_tcpsocket_stats stats;
+        if (MEDUSA_IS_ERR_OR_NULL(websocketserver_client->tcpsocket)) {
+                return;
+        }
+        /* keep the server totals once the client is gone */
+        if (websocketserver_client->websocketserver != NULL &&
+            medusa_tcpsocket_get_stats_unlocked(websocketserver_client->tcpsocket, &stats) == 0) {
+                medusa_tcpsocket_stats_merge(&websocketserver_client->websocketserver->tcpsocket_stats, &stats);
+        }
+        medusa_tcpsocket_destroy_unlocked(websocketserver_client->tcpsocket);
+        websocketserver_client->tcpsocket = NULL;
+}
+
 static inline int websocketserver_client_set_state (struct medusa_websocketserver_client *websocketserver_client, unsigned int state)
 {
         int rc;
@@ -965,16 +1064,10 @@ static inline int websocketserver_client_set_state (struct medusa_websocketserve
         struct medusa_websocketserver_client_event_state_changed medusa_websocketserver_client_event_state_changed;
         websocketserver_client->error = 0;
         if (state == MEDUSA_WEBSOCKETSERVER_CLIENT_STATE_ERROR) {
-                if (!MEDUSA_IS_ERR_OR_NULL(websocketserver_client->tcpsocket)) {
-                        medusa_tcpsocket_destroy_unlocked(websocketserver_client->tcpsocket);
-                        websocketserver_client->tcpsocket = NULL;
-                }
+                websocketserver_client_destroy_tcpsocket(websocketserver_client);
         }
         if (state == MEDUSA_WEBSOCKETSERVER_CLIENT_STATE_DISCONNECTED) {
-                if (!MEDUSA_IS_ERR_OR_NULL(websocketserver_client->tcpsocket)) {
-                        medusa_tcpsocket_destroy_unlocked(websocketserver_client->tcpsocket);
-                        websocketserver_client->tcpsocket = NULL;
-                }
+                websocketserver_client_destroy_tcpsocket(websocketserver_client);
         }
         pstate = websocketserver_client->state;
         websocketserver_client->state = state;
@@ -987,208 +1080,787 @@ static inline int websocketserver_client_set_state (struct medusa_websocketserve
         return 0;
 }
 
-static int websocketserver_client_httpparser_on_message_begin (http_parser *http_parser)
-{
-        struct medusa_websocketserver_client *websocketserver_client = http_parser->data;
-        (void) websocketserver_client;
-        return 0;
+static unsigned int websocketserver_frame_header (uint8_t *header, unsigned int final, unsigned int type, unsigned int deflated, int64_t length)
+{
+        unsigned int i;
+        unsigned int size;
+        header[0]  = 0;
+        header[0] |= (final) ? 0x80 : 0x00;
+        header[0] |= (deflated) ? 0x40 : 0x00;
+        header[0] |= (type == MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_CONTINUATION) ? 0x00 :
+                     (type == MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_CLOSE)        ? 0x08 :
+                     (type == MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_PING)         ? 0x09 :
+                     (type == MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_PONG)         ? 0x0a :
+                     (type == MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_TEXT)         ? 0x01 :
+                     (type == MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_BINARY)       ? 0x02 :
+                     0x00;
+        if (length <= 125) {
+                header[1] = length;
+                size = 2;
+        } else if (length <= 0xffff) {
+                header[1] = 126;
+                header[2] = (length >> 8) & 0xff;
+                header[3] = (length >> 0) & 0xff;
+                size = 4;
+        } else {
+                header[1] = 127;
+                for (i = 0; i < 8; i++) {
+                        header[2 + i] = (((uint64_t) length) >> (56 - i * 8)) & 0xff;
+                }
+                size = 10;
+        }
+        return size;
 }
 
-static int websocketserver_client_httpparser_on_url (http_parser *http_parser, const char *at, size_t length)
+/* control frames carry at most 125 bytes and are never fragmented */
+static int websocketserver_frame_check (unsigned int final, unsigned int type, int64_t length)
 {
-        struct medusa_websocketserver_client *websocketserver_client = http_parser->data;
-        (void) websocketserver_client;
-        (void) at;
-        (void) length;
-        return 0;
+        if (length < 0) {
+                return -EINVAL;
+        }
+        switch (type) {
+                case MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_CONTINUATION:
+                case MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_TEXT:
+                case MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_BINARY:
+                        return 0;
+                case MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_CLOSE:
+                case MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_PING:
+                case MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_PONG:
+                        if (!final || length > 125) {
+                                return -EINVAL;
+                        }
+                        return 0;
+        }
+        return -EINVAL;
 }
 
-static int websocketserver_client_httpparser_on_status (http_parser *http_parser, const char *at, size_t length)
+static struct medusa_websocketserver_frame * websocketserver_frame_create (unsigned int final, unsigned int type, unsigned int deflated, const void *data, int64_t length)
 {
-        struct medusa_websocketserver_client *websocketserver_client = http_parser->data;
-        (void) websocketserver_client;
-        (void) at;
-        (void) length;
-        return 0;
+        int rc;
+        unsigned int size;
+        uint8_t header[10];
+        struct medusa_websocketserver_frame *frame;
+        rc = websocketserver_frame_check(final, type, length);
+        if (rc < 0) {
+                return MEDUSA_ERR_PTR(rc);
+        }
+        if (data == NULL && length > 0) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        size = websocketserver_frame_header(header, final, type, deflated, length);
+        frame = malloc(sizeof(struct medusa_websocketserver_frame) + size + length);
+        if (frame == NULL) {
+                return MEDUSA_ERR_PTR(-ENOMEM);
+        }
+        frame->refcount = 1;
+        frame->flags    = MEDUSA_WEBSOCKETSERVER_FRAME_FLAG_NONE;
+        frame->final    = !!final;
+        frame->type     = type;
+        frame->offset   = size;
+        frame->length   = size + length;
+        if (final &&
+            (type == MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_TEXT ||
+             type == MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_BINARY)) {
+                frame->flags |= MEDUSA_WEBSOCKETSERVER_FRAME_FLAG_DROPPABLE;
+        }
+        if (deflated) {
+                frame->flags |= MEDUSA_WEBSOCKETSERVER_FRAME_FLAG_DEFLATED;
+        }
+        memcpy(frame->data, header, size);
+        if (length > 0) {
+                memcpy(frame->data + size, data, length);
+        }
+        return frame;
 }
 
-static int websocketserver_client_httpparser_on_header_field (http_parser *http_parser, const char *at, size_t length)
+static struct medusa_websocketserver_frame * websocketserver_frame_deflate (struct medusa_websocketserver_frame *frame, struct medusa_websocket_deflate *deflate, struct medusa_buffer *buffer)
 {
         int rc;
-        struct medusa_websocketserver_client_event_request_header websocketserver_client_event_request_header;
-        struct medusa_websocketserver_client *websocketserver_client = http_parser->data;
-
-        if (websocketserver_client->http_parser_header_field != NULL &&
-            websocketserver_client->http_parser_header_value != NULL) {
-                websocketserver_client_event_request_header.field = websocketserver_client->http_parser_header_field;
-                websocketserver_client_event_request_header.value = websocketserver_client->http_parser_header_value;
-                rc = medusa_websocketserver_client_onevent_unlocked(websocketserver_client, MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_REQUEST_HEADER, &websocketserver_client_event_request_header);
-                if (rc < 0) {
-                        return rc;
-                }
-                if (strcasecmp(websocketserver_client->http_parser_header_field, "Sec-WebSocket-Key") == 0) {
-                        if (websocketserver_client->sec_websocket_key != NULL) {
-                                free(websocketserver_client->sec_websocket_key);
-                        }
-                        websocketserver_client->sec_websocket_key = strdup(websocketserver_client->http_parser_header_value);
-                        if (websocketserver_client->sec_websocket_key == NULL) {
-                                return -ENOMEM;
-                        }
-                }
-                if (strcasecmp(websocketserver_client->http_parser_header_field, "Sec-WebSocket-Protocol") == 0) {
-                        if (websocketserver_client->sec_websocket_protocol != NULL) {
-                                free(websocketserver_client->sec_websocket_protocol);
-                        }
-                        websocketserver_client->sec_websocket_protocol = strdup(websocketserver_client->http_parser_header_value);
-                        if (websocketserver_client->sec_websocket_protocol == NULL) {
-                                return -ENOMEM;
-                        }
-                }
-                if (websocketserver_client->http_parser_header_field != NULL) {
-                        free(websocketserver_client->http_parser_header_field);
-                        websocketserver_client->http_parser_header_field = NULL;
-                }
+        int64_t length;
+        void *payload;
+        rc = medusa_buffer_reset(buffer);
+        if (rc < 0) {
+                return MEDUSA_ERR_PTR(rc);
         }
-
-        if (websocketserver_client->http_parser_header_value != NULL) {
-                free(websocketserver_client->http_parser_header_value);
-                websocketserver_client->http_parser_header_value = NULL;
+        length = medusa_websocket_deflate_compress(deflate, frame->data + frame->offset, frame->length - frame->offset, buffer);
+        if (length < 0) {
+                return MEDUSA_ERR_PTR(length);
         }
-
-        if (websocketserver_client->http_parser_header_field != NULL) {
-                char *tmp = realloc(websocketserver_client->http_parser_header_field, strlen(websocketserver_client->http_parser_header_field) + length + 1);
-                if (tmp == NULL) {
-                        return -ENOMEM;
-                }
-                websocketserver_client->http_parser_header_field = tmp;
-                strncat(websocketserver_client->http_parser_header_field, at, length);
-        } else {
-                websocketserver_client->http_parser_header_field = medusa_strndup(at, length);
-                if (websocketserver_client->http_parser_header_field == NULL) {
-                        return -ENOMEM;
+        payload = NULL;
+        if (length > 0) {
+                payload = medusa_buffer_linearize(buffer, 0, length);
+                if (MEDUSA_IS_ERR_OR_NULL(payload)) {
+                        return MEDUSA_ERR_PTR(-EIO);
                 }
         }
-
-        return 0;
+        return websocketserver_frame_create(frame->final, frame->type, 1, payload, length);
 }
 
-static int websocketserver_client_httpparser_on_header_value (http_parser *http_parser, const char *at, size_t length)
+static struct medusa_buffer * websocketserver_deflate_buffer (struct medusa_websocketserver *websocketserver)
 {
-        struct medusa_websocketserver_client *websocketserver_client = http_parser->data;
-
-        if (websocketserver_client->http_parser_header_value != NULL) {
-                char *tmp = realloc(websocketserver_client->http_parser_header_value, strlen(websocketserver_client->http_parser_header_value) + length + 1);
-                if (tmp == NULL) {
-                        return -ENOMEM;
-                }
-                websocketserver_client->http_parser_header_value = tmp;
-                strncat(websocketserver_client->http_parser_header_value, at, length);
-        } else {
-                websocketserver_client->http_parser_header_value = medusa_strndup(at, length);
-                if (websocketserver_client->http_parser_header_value == NULL) {
-                        return -ENOMEM;
+        if (websocketserver->deflate.buffer == NULL) {
+                websocketserver->deflate.buffer = medusa_buffer_create(MEDUSA_BUFFER_TYPE_SIMPLE);
+                if (MEDUSA_IS_ERR_OR_NULL(websocketserver->deflate.buffer)) {
+                        struct medusa_buffer *buffer = websocketserver->deflate.buffer;
+                        websocketserver->deflate.buffer = NULL;
+                        return buffer;
                 }
         }
+        return websocketserver->deflate.buffer;
+}
 
-        return 0;
+static int websocketserver_client_deflate_usable (struct medusa_websocketserver_client *websocketserver_client, unsigned int final, unsigned int type, int64_t length)
+{
+        if (!websocketserver_client->deflate.enabled) {
+                return 0;
+        }
+        if (websocketserver_client->websocketserver == NULL) {
+                return 0;
+        }
+        if (!final) {
+                return 0;
+        }
+        if (type != MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_TEXT &&
+            type != MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_BINARY) {
+                return 0;
+        }
+        if (length < websocketserver_client->websocketserver->deflate.threshold) {
+                return 0;
+        }
+        return 1;
 }
 
-static int websocketserver_client_httpparser_on_headers_complete (http_parser *http_parser)
+static int websocketserver_client_deflate_frame_usable (struct medusa_websocketserver_client *websocketserver_client, struct medusa_websocketserver_frame *frame)
 {
-        int rc;
-        struct medusa_websocketserver_client_event_request_header websocketserver_client_event_request_header;
-        struct medusa_websocketserver_client *websocketserver_client = http_parser->data;
-        if (websocketserver_client->http_parser_header_field != NULL &&
-            websocketserver_client->http_parser_header_value != NULL) {
-                websocketserver_client_event_request_header.field = websocketserver_client->http_parser_header_field;
-                websocketserver_client_event_request_header.value = websocketserver_client->http_parser_header_value;
-                rc = medusa_websocketserver_client_onevent_unlocked(websocketserver_client, MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_REQUEST_HEADER, &websocketserver_client_event_request_header);
-                if (rc < 0) {
-                        return rc;
-                }
-                if (strcasecmp(websocketserver_client->http_parser_header_field, "Sec-WebSocket-Key") == 0) {
-                        if (websocketserver_client->sec_websocket_key != NULL) {
-                                free(websocketserver_client->sec_websocket_key);
-                        }
-                        websocketserver_client->sec_websocket_key = strdup(websocketserver_client->http_parser_header_value);
-                        if (websocketserver_client->sec_websocket_key == NULL) {
-                                return -ENOMEM;
-                        }
-                }
-                if (strcasecmp(websocketserver_client->http_parser_header_field, "Sec-WebSocket-Protocol") == 0) {
-                        if (websocketserver_client->sec_websocket_protocol != NULL) {
-                                free(websocketserver_client->sec_websocket_protocol);
-                        }
-                        websocketserver_client->sec_websocket_protocol = strdup(websocketserver_client->http_parser_header_value);
-                        if (websocketserver_client->sec_websocket_protocol == NULL) {
-                                return -ENOMEM;
-                        }
+        if (frame->flags & MEDUSA_WEBSOCKETSERVER_FRAME_FLAG_DEFLATED) {
+                return 0;
+        }
+        return websocketserver_client_deflate_usable(websocketserver_client, frame->final, frame->type, frame->length - frame->offset);
+}
+
+static struct medusa_websocketserver_frame * websocketserver_client_deflate_frame (struct medusa_websocketserver_client *websocketserver_client, struct medusa_websocketserver_frame *frame)
+{
+        struct medusa_buffer *buffer;
+        struct medusa_websocket_deflate *deflate;
+        struct medusa_websocketserver_frame *deflated;
+        buffer = websocketserver_deflate_buffer(websocketserver_client->websocketserver);
+        if (MEDUSA_IS_ERR_OR_NULL(buffer)) {
+                return MEDUSA_ERR_PTR(-ENOMEM);
+        }
+        deflate = websocketserver_client->deflate.compress;
+        if (deflate == NULL) {
+                deflate = medusa_websocket_deflate_acquire(MEDUSA_WEBSOCKET_DEFLATE_TYPE_COMPRESS, websocketserver_client->deflate.compress_window_bits, websocketserver_client->websocketserver->deflate.level);
+                if (MEDUSA_IS_ERR_OR_NULL(deflate)) {
+                        return MEDUSA_ERR_PTR(MEDUSA_PTR_ERR(deflate));
                 }
         }
-        if (websocketserver_client->http_parser_header_field != NULL) {
-                free(websocketserver_client->http_parser_header_field);
-                websocketserver_client->http_parser_header_field = NULL;
+        deflated = websocketserver_frame_deflate(frame, deflate, buffer);
+        if (deflate != websocketserver_client->deflate.compress) {
+                medusa_websocket_deflate_release(deflate);
         }
-        if (websocketserver_client->http_parser_header_value != NULL) {
-                free(websocketserver_client->http_parser_header_value);
-                websocketserver_client->http_parser_header_value = NULL;
+        if (MEDUSA_IS_ERR_OR_NULL(deflated)) {
+                return deflated;
         }
-        return 0;
+        /* frames compressed with the connection context can not be dropped,
+         * the peer would lose track of the sliding window */
+        if (websocketserver_client->deflate.compress != NULL ||
+            !(frame->flags & MEDUSA_WEBSOCKETSERVER_FRAME_FLAG_DROPPABLE)) {
+                deflated->flags &= ~MEDUSA_WEBSOCKETSERVER_FRAME_FLAG_DROPPABLE;
+        }
+        return deflated;
 }
 
-static int websocketserver_client_httpparser_on_body (http_parser *http_parser, const char *at, size_t length)
+static int websocketserver_client_add_extensions (struct medusa_websocketserver_client *websocketserver_client, const char *value)
 {
-        struct medusa_websocketserver_client *websocketserver_client = http_parser->data;
-        (void) websocketserver_client;
-        (void) at;
-        (void) length;
+        char *tmp;
+        if (websocketserver_client->sec_websocket_extensions == NULL) {
+                websocketserver_client->sec_websocket_extensions = strdup(value);
+                if (websocketserver_client->sec_websocket_extensions == NULL) {
+                        return -ENOMEM;
+                }
+                return 0;
+        }
+        tmp = realloc(websocketserver_client->sec_websocket_extensions, strlen(websocketserver_client->sec_websocket_extensions) + strlen(", ") + strlen(value) + 1);
+        if (tmp == NULL) {
+                return -ENOMEM;
+        }
+        websocketserver_client->sec_websocket_extensions = tmp;
+        strcat(websocketserver_client->sec_websocket_extensions, ", ");
+        strcat(websocketserver_client->sec_websocket_extensions, value);
         return 0;
 }
 
-static int websocketserver_client_httpparser_on_message_complete (http_parser *http_parser)
+static int websocketserver_client_deflate_negotiate (struct medusa_websocketserver_client *websocketserver_client, char *extensions, int length)
 {
         int rc;
-        struct medusa_websocketserver_client *websocketserver_client = http_parser->data;
-        (void) websocketserver_client;
-        rc = websocketserver_client_set_state(websocketserver_client, MEDUSA_WEBSOCKETSERVER_CLIENT_STATE_REQUEST_RECEIVED);
-        if (rc < 0) {
+        int window_bits;
+        struct medusa_websocket_deflate_params offer;
+        struct medusa_websocket_deflate_params response;
+        struct medusa_websocketserver *websocketserver = websocketserver_client->websocketserver;
+
+        extensions[0] = '\0';
+        if (!websocketserver->deflate.enabled) {
+                return 0;
+        }
+        if (websocketserver_client->sec_websocket_extensions == NULL) {
+                return 0;
+        }
+        rc = medusa_websocket_deflate_params_parse(&offer, websocketserver_client->sec_websocket_extensions);
+        if (rc <= 0) {
                 return rc;
         }
-        rc = medusa_websocketserver_client_onevent_unlocked(websocketserver_client, MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_REQUEST_RECEIVED, NULL);
+
+        window_bits = websocketserver->deflate.window_bits;
+        if (offer.server_max_window_bits > 0 && offer.server_max_window_bits < window_bits) {
+                window_bits = offer.server_max_window_bits;
+        }
+        if (window_bits < MEDUSA_WEBSOCKET_DEFLATE_WINDOW_BITS_MIN) {
+                return 0;
+        }
+
+        memset(&response, 0, sizeof(struct medusa_websocket_deflate_params));
+        response.server_no_context_takeover = offer.server_no_context_takeover || websocketserver->deflate.no_context_takeover;
+        response.client_no_context_takeover = offer.client_no_context_takeover;
+        response.server_max_window_bits     = (offer.server_max_window_bits > 0 || window_bits < MEDUSA_WEBSOCKET_DEFLATE_WINDOW_BITS_MAX) ? window_bits : 0;
+        response.client_max_window_bits     = (offer.client_max_window_bits > 0) ? offer.client_max_window_bits : 0;
+        rc = medusa_websocket_deflate_params_format(&response, extensions, length);
         if (rc < 0) {
                 return rc;
         }
-        return 0;
+
+        websocketserver_client->deflate.compress_window_bits           = window_bits;
+        websocketserver_client->deflate.compress_no_context_takeover   = response.server_no_context_takeover;
+        websocketserver_client->deflate.decompress_window_bits         = (response.client_max_window_bits > 0) ? response.client_max_window_bits : MEDUSA_WEBSOCKET_DEFLATE_WINDOW_BITS_MAX;
+        websocketserver_client->deflate.decompress_no_context_takeover = response.client_no_context_takeover;
+        if (!websocketserver_client->deflate.compress_no_context_takeover) {
+                websocketserver_client->deflate.compress = medusa_websocket_deflate_acquire(MEDUSA_WEBSOCKET_DEFLATE_TYPE_COMPRESS, window_bits, websocketserver->deflate.level);
+                if (MEDUSA_IS_ERR_OR_NULL(websocketserver_client->deflate.compress)) {
+                        rc = MEDUSA_PTR_ERR(websocketserver_client->deflate.compress);
+                        websocketserver_client->deflate.compress = NULL;
+                        return rc;
+                }
+        }
+        websocketserver_client->deflate.enabled = 1;
+        return 1;
 }
 
-static int websocketserver_client_httpparser_on_chunk_header (http_parser *http_parser)
+static void websocketserver_client_deflate_uninit (struct medusa_websocketserver_client *websocketserver_client)
 {
-        struct medusa_websocketserver_client *websocketserver_client = http_parser->data;
-        (void) websocketserver_client;
-        return 0;
+        if (websocketserver_client->deflate.compress != NULL) {
+                medusa_websocket_deflate_release(websocketserver_client->deflate.compress);
+                websocketserver_client->deflate.compress = NULL;
+        }
+        if (websocketserver_client->deflate.decompress != NULL) {
+                medusa_websocket_deflate_release(websocketserver_client->deflate.decompress);
+                websocketserver_client->deflate.decompress = NULL;
+        }
+        if (!MEDUSA_IS_ERR_OR_NULL(websocketserver_client->deflate.buffer)) {
+                medusa_buffer_destroy(websocketserver_client->deflate.buffer);
+                websocketserver_client->deflate.buffer = NULL;
+        }
+        websocketserver_client->deflate.enabled = 0;
 }
 
-static int websocketserver_client_httpparser_on_chunk_complete (http_parser *http_parser)
+static unsigned int websocketserver_client_frame_type (uint8_t opcode)
 {
-        struct medusa_websocketserver_client *websocketserver_client = http_parser->data;
-        (void) websocketserver_client;
-        return 0;
+        return (opcode == WS_OPCODE_CLOSE) ? MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_CLOSE :
+               (opcode == WS_OPCODE_PING) ? MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_PING :
+               (opcode == WS_OPCODE_PONG) ? MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_PONG :
+               (opcode == WS_OPCODE_TEXT) ? MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_TEXT :
+               (opcode == WS_OPCODE_BINARY) ? MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_BINARY :
+               MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_CONTINUATION;
 }
 
-static int websocketserver_client_tcpsocket_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
+static int websocketserver_client_message_begin (struct medusa_websocketserver_client *websocketserver_client, uint8_t uint8)
 {
         int rc;
-        int error;
-        struct medusa_monitor *monitor;
-        struct medusa_websocketserver_client *websocketserver_client = (struct medusa_websocketserver_client *) context;
+        uint8_t opcode;
 
-        if (events & MEDUSA_TCPSOCKET_EVENT_DESTROY) {
-                return 0;
+        opcode = uint8 & 0x0f;
+        if (opcode & 0x08) {
+                /* control frames are never compressed */
+                return (uint8 & 0x40) ? -EIO : 0;
+        }
+        if (opcode != WS_OPCODE_CONTINUE) {
+                if ((uint8 & 0x40) && !websocketserver_client->deflate.enabled) {
+                        return -EIO;
+                }
+                websocketserver_client->deflate.message = !!(uint8 & 0x40);
+                websocketserver_client->message.type    = websocketserver_client_frame_type(opcode);
+                websocketserver_client->message.length  = 0;
+                if (websocketserver_client->message.buffer != NULL) {
+                        rc = medusa_buffer_reset(websocketserver_client->message.buffer);
+                        if (rc < 0) {
+                                return rc;
+                        }
+                }
+        } else if (uint8 & 0x40) {
+                return -EIO;
+        }
+        return 0;
+}
+
+static int websocketserver_client_inflate_payload (struct medusa_websocketserver_client *websocketserver_client, uint8_t uint8, int final, uint8_t **payload, int64_t *length)
+{
+        int64_t rc;
+        void *data;
+
+        if (uint8 & 0x08) {
+                return 0;
+        }
+        if (!websocketserver_client->deflate.message) {
+                return 0;
+        }
+
+        if (websocketserver_client->deflate.buffer == NULL) {
+                websocketserver_client->deflate.buffer = medusa_buffer_create(MEDUSA_BUFFER_TYPE_SIMPLE);
+                if (MEDUSA_IS_ERR_OR_NULL(websocketserver_client->deflate.buffer)) {
+                        websocketserver_client->deflate.buffer = NULL;
+                        return -ENOMEM;
+                }
+        }
+        rc = medusa_buffer_reset(websocketserver_client->deflate.buffer);
+        if (rc < 0) {
+                return rc;
+        }
+        if (websocketserver_client->deflate.decompress == NULL) {
+                websocketserver_client->deflate.decompress = medusa_websocket_deflate_acquire(MEDUSA_WEBSOCKET_DEFLATE_TYPE_DECOMPRESS, websocketserver_client->deflate.decompress_window_bits, 0);
+                if (MEDUSA_IS_ERR_OR_NULL(websocketserver_client->deflate.decompress)) {
+                        rc = MEDUSA_PTR_ERR(websocketserver_client->deflate.decompress);
+                        websocketserver_client->deflate.decompress = NULL;
+                        return rc;
+                }
+        }
+        rc = medusa_websocket_deflate_decompress(websocketserver_client->deflate.decompress, *payload, *length, final, websocketserver_client->deflate.buffer);
+        if (rc < 0) {
+                return rc;
+        }
+        if (final) {
+                websocketserver_client->deflate.message = 0;
+                if (websocketserver_client->deflate.decompress_no_context_takeover) {
+                        medusa_websocket_deflate_release(websocketserver_client->deflate.decompress);
+                        websocketserver_client->deflate.decompress = NULL;
+                }
+        }
+        if (rc > 0) {
+                data = medusa_buffer_linearize(websocketserver_client->deflate.buffer, 0, rc);
+                if (MEDUSA_IS_ERR_OR_NULL(data)) {
+                        return -EIO;
+                }
+                *payload = data;
+        }
+        *length = rc;
+        return 1;
+}
+
+static void websocketserver_client_frame_free (struct medusa_websocketserver_client_frame *websocketserver_client_frame)
+{
+        medusa_websocketserver_frame_unref(websocketserver_client_frame->frame);
+#if defined(MEDUSA_WEBSOCKETSERVER_USE_POOL) && (MEDUSA_WEBSOCKETSERVER_USE_POOL == 1)
+        medusa_pool_free(websocketserver_client_frame);
+#else
+        free(websocketserver_client_frame);
+#endif
+}
+
+static int websocketserver_client_frames_push (struct medusa_websocketserver_client *websocketserver_client, struct medusa_websocketserver_frame *frame)
+{
+        struct medusa_websocketserver_client_frame *websocketserver_client_frame;
+#if defined(MEDUSA_WEBSOCKETSERVER_USE_POOL) && (MEDUSA_WEBSOCKETSERVER_USE_POOL == 1)
+        websocketserver_client_frame = medusa_pool_malloc(g_pool_websocketserver_client_frame);
+#else
+        websocketserver_client_frame = malloc(sizeof(struct medusa_websocketserver_client_frame));
+#endif
+        if (websocketserver_client_frame == NULL) {
+                return -ENOMEM;
+        }
+        websocketserver_client_frame->frame = medusa_websocketserver_frame_ref(frame);
+        TAILQ_INSERT_TAIL(&websocketserver_client->frames, websocketserver_client_frame, list);
+        websocketserver_client->frames_length += frame->length;
+        return 0;
+}
+
+static void websocketserver_client_frames_drop (struct medusa_websocketserver_client *websocketserver_client, unsigned int *count, int64_t *length)
+{
+        struct medusa_websocketserver_client_frame *websocketserver_client_frame;
+        struct medusa_websocketserver_client_frame *nwebsocketserver_client_frame;
+        TAILQ_FOREACH_SAFE(websocketserver_client_frame, &websocketserver_client->frames, list, nwebsocketserver_client_frame) {
+                if (websocketserver_client_frame == TAILQ_FIRST(&websocketserver_client->frames) &&
+                    websocketserver_client->frames_offset > 0) {
+                        continue;
+                }
+                if (!(websocketserver_client_frame->frame->flags & MEDUSA_WEBSOCKETSERVER_FRAME_FLAG_DROPPABLE)) {
+                        continue;
+                }
+                TAILQ_REMOVE(&websocketserver_client->frames, websocketserver_client_frame, list);
+                websocketserver_client->frames_length -= websocketserver_client_frame->frame->length;
+                *count  += 1;
+                *length += websocketserver_client_frame->frame->length;
+                websocketserver_client_frame_free(websocketserver_client_frame);
+        }
+}
+
+static void websocketserver_client_frames_clear (struct medusa_websocketserver_client *websocketserver_client)
+{
+        struct medusa_websocketserver_client_frame *websocketserver_client_frame;
+        while ((websocketserver_client_frame = TAILQ_FIRST(&websocketserver_client->frames)) != NULL) {
+                TAILQ_REMOVE(&websocketserver_client->frames, websocketserver_client_frame, list);
+                websocketserver_client_frame_free(websocketserver_client_frame);
+        }
+        websocketserver_client->frames_offset = 0;
+        websocketserver_client->frames_length = 0;
+}
+
+static int websocketserver_client_frames_flush (struct medusa_websocketserver_client *websocketserver_client)
+{
+        int64_t rc;
+        int64_t length;
+        int64_t blength;
+        struct medusa_buffer *wbuffer;
+        struct medusa_websocketserver_client_frame *websocketserver_client_frame;
+        if (TAILQ_EMPTY(&websocketserver_client->frames)) {
+                return 0;
+        }
+        wbuffer = medusa_tcpsocket_get_write_buffer_unlocked(websocketserver_client->tcpsocket);
+        if (MEDUSA_IS_ERR_OR_NULL(wbuffer)) {
+                return -EIO;
+        }
+        /* queued frames are shared between clients, copy only a window of
+         * them into the socket buffer and refill as it drains */
+        while ((websocketserver_client_frame = TAILQ_FIRST(&websocketserver_client->frames)) != NULL) {
+                blength = medusa_buffer_get_length(wbuffer);
+                if (blength < 0) {
+                        return blength;
+                }
+                if (blength >= MEDUSA_WEBSOCKETSERVER_CLIENT_FRAMES_WINDOW) {
+                        break;
+                }
+                length = websocketserver_client_frame->frame->length - websocketserver_client->frames_offset;
+                if (length > MEDUSA_WEBSOCKETSERVER_CLIENT_FRAMES_WINDOW - blength) {
+                        length = MEDUSA_WEBSOCKETSERVER_CLIENT_FRAMES_WINDOW - blength;
+                }
+                rc = medusa_buffer_append(wbuffer, websocketserver_client_frame->frame->data + websocketserver_client->frames_offset, length);
+                if (rc < 0) {
+                        return rc;
+                }
+                websocketserver_client->frames_offset += length;
+                websocketserver_client->frames_length -= length;
+                if (websocketserver_client->frames_offset == websocketserver_client_frame->frame->length) {
+                        TAILQ_REMOVE(&websocketserver_client->frames, websocketserver_client_frame, list);
+                        websocketserver_client->frames_offset = 0;
+                        websocketserver_client_frame_free(websocketserver_client_frame);
+                }
+        }
+        return 0;
+}
+
+static int64_t websocketserver_client_write_frame (struct medusa_websocketserver_client *websocketserver_client, struct medusa_websocketserver_frame *frame, struct medusa_websocketserver_frame *deflated)
+{
+        int rc;
+        int error;
+        int64_t length;
+        int64_t pending;
+        struct medusa_buffer *wbuffer;
+        struct medusa_websocketserver_client_event_frames_dropped medusa_websocketserver_client_event_frames_dropped;
+
+        wbuffer = medusa_tcpsocket_get_write_buffer_unlocked(websocketserver_client->tcpsocket);
+        if (MEDUSA_IS_ERR_OR_NULL(wbuffer)) {
+                return -EIO;
+        }
+        pending = medusa_websocketserver_client_get_pending_unlocked(websocketserver_client);
+        if (pending < 0) {
+                error = pending;
+                goto bail;
+        }
+
+        if (websocketserver_client->backpressure_limit > 0 &&
+            pending + frame->length > websocketserver_client->backpressure_limit &&
+            (frame->flags & MEDUSA_WEBSOCKETSERVER_FRAME_FLAG_DROPPABLE)) {
+                medusa_websocketserver_client_event_frames_dropped.count  = 0;
+                medusa_websocketserver_client_event_frames_dropped.length = 0;
+                if (websocketserver_client->backpressure_policy == MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_SKIP) {
+                        medusa_websocketserver_client_event_frames_dropped.count  = 1;
+                        medusa_websocketserver_client_event_frames_dropped.length = frame->length;
+                        rc = medusa_websocketserver_client_onevent_unlocked(websocketserver_client, MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_FRAMES_DROPPED, &medusa_websocketserver_client_event_frames_dropped);
+                        if (rc < 0) {
+                                error = rc;
+                                goto bail;
+                        }
+                        return 0;
+                } else if (websocketserver_client->backpressure_policy == MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_DROP) {
+                        websocketserver_client_frames_drop(websocketserver_client, &medusa_websocketserver_client_event_frames_dropped.count, &medusa_websocketserver_client_event_frames_dropped.length);
+                        if (medusa_websocketserver_client_event_frames_dropped.count > 0) {
+                                rc = medusa_websocketserver_client_onevent_unlocked(websocketserver_client, MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_FRAMES_DROPPED, &medusa_websocketserver_client_event_frames_dropped);
+                                if (rc < 0) {
+                                        error = rc;
+                                        goto bail;
+                                }
+                        }
+                } else if (websocketserver_client->backpressure_policy == MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_DISCONNECT) {
+                        websocketserver_client_set_state(websocketserver_client, MEDUSA_WEBSOCKETSERVER_CLIENT_STATE_ERROR);
+                        websocketserver_client->error = ENOBUFS;
+                        medusa_websocketserver_client_onevent_unlocked(websocketserver_client, MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_ERROR, NULL);
+                        medusa_websocketserver_client_destroy_unlocked(websocketserver_client);
+                        return -ENOBUFS;
+                }
+        }
+
+        if (deflated != NULL) {
+                frame = medusa_websocketserver_frame_ref(deflated);
+        } else if (websocketserver_client_deflate_frame_usable(websocketserver_client, frame)) {
+                frame = websocketserver_client_deflate_frame(websocketserver_client, frame);
+        } else {
+                frame = medusa_websocketserver_frame_ref(frame);
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(frame)) {
+                error = MEDUSA_PTR_ERR(frame);
+                goto bail;
+        }
+        length = frame->length;
+
+        if (TAILQ_EMPTY(&websocketserver_client->frames) &&
+            pending + frame->length <= MEDUSA_WEBSOCKETSERVER_CLIENT_FRAMES_WINDOW) {
+                rc = medusa_buffer_append(wbuffer, frame->data, frame->length);
+                medusa_websocketserver_frame_unref(frame);
+                if (rc < 0) {
+                        error = rc;
+                        goto bail;
+                }
+                return length;
+        }
+        rc = websocketserver_client_frames_push(websocketserver_client, frame);
+        medusa_websocketserver_frame_unref(frame);
+        if (rc < 0) {
+                error = rc;
+                goto bail;
+        }
+        rc = websocketserver_client_frames_flush(websocketserver_client);
+        if (rc < 0) {
+                error = rc;
+                goto bail;
+        }
+
+        return length;
+bail:   websocketserver_client_set_state(websocketserver_client, MEDUSA_WEBSOCKETSERVER_CLIENT_STATE_ERROR);
+        websocketserver_client->error = -error;
+        medusa_websocketserver_client_onevent_unlocked(websocketserver_client, MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_ERROR, NULL);
+        return error;
+}
+
+static int websocketserver_client_httpparser_on_message_begin (http_parser *http_parser)
+{
+        struct medusa_websocketserver_client *websocketserver_client = http_parser->data;
+        (void) websocketserver_client;
+        return 0;
+}
+
+static int websocketserver_client_httpparser_on_url (http_parser *http_parser, const char *at, size_t length)
+{
+        struct medusa_websocketserver_client *websocketserver_client = http_parser->data;
+        (void) websocketserver_client;
+        (void) at;
+        (void) length;
+        return 0;
+}
+
+static int websocketserver_client_httpparser_on_status (http_parser *http_parser, const char *at, size_t length)
+{
+        struct medusa_websocketserver_client *websocketserver_client = http_parser->data;
+        (void) websocketserver_client;
+        (void) at;
+        (void) length;
+        return 0;
+}
+
+static int websocketserver_client_httpparser_on_header_field (http_parser *http_parser, const char *at, size_t length)
+{
+        int rc;
+        struct medusa_websocketserver_client_event_request_header websocketserver_client_event_request_header;
+        struct medusa_websocketserver_client *websocketserver_client = http_parser->data;
+
+        if (websocketserver_client->http_parser_header_field != NULL &&
+            websocketserver_client->http_parser_header_value != NULL) {
+                websocketserver_client_event_request_header.field = websocketserver_client->http_parser_header_field;
+                websocketserver_client_event_request_header.value = websocketserver_client->http_parser_header_value;
+                rc = medusa_websocketserver_client_onevent_unlocked(websocketserver_client, MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_REQUEST_HEADER, &websocketserver_client_event_request_header);
+                if (rc < 0) {
+                        return rc;
+                }
+                if (strcasecmp(websocketserver_client->http_parser_header_field, "Sec-WebSocket-Key") == 0) {
+                        if (websocketserver_client->sec_websocket_key != NULL) {
+                                free(websocketserver_client->sec_websocket_key);
+                        }
+                        websocketserver_client->sec_websocket_key = strdup(websocketserver_client->http_parser_header_value);
+                        if (websocketserver_client->sec_websocket_key == NULL) {
+                                return -ENOMEM;
+                        }
+                }
+                if (strcasecmp(websocketserver_client->http_parser_header_field, "Sec-WebSocket-Protocol") == 0) {
+                        if (websocketserver_client->sec_websocket_protocol != NULL) {
+                                free(websocketserver_client->sec_websocket_protocol);
+                        }
+                        websocketserver_client->sec_websocket_protocol = strdup(websocketserver_client->http_parser_header_value);
+                        if (websocketserver_client->sec_websocket_protocol == NULL) {
+                                return -ENOMEM;
+                        }
+                }
+                if (strcasecmp(websocketserver_client->http_parser_header_field, "Sec-WebSocket-Extensions") == 0) {
+                        rc = websocketserver_client_add_extensions(websocketserver_client, websocketserver_client->http_parser_header_value);
+                        if (rc < 0) {
+                                return rc;
+                        }
+                }
+                if (websocketserver_client->http_parser_header_field != NULL) {
+                        free(websocketserver_client->http_parser_header_field);
+                        websocketserver_client->http_parser_header_field = NULL;
+                }
+        }
+
+        if (websocketserver_client->http_parser_header_value != NULL) {
+                free(websocketserver_client->http_parser_header_value);
+                websocketserver_client->http_parser_header_value = NULL;
+        }
+
+        if (websocketserver_client->http_parser_header_field != NULL) {
+                char *tmp = realloc(websocketserver_client->http_parser_header_field, strlen(websocketserver_client->http_parser_header_field) + length + 1);
+                if (tmp == NULL) {
+                        return -ENOMEM;
+                }
+                websocketserver_client->http_parser_header_field = tmp;
+                strncat(websocketserver_client->http_parser_header_field, at, length);
+        } else {
+                websocketserver_client->http_parser_header_field = medusa_strndup(at, length);
+                if (websocketserver_client->http_parser_header_field == NULL) {
+                        return -ENOMEM;
+                }
+        }
+
+        return 0;
+}
+
+static int websocketserver_client_httpparser_on_header_value (http_parser *http_parser, const char *at, size_t length)
+{
+        struct medusa_websocketserver_client *websocketserver_client = http_parser->data;
+
+        if (websocketserver_client->http_parser_header_value != NULL) {
+                char *tmp = realloc(websocketserver_client->http_parser_header_value, strlen(websocketserver_client->http_parser_header_value) + length + 1);
+                if (tmp == NULL) {
+                        return -ENOMEM;
+                }
+                websocketserver_client->http_parser_header_value = tmp;
+                strncat(websocketserver_client->http_parser_header_value, at, length);
+        } else {
+                websocketserver_client->http_parser_header_value = medusa_strndup(at, length);
+                if (websocketserver_client->http_parser_header_value == NULL) {
+                        return -ENOMEM;
+                }
+        }
+
+        return 0;
+}
+
+static int websocketserver_client_httpparser_on_headers_complete (http_parser *http_parser)
+{
+        int rc;
+        struct medusa_websocketserver_client_event_request_header websocketserver_client_event_request_header;
+        struct medusa_websocketserver_client *websocketserver_client = http_parser->data;
+        if (websocketserver_client->http_parser_header_field != NULL &&
+            websocketserver_client->http_parser_header_value != NULL) {
+                websocketserver_client_event_request_header.field = websocketserver_client->http_parser_header_field;
+                websocketserver_client_event_request_header.value = websocketserver_client->http_parser_header_value;
+                rc = medusa_websocketserver_client_onevent_unlocked(websocketserver_client, MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_REQUEST_HEADER, &websocketserver_client_event_request_header);
+                if (rc < 0) {
+                        return rc;
+                }
+                if (strcasecmp(websocketserver_client->http_parser_header_field, "Sec-WebSocket-Key") == 0) {
+                        if (websocketserver_client->sec_websocket_key != NULL) {
+                                free(websocketserver_client->sec_websocket_key);
+                        }
+                        websocketserver_client->sec_websocket_key = strdup(websocketserver_client->http_parser_header_value);
+                        if (websocketserver_client->sec_websocket_key == NULL) {
+                                return -ENOMEM;
+                        }
+                }
+                if (strcasecmp(websocketserver_client->http_parser_header_field, "Sec-WebSocket-Protocol") == 0) {
+                        if (websocketserver_client->sec_websocket_protocol != NULL) {
+                                free(websocketserver_client->sec_websocket_protocol);
+                        }
+                        websocketserver_client->sec_websocket_protocol = strdup(websocketserver_client->http_parser_header_value);
+                        if (websocketserver_client->sec_websocket_protocol == NULL) {
+                                return -ENOMEM;
+                        }
+                }
+                if (strcasecmp(websocketserver_client->http_parser_header_field, "Sec-WebSocket-Extensions") == 0) {
+                        rc = websocketserver_client_add_extensions(websocketserver_client, websocketserver_client->http_parser_header_value);
+                        if (rc < 0) {
+                                return rc;
+                        }
+                }
+        }
+        if (websocketserver_client->http_parser_header_field != NULL) {
+                free(websocketserver_client->http_parser_header_field);
+                websocketserver_client->http_parser_header_field = NULL;
+        }
+        if (websocketserver_client->http_parser_header_value != NULL) {
+                free(websocketserver_client->http_parser_header_value);
+                websocketserver_client->http_parser_header_value = NULL;
+        }
+        return 0;
+}
+
+static int websocketserver_client_httpparser_on_body (http_parser *http_parser, const char *at, size_t length)
+{
+        struct medusa_websocketserver_client *websocketserver_client = http_parser->data;
+        (void) websocketserver_client;
+        (void) at;
+        (void) length;
+        return 0;
+}
+
+static int websocketserver_client_httpparser_on_message_complete (http_parser *http_parser)
+{
+        int rc;
+        struct medusa_websocketserver_client *websocketserver_client = http_parser->data;
+        (void) websocketserver_client;
+        rc = websocketserver_client_set_state(websocketserver_client, MEDUSA_WEBSOCKETSERVER_CLIENT_STATE_REQUEST_RECEIVED);
+        if (rc < 0) {
+                return rc;
+        }
+        rc = medusa_websocketserver_client_onevent_unlocked(websocketserver_client, MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_REQUEST_RECEIVED, NULL);
+        if (rc < 0) {
+                return rc;
+        }
+        return 0;
+}
+
+static int websocketserver_client_httpparser_on_chunk_header (http_parser *http_parser)
+{
+        struct medusa_websocketserver_client *websocketserver_client = http_parser->data;
+        (void) websocketserver_client;
+        return 0;
+}
+
+static int websocketserver_client_httpparser_on_chunk_complete (http_parser *http_parser)
+{
+        struct medusa_websocketserver_client *websocketserver_client = http_parser->data;
+        (void) websocketserver_client;
+        return 0;
+}
+
+static int websocketserver_client_tcpsocket_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
+{
+        int rc;
+        int error;
+        struct medusa_monitor *monitor;
+        struct medusa_websocketserver_client *websocketserver_client = (struct medusa_websocketserver_client *) context;
+
+        if (events & MEDUSA_TCPSOCKET_EVENT_DESTROY) {
+                return 0;
         }
 
-        monitor = medusa_tcpsocket_get_monitor(tcpsocket);
-        medusa_monitor_lock(monitor);
-
+        monitor = medusa_tcpsocket_get_monitor(tcpsocket);
+        medusa_monitor_lock(monitor);
+
         if (events & MEDUSA_TCPSOCKET_EVENT_CONNECTED) {
                 websocketserver_client_set_state(websocketserver_client, MEDUSA_WEBSOCKETSERVER_CLIENT_STATE_ACCEPTED);
                 rc = medusa_websocketserver_client_onevent_unlocked(websocketserver_client, MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_ACCEPTED, NULL);
@@ -1273,6 +1945,7 @@ static int websocketserver_client_tcpsocket_onevent (struct medusa_tcpsocket *tc
                         char *str;
                         char hash[MEDUSA_SHA1_LENGTH];
                         char *base64;
+                        char extensions[128];
                         const char *gid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
                         const char *key = websocketserver_client->sec_websocket_key;
 
@@ -1282,6 +1955,15 @@ static int websocketserver_client_tcpsocket_onevent (struct medusa_tcpsocket *tc
                                 goto bail;
                         }
 
+                        rc = websocketserver_client_deflate_negotiate(websocketserver_client, extensions, sizeof(extensions));
+                        if (rc < 0) {
+                                medusa_errorf("websocketserver_client_deflate_negotiate failed, rc: %d", rc);
+                                error = rc;
+                                goto bail;
+                        }
+                        free(websocketserver_client->sec_websocket_extensions);
+                        websocketserver_client->sec_websocket_extensions = NULL;
+
                         str = malloc(strlen(key) + strlen(gid) + 1);
                         if (str == NULL) {
                                 medusa_errorf("can not allocate memory");
@@ -1307,10 +1989,14 @@ static int websocketserver_client_tcpsocket_onevent (struct medusa_tcpsocket *tc
 			        "Connection: Upgrade\r\n"
                                 "Sec-WebSocket-Protocol: %s\r\n"
 			        "Sec-WebSocket-Accept: %s\r\n"
+                                "%s%s%s"
                                 "\r\n",
                                 (websocketserver_client->websocketserver->servername) ? websocketserver_client->websocketserver->servername : "medusa-websocketserver",
                                 (websocketserver_client->sec_websocket_protocol) ? websocketserver_client->sec_websocket_protocol : "generic",
-			        base64);
+			        base64,
+                                (extensions[0] != '\0') ? "Sec-WebSocket-Extensions: " : "",
+                                extensions,
+                                (extensions[0] != '\0') ? "\r\n" : "");
                         free(base64);
                         free(str);
 
@@ -1403,6 +2089,11 @@ restart_buffer:
                                                                 error = rc;
                                                                 goto bail;
                                                         }
+                                                        if (uint64 & 0x8000000000000000ULL) {
+                                                                medusa_errorf("invalid frame payload length");
+                                                                error = -EIO;
+                                                                goto bail;
+                                                        }
                                                         websocketserver_client->frame_mask_offset    = 10;
                                                         websocketserver_client->frame_payload_offset = websocketserver_client->frame_mask_offset + 4;
                                                         websocketserver_client->frame_payload_length = uint64;
@@ -1418,13 +2109,32 @@ restart_buffer:
                                                 websocketserver_client->frame_mask_offset     = 0;
                                                 websocketserver_client->frame_payload_offset -= 4;
                                         }
+                                        rc = medusa_buffer_peek_uint8(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), 0, &websocketserver_client->frame_opcode);
+                                        if (rc < 0) {
+                                                medusa_errorf("medusa_buffer_peek_uint8 failed, rc: %d", (int) rc);
+                                                error = rc;
+                                                goto bail;
+                                        }
+                                        rc = websocketserver_client_message_begin(websocketserver_client, websocketserver_client->frame_opcode);
+                                        if (rc < 0) {
+                                                medusa_errorf("websocketserver_client_message_begin failed, rc: %d", rc);
+                                                error = rc;
+                                                goto bail;
+                                        }
+                                        if (websocketserver_client->max_message_size > 0 &&
+                                            !(websocketserver_client->frame_opcode & 0x08) &&
+                                            !websocketserver_client->deflate.message &&
+                                            websocketserver_client->message.length + websocketserver_client->frame_payload_length > websocketserver_client->max_message_size) {
+                                                medusa_errorf("message is too big, length: %lld / %lld", (long long) (websocketserver_client->message.length + websocketserver_client->frame_payload_length), (long long) websocketserver_client->max_message_size);
+                                                error = -EMSGSIZE;
+                                                goto bail;
+                                        }
+                                        websocketserver_client->frame_payload_consumed = 0;
                                         websocketserver_client->frame_state = MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_STATE_PAYLOAD;
                                         FALL_THROUGH;
                                 }
                                 case MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_STATE_PAYLOAD: {
-                                        unsigned int i;
                                         int64_t rlength;
-                                        uint8_t *payload;
 
                                         rlength = medusa_buffer_get_length(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket));
                                         if (rlength < 0) {
@@ -1432,94 +2142,259 @@ restart_buffer:
                                                 error = rlength;
                                                 goto bail;
                                         }
+                                        if (websocketserver_client->message_mode == MEDUSA_WEBSOCKETSERVER_CLIENT_MESSAGE_MODE_STREAM &&
+                                            !(websocketserver_client->frame_opcode & 0x08)) {
+                                                /* data frames are delivered as they arrive, drop the header and continue with the payload */
+                                                if (rlength < websocketserver_client->frame_payload_offset) {
+                                                        goto short_buffer;
+                                                }
+                                                if (websocketserver_client->frame_mask_offset != 0) {
+                                                        rc = medusa_buffer_peek_data(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), websocketserver_client->frame_mask_offset, websocketserver_client->frame_mask, 4);
+                                                        if (rc < 0) {
+                                                                medusa_errorf("medusa_buffer_peek_data failed, rc: %d", (int) rc);
+                                                                error = rc;
+                                                                goto bail;
+                                                        }
+                                                }
+                                                rlength = medusa_buffer_choke(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), 0, websocketserver_client->frame_payload_offset);
+                                                if (rlength != websocketserver_client->frame_payload_offset) {
+                                                        medusa_errorf("medusa_buffer_choke failed, rlength: %d / %d", (int) rlength, (int) websocketserver_client->frame_payload_offset);
+                                                        error = -EIO;
+                                                        goto bail;
+                                                }
+                                                websocketserver_client->frame_state = MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_STATE_STREAM;
+                                                goto restart_buffer;
+                                        }
                                         if (rlength < websocketserver_client->frame_payload_offset + websocketserver_client->frame_payload_length) {
                                                 goto short_buffer;
                                         }
 
+                                        if (websocketserver_client->frame_mask_offset != 0) {
+                                                uint8_t mask[4];
+                                                rc = medusa_buffer_peek_data(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), websocketserver_client->frame_mask_offset, mask, 4);
+                                                if (rc < 0) {
+                                                        medusa_errorf("medusa_buffer_peek_data failed, rc: %d", (int) rc);
+                                                        error = rc;
+                                                        goto bail;
+                                                }
+                                                rc = medusa_websocket_mask_buffer(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), websocketserver_client->frame_payload_offset, websocketserver_client->frame_payload_length, mask);
+                                                if (rc < 0) {
+                                                        medusa_errorf("medusa_websocket_mask_buffer failed, rc: %d", (int) rc);
+                                                        error = rc;
+                                                        goto bail;
+                                                }
+                                        }
+
+                                        websocketserver_client->frame_state = MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_STATE_FINISH;
+                                        FALL_THROUGH;
+                                }
+                                case MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_STATE_FINISH: {
+                                        uint8_t uint8;
+                                        uint8_t opcode;
+                                        int64_t clength;
+                                        int64_t plength;
+                                        uint8_t *payload;
+                                        unsigned int assembled;
+                                        struct medusa_websocketserver_client_event_message medusa_websocketserver_client_event_message;
+
+                                        uint8  = websocketserver_client->frame_opcode;
+                                        opcode = uint8 & 0x0f;
+
                                         payload = medusa_buffer_linearize(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), websocketserver_client->frame_payload_offset, websocketserver_client->frame_payload_length);
                                         if (MEDUSA_IS_ERR_OR_NULL(payload)) {
                                                 medusa_errorf("medusa_buffer_linearize failed, rc: %d", MEDUSA_PTR_ERR(payload));
                                                 error = MEDUSA_PTR_ERR(payload);
                                                 goto bail;
                                         }
-                                        if (websocketserver_client->frame_mask_offset != 0) {
-                                                uint8_t mask[4];
-                                                rc  = medusa_buffer_peek_uint8(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), websocketserver_client->frame_mask_offset + 0, &mask[0]);
-                                                rc |= medusa_buffer_peek_uint8(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), websocketserver_client->frame_mask_offset + 1, &mask[1]);
-                                                rc |= medusa_buffer_peek_uint8(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), websocketserver_client->frame_mask_offset + 2, &mask[2]);
-                                                rc |= medusa_buffer_peek_uint8(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), websocketserver_client->frame_mask_offset + 3, &mask[3]);
+
+                                        plength = websocketserver_client->frame_payload_length;
+                                        rc = websocketserver_client_inflate_payload(websocketserver_client, uint8, !!(uint8 & 0x80), &payload, &plength);
+                                        if (rc < 0) {
+                                                medusa_errorf("websocketserver_client_inflate_payload failed, rc: %d", rc);
+                                                error = rc;
+                                                goto bail;
+                                        }
+
+                                        medusa_websocketserver_client_event_message.final   = !!(uint8 & 0x80);
+                                        medusa_websocketserver_client_event_message.type    = websocketserver_client_frame_type(opcode);
+                                        medusa_websocketserver_client_event_message.length  = plength;
+                                        medusa_websocketserver_client_event_message.payload = payload;
+
+                                        assembled = 0;
+                                        if (!(opcode & 0x08)) {
+                                                if (websocketserver_client->max_message_size > 0 &&
+                                                    websocketserver_client->message.length + plength > websocketserver_client->max_message_size) {
+                                                        medusa_errorf("message is too big, length: %lld / %lld", (long long) (websocketserver_client->message.length + plength), (long long) websocketserver_client->max_message_size);
+                                                        error = -EMSGSIZE;
+                                                        goto bail;
+                                                }
+                                                if (websocketserver_client->message_mode == MEDUSA_WEBSOCKETSERVER_CLIENT_MESSAGE_MODE_ASSEMBLE &&
+                                                    (opcode == WS_OPCODE_CONTINUE || !(uint8 & 0x80))) {
+                                                        /* fragments are collected until the final one, unfragmented messages are delivered in place */
+                                                        if (websocketserver_client->message.buffer == NULL) {
+                                                                websocketserver_client->message.buffer = medusa_buffer_create(MEDUSA_BUFFER_TYPE_SIMPLE);
+                                                                if (MEDUSA_IS_ERR_OR_NULL(websocketserver_client->message.buffer)) {
+                                                                        error = MEDUSA_PTR_ERR(websocketserver_client->message.buffer);
+                                                                        websocketserver_client->message.buffer = NULL;
+                                                                        goto bail;
+                                                                }
+                                                        }
+                                                        if (plength > 0) {
+                                                                rc = medusa_buffer_append(websocketserver_client->message.buffer, payload, plength);
+                                                                if (rc < 0) {
+                                                                        medusa_errorf("medusa_buffer_append failed, rc: %d", rc);
+                                                                        error = rc;
+                                                                        goto bail;
+                                                                }
+                                                        }
+                                                        assembled = 1;
+                                                }
+                                                websocketserver_client->message.length += plength;
+                                        }
+
+                                        if (assembled && (uint8 & 0x80)) {
+                                                payload = NULL;
+                                                if (websocketserver_client->message.length > 0) {
+                                                        payload = medusa_buffer_linearize(websocketserver_client->message.buffer, 0, websocketserver_client->message.length);
+                                                        if (MEDUSA_IS_ERR_OR_NULL(payload)) {
+                                                                medusa_errorf("medusa_buffer_linearize failed, rc: %d", MEDUSA_PTR_ERR(payload));
+                                                                error = MEDUSA_PTR_ERR(payload);
+                                                                goto bail;
+                                                        }
+                                                }
+                                                medusa_websocketserver_client_event_message.type    = websocketserver_client->message.type;
+                                                medusa_websocketserver_client_event_message.length  = websocketserver_client->message.length;
+                                                medusa_websocketserver_client_event_message.payload = payload;
+                                        }
+                                        if (!assembled || (uint8 & 0x80)) {
+                                                rc = medusa_websocketserver_client_onevent_unlocked(websocketserver_client, MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_MESSAGE, &medusa_websocketserver_client_event_message);
+                                                if (rc < 0) {
+                                                        medusa_errorf("medusa_websocketserver_client_onevent_unlocked failed, rc: %d", rc);
+                                                        error = rc;
+                                                        goto bail;
+                                                }
+                                        }
+                                        if (assembled && (uint8 & 0x80)) {
+                                                rc = medusa_buffer_reset(websocketserver_client->message.buffer);
+                                                if (rc < 0) {
+                                                        medusa_errorf("medusa_buffer_reset failed, rc: %d", rc);
+                                                        error = rc;
+                                                        goto bail;
+                                                }
+                                        }
+                                        clength = medusa_buffer_choke(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), 0, websocketserver_client->frame_payload_offset + websocketserver_client->frame_payload_length);
+                                        if (clength != websocketserver_client->frame_payload_offset + websocketserver_client->frame_payload_length) {
+                                                medusa_errorf("medusa_websocketserver_client_onevent_unlocked failed, clength: %d / %d", (int) clength, (int) (websocketserver_client->frame_payload_offset + websocketserver_client->frame_payload_length));
+                                                error = -EIO;
+                                                goto bail;
+                                        }
+
+                                        if (opcode == WS_OPCODE_CLOSE) {
+                                                rc = websocketserver_client_set_state(websocketserver_client, MEDUSA_WEBSOCKETSERVER_CLIENT_STATE_DISCONNECTED);
                                                 if (rc < 0) {
-                                                        medusa_errorf("medusa_buffer_peek_uint8 failed, rlength: %d", (int) rc);
+                                                        medusa_errorf("websocketserver_client_set_state failed, rc: %d", rc);
                                                         error = rc;
                                                         goto bail;
                                                 }
-                                                for (i = 0; i < websocketserver_client->frame_payload_length; i++) {
-                                                        payload[i] = payload[i] ^ mask[i & 3];
+                                                rc = medusa_websocketserver_client_onevent_unlocked(websocketserver_client, MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_DISCONNECTED, NULL);
+                                                if (rc < 0) {
+                                                        medusa_errorf("medusa_websocketserver_client_onevent_unlocked failed, rc: %d", rc);
+                                                        error = rc;
+                                                        goto bail;
                                                 }
+                                                medusa_websocketserver_client_destroy_unlocked(websocketserver_client);
+                                                goto out;
                                         }
 
-                                        websocketserver_client->frame_state = MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_STATE_FINISH;
-                                        FALL_THROUGH;
+                                        websocketserver_client->frame_state = MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_STATE_START;
+                                        goto restart_buffer;
                                 }
-                                case MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_STATE_FINISH: {
-                                        uint8_t uint8;
-                                        uint8_t opcode;
+                                case MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_STATE_STREAM: {
+                                        int64_t rlength;
                                         int64_t clength;
+                                        int64_t plength;
                                         uint8_t *payload;
-                                        struct medusa_websocketserver_client_event_message medusa_websocketserver_client_event_message;
+                                        unsigned int final;
+                                        struct medusa_websocketserver_client_event_message_chunk medusa_websocketserver_client_event_message_chunk;
 
-                                        rc = medusa_buffer_peek_uint8(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), 0, &uint8);
-                                        if (rc < 0) {
-                                                medusa_errorf("medusa_buffer_peek_uint8 failed, rc: %d", (int) rc);
-                                                error = rc;
+                                        rlength = medusa_buffer_get_length(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket));
+                                        if (rlength < 0) {
+                                                medusa_errorf("medusa_buffer_get_length failed, rlength: %d", (int) rlength);
+                                                error = rlength;
                                                 goto bail;
                                         }
+                                        clength = websocketserver_client->frame_payload_length - websocketserver_client->frame_payload_consumed;
+                                        if (clength > rlength) {
+                                                clength = rlength;
+                                        }
+                                        if (clength == 0 && websocketserver_client->frame_payload_length != 0) {
+                                                goto short_buffer;
+                                        }
 
-                                        payload = medusa_buffer_linearize(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), websocketserver_client->frame_payload_offset, websocketserver_client->frame_payload_length);
-                                        if (MEDUSA_IS_ERR_OR_NULL(payload)) {
-                                                medusa_errorf("medusa_buffer_linearize failed, rc: %d", MEDUSA_PTR_ERR(payload));
-                                                error = MEDUSA_PTR_ERR(payload);
-                                                goto bail;
+                                        payload = NULL;
+                                        if (clength > 0) {
+                                                if (websocketserver_client->frame_mask_offset != 0) {
+                                                        unsigned int i;
+                                                        uint8_t mask[4];
+                                                        for (i = 0; i < 4; i++) {
+                                                                mask[i] = websocketserver_client->frame_mask[(websocketserver_client->frame_payload_consumed + i) & 3];
+                                                        }
+                                                        rc = medusa_websocket_mask_buffer(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), 0, clength, mask);
+                                                        if (rc < 0) {
+                                                                medusa_errorf("medusa_websocket_mask_buffer failed, rc: %d", (int) rc);
+                                                                error = rc;
+                                                                goto bail;
+                                                        }
+                                                }
+                                                payload = medusa_buffer_linearize(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), 0, clength);
+                                                if (MEDUSA_IS_ERR_OR_NULL(payload)) {
+                                                        medusa_errorf("medusa_buffer_linearize failed, rc: %d", MEDUSA_PTR_ERR(payload));
+                                                        error = MEDUSA_PTR_ERR(payload);
+                                                        goto bail;
+                                                }
                                         }
 
-                                        opcode = uint8 & 0x0f;
-                                        medusa_websocketserver_client_event_message.final   = !!(uint8 & 0x80);
-                                        medusa_websocketserver_client_event_message.type    = (opcode == WS_OPCODE_CLOSE) ? MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_CLOSE :
-                                                                                              (opcode == WS_OPCODE_PING) ? MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_PING :
-                                                                                              (opcode == WS_OPCODE_PONG) ? MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_PONG :
-                                                                                              (opcode == WS_OPCODE_TEXT) ? MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_TEXT :
-                                                                                              (opcode == WS_OPCODE_BINARY) ? MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_BINARY :
-                                                                                              MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_CONTINUATION;
-                                        medusa_websocketserver_client_event_message.length  = websocketserver_client->frame_payload_length;
-                                        medusa_websocketserver_client_event_message.payload = payload;
-                                        rc = medusa_websocketserver_client_onevent_unlocked(websocketserver_client, MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_MESSAGE, &medusa_websocketserver_client_event_message);
+                                        final   = (websocketserver_client->frame_opcode & 0x80) && (websocketserver_client->frame_payload_consumed + clength == websocketserver_client->frame_payload_length);
+                                        plength = clength;
+                                        rc = websocketserver_client_inflate_payload(websocketserver_client, websocketserver_client->frame_opcode, final, &payload, &plength);
                                         if (rc < 0) {
-                                                medusa_errorf("medusa_websocketserver_client_onevent_unlocked failed, rc: %d", rc);
+                                                medusa_errorf("websocketserver_client_inflate_payload failed, rc: %d", rc);
                                                 error = rc;
                                                 goto bail;
                                         }
-                                        clength = medusa_buffer_choke(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), 0, websocketserver_client->frame_payload_offset + websocketserver_client->frame_payload_length);
-                                        if (clength != websocketserver_client->frame_payload_offset + websocketserver_client->frame_payload_length) {
-                                                medusa_errorf("medusa_websocketserver_client_onevent_unlocked failed, clength: %d / %d", (int) clength, (int) websocketserver_client->frame_payload_offset + websocketserver_client->frame_payload_length);
-                                                error = -EIO;
+                                        if (websocketserver_client->max_message_size > 0 &&
+                                            websocketserver_client->message.length + plength > websocketserver_client->max_message_size) {
+                                                medusa_errorf("message is too big, length: %lld / %lld", (long long) (websocketserver_client->message.length + plength), (long long) websocketserver_client->max_message_size);
+                                                error = -EMSGSIZE;
                                                 goto bail;
                                         }
 
-                                        if (opcode == WS_OPCODE_CLOSE) {
-                                                rc = websocketserver_client_set_state(websocketserver_client, MEDUSA_WEBSOCKETSERVER_CLIENT_STATE_DISCONNECTED);
+                                        if (plength > 0 || final) {
+                                                medusa_websocketserver_client_event_message_chunk.final   = final;
+                                                medusa_websocketserver_client_event_message_chunk.type    = websocketserver_client->message.type;
+                                                medusa_websocketserver_client_event_message_chunk.offset  = websocketserver_client->message.length;
+                                                medusa_websocketserver_client_event_message_chunk.length  = plength;
+                                                medusa_websocketserver_client_event_message_chunk.payload = (plength > 0) ? payload : NULL;
+                                                rc = medusa_websocketserver_client_onevent_unlocked(websocketserver_client, MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_MESSAGE_CHUNK, &medusa_websocketserver_client_event_message_chunk);
                                                 if (rc < 0) {
-                                                        medusa_errorf("websocketserver_client_set_state failed, rc: %d", rc);
+                                                        medusa_errorf("medusa_websocketserver_client_onevent_unlocked failed, rc: %d", rc);
                                                         error = rc;
                                                         goto bail;
                                                 }
-                                                rc = medusa_websocketserver_client_onevent_unlocked(websocketserver_client, MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_DISCONNECTED, NULL);
-                                                if (rc < 0) {
-                                                        medusa_errorf("medusa_websocketserver_client_onevent_unlocked failed, rc: %d", rc);
-                                                        error = rc;
+                                        }
+                                        websocketserver_client->message.length += plength;
+
+                                        if (clength > 0) {
+                                                rlength = medusa_buffer_choke(medusa_tcpsocket_get_read_buffer_unlocked(tcpsocket), 0, clength);
+                                                if (rlength != clength) {
+                                                        medusa_errorf("medusa_buffer_choke failed, rlength: %d / %d", (int) rlength, (int) clength);
+                                                        error = -EIO;
                                                         goto bail;
                                                 }
-                                                medusa_websocketserver_client_destroy_unlocked(websocketserver_client);
-                                                goto out;
+                                        }
+                                        websocketserver_client->frame_payload_consumed += clength;
+                                        if (websocketserver_client->frame_payload_consumed < websocketserver_client->frame_payload_length) {
+                                                goto short_buffer;
                                         }
 
                                         websocketserver_client->frame_state = MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_STATE_START;
@@ -1534,8 +2409,14 @@ short_buffer:
         if (events & MEDUSA_TCPSOCKET_EVENT_BUFFERED_WRITE) {
                 struct medusa_tcpsocket_event_buffered_write *medusa_tcpsocket_event_buffered_write = (struct medusa_tcpsocket_event_buffered_write *) param;
                 struct medusa_websocketserver_client_event_buffered_write medusa_websocketserver_client_event_buffered_write;
+                rc = websocketserver_client_frames_flush(websocketserver_client);
+                if (rc < 0) {
+                        medusa_errorf("websocketserver_client_frames_flush failed, rc: %d", rc);
+                        error = rc;
+                        goto bail;
+                }
                 medusa_websocketserver_client_event_buffered_write.length    = medusa_tcpsocket_event_buffered_write->length;
-                medusa_websocketserver_client_event_buffered_write.remaining = medusa_tcpsocket_event_buffered_write->remaining;
+                medusa_websocketserver_client_event_buffered_write.remaining = medusa_websocketserver_client_get_pending_unlocked(websocketserver_client);
                 rc = medusa_websocketserver_client_onevent_unlocked(websocketserver_client, MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_BUFFERED_WRITE, &medusa_websocketserver_client_event_buffered_write);
                 if (rc < 0) {
                         medusa_errorf("medusa_websocketserver_client_onevent_unlocked failed, rc: %d", rc);
@@ -1544,12 +2425,20 @@ short_buffer:
                 }
         }
         if (events & MEDUSA_TCPSOCKET_EVENT_BUFFERED_WRITE_FINISHED) {
-                rc = medusa_websocketserver_client_onevent_unlocked(websocketserver_client, MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_BUFFERED_WRITE_FINISHED, NULL);
+                rc = websocketserver_client_frames_flush(websocketserver_client);
                 if (rc < 0) {
-                        medusa_errorf("medusa_websocketserver_client_onevent_unlocked failed, rc: %d", rc);
+                        medusa_errorf("websocketserver_client_frames_flush failed, rc: %d", rc);
                         error = rc;
                         goto bail;
                 }
+                if (medusa_websocketserver_client_get_pending_unlocked(websocketserver_client) == 0) {
+                        rc = medusa_websocketserver_client_onevent_unlocked(websocketserver_client, MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_BUFFERED_WRITE_FINISHED, NULL);
+                        if (rc < 0) {
+                                medusa_errorf("medusa_websocketserver_client_onevent_unlocked failed, rc: %d", rc);
+                                error = rc;
+                                goto bail;
+                        }
+                }
         }
         if (events & MEDUSA_TCPSOCKET_EVENT_ERROR) {
                 struct medusa_tcpsocket_event_error *medusa_tcpsocket_event_error = (struct medusa_tcpsocket_event_error *) param;
@@ -1593,6 +2482,151 @@ bail:   websocketserver_client_set_state(websocketserver_client, MEDUSA_WEBSOCKE
         return 0;
 }
 
+__attribute__ ((visibility ("default"))) struct medusa_websocketserver_frame * medusa_websocketserver_frame_create (unsigned int final, unsigned int type, const void *data, int64_t length)
+{
+        return websocketserver_frame_create(final, type, 0, data, length);
+}
+
+__attribute__ ((visibility ("default"))) struct medusa_websocketserver_frame * medusa_websocketserver_frame_ref (struct medusa_websocketserver_frame *frame)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(frame)) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        __atomic_add_fetch(&frame->refcount, 1, __ATOMIC_RELAXED);
+        return frame;
+}
+
+__attribute__ ((visibility ("default"))) void medusa_websocketserver_frame_unref (struct medusa_websocketserver_frame *frame)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(frame)) {
+                return;
+        }
+        if (__atomic_sub_fetch(&frame->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+                free(frame);
+        }
+}
+
+__attribute__ ((visibility ("default"))) int64_t medusa_websocketserver_frame_get_length (const struct medusa_websocketserver_frame *frame)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(frame)) {
+                return -EINVAL;
+        }
+        return frame->length;
+}
+
+__attribute__ ((visibility ("default"))) int64_t medusa_websocketserver_frame_get_refcount (const struct medusa_websocketserver_frame *frame)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(frame)) {
+                return -EINVAL;
+        }
+        return __atomic_load_n(&frame->refcount, __ATOMIC_ACQUIRE);
+}
+
+__attribute__ ((visibility ("default"))) int medusa_websocketserver_broadcast_frame_unlocked (struct medusa_websocketserver *websocketserver, struct medusa_websocketserver_frame *frame)
+{
+        int64_t rc;
+        int count;
+        struct medusa_buffer *buffer;
+        struct medusa_websocket_deflate *deflate;
+        struct medusa_websocketserver_frame *deflated;
+        struct medusa_websocketserver_client *websocketserver_client;
+        struct medusa_websocketserver_client *nwebsocketserver_client;
+        if (MEDUSA_IS_ERR_OR_NULL(websocketserver)) {
+                return -EINVAL;
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(frame)) {
+                return -EINVAL;
+        }
+        count = 0;
+        deflated = NULL;
+        TAILQ_FOREACH_SAFE(websocketserver_client, &websocketserver->clients, list, nwebsocketserver_client) {
+                if (websocketserver_client->state != MEDUSA_WEBSOCKETSERVER_CLIENT_STATE_CONNECTED) {
+                        continue;
+                }
+                if (!medusa_subject_is_active(&websocketserver_client->subject)) {
+                        continue;
+                }
+                /* clients without context takeover share one compressed
+                 * message, the others are compressed with their own context */
+                if (deflated == NULL &&
+                    websocketserver_client->deflate.compress_no_context_takeover &&
+                    websocketserver_client->deflate.compress_window_bits >= websocketserver->deflate.window_bits &&
+                    websocketserver_client_deflate_frame_usable(websocketserver_client, frame)) {
+                        buffer = websocketserver_deflate_buffer(websocketserver);
+                        if (MEDUSA_IS_ERR_OR_NULL(buffer)) {
+                                return -ENOMEM;
+                        }
+                        deflate = medusa_websocket_deflate_acquire(MEDUSA_WEBSOCKET_DEFLATE_TYPE_COMPRESS, websocketserver->deflate.window_bits, websocketserver->deflate.level);
+                        if (MEDUSA_IS_ERR_OR_NULL(deflate)) {
+                                return MEDUSA_PTR_ERR(deflate);
+                        }
+                        deflated = websocketserver_frame_deflate(frame, deflate, buffer);
+                        medusa_websocket_deflate_release(deflate);
+                        if (MEDUSA_IS_ERR_OR_NULL(deflated)) {
+                                return MEDUSA_PTR_ERR(deflated);
+                        }
+                        if (!(frame->flags & MEDUSA_WEBSOCKETSERVER_FRAME_FLAG_DROPPABLE)) {
+                                deflated->flags &= ~MEDUSA_WEBSOCKETSERVER_FRAME_FLAG_DROPPABLE;
+                        }
+                }
+                if (deflated != NULL &&
+                    websocketserver_client->deflate.enabled &&
+                    websocketserver_client->deflate.compress_no_context_takeover &&
+                    websocketserver_client->deflate.compress_window_bits >= websocketserver->deflate.window_bits) {
+                        rc = websocketserver_client_write_frame(websocketserver_client, frame, deflated);
+                } else {
+                        rc = websocketserver_client_write_frame(websocketserver_client, frame, NULL);
+                }
+                if (rc > 0) {
+                        count += 1;
+                }
+        }
+        if (deflated != NULL) {
+                medusa_websocketserver_frame_unref(deflated);
+        }
+        return count;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_websocketserver_broadcast_frame (struct medusa_websocketserver *websocketserver, struct medusa_websocketserver_frame *frame)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(websocketserver)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(websocketserver->subject.monitor);
+        rc = medusa_websocketserver_broadcast_frame_unlocked(websocketserver, frame);
+        medusa_monitor_unlock(websocketserver->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_websocketserver_broadcast_unlocked (struct medusa_websocketserver *websocketserver, unsigned int final, unsigned int type, const void *data, int64_t length)
+{
+        int rc;
+        struct medusa_websocketserver_frame *frame;
+        if (MEDUSA_IS_ERR_OR_NULL(websocketserver)) {
+                return -EINVAL;
+        }
+        frame = medusa_websocketserver_frame_create(final, type, data, length);
+        if (MEDUSA_IS_ERR_OR_NULL(frame)) {
+                return MEDUSA_PTR_ERR(frame);
+        }
+        rc = medusa_websocketserver_broadcast_frame_unlocked(websocketserver, frame);
+        medusa_websocketserver_frame_unref(frame);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_websocketserver_broadcast (struct medusa_websocketserver *websocketserver, unsigned int final, unsigned int type, const void *data, int64_t length)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(websocketserver)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(websocketserver->subject.monitor);
+        rc = medusa_websocketserver_broadcast_unlocked(websocketserver, final, type, data, length);
+        medusa_monitor_unlock(websocketserver->subject.monitor);
+        return rc;
+}
+
 __attribute__ ((visibility ("default"))) int medusa_websocketserver_accept_options_default (struct medusa_websocketserver_accept_options *options)
 {
         if (options == NULL) {
@@ -1652,6 +2686,14 @@ __attribute__ ((visibility ("default"))) struct medusa_websocketserver_client *
         if (MEDUSA_IS_ERR_OR_NULL(options->onevent)) {
                 return MEDUSA_ERR_PTR(-EINVAL);
         }
+        if (options->message_mode != MEDUSA_WEBSOCKETSERVER_CLIENT_MESSAGE_MODE_FRAME &&
+            options->message_mode != MEDUSA_WEBSOCKETSERVER_CLIENT_MESSAGE_MODE_STREAM &&
+            options->message_mode != MEDUSA_WEBSOCKETSERVER_CLIENT_MESSAGE_MODE_ASSEMBLE) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
+        if (options->max_message_size < 0) {
+                return MEDUSA_ERR_PTR(-EINVAL);
+        }
 
 #if defined(MEDUSA_WEBSOCKETSERVER_USE_POOL) && (MEDUSA_WEBSOCKETSERVER_USE_POOL == 1)
         websocketserver_client = medusa_pool_malloc(g_pool_websocketserver_client);
@@ -1670,6 +2712,11 @@ __attribute__ ((visibility ("default"))) struct medusa_websocketserver_client *
         websocketserver_client->onevent = options->onevent;
         websocketserver_client->context = options->context;
         websocketserver_client->frame_state = MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_STATE_START;
+        TAILQ_INIT(&websocketserver_client->frames);
+        websocketserver_client->backpressure_limit  = options->backpressure_limit;
+        websocketserver_client->backpressure_policy = options->backpressure_policy;
+        websocketserver_client->message_mode        = options->message_mode;
+        websocketserver_client->max_message_size    = options->max_message_size;
         rc = medusa_monitor_add_unlocked(websocketserver->subject.monitor, &websocketserver_client->subject);
         if (rc < 0) {
                 error = rc;
@@ -1866,63 +2913,60 @@ __attribute__ ((visibility ("default"))) int64_t medusa_websocketserver_client_w
 {
         int rc;
         int error;
-        uint8_t uint8;
+        uint8_t header[10];
+        struct medusa_iovec iovecs[2];
+        struct medusa_websocketserver_frame *frame;
+        struct medusa_websocketserver_frame *deflated;
 
         if (MEDUSA_IS_ERR_OR_NULL(websocketserver_client)) {
                 return -EINVAL;
         }
-
-        uint8  = 0;
-        uint8 |= (final) ? 0x80 : 0x00;
-        uint8 |= (type == MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_CONTINUATION) ? 0x00 :
-                 (type == MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_CLOSE)        ? 0x08 :
-                 (type == MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_PING)         ? 0x09 :
-                 (type == MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_PONG)         ? 0x0a :
-                 (type == MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_TEXT)         ? 0x01 :
-                 (type == MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_BINARY)       ? 0x02 :
-                 0x00;
-        rc = medusa_buffer_append_uint8_be(medusa_tcpsocket_get_write_buffer_unlocked(websocketserver_client->tcpsocket), uint8);
+        rc = websocketserver_frame_check(final, type, length);
         if (rc < 0) {
-                error = rc;
-                goto bail;
+                return rc;
+        }
+        if (data == NULL && length > 0) {
+                return -EINVAL;
         }
 
-        if (length <= 125) {
-                uint8  = 0;
-                uint8 |= length;
-                rc = medusa_buffer_append_uint8_be(medusa_tcpsocket_get_write_buffer_unlocked(websocketserver_client->tcpsocket), uint8);
-                if (rc < 0) {
-                        error = rc;
+        if (!TAILQ_EMPTY(&websocketserver_client->frames) ||
+            websocketserver_client_deflate_usable(websocketserver_client, final, type, length)) {
+                /* frames are still waiting in the queue keep the order, or
+                 * the message is going to be compressed */
+                frame = medusa_websocketserver_frame_create(final, type, data, length);
+                if (MEDUSA_IS_ERR_OR_NULL(frame)) {
+                        error = MEDUSA_PTR_ERR(frame);
                         goto bail;
                 }
-        } else if (length <= 0xffff) {
-                uint8  = 0;
-                uint8 |= 126;
-                rc = medusa_buffer_append_uint8_be(medusa_tcpsocket_get_write_buffer_unlocked(websocketserver_client->tcpsocket), uint8);
-                if (rc < 0) {
-                        error = rc;
-                        goto bail;
-                }
-                rc = medusa_buffer_append_uint16_be(medusa_tcpsocket_get_write_buffer_unlocked(websocketserver_client->tcpsocket), length);
-                if (rc < 0) {
-                        error = rc;
-                        goto bail;
+                if (websocketserver_client_deflate_frame_usable(websocketserver_client, frame)) {
+                        deflated = websocketserver_client_deflate_frame(websocketserver_client, frame);
+                        medusa_websocketserver_frame_unref(frame);
+                        if (MEDUSA_IS_ERR_OR_NULL(deflated)) {
+                                error = MEDUSA_PTR_ERR(deflated);
+                                goto bail;
+                        }
+                        frame = deflated;
                 }
-        } else {
-                uint8  = 0;
-                uint8 |= 127;
-                rc = medusa_buffer_append_uint8_be(medusa_tcpsocket_get_write_buffer_unlocked(websocketserver_client->tcpsocket), uint8);
+                frame->flags &= ~MEDUSA_WEBSOCKETSERVER_FRAME_FLAG_DROPPABLE;
+                rc = websocketserver_client_frames_push(websocketserver_client, frame);
+                medusa_websocketserver_frame_unref(frame);
                 if (rc < 0) {
                         error = rc;
                         goto bail;
                 }
-                rc = medusa_buffer_append_uint64_be(medusa_tcpsocket_get_write_buffer_unlocked(websocketserver_client->tcpsocket), length);
+                rc = websocketserver_client_frames_flush(websocketserver_client);
                 if (rc < 0) {
                         error = rc;
                         goto bail;
                 }
+                return length;
         }
-        rc = medusa_buffer_append(medusa_tcpsocket_get_write_buffer_unlocked(websocketserver_client->tcpsocket), data, length);
+
+        iovecs[0].iov_base = header;
+        iovecs[0].iov_len  = websocketserver_frame_header(header, final, type, 0, length);
+        iovecs[1].iov_base = (void *) data;
+        iovecs[1].iov_len  = length;
+        rc = medusa_buffer_appendv(medusa_tcpsocket_get_write_buffer_unlocked(websocketserver_client->tcpsocket), iovecs, (length > 0) ? 2 : 1);
         if (rc < 0) {
                 error = rc;
                 goto bail;
@@ -1947,6 +2991,88 @@ __attribute__ ((visibility ("default"))) int64_t medusa_websocketserver_client_w
         return rc;
 }
 
+__attribute__ ((visibility ("default"))) int64_t medusa_websocketserver_client_write_frame_unlocked (struct medusa_websocketserver_client *websocketserver_client, struct medusa_websocketserver_frame *frame)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(websocketserver_client)) {
+                return -EINVAL;
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(frame)) {
+                return -EINVAL;
+        }
+        return websocketserver_client_write_frame(websocketserver_client, frame, NULL);
+}
+
+__attribute__ ((visibility ("default"))) int64_t medusa_websocketserver_client_write_frame (struct medusa_websocketserver_client *websocketserver_client, struct medusa_websocketserver_frame *frame)
+{
+        int64_t rc;
+        if (MEDUSA_IS_ERR_OR_NULL(websocketserver_client)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(websocketserver_client->subject.monitor);
+        rc = medusa_websocketserver_client_write_frame_unlocked(websocketserver_client, frame);
+        medusa_monitor_unlock(websocketserver_client->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int64_t medusa_websocketserver_client_get_pending_unlocked (const struct medusa_websocketserver_client *websocketserver_client)
+{
+        int64_t blength;
+        if (MEDUSA_IS_ERR_OR_NULL(websocketserver_client)) {
+                return -EINVAL;
+        }
+        blength = 0;
+        if (!MEDUSA_IS_ERR_OR_NULL(websocketserver_client->tcpsocket)) {
+                blength = medusa_buffer_get_length(medusa_tcpsocket_get_write_buffer_unlocked(websocketserver_client->tcpsocket));
+                if (blength < 0) {
+                        return blength;
+                }
+        }
+        return websocketserver_client->frames_length + blength;
+}
+
+__attribute__ ((visibility ("default"))) int64_t medusa_websocketserver_client_get_pending (const struct medusa_websocketserver_client *websocketserver_client)
+{
+        int64_t rc;
+        if (MEDUSA_IS_ERR_OR_NULL(websocketserver_client)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(websocketserver_client->subject.monitor);
+        rc = medusa_websocketserver_client_get_pending_unlocked(websocketserver_client);
+        medusa_monitor_unlock(websocketserver_client->subject.monitor);
+        return rc;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_websocketserver_client_set_backpressure_unlocked (struct medusa_websocketserver_client *websocketserver_client, int64_t limit, unsigned int policy)
+{
+        if (MEDUSA_IS_ERR_OR_NULL(websocketserver_client)) {
+                return -EINVAL;
+        }
+        if (limit < 0) {
+                return -EINVAL;
+        }
+        if (policy != MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_NONE &&
+            policy != MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_SKIP &&
+            policy != MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_DROP &&
+            policy != MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_DISCONNECT) {
+                return -EINVAL;
+        }
+        websocketserver_client->backpressure_limit  = limit;
+        websocketserver_client->backpressure_policy = policy;
+        return 0;
+}
+
+__attribute__ ((visibility ("default"))) int medusa_websocketserver_client_set_backpressure (struct medusa_websocketserver_client *websocketserver_client, int64_t limit, unsigned int policy)
+{
+        int rc;
+        if (MEDUSA_IS_ERR_OR_NULL(websocketserver_client)) {
+                return -EINVAL;
+        }
+        medusa_monitor_lock(websocketserver_client->subject.monitor);
+        rc = medusa_websocketserver_client_set_backpressure_unlocked(websocketserver_client, limit, policy);
+        medusa_monitor_unlock(websocketserver_client->subject.monitor);
+        return rc;
+}
+
 __attribute__ ((visibility ("default"))) int medusa_websocketserver_client_get_sockname_unlocked (struct medusa_websocketserver_client *websocketserver_client, struct sockaddr_storage *sockaddr)
 {
         int rc;
@@ -2166,6 +3292,16 @@ __attribute__ ((visibility ("default"))) int medusa_websocketserver_client_oneve
                 }
         }
         if (events & MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_DESTROY) {
+                websocketserver_client_frames_clear(websocketserver_client);
+                websocketserver_client_deflate_uninit(websocketserver_client);
+                if (websocketserver_client->message.buffer != NULL) {
+                        medusa_buffer_destroy(websocketserver_client->message.buffer);
+                        websocketserver_client->message.buffer = NULL;
+                }
+                if (websocketserver_client->sec_websocket_extensions != NULL) {
+                        free(websocketserver_client->sec_websocket_extensions);
+                        websocketserver_client->sec_websocket_extensions = NULL;
+                }
                 if (websocketserver_client->sec_websocket_key != NULL) {
                         free(websocketserver_client->sec_websocket_key);
                         websocketserver_client->sec_websocket_key = NULL;
@@ -2182,10 +3318,7 @@ __attribute__ ((visibility ("default"))) int medusa_websocketserver_client_oneve
                         free(websocketserver_client->http_parser_header_value);
                         websocketserver_client->http_parser_header_value = NULL;
                 }
-                if (!MEDUSA_IS_ERR_OR_NULL(websocketserver_client->tcpsocket)) {
-                        medusa_tcpsocket_destroy_unlocked(websocketserver_client->tcpsocket);
-                        websocketserver_client->tcpsocket = NULL;
-                }
+                websocketserver_client_destroy_tcpsocket(websocketserver_client);
                 if (websocketserver_client->websocketserver != NULL) {
                         TAILQ_REMOVE(&websocketserver_client->websocketserver->clients, websocketserver_client, list);
                         websocketserver_client->websocketserver = NULL;
@@ -2245,6 +3378,8 @@ __attribute__ ((visibility ("default"))) const char * medusa_websocketserver_cli
         if (events == MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_DISCONNECTED)                 return "MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_DISCONNECTED";
         if (events == MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_STATE_CHANGED)                return "MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_STATE_CHANGED";
         if (events == MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_DESTROY)                      return "MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_DESTROY";
+        if (events == MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_FRAMES_DROPPED)               return "MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_FRAMES_DROPPED";
+        if (events == MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_MESSAGE_CHUNK)                return "MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_MESSAGE_CHUNK";
         return "MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_UNKNOWN";
 }
 
@@ -2271,17 +3406,72 @@ __attribute__ ((visibility ("default"))) const char * medusa_websocketserver_cli
         return "MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_UNKNOWN";
 }
 
+__attribute__ ((visibility ("default"))) const char * medusa_websocketserver_client_backpressure_policy_string (unsigned int policy)
+{
+        if (policy == MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_NONE)           return "MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_NONE";
+        if (policy == MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_SKIP)           return "MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_SKIP";
+        if (policy == MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_DROP)           return "MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_DROP";
+        if (policy == MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_DISCONNECT)     return "MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_DISCONNECT";
+        return "MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_UNKNOWN";
+}
+
+__attribute__ ((visibility ("default"))) const char * medusa_websocketserver_client_message_mode_string (unsigned int mode)
+{
+        if (mode == MEDUSA_WEBSOCKETSERVER_CLIENT_MESSAGE_MODE_FRAME)           return "MEDUSA_WEBSOCKETSERVER_CLIENT_MESSAGE_MODE_FRAME";
+        if (mode == MEDUSA_WEBSOCKETSERVER_CLIENT_MESSAGE_MODE_STREAM)          return "MEDUSA_WEBSOCKETSERVER_CLIENT_MESSAGE_MODE_STREAM";
+        if (mode == MEDUSA_WEBSOCKETSERVER_CLIENT_MESSAGE_MODE_ASSEMBLE)        return "MEDUSA_WEBSOCKETSERVER_CLIENT_MESSAGE_MODE_ASSEMBLE";
+        return "MEDUSA_WEBSOCKETSERVER_CLIENT_MESSAGE_MODE_UNKNOWN";
+}
+
+static int websocketserver_subject_onevent (struct medusa_subject *subject, unsigned int events, void *param)
+{
+        return medusa_websocketserver_onevent_unlocked((struct medusa_websocketserver *) subject, events, param);
+}
+
+static int websocketserver_subject_destroy (struct medusa_subject *subject)
+{
+        return medusa_websocketserver_onevent_unlocked((struct medusa_websocketserver *) subject, MEDUSA_WEBSOCKETSERVER_EVENT_DESTROY, NULL);
+}
+
+static const struct medusa_subject_type g_subject_type_websocketserver = {
+        .rank    = MEDUSA_SUBJECT_RANK_WEBSOCKETSERVER,
+        .onevent = websocketserver_subject_onevent,
+        .destroy = websocketserver_subject_destroy
+};
+
+static int websocketserver_client_subject_onevent (struct medusa_subject *subject, unsigned int events, void *param)
+{
+        return medusa_websocketserver_client_onevent_unlocked((struct medusa_websocketserver_client *) subject, events, param);
+}
+
+static int websocketserver_client_subject_destroy (struct medusa_subject *subject)
+{
+        return medusa_websocketserver_client_onevent_unlocked((struct medusa_websocketserver_client *) subject, MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_DESTROY, NULL);
+}
+
+static const struct medusa_subject_type g_subject_type_websocketserver_client = {
+        .rank    = MEDUSA_SUBJECT_RANK_WEBSOCKETSERVER_CLIENT,
+        .onevent = websocketserver_client_subject_onevent,
+        .destroy = websocketserver_client_subject_destroy
+};
+
 __attribute__ ((constructor)) static void websocketserver_constructor (void)
 {
+        medusa_monitor_register_subject_type(MEDUSA_SUBJECT_TYPE_WEBSOCKETSERVER, &g_subject_type_websocketserver);
+        medusa_monitor_register_subject_type(MEDUSA_SUBJECT_TYPE_WEBSOCKETSERVER_CLIENT, &g_subject_type_websocketserver_client);
 #if defined(MEDUSA_WEBSOCKETSERVER_USE_POOL) && (MEDUSA_WEBSOCKETSERVER_USE_POOL == 1)
         g_pool_websocketserver = medusa_pool_create("medusa-websocketserver", sizeof(struct medusa_websocketserver), 0, 0, MEDUSA_POOL_FLAG_DEFAULT | MEDUSA_POOL_FLAG_THREAD_SAFE, NULL, NULL, NULL);
         g_pool_websocketserver_client = medusa_pool_create("medusa-websocketserver-client", sizeof(struct medusa_websocketserver_client), 0, 0, MEDUSA_POOL_FLAG_DEFAULT | MEDUSA_POOL_FLAG_THREAD_SAFE, NULL, NULL, NULL);
+        g_pool_websocketserver_client_frame = medusa_pool_create("medusa-websocketserver-client-frame", sizeof(struct medusa_websocketserver_client_frame), 0, 0, MEDUSA_POOL_FLAG_DEFAULT | MEDUSA_POOL_FLAG_THREAD_SAFE, NULL, NULL, NULL);
 #endif
 }
 
 __attribute__ ((destructor)) static void websocketserver_destructor (void)
 {
 #if defined(MEDUSA_WEBSOCKETSERVER_USE_POOL) && (MEDUSA_WEBSOCKETSERVER_USE_POOL == 1)
+        if (g_pool_websocketserver_client_frame != NULL) {
+                medusa_pool_destroy(g_pool_websocketserver_client_frame);
+        }
         if (g_pool_websocketserver_client != NULL) {
                 medusa_pool_destroy(g_pool_websocketserver_client);
         }
@@ -5,8 +5,10 @@
 struct sockaddr_storage;
 
 struct medusa_monitor;
+struct medusa_tcpsocket_stats;
 struct medusa_websocketserver;
 struct medusa_websocketserver_client;
+struct medusa_websocketserver_frame;
 
 enum {
         MEDUSA_WEBSOCKETSERVER_PROTOCOL_ANY                     = 0,
@@ -65,7 +67,9 @@ enum {
         MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_BUFFERED_WRITE_FINISHED     = (1 <<  8),
         MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_DISCONNECTED                = (1 <<  9),
         MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_STATE_CHANGED               = (1 << 10),
-        MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_DESTROY                     = (1 << 11)
+        MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_DESTROY                     = (1 << 11),
+        MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_FRAMES_DROPPED              = (1 << 12),
+        MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_MESSAGE_CHUNK               = (1 << 13)
 #define MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_ERROR                       MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_ERROR
 #define MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_ACCEPTED                    MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_ACCEPTED
 #define MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_REQUEST_RECEIVING           MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_REQUEST_RECEIVING
@@ -78,6 +82,8 @@ enum {
 #define MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_DISCONNECTED                MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_DISCONNECTED
 #define MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_STATE_CHANGED               MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_STATE_CHANGED
 #define MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_DESTROY                     MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_DESTROY
+#define MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_FRAMES_DROPPED              MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_FRAMES_DROPPED
+#define MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_MESSAGE_CHUNK               MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_MESSAGE_CHUNK
 };
 
 enum {
@@ -112,6 +118,26 @@ enum {
 #define MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_BINARY         MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_BINARY
 };
 
+enum {
+        MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_NONE          = 0,
+        MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_SKIP          = 1,
+        MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_DROP          = 2,
+        MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_DISCONNECT    = 3
+#define MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_NONE          MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_NONE
+#define MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_SKIP          MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_SKIP
+#define MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_DROP          MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_DROP
+#define MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_DISCONNECT    MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_DISCONNECT
+};
+
+enum {
+        MEDUSA_WEBSOCKETSERVER_CLIENT_MESSAGE_MODE_FRAME        = 0,
+        MEDUSA_WEBSOCKETSERVER_CLIENT_MESSAGE_MODE_STREAM       = 1,
+        MEDUSA_WEBSOCKETSERVER_CLIENT_MESSAGE_MODE_ASSEMBLE     = 2
+#define MEDUSA_WEBSOCKETSERVER_CLIENT_MESSAGE_MODE_FRAME        MEDUSA_WEBSOCKETSERVER_CLIENT_MESSAGE_MODE_FRAME
+#define MEDUSA_WEBSOCKETSERVER_CLIENT_MESSAGE_MODE_STREAM       MEDUSA_WEBSOCKETSERVER_CLIENT_MESSAGE_MODE_STREAM
+#define MEDUSA_WEBSOCKETSERVER_CLIENT_MESSAGE_MODE_ASSEMBLE     MEDUSA_WEBSOCKETSERVER_CLIENT_MESSAGE_MODE_ASSEMBLE
+};
+
 struct medusa_websocketserver_init_options {
         struct medusa_monitor *monitor;
         unsigned int protocol;
@@ -120,8 +146,14 @@ struct medusa_websocketserver_init_options {
         const char *servername;
         int reuseport;
         int backlog;
+        int stats;
         int enabled;
         int started;
+        int deflate_enabled;
+        int deflate_level;
+        int deflate_window_bits;
+        int deflate_no_context_takeover;
+        int64_t deflate_threshold;
         int (*onevent) (struct medusa_websocketserver *websocketserver, unsigned int events, void *context, void *param);
         void *context;
 };
@@ -130,6 +162,10 @@ struct medusa_websocketserver_accept_options {
         int enabled;
         double read_timeout;
         double write_timeout;
+        int64_t backpressure_limit;
+        unsigned int backpressure_policy;
+        unsigned int message_mode;
+        int64_t max_message_size;
         int (*onevent) (struct medusa_websocketserver_client *websocketserver_client, unsigned int events, void *context, void *param);
         void *context;
 };
@@ -156,6 +192,19 @@ struct medusa_websocketserver_client_event_buffered_write {
         int64_t remaining;
 };
 
+struct medusa_websocketserver_client_event_frames_dropped {
+        unsigned int count;
+        int64_t length;
+};
+
+struct medusa_websocketserver_client_event_message_chunk {
+        unsigned int final;
+        unsigned int type;
+        int64_t offset;
+        int64_t length;
+        const void *payload;
+};
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -173,6 +222,7 @@ int medusa_websocketserver_get_error (const struct medusa_websocketserver *webso
 int medusa_websocketserver_get_protocol (struct medusa_websocketserver *websocketserver);
 int medusa_websocketserver_get_sockport (const struct medusa_websocketserver *websocketserver);
 int medusa_websocketserver_get_sockname (const struct medusa_websocketserver *websocketserver, struct sockaddr_storage *sockaddr);
+int medusa_websocketserver_get_stats (const struct medusa_websocketserver *websocketserver, struct medusa_tcpsocket_stats *stats);
 
 int medusa_websocketserver_set_enabled (struct medusa_websocketserver *websocketserver, int enabled);
 int medusa_websocketserver_get_enabled (const struct medusa_websocketserver *websocketserver);
@@ -207,6 +257,15 @@ struct medusa_monitor * medusa_websocketserver_get_monitor (struct medusa_websoc
 const char * medusa_websocketserver_event_string (unsigned int events);
 const char * medusa_websocketserver_state_string (unsigned int state);
 
+struct medusa_websocketserver_frame * medusa_websocketserver_frame_create (unsigned int final, unsigned int type, const void *data, int64_t length);
+struct medusa_websocketserver_frame * medusa_websocketserver_frame_ref (struct medusa_websocketserver_frame *frame);
+void medusa_websocketserver_frame_unref (struct medusa_websocketserver_frame *frame);
+int64_t medusa_websocketserver_frame_get_length (const struct medusa_websocketserver_frame *frame);
+int64_t medusa_websocketserver_frame_get_refcount (const struct medusa_websocketserver_frame *frame);
+
+int medusa_websocketserver_broadcast (struct medusa_websocketserver *websocketserver, unsigned int final, unsigned int type, const void *data, int64_t length);
+int medusa_websocketserver_broadcast_frame (struct medusa_websocketserver *websocketserver, struct medusa_websocketserver_frame *frame);
+
 int medusa_websocketserver_accept_options_default (struct medusa_websocketserver_accept_options *options);
 
 struct medusa_websocketserver_client * medusa_websocketserver_accept (struct medusa_websocketserver *websocketserver, int (*onevent) (struct medusa_websocketserver_client *websocketserver_client, unsigned int events, void *context, void *param), void *context);
@@ -222,6 +281,10 @@ struct medusa_buffer * medusa_websocketserver_client_get_read_buffer (const stru
 struct medusa_buffer * medusa_websocketserver_client_get_write_buffer (const struct medusa_websocketserver_client *websocketserver_client);
 
 int64_t medusa_websocketserver_client_write (struct medusa_websocketserver_client *websocketserver_client, unsigned int final, unsigned int type, const void *data, int64_t length);
+int64_t medusa_websocketserver_client_write_frame (struct medusa_websocketserver_client *websocketserver_client, struct medusa_websocketserver_frame *frame);
+int64_t medusa_websocketserver_client_get_pending (const struct medusa_websocketserver_client *websocketserver_client);
+
+int medusa_websocketserver_client_set_backpressure (struct medusa_websocketserver_client *websocketserver_client, int64_t limit, unsigned int policy);
 
 int medusa_websocketserver_client_get_sockname (struct medusa_websocketserver_client *websocketserver_client, struct sockaddr_storage *sockaddr);
 int medusa_websocketserver_client_get_peername (struct medusa_websocketserver_client *websocketserver_client, struct sockaddr_storage *sockaddr);
@@ -247,6 +310,8 @@ struct medusa_monitor * medusa_websocketserver_client_get_monitor (struct medusa
 const char * medusa_websocketserver_client_event_string (unsigned int events);
 const char * medusa_websocketserver_client_state_string (unsigned int state);
 const char * medusa_websocketserver_client_frame_type_string (unsigned int type);
+const char * medusa_websocketserver_client_backpressure_policy_string (unsigned int policy);
+const char * medusa_websocketserver_client_message_mode_string (unsigned int mode);
 
 #ifdef __cplusplus
 }
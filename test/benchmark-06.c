@@ -0,0 +1,228 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include <time.h>
+#include <signal.h>
+
+#include "medusa/error.h"
+#include "medusa/clock.h"
+#include "medusa/iovec.h"
+#include "medusa/buffer.h"
+#include "medusa/websocket-mask.h"
+
+static const unsigned int g_types[] = {
+        MEDUSA_WEBSOCKET_MASK_TYPE_DEFAULT,
+        MEDUSA_WEBSOCKET_MASK_TYPE_BYTE,
+        MEDUSA_WEBSOCKET_MASK_TYPE_WORD,
+        MEDUSA_WEBSOCKET_MASK_TYPE_SSE2,
+        MEDUSA_WEBSOCKET_MASK_TYPE_AVX2
+};
+
+static void reference_mask (uint8_t *data, int64_t length, const uint8_t *mask, unsigned int offset)
+{
+        int64_t i;
+        for (i = 0; i < length; i++) {
+                data[i] ^= mask[(offset + i) & 3];
+        }
+}
+
+static int test_verify (unsigned int type)
+{
+        unsigned int i;
+        unsigned int j;
+        unsigned int length;
+        unsigned int offset;
+        unsigned int phase;
+        uint8_t mask[4];
+        uint8_t data[256 + 32];
+        uint8_t check[256 + 32];
+
+        for (i = 0; i < 1000; i++) {
+                mask[0] = rand();
+                mask[1] = rand();
+                mask[2] = rand();
+                mask[3] = rand();
+                length  = rand() % 256;
+                offset  = rand() % 32;
+                phase   = rand() % 4;
+                for (j = 0; j < sizeof(data); j++) {
+                        data[j] = rand();
+                }
+                memcpy(check, data, sizeof(data));
+                reference_mask(check + offset, length, mask, phase);
+                if (medusa_websocket_mask_with_type(type, data + offset, length, mask, phase) != ((phase + length) & 3)) {
+                        fprintf(stderr, "  invalid phase\n");
+                        return -1;
+                }
+                if (memcmp(data, check, sizeof(data)) != 0) {
+                        fprintf(stderr, "  invalid data, length: %u, offset: %u, phase: %u\n", length, offset, phase);
+                        return -1;
+                }
+        }
+        return 0;
+}
+
+static int test_buffer (void)
+{
+        int rc;
+        int64_t i;
+        int64_t niovecs;
+        uint8_t mask[4];
+        uint8_t data[4000];
+        uint8_t check[4000];
+        struct medusa_buffer *buffer;
+
+        buffer = medusa_buffer_create(MEDUSA_BUFFER_TYPE_RING);
+        if (MEDUSA_IS_ERR_OR_NULL(buffer)) {
+                return -1;
+        }
+        for (i = 0; i < (int64_t) sizeof(data); i++) {
+                data[i] = rand();
+        }
+        mask[0] = rand();
+        mask[1] = rand();
+        mask[2] = rand();
+        mask[3] = rand();
+
+        /* move the ring head forward so that the payload wraps */
+        rc = medusa_buffer_append(buffer, data, sizeof(data));
+        if (rc < 0) {
+                goto bail;
+        }
+        rc = medusa_buffer_choke(buffer, 0, 3000);
+        if (rc < 0) {
+                goto bail;
+        }
+        rc = medusa_buffer_append(buffer, data, 3000);
+        if (rc < 0) {
+                goto bail;
+        }
+        niovecs = medusa_buffer_peekv(buffer, 0, -1, NULL, 0);
+        if (niovecs != 2) {
+                fprintf(stderr, "  buffer does not wrap, iovecs: %d\n", (int) niovecs);
+                goto bail;
+        }
+
+        memcpy(check, data + 3000, 1000);
+        memcpy(check + 1000, data, 3000);
+        reference_mask(check + 7, sizeof(check) - 7, mask, 0);
+        rc = medusa_websocket_mask_buffer(buffer, 7, sizeof(check) - 7, mask);
+        if (rc < 0) {
+                goto bail;
+        }
+        rc = medusa_buffer_peek_data(buffer, 0, data, sizeof(data));
+        if (rc < 0) {
+                goto bail;
+        }
+        if (memcmp(data, check, sizeof(data)) != 0) {
+                fprintf(stderr, "  invalid buffer data\n");
+                goto bail;
+        }
+
+        medusa_buffer_destroy(buffer);
+        return 0;
+bail:   medusa_buffer_destroy(buffer);
+        return -1;
+}
+
+static int test_throughput (unsigned int type, unsigned int size, unsigned int loops)
+{
+        unsigned int i;
+        uint8_t mask[4];
+        uint8_t *data;
+        uint64_t usecs;
+        struct timespec ts;
+        struct timespec te;
+
+        data = malloc(size);
+        if (data == NULL) {
+                return -1;
+        }
+        memset(data, 0x5a, size);
+        mask[0] = 0x01;
+        mask[1] = 0x02;
+        mask[2] = 0x03;
+        mask[3] = 0x04;
+
+        medusa_clock_monotonic(&ts);
+        for (i = 0; i < loops; i++) {
+                medusa_websocket_mask_with_type(type, data, size, mask, 0);
+        }
+        medusa_clock_monotonic(&te);
+        medusa_timespec_sub(&te, &ts, &te);
+
+        usecs = te.tv_sec * 1000000ULL + te.tv_nsec / 1000;
+        if (usecs == 0) {
+                usecs = 1;
+        }
+        fprintf(stderr, "  size: %u, loops: %u, usecs: %llu, throughput: %.2f MB/s\n",
+                size, loops, (unsigned long long) usecs,
+                ((double) size * loops) / ((double) usecs));
+
+        free(data);
+        return 0;
+}
+
+static void alarm_handler (int sig)
+{
+        (void) sig;
+        abort();
+}
+
+int main (int argc, char *argv[])
+{
+        int c;
+        int rc;
+        unsigned int i;
+        unsigned int size;
+        unsigned int loops;
+
+        srand(time(NULL));
+        signal(SIGALRM, alarm_handler);
+
+        size  = 1024 * 1024;
+        loops = 64;
+
+        while ((c = getopt(argc, argv, "s:l:")) != -1) {
+                switch (c) {
+                        case 's':
+                                size = atoi(optarg);
+                                break;
+                        case 'l':
+                                loops = atoi(optarg);
+                                break;
+                }
+        }
+
+        alarm(10);
+
+        fprintf(stderr, "testing buffer\n");
+        rc = test_buffer();
+        if (rc != 0) {
+                return -1;
+        }
+
+        for (i = 0; i < sizeof(g_types) / sizeof(g_types[0]); i++) {
+                if (!medusa_websocket_mask_type_supported(g_types[i])) {
+                        fprintf(stderr, "skipping type: %s\n", medusa_websocket_mask_type_string(g_types[i]));
+                        continue;
+                }
+                fprintf(stderr, "testing type: %s\n", medusa_websocket_mask_type_string(g_types[i]));
+                rc = test_verify(g_types[i]);
+                if (rc != 0) {
+                        return -1;
+                }
+                rc = test_throughput(g_types[i], size, loops);
+                if (rc != 0) {
+                        return -1;
+                }
+        }
+
+        return 0;
+}
@@ -0,0 +1,368 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include <time.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "medusa/error.h"
+#include "medusa/clock.h"
+#include "medusa/websocketserver.h"
+#include "medusa/websocketclient.h"
+#include "medusa/websocket-deflate.h"
+#include "medusa/monitor.h"
+
+struct bench {
+        const char *name;
+        int deflate;
+        int no_context_takeover;
+};
+
+static const struct bench g_benchs[] = {
+        { "plain",                       0, 0 },
+        { "deflate",                     1, 0 },
+        { "deflate-no-context-takeover", 1, 1 },
+};
+
+static unsigned int g_nclients;
+static unsigned int g_nmessages;
+static unsigned int g_size;
+
+static char *g_payload;
+static int64_t *g_offsets;
+
+static unsigned int g_connected;
+static unsigned int g_finished;
+static unsigned int g_received;
+static int64_t g_payload_bytes;
+static int64_t g_wire_bytes;
+static int g_error;
+
+static const char * payload_message (unsigned int index, unsigned int *length)
+{
+        *length = g_offsets[index + 1] - g_offsets[index];
+        return g_payload + g_offsets[index];
+}
+
+static int payload_create (void)
+{
+        int rc;
+        unsigned int i;
+        int64_t offset;
+        g_payload = malloc((int64_t) (g_size + 128) * g_nmessages);
+        if (g_payload == NULL) {
+                return -1;
+        }
+        g_offsets = malloc(sizeof(int64_t) * (g_nmessages + 1));
+        if (g_offsets == NULL) {
+                return -1;
+        }
+        /* json like payload, the usual workload of a websocket api */
+        offset = 0;
+        for (i = 0; i < g_nmessages; i++) {
+                g_offsets[i] = offset;
+                rc = sprintf(g_payload + offset, "{\"id\":%u,\"items\":[", i);
+                offset += rc;
+                while (offset - g_offsets[i] < g_size) {
+                        rc = sprintf(g_payload + offset, "{\"symbol\":\"SYM%03u\",\"price\":%u.%02u,\"volume\":%u,\"status\":\"active\"},", rand() % 100, rand() % 1000, rand() % 100, rand() % 100000);
+                        offset += rc;
+                }
+                rc = sprintf(g_payload + offset, "{}]}");
+                offset += rc;
+        }
+        g_offsets[i] = offset;
+        return 0;
+}
+
+static int websocketserver_client_onevent (struct medusa_websocketserver_client *websocketserver_client, unsigned int events, void *context, void *param)
+{
+        unsigned int length;
+        const char *message;
+        (void) context;
+        if (events & MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_BUFFERED_WRITE) {
+                struct medusa_websocketserver_client_event_buffered_write *medusa_websocketserver_client_event_buffered_write = (struct medusa_websocketserver_client_event_buffered_write *) param;
+                g_wire_bytes += medusa_websocketserver_client_event_buffered_write->length;
+        }
+        if (events & MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_MESSAGE) {
+                struct medusa_websocketserver_client_event_message *medusa_websocketserver_client_event_message = (struct medusa_websocketserver_client_event_message *) param;
+                message = payload_message(0, &length);
+                if (medusa_websocketserver_client_event_message->length != length ||
+                    memcmp(medusa_websocketserver_client_event_message->payload, message, length) != 0) {
+                        fprintf(stderr, "  server received invalid message\n");
+                        g_error = 1;
+                        return medusa_monitor_break(medusa_websocketserver_client_get_monitor(websocketserver_client));
+                }
+                g_received += 1;
+        }
+        if (events & MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_ERROR) {
+                fprintf(stderr, "  server client error\n");
+                g_error = 1;
+                return medusa_monitor_break(medusa_websocketserver_client_get_monitor(websocketserver_client));
+        }
+        return 0;
+}
+
+static int websocketserver_onevent (struct medusa_websocketserver *websocketserver, unsigned int events, void *context, void *param)
+{
+        struct medusa_websocketserver_client *websocketserver_client;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_WEBSOCKETSERVER_EVENT_CONNECTION) {
+                websocketserver_client = medusa_websocketserver_accept(websocketserver, websocketserver_client_onevent, NULL);
+                if (MEDUSA_IS_ERR_OR_NULL(websocketserver_client)) {
+                        return MEDUSA_PTR_ERR(websocketserver_client);
+                }
+        }
+        return 0;
+}
+
+static int websocketclient_onevent (struct medusa_websocketclient *websocketclient, unsigned int events, void *context, void *param)
+{
+        int rc;
+        unsigned int i;
+        unsigned int length;
+        const char *message;
+        unsigned int *received = medusa_websocketclient_get_userdata(websocketclient);
+        struct medusa_websocketserver *websocketserver = context;
+        if (events & MEDUSA_WEBSOCKETCLIENT_EVENT_CONNECTED) {
+                message = payload_message(0, &length);
+                rc = medusa_websocketclient_write(websocketclient, 1, MEDUSA_WEBSOCKETCLIENT_FRAME_TYPE_TEXT, message, length);
+                if (rc < 0) {
+                        return rc;
+                }
+                g_connected += 1;
+                if (g_connected == g_nclients) {
+                        for (i = 0; i < g_nmessages; i++) {
+                                message = payload_message(i, &length);
+                                rc = medusa_websocketserver_broadcast(websocketserver, 1, MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_TEXT, message, length);
+                                if (rc != (int) g_nclients) {
+                                        fprintf(stderr, "  broadcast failed, rc: %d\n", rc);
+                                        g_error = 1;
+                                        return medusa_monitor_break(medusa_websocketclient_get_monitor(websocketclient));
+                                }
+                        }
+                }
+        }
+        if (events & MEDUSA_WEBSOCKETCLIENT_EVENT_MESSAGE) {
+                struct medusa_websocketclient_event_message *medusa_websocketclient_event_message = (struct medusa_websocketclient_event_message *) param;
+                if (*received >= g_nmessages) {
+                        fprintf(stderr, "  client received too many messages\n");
+                        g_error = 1;
+                        return medusa_monitor_break(medusa_websocketclient_get_monitor(websocketclient));
+                }
+                message = payload_message(*received, &length);
+                if (medusa_websocketclient_event_message->length != length ||
+                    memcmp(medusa_websocketclient_event_message->payload, message, length) != 0) {
+                        fprintf(stderr, "  client received invalid message: %u\n", *received);
+                        g_error = 1;
+                        return medusa_monitor_break(medusa_websocketclient_get_monitor(websocketclient));
+                }
+                g_payload_bytes += length;
+                *received += 1;
+                if (*received == g_nmessages) {
+                        g_finished += 1;
+                        if (g_finished == g_nclients) {
+                                return medusa_monitor_break(medusa_websocketclient_get_monitor(websocketclient));
+                        }
+                }
+        }
+        if (events & MEDUSA_WEBSOCKETCLIENT_EVENT_ERROR) {
+                fprintf(stderr, "  client error\n");
+                g_error = 1;
+                return medusa_monitor_break(medusa_websocketclient_get_monitor(websocketclient));
+        }
+        return 0;
+}
+
+static uint64_t rusage_usecs (void)
+{
+        struct rusage rusage;
+        getrusage(RUSAGE_SELF, &rusage);
+        return (rusage.ru_utime.tv_sec + rusage.ru_stime.tv_sec) * 1000000ULL + rusage.ru_utime.tv_usec + rusage.ru_stime.tv_usec;
+}
+
+static int test_bench (const struct bench *bench)
+{
+        int rc;
+        int port;
+        unsigned int i;
+        unsigned int *received;
+        uint64_t usecs;
+        uint64_t cpu;
+        struct timespec ts;
+        struct timespec te;
+        struct medusa_monitor *monitor;
+        struct medusa_websocketserver *websocketserver;
+        struct medusa_websocketclient *websocketclient;
+        struct medusa_websocketserver_init_options websocketserver_init_options;
+        struct medusa_websocketclient_connect_options websocketclient_connect_options;
+
+        g_connected = 0;
+        g_finished  = 0;
+        g_received  = 0;
+        g_payload_bytes   = 0;
+        g_wire_bytes   = 0;
+        g_error     = 0;
+
+        received = calloc(g_nclients, sizeof(unsigned int));
+        if (received == NULL) {
+                return -1;
+        }
+
+        monitor = medusa_monitor_create_with_options(NULL);
+        if (MEDUSA_IS_ERR_OR_NULL(monitor)) {
+                goto bail;
+        }
+
+        rc = medusa_websocketserver_init_options_default(&websocketserver_init_options);
+        if (rc < 0) {
+                goto bail;
+        }
+        websocketserver_init_options.monitor                     = monitor;
+        websocketserver_init_options.protocol                    = MEDUSA_WEBSOCKETSERVER_PROTOCOL_IPV4;
+        websocketserver_init_options.address                     = "127.0.0.1";
+        websocketserver_init_options.port                        = 0;
+        websocketserver_init_options.reuseport                   = 0;
+        websocketserver_init_options.enabled                     = 1;
+        websocketserver_init_options.started                     = 1;
+        websocketserver_init_options.deflate_enabled             = bench->deflate;
+        websocketserver_init_options.deflate_no_context_takeover = bench->no_context_takeover;
+        websocketserver_init_options.onevent                     = websocketserver_onevent;
+        websocketserver_init_options.context                     = NULL;
+        websocketserver = medusa_websocketserver_create_with_options(&websocketserver_init_options);
+        if (MEDUSA_IS_ERR_OR_NULL(websocketserver)) {
+                fprintf(stderr, "  medusa_websocketserver_create_with_options failed\n");
+                goto bail;
+        }
+        port = medusa_websocketserver_get_sockport(websocketserver);
+        if (port <= 0) {
+                fprintf(stderr, "  medusa_websocketserver_get_sockport failed, port: %d\n", port);
+                goto bail;
+        }
+
+        for (i = 0; i < g_nclients; i++) {
+                rc = medusa_websocketclient_connect_options_default(&websocketclient_connect_options);
+                if (rc < 0) {
+                        goto bail;
+                }
+                websocketclient_connect_options.monitor         = monitor;
+                websocketclient_connect_options.protocol        = MEDUSA_WEBSOCKETCLIENT_PROTOCOL_IPV4;
+                websocketclient_connect_options.address         = "127.0.0.1";
+                websocketclient_connect_options.port            = port;
+                websocketclient_connect_options.server_path     = "/";
+                websocketclient_connect_options.server_protocol = "benchmark";
+                websocketclient_connect_options.deflate_enabled = bench->deflate;
+                websocketclient_connect_options.enabled         = 1;
+                websocketclient_connect_options.onevent         = websocketclient_onevent;
+                websocketclient_connect_options.context         = websocketserver;
+                websocketclient = medusa_websocketclient_connect_with_options(&websocketclient_connect_options);
+                if (MEDUSA_IS_ERR_OR_NULL(websocketclient)) {
+                        fprintf(stderr, "  medusa_websocketclient_connect_with_options failed\n");
+                        goto bail;
+                }
+                medusa_websocketclient_set_userdata(websocketclient, &received[i]);
+        }
+
+        cpu = rusage_usecs();
+        medusa_clock_monotonic(&ts);
+        rc = medusa_monitor_run(monitor);
+        if (rc < 0) {
+                goto bail;
+        }
+        medusa_clock_monotonic(&te);
+        medusa_timespec_sub(&te, &ts, &te);
+        cpu = rusage_usecs() - cpu;
+
+        if (g_error != 0 || g_finished != g_nclients || g_received != g_nclients) {
+                fprintf(stderr, "  failed, finished: %u, received: %u\n", g_finished, g_received);
+                goto bail;
+        }
+
+        usecs = te.tv_sec * 1000000ULL + te.tv_nsec / 1000;
+        fprintf(stderr, "  name: %s, clients: %u, messages: %u, payload: %lld, wire: %lld, ratio: %.3f, usecs: %llu, cpu: %llu\n",
+                bench->name, g_nclients, g_nmessages,
+                (long long) g_payload_bytes, (long long) g_wire_bytes,
+                (g_payload_bytes > 0) ? ((double) g_wire_bytes / (double) g_payload_bytes) : 0,
+                (unsigned long long) usecs, (unsigned long long) cpu);
+        if (bench->deflate && g_wire_bytes >= g_payload_bytes) {
+                fprintf(stderr, "  compression did not reduce the wire bytes\n");
+                goto bail;
+        }
+
+        medusa_monitor_destroy(monitor);
+        free(received);
+        return 0;
+bail:   if (!MEDUSA_IS_ERR_OR_NULL(monitor)) {
+                medusa_monitor_destroy(monitor);
+        }
+        free(received);
+        return -1;
+}
+
+static void alarm_handler (int sig)
+{
+        (void) sig;
+        abort();
+}
+
+int main (int argc, char *argv[])
+{
+        int c;
+        int rc;
+        unsigned int i;
+
+        srand(time(NULL));
+        signal(SIGALRM, alarm_handler);
+        signal(SIGPIPE, SIG_IGN);
+
+        g_nclients  = 4;
+        g_nmessages = 1000;
+        g_size      = 4096;
+
+        while ((c = getopt(argc, argv, "c:m:s:")) != -1) {
+                switch (c) {
+                        case 'c':
+                                g_nclients = atoi(optarg);
+                                break;
+                        case 'm':
+                                g_nmessages = atoi(optarg);
+                                break;
+                        case 's':
+                                g_size = atoi(optarg);
+                                break;
+                }
+        }
+        if (g_nclients == 0 || g_nmessages == 0) {
+                return -1;
+        }
+
+        alarm(30);
+
+        rc = payload_create();
+        if (rc != 0) {
+                return -1;
+        }
+
+        for (i = 0; i < sizeof(g_benchs) / sizeof(g_benchs[0]); i++) {
+                if (g_benchs[i].deflate && !medusa_websocket_deflate_supported()) {
+                        fprintf(stderr, "skipping bench: %s\n", g_benchs[i].name);
+                        continue;
+                }
+                fprintf(stderr, "testing bench: %s\n", g_benchs[i].name);
+                rc = test_bench(&g_benchs[i]);
+                if (rc != 0) {
+                        return -1;
+                }
+        }
+
+        free(g_offsets);
+        free(g_payload);
+        return 0;
+}
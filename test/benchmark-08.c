@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+
+#include <time.h>
+#include <signal.h>
+
+#include "medusa/error.h"
+#include "medusa/clock.h"
+#include "medusa/io.h"
+#include "medusa/monitor.h"
+
+static const unsigned int g_polls[] = {
+        MEDUSA_MONITOR_POLL_DEFAULT,
+#if defined(__LINUX__)
+        MEDUSA_MONITOR_POLL_EPOLL,
+#endif
+#if defined(__APPLE__)
+        MEDUSA_MONITOR_POLL_KQUEUE,
+#endif
+        MEDUSA_MONITOR_POLL_POLL,
+        MEDUSA_MONITOR_POLL_SELECT,
+#if defined(__WINDOWS__)
+        MEDUSA_MONITOR_POLL_WSAPOLL,
+#endif
+};
+
+static int *g_pipes;
+static unsigned int *g_order;
+static unsigned int g_samples;
+static unsigned int g_npipes;
+static unsigned int g_count;
+static unsigned int g_failures;
+
+static struct medusa_io **g_ios;
+
+static int io_onevent (struct medusa_io *io, unsigned int events, void *context, void *param)
+{
+        ssize_t n;
+        unsigned char ch;
+
+        (void) context;
+        (void) param;
+
+        if (events & MEDUSA_IO_EVENT_IN) {
+                n = read(medusa_io_get_fd(io), (char *) &ch, sizeof(ch));
+                if (n == 1) {
+                        g_count += 1;
+                } else {
+                        g_failures++;
+                }
+        }
+
+        return 0;
+}
+
+static void shuffle (unsigned int *order, unsigned int count)
+{
+        unsigned int i;
+        unsigned int j;
+        unsigned int t;
+        for (i = 0; i < count; i++) {
+                order[i] = i;
+        }
+        for (i = count - 1; i > 0; i--) {
+                j = rand() % (i + 1);
+                t = order[i];
+                order[i] = order[j];
+                order[j] = t;
+        }
+}
+
+static int test_poll (unsigned int poll)
+{
+        int rc;
+        unsigned int i;
+        unsigned int j;
+        unsigned int k;
+
+        struct medusa_monitor *monitor;
+        struct medusa_monitor_init_options options;
+
+        struct timespec ts;
+        struct timespec te;
+        struct timespec tt;
+
+        monitor = NULL;
+        tt.tv_sec  = 0;
+        tt.tv_nsec = 0;
+
+        medusa_monitor_init_options_default(&options);
+        options.poll.type = poll;
+
+        monitor = medusa_monitor_create_with_options(&options);
+        if (monitor == NULL) {
+                goto bail;
+        }
+
+        for (j = 0; j < g_samples; j++) {
+                medusa_clock_monotonic(&ts);
+
+                for (i = 0; i < g_npipes; i++) {
+                        g_ios[i] = medusa_io_create(monitor, g_pipes[i * 2], io_onevent, NULL);
+                        if (MEDUSA_IS_ERR_OR_NULL(g_ios[i])) {
+                                goto bail;
+                        }
+                        rc  = medusa_io_set_events(g_ios[i], MEDUSA_IO_EVENT_IN);
+                        rc |= medusa_io_set_enabled(g_ios[i], 1);
+                        if (rc < 0) {
+                                goto bail;
+                        }
+                }
+                rc = medusa_monitor_run_timeout(monitor, 0.0);
+                if (rc < 0) {
+                        goto bail;
+                }
+
+                /* every registered descriptor must still be reachable */
+                k = rand() % g_npipes;
+                rc = write(g_pipes[k * 2 + 1], "e", 1);
+                if (rc != 1) {
+                        goto bail;
+                }
+                g_count = 0;
+                while (g_count != 1) {
+                        rc = medusa_monitor_run_timeout(monitor, 0.0);
+                        if (rc < 0) {
+                                goto bail;
+                        }
+                }
+
+                shuffle(g_order, g_npipes);
+                for (i = 0; i < g_npipes; i++) {
+                        medusa_io_destroy(g_ios[g_order[i]]);
+                        g_ios[g_order[i]] = NULL;
+                        if ((i % 16) == 0) {
+                                rc = medusa_monitor_run_timeout(monitor, 0.0);
+                                if (rc < 0) {
+                                        goto bail;
+                                }
+                        }
+                }
+                rc = medusa_monitor_run_timeout(monitor, 0.0);
+                if (rc < 0) {
+                        goto bail;
+                }
+
+                medusa_clock_monotonic(&te);
+                medusa_timespec_sub(&te, &ts, &te);
+                medusa_timespec_add(&tt, &te, &tt);
+        }
+
+        fprintf(stderr, "  pipes: %u, samples: %u, usecs: %lld\n", g_npipes, g_samples, (long long) (tt.tv_sec * 1000000 + tt.tv_nsec / 1000));
+
+        medusa_monitor_destroy(monitor);
+        return 0;
+bail:   if (monitor != NULL) {
+                medusa_monitor_destroy(monitor);
+        }
+        return -1;
+}
+
+static void alarm_handler (int sig)
+{
+        (void) sig;
+        abort();
+}
+
+int main (int argc, char *argv[])
+{
+        int c;
+        int rc;
+        unsigned int i;
+
+        srand(time(NULL));
+        signal(SIGALRM, alarm_handler);
+
+        g_samples  = 10;
+        g_pipes    = NULL;
+        g_npipes   = 400;
+
+        while ((c = getopt(argc, argv, "n:s:")) != -1) {
+                switch (c) {
+                        case 'n':
+                                g_npipes = atoi(optarg);
+                                break;
+                        case 's':
+                                g_samples = atoi(optarg);
+                                break;
+                        default:
+                                fprintf(stderr, "unknown param: %c", c);
+                                return -1;
+                }
+        }
+        if (g_npipes == 0) {
+                return -1;
+        }
+
+        g_ios = malloc(sizeof(struct medusa_io *) * g_npipes);
+        if (g_ios == NULL) {
+                return -1;
+        }
+        g_order = malloc(sizeof(unsigned int) * g_npipes);
+        if (g_order == NULL) {
+                return -1;
+        }
+        g_pipes = malloc(sizeof(int[2]) * g_npipes);
+        if (g_pipes == NULL) {
+                return -1;
+        }
+        for (i = 0; i < g_npipes; i++) {
+                rc = socketpair(AF_UNIX, SOCK_STREAM, 0, &g_pipes[i * 2]);
+                if (rc != 0) {
+                        return -1;
+                }
+        }
+
+        for (i = 0; i < sizeof(g_polls) / sizeof(g_polls[0]); i++) {
+                alarm(10);
+                if (g_polls[i] == MEDUSA_MONITOR_POLL_SELECT &&
+                    g_pipes[g_npipes * 2 - 1] >= FD_SETSIZE) {
+                        fprintf(stderr, "skipping poll: %d\n", g_polls[i]);
+                        continue;
+                }
+                fprintf(stderr, "testing poll: %d\n", g_polls[i]);
+
+                rc = test_poll(g_polls[i]);
+                if (rc != 0) {
+                        return -1;
+                }
+        }
+
+        for (i = 0; i < g_npipes; i++) {
+                close(g_pipes[i * 2]);
+                close(g_pipes[i * 2 + 1]);
+        }
+        free(g_pipes);
+        free(g_order);
+        free(g_ios);
+        return g_failures ? -1 : 0;
+}
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdarg.h>
+#include <signal.h>
+#include <pthread.h>
+
+#define MEDUSA_DEBUG_NAME       "debug-00"
+
+#include "medusa/debug.h"
+
+#define NTHREADS        4
+#define NRECORDS        2000
+
+static unsigned int g_lines;
+static pthread_key_t g_late_key;
+
+static int debug_callback (void *context, const char *format, ...)
+{
+        va_list ap;
+        char line[512];
+        (void) context;
+        va_start(ap, format);
+        vsnprintf(line, sizeof(line), format, ap);
+        va_end(ap);
+        if (strstr(line, "record: ") != NULL) {
+                __atomic_add_fetch(&g_lines, 1, __ATOMIC_RELAXED);
+        }
+        return 0;
+}
+
+/* runs after the ring of the thread is released */
+static void late_destructor (void *context)
+{
+        medusa_errorf("record: late, thread: %p", context);
+}
+
+static void * logger_thread (void *context)
+{
+        int i;
+        (void) context;
+        for (i = 0; i < NRECORDS; i++) {
+                medusa_errorf("record: %d, thread: %p", i, (void *) &i);
+                if ((i % 64) == 0) {
+                        usleep(1000);
+                }
+        }
+        pthread_setspecific(g_late_key, &i);
+        return NULL;
+}
+
+static void alarm_handler (int sig)
+{
+        (void) sig;
+        abort();
+}
+
+int main (int argc, char *argv[])
+{
+        int rc;
+        unsigned int i;
+        unsigned long long dropped;
+        pthread_t threads[NTHREADS];
+
+        (void) argc;
+        (void) argv;
+
+        signal(SIGALRM, alarm_handler);
+        alarm(10);
+
+        medusa_debug_set_callback(debug_callback, NULL);
+        rc = medusa_debug_set_async(1);
+        if (rc < 0) {
+                fprintf(stderr, "can not enable async logging\n");
+                return -1;
+        }
+        medusa_errorf("start");
+        rc = pthread_key_create(&g_late_key, late_destructor);
+        if (rc != 0) {
+                return -1;
+        }
+
+        for (i = 0; i < NTHREADS; i++) {
+                rc = pthread_create(&threads[i], NULL, logger_thread, NULL);
+                if (rc != 0) {
+                        return -1;
+                }
+        }
+        for (i = 0; i < NTHREADS; i++) {
+                pthread_join(threads[i], NULL);
+        }
+
+        /* records of exited threads are still drained */
+        rc = medusa_debug_set_async(0);
+        if (rc < 0) {
+                return -1;
+        }
+        dropped = medusa_debug_get_dropped();
+        fprintf(stderr, "lines: %u, dropped: %llu\n", g_lines, dropped);
+        if (g_lines + dropped != NTHREADS * (NRECORDS + 1)) {
+                return -1;
+        }
+        if (g_lines == 0) {
+                return -1;
+        }
+        medusa_debug_set_callback(NULL, NULL);
+        return 0;
+}
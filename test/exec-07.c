@@ -0,0 +1,176 @@
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+
+#include "medusa/error.h"
+#include "medusa/buffer.h"
+#include "medusa/exec.h"
+#include "medusa/monitor.h"
+
+#if !defined(__LINUX__)
+
+int main (int argc, char *argv[])
+{
+        (void) argc;
+        (void) argv;
+        fprintf(stderr, "not supported\n");
+        return 0;
+}
+
+#else
+
+static const unsigned int g_polls[] = {
+        MEDUSA_MONITOR_POLL_DEFAULT,
+#if defined(__LINUX__)
+        MEDUSA_MONITOR_POLL_EPOLL,
+#endif
+#if defined(__APPLE__)
+        MEDUSA_MONITOR_POLL_KQUEUE,
+#endif
+        MEDUSA_MONITOR_POLL_POLL,
+        MEDUSA_MONITOR_POLL_SELECT,
+#if defined(__WINDOWS__)
+        MEDUSA_MONITOR_POLL_WSAPOLL,
+#endif
+};
+
+struct test {
+        int stopped;
+        int finished;
+        int64_t out;
+        int64_t err;
+};
+
+static int exec_onevent (struct medusa_exec *exec, unsigned int events, void *context, void *param)
+{
+        struct test *test = (struct test *) context;
+        (void) param;
+        if (events & MEDUSA_EXEC_EVENT_STDIN_WRITE_FINISHED) {
+                test->finished = 1;
+        }
+        if (events & MEDUSA_EXEC_EVENT_STDOUT_READ) {
+                test->out = medusa_buffer_get_length(medusa_exec_get_stdout_buffer(exec));
+        }
+        if (events & MEDUSA_EXEC_EVENT_STDERR_READ) {
+                test->err = medusa_buffer_get_length(medusa_exec_get_stderr_buffer(exec));
+        }
+        if (events & MEDUSA_EXEC_EVENT_STOPPED) {
+                if (medusa_exec_get_wstatus(exec) != 0) {
+                        return -1;
+                }
+                if (medusa_buffer_memcmp(medusa_exec_get_stdout_buffer(exec), 0, "hello medusa", 12) != 0) {
+                        return -1;
+                }
+                if (medusa_buffer_memcmp(medusa_exec_get_stderr_buffer(exec), 0, "error\n", 6) != 0) {
+                        return -1;
+                }
+                test->stopped = 1;
+        }
+        return 0;
+}
+
+static int test_poll (unsigned int poll)
+{
+        int rc;
+
+        struct medusa_monitor *monitor;
+        struct medusa_monitor_init_options options;
+
+        struct test test;
+        struct medusa_exec *exec;
+        struct medusa_exec_init_options exec_init_options;
+
+        monitor = NULL;
+
+        medusa_monitor_init_options_default(&options);
+        options.poll.type = poll;
+
+        monitor = medusa_monitor_create_with_options(&options);
+        if (monitor == NULL) {
+                goto bail;
+        }
+
+        memset(&test, 0, sizeof(struct test));
+        medusa_exec_init_options_default(&exec_init_options);
+        exec_init_options.monitor = monitor;
+        exec_init_options.argv    = (const char *[]) { "sh", "-c", "cat; echo error >&2", NULL };
+        exec_init_options.onevent = exec_onevent;
+        exec_init_options.context = &test;
+        exec_init_options.stdio   = MEDUSA_EXEC_STDIO_ALL;
+        exec = medusa_exec_create_with_options(&exec_init_options);
+        if (MEDUSA_IS_ERR_OR_NULL(exec)) {
+                goto bail;
+        }
+        rc = medusa_buffer_printf(medusa_exec_get_stdin_buffer(exec), "hello medusa");
+        if (rc != 12) {
+                goto bail;
+        }
+        rc = medusa_exec_close_stdin(exec);
+        if (rc < 0) {
+                goto bail;
+        }
+        rc = medusa_exec_set_enabled(exec, 1);
+        if (rc < 0) {
+                goto bail;
+        }
+
+        while (1) {
+                rc = medusa_monitor_run_timeout(monitor, 1.0);
+                if (rc < 0) {
+                        goto bail;
+                }
+                if (rc == 0) {
+                        goto bail;
+                }
+                if (test.stopped) {
+                        break;
+                }
+        }
+        if (test.finished != 1 || test.out != 12 || test.err != 6) {
+                goto bail;
+        }
+
+        medusa_monitor_destroy(monitor);
+        return 0;
+bail:   if (monitor != NULL) {
+                medusa_monitor_destroy(monitor);
+        }
+        return -1;
+}
+
+static void alarm_handler (int sig)
+{
+        (void) sig;
+        abort();
+}
+
+int main (int argc, char *argv[])
+{
+        int rc;
+        unsigned int i;
+
+        (void) argc;
+        (void) argv;
+
+        srand(time(NULL));
+        signal(SIGALRM, alarm_handler);
+
+        for (i = 0; i < sizeof(g_polls) / sizeof(g_polls[0]); i++) {
+                alarm(5);
+                fprintf(stderr, "testing poll: %d\n", g_polls[i]);
+
+                rc = test_poll(g_polls[i]);
+                if (rc != 0) {
+                        return -1;
+                }
+        }
+        return 0;
+}
+
+#endif
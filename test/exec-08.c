@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+
+#include "medusa/error.h"
+#include "medusa/buffer.h"
+#include "medusa/timer.h"
+#include "medusa/exec.h"
+#include "medusa/monitor.h"
+
+#if !defined(__LINUX__)
+
+int main (int argc, char *argv[])
+{
+        (void) argc;
+        (void) argv;
+        fprintf(stderr, "not supported\n");
+        return 0;
+}
+
+#else
+
+static const unsigned int g_polls[] = {
+        MEDUSA_MONITOR_POLL_DEFAULT,
+#if defined(__LINUX__)
+        MEDUSA_MONITOR_POLL_EPOLL,
+#endif
+#if defined(__APPLE__)
+        MEDUSA_MONITOR_POLL_KQUEUE,
+#endif
+        MEDUSA_MONITOR_POLL_POLL,
+        MEDUSA_MONITOR_POLL_SELECT,
+#if defined(__WINDOWS__)
+        MEDUSA_MONITOR_POLL_WSAPOLL,
+#endif
+};
+
+struct test {
+        int run;
+        int stopped;
+        int64_t wstatus;
+};
+
+static int exec_onevent (struct medusa_exec *exec, unsigned int events, void *context, void *param)
+{
+        struct test *test = (struct test *) context;
+        (void) param;
+        if (events & MEDUSA_EXEC_EVENT_STDOUT_READ) {
+                /* each run echoes its own input, then gets killed */
+                if (medusa_buffer_get_length(medusa_exec_get_stdout_buffer(exec)) < 3) {
+                        return 0;
+                }
+                if (medusa_buffer_memcmp(medusa_exec_get_stdout_buffer(exec), 0, (test->run == 0) ? "one" : "two", 3) != 0) {
+                        return -1;
+                }
+                return medusa_exec_set_enabled(exec, 0);
+        }
+        if (events & MEDUSA_EXEC_EVENT_STOPPED) {
+                test->wstatus = medusa_exec_get_wstatus(exec);
+                test->stopped += 1;
+        }
+        return 0;
+}
+
+static int timer_onevent (struct medusa_timer *timer, unsigned int events, void *context, void *param)
+{
+        struct medusa_exec *exec = (struct medusa_exec *) context;
+        (void) timer;
+        (void) param;
+        if (events & MEDUSA_TIMER_EVENT_TIMEOUT) {
+                /* stdin of the second run must still be open */
+                if (medusa_buffer_printf(medusa_exec_get_stdin_buffer(exec), "two") != 3) {
+                        return -1;
+                }
+        }
+        return 0;
+}
+
+static int test_restart (struct medusa_monitor *monitor)
+{
+        int rc;
+        struct test test;
+        struct medusa_exec *exec;
+        struct medusa_timer *timer;
+        struct medusa_exec_init_options exec_init_options;
+
+        memset(&test, 0, sizeof(struct test));
+        medusa_exec_init_options_default(&exec_init_options);
+        exec_init_options.monitor = monitor;
+        exec_init_options.argv    = (const char *[]) { "sh", "-c", "cat; exec sleep 10", NULL };
+        exec_init_options.onevent = exec_onevent;
+        exec_init_options.context = &test;
+        exec_init_options.stdio   = MEDUSA_EXEC_STDIO_STDIN | MEDUSA_EXEC_STDIO_STDOUT;
+        exec = medusa_exec_create_with_options(&exec_init_options);
+        if (MEDUSA_IS_ERR_OR_NULL(exec)) {
+                return -1;
+        }
+        rc = medusa_buffer_printf(medusa_exec_get_stdin_buffer(exec), "one");
+        if (rc != 3) {
+                return -1;
+        }
+        rc = medusa_exec_close_stdin(exec);
+        if (rc < 0) {
+                return -1;
+        }
+        rc = medusa_exec_set_enabled(exec, 1);
+        if (rc < 0) {
+                return -1;
+        }
+        while (test.stopped == 0) {
+                rc = medusa_monitor_run_timeout(monitor, 1.0);
+                if (rc <= 0) {
+                        return -1;
+                }
+        }
+
+        test.run = 1;
+        rc = medusa_exec_set_enabled(exec, 1);
+        if (rc < 0) {
+                return -1;
+        }
+        timer = medusa_timer_create_singleshot(monitor, 0.1, timer_onevent, exec);
+        if (MEDUSA_IS_ERR_OR_NULL(timer)) {
+                return -1;
+        }
+        while (test.stopped == 1) {
+                rc = medusa_monitor_run_timeout(monitor, 1.0);
+                if (rc <= 0) {
+                        return -1;
+                }
+        }
+        medusa_exec_destroy(exec);
+        return 0;
+}
+
+static int test_inplace (struct medusa_monitor *monitor)
+{
+        int rc;
+        int flags;
+        struct test test;
+        struct medusa_exec *exec;
+        struct medusa_exec_init_options exec_init_options;
+
+        /* a descriptor already at its stdio slot is not dup'ed, close on
+         * exec has to be cleared anyway */
+        flags = fcntl(2, F_GETFD);
+        if (flags < 0) {
+                return -1;
+        }
+        fcntl(2, F_SETFD, flags | FD_CLOEXEC);
+
+        memset(&test, 0, sizeof(struct test));
+        medusa_exec_init_options_default(&exec_init_options);
+        exec_init_options.monitor = monitor;
+        exec_init_options.argv    = (const char *[]) { "sh", "-c", "echo '  stderr in place' >&2", NULL };
+        exec_init_options.iov     = (int []) { -1, -1, 2 };
+        exec_init_options.onevent = exec_onevent;
+        exec_init_options.context = &test;
+        exec_init_options.enabled = 1;
+        exec = medusa_exec_create_with_options(&exec_init_options);
+        if (MEDUSA_IS_ERR_OR_NULL(exec)) {
+                fcntl(2, F_SETFD, flags);
+                return -1;
+        }
+        while (test.stopped == 0) {
+                rc = medusa_monitor_run_timeout(monitor, 1.0);
+                if (rc <= 0) {
+                        fcntl(2, F_SETFD, flags);
+                        return -1;
+                }
+        }
+        fcntl(2, F_SETFD, flags);
+        if (test.wstatus != 0) {
+                return -1;
+        }
+        medusa_exec_destroy(exec);
+        return 0;
+}
+
+static int test_poll (unsigned int poll)
+{
+        int rc;
+
+        struct medusa_monitor *monitor;
+        struct medusa_monitor_init_options options;
+
+        monitor = NULL;
+
+        medusa_monitor_init_options_default(&options);
+        options.poll.type = poll;
+
+        monitor = medusa_monitor_create_with_options(&options);
+        if (monitor == NULL) {
+                goto bail;
+        }
+
+        rc = test_restart(monitor);
+        if (rc < 0) {
+                fprintf(stderr, "  restart failed\n");
+                goto bail;
+        }
+        rc = test_inplace(monitor);
+        if (rc < 0) {
+                fprintf(stderr, "  inplace failed\n");
+                goto bail;
+        }
+
+        medusa_monitor_destroy(monitor);
+        return 0;
+bail:   if (monitor != NULL) {
+                medusa_monitor_destroy(monitor);
+        }
+        return -1;
+}
+
+static void alarm_handler (int sig)
+{
+        (void) sig;
+        abort();
+}
+
+int main (int argc, char *argv[])
+{
+        int rc;
+        unsigned int i;
+
+        (void) argc;
+        (void) argv;
+
+        srand(time(NULL));
+        signal(SIGALRM, alarm_handler);
+
+        for (i = 0; i < sizeof(g_polls) / sizeof(g_polls[0]); i++) {
+                alarm(5);
+                fprintf(stderr, "testing poll: %d\n", g_polls[i]);
+
+                rc = test_poll(g_polls[i]);
+                if (rc != 0) {
+                        return -1;
+                }
+        }
+        return 0;
+}
+
+#endif
@@ -0,0 +1,287 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <errno.h>
+
+#include "medusa/error.h"
+#include "medusa/buffer.h"
+#include "medusa/tcpsocket.h"
+#include "medusa/httpclient.h"
+#include "medusa/httprequest.h"
+#include "medusa/monitor.h"
+
+#define REQUEST_COUNT           10
+#define REQUEST_CONNECTIONS     2
+
+static const unsigned int g_polls[] = {
+        MEDUSA_MONITOR_POLL_DEFAULT,
+#if defined(__LINUX__)
+        MEDUSA_MONITOR_POLL_EPOLL,
+#endif
+#if defined(__APPLE__)
+        MEDUSA_MONITOR_POLL_KQUEUE,
+#endif
+        MEDUSA_MONITOR_POLL_POLL,
+        MEDUSA_MONITOR_POLL_SELECT,
+#if defined(__WINDOWS__)
+        MEDUSA_MONITOR_POLL_WSAPOLL,
+#endif
+};
+
+static unsigned int g_accepted;
+static unsigned int g_received;
+static unsigned int g_disconnected;
+
+static int httprequest_onevent (struct medusa_httprequest *httprequest, unsigned int events, void *context, void *param)
+{
+        const struct medusa_httprequest_reply *reply;
+        const struct medusa_httprequest_reply_body *body;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_HTTPREQUEST_EVENT_RECEIVED) {
+                reply = medusa_httprequest_get_reply(httprequest);
+                if (medusa_httprequest_reply_status_get_code(medusa_httprequest_reply_get_status(reply)) != 200) {
+                        return -1;
+                }
+                body = medusa_httprequest_reply_get_body(reply);
+                if (medusa_httprequest_reply_body_get_length(body) != 2 ||
+                    memcmp(medusa_httprequest_reply_body_get_value(body), "ok", 2) != 0) {
+                        return -1;
+                }
+                g_received += 1;
+        }
+        if (events & MEDUSA_HTTPREQUEST_EVENT_DISCONNECTED) {
+                g_disconnected += 1;
+        }
+        return 0;
+}
+
+static int tcpsocket_server_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
+{
+        int rc;
+        int64_t end;
+        struct medusa_buffer *rbuffer;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_TCPSOCKET_EVENT_BUFFERED_READ) {
+                rbuffer = medusa_tcpsocket_get_read_buffer(tcpsocket);
+                while ((end = medusa_buffer_strcasestr(rbuffer, 0, "\r\n\r\n")) >= 0) {
+                        rc = medusa_buffer_choke(rbuffer, 0, end + 4);
+                        if (rc != end + 4) {
+                                return -1;
+                        }
+                        rc = medusa_tcpsocket_printf(tcpsocket, "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+                        if (rc < 0) {
+                                return -1;
+                        }
+                }
+        }
+        return 0;
+}
+
+static int tcpsocket_listener_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
+{
+        int rc;
+        struct medusa_tcpsocket *accepted;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_TCPSOCKET_EVENT_CONNECTION) {
+                accepted = medusa_tcpsocket_accept(tcpsocket, tcpsocket_server_onevent, context);
+                if (MEDUSA_IS_ERR_OR_NULL(accepted)) {
+                        return MEDUSA_PTR_ERR(accepted);
+                }
+                rc  = medusa_tcpsocket_set_buffered(accepted, 1);
+                rc |= medusa_tcpsocket_set_nonblocking(accepted, 1);
+                rc |= medusa_tcpsocket_set_enabled(accepted, 1);
+                if (rc < 0) {
+                        medusa_tcpsocket_destroy(accepted);
+                        return -1;
+                }
+                g_accepted += 1;
+        }
+        return 0;
+}
+
+static int make_requests (struct medusa_monitor *monitor, struct medusa_httpclient *httpclient, int port, unsigned int count)
+{
+        int rc;
+        unsigned int i;
+        struct medusa_httprequest *httprequest;
+        struct medusa_httprequest_init_options httprequest_init_options;
+
+        g_received     = 0;
+        g_disconnected = 0;
+
+        for (i = 0; i < count; i++) {
+                medusa_httprequest_init_options_default(&httprequest_init_options);
+                httprequest_init_options.monitor    = monitor;
+                httprequest_init_options.httpclient = httpclient;
+                httprequest_init_options.onevent    = httprequest_onevent;
+                httprequest = medusa_httprequest_create_with_options(&httprequest_init_options);
+                if (MEDUSA_IS_ERR_OR_NULL(httprequest)) {
+                        return -1;
+                }
+                rc = medusa_httprequest_set_url(httprequest, "http://127.0.0.1:%d/", port);
+                if (rc < 0) {
+                        return -1;
+                }
+                rc = medusa_httprequest_make_get(httprequest);
+                if (rc < 0) {
+                        return -1;
+                }
+        }
+        if (medusa_httpclient_get_connection_count(httpclient) > REQUEST_CONNECTIONS) {
+                fprintf(stderr, "  connections: %lld\n", (long long) medusa_httpclient_get_connection_count(httpclient));
+                return -1;
+        }
+
+        while (g_disconnected < count) {
+                rc = medusa_monitor_run_once(monitor);
+                if (rc < 0) {
+                        return -1;
+                }
+        }
+        if (g_received != count) {
+                fprintf(stderr, "  received: %u / %u\n", g_received, count);
+                return -1;
+        }
+        return 0;
+}
+
+static int test_poll (unsigned int poll)
+{
+        int rc;
+
+        struct medusa_monitor *monitor;
+        struct medusa_monitor_init_options monitor_init_options;
+
+        int port;
+        struct medusa_tcpsocket *tcpsocket;
+        struct medusa_tcpsocket_bind_options tcpsocket_bind_options;
+
+        struct medusa_httpclient *httpclient;
+        struct medusa_httpclient_init_options httpclient_init_options;
+
+        monitor = NULL;
+        g_accepted = 0;
+
+        medusa_monitor_init_options_default(&monitor_init_options);
+        monitor_init_options.poll.type = poll;
+
+        monitor = medusa_monitor_create_with_options(&monitor_init_options);
+        if (monitor == NULL) {
+                goto bail;
+        }
+
+        for (port = 12345; port < 65535; port++) {
+                rc = medusa_tcpsocket_bind_options_default(&tcpsocket_bind_options);
+                if (rc < 0) {
+                        goto bail;
+                }
+                tcpsocket_bind_options.monitor     = monitor;
+                tcpsocket_bind_options.onevent     = tcpsocket_listener_onevent;
+                tcpsocket_bind_options.context     = NULL;
+                tcpsocket_bind_options.protocol    = MEDUSA_TCPSOCKET_PROTOCOL_IPV4;
+                tcpsocket_bind_options.address     = "127.0.0.1";
+                tcpsocket_bind_options.port        = port;
+                tcpsocket_bind_options.reuseaddr   = 1;
+                tcpsocket_bind_options.reuseport   = 0;
+                tcpsocket_bind_options.backlog     = 128;
+                tcpsocket_bind_options.nonblocking = 1;
+                tcpsocket_bind_options.buffered    = 1;
+                tcpsocket_bind_options.enabled     = 1;
+                tcpsocket = medusa_tcpsocket_bind_with_options(&tcpsocket_bind_options);
+                if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                        goto bail;
+                }
+                if (medusa_tcpsocket_get_state(tcpsocket) == MEDUSA_TCPSOCKET_STATE_ERROR) {
+                        medusa_tcpsocket_destroy(tcpsocket);
+                } else {
+                        break;
+                }
+        }
+        if (port >= 65535) {
+                goto bail;
+        }
+        fprintf(stderr, "port: %d\n", port);
+
+        medusa_httpclient_init_options_default(&httpclient_init_options);
+        httpclient_init_options.monitor                  = monitor;
+        httpclient_init_options.max_connections_per_host = REQUEST_CONNECTIONS;
+        httpclient_init_options.idle_timeout             = 5.0;
+        httpclient = medusa_httpclient_create_with_options(&httpclient_init_options);
+        if (MEDUSA_IS_ERR_OR_NULL(httpclient)) {
+                goto bail;
+        }
+
+        rc = make_requests(monitor, httpclient, port, REQUEST_COUNT);
+        if (rc < 0) {
+                goto bail;
+        }
+        fprintf(stderr, "  accepted: %u, connections: %lld, idles: %lld, pendings: %lld\n",
+                g_accepted,
+                (long long) medusa_httpclient_get_connection_count(httpclient),
+                (long long) medusa_httpclient_get_idle_count(httpclient),
+                (long long) medusa_httpclient_get_pending_count(httpclient));
+        if (g_accepted > REQUEST_CONNECTIONS) {
+                goto bail;
+        }
+        if (medusa_httpclient_get_pending_count(httpclient) != 0) {
+                goto bail;
+        }
+        if (medusa_httpclient_get_idle_count(httpclient) != medusa_httpclient_get_connection_count(httpclient)) {
+                goto bail;
+        }
+
+        /* second round must be served from the idle connections */
+        rc = make_requests(monitor, httpclient, port, REQUEST_CONNECTIONS);
+        if (rc < 0) {
+                goto bail;
+        }
+        if (g_accepted > REQUEST_CONNECTIONS) {
+                fprintf(stderr, "  accepted: %u\n", g_accepted);
+                goto bail;
+        }
+
+        medusa_monitor_destroy(monitor);
+        return 0;
+bail:   if (monitor != NULL) {
+                medusa_monitor_destroy(monitor);
+        }
+        return -1;
+}
+
+static void alarm_handler (int sig)
+{
+        (void) sig;
+        abort();
+}
+
+int main (int argc, char *argv[])
+{
+        int rc;
+        unsigned int i;
+
+        (void) argc;
+        (void) argv;
+
+        srand(time(NULL));
+        signal(SIGALRM, alarm_handler);
+
+        for (i = 0; i < sizeof(g_polls) / sizeof(g_polls[0]); i++) {
+                alarm(5);
+
+                fprintf(stderr, "testing poll: %d\n", g_polls[i]);
+                rc = test_poll(g_polls[i]);
+                if (rc != 0) {
+                        fprintf(stderr, "  failed\n");
+                        return -1;
+                }
+                fprintf(stderr, "success\n");
+        }
+        return 0;
+}
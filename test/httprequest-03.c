@@ -0,0 +1,367 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <errno.h>
+
+#include <sys/stat.h>
+
+#include "medusa/error.h"
+#include "medusa/buffer.h"
+#include "medusa/tcpsocket.h"
+#include "medusa/httprequest.h"
+#include "medusa/monitor.h"
+
+#define BODY_CHUNK              65536
+#define BODY_CHUNKS             128
+
+enum {
+        SINK_STREAM,
+        SINK_BUFFER,
+        SINK_FD,
+        SINK_ACCUMULATE
+};
+
+static const unsigned int g_polls[] = {
+        MEDUSA_MONITOR_POLL_DEFAULT,
+#if defined(__LINUX__)
+        MEDUSA_MONITOR_POLL_EPOLL,
+#endif
+#if defined(__APPLE__)
+        MEDUSA_MONITOR_POLL_KQUEUE,
+#endif
+        MEDUSA_MONITOR_POLL_POLL,
+        MEDUSA_MONITOR_POLL_SELECT,
+#if defined(__WINDOWS__)
+        MEDUSA_MONITOR_POLL_WSAPOLL,
+#endif
+};
+
+static char g_chunk[BODY_CHUNK];
+
+static int g_received;
+static int g_disconnected;
+static int64_t g_streamed;
+static unsigned int g_chunks;
+
+static int httprequest_onevent (struct medusa_httprequest *httprequest, unsigned int events, void *context, void *param)
+{
+        int64_t i;
+        const char *value;
+        const struct medusa_httprequest_reply *reply;
+        const struct medusa_httprequest_reply_body *body;
+        const struct medusa_httprequest_reply_header *header;
+        (void) context;
+        if (events & MEDUSA_HTTPREQUEST_EVENT_RECEIVED_BODY) {
+                struct medusa_httprequest_event_received_body *medusa_httprequest_event_received_body = (struct medusa_httprequest_event_received_body *) param;
+                for (i = 0; i < medusa_httprequest_event_received_body->length; i++) {
+                        if (((const char *) medusa_httprequest_event_received_body->data)[i] != g_chunk[(g_streamed + i) % BODY_CHUNK]) {
+                                return -1;
+                        }
+                }
+                g_streamed += medusa_httprequest_event_received_body->length;
+                g_chunks   += 1;
+        }
+        if (events & MEDUSA_HTTPREQUEST_EVENT_RECEIVED) {
+                reply = medusa_httprequest_get_reply(httprequest);
+                if (medusa_httprequest_reply_status_get_code(medusa_httprequest_reply_get_status(reply)) != 200) {
+                        return -1;
+                }
+                value = NULL;
+                for (header = medusa_httprequest_reply_headers_get_first(medusa_httprequest_reply_get_headers(reply));
+                     header != NULL;
+                     header = medusa_httprequest_reply_header_get_next(header)) {
+                        if (strcmp(medusa_httprequest_reply_header_get_key(header), "X-Medusa-Test") == 0) {
+                                value = medusa_httprequest_reply_header_get_value(header);
+                        }
+                }
+                if (value == NULL || strcmp(value, "streaming") != 0) {
+                        return -1;
+                }
+                body = medusa_httprequest_reply_get_body(reply);
+                if (medusa_httprequest_reply_body_get_length(body) != (int64_t) BODY_CHUNK * BODY_CHUNKS) {
+                        return -1;
+                }
+                g_received = 1;
+        }
+        if (events & MEDUSA_HTTPREQUEST_EVENT_DISCONNECTED) {
+                g_disconnected = 1;
+        }
+        return 0;
+}
+
+static int tcpsocket_server_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
+{
+        int i;
+        int rc;
+        int64_t end;
+        struct medusa_buffer *rbuffer;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_TCPSOCKET_EVENT_BUFFERED_READ) {
+                rbuffer = medusa_tcpsocket_get_read_buffer(tcpsocket);
+                end = medusa_buffer_strcasestr(rbuffer, 0, "\r\n\r\n");
+                if (end >= 0) {
+                        medusa_buffer_reset(rbuffer);
+                        rc = medusa_tcpsocket_printf(tcpsocket, "HTTP/1.1 200 OK\r\nX-Medusa-Test: streaming\r\nContent-Length: %d\r\n\r\n", BODY_CHUNK * BODY_CHUNKS);
+                        if (rc < 0) {
+                                return -1;
+                        }
+                        for (i = 0; i < BODY_CHUNKS; i++) {
+                                rc = medusa_tcpsocket_write(tcpsocket, g_chunk, BODY_CHUNK);
+                                if (rc != BODY_CHUNK) {
+                                        return -1;
+                                }
+                        }
+                }
+        }
+        if (events & MEDUSA_TCPSOCKET_EVENT_BUFFERED_WRITE_FINISHED) {
+                medusa_tcpsocket_destroy(tcpsocket);
+        }
+        return 0;
+}
+
+static int tcpsocket_listener_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
+{
+        int rc;
+        struct medusa_tcpsocket *accepted;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_TCPSOCKET_EVENT_CONNECTION) {
+                accepted = medusa_tcpsocket_accept(tcpsocket, tcpsocket_server_onevent, context);
+                if (MEDUSA_IS_ERR_OR_NULL(accepted)) {
+                        return MEDUSA_PTR_ERR(accepted);
+                }
+                rc  = medusa_tcpsocket_set_buffered(accepted, 1);
+                rc |= medusa_tcpsocket_set_nonblocking(accepted, 1);
+                rc |= medusa_tcpsocket_set_enabled(accepted, 1);
+                if (rc < 0) {
+                        medusa_tcpsocket_destroy(accepted);
+                        return -1;
+                }
+        }
+        return 0;
+}
+
+static int test_sink (struct medusa_monitor *monitor, int port, unsigned int sink)
+{
+        int rc;
+        int fd;
+        struct stat st;
+        struct medusa_buffer *buffer;
+        struct medusa_httprequest *httprequest;
+        struct medusa_httprequest_init_options httprequest_init_options;
+        const struct medusa_httprequest_reply_body *body;
+
+        fd     = -1;
+        buffer = NULL;
+
+        g_received     = 0;
+        g_disconnected = 0;
+        g_streamed     = 0;
+        g_chunks       = 0;
+
+        medusa_httprequest_init_options_default(&httprequest_init_options);
+        httprequest_init_options.monitor = monitor;
+        httprequest_init_options.onevent = httprequest_onevent;
+        if (sink == SINK_STREAM) {
+                httprequest_init_options.body_stream = 1;
+        }
+        httprequest = medusa_httprequest_create_with_options(&httprequest_init_options);
+        if (MEDUSA_IS_ERR_OR_NULL(httprequest)) {
+                goto bail;
+        }
+        if (sink == SINK_BUFFER) {
+                buffer = medusa_buffer_create(MEDUSA_BUFFER_TYPE_DEFAULT);
+                if (MEDUSA_IS_ERR_OR_NULL(buffer)) {
+                        goto bail;
+                }
+                rc = medusa_httprequest_set_body_buffer(httprequest, buffer);
+                if (rc < 0) {
+                        goto bail;
+                }
+        }
+        if (sink == SINK_FD) {
+                char name[] = "/tmp/medusa-httprequest-03-XXXXXX";
+                fd = mkstemp(name);
+                if (fd < 0) {
+                        goto bail;
+                }
+                unlink(name);
+                rc = medusa_httprequest_set_body_fd(httprequest, fd);
+                if (rc < 0) {
+                        goto bail;
+                }
+        }
+        rc = medusa_httprequest_set_url(httprequest, "http://127.0.0.1:%d/", port);
+        if (rc < 0) {
+                goto bail;
+        }
+        rc = medusa_httprequest_make_get(httprequest);
+        if (rc < 0) {
+                goto bail;
+        }
+
+        while (g_disconnected == 0) {
+                rc = medusa_monitor_run_once(monitor);
+                if (rc < 0) {
+                        goto bail;
+                }
+        }
+        fprintf(stderr, "  sink: %u, received: %d, streamed: %lld, chunks: %u\n", sink, g_received, (long long) g_streamed, g_chunks);
+        if (g_received == 0) {
+                goto bail;
+        }
+        if (g_streamed != (int64_t) BODY_CHUNK * BODY_CHUNKS) {
+                goto bail;
+        }
+
+        body = medusa_httprequest_reply_get_body(medusa_httprequest_get_reply(httprequest));
+        if (medusa_httprequest_reply_body_get_length(body) != (int64_t) BODY_CHUNK * BODY_CHUNKS) {
+                goto bail;
+        }
+        if (sink == SINK_ACCUMULATE) {
+                if (medusa_httprequest_reply_body_get_value(body) == NULL ||
+                    memcmp(medusa_httprequest_reply_body_get_value(body), g_chunk, BODY_CHUNK) != 0) {
+                        goto bail;
+                }
+        } else if (medusa_httprequest_reply_body_get_value(body) != NULL) {
+                goto bail;
+        }
+        if (sink == SINK_BUFFER &&
+            medusa_buffer_get_length(buffer) != (int64_t) BODY_CHUNK * BODY_CHUNKS) {
+                goto bail;
+        }
+        if (sink == SINK_FD) {
+                if (fstat(fd, &st) != 0 ||
+                    st.st_size != (off_t) BODY_CHUNK * BODY_CHUNKS) {
+                        goto bail;
+                }
+        }
+
+        medusa_httprequest_destroy(httprequest);
+        if (buffer != NULL) {
+                medusa_buffer_destroy(buffer);
+        }
+        if (fd >= 0) {
+                close(fd);
+        }
+        return 0;
+bail:   if (!MEDUSA_IS_ERR_OR_NULL(httprequest)) {
+                medusa_httprequest_destroy(httprequest);
+        }
+        if (!MEDUSA_IS_ERR_OR_NULL(buffer)) {
+                medusa_buffer_destroy(buffer);
+        }
+        if (fd >= 0) {
+                close(fd);
+        }
+        return -1;
+}
+
+static int test_poll (unsigned int poll)
+{
+        int rc;
+        unsigned int sink;
+
+        struct medusa_monitor *monitor;
+        struct medusa_monitor_init_options monitor_init_options;
+
+        int port;
+        struct medusa_tcpsocket *tcpsocket;
+        struct medusa_tcpsocket_bind_options tcpsocket_bind_options;
+
+        monitor = NULL;
+
+        medusa_monitor_init_options_default(&monitor_init_options);
+        monitor_init_options.poll.type = poll;
+
+        monitor = medusa_monitor_create_with_options(&monitor_init_options);
+        if (monitor == NULL) {
+                goto bail;
+        }
+
+        for (port = 12345; port < 65535; port++) {
+                rc = medusa_tcpsocket_bind_options_default(&tcpsocket_bind_options);
+                if (rc < 0) {
+                        goto bail;
+                }
+                tcpsocket_bind_options.monitor     = monitor;
+                tcpsocket_bind_options.onevent     = tcpsocket_listener_onevent;
+                tcpsocket_bind_options.context     = NULL;
+                tcpsocket_bind_options.protocol    = MEDUSA_TCPSOCKET_PROTOCOL_IPV4;
+                tcpsocket_bind_options.address     = "127.0.0.1";
+                tcpsocket_bind_options.port        = port;
+                tcpsocket_bind_options.reuseaddr   = 1;
+                tcpsocket_bind_options.reuseport   = 0;
+                tcpsocket_bind_options.backlog     = 128;
+                tcpsocket_bind_options.nonblocking = 1;
+                tcpsocket_bind_options.buffered    = 1;
+                tcpsocket_bind_options.enabled     = 1;
+                tcpsocket = medusa_tcpsocket_bind_with_options(&tcpsocket_bind_options);
+                if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                        goto bail;
+                }
+                if (medusa_tcpsocket_get_state(tcpsocket) == MEDUSA_TCPSOCKET_STATE_ERROR) {
+                        medusa_tcpsocket_destroy(tcpsocket);
+                } else {
+                        break;
+                }
+        }
+        if (port >= 65535) {
+                goto bail;
+        }
+        fprintf(stderr, "port: %d\n", port);
+
+        for (sink = SINK_STREAM; sink <= SINK_ACCUMULATE; sink++) {
+                rc = test_sink(monitor, port, sink);
+                if (rc < 0) {
+                        goto bail;
+                }
+        }
+
+        medusa_monitor_destroy(monitor);
+        return 0;
+bail:   if (monitor != NULL) {
+                medusa_monitor_destroy(monitor);
+        }
+        return -1;
+}
+
+static void alarm_handler (int sig)
+{
+        (void) sig;
+        abort();
+}
+
+int main (int argc, char *argv[])
+{
+        int rc;
+        unsigned int i;
+
+        (void) argc;
+        (void) argv;
+
+        srand(time(NULL));
+        signal(SIGALRM, alarm_handler);
+
+        for (i = 0; i < sizeof(g_chunk); i++) {
+                g_chunk[i] = 'a' + (i % 26);
+        }
+
+        for (i = 0; i < sizeof(g_polls) / sizeof(g_polls[0]); i++) {
+                alarm(5);
+
+                fprintf(stderr, "testing poll: %d\n", g_polls[i]);
+                rc = test_poll(g_polls[i]);
+                if (rc != 0) {
+                        fprintf(stderr, "  failed\n");
+                        return -1;
+                }
+                fprintf(stderr, "success\n");
+        }
+        return 0;
+}
@@ -76,6 +76,8 @@ static int test_poll (unsigned int poll)
                                 break;
                         case MEDUSA_SUBJECT_TYPE_HTTPREQUEST:
                                 break;
+                        case MEDUSA_SUBJECT_TYPE_HTTPCLIENT:
+                                break;
                         case MEDUSA_SUBJECT_TYPE_DNSREQUEST:
                                 break;
                         case MEDUSA_SUBJECT_TYPE_DNSRESOLVER:
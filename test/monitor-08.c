@@ -0,0 +1,273 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+
+#include "medusa/error.h"
+#include "medusa/io.h"
+#include "medusa/timer.h"
+#include "medusa/signal.h"
+#include "medusa/monitor.h"
+
+static const unsigned int g_polls[] = {
+        MEDUSA_MONITOR_POLL_DEFAULT,
+#if defined(__LINUX__)
+        MEDUSA_MONITOR_POLL_EPOLL,
+#endif
+#if defined(__APPLE__)
+        MEDUSA_MONITOR_POLL_KQUEUE,
+#endif
+        MEDUSA_MONITOR_POLL_POLL,
+        MEDUSA_MONITOR_POLL_SELECT,
+#if defined(__WINDOWS__)
+        MEDUSA_MONITOR_POLL_WSAPOLL,
+#endif
+};
+
+#define TIMER_COUNT     20
+
+static int g_fds[2];
+static unsigned int g_reads;
+static unsigned int g_timeouts;
+static unsigned int g_signals;
+static unsigned int g_reports;
+
+static int monitor_onevent (struct medusa_monitor *monitor, unsigned int events, void *context, void *param)
+{
+        struct medusa_monitor_stats stats;
+        struct medusa_monitor_stats *reported = param;
+        (void) context;
+        if (events & MEDUSA_MONITOR_EVENT_STATS) {
+                /* callback runs unlocked, monitor can be queried */
+                if (medusa_monitor_get_stats(monitor, &stats) < 0) {
+                        return -1;
+                }
+                if (stats.iterations < reported->iterations) {
+                        return -1;
+                }
+                g_reports += 1;
+        }
+        return 0;
+}
+
+static int io_onevent (struct medusa_io *io, unsigned int events, void *context, void *param)
+{
+        int rc;
+        char c;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_IO_EVENT_IN) {
+                rc = read(medusa_io_get_fd(io), &c, 1);
+                if (rc != 1) {
+                        return -1;
+                }
+                g_reads += 1;
+        }
+        return 0;
+}
+
+static int signal_onevent (struct medusa_signal *signal, unsigned int events, void *context, void *param)
+{
+        (void) signal;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_SIGNAL_EVENT_FIRED) {
+                g_signals += 1;
+        }
+        return 0;
+}
+
+static int timer_onevent (struct medusa_timer *timer, unsigned int events, void *context, void *param)
+{
+        int rc;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_TIMER_EVENT_TIMEOUT) {
+                rc = write(g_fds[1], "x", 1);
+                if (rc != 1) {
+                        return -1;
+                }
+                g_timeouts += 1;
+                if (g_timeouts == 1) {
+                        kill(getpid(), SIGUSR1);
+                }
+                if (g_timeouts == TIMER_COUNT) {
+                        return medusa_monitor_break(medusa_timer_get_monitor(timer));
+                }
+        }
+        return 0;
+}
+
+static int test_poll (unsigned int poll)
+{
+        int rc;
+        unsigned int i;
+        unsigned long long p50;
+        unsigned long long p99;
+
+        struct medusa_io *io;
+        struct medusa_timer *timer;
+        struct medusa_signal *signal;
+
+        struct medusa_monitor *monitor;
+        struct medusa_monitor_stats stats;
+        struct medusa_monitor_init_options options;
+
+        monitor = NULL;
+        g_fds[0] = -1;
+        g_fds[1] = -1;
+        g_reads    = 0;
+        g_timeouts = 0;
+        g_signals  = 0;
+        g_reports  = 0;
+
+        medusa_monitor_init_options_default(&options);
+        options.poll.type        = poll;
+        options.stats.interval   = 0.02;
+        options.onevent.callback = monitor_onevent;
+        options.onevent.context  = NULL;
+
+        monitor = medusa_monitor_create_with_options(&options);
+        if (monitor == NULL) {
+                goto bail;
+        }
+
+        rc = pipe(g_fds);
+        if (rc != 0) {
+                goto bail;
+        }
+        io = medusa_io_create(monitor, g_fds[0], io_onevent, NULL);
+        if (MEDUSA_IS_ERR_OR_NULL(io)) {
+                goto bail;
+        }
+        rc  = medusa_io_set_events(io, MEDUSA_IO_EVENT_IN);
+        rc |= medusa_io_set_enabled(io, 1);
+        if (rc < 0) {
+                goto bail;
+        }
+
+        signal = medusa_signal_create(monitor, SIGUSR1, signal_onevent, NULL);
+        if (MEDUSA_IS_ERR_OR_NULL(signal)) {
+                goto bail;
+        }
+        rc = medusa_signal_set_enabled(signal, 1);
+        if (rc < 0) {
+                goto bail;
+        }
+
+        timer = medusa_timer_create(monitor, timer_onevent, NULL);
+        if (MEDUSA_IS_ERR_OR_NULL(timer)) {
+                goto bail;
+        }
+        rc  = medusa_timer_set_interval(timer, 0.005);
+        rc |= medusa_timer_set_enabled(timer, 1);
+        if (rc < 0) {
+                goto bail;
+        }
+
+        rc = medusa_monitor_run(monitor);
+        if (rc < 0) {
+                goto bail;
+        }
+        rc = medusa_monitor_run_timeout(monitor, 0.01);
+        if (rc < 0) {
+                goto bail;
+        }
+
+        rc = medusa_monitor_get_stats(monitor, &stats);
+        if (rc < 0) {
+                goto bail;
+        }
+        if (stats.enabled == 0) {
+                fprintf(stderr, "  stats are compiled out, skipping\n");
+                medusa_monitor_destroy(monitor);
+                close(g_fds[0]);
+                close(g_fds[1]);
+                return 0;
+        }
+
+        p50 = medusa_monitor_stats_histogram_percentile(&stats.lateness, 50);
+        p99 = medusa_monitor_stats_histogram_percentile(&stats.lateness, 99);
+        fprintf(stderr, "  iterations: %llu, wait: %llu, busy: %llu, changes: %llu, deletes: %llu, timers: %llu, reports: %u\n",
+                stats.iterations, stats.wait_time, stats.busy_time, stats.changes, stats.deletes, stats.timers, g_reports);
+        fprintf(stderr, "  events io: %llu, timer: %llu, signal: %llu, lateness p50: %llu, p99: %llu, max: %llu\n",
+                stats.events[MEDUSA_MONITOR_STATS_SUBJECT_IO], stats.events[MEDUSA_MONITOR_STATS_SUBJECT_TIMER], stats.events[MEDUSA_MONITOR_STATS_SUBJECT_SIGNAL], p50, p99, stats.lateness.max);
+
+        if (stats.iterations == 0 ||
+            stats.wait_time == 0 ||
+            stats.changes == 0) {
+                goto bail;
+        }
+        /* wakeup and timer fds are ios too, so there are at least as many io events as reads */
+        if (stats.events[MEDUSA_MONITOR_STATS_SUBJECT_IO] < g_reads ||
+            stats.events[MEDUSA_MONITOR_STATS_SUBJECT_TIMER] != TIMER_COUNT ||
+            stats.timers != TIMER_COUNT) {
+                goto bail;
+        }
+        if (g_signals != 1 ||
+            stats.events[MEDUSA_MONITOR_STATS_SUBJECT_SIGNAL] != g_signals) {
+                goto bail;
+        }
+        for (i = 0; i < MEDUSA_MONITOR_STATS_SUBJECT_COUNT; i++) {
+                if (stats.callback[i].count != stats.events[i]) {
+                        goto bail;
+                }
+        }
+        if (stats.lateness.count != TIMER_COUNT ||
+            p50 > p99 ||
+            p99 > stats.lateness.max) {
+                goto bail;
+        }
+        if (g_reports == 0) {
+                goto bail;
+        }
+
+        medusa_monitor_destroy(monitor);
+        close(g_fds[0]);
+        close(g_fds[1]);
+        return 0;
+bail:   if (monitor != NULL) {
+                medusa_monitor_destroy(monitor);
+        }
+        if (g_fds[0] >= 0) {
+                close(g_fds[0]);
+        }
+        if (g_fds[1] >= 0) {
+                close(g_fds[1]);
+        }
+        return -1;
+}
+
+static void alarm_handler (int sig)
+{
+        (void) sig;
+        abort();
+}
+
+int main (int argc, char *argv[])
+{
+        int rc;
+        unsigned int i;
+
+        (void) argc;
+        (void) argv;
+
+        srand(time(NULL));
+        signal(SIGALRM, alarm_handler);
+
+        for (i = 0; i < sizeof(g_polls) / sizeof(g_polls[0]); i++) {
+                alarm(5);
+                fprintf(stderr, "testing poll: %d\n", g_polls[i]);
+                rc = test_poll(g_polls[i]);
+                if (rc != 0) {
+                        fprintf(stderr, "poll: %d test failed\n", g_polls[i]);
+                        return -1;
+                }
+        }
+
+        return 0;
+}
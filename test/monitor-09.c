@@ -0,0 +1,177 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+
+#include "medusa/error.h"
+#include "medusa/clock.h"
+#include "medusa/timer.h"
+#include "medusa/monitor.h"
+
+static const unsigned int g_polls[] = {
+        MEDUSA_MONITOR_POLL_DEFAULT,
+#if defined(__LINUX__)
+        MEDUSA_MONITOR_POLL_EPOLL,
+#endif
+#if defined(__APPLE__)
+        MEDUSA_MONITOR_POLL_KQUEUE,
+#endif
+        MEDUSA_MONITOR_POLL_POLL,
+        MEDUSA_MONITOR_POLL_SELECT,
+#if defined(__WINDOWS__)
+        MEDUSA_MONITOR_POLL_WSAPOLL,
+#endif
+};
+
+static unsigned int g_stalls;
+static unsigned int g_timeouts;
+static struct medusa_monitor_event_error_subject_stall g_stall;
+
+static int timer_onevent (struct medusa_timer *timer, unsigned int events, void *context, void *param);
+
+static int monitor_onevent (struct medusa_monitor *monitor, unsigned int events, void *context, void *param)
+{
+        struct medusa_monitor_event_error *error = param;
+        (void) monitor;
+        (void) context;
+        if (events & MEDUSA_MONITOR_EVENT_ERROR) {
+                if (error->type == MEDUSA_MONITOR_ERROR_TYPE_SUBJECT_STALL) {
+                        g_stall = error->u.subject_stall;
+                        g_stalls += 1;
+                        fprintf(stderr, "  stall: subject type: %u, callback: %p, duration: %.3f ms, backtrace: %d\n",
+                                g_stall.subject_type, g_stall.callback, g_stall.duration / 1e6, g_stall.backtrace_count);
+                }
+        }
+        return 0;
+}
+
+static int timer_onevent (struct medusa_timer *timer, unsigned int events, void *context, void *param)
+{
+        double elapsed;
+        struct timespec now;
+        struct timespec started;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_TIMER_EVENT_TIMEOUT) {
+                g_timeouts += 1;
+                if (g_timeouts == 2) {
+                        /* spin, a sleep would be cut short by the backtrace signal */
+                        medusa_clock_monotonic(&started);
+                        do {
+                                medusa_clock_monotonic(&now);
+                                medusa_timespec_sub(&now, &started, &now);
+                                elapsed = now.tv_sec + now.tv_nsec * 1e-9;
+                        } while (elapsed < 0.2);
+                }
+                if (g_timeouts == 4) {
+                        return medusa_monitor_break(medusa_timer_get_monitor(timer));
+                }
+        }
+        return 0;
+}
+
+static int test_poll (unsigned int poll)
+{
+        int rc;
+
+        struct medusa_timer *timer;
+
+        struct medusa_monitor *monitor;
+        struct medusa_monitor_stats stats;
+        struct medusa_monitor_init_options options;
+
+        monitor = NULL;
+        g_stalls   = 0;
+        g_timeouts = 0;
+        memset(&g_stall, 0, sizeof(g_stall));
+
+        medusa_monitor_init_options_default(&options);
+        options.poll.type          = poll;
+        options.watchdog.threshold = 0.05;
+        options.watchdog.backtrace = 1;
+        options.onevent.callback   = monitor_onevent;
+        options.onevent.context    = NULL;
+
+        monitor = medusa_monitor_create_with_options(&options);
+        if (monitor == NULL) {
+                goto bail;
+        }
+
+        timer = medusa_timer_create(monitor, timer_onevent, NULL);
+        if (MEDUSA_IS_ERR_OR_NULL(timer)) {
+                goto bail;
+        }
+        rc  = medusa_timer_set_interval(timer, 0.01);
+        rc |= medusa_timer_set_enabled(timer, 1);
+        if (rc < 0) {
+                goto bail;
+        }
+
+        rc = medusa_monitor_run(monitor);
+        if (rc < 0) {
+                goto bail;
+        }
+
+        rc = medusa_monitor_get_stats(monitor, &stats);
+        if (rc < 0) {
+                goto bail;
+        }
+        fprintf(stderr, "  stalls: %llu\n", stats.stalls);
+
+        /* only the spinning callback is slow */
+        if (g_stalls != 1 || stats.stalls != 1) {
+                goto bail;
+        }
+        if (g_stall.callback != (void *) timer_onevent) {
+                goto bail;
+        }
+        if (g_stall.duration < 150000000ULL) {
+                goto bail;
+        }
+#if defined(__LINUX__) && defined(__GLIBC__)
+        if (g_stall.backtrace == NULL || g_stall.backtrace_count <= 0) {
+                goto bail;
+        }
+#endif
+
+        medusa_monitor_destroy(monitor);
+        return 0;
+bail:   if (monitor != NULL) {
+                medusa_monitor_destroy(monitor);
+        }
+        return -1;
+}
+
+static void alarm_handler (int sig)
+{
+        (void) sig;
+        abort();
+}
+
+int main (int argc, char *argv[])
+{
+        int rc;
+        unsigned int i;
+
+        (void) argc;
+        (void) argv;
+
+        srand(time(NULL));
+        signal(SIGALRM, alarm_handler);
+
+        for (i = 0; i < sizeof(g_polls) / sizeof(g_polls[0]); i++) {
+                alarm(5);
+                fprintf(stderr, "testing poll: %d\n", g_polls[i]);
+                rc = test_poll(g_polls[i]);
+                if (rc != 0) {
+                        fprintf(stderr, "poll: %d test failed\n", g_polls[i]);
+                        return -1;
+                }
+        }
+
+        return 0;
+}
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <sys/types.h>
+
+#include "medusa/error.h"
+#include "medusa/timer.h"
+#include "medusa/signal.h"
+#include "medusa/monitor.h"
+
+static const unsigned int g_signals[] = {
+        MEDUSA_MONITOR_SIGNAL_DEFAULT,
+#if defined(__LINUX__)
+        MEDUSA_MONITOR_SIGNAL_SIGNALFD,
+#endif
+        MEDUSA_MONITOR_SIGNAL_SIGACTION,
+};
+
+static int g_pipe[2];
+static volatile unsigned int g_fired;
+static volatile int g_blocked;
+
+static int signal_onevent (struct medusa_signal *signal, unsigned int events, void *context, void *param)
+{
+        (void) signal;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_SIGNAL_EVENT_FIRED) {
+                g_fired += 1;
+        }
+        return 0;
+}
+
+static int timer_onevent (struct medusa_timer *timer, unsigned int events, void *context, void *param)
+{
+        ssize_t rc;
+        (void) timer;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_TIMER_EVENT_TIMEOUT) {
+                rc = write(g_pipe[1], "x", 1);
+                if (rc != 1) {
+                        return -EIO;
+                }
+        }
+        return 0;
+}
+
+/* a thread the library does not own, started before the monitor */
+static void * thread_worker (void *arg)
+{
+        char c;
+        ssize_t rc;
+        sigset_t sigset;
+        (void) arg;
+        rc = read(g_pipe[0], &c, 1);
+        if (rc != 1) {
+                return NULL;
+        }
+        kill(getpid(), SIGUSR1);
+        while (g_fired == 0) {
+                usleep(1000);
+        }
+        pthread_sigmask(SIG_BLOCK, NULL, &sigset);
+        g_blocked = sigismember(&sigset, SIGUSR1);
+        return NULL;
+}
+
+static int test_signal (unsigned int type)
+{
+        int rc;
+        sigset_t sigset;
+        pthread_t thread;
+
+        struct medusa_monitor *monitor;
+        struct medusa_monitor_init_options options;
+
+        struct medusa_timer *timer;
+        struct medusa_signal *signal;
+
+        monitor = NULL;
+        g_fired = 0;
+        g_blocked = -1;
+
+        rc = pipe(g_pipe);
+        if (rc != 0) {
+                return -1;
+        }
+        rc = pthread_create(&thread, NULL, thread_worker, NULL);
+        if (rc != 0) {
+                return -1;
+        }
+
+        medusa_monitor_init_options_default(&options);
+        options.signal.type = type;
+
+        monitor = medusa_monitor_create_with_options(&options);
+        if (monitor == NULL) {
+                goto bail;
+        }
+
+        signal = medusa_signal_create(monitor, SIGUSR1, signal_onevent, NULL);
+        if (MEDUSA_IS_ERR_OR_NULL(signal)) {
+                goto bail;
+        }
+        rc = medusa_signal_set_enabled(signal, 1);
+        if (rc < 0) {
+                goto bail;
+        }
+
+        timer = medusa_timer_create_singleshot(monitor, 0.1, timer_onevent, NULL);
+        if (MEDUSA_IS_ERR_OR_NULL(timer)) {
+                goto bail;
+        }
+
+        while (g_fired == 0) {
+                rc = medusa_monitor_run_once(monitor);
+                if (rc < 0) {
+                        goto bail;
+                }
+        }
+        pthread_join(thread, NULL);
+
+        /* the signal reached the monitor, the other thread mask is as it was */
+        fprintf(stderr, "  fired: %u, blocked: %d\n", g_fired, g_blocked);
+        if (g_blocked != 0) {
+                goto bail;
+        }
+
+        medusa_monitor_destroy(monitor);
+        monitor = NULL;
+
+        pthread_sigmask(SIG_BLOCK, NULL, &sigset);
+        if (sigismember(&sigset, SIGUSR1)) {
+                goto bail;
+        }
+
+        close(g_pipe[0]);
+        close(g_pipe[1]);
+        return 0;
+bail:   if (monitor != NULL) {
+                medusa_monitor_destroy(monitor);
+        }
+        return -1;
+}
+
+static void sigalarm_handler (int sig)
+{
+        (void) sig;
+        abort();
+}
+
+static void sigint_handler (int sig)
+{
+        (void) sig;
+        abort();
+}
+
+int main (int argc, char *argv[])
+{
+        int rc;
+        unsigned int i;
+
+        (void) argc;
+        (void) argv;
+
+        srand(time(NULL));
+        signal(SIGALRM, sigalarm_handler);
+        signal(SIGINT, sigint_handler);
+
+        for (i = 0; i < sizeof(g_signals) / sizeof(g_signals[0]); i++) {
+                alarm(5);
+                fprintf(stderr, "testing signal: %s\n", medusa_monitor_signal_type_string(g_signals[i]));
+                rc = test_signal(g_signals[i]);
+                if (rc != 0) {
+                        return -1;
+                }
+        }
+        return 0;
+}
@@ -0,0 +1,410 @@
+#if defined(__LINUX__)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#include "medusa/error.h"
+#include "medusa/buffer.h"
+#include "medusa/tcpsocket.h"
+#include "medusa/monitor.h"
+
+#define PAYLOAD_LENGTH  (1024 * 1024)
+
+static const unsigned int g_polls[] = {
+        MEDUSA_MONITOR_POLL_DEFAULT,
+#if defined(__LINUX__)
+        MEDUSA_MONITOR_POLL_EPOLL,
+#endif
+        MEDUSA_MONITOR_POLL_POLL,
+        MEDUSA_MONITOR_POLL_SELECT,
+};
+
+struct context {
+        unsigned short backend_port;
+        struct medusa_tcpsocket *frontend;
+        char *payload;
+        int64_t sent;
+        int64_t received;
+        int piped;
+        int finished;
+        struct medusa_tcpsocket_pipe_stats frontend_stats;
+        struct medusa_tcpsocket_pipe_stats backend_stats;
+};
+
+static int tcpsocket_echo_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
+{
+        int rc;
+        int64_t length;
+        char data[4096];
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_TCPSOCKET_EVENT_BUFFERED_READ) {
+                while (1) {
+                        length = medusa_buffer_get_length(medusa_tcpsocket_get_read_buffer(tcpsocket));
+                        if (length <= 0) {
+                                break;
+                        }
+                        if (length > (int64_t) sizeof(data)) {
+                                length = sizeof(data);
+                        }
+                        rc = medusa_buffer_read_data(medusa_tcpsocket_get_read_buffer(tcpsocket), 0, data, length);
+                        if (rc != 0) {
+                                fprintf(stderr, "medusa_buffer_read_data failed: %d, %s\n", rc, medusa_strerror(rc));
+                                return -1;
+                        }
+                        rc = medusa_buffer_append(medusa_tcpsocket_get_write_buffer(tcpsocket), data, length);
+                        if (rc != length) {
+                                fprintf(stderr, "medusa_buffer_append failed: %d\n", rc);
+                                return -1;
+                        }
+                }
+        }
+        if (events & MEDUSA_TCPSOCKET_EVENT_DISCONNECTED) {
+                medusa_tcpsocket_destroy(tcpsocket);
+        }
+        return 0;
+}
+
+static int tcpsocket_echo_listener_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
+{
+        struct medusa_tcpsocket *accepted;
+        struct medusa_tcpsocket_accept_options tcpsocket_accept_options;
+        (void) param;
+        if (events & MEDUSA_TCPSOCKET_EVENT_CONNECTION) {
+                medusa_tcpsocket_accept_options_default(&tcpsocket_accept_options);
+                tcpsocket_accept_options.onevent     = tcpsocket_echo_onevent;
+                tcpsocket_accept_options.context     = context;
+                tcpsocket_accept_options.nonblocking = 1;
+                tcpsocket_accept_options.buffered    = 1;
+                tcpsocket_accept_options.enabled     = 1;
+                accepted = medusa_tcpsocket_accept_with_options(tcpsocket, &tcpsocket_accept_options);
+                if (MEDUSA_IS_ERR_OR_NULL(accepted)) {
+                        return MEDUSA_PTR_ERR(accepted);
+                }
+        }
+        return 0;
+}
+
+static int tcpsocket_backend_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
+{
+        int rc;
+        struct context *ctx = context;
+        (void) param;
+        fprintf(stderr, "backend  events: 0x%08x, %s\n", events, medusa_tcpsocket_event_string(events));
+        if (events & MEDUSA_TCPSOCKET_EVENT_CONNECTED) {
+                rc = medusa_tcpsocket_pipe(ctx->frontend, tcpsocket, NULL);
+                if (rc < 0) {
+                        fprintf(stderr, "medusa_tcpsocket_pipe failed: %d, %s\n", rc, medusa_strerror(rc));
+                        return -1;
+                }
+                if (medusa_tcpsocket_get_piped(tcpsocket) != 1) {
+                        fprintf(stderr, "medusa_tcpsocket_get_piped failed\n");
+                        return -1;
+                }
+                ctx->piped = 1;
+        }
+        if (events & MEDUSA_TCPSOCKET_EVENT_ERROR) {
+                return -1;
+        }
+        if (events & MEDUSA_TCPSOCKET_EVENT_DISCONNECTED) {
+                medusa_tcpsocket_get_pipe_stats(tcpsocket, &ctx->backend_stats);
+                ctx->finished |= 2;
+                medusa_tcpsocket_destroy(tcpsocket);
+        }
+        return 0;
+}
+
+static int tcpsocket_frontend_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
+{
+        struct context *ctx = context;
+        (void) param;
+        fprintf(stderr, "frontend events: 0x%08x, %s\n", events, medusa_tcpsocket_event_string(events));
+        if (events & MEDUSA_TCPSOCKET_EVENT_ERROR) {
+                return -1;
+        }
+        if (events & MEDUSA_TCPSOCKET_EVENT_DISCONNECTED) {
+                medusa_tcpsocket_get_pipe_stats(tcpsocket, &ctx->frontend_stats);
+                ctx->finished |= 1;
+                medusa_tcpsocket_destroy(tcpsocket);
+        }
+        return 0;
+}
+
+static int tcpsocket_frontend_listener_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
+{
+        struct context *ctx = context;
+        struct medusa_tcpsocket *backend;
+        struct medusa_tcpsocket_accept_options tcpsocket_accept_options;
+        struct medusa_tcpsocket_connect_options tcpsocket_connect_options;
+        (void) param;
+        if (events & MEDUSA_TCPSOCKET_EVENT_CONNECTION) {
+                medusa_tcpsocket_accept_options_default(&tcpsocket_accept_options);
+                tcpsocket_accept_options.onevent     = tcpsocket_frontend_onevent;
+                tcpsocket_accept_options.context     = context;
+                tcpsocket_accept_options.nonblocking = 1;
+                tcpsocket_accept_options.buffered    = 1;
+                tcpsocket_accept_options.enabled     = 1;
+                ctx->frontend = medusa_tcpsocket_accept_with_options(tcpsocket, &tcpsocket_accept_options);
+                if (MEDUSA_IS_ERR_OR_NULL(ctx->frontend)) {
+                        return MEDUSA_PTR_ERR(ctx->frontend);
+                }
+                medusa_tcpsocket_connect_options_default(&tcpsocket_connect_options);
+                tcpsocket_connect_options.monitor     = medusa_tcpsocket_get_monitor(tcpsocket);
+                tcpsocket_connect_options.onevent     = tcpsocket_backend_onevent;
+                tcpsocket_connect_options.context     = context;
+                tcpsocket_connect_options.protocol    = MEDUSA_TCPSOCKET_PROTOCOL_IPV4;
+                tcpsocket_connect_options.address     = "127.0.0.1";
+                tcpsocket_connect_options.port        = ctx->backend_port;
+                tcpsocket_connect_options.nonblocking = 1;
+                tcpsocket_connect_options.buffered    = 1;
+                tcpsocket_connect_options.enabled     = 1;
+                backend = medusa_tcpsocket_connect_with_options(&tcpsocket_connect_options);
+                if (MEDUSA_IS_ERR_OR_NULL(backend)) {
+                        return MEDUSA_PTR_ERR(backend);
+                }
+        }
+        return 0;
+}
+
+static int tcpsocket_client_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
+{
+        int rc;
+        int64_t length;
+        char data[4096];
+        struct context *ctx = context;
+        (void) param;
+        if (events & MEDUSA_TCPSOCKET_EVENT_CONNECTED) {
+                rc = medusa_buffer_append(medusa_tcpsocket_get_write_buffer(tcpsocket), ctx->payload, PAYLOAD_LENGTH);
+                if (rc != PAYLOAD_LENGTH) {
+                        fprintf(stderr, "medusa_buffer_append failed: %d\n", rc);
+                        return -1;
+                }
+                ctx->sent = PAYLOAD_LENGTH;
+        }
+        if (events & MEDUSA_TCPSOCKET_EVENT_BUFFERED_READ) {
+                while (1) {
+                        length = medusa_buffer_get_length(medusa_tcpsocket_get_read_buffer(tcpsocket));
+                        if (length <= 0) {
+                                break;
+                        }
+                        if (length > (int64_t) sizeof(data)) {
+                                length = sizeof(data);
+                        }
+                        rc = medusa_buffer_read_data(medusa_tcpsocket_get_read_buffer(tcpsocket), 0, data, length);
+                        if (rc != 0) {
+                                fprintf(stderr, "medusa_buffer_read_data failed: %d, %s\n", rc, medusa_strerror(rc));
+                                return -1;
+                        }
+                        if (memcmp(data, ctx->payload + ctx->received, length) != 0) {
+                                fprintf(stderr, "payload mismatch at: %lld\n", (long long) ctx->received);
+                                return -1;
+                        }
+                        ctx->received += length;
+                }
+                if (ctx->received == PAYLOAD_LENGTH) {
+                        rc = shutdown(medusa_tcpsocket_get_fd(tcpsocket), SHUT_WR);
+                        if (rc != 0) {
+                                fprintf(stderr, "shutdown failed\n");
+                                return -1;
+                        }
+                }
+        }
+        if (events & MEDUSA_TCPSOCKET_EVENT_DISCONNECTED) {
+                if (ctx->finished != 3) {
+                        fprintf(stderr, "pipe is not finished: %d\n", ctx->finished);
+                        return -1;
+                }
+                return medusa_monitor_break(medusa_tcpsocket_get_monitor(tcpsocket));
+        }
+        if (events & MEDUSA_TCPSOCKET_EVENT_ERROR) {
+                return -1;
+        }
+        return 0;
+}
+
+static struct medusa_tcpsocket * bind_any (struct medusa_monitor *monitor, int (*onevent) (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param), void *context, unsigned short *port)
+{
+        int rc;
+        struct medusa_tcpsocket *tcpsocket;
+        struct medusa_tcpsocket_bind_options tcpsocket_bind_options;
+        for (*port = 12345; *port < 65535; *port += 1) {
+                rc = medusa_tcpsocket_bind_options_default(&tcpsocket_bind_options);
+                if (rc < 0) {
+                        return NULL;
+                }
+                tcpsocket_bind_options.monitor     = monitor;
+                tcpsocket_bind_options.onevent     = onevent;
+                tcpsocket_bind_options.context     = context;
+                tcpsocket_bind_options.protocol    = MEDUSA_TCPSOCKET_PROTOCOL_IPV4;
+                tcpsocket_bind_options.address     = "127.0.0.1";
+                tcpsocket_bind_options.port        = *port;
+                tcpsocket_bind_options.reuseaddr   = 1;
+                tcpsocket_bind_options.reuseport   = 0;
+                tcpsocket_bind_options.backlog     = 10;
+                tcpsocket_bind_options.nonblocking = 1;
+                tcpsocket_bind_options.buffered    = 0;
+                tcpsocket_bind_options.enabled     = 1;
+                tcpsocket = medusa_tcpsocket_bind_with_options(&tcpsocket_bind_options);
+                if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                        return NULL;
+                }
+                if (medusa_tcpsocket_get_state(tcpsocket) != MEDUSA_TCPSOCKET_STATE_ERROR) {
+                        return tcpsocket;
+                }
+                medusa_tcpsocket_destroy(tcpsocket);
+        }
+        return NULL;
+}
+
+static int test_poll (unsigned int poll)
+{
+        int rc;
+        int64_t i;
+        unsigned short port;
+        struct context ctx;
+
+        struct medusa_monitor *monitor;
+        struct medusa_monitor_init_options monitor_init_options;
+
+        struct medusa_tcpsocket *tcpsocket;
+        struct medusa_tcpsocket_connect_options tcpsocket_connect_options;
+
+        monitor = NULL;
+        memset(&ctx, 0, sizeof(struct context));
+
+        ctx.payload = malloc(PAYLOAD_LENGTH);
+        if (ctx.payload == NULL) {
+                goto bail;
+        }
+        for (i = 0; i < PAYLOAD_LENGTH; i++) {
+                ctx.payload[i] = rand();
+        }
+
+        medusa_monitor_init_options_default(&monitor_init_options);
+        monitor_init_options.poll.type = poll;
+
+        monitor = medusa_monitor_create_with_options(&monitor_init_options);
+        if (monitor == NULL) {
+                goto bail;
+        }
+
+        tcpsocket = bind_any(monitor, tcpsocket_echo_listener_onevent, &ctx, &ctx.backend_port);
+        if (tcpsocket == NULL) {
+                fprintf(stderr, "can not bind backend\n");
+                goto bail;
+        }
+        tcpsocket = bind_any(monitor, tcpsocket_frontend_listener_onevent, &ctx, &port);
+        if (tcpsocket == NULL) {
+                fprintf(stderr, "can not bind frontend\n");
+                goto bail;
+        }
+        fprintf(stderr, "backend: %d, frontend: %d\n", ctx.backend_port, port);
+
+        rc = medusa_tcpsocket_connect_options_default(&tcpsocket_connect_options);
+        if (rc < 0) {
+                fprintf(stderr, "medusa_tcpsocket_connect_options_default failed\n");
+                goto bail;
+        }
+        tcpsocket_connect_options.monitor     = monitor;
+        tcpsocket_connect_options.onevent     = tcpsocket_client_onevent;
+        tcpsocket_connect_options.context     = &ctx;
+        tcpsocket_connect_options.protocol    = MEDUSA_TCPSOCKET_PROTOCOL_IPV4;
+        tcpsocket_connect_options.address     = "127.0.0.1";
+        tcpsocket_connect_options.port        = port;
+        tcpsocket_connect_options.nonblocking = 1;
+        tcpsocket_connect_options.buffered    = 1;
+        tcpsocket_connect_options.enabled     = 1;
+
+        tcpsocket = medusa_tcpsocket_connect_with_options(&tcpsocket_connect_options);
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                fprintf(stderr, "medusa_tcpsocket_connect_with_options failed\n");
+                goto bail;
+        }
+
+        rc = medusa_monitor_run(monitor);
+        if (rc != 0) {
+                fprintf(stderr, "medusa_monitor_run failed\n");
+                goto bail;
+        }
+
+        fprintf(stderr, "frontend received: %lld, sent: %lld\n", (long long) ctx.frontend_stats.received, (long long) ctx.frontend_stats.sent);
+        fprintf(stderr, "backend  received: %lld, sent: %lld\n", (long long) ctx.backend_stats.received, (long long) ctx.backend_stats.sent);
+        if (ctx.piped != 1 ||
+            ctx.received != PAYLOAD_LENGTH ||
+            ctx.frontend_stats.received != PAYLOAD_LENGTH ||
+            ctx.frontend_stats.sent != PAYLOAD_LENGTH ||
+            ctx.backend_stats.received != PAYLOAD_LENGTH ||
+            ctx.backend_stats.sent != PAYLOAD_LENGTH) {
+                fprintf(stderr, "pipe stats mismatch\n");
+                goto bail;
+        }
+
+        medusa_monitor_destroy(monitor);
+        free(ctx.payload);
+        return 0;
+bail:   if (monitor != NULL) {
+                medusa_monitor_destroy(monitor);
+        }
+        free(ctx.payload);
+        return -1;
+}
+
+static void sigalarm_handler (int sig)
+{
+        (void) sig;
+        abort();
+}
+
+static void sigint_handler (int sig)
+{
+        (void) sig;
+        abort();
+}
+
+int main (int argc, char *argv[])
+{
+        int rc;
+        unsigned int i;
+
+        (void) argc;
+        (void) argv;
+
+        srand(time(NULL));
+        signal(SIGALRM, sigalarm_handler);
+        signal(SIGINT, sigint_handler);
+        signal(SIGPIPE, SIG_IGN);
+
+        for (i = 0; i < sizeof(g_polls) / sizeof(g_polls[0]); i++) {
+                alarm(5);
+
+                fprintf(stderr, "testing poll: %d\n", g_polls[i]);
+                rc = test_poll(g_polls[i]);
+                if (rc != 0) {
+                        fprintf(stderr, "failed\n");
+                        return -1;
+                }
+                fprintf(stderr, "success\n");
+        }
+        return 0;
+}
+
+#else
+
+#include <stdio.h>
+
+int main (int argc, char *argv[])
+{
+        (void) argc;
+        (void) argv;
+        fprintf(stderr, "medusa tcpsocket pipe is only supported on linux\n");
+        return 0;
+}
+
+#endif
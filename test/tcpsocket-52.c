@@ -0,0 +1,272 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <errno.h>
+
+#if defined(__WINDOWS__)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#endif
+
+#include "medusa/error.h"
+#include "medusa/tcpsocket.h"
+#include "medusa/monitor.h"
+
+static const unsigned int g_polls[] = {
+        MEDUSA_MONITOR_POLL_DEFAULT,
+#if defined(__LINUX__)
+        MEDUSA_MONITOR_POLL_EPOLL,
+#endif
+#if defined(__APPLE__)
+        MEDUSA_MONITOR_POLL_KQUEUE,
+#endif
+        MEDUSA_MONITOR_POLL_POLL,
+        MEDUSA_MONITOR_POLL_SELECT,
+#if defined(__WINDOWS__)
+        MEDUSA_MONITOR_POLL_WSAPOLL,
+#endif
+};
+
+static const char *g_name = "localhost";
+static char g_address[INET6_ADDRSTRLEN];
+static unsigned int g_protocol;
+static unsigned int g_accepted;
+static unsigned int g_connected;
+static unsigned int g_errors;
+
+static int tcpsocket_client_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
+{
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_TCPSOCKET_EVENT_ERROR) {
+                fprintf(stderr, "  client error: %d\n", medusa_tcpsocket_get_error(tcpsocket));
+                g_errors += 1;
+        }
+        if (events & MEDUSA_TCPSOCKET_EVENT_CONNECTED) {
+                g_connected += 1;
+                medusa_tcpsocket_destroy(tcpsocket);
+        }
+        return 0;
+}
+
+static int tcpsocket_server_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
+{
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_TCPSOCKET_EVENT_DISCONNECTED) {
+                medusa_tcpsocket_destroy(tcpsocket);
+        }
+        return 0;
+}
+
+static int tcpsocket_listener_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
+{
+        int rc;
+        struct medusa_tcpsocket *accepted;
+        (void) param;
+        if (events & MEDUSA_TCPSOCKET_EVENT_CONNECTION) {
+                accepted = medusa_tcpsocket_accept(tcpsocket, tcpsocket_server_onevent, context);
+                if (MEDUSA_IS_ERR_OR_NULL(accepted)) {
+                        return MEDUSA_PTR_ERR(accepted);
+                }
+                rc  = medusa_tcpsocket_set_nonblocking(accepted, 1);
+                rc |= medusa_tcpsocket_set_enabled(accepted, 1);
+                if (rc < 0) {
+                        return -1;
+                }
+                g_accepted += 1;
+        }
+        return 0;
+}
+
+static struct medusa_tcpsocket * tcpsocket_connect (struct medusa_monitor *monitor, int port, double attempt_delay)
+{
+        struct medusa_tcpsocket_connect_options tcpsocket_connect_options;
+        medusa_tcpsocket_connect_options_default(&tcpsocket_connect_options);
+        tcpsocket_connect_options.monitor       = monitor;
+        tcpsocket_connect_options.onevent       = tcpsocket_client_onevent;
+        tcpsocket_connect_options.context       = NULL;
+        tcpsocket_connect_options.protocol      = MEDUSA_TCPSOCKET_PROTOCOL_ANY;
+        tcpsocket_connect_options.address       = g_name;
+        tcpsocket_connect_options.port          = port;
+        tcpsocket_connect_options.attempt_delay = attempt_delay;
+        tcpsocket_connect_options.nonblocking   = 1;
+        tcpsocket_connect_options.enabled       = 1;
+        return medusa_tcpsocket_connect_with_options(&tcpsocket_connect_options);
+}
+
+static int test_poll (unsigned int poll)
+{
+        int rc;
+
+        struct medusa_monitor *monitor;
+        struct medusa_monitor_init_options monitor_init_options;
+
+        int port;
+        struct medusa_tcpsocket *listener;
+        struct medusa_tcpsocket *tcpsocket;
+        struct medusa_tcpsocket_bind_options tcpsocket_bind_options;
+
+        monitor = NULL;
+        g_accepted  = 0;
+        g_connected = 0;
+        g_errors    = 0;
+
+        medusa_monitor_init_options_default(&monitor_init_options);
+        monitor_init_options.poll.type = poll;
+
+        monitor = medusa_monitor_create_with_options(&monitor_init_options);
+        if (monitor == NULL) {
+                goto bail;
+        }
+
+        /* only the last address listens, earlier ones are refused */
+        listener = NULL;
+        for (port = 12345; port < 65535; port++) {
+                rc = medusa_tcpsocket_bind_options_default(&tcpsocket_bind_options);
+                if (rc < 0) {
+                        goto bail;
+                }
+                tcpsocket_bind_options.monitor     = monitor;
+                tcpsocket_bind_options.onevent     = tcpsocket_listener_onevent;
+                tcpsocket_bind_options.context     = NULL;
+                tcpsocket_bind_options.protocol    = g_protocol;
+                tcpsocket_bind_options.address     = g_address;
+                tcpsocket_bind_options.port        = port;
+                tcpsocket_bind_options.reuseaddr   = 1;
+                tcpsocket_bind_options.reuseport   = 0;
+                tcpsocket_bind_options.backlog     = 128;
+                tcpsocket_bind_options.nonblocking = 1;
+                tcpsocket_bind_options.enabled     = 1;
+                listener = medusa_tcpsocket_bind_with_options(&tcpsocket_bind_options);
+                if (MEDUSA_IS_ERR_OR_NULL(listener)) {
+                        goto bail;
+                }
+                if (medusa_tcpsocket_get_state(listener) == MEDUSA_TCPSOCKET_STATE_ERROR) {
+                        medusa_tcpsocket_destroy(listener);
+                } else {
+                        break;
+                }
+        }
+        if (port >= 65535) {
+                goto bail;
+        }
+        fprintf(stderr, "port: %d\n", port);
+
+        tcpsocket = tcpsocket_connect(monitor, port, 0.250);
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                goto bail;
+        }
+        tcpsocket = tcpsocket_connect(monitor, port, 0);
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                goto bail;
+        }
+        while (g_connected < 2 || g_accepted < 2) {
+                rc = medusa_monitor_run_once(monitor);
+                if (rc < 0) {
+                        goto bail;
+                }
+                if (g_errors != 0) {
+                        goto bail;
+                }
+        }
+        fprintf(stderr, "  connected: %u, accepted: %u\n", g_connected, g_accepted);
+
+        /* no address listens, error is reported once all attempts fail */
+        medusa_tcpsocket_destroy(listener);
+        tcpsocket = tcpsocket_connect(monitor, port, 0.250);
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                goto bail;
+        }
+        while (g_errors < 1) {
+                rc = medusa_monitor_run_once(monitor);
+                if (rc < 0) {
+                        goto bail;
+                }
+        }
+        if (g_connected != 2) {
+                goto bail;
+        }
+
+        medusa_monitor_destroy(monitor);
+        return 0;
+bail:   if (monitor != NULL) {
+                medusa_monitor_destroy(monitor);
+        }
+        return -1;
+}
+
+static void alarm_handler (int sig)
+{
+        (void) sig;
+        abort();
+}
+
+int main (int argc, char *argv[])
+{
+        int rc;
+        unsigned int i;
+        unsigned int count;
+        struct addrinfo hints;
+        struct addrinfo *result;
+        struct addrinfo *entry;
+
+        (void) argc;
+        (void) argv;
+
+        srand(time(NULL));
+        signal(SIGALRM, alarm_handler);
+        signal(SIGPIPE, SIG_IGN);
+
+        memset(&hints, 0, sizeof(struct addrinfo));
+        hints.ai_family   = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        rc = getaddrinfo(g_name, NULL, &hints, &result);
+        if (rc != 0) {
+                fprintf(stderr, "can not resolve: %s, skipping\n", g_name);
+                return 0;
+        }
+        count = 0;
+        for (entry = result; entry != NULL; entry = entry->ai_next) {
+                count += 1;
+                if (entry->ai_next != NULL) {
+                        continue;
+                }
+                if (entry->ai_family == AF_INET) {
+                        g_protocol = MEDUSA_TCPSOCKET_PROTOCOL_IPV4;
+                        inet_ntop(AF_INET, &((struct sockaddr_in *) entry->ai_addr)->sin_addr, g_address, sizeof(g_address));
+                } else {
+                        g_protocol = MEDUSA_TCPSOCKET_PROTOCOL_IPV6;
+                        inet_ntop(AF_INET6, &((struct sockaddr_in6 *) entry->ai_addr)->sin6_addr, g_address, sizeof(g_address));
+                }
+        }
+        freeaddrinfo(result);
+        if (count < 2) {
+                fprintf(stderr, "%s has %u address, skipping\n", g_name, count);
+                return 0;
+        }
+        fprintf(stderr, "name: %s, addresses: %u, listen: %s\n", g_name, count, g_address);
+
+        for (i = 0; i < sizeof(g_polls) / sizeof(g_polls[0]); i++) {
+                alarm(5);
+
+                fprintf(stderr, "testing poll: %d\n", g_polls[i]);
+                rc = test_poll(g_polls[i]);
+                if (rc != 0) {
+                        fprintf(stderr, "  failed\n");
+                        return -1;
+                }
+                fprintf(stderr, "success\n");
+        }
+        return 0;
+}
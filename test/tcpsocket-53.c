@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <errno.h>
+
+#include "medusa/error.h"
+#include "medusa/buffer.h"
+#include "medusa/tcpsocket.h"
+#include "medusa/monitor.h"
+
+static const unsigned int g_polls[] = {
+        MEDUSA_MONITOR_POLL_DEFAULT,
+#if defined(__LINUX__)
+        MEDUSA_MONITOR_POLL_EPOLL,
+#endif
+#if defined(__APPLE__)
+        MEDUSA_MONITOR_POLL_KQUEUE,
+#endif
+        MEDUSA_MONITOR_POLL_POLL,
+        MEDUSA_MONITOR_POLL_SELECT,
+#if defined(__WINDOWS__)
+        MEDUSA_MONITOR_POLL_WSAPOLL,
+#endif
+};
+
+#define DATA_LENGTH     (256 * 1024)
+
+static char g_data[DATA_LENGTH];
+static int64_t g_received;
+static unsigned int g_errors;
+static struct medusa_tcpsocket *g_client;
+static struct medusa_tcpsocket *g_server;
+
+static int tcpsocket_client_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
+{
+        int64_t rc;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_TCPSOCKET_EVENT_ERROR) {
+                g_errors += 1;
+        }
+        if (events & MEDUSA_TCPSOCKET_EVENT_CONNECTED) {
+                rc = medusa_tcpsocket_write(tcpsocket, g_data, sizeof(g_data));
+                if (rc != sizeof(g_data)) {
+                        return -1;
+                }
+        }
+        return 0;
+}
+
+static int tcpsocket_server_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
+{
+        int64_t length;
+        struct medusa_buffer *buffer;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_TCPSOCKET_EVENT_ERROR) {
+                g_errors += 1;
+        }
+        if (events & MEDUSA_TCPSOCKET_EVENT_BUFFERED_READ) {
+                buffer = medusa_tcpsocket_get_read_buffer(tcpsocket);
+                if (MEDUSA_IS_ERR_OR_NULL(buffer)) {
+                        return -1;
+                }
+                length = medusa_buffer_get_length(buffer);
+                if (length < 0) {
+                        return -1;
+                }
+                if (medusa_buffer_choke(buffer, 0, length) != length) {
+                        return -1;
+                }
+                g_received += length;
+                if (g_received == DATA_LENGTH) {
+                        return medusa_monitor_break(medusa_tcpsocket_get_monitor(tcpsocket));
+                }
+        }
+        return 0;
+}
+
+static int tcpsocket_listener_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
+{
+        struct medusa_tcpsocket_accept_options options;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_TCPSOCKET_EVENT_CONNECTION) {
+                medusa_tcpsocket_accept_options_default(&options);
+                options.onevent     = tcpsocket_server_onevent;
+                options.context     = NULL;
+                options.nonblocking = 1;
+                options.buffered    = 1;
+                options.enabled     = 1;
+                g_server = medusa_tcpsocket_accept_with_options(tcpsocket, &options);
+                if (MEDUSA_IS_ERR_OR_NULL(g_server)) {
+                        return MEDUSA_PTR_ERR(g_server);
+                }
+        }
+        return 0;
+}
+
+static int test_poll (unsigned int poll)
+{
+        int rc;
+
+        struct medusa_monitor *monitor;
+        struct medusa_monitor_init_options monitor_init_options;
+
+        int port;
+        struct medusa_tcpsocket *listener;
+        struct medusa_tcpsocket_stats client;
+        struct medusa_tcpsocket_stats server;
+        struct medusa_tcpsocket_bind_options tcpsocket_bind_options;
+        struct medusa_tcpsocket_connect_options tcpsocket_connect_options;
+
+        monitor = NULL;
+        g_received = 0;
+        g_errors   = 0;
+        g_client   = NULL;
+        g_server   = NULL;
+
+        medusa_monitor_init_options_default(&monitor_init_options);
+        monitor_init_options.poll.type = poll;
+
+        monitor = medusa_monitor_create_with_options(&monitor_init_options);
+        if (monitor == NULL) {
+                goto bail;
+        }
+
+        /* accepted sockets inherit stats from the listener */
+        for (port = 12345; port < 65535; port++) {
+                medusa_tcpsocket_bind_options_default(&tcpsocket_bind_options);
+                tcpsocket_bind_options.monitor     = monitor;
+                tcpsocket_bind_options.onevent     = tcpsocket_listener_onevent;
+                tcpsocket_bind_options.context     = NULL;
+                tcpsocket_bind_options.protocol    = MEDUSA_TCPSOCKET_PROTOCOL_IPV4;
+                tcpsocket_bind_options.address     = "127.0.0.1";
+                tcpsocket_bind_options.port        = port;
+                tcpsocket_bind_options.reuseaddr   = 1;
+                tcpsocket_bind_options.backlog     = 128;
+                tcpsocket_bind_options.nonblocking = 1;
+                tcpsocket_bind_options.stats       = 1;
+                tcpsocket_bind_options.enabled     = 1;
+                listener = medusa_tcpsocket_bind_with_options(&tcpsocket_bind_options);
+                if (MEDUSA_IS_ERR_OR_NULL(listener)) {
+                        goto bail;
+                }
+                if (medusa_tcpsocket_get_state(listener) == MEDUSA_TCPSOCKET_STATE_ERROR) {
+                        medusa_tcpsocket_destroy(listener);
+                } else {
+                        break;
+                }
+        }
+        if (port >= 65535) {
+                goto bail;
+        }
+        fprintf(stderr, "port: %d\n", port);
+
+        medusa_tcpsocket_connect_options_default(&tcpsocket_connect_options);
+        tcpsocket_connect_options.monitor     = monitor;
+        tcpsocket_connect_options.onevent     = tcpsocket_client_onevent;
+        tcpsocket_connect_options.context     = NULL;
+        tcpsocket_connect_options.protocol    = MEDUSA_TCPSOCKET_PROTOCOL_IPV4;
+        tcpsocket_connect_options.address     = "127.0.0.1";
+        tcpsocket_connect_options.port        = port;
+        tcpsocket_connect_options.nonblocking = 1;
+        tcpsocket_connect_options.buffered    = 1;
+        tcpsocket_connect_options.stats       = 1;
+        tcpsocket_connect_options.enabled     = 1;
+        g_client = medusa_tcpsocket_connect_with_options(&tcpsocket_connect_options);
+        if (MEDUSA_IS_ERR_OR_NULL(g_client)) {
+                goto bail;
+        }
+
+        rc = medusa_monitor_run(monitor);
+        if (rc < 0 || g_errors != 0) {
+                goto bail;
+        }
+        if (MEDUSA_IS_ERR_OR_NULL(g_server) ||
+            medusa_tcpsocket_get_stats_enabled(g_server) != 1) {
+                goto bail;
+        }
+
+        rc  = medusa_tcpsocket_get_stats(g_client, &client);
+        rc |= medusa_tcpsocket_get_stats(g_server, &server);
+        if (rc < 0) {
+                goto bail;
+        }
+        fprintf(stderr, "  client sent: %lld, calls: %lld, eagain: %lld, highwater: %lld, wpending: %.6f, connect: %.6f, rtt: %.6f\n",
+                (long long) client.sent, (long long) client.send_calls, (long long) client.send_eagain,
+                (long long) client.wbuffer_highwater, client.wpending, client.connect, client.rtt);
+        fprintf(stderr, "  server received: %lld, calls: %lld, eagain: %lld\n",
+                (long long) server.received, (long long) server.recv_calls, (long long) server.recv_eagain);
+
+        if (client.sockets != 1 || server.sockets != 1) {
+                goto bail;
+        }
+        if (client.sent != DATA_LENGTH ||
+            client.send_calls <= 0 ||
+            client.wbuffer_highwater != DATA_LENGTH ||
+            client.wpending < 0 ||
+            client.connect < 0) {
+                goto bail;
+        }
+        if (server.received != DATA_LENGTH ||
+            server.recv_calls <= 0 ||
+            server.sent != 0) {
+                goto bail;
+        }
+#if defined(__LINUX__)
+        if (client.rtt < 0 || server.rtt < 0) {
+                goto bail;
+        }
+#endif
+
+        /* counters start over when stats are turned on again */
+        rc  = medusa_tcpsocket_set_stats_enabled(g_client, 0);
+        rc |= medusa_tcpsocket_get_stats(g_client, &client);
+        if (rc < 0 || client.sockets != 0 || client.sent != 0) {
+                goto bail;
+        }
+
+        medusa_monitor_destroy(monitor);
+        return 0;
+bail:   if (monitor != NULL) {
+                medusa_monitor_destroy(monitor);
+        }
+        return -1;
+}
+
+static void alarm_handler (int sig)
+{
+        (void) sig;
+        abort();
+}
+
+int main (int argc, char *argv[])
+{
+        int rc;
+        unsigned int i;
+
+        (void) argc;
+        (void) argv;
+
+        srand(time(NULL));
+        signal(SIGALRM, alarm_handler);
+        signal(SIGPIPE, SIG_IGN);
+
+        memset(g_data, 'x', sizeof(g_data));
+
+        for (i = 0; i < sizeof(g_polls) / sizeof(g_polls[0]); i++) {
+                alarm(5);
+                fprintf(stderr, "testing poll: %d\n", g_polls[i]);
+                rc = test_poll(g_polls[i]);
+                if (rc != 0) {
+                        fprintf(stderr, "poll: %d test failed\n", g_polls[i]);
+                        return -1;
+                }
+        }
+        return 0;
+}
@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <errno.h>
+
+#include "medusa/error.h"
+#include "medusa/clock.h"
+#include "medusa/buffer.h"
+#include "medusa/timer.h"
+#include "medusa/tcpsocket.h"
+#include "medusa/monitor.h"
+
+static const unsigned int g_polls[] = {
+        MEDUSA_MONITOR_POLL_DEFAULT,
+#if defined(__LINUX__)
+        MEDUSA_MONITOR_POLL_EPOLL,
+#endif
+#if defined(__APPLE__)
+        MEDUSA_MONITOR_POLL_KQUEUE,
+#endif
+        MEDUSA_MONITOR_POLL_POLL,
+        MEDUSA_MONITOR_POLL_SELECT,
+#if defined(__WINDOWS__)
+        MEDUSA_MONITOR_POLL_WSAPOLL,
+#endif
+};
+
+#define CLIENTS         8
+#define MAX_CONNECTIONS 4
+
+static unsigned int g_errors;
+static unsigned int g_served;
+static unsigned int g_accepted;
+static unsigned int g_checked;
+static struct medusa_tcpsocket *g_listener;
+static struct medusa_tcpsocket *g_servers[CLIENTS];
+
+static int tcpsocket_client_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
+{
+        int64_t length;
+        struct medusa_buffer *buffer;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_TCPSOCKET_EVENT_ERROR) {
+                g_errors += 1;
+        }
+        if (events & MEDUSA_TCPSOCKET_EVENT_BUFFERED_READ) {
+                buffer = medusa_tcpsocket_get_read_buffer(tcpsocket);
+                if (MEDUSA_IS_ERR_OR_NULL(buffer)) {
+                        return -1;
+                }
+                length = medusa_buffer_get_length(buffer);
+                if (length != 1) {
+                        return -1;
+                }
+                if (medusa_buffer_choke(buffer, 0, length) != length) {
+                        return -1;
+                }
+                g_served += 1;
+                if (g_served == CLIENTS) {
+                        return medusa_monitor_break(medusa_tcpsocket_get_monitor(tcpsocket));
+                }
+        }
+        return 0;
+}
+
+static int tcpsocket_server_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
+{
+        (void) tcpsocket;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_TCPSOCKET_EVENT_ERROR) {
+                g_errors += 1;
+        }
+        return 0;
+}
+
+static int tcpsocket_listener_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
+{
+        int64_t rc;
+        struct medusa_tcpsocket *accepted;
+        struct medusa_tcpsocket_accept_options options;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_TCPSOCKET_EVENT_CONNECTION) {
+                if (g_accepted >= CLIENTS) {
+                        return -1;
+                }
+                medusa_tcpsocket_accept_options_default(&options);
+                options.onevent     = tcpsocket_server_onevent;
+                options.context     = NULL;
+                options.nonblocking = 1;
+                options.buffered    = 1;
+                options.enabled     = 1;
+                accepted = medusa_tcpsocket_accept_with_options(tcpsocket, &options);
+                if (MEDUSA_IS_ERR_OR_NULL(accepted)) {
+                        return MEDUSA_PTR_ERR(accepted);
+                }
+                if (medusa_tcpsocket_get_nonblocking(accepted) != 1) {
+                        return -1;
+                }
+                rc = medusa_tcpsocket_write(accepted, "x", 1);
+                if (rc != 1) {
+                        return -1;
+                }
+                g_servers[g_accepted++] = accepted;
+        }
+        return 0;
+}
+
+static int limit_timer_onevent (struct medusa_timer *timer, unsigned int events, void *context, void *param)
+{
+        unsigned int i;
+        struct medusa_tcpsocket_accept_stats stats;
+        (void) timer;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_TIMER_EVENT_TIMEOUT) {
+                /* the listener stops at the limit, closing connections lets
+                 * the rest in */
+                if (medusa_tcpsocket_get_accept_stats(g_listener, &stats) < 0) {
+                        return -1;
+                }
+                fprintf(stderr, "  accepted: %u, connections: %lld, limited: %lld\n", g_accepted, (long long) stats.connections, (long long) stats.limited);
+                if (g_accepted != MAX_CONNECTIONS ||
+                    stats.connections != MAX_CONNECTIONS ||
+                    stats.limited < 1) {
+                        return -1;
+                }
+                for (i = 0; i < MAX_CONNECTIONS; i++) {
+                        medusa_tcpsocket_destroy(g_servers[i]);
+                }
+                g_checked = 1;
+        }
+        return 0;
+}
+
+static int test_poll (unsigned int poll, int batch, double rate)
+{
+        int rc;
+        unsigned int i;
+
+        struct medusa_monitor *monitor;
+        struct medusa_monitor_init_options monitor_init_options;
+
+        int port;
+        struct timespec started;
+        struct timespec finished;
+        struct medusa_timer *timer;
+        struct medusa_tcpsocket *client;
+        struct medusa_tcpsocket_accept_stats stats;
+        struct medusa_tcpsocket_bind_options tcpsocket_bind_options;
+        struct medusa_tcpsocket_connect_options tcpsocket_connect_options;
+
+        monitor = NULL;
+        g_errors   = 0;
+        g_served   = 0;
+        g_accepted = 0;
+        g_checked  = 0;
+
+        medusa_monitor_init_options_default(&monitor_init_options);
+        monitor_init_options.poll.type = poll;
+
+        monitor = medusa_monitor_create_with_options(&monitor_init_options);
+        if (monitor == NULL) {
+                goto bail;
+        }
+
+        for (port = 12345; port < 65535; port++) {
+                medusa_tcpsocket_bind_options_default(&tcpsocket_bind_options);
+                tcpsocket_bind_options.monitor         = monitor;
+                tcpsocket_bind_options.onevent         = tcpsocket_listener_onevent;
+                tcpsocket_bind_options.context         = NULL;
+                tcpsocket_bind_options.protocol        = MEDUSA_TCPSOCKET_PROTOCOL_IPV4;
+                tcpsocket_bind_options.address         = "127.0.0.1";
+                tcpsocket_bind_options.port            = port;
+                tcpsocket_bind_options.reuseaddr       = 1;
+                tcpsocket_bind_options.backlog         = 128;
+                tcpsocket_bind_options.nonblocking     = 1;
+                tcpsocket_bind_options.accept_batch    = batch;
+                tcpsocket_bind_options.max_connections = (rate > 0) ? 0 : MAX_CONNECTIONS;
+                tcpsocket_bind_options.accept_rate     = rate;
+                tcpsocket_bind_options.accept_burst    = 1;
+                tcpsocket_bind_options.enabled         = 1;
+                g_listener = medusa_tcpsocket_bind_with_options(&tcpsocket_bind_options);
+                if (MEDUSA_IS_ERR_OR_NULL(g_listener)) {
+                        goto bail;
+                }
+                if (medusa_tcpsocket_get_state(g_listener) == MEDUSA_TCPSOCKET_STATE_ERROR) {
+                        medusa_tcpsocket_destroy(g_listener);
+                } else {
+                        break;
+                }
+        }
+        if (port >= 65535) {
+                goto bail;
+        }
+        fprintf(stderr, "port: %d, batch: %d, rate: %.1f\n", port, batch, rate);
+        if (medusa_tcpsocket_get_accept_batch(g_listener) != batch ||
+            medusa_tcpsocket_get_accept_rate(g_listener) != rate) {
+                goto bail;
+        }
+
+        for (i = 0; i < CLIENTS; i++) {
+                medusa_tcpsocket_connect_options_default(&tcpsocket_connect_options);
+                tcpsocket_connect_options.monitor     = monitor;
+                tcpsocket_connect_options.onevent     = tcpsocket_client_onevent;
+                tcpsocket_connect_options.context     = NULL;
+                tcpsocket_connect_options.protocol    = MEDUSA_TCPSOCKET_PROTOCOL_IPV4;
+                tcpsocket_connect_options.address     = "127.0.0.1";
+                tcpsocket_connect_options.port        = port;
+                tcpsocket_connect_options.nonblocking = 1;
+                tcpsocket_connect_options.buffered    = 1;
+                tcpsocket_connect_options.enabled     = 1;
+                client = medusa_tcpsocket_connect_with_options(&tcpsocket_connect_options);
+                if (MEDUSA_IS_ERR_OR_NULL(client)) {
+                        goto bail;
+                }
+        }
+
+        if (rate <= 0) {
+                timer = medusa_timer_create_singleshot(monitor, 0.25, limit_timer_onevent, NULL);
+                if (MEDUSA_IS_ERR_OR_NULL(timer)) {
+                        goto bail;
+                }
+        }
+
+        medusa_clock_monotonic(&started);
+        rc = medusa_monitor_run(monitor);
+        if (rc < 0 || g_errors != 0 || g_served != CLIENTS) {
+                goto bail;
+        }
+        medusa_clock_monotonic(&finished);
+        medusa_timespec_sub(&finished, &started, &finished);
+
+        rc = medusa_tcpsocket_get_accept_stats(g_listener, &stats);
+        if (rc < 0) {
+                goto bail;
+        }
+        fprintf(stderr, "  accepted: %lld, connections: %lld, wakeups: %lld, rejected: %lld, limited: %lld, ratelimited: %lld, elapsed: %ld.%09ld\n",
+                (long long) stats.accepted, (long long) stats.connections, (long long) stats.wakeups,
+                (long long) stats.rejected, (long long) stats.limited, (long long) stats.ratelimited,
+                (long) finished.tv_sec, (long) finished.tv_nsec);
+        if (stats.accepted != CLIENTS ||
+            stats.rejected != 0 ||
+            stats.wakeups < 1) {
+                goto bail;
+        }
+        if (rate > 0) {
+                /* one token up front, the rest at rate per second */
+                if (stats.ratelimited < 1 ||
+                    stats.connections != CLIENTS ||
+                    finished.tv_sec * 1e9 + finished.tv_nsec < (CLIENTS - 1) / rate * 1e9 * 0.9) {
+                        goto bail;
+                }
+        } else {
+                if (g_checked != 1 ||
+                    stats.connections != CLIENTS - MAX_CONNECTIONS) {
+                        goto bail;
+                }
+        }
+
+        medusa_monitor_destroy(monitor);
+        return 0;
+bail:   if (monitor != NULL) {
+                medusa_monitor_destroy(monitor);
+        }
+        return -1;
+}
+
+static void alarm_handler (int sig)
+{
+        (void) sig;
+        abort();
+}
+
+int main (int argc, char *argv[])
+{
+        int rc;
+        unsigned int i;
+
+        (void) argc;
+        (void) argv;
+
+        srand(time(NULL));
+        signal(SIGALRM, alarm_handler);
+        signal(SIGPIPE, SIG_IGN);
+
+        for (i = 0; i < sizeof(g_polls) / sizeof(g_polls[0]); i++) {
+                alarm(5);
+                fprintf(stderr, "testing poll: %d\n", g_polls[i]);
+                rc  = test_poll(g_polls[i], 0, 0);
+                rc |= test_poll(g_polls[i], 16, 0);
+                rc |= test_poll(g_polls[i], 16, 40);
+                if (rc != 0) {
+                        fprintf(stderr, "poll: %d test failed\n", g_polls[i]);
+                        return -1;
+                }
+        }
+        return 0;
+}
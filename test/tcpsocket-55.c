@@ -0,0 +1,354 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "medusa/error.h"
+#include "medusa/buffer.h"
+#include "medusa/timer.h"
+#include "medusa/tcpsocket.h"
+#include "medusa/monitor.h"
+
+static const unsigned int g_polls[] = {
+        MEDUSA_MONITOR_POLL_DEFAULT,
+#if defined(__LINUX__)
+        MEDUSA_MONITOR_POLL_EPOLL,
+#endif
+#if defined(__APPLE__)
+        MEDUSA_MONITOR_POLL_KQUEUE,
+#endif
+        MEDUSA_MONITOR_POLL_POLL,
+        MEDUSA_MONITOR_POLL_SELECT,
+#if defined(__WINDOWS__)
+        MEDUSA_MONITOR_POLL_WSAPOLL,
+#endif
+};
+
+#define NOTSENT_LOWAT   16384
+
+enum {
+        MODE_WRITE_CONNECTED,
+        MODE_WRITE_LATER,
+        MODE_REFUSED
+};
+
+static unsigned int g_mode;
+static unsigned int g_errors;
+static unsigned int g_refused;
+static unsigned int g_echoed;
+static unsigned int g_accepted;
+
+static int client_write_timer_onevent (struct medusa_timer *timer, unsigned int events, void *context, void *param)
+{
+        int64_t rc;
+        struct medusa_tcpsocket *tcpsocket = context;
+        (void) timer;
+        (void) param;
+        if (events & MEDUSA_TIMER_EVENT_TIMEOUT) {
+                if (medusa_tcpsocket_get_state(tcpsocket) != MEDUSA_TCPSOCKET_STATE_CONNECTED) {
+                        return -1;
+                }
+                rc = medusa_tcpsocket_write(tcpsocket, "ping", 4);
+                if (rc != 4) {
+                        return -1;
+                }
+        }
+        return 0;
+}
+
+static int tcpsocket_client_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
+{
+        int64_t rc;
+        struct medusa_timer *timer;
+        struct medusa_buffer *buffer;
+        (void) context;
+        if (events & MEDUSA_TCPSOCKET_EVENT_CONNECTED) {
+                if (medusa_tcpsocket_get_fastopen(tcpsocket) != 1) {
+                        return -1;
+                }
+                if (g_mode == MODE_WRITE_LATER) {
+                        timer = medusa_timer_create_singleshot(medusa_tcpsocket_get_monitor(tcpsocket), 0.1, client_write_timer_onevent, tcpsocket);
+                        if (MEDUSA_IS_ERR_OR_NULL(timer)) {
+                                return MEDUSA_PTR_ERR(timer);
+                        }
+                } else {
+                        rc = medusa_tcpsocket_write(tcpsocket, "ping", 4);
+                        if (rc != 4) {
+                                return -1;
+                        }
+                }
+        }
+        if (events & MEDUSA_TCPSOCKET_EVENT_BUFFERED_READ) {
+                buffer = medusa_tcpsocket_get_read_buffer(tcpsocket);
+                if (MEDUSA_IS_ERR_OR_NULL(buffer)) {
+                        return -1;
+                }
+                if (medusa_buffer_get_length(buffer) < 4) {
+                        return 0;
+                }
+                if (medusa_buffer_memcmp(buffer, 0, "ping", 4) != 0) {
+                        return -1;
+                }
+                g_echoed += 1;
+                return medusa_monitor_break(medusa_tcpsocket_get_monitor(tcpsocket));
+        }
+        if (events & MEDUSA_TCPSOCKET_EVENT_ERROR) {
+                struct medusa_tcpsocket_event_error *medusa_tcpsocket_event_error = param;
+                fprintf(stderr, "  client error: %d, %s\n", medusa_tcpsocket_event_error->error, strerror(medusa_tcpsocket_event_error->error));
+                if (g_mode == MODE_REFUSED &&
+                    medusa_tcpsocket_event_error->error == ECONNREFUSED) {
+                        g_refused += 1;
+                } else {
+                        g_errors += 1;
+                }
+                return medusa_monitor_break(medusa_tcpsocket_get_monitor(tcpsocket));
+        }
+        return 0;
+}
+
+static int tcpsocket_server_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
+{
+        int64_t rc;
+        struct medusa_buffer *buffer;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_TCPSOCKET_EVENT_BUFFERED_READ) {
+                buffer = medusa_tcpsocket_get_read_buffer(tcpsocket);
+                if (MEDUSA_IS_ERR_OR_NULL(buffer)) {
+                        return -1;
+                }
+                if (medusa_buffer_get_length(buffer) < 4) {
+                        return 0;
+                }
+                rc = medusa_tcpsocket_write(tcpsocket, "ping", 4);
+                if (rc != 4) {
+                        return -1;
+                }
+                rc = medusa_buffer_choke(buffer, 0, 4);
+                if (rc != 4) {
+                        return -1;
+                }
+        }
+        if (events & MEDUSA_TCPSOCKET_EVENT_ERROR) {
+                g_errors += 1;
+        }
+        return 0;
+}
+
+static int tcpsocket_listener_onevent (struct medusa_tcpsocket *tcpsocket, unsigned int events, void *context, void *param)
+{
+        struct medusa_tcpsocket *accepted;
+        struct medusa_tcpsocket_accept_options options;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_TCPSOCKET_EVENT_CONNECTION) {
+                medusa_tcpsocket_accept_options_default(&options);
+                options.onevent     = tcpsocket_server_onevent;
+                options.context     = NULL;
+                options.nonblocking = 1;
+                options.buffered    = 1;
+                options.enabled     = 1;
+                accepted = medusa_tcpsocket_accept_with_options(tcpsocket, &options);
+                if (MEDUSA_IS_ERR_OR_NULL(accepted)) {
+                        return MEDUSA_PTR_ERR(accepted);
+                }
+                /* not set in the options, taken from the listener */
+                if (medusa_tcpsocket_get_notsent_lowat(accepted) != NOTSENT_LOWAT) {
+                        return -1;
+                }
+#if defined(TCP_NOTSENT_LOWAT)
+                {
+                        int rc;
+                        int value;
+                        socklen_t length;
+                        length = sizeof(value);
+                        rc = getsockopt(medusa_tcpsocket_get_fd(accepted), IPPROTO_TCP, TCP_NOTSENT_LOWAT, &value, &length);
+                        if (rc != 0 || value != NOTSENT_LOWAT) {
+                                return -1;
+                        }
+                }
+#endif
+                g_accepted += 1;
+        }
+        return 0;
+}
+
+static int closed_port (void)
+{
+        int fd;
+        int port;
+        socklen_t length;
+        struct sockaddr_in sockaddr;
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) {
+                return -1;
+        }
+        memset(&sockaddr, 0, sizeof(sockaddr));
+        sockaddr.sin_family      = AF_INET;
+        sockaddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        sockaddr.sin_port        = 0;
+        length = sizeof(sockaddr);
+        if (bind(fd, (struct sockaddr *) &sockaddr, sizeof(sockaddr)) != 0 ||
+            getsockname(fd, (struct sockaddr *) &sockaddr, &length) != 0) {
+                close(fd);
+                return -1;
+        }
+        port = ntohs(sockaddr.sin_port);
+        close(fd);
+        return port;
+}
+
+static int test_poll (unsigned int poll, unsigned int mode)
+{
+        int rc;
+
+        struct medusa_monitor *monitor;
+        struct medusa_monitor_init_options monitor_init_options;
+
+        int port;
+        struct medusa_tcpsocket *tcpsocket;
+        struct medusa_tcpsocket_bind_options tcpsocket_bind_options;
+        struct medusa_tcpsocket_connect_options tcpsocket_connect_options;
+
+        monitor = NULL;
+        g_mode     = mode;
+        g_errors   = 0;
+        g_refused  = 0;
+        g_echoed   = 0;
+        g_accepted = 0;
+
+        medusa_monitor_init_options_default(&monitor_init_options);
+        monitor_init_options.poll.type = poll;
+
+        monitor = medusa_monitor_create_with_options(&monitor_init_options);
+        if (monitor == NULL) {
+                goto bail;
+        }
+
+        if (mode == MODE_REFUSED) {
+                port = closed_port();
+                if (port <= 0) {
+                        goto bail;
+                }
+        } else {
+                for (port = 12345; port < 65535; port++) {
+                        medusa_tcpsocket_bind_options_default(&tcpsocket_bind_options);
+                        tcpsocket_bind_options.monitor       = monitor;
+                        tcpsocket_bind_options.onevent       = tcpsocket_listener_onevent;
+                        tcpsocket_bind_options.context       = NULL;
+                        tcpsocket_bind_options.protocol      = MEDUSA_TCPSOCKET_PROTOCOL_IPV4;
+                        tcpsocket_bind_options.address       = "127.0.0.1";
+                        tcpsocket_bind_options.port          = port;
+                        tcpsocket_bind_options.reuseaddr     = 1;
+                        tcpsocket_bind_options.reuseport     = 1;
+                        tcpsocket_bind_options.fastopen      = 16;
+                        tcpsocket_bind_options.defer_accept  = 1;
+                        tcpsocket_bind_options.incoming_cpu  = 0;
+                        tcpsocket_bind_options.notsent_lowat = NOTSENT_LOWAT;
+                        tcpsocket_bind_options.nonblocking   = 1;
+                        tcpsocket_bind_options.buffered      = 1;
+                        tcpsocket_bind_options.enabled       = 1;
+                        tcpsocket = medusa_tcpsocket_bind_with_options(&tcpsocket_bind_options);
+                        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                                goto bail;
+                        }
+                        if (medusa_tcpsocket_get_state(tcpsocket) == MEDUSA_TCPSOCKET_STATE_ERROR) {
+                                medusa_tcpsocket_destroy(tcpsocket);
+                        } else {
+                                break;
+                        }
+                }
+                if (port >= 65535) {
+                        goto bail;
+                }
+                if (medusa_tcpsocket_get_fastopen(tcpsocket) != 16 ||
+                    medusa_tcpsocket_get_defer_accept(tcpsocket) != 1 ||
+                    medusa_tcpsocket_get_incoming_cpu(tcpsocket) != 0 ||
+                    medusa_tcpsocket_get_notsent_lowat(tcpsocket) != NOTSENT_LOWAT) {
+                        goto bail;
+                }
+        }
+        fprintf(stderr, "port: %d, mode: %d\n", port, mode);
+
+        medusa_tcpsocket_connect_options_default(&tcpsocket_connect_options);
+        tcpsocket_connect_options.monitor     = monitor;
+        tcpsocket_connect_options.onevent     = tcpsocket_client_onevent;
+        tcpsocket_connect_options.context     = NULL;
+        tcpsocket_connect_options.protocol    = MEDUSA_TCPSOCKET_PROTOCOL_IPV4;
+        tcpsocket_connect_options.address     = "127.0.0.1";
+        tcpsocket_connect_options.port        = port;
+        tcpsocket_connect_options.fastopen    = 1;
+        tcpsocket_connect_options.nonblocking = 1;
+        tcpsocket_connect_options.buffered    = 1;
+        tcpsocket_connect_options.enabled     = 1;
+        tcpsocket = medusa_tcpsocket_connect_with_options(&tcpsocket_connect_options);
+        if (MEDUSA_IS_ERR_OR_NULL(tcpsocket)) {
+                goto bail;
+        }
+
+        rc = medusa_monitor_run(monitor);
+        if (rc < 0) {
+                goto bail;
+        }
+        fprintf(stderr, "  accepted: %u, echoed: %u, refused: %u, errors: %u\n", g_accepted, g_echoed, g_refused, g_errors);
+        if (g_errors != 0) {
+                goto bail;
+        }
+        if (mode == MODE_REFUSED) {
+                if (g_refused != 1) {
+                        goto bail;
+                }
+        } else {
+                if (g_accepted != 1 || g_echoed != 1) {
+                        goto bail;
+                }
+        }
+
+        medusa_monitor_destroy(monitor);
+        return 0;
+bail:   if (monitor != NULL) {
+                medusa_monitor_destroy(monitor);
+        }
+        return -1;
+}
+
+static void alarm_handler (int sig)
+{
+        (void) sig;
+        abort();
+}
+
+int main (int argc, char *argv[])
+{
+        int rc;
+        unsigned int i;
+
+        (void) argc;
+        (void) argv;
+
+        srand(time(NULL));
+        signal(SIGALRM, alarm_handler);
+        signal(SIGPIPE, SIG_IGN);
+
+        for (i = 0; i < sizeof(g_polls) / sizeof(g_polls[0]); i++) {
+                alarm(5);
+                fprintf(stderr, "testing poll: %d\n", g_polls[i]);
+                rc  = test_poll(g_polls[i], MODE_WRITE_CONNECTED);
+                rc |= test_poll(g_polls[i], MODE_WRITE_LATER);
+                rc |= test_poll(g_polls[i], MODE_REFUSED);
+                if (rc != 0) {
+                        fprintf(stderr, "poll: %d test failed\n", g_polls[i]);
+                        return -1;
+                }
+        }
+        return 0;
+}
@@ -0,0 +1,184 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+
+#if defined(__WINDOWS__)
+#include <windows.h>
+#endif
+
+#include "medusa/error.h"
+#include "medusa/clock.h"
+#include "medusa/timer.h"
+#include "medusa/monitor.h"
+
+static const unsigned int g_polls[] = {
+        MEDUSA_MONITOR_POLL_DEFAULT,
+#if defined(__LINUX__)
+        MEDUSA_MONITOR_POLL_EPOLL,
+#endif
+#if defined(__APPLE__)
+        MEDUSA_MONITOR_POLL_KQUEUE,
+#endif
+#if defined(__LINUX__) || defined(__APPLE__)
+        MEDUSA_MONITOR_POLL_POLL,
+#endif
+        MEDUSA_MONITOR_POLL_SELECT,
+#if defined(__WINDOWS__)
+        MEDUSA_MONITOR_POLL_WSAPOLL,
+#endif
+};
+
+#define TIMER_COUNT     100
+
+static struct medusa_monitor *g_monitor;
+static struct timespec g_started;
+static int g_timer_count;
+static int g_timer_early;
+
+static int timer_onevent (struct medusa_timer *timer, unsigned int events, void *context, void *param)
+{
+        double interval;
+        struct timespec now;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_TIMER_EVENT_TIMEOUT) {
+                medusa_clock_monotonic(&now);
+                medusa_timespec_sub(&now, &g_started, &now);
+                interval = medusa_timer_get_interval(timer);
+                if (now.tv_sec + now.tv_nsec * 1e-9 < interval - 0.001) {
+                        fprintf(stderr, "timer fired early: %f < %f\n", now.tv_sec + now.tv_nsec * 1e-9, interval);
+                        g_timer_early += 1;
+                }
+                g_timer_count += 1;
+                if (g_timer_count == TIMER_COUNT) {
+                        return medusa_monitor_break(g_monitor);
+                }
+        }
+        return 0;
+}
+
+static int test_poll (unsigned int poll, double slack)
+{
+        int i;
+        int rc;
+        struct medusa_timer *timer;
+        struct medusa_monitor_stats stats;
+        struct medusa_monitor_init_options options;
+
+        g_monitor = NULL;
+        g_timer_count = 0;
+        g_timer_early = 0;
+
+        medusa_monitor_init_options_default(&options);
+        options.poll.type   = poll;
+        options.timer.slack = slack;
+
+        g_monitor = medusa_monitor_create_with_options(&options);
+        if (MEDUSA_IS_ERR_OR_NULL(g_monitor)) {
+                fprintf(stderr, "medusa_monitor_create failed\n");
+                goto bail;
+        }
+        if (medusa_monitor_get_timer_slack(g_monitor) != slack) {
+                fprintf(stderr, "medusa_monitor_get_timer_slack failed\n");
+                goto bail;
+        }
+
+        medusa_clock_monotonic(&g_started);
+        for (i = 0; i < TIMER_COUNT; i++) {
+                timer = medusa_timer_create(g_monitor, timer_onevent, NULL);
+                if (MEDUSA_IS_ERR_OR_NULL(timer)) {
+                        fprintf(stderr, "medusa_timer_create failed\n");
+                        goto bail;
+                }
+                rc  = medusa_timer_set_interval(timer, 0.10 + i * 0.002);
+                rc |= medusa_timer_set_resolution(timer, MEDUSA_TIMER_RESOLUTION_MILLISECONDS);
+                rc |= medusa_timer_set_singleshot(timer, 1);
+                rc |= medusa_timer_set_enabled(timer, 1);
+                if (rc < 0) {
+                        fprintf(stderr, "medusa_timer_set failed\n");
+                        goto bail;
+                }
+        }
+
+        rc = medusa_monitor_run(g_monitor);
+        if (rc != 0) {
+                fprintf(stderr, "can not run monitor\n");
+                goto bail;
+        }
+        if (g_timer_early != 0) {
+                goto bail;
+        }
+
+        rc = medusa_monitor_get_stats(g_monitor, &stats);
+        if (rc < 0) {
+                fprintf(stderr, "medusa_monitor_get_stats failed\n");
+                goto bail;
+        }
+        fprintf(stderr, "slack: %f, wakeups: %llu, timer_wakeups: %llu\n", slack, stats.wakeups, stats.timer_wakeups);
+        if (stats.timer_wakeups == 0 ||
+            stats.wakeups < stats.timer_wakeups) {
+                goto bail;
+        }
+        if (slack > 0 && stats.timer_wakeups > (0.002 * TIMER_COUNT) / slack + 2) {
+                fprintf(stderr, "timers are not coalesced\n");
+                goto bail;
+        }
+
+        fprintf(stderr, "finish\n");
+
+        medusa_monitor_destroy(g_monitor);
+        return 0;
+bail:   if (g_monitor != NULL) {
+                medusa_monitor_destroy(g_monitor);
+        }
+        return -1;
+}
+
+#if !defined(__WINDOWS__)
+
+static void alarm_handler (int sig)
+{
+        (void) sig;
+        abort();
+}
+
+#endif
+
+int main (int argc, char *argv[])
+{
+        int rc;
+        unsigned int i;
+
+        (void) argc;
+        (void) argv;
+
+#if defined(__WINDOWS__)
+        WSADATA wsaData;
+        WSAStartup(MAKEWORD(2,2), &wsaData);
+#endif
+
+        srand(time(NULL));
+#if !defined(__WINDOWS__)
+        signal(SIGALRM, alarm_handler);
+#endif
+
+        for (i = 0; i < sizeof(g_polls) / sizeof(g_polls[0]); i++) {
+#if !defined(__WINDOWS__)
+                alarm(5);
+#endif
+                fprintf(stderr, "testing poll: %d\n", g_polls[i]);
+
+                rc  = test_poll(g_polls[i], 0.0);
+                rc |= test_poll(g_polls[i], 0.05);
+                if (rc != 0) {
+                        fprintf(stderr, "failed\n");
+                        return -1;
+                }
+        }
+        return 0;
+}
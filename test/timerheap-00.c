@@ -0,0 +1,151 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../src/timerheap.h"
+#include "../src/timerheap.c"
+
+struct entry {
+        int add;
+        int del;
+        uint64_t pri;
+        unsigned int pos;
+};
+
+int main (int argc, char *argv[])
+{
+        int i;
+        int count;
+        struct entry *entries;
+
+        uint64_t p;
+        uint64_t d;
+        struct entry *entry;
+        struct medusa_timerheap *heap;
+
+        long int seed;
+
+        (void) argc;
+        (void) argv;
+
+        seed = time(NULL);
+        srand(seed);
+
+        fprintf(stderr, "seed: %ld\n", seed);
+
+        count = 1 + rand() % 10000;
+        entries = malloc(sizeof(struct entry) * count);
+        if (entries == NULL) {
+                return -1;
+        }
+        for (i = 0; i < count; i++) {
+                entries[i].add = 0;
+                entries[i].del = 0;
+                entries[i].pri = rand() % (count / 2 + 1);
+                entries[i].pos = -1;
+        }
+
+        heap = medusa_timerheap_create(rand() % 64, offsetof(struct entry, pos));
+        if (heap == NULL) {
+                return -1;
+        }
+
+        fprintf(stderr, "add\n");
+        while (medusa_timerheap_count(heap) != (unsigned int) count) {
+                i = rand() % count;
+                if (entries[i].add == 0) {
+                        if (medusa_timerheap_add(heap, &entries[i], entries[i].pri) != 0) {
+                                return -1;
+                        }
+                        entries[i].add = 1;
+                }
+        }
+        if (!medusa_timerheap_verify(heap)) {
+                fprintf(stderr, "heap is invalid\n");
+                return -1;
+        }
+
+        fprintf(stderr, "mod\n");
+        for (i = 0; i < count; i++) {
+                entries[i].pri = rand() % (count / 2 + 1);
+                if (medusa_timerheap_mod(heap, &entries[i], entries[i].pri) != 0) {
+                        return -1;
+                }
+        }
+        if (!medusa_timerheap_verify(heap)) {
+                fprintf(stderr, "heap is invalid\n");
+                return -1;
+        }
+
+        fprintf(stderr, "del\n");
+        while (medusa_timerheap_count(heap) > (unsigned int) count / 2) {
+                i = rand() % count;
+                if (entries[i].del == 0) {
+                        if (medusa_timerheap_del(heap, &entries[i]) != 0) {
+                                return -1;
+                        }
+                        entries[i].del = 1;
+                }
+        }
+        if (!medusa_timerheap_verify(heap)) {
+                fprintf(stderr, "heap is invalid\n");
+                return -1;
+        }
+        for (i = 0; i < count; i++) {
+                if (entries[i].del != 0 && medusa_timerheap_del(heap, &entries[i]) == 0) {
+                        fprintf(stderr, "deleted entry is still present\n");
+                        return -1;
+                }
+        }
+
+        fprintf(stderr, "pop expired\n");
+        p = 0;
+        d = count / 4;
+        while ((entry = medusa_timerheap_pop_expired(heap, d)) != NULL) {
+                if (entry->del != 0) {
+                        fprintf(stderr, "  del is invalid: %d\n", entry->del);
+                        return -1;
+                }
+                if (entry->pri < p || entry->pri > d) {
+                        fprintf(stderr, "  %llu is out of order\n", (unsigned long long) entry->pri);
+                        return -1;
+                }
+                p = entry->pri;
+                entry->del = 1;
+        }
+        if (medusa_timerheap_peek(heap, &d) != NULL && d <= (uint64_t) count / 4) {
+                fprintf(stderr, "  expired entry is left: %llu\n", (unsigned long long) d);
+                return -1;
+        }
+
+        fprintf(stderr, "pop\n");
+        while (medusa_timerheap_count(heap) > 0) {
+                entry = medusa_timerheap_pop(heap, &d);
+                if (entry == NULL) {
+                        return -1;
+                }
+                if (entry->del != 0) {
+                        fprintf(stderr, "  del is invalid: %d\n", entry->del);
+                        return -1;
+                }
+                if (d != entry->pri || entry->pri < p) {
+                        fprintf(stderr, "  %llu < %llu\n", (unsigned long long) entry->pri, (unsigned long long) p);
+                        return -1;
+                }
+                p = entry->pri;
+                entry->del = 1;
+        }
+        if (medusa_timerheap_pop(heap, NULL) != NULL) {
+                return -1;
+        }
+
+        medusa_timerheap_destroy(heap);
+        free(entries);
+
+        fprintf(stderr, "finish\n");
+
+        return 0;
+}
@@ -0,0 +1,197 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "../src/clock.h"
+#include "../src/pqueue.h"
+#include "../src/pqueue.c"
+#include "../src/timerheap.h"
+#include "../src/timerheap.c"
+
+struct entry {
+        struct timespec timespec;
+        uint64_t deadline;
+        unsigned int pos;
+};
+
+static int entry_compare (void *a, void *b)
+{
+        struct entry *ea = (struct entry *) a;
+        struct entry *eb = (struct entry *) b;
+        return medusa_timespec_compare(&ea->timespec, &eb->timespec, >);
+}
+
+static void entry_set_position (void *a, unsigned int p)
+{
+        struct entry *ea = (struct entry *) a;
+        ea->pos = p;
+}
+
+static unsigned int entry_get_position (void *a)
+{
+        struct entry *ea = (struct entry *) a;
+        return ea->pos;
+}
+
+static void entry_set (struct entry *entry, long long nsecs)
+{
+        entry->timespec.tv_sec  = nsecs / 1000000000;
+        entry->timespec.tv_nsec = nsecs % 1000000000;
+        entry->deadline         = nsecs;
+}
+
+static long long usecs_since (struct timespec *ts)
+{
+        struct timespec te;
+        clock_gettime(CLOCK_MONOTONIC, &te);
+        medusa_timespec_sub(&te, ts, &te);
+        return te.tv_sec * 1000000LL + te.tv_nsec / 1000;
+}
+
+static int test_pqueue (struct entry *entries, int count)
+{
+        int i;
+        struct timespec ts;
+        struct entry *entry;
+        struct entry *pentry;
+        struct medusa_pqueue_head *pqueue;
+
+        pqueue = medusa_pqueue_create(0, 64, entry_compare, entry_set_position, entry_get_position);
+        if (pqueue == NULL) {
+                return -1;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        for (i = 0; i < count; i++) {
+                if (medusa_pqueue_add(pqueue, &entries[i]) != 0) {
+                        return -1;
+                }
+        }
+        fprintf(stderr, "  pqueue    add: %lld usecs\n", usecs_since(&ts));
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        for (i = 0; i < count; i++) {
+                struct timespec timespec = entries[i].timespec;
+                entry_set(&entries[i], entries[i].deadline + rand() % 1000000);
+                medusa_pqueue_mod(pqueue, &entries[i], medusa_timespec_compare(&timespec, &entries[i].timespec, >));
+        }
+        fprintf(stderr, "  pqueue    mod: %lld usecs\n", usecs_since(&ts));
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        for (pentry = NULL, i = 0; i < count; i++) {
+                entry = medusa_pqueue_pop(pqueue);
+                if (entry == NULL) {
+                        return -1;
+                }
+                if (pentry != NULL && pentry->deadline > entry->deadline) {
+                        fprintf(stderr, "  pqueue order is invalid\n");
+                        return -1;
+                }
+                pentry = entry;
+        }
+        fprintf(stderr, "  pqueue    pop: %lld usecs\n", usecs_since(&ts));
+
+        medusa_pqueue_destroy(pqueue);
+        return 0;
+}
+
+static int test_timerheap (struct entry *entries, int count)
+{
+        int i;
+        struct timespec ts;
+        struct entry *entry;
+        struct entry *pentry;
+        struct medusa_timerheap *heap;
+
+        heap = medusa_timerheap_create(64, offsetof(struct entry, pos));
+        if (heap == NULL) {
+                return -1;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        for (i = 0; i < count; i++) {
+                if (medusa_timerheap_add(heap, &entries[i], entries[i].deadline) != 0) {
+                        return -1;
+                }
+        }
+        fprintf(stderr, "  timerheap add: %lld usecs\n", usecs_since(&ts));
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        for (i = 0; i < count; i++) {
+                entry_set(&entries[i], entries[i].deadline + rand() % 1000000);
+                if (medusa_timerheap_mod(heap, &entries[i], entries[i].deadline) != 0) {
+                        return -1;
+                }
+        }
+        fprintf(stderr, "  timerheap mod: %lld usecs\n", usecs_since(&ts));
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        for (pentry = NULL, i = 0; i < count; i++) {
+                entry = medusa_timerheap_pop_expired(heap, UINT64_MAX);
+                if (entry == NULL) {
+                        return -1;
+                }
+                if (pentry != NULL && pentry->deadline > entry->deadline) {
+                        fprintf(stderr, "  timerheap order is invalid\n");
+                        return -1;
+                }
+                pentry = entry;
+        }
+        fprintf(stderr, "  timerheap pop: %lld usecs\n", usecs_since(&ts));
+
+        medusa_timerheap_destroy(heap);
+        return 0;
+}
+
+int main (int argc, char *argv[])
+{
+        int c;
+        int i;
+        int count;
+        unsigned int seed;
+        struct entry *entries;
+
+        seed  = time(NULL);
+        count = 1000000;
+
+        while ((c = getopt(argc, argv, "n:")) != -1) {
+                switch (c) {
+                        case 'n':
+                                count = atoi(optarg);
+                                break;
+                        default:
+                                fprintf(stderr, "unknown param: %c", c);
+                                return -1;
+                }
+        }
+
+        fprintf(stderr, "seed: %u, count: %d\n", seed, count);
+
+        entries = malloc(sizeof(struct entry) * count);
+        if (entries == NULL) {
+                return -1;
+        }
+
+        srand(seed);
+        for (i = 0; i < count; i++) {
+                entry_set(&entries[i], (long long) rand() * 1000);
+        }
+        if (test_pqueue(entries, count) != 0) {
+                return -1;
+        }
+
+        srand(seed);
+        for (i = 0; i < count; i++) {
+                entry_set(&entries[i], (long long) rand() * 1000);
+        }
+        if (test_timerheap(entries, count) != 0) {
+                return -1;
+        }
+
+        free(entries);
+        return 0;
+}
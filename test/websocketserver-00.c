@@ -0,0 +1,341 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+
+#include "medusa/error.h"
+#include "medusa/tcpsocket.h"
+#include "medusa/websocketserver.h"
+#include "medusa/websocketclient.h"
+#include "medusa/monitor.h"
+
+static const unsigned int g_polls[] = {
+        MEDUSA_MONITOR_POLL_DEFAULT,
+#if defined(__LINUX__)
+        MEDUSA_MONITOR_POLL_EPOLL,
+#endif
+#if defined(__APPLE__)
+        MEDUSA_MONITOR_POLL_KQUEUE,
+#endif
+        MEDUSA_MONITOR_POLL_POLL,
+        MEDUSA_MONITOR_POLL_SELECT,
+#if defined(__WINDOWS__)
+        MEDUSA_MONITOR_POLL_WSAPOLL,
+#endif
+};
+
+#define CLIENTS         4
+#define FRAMES          64
+#define PAYLOAD         4096
+#define LIMIT           (128 * 1024)
+
+struct peer {
+        unsigned int policy;
+        int connected;
+        int hello;
+        unsigned int received;
+        unsigned int dropped;
+        unsigned int drops;
+        int error;
+        int disconnected;
+};
+
+static const unsigned int g_policies[CLIENTS] = {
+        MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_NONE,
+        MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_SKIP,
+        MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_DROP,
+        MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_DISCONNECT,
+};
+
+static unsigned int g_errors;
+static unsigned int g_accepted;
+static struct peer g_peers[CLIENTS];
+static char g_payload[PAYLOAD];
+
+static int websocketserver_client_onevent (struct medusa_websocketserver_client *websocketserver_client, unsigned int events, void *context, void *param)
+{
+        struct peer *peer = (struct peer *) context;
+        (void) websocketserver_client;
+        if (events & MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_CONNECTED) {
+                peer->connected = 1;
+        }
+        if (events & MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_FRAMES_DROPPED) {
+                struct medusa_websocketserver_client_event_frames_dropped *medusa_websocketserver_client_event_frames_dropped = (struct medusa_websocketserver_client_event_frames_dropped *) param;
+                if (medusa_websocketserver_client_event_frames_dropped->count == 0 ||
+                    medusa_websocketserver_client_event_frames_dropped->length <= 0) {
+                        g_errors += 1;
+                }
+                peer->dropped += medusa_websocketserver_client_event_frames_dropped->count;
+                peer->drops   += 1;
+        }
+        if (events & MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_ERROR) {
+                peer->error = 1;
+        }
+        return 0;
+}
+
+static int websocketserver_onevent (struct medusa_websocketserver *websocketserver, unsigned int events, void *context, void *param)
+{
+        int rc;
+        struct medusa_websocketserver_client *websocketserver_client;
+        struct medusa_websocketserver_accept_options websocketserver_accept_options;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_WEBSOCKETSERVER_EVENT_CONNECTION) {
+                if (g_accepted >= CLIENTS) {
+                        return -1;
+                }
+                rc = medusa_websocketserver_accept_options_default(&websocketserver_accept_options);
+                if (rc < 0) {
+                        return rc;
+                }
+                websocketserver_accept_options.enabled             = 1;
+                websocketserver_accept_options.backpressure_limit  = LIMIT;
+                websocketserver_accept_options.backpressure_policy = g_peers[g_accepted].policy;
+                websocketserver_accept_options.onevent             = websocketserver_client_onevent;
+                websocketserver_accept_options.context             = &g_peers[g_accepted];
+                websocketserver_client = medusa_websocketserver_accept_with_options(websocketserver, &websocketserver_accept_options);
+                if (MEDUSA_IS_ERR_OR_NULL(websocketserver_client)) {
+                        return MEDUSA_PTR_ERR(websocketserver_client);
+                }
+                g_accepted += 1;
+        }
+        return 0;
+}
+
+static int websocketclient_onevent (struct medusa_websocketclient *websocketclient, unsigned int events, void *context, void *param)
+{
+        struct peer *peer = (struct peer *) context;
+        (void) websocketclient;
+        if (events & MEDUSA_WEBSOCKETCLIENT_EVENT_MESSAGE) {
+                struct medusa_websocketclient_event_message *medusa_websocketclient_event_message = (struct medusa_websocketclient_event_message *) param;
+                if (medusa_websocketclient_event_message->length == 5 &&
+                    memcmp(medusa_websocketclient_event_message->payload, "hello", 5) == 0) {
+                        peer->hello += 1;
+                } else if (medusa_websocketclient_event_message->length == PAYLOAD &&
+                           memcmp(medusa_websocketclient_event_message->payload, g_payload, PAYLOAD) == 0) {
+                        peer->received += 1;
+                } else {
+                        g_errors += 1;
+                }
+        }
+        if (events & (MEDUSA_WEBSOCKETCLIENT_EVENT_ERROR | MEDUSA_WEBSOCKETCLIENT_EVENT_DISCONNECTED)) {
+                if (peer->policy != MEDUSA_WEBSOCKETSERVER_CLIENT_BACKPRESSURE_POLICY_DISCONNECT) {
+                        g_errors += 1;
+                }
+                peer->disconnected = 1;
+        }
+        return 0;
+}
+
+static int test_done (void)
+{
+        return g_peers[0].received == FRAMES &&
+               g_peers[1].received == FRAMES - g_peers[1].dropped &&
+               g_peers[2].received == FRAMES - g_peers[2].dropped &&
+               g_peers[3].disconnected;
+}
+
+static int test_poll (unsigned int poll)
+{
+        int rc;
+        int port;
+        unsigned int i;
+
+        struct medusa_monitor *monitor;
+        struct medusa_monitor_init_options monitor_init_options;
+
+        struct medusa_websocketserver *websocketserver;
+        struct medusa_websocketserver_frame *frame;
+        struct medusa_websocketserver_init_options websocketserver_init_options;
+
+        struct medusa_websocketclient *websocketclient;
+        struct medusa_websocketclient_connect_options websocketclient_connect_options;
+
+        monitor = NULL;
+        frame   = NULL;
+
+        g_errors   = 0;
+        g_accepted = 0;
+        memset(g_peers, 0, sizeof(g_peers));
+        for (i = 0; i < CLIENTS; i++) {
+                g_peers[i].policy = g_policies[i];
+        }
+
+        medusa_monitor_init_options_default(&monitor_init_options);
+        monitor_init_options.poll.type = poll;
+
+        monitor = medusa_monitor_create_with_options(&monitor_init_options);
+        if (monitor == NULL) {
+                goto bail;
+        }
+
+        rc = medusa_websocketserver_init_options_default(&websocketserver_init_options);
+        if (rc < 0) {
+                goto bail;
+        }
+        websocketserver_init_options.monitor   = monitor;
+        websocketserver_init_options.protocol  = MEDUSA_WEBSOCKETSERVER_PROTOCOL_IPV4;
+        websocketserver_init_options.address   = "127.0.0.1";
+        websocketserver_init_options.port      = 0;
+        websocketserver_init_options.reuseport = 0;
+        websocketserver_init_options.enabled   = 1;
+        websocketserver_init_options.started   = 1;
+        websocketserver_init_options.onevent   = websocketserver_onevent;
+        websocketserver_init_options.context   = NULL;
+        websocketserver = medusa_websocketserver_create_with_options(&websocketserver_init_options);
+        if (MEDUSA_IS_ERR_OR_NULL(websocketserver)) {
+                goto bail;
+        }
+        port = medusa_websocketserver_get_sockport(websocketserver);
+        if (port <= 0) {
+                goto bail;
+        }
+        fprintf(stderr, "  port: %d\n", port);
+
+        /* one at a time, so accept order matches the policy table */
+        for (i = 0; i < CLIENTS; i++) {
+                rc = medusa_websocketclient_connect_options_default(&websocketclient_connect_options);
+                if (rc < 0) {
+                        goto bail;
+                }
+                websocketclient_connect_options.monitor         = monitor;
+                websocketclient_connect_options.protocol        = MEDUSA_WEBSOCKETCLIENT_PROTOCOL_IPV4;
+                websocketclient_connect_options.address         = "127.0.0.1";
+                websocketclient_connect_options.port            = port;
+                websocketclient_connect_options.server_path     = "/";
+                websocketclient_connect_options.server_protocol = "test";
+                websocketclient_connect_options.enabled         = 1;
+                websocketclient_connect_options.onevent         = websocketclient_onevent;
+                websocketclient_connect_options.context         = &g_peers[i];
+                websocketclient = medusa_websocketclient_connect_with_options(&websocketclient_connect_options);
+                if (MEDUSA_IS_ERR_OR_NULL(websocketclient)) {
+                        goto bail;
+                }
+                while (g_peers[i].connected == 0) {
+                        rc = medusa_monitor_run_timeout(monitor, 1.0);
+                        if (rc < 0) {
+                                goto bail;
+                        }
+                }
+        }
+
+        /* invalid opcodes and oversized or fragmented control frames are
+         * never encoded */
+        if (!MEDUSA_IS_ERR(medusa_websocketserver_frame_create(1, 17, "x", 1)) ||
+            !MEDUSA_IS_ERR(medusa_websocketserver_frame_create(1, MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_PING, g_payload, 126)) ||
+            !MEDUSA_IS_ERR(medusa_websocketserver_frame_create(0, MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_PONG, "x", 1)) ||
+            medusa_websocketserver_broadcast(websocketserver, 1, MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_CLOSE, g_payload, 200) != -EINVAL) {
+                fprintf(stderr, "  invalid frame accepted\n");
+                goto bail;
+        }
+
+        rc = medusa_websocketserver_broadcast(websocketserver, 1, MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_TEXT, "hello", 5);
+        if (rc != CLIENTS) {
+                fprintf(stderr, "  broadcast: %d\n", rc);
+                goto bail;
+        }
+        while (g_peers[0].hello + g_peers[1].hello + g_peers[2].hello + g_peers[3].hello != CLIENTS) {
+                rc = medusa_monitor_run_timeout(monitor, 1.0);
+                if (rc < 0) {
+                        goto bail;
+                }
+        }
+
+        /* nothing is sent while the loop is not running, every client
+         * fills up and hits its policy */
+        frame = medusa_websocketserver_frame_create(1, MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_TEXT, g_payload, PAYLOAD);
+        if (MEDUSA_IS_ERR_OR_NULL(frame)) {
+                frame = NULL;
+                goto bail;
+        }
+        for (i = 0; i < FRAMES; i++) {
+                rc = medusa_websocketserver_broadcast_frame(websocketserver, frame);
+                if (rc < 0) {
+                        goto bail;
+                }
+        }
+        fprintf(stderr, "  refcount: %lld, skipped: %u, dropped: %u / %u\n",
+                (long long) medusa_websocketserver_frame_get_refcount(frame),
+                g_peers[1].dropped, g_peers[2].dropped, g_peers[2].drops);
+        if (medusa_websocketserver_frame_get_refcount(frame) <= 1) {
+                goto bail;
+        }
+        if (g_peers[0].dropped != 0 ||
+            g_peers[1].dropped == 0 ||
+            g_peers[1].drops != g_peers[1].dropped ||
+            g_peers[2].dropped == 0 ||
+            g_peers[3].error != 1) {
+                goto bail;
+        }
+
+        while (!test_done()) {
+                rc = medusa_monitor_run_timeout(monitor, 1.0);
+                if (rc < 0) {
+                        goto bail;
+                }
+                if (g_errors != 0) {
+                        goto bail;
+                }
+        }
+        fprintf(stderr, "  received: %u, %u, %u\n", g_peers[0].received, g_peers[1].received, g_peers[2].received);
+
+        /* every queue has drained, only our reference is left */
+        if (medusa_websocketserver_frame_get_refcount(frame) != 1) {
+                goto bail;
+        }
+        medusa_websocketserver_frame_unref(frame);
+        frame = NULL;
+
+        if (g_errors != 0) {
+                goto bail;
+        }
+
+        medusa_monitor_destroy(monitor);
+        return 0;
+bail:   if (frame != NULL) {
+                medusa_websocketserver_frame_unref(frame);
+        }
+        if (monitor != NULL) {
+                medusa_monitor_destroy(monitor);
+        }
+        return -1;
+}
+
+static void alarm_handler (int sig)
+{
+        (void) sig;
+        abort();
+}
+
+int main (int argc, char *argv[])
+{
+        int rc;
+        unsigned int i;
+
+        (void) argc;
+        (void) argv;
+
+        srand(time(NULL));
+        signal(SIGALRM, alarm_handler);
+        signal(SIGPIPE, SIG_IGN);
+
+        for (i = 0; i < sizeof(g_payload); i++) {
+                g_payload[i] = 'a' + (rand() % 26);
+        }
+
+        for (i = 0; i < sizeof(g_polls) / sizeof(g_polls[0]); i++) {
+                alarm(10);
+                fprintf(stderr, "testing poll: %d\n", g_polls[i]);
+                rc = test_poll(g_polls[i]);
+                if (rc != 0) {
+                        fprintf(stderr, "poll: %d test failed\n", g_polls[i]);
+                        return -1;
+                }
+        }
+        return 0;
+}
@@ -0,0 +1,404 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+
+#include "medusa/error.h"
+#include "medusa/tcpsocket.h"
+#include "medusa/websocketserver.h"
+#include "medusa/websocketclient.h"
+#include "medusa/monitor.h"
+
+static const unsigned int g_polls[] = {
+        MEDUSA_MONITOR_POLL_DEFAULT,
+#if defined(__LINUX__)
+        MEDUSA_MONITOR_POLL_EPOLL,
+#endif
+#if defined(__APPLE__)
+        MEDUSA_MONITOR_POLL_KQUEUE,
+#endif
+        MEDUSA_MONITOR_POLL_POLL,
+        MEDUSA_MONITOR_POLL_SELECT,
+#if defined(__WINDOWS__)
+        MEDUSA_MONITOR_POLL_WSAPOLL,
+#endif
+};
+
+#define CLIENTS         4
+#define MESSAGE         "hello world"
+
+static const char *g_fragments[] = {
+        "hel",
+        "lo ",
+        "world",
+};
+
+struct side {
+        unsigned int chunks;
+        unsigned int messages;
+        int64_t length;
+        char payload[64];
+        unsigned int error;
+        int closed;
+};
+
+struct peer {
+        unsigned int mode;
+        int64_t server_max;
+        int64_t client_max;
+        struct side server;
+        struct side client;
+};
+
+static const struct peer g_setup[CLIENTS] = {
+        { .mode = MEDUSA_WEBSOCKETSERVER_CLIENT_MESSAGE_MODE_STREAM,   .server_max = 0, .client_max = 0 },
+        { .mode = MEDUSA_WEBSOCKETSERVER_CLIENT_MESSAGE_MODE_ASSEMBLE, .server_max = 0, .client_max = 0 },
+        { .mode = MEDUSA_WEBSOCKETSERVER_CLIENT_MESSAGE_MODE_ASSEMBLE, .server_max = 8, .client_max = 0 },
+        { .mode = MEDUSA_WEBSOCKETSERVER_CLIENT_MESSAGE_MODE_ASSEMBLE, .server_max = 0, .client_max = 8 },
+};
+
+static unsigned int g_errors;
+static unsigned int g_accepted;
+static struct peer g_peers[CLIENTS];
+
+static int side_chunk (struct side *side, unsigned int final, int64_t offset, int64_t length, const void *payload)
+{
+        if (offset != side->length ||
+            offset + length > (int64_t) sizeof(side->payload)) {
+                g_errors += 1;
+                return -1;
+        }
+        memcpy(side->payload + offset, payload, length);
+        side->length += length;
+        side->chunks += 1;
+        if (final) {
+                if (side->length != strlen(MESSAGE) ||
+                    memcmp(side->payload, MESSAGE, side->length) != 0) {
+                        g_errors += 1;
+                        return -1;
+                }
+                side->messages += 1;
+                return 1;
+        }
+        return 0;
+}
+
+static int side_message (struct side *side, unsigned int final, unsigned int length, const void *payload)
+{
+        /* assembled messages come out whole, exactly once */
+        if (final != 1 ||
+            length != strlen(MESSAGE) ||
+            memcmp(payload, MESSAGE, length) != 0) {
+                g_errors += 1;
+                return -1;
+        }
+        side->messages += 1;
+        return 1;
+}
+
+static int websocketserver_client_onevent (struct medusa_websocketserver_client *websocketserver_client, unsigned int events, void *context, void *param)
+{
+        int rc;
+        unsigned int i;
+        struct peer *peer = (struct peer *) context;
+        rc = 0;
+        if (events & MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_MESSAGE_CHUNK) {
+                struct medusa_websocketserver_client_event_message_chunk *medusa_websocketserver_client_event_message_chunk = (struct medusa_websocketserver_client_event_message_chunk *) param;
+                if (peer->mode != MEDUSA_WEBSOCKETSERVER_CLIENT_MESSAGE_MODE_STREAM ||
+                    medusa_websocketserver_client_event_message_chunk->type != MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_TEXT) {
+                        g_errors += 1;
+                        return 0;
+                }
+                rc = side_chunk(&peer->server,
+                                medusa_websocketserver_client_event_message_chunk->final,
+                                medusa_websocketserver_client_event_message_chunk->offset,
+                                medusa_websocketserver_client_event_message_chunk->length,
+                                medusa_websocketserver_client_event_message_chunk->payload);
+        }
+        if (events & MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_MESSAGE) {
+                struct medusa_websocketserver_client_event_message *medusa_websocketserver_client_event_message = (struct medusa_websocketserver_client_event_message *) param;
+                if (peer->mode != MEDUSA_WEBSOCKETSERVER_CLIENT_MESSAGE_MODE_ASSEMBLE ||
+                    medusa_websocketserver_client_event_message->type != MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_TEXT) {
+                        g_errors += 1;
+                        return 0;
+                }
+                rc = side_message(&peer->server,
+                                  medusa_websocketserver_client_event_message->final,
+                                  medusa_websocketserver_client_event_message->length,
+                                  medusa_websocketserver_client_event_message->payload);
+        }
+        if (events & MEDUSA_WEBSOCKETSERVER_CLIENT_EVENT_ERROR) {
+                peer->server.error = 1;
+        }
+        if (rc == 1) {
+                /* echo it back fragmented the same way */
+                for (i = 0; i < sizeof(g_fragments) / sizeof(g_fragments[0]); i++) {
+                        rc = medusa_websocketserver_client_write(websocketserver_client,
+                                                                 i == sizeof(g_fragments) / sizeof(g_fragments[0]) - 1,
+                                                                 (i == 0) ? MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_TEXT : MEDUSA_WEBSOCKETSERVER_CLIENT_FRAME_TYPE_CONTINUATION,
+                                                                 g_fragments[i], strlen(g_fragments[i]));
+                        if (rc != (int) strlen(g_fragments[i])) {
+                                g_errors += 1;
+                                return -1;
+                        }
+                }
+        }
+        return 0;
+}
+
+static int websocketserver_onevent (struct medusa_websocketserver *websocketserver, unsigned int events, void *context, void *param)
+{
+        int rc;
+        struct medusa_websocketserver_client *websocketserver_client;
+        struct medusa_websocketserver_accept_options websocketserver_accept_options;
+        (void) context;
+        (void) param;
+        if (events & MEDUSA_WEBSOCKETSERVER_EVENT_CONNECTION) {
+                if (g_accepted >= CLIENTS) {
+                        return -1;
+                }
+                rc = medusa_websocketserver_accept_options_default(&websocketserver_accept_options);
+                if (rc < 0) {
+                        return rc;
+                }
+                websocketserver_accept_options.enabled          = 1;
+                websocketserver_accept_options.message_mode     = g_peers[g_accepted].mode;
+                websocketserver_accept_options.max_message_size = g_peers[g_accepted].server_max;
+                websocketserver_accept_options.onevent          = websocketserver_client_onevent;
+                websocketserver_accept_options.context          = &g_peers[g_accepted];
+                websocketserver_client = medusa_websocketserver_accept_with_options(websocketserver, &websocketserver_accept_options);
+                if (MEDUSA_IS_ERR_OR_NULL(websocketserver_client)) {
+                        return MEDUSA_PTR_ERR(websocketserver_client);
+                }
+                g_accepted += 1;
+        }
+        return 0;
+}
+
+static int websocketclient_onevent (struct medusa_websocketclient *websocketclient, unsigned int events, void *context, void *param)
+{
+        int64_t rc;
+        unsigned int i;
+        struct peer *peer = (struct peer *) context;
+        if (events & MEDUSA_WEBSOCKETCLIENT_EVENT_CONNECTED) {
+                for (i = 0; i < sizeof(g_fragments) / sizeof(g_fragments[0]); i++) {
+                        rc = medusa_websocketclient_write(websocketclient,
+                                                          i == sizeof(g_fragments) / sizeof(g_fragments[0]) - 1,
+                                                          (i == 0) ? MEDUSA_WEBSOCKETCLIENT_FRAME_TYPE_TEXT : MEDUSA_WEBSOCKETCLIENT_FRAME_TYPE_CONTINUATION,
+                                                          g_fragments[i], strlen(g_fragments[i]));
+                        if (rc != (int64_t) strlen(g_fragments[i])) {
+                                g_errors += 1;
+                                return -1;
+                        }
+                }
+        }
+        if (events & MEDUSA_WEBSOCKETCLIENT_EVENT_MESSAGE_CHUNK) {
+                struct medusa_websocketclient_event_message_chunk *medusa_websocketclient_event_message_chunk = (struct medusa_websocketclient_event_message_chunk *) param;
+                if (peer->mode != MEDUSA_WEBSOCKETCLIENT_MESSAGE_MODE_STREAM ||
+                    medusa_websocketclient_event_message_chunk->type != MEDUSA_WEBSOCKETCLIENT_FRAME_TYPE_TEXT) {
+                        g_errors += 1;
+                        return 0;
+                }
+                side_chunk(&peer->client,
+                           medusa_websocketclient_event_message_chunk->final,
+                           medusa_websocketclient_event_message_chunk->offset,
+                           medusa_websocketclient_event_message_chunk->length,
+                           medusa_websocketclient_event_message_chunk->payload);
+        }
+        if (events & MEDUSA_WEBSOCKETCLIENT_EVENT_MESSAGE) {
+                struct medusa_websocketclient_event_message *medusa_websocketclient_event_message = (struct medusa_websocketclient_event_message *) param;
+                if (peer->mode != MEDUSA_WEBSOCKETCLIENT_MESSAGE_MODE_ASSEMBLE ||
+                    medusa_websocketclient_event_message->type != MEDUSA_WEBSOCKETCLIENT_FRAME_TYPE_TEXT) {
+                        g_errors += 1;
+                        return 0;
+                }
+                side_message(&peer->client,
+                             medusa_websocketclient_event_message->final,
+                             medusa_websocketclient_event_message->length,
+                             medusa_websocketclient_event_message->payload);
+        }
+        if (events & MEDUSA_WEBSOCKETCLIENT_EVENT_ERROR) {
+                struct medusa_websocketclient_event_error *medusa_websocketclient_event_error = (struct medusa_websocketclient_event_error *) param;
+                peer->client.error = medusa_websocketclient_event_error->error;
+        }
+        if (events & MEDUSA_WEBSOCKETCLIENT_EVENT_DISCONNECTED) {
+                peer->client.closed = 1;
+        }
+        return 0;
+}
+
+static int test_done (void)
+{
+        return g_peers[0].client.messages == 1 &&
+               g_peers[1].client.messages == 1 &&
+               g_peers[2].server.error == 1 && (g_peers[2].client.closed || g_peers[2].client.error) &&
+               g_peers[3].client.error != 0;
+}
+
+static int test_check (void)
+{
+        /* stream mode hands out at least one chunk per fragment */
+        if (g_peers[0].server.chunks < 3 || g_peers[0].server.messages != 1 ||
+            g_peers[0].client.chunks < 3 || g_peers[0].client.messages != 1) {
+                return -1;
+        }
+        /* assembled mode collects the continuations into one message */
+        if (g_peers[1].server.chunks != 0 || g_peers[1].server.messages != 1 ||
+            g_peers[1].client.chunks != 0 || g_peers[1].client.messages != 1 ||
+            g_peers[1].client.error != 0 || g_peers[1].client.closed != 0) {
+                return -1;
+        }
+        /* the limit is enforced on the assembled length, not per frame */
+        if (g_peers[2].server.messages != 0) {
+                return -1;
+        }
+        if (g_peers[3].server.messages != 1 ||
+            g_peers[3].client.messages != 0 ||
+            g_peers[3].client.error != EMSGSIZE) {
+                return -1;
+        }
+        return 0;
+}
+
+static int test_poll (unsigned int poll)
+{
+        int rc;
+        int port;
+        unsigned int i;
+
+        struct medusa_monitor *monitor;
+        struct medusa_monitor_init_options monitor_init_options;
+
+        struct medusa_websocketserver *websocketserver;
+        struct medusa_websocketserver_init_options websocketserver_init_options;
+
+        struct medusa_websocketclient *websocketclient;
+        struct medusa_websocketclient_connect_options websocketclient_connect_options;
+
+        monitor = NULL;
+
+        g_errors   = 0;
+        g_accepted = 0;
+        memcpy(g_peers, g_setup, sizeof(g_peers));
+
+        medusa_monitor_init_options_default(&monitor_init_options);
+        monitor_init_options.poll.type = poll;
+
+        monitor = medusa_monitor_create_with_options(&monitor_init_options);
+        if (monitor == NULL) {
+                goto bail;
+        }
+
+        rc = medusa_websocketserver_init_options_default(&websocketserver_init_options);
+        if (rc < 0) {
+                goto bail;
+        }
+        websocketserver_init_options.monitor   = monitor;
+        websocketserver_init_options.protocol  = MEDUSA_WEBSOCKETSERVER_PROTOCOL_IPV4;
+        websocketserver_init_options.address   = "127.0.0.1";
+        websocketserver_init_options.port      = 0;
+        websocketserver_init_options.reuseport = 0;
+        websocketserver_init_options.enabled   = 1;
+        websocketserver_init_options.started   = 1;
+        websocketserver_init_options.onevent   = websocketserver_onevent;
+        websocketserver_init_options.context   = NULL;
+        websocketserver = medusa_websocketserver_create_with_options(&websocketserver_init_options);
+        if (MEDUSA_IS_ERR_OR_NULL(websocketserver)) {
+                goto bail;
+        }
+        port = medusa_websocketserver_get_sockport(websocketserver);
+        if (port <= 0) {
+                goto bail;
+        }
+        fprintf(stderr, "  port: %d\n", port);
+
+        /* one at a time, so accept order matches the setup table */
+        for (i = 0; i < CLIENTS; i++) {
+                rc = medusa_websocketclient_connect_options_default(&websocketclient_connect_options);
+                if (rc < 0) {
+                        goto bail;
+                }
+                websocketclient_connect_options.monitor          = monitor;
+                websocketclient_connect_options.protocol         = MEDUSA_WEBSOCKETCLIENT_PROTOCOL_IPV4;
+                websocketclient_connect_options.address          = "127.0.0.1";
+                websocketclient_connect_options.port             = port;
+                websocketclient_connect_options.server_path      = "/";
+                websocketclient_connect_options.server_protocol  = "test";
+                websocketclient_connect_options.message_mode     = g_peers[i].mode;
+                websocketclient_connect_options.max_message_size = g_peers[i].client_max;
+                websocketclient_connect_options.enabled          = 1;
+                websocketclient_connect_options.onevent          = websocketclient_onevent;
+                websocketclient_connect_options.context          = &g_peers[i];
+                websocketclient = medusa_websocketclient_connect_with_options(&websocketclient_connect_options);
+                if (MEDUSA_IS_ERR_OR_NULL(websocketclient)) {
+                        goto bail;
+                }
+                while (g_accepted != i + 1) {
+                        rc = medusa_monitor_run_timeout(monitor, 1.0);
+                        if (rc < 0) {
+                                goto bail;
+                        }
+                }
+        }
+
+        while (!test_done()) {
+                rc = medusa_monitor_run_timeout(monitor, 1.0);
+                if (rc < 0) {
+                        goto bail;
+                }
+                if (g_errors != 0) {
+                        goto bail;
+                }
+        }
+        for (i = 0; i < CLIENTS; i++) {
+                fprintf(stderr, "  %u: server chunks: %u, messages: %u, error: %u, client chunks: %u, messages: %u, error: %u\n",
+                        i,
+                        g_peers[i].server.chunks, g_peers[i].server.messages, g_peers[i].server.error,
+                        g_peers[i].client.chunks, g_peers[i].client.messages, g_peers[i].client.error);
+        }
+        rc = test_check();
+        if (rc < 0) {
+                goto bail;
+        }
+
+        medusa_monitor_destroy(monitor);
+        return 0;
+bail:   if (monitor != NULL) {
+                medusa_monitor_destroy(monitor);
+        }
+        return -1;
+}
+
+static void alarm_handler (int sig)
+{
+        (void) sig;
+        abort();
+}
+
+int main (int argc, char *argv[])
+{
+        int rc;
+        unsigned int i;
+
+        (void) argc;
+        (void) argv;
+
+        srand(time(NULL));
+        signal(SIGALRM, alarm_handler);
+        signal(SIGPIPE, SIG_IGN);
+
+        for (i = 0; i < sizeof(g_polls) / sizeof(g_polls[0]); i++) {
+                alarm(5);
+                fprintf(stderr, "testing poll: %d\n", g_polls[i]);
+                rc = test_poll(g_polls[i]);
+                if (rc != 0) {
+                        fprintf(stderr, "poll: %d test failed\n", g_polls[i]);
+                        return -1;
+                }
+        }
+        return 0;
+}